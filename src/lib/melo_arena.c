@@ -0,0 +1,273 @@
+/*
+ * melo_arena.c: Request-scoped memory arena
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "melo_arena.h"
+
+/**
+ * SECTION:melo_arena
+ * @title: MeloArena
+ * @short_description: Request-scoped memory arena
+ *
+ * #MeloArena is a simple bump allocator to reduce the number of small
+ * allocations done while building a result, as a browser list: the memory is
+ * taken from large blocks and it is released in a single operation with
+ * melo_arena_free(). An allocation cannot be freed individually.
+ *
+ * An arena is not thread-safe: it should be used by one thread at a time,
+ * typically the thread handling the request.
+ */
+
+/* Default size of a block (in bytes) */
+#define MELO_ARENA_BLOCK_SIZE 4096
+
+/* Alignment of allocations */
+#define MELO_ARENA_ALIGN (2 * sizeof (gpointer))
+
+typedef struct _MeloArenaBlock MeloArenaBlock;
+
+struct _MeloArenaBlock {
+  MeloArenaBlock *next;
+  gsize size;
+  gsize used;
+};
+
+struct _MeloArena {
+  MeloArenaBlock *blocks;
+  gsize block_size;
+  gsize size;
+};
+
+/* Size of block header, data is aligned after it */
+#define MELO_ARENA_HEADER_SIZE \
+  ((sizeof (MeloArenaBlock) + MELO_ARENA_ALIGN - 1) & ~(MELO_ARENA_ALIGN - 1))
+#define MELO_ARENA_BLOCK_DATA(b) ((guint8 *) (b) + MELO_ARENA_HEADER_SIZE)
+
+/**
+ * melo_arena_new:
+ * @block_size: the size of the blocks (in bytes), or 0 for default size
+ *
+ * Create a new arena. The first block is allocated with the first allocation.
+ *
+ * Returns: (transfer full): a new #MeloArena. Use melo_arena_free() after
+ * usage.
+ */
+MeloArena *
+melo_arena_new (gsize block_size)
+{
+  MeloArena *arena;
+
+  arena = g_slice_new0 (MeloArena);
+  arena->block_size = block_size ? block_size : MELO_ARENA_BLOCK_SIZE;
+
+  return arena;
+}
+
+/**
+ * melo_arena_free:
+ * @arena: the arena
+ *
+ * Release all the memory allocated from @arena and free it.
+ */
+void
+melo_arena_free (MeloArena *arena)
+{
+  MeloArenaBlock *b, *next;
+
+  if (!arena)
+    return;
+
+  /* Free all blocks */
+  for (b = arena->blocks; b != NULL; b = next) {
+    next = b->next;
+    g_free (b);
+  }
+  g_slice_free (MeloArena, arena);
+}
+
+static MeloArenaBlock *
+melo_arena_block_new (MeloArena *arena, gsize size)
+{
+  MeloArenaBlock *b;
+
+  /* Allocate block */
+  b = g_malloc (MELO_ARENA_HEADER_SIZE + size);
+  b->size = size;
+  b->used = 0;
+  arena->size += size;
+
+  return b;
+}
+
+/**
+ * melo_arena_alloc:
+ * @arena: the arena
+ * @size: the number of bytes to allocate
+ *
+ * Allocate @size bytes from @arena. The memory is not initialized and it is
+ * released with melo_arena_free().
+ *
+ * Returns: a pointer to the allocated memory.
+ */
+gpointer
+melo_arena_alloc (MeloArena *arena, gsize size)
+{
+  MeloArenaBlock *b = arena->blocks;
+  gpointer ptr;
+
+  /* Align size */
+  size = (size + MELO_ARENA_ALIGN - 1) & ~(MELO_ARENA_ALIGN - 1);
+
+  /* Allocate from current block */
+  if (b && b->size - b->used >= size) {
+    ptr = MELO_ARENA_BLOCK_DATA (b) + b->used;
+    b->used += size;
+    return ptr;
+  }
+
+  /* Large allocation: use a dedicated block and keep current block */
+  if (size > arena->block_size / 4) {
+    MeloArenaBlock *large;
+
+    large = melo_arena_block_new (arena, size);
+    large->used = size;
+    if (b) {
+      large->next = b->next;
+      b->next = large;
+    } else {
+      large->next = NULL;
+      arena->blocks = large;
+    }
+    return MELO_ARENA_BLOCK_DATA (large);
+  }
+
+  /* Add a new block */
+  b = melo_arena_block_new (arena, arena->block_size);
+  b->next = arena->blocks;
+  arena->blocks = b;
+  b->used = size;
+
+  return MELO_ARENA_BLOCK_DATA (b);
+}
+
+/**
+ * melo_arena_alloc0:
+ * @arena: the arena
+ * @size: the number of bytes to allocate
+ *
+ * Allocate @size bytes from @arena, initialized to 0.
+ *
+ * Returns: a pointer to the allocated memory.
+ */
+gpointer
+melo_arena_alloc0 (MeloArena *arena, gsize size)
+{
+  return memset (melo_arena_alloc (arena, size), 0, size);
+}
+
+/**
+ * melo_arena_strdup:
+ * @arena: the arena
+ * @str: (allow-none): the string to duplicate
+ *
+ * Duplicate a string in @arena.
+ *
+ * Returns: a copy of @str allocated from @arena, or %NULL if @str is %NULL.
+ */
+gchar *
+melo_arena_strdup (MeloArena *arena, const gchar *str)
+{
+  gsize len;
+
+  if (!str)
+    return NULL;
+
+  len = strlen (str) + 1;
+  return memcpy (melo_arena_alloc (arena, len), str, len);
+}
+
+/**
+ * melo_arena_strdup_printf:
+ * @arena: the arena
+ * @format: a standard printf() format string
+ * @...: the parameters to insert into the format string
+ *
+ * Format a new string in @arena, as g_strdup_printf().
+ *
+ * Returns: a new string allocated from @arena.
+ */
+gchar *
+melo_arena_strdup_printf (MeloArena *arena, const gchar *format, ...)
+{
+  va_list args;
+  gchar *str;
+
+  va_start (args, format);
+  str = melo_arena_strdup_vprintf (arena, format, args);
+  va_end (args);
+
+  return str;
+}
+
+/**
+ * melo_arena_strdup_vprintf:
+ * @arena: the arena
+ * @format: a standard printf() format string
+ * @args: the list of parameters to insert into the format string
+ *
+ * Format a new string in @arena, as g_strdup_vprintf().
+ *
+ * Returns: a new string allocated from @arena.
+ */
+gchar *
+melo_arena_strdup_vprintf (MeloArena *arena, const gchar *format,
+                           va_list args)
+{
+  va_list copy;
+  gchar *str;
+  gint len;
+
+  /* Get string length */
+  G_VA_COPY (copy, args);
+  len = g_vsnprintf (NULL, 0, format, copy);
+  va_end (copy);
+
+  /* Format string */
+  str = melo_arena_alloc (arena, len + 1);
+  g_vsnprintf (str, len + 1, format, args);
+
+  return str;
+}
+
+/**
+ * melo_arena_get_size:
+ * @arena: the arena
+ *
+ * Get the memory held by @arena, for memory accounting.
+ *
+ * Returns: the size of all blocks of @arena (in bytes).
+ */
+gsize
+melo_arena_get_size (MeloArena *arena)
+{
+  return arena->size;
+}
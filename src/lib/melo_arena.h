@@ -0,0 +1,54 @@
+/*
+ * melo_arena.h: Request-scoped memory arena
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __MELO_ARENA_H__
+#define __MELO_ARENA_H__
+
+#include <glib.h>
+
+typedef struct _MeloArena MeloArena;
+
+MeloArena *melo_arena_new (gsize block_size);
+void melo_arena_free (MeloArena *arena);
+
+gpointer melo_arena_alloc (MeloArena *arena, gsize size);
+gpointer melo_arena_alloc0 (MeloArena *arena, gsize size);
+gchar *melo_arena_strdup (MeloArena *arena, const gchar *str);
+gchar *melo_arena_strdup_printf (MeloArena *arena, const gchar *format,
+                                 ...) G_GNUC_PRINTF (2, 3);
+gchar *melo_arena_strdup_vprintf (MeloArena *arena, const gchar *format,
+                                  va_list args) G_GNUC_PRINTF (2, 0);
+
+gsize melo_arena_get_size (MeloArena *arena);
+
+/**
+ * melo_arena_new0:
+ * @arena: the arena
+ * @type: the type of the structure to allocate
+ *
+ * Allocate a zero-filled structure of type @type from @arena.
+ *
+ * Returns: a pointer to the new structure, cast to @type.
+ */
+#define melo_arena_new0(arena, type) \
+  ((type *) melo_arena_alloc0 ((arena), sizeof (type)))
+
+#endif /* __MELO_ARENA_H__ */
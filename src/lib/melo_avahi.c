@@ -26,6 +26,7 @@
 #include <avahi-client/publish.h>
 #include <avahi-client/lookup.h>
 
+#include "melo_event.h"
 #include "melo_avahi.h"
 
 /**
@@ -36,6 +37,14 @@
  * #MeloAvahi is intended to help Zeroconf / mDNS service registration for
  * any sub-module of Melo. It also do discovering in order to list a specific
  * service type on the network.
+ *
+ * The discovered services are kept in a cache indexed by name, type and
+ * interface. Each change of the cache is notified with the
+ * #MeloAvahi::service-added, #MeloAvahi::service-updated and
+ * #MeloAvahi::service-removed signals, and with a #MELO_EVENT_TYPE_SERVICE
+ * event. A generation counter, retrieved with melo_avahi_get_generation(), is
+ * also incremented on each change, so a caller polling the service list only
+ * needs to copy it with melo_avahi_list_services() when it has changed.
  */
 
 /* Common avahi client */
@@ -49,9 +58,22 @@ struct _MeloAvahiPrivate {
   GList *pservices;
   /* Service browser */
   GHashTable *browsers;
-  GList *bservices;
+  GHashTable *bservices;
+  guint generation;
+};
+
+enum {
+  SERVICE_ADDED,
+  SERVICE_UPDATED,
+  SERVICE_REMOVED,
+  LAST_SIGNAL
 };
 
+static guint melo_avahi_signals[LAST_SIGNAL];
+
+static guint melo_avahi_service_hash (gconstpointer key);
+static gboolean melo_avahi_service_equal (gconstpointer a, gconstpointer b);
+
 G_DEFINE_TYPE_WITH_PRIVATE (MeloAvahi, melo_avahi, G_TYPE_OBJECT)
 
 static void
@@ -70,7 +92,7 @@ melo_avahi_finalize (GObject *gobject)
 
   /* Free service list */
   g_list_free_full (priv->pservices, (GDestroyNotify) melo_avahi_service_free);
-  g_list_free_full (priv->bservices, (GDestroyNotify) melo_avahi_service_free);
+  g_hash_table_unref (priv->bservices);
 
   /* Lock avahi client */
   G_LOCK (melo_avahi_mutex);
@@ -96,6 +118,43 @@ melo_avahi_class_init (MeloAvahiClass *klass)
 
   /* Add custom finalize() function */
   object_class->finalize = melo_avahi_finalize;
+
+  /**
+   * MeloAvahi::service-added:
+   * @avahi: the avahi object
+   * @service: the #MeloAvahiService discovered
+   *
+   * Will be emitted when a new service has been discovered and resolved.
+   */
+  melo_avahi_signals[SERVICE_ADDED] =
+    g_signal_new ("service-added", G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_FIRST, 0, NULL, NULL, NULL, G_TYPE_NONE, 1,
+                  G_TYPE_POINTER);
+
+  /**
+   * MeloAvahi::service-updated:
+   * @avahi: the avahi object
+   * @service: the #MeloAvahiService updated
+   *
+   * Will be emitted when the port, the address or the TXT record of a service
+   * has changed.
+   */
+  melo_avahi_signals[SERVICE_UPDATED] =
+    g_signal_new ("service-updated", G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_FIRST, 0, NULL, NULL, NULL, G_TYPE_NONE, 1,
+                  G_TYPE_POINTER);
+
+  /**
+   * MeloAvahi::service-removed:
+   * @avahi: the avahi object
+   * @service: the #MeloAvahiService removed
+   *
+   * Will be emitted when a service has disappeared, before it is freed.
+   */
+  melo_avahi_signals[SERVICE_REMOVED] =
+    g_signal_new ("service-removed", G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_FIRST, 0, NULL, NULL, NULL, G_TYPE_NONE, 1,
+                  G_TYPE_POINTER);
 }
 
 static void
@@ -108,6 +167,12 @@ melo_avahi_init (MeloAvahi *self)
   /* Init mutex */
   g_mutex_init (&priv->mutex);
 
+  /* Create service cache */
+  priv->bservices = g_hash_table_new_full (melo_avahi_service_hash,
+                                      melo_avahi_service_equal,
+                                      (GDestroyNotify) melo_avahi_service_free,
+                                      NULL);
+
   /* Lock avahi client */
   G_LOCK (melo_avahi_mutex);
 
@@ -203,6 +268,20 @@ melo_avahi_service_cmp (const MeloAvahiService *a, const MeloAvahiService *b)
          a->iface != b->iface;
 }
 
+static guint
+melo_avahi_service_hash (gconstpointer key)
+{
+  const MeloAvahiService *s = key;
+
+  return (g_str_hash (s->name) * 31 + g_str_hash (s->type)) * 31 + s->iface;
+}
+
+static gboolean
+melo_avahi_service_equal (gconstpointer a, gconstpointer b)
+{
+  return !melo_avahi_service_cmp (a, b);
+}
+
 /**
  * melo_avahi_service_get_txt:
  * @s: an avahi service
@@ -415,6 +494,27 @@ melo_avahi_remove_service (MeloAvahi *avahi, const MeloAvahiService *service)
   melo_avahi_update_group (melo_avahi_client->avahi_client, priv);
 }
 
+static void
+melo_avahi_notify (MeloAvahi *avahi, guint signal,
+                   const MeloAvahiService *service)
+{
+  /* Emit signal */
+  g_signal_emit (avahi, melo_avahi_signals[signal], 0, service);
+
+  /* Send event */
+  switch (signal) {
+    case SERVICE_ADDED:
+      melo_event_service_add (service->type, service);
+      break;
+    case SERVICE_UPDATED:
+      melo_event_service_update (service->type, service);
+      break;
+    case SERVICE_REMOVED:
+      melo_event_service_remove (service->type, service);
+      break;
+  }
+}
+
 static void
 melo_avahi_resolve_callback (AvahiServiceResolver *ar, AvahiIfIndex interface,
                              AvahiProtocol protocol, AvahiResolverEvent event,
@@ -429,19 +529,26 @@ melo_avahi_resolve_callback (AvahiServiceResolver *ar, AvahiIfIndex interface,
     .type = (gchar *) type,
     .iface = interface,
   };
-  MeloAvahiPrivate *priv = (MeloAvahiPrivate *) userdata;
+  MeloAvahi *avahi = (MeloAvahi *) userdata;
+  MeloAvahiPrivate *priv = avahi->priv;
   MeloAvahiService *s;
-  GList *l;
+  unsigned char ip[4];
+  guint signal;
 
   switch (event) {
     case AVAHI_RESOLVER_FOUND:
+      /* Get address */
+      ip[0] = address->data.ipv4.address;
+      ip[1] = address->data.ipv4.address >> 8;
+      ip[2] = address->data.ipv4.address >> 16;
+      ip[3] = address->data.ipv4.address >> 24;
+
       /* Lock services list */
       g_mutex_lock (&priv->mutex);
 
       /* Find service record */
-      l = g_list_find_custom (priv->bservices, &service,
-                              (GCompareFunc) melo_avahi_service_cmp);
-      if (!l) {
+      s = g_hash_table_lookup (priv->bservices, &service);
+      if (!s) {
         /* Create new service */
         s = g_slice_new0 (MeloAvahiService);
         if (!s) {
@@ -453,22 +560,32 @@ melo_avahi_resolve_callback (AvahiServiceResolver *ar, AvahiIfIndex interface,
         s->type = g_strdup (type);
         s->iface = interface;
         /* Add new service */
-        priv->bservices = g_list_prepend (priv->bservices, s);
-      } else {
-        s = (MeloAvahiService *) l->data;
-      }
+        g_hash_table_add (priv->bservices, s);
+        signal = SERVICE_ADDED;
+      } else if (s->port == port && !memcmp (s->ip, ip, 4) &&
+                 avahi_string_list_equal (s->txt, txt)) {
+        /* Service has not changed */
+        g_mutex_unlock (&priv->mutex);
+        goto end;
+      } else
+        signal = SERVICE_UPDATED;
 
       /* Update service */
       avahi_string_list_free (s->txt);
       s->txt = txt ? avahi_string_list_copy (txt) : NULL;
       s->port = port;
-      s->ip[0] = address->data.ipv4.address;
-      s->ip[1] = address->data.ipv4.address >> 8;
-      s->ip[2] = address->data.ipv4.address >> 16;
-      s->ip[3] = address->data.ipv4.address >> 24;
+      memcpy (s->ip, ip, 4);
+      g_atomic_int_inc (&priv->generation);
+
+      /* Copy service to notify outside of lock */
+      s = melo_avahi_service_copy (s);
 
       /* Unlock services list */
       g_mutex_unlock (&priv->mutex);
+
+      /* Notify change */
+      melo_avahi_notify (avahi, signal, s);
+      melo_avahi_service_free (s);
       break;
     case AVAHI_RESOLVER_FAILURE:
       break;
@@ -491,8 +608,9 @@ melo_avahi_browser_callback (AvahiServiceBrowser *ab, AvahiIfIndex interface,
     .type = (gchar *) type,
     .iface = interface,
   };
-  MeloAvahiPrivate *priv = (MeloAvahiPrivate *) userdata;
-  GList *l;
+  MeloAvahi *avahi = (MeloAvahi *) userdata;
+  MeloAvahiPrivate *priv = avahi->priv;
+  gpointer s = NULL;
 
   switch (event) {
     case AVAHI_BROWSER_NEW:
@@ -506,20 +624,20 @@ melo_avahi_browser_callback (AvahiServiceBrowser *ab, AvahiIfIndex interface,
       /* Lock services list */
       g_mutex_lock (&priv->mutex);
 
-      /* Remove service from list */
-      l = priv->bservices;
-      while  (l != NULL) {
-        GList *next = l->next;
-        if (!melo_avahi_service_cmp (&service, (MeloAvahiService *) l->data)) {
-          melo_avahi_service_free ((MeloAvahiService *) l->data);
-          priv->bservices = g_list_delete_link (priv->bservices, l);
-        }
-        l = next;
+      /* Remove service from cache */
+      if (g_hash_table_lookup_extended (priv->bservices, &service, &s, NULL)) {
+        g_hash_table_steal (priv->bservices, s);
+        g_atomic_int_inc (&priv->generation);
       }
 
       /* Unlock services list */
       g_mutex_unlock (&priv->mutex);
 
+      /* Notify removal */
+      if (s) {
+        melo_avahi_notify (avahi, SERVICE_REMOVED, s);
+        melo_avahi_service_free (s);
+      }
       break;
     case AVAHI_BROWSER_ALL_FOR_NOW:
     case AVAHI_BROWSER_CACHE_EXHAUSTED:
@@ -568,7 +686,7 @@ melo_avahi_add_browser (MeloAvahi *avahi, const gchar *type)
   ab = avahi_service_browser_new (melo_avahi_client->avahi_client,
                                   AVAHI_IF_UNSPEC, AVAHI_PROTO_UNSPEC, type,
                                   NULL, 0, melo_avahi_browser_callback,
-                                  priv);
+                                  avahi);
   if (!ab)
     return FALSE;
 
@@ -585,12 +703,6 @@ unlock:
   return TRUE;
 }
 
-static gpointer
-melo_avahi_service_list_copy (gconstpointer src, gpointer data)
-{
-  return melo_avahi_service_copy ((MeloAvahiService *) src);
-}
-
 /**
  * melo_avahi_list_services:
  * @avahi: the avahi object
@@ -599,6 +711,10 @@ melo_avahi_service_list_copy (gconstpointer src, gpointer data)
  * available on the network with a service type for which a browser has been
  * added with melo_avahi_add_browser().
  *
+ * To avoid copying the list when nothing has changed, the caller can compare
+ * the value returned by melo_avahi_get_generation() with the one of its
+ * previous call.
+ *
  * Returns: (transfer full): a #GList of #MeloAvahiService available. You must
  * free list and its data when you are done with it. You can use
  * g_list_free_full() with melo_avahi_service_free() to do this.
@@ -607,8 +723,37 @@ GList *
 melo_avahi_list_services (MeloAvahi *avahi)
 {
   MeloAvahiPrivate *priv = avahi->priv;
+  GHashTableIter iter;
+  GList *list = NULL;
+  gpointer s;
 
-  return g_list_copy_deep (priv->bservices, melo_avahi_service_list_copy, NULL);
+  /* Lock services list */
+  g_mutex_lock (&priv->mutex);
+
+  /* Copy services */
+  g_hash_table_iter_init (&iter, priv->bservices);
+  while (g_hash_table_iter_next (&iter, &s, NULL))
+    list = g_list_prepend (list, melo_avahi_service_copy (s));
+
+  /* Unlock services list */
+  g_mutex_unlock (&priv->mutex);
+
+  return list;
+}
+
+/**
+ * melo_avahi_get_generation:
+ * @avahi: the avahi object
+ *
+ * Get the generation of the discovered service list: it is incremented each
+ * time a service is added, updated or removed.
+ *
+ * Returns: the current generation of the service list.
+ */
+guint
+melo_avahi_get_generation (MeloAvahi *avahi)
+{
+  return g_atomic_int_get (&avahi->priv->generation);
 }
 
 /**
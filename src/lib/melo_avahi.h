@@ -102,6 +102,7 @@ void melo_avahi_remove_service (MeloAvahi *avahi,
 /* Service browser */
 gboolean melo_avahi_add_browser (MeloAvahi *avahi, const gchar *type);
 GList *melo_avahi_list_services (MeloAvahi *avahi);
+guint melo_avahi_get_generation (MeloAvahi *avahi);
 void melo_avahi_remove_browser (MeloAvahi *avahi, const gchar *type);
 
 gchar *melo_avahi_service_get_txt (const MeloAvahiService *s, const gchar *key);
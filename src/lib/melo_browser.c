@@ -20,6 +20,7 @@
  */
 
 #include "melo_browser.h"
+#include "melo_plugin.h"
 
 /**
  * SECTION:melo_browser
@@ -57,8 +58,33 @@ G_LOCK_DEFINE_STATIC (melo_browser_mutex);
 static GHashTable *melo_browser_hash = NULL;
 static GList *melo_browser_list = NULL;
 
+/* Prefetch of next pages: lifetime of a prefetched page (in us), maximal count
+ * of pages kept and maximal count of pending prefetches
+ */
+#define MELO_BROWSER_PREFETCH_TTL (10 * G_USEC_PER_SEC)
+#define MELO_BROWSER_PREFETCH_MAX 16
+#define MELO_BROWSER_PREFETCH_QUEUE 4
+
+typedef struct {
+  MeloBrowserList *list;
+  gint64 time;
+} MeloBrowserPrefetch;
+
+typedef struct {
+  MeloBrowser *browser;
+  gchar *key;
+  gchar *path;
+  gchar *token;
+  MeloBrowserGetListParams params;
+} MeloBrowserPrefetchJob;
+
+G_LOCK_DEFINE_STATIC (melo_browser_prefetch_mutex);
+static GHashTable *melo_browser_prefetch_hash = NULL;
+static GThreadPool *melo_browser_prefetch_pool = NULL;
+
 struct _MeloBrowserPrivate {
   gchar *id;
+  gboolean prefetch;
 };
 
 enum {
@@ -74,6 +100,171 @@ static void melo_browser_get_property (GObject *object, guint property_id,
 
 G_DEFINE_ABSTRACT_TYPE_WITH_PRIVATE (MeloBrowser, melo_browser, G_TYPE_OBJECT)
 
+/* Default asynchronous implementations: the synchronous virtual methods are
+ * called from a thread, with the cancellable set as current (see
+ * g_cancellable_get_current()). The task returns as soon as it is cancelled,
+ * even if the synchronous call is still running.
+ */
+typedef enum {
+  MELO_BROWSER_ASYNC_GET_LIST,
+  MELO_BROWSER_ASYNC_SEARCH,
+  MELO_BROWSER_ASYNC_GET_TAGS,
+} MeloBrowserAsyncType;
+
+typedef struct {
+  MeloBrowserAsyncType type;
+  gchar *path;
+  gchar *token;
+  MeloBrowserGetListParams params;
+  MeloTagsFields fields;
+} MeloBrowserAsyncData;
+
+static void
+melo_browser_async_data_free (gpointer data)
+{
+  MeloBrowserAsyncData *d = data;
+
+  g_free (d->path);
+  g_free (d->token);
+  g_slice_free (MeloBrowserAsyncData, d);
+}
+
+static void
+melo_browser_async_thread (GTask *task, gpointer source_object,
+                           gpointer task_data, GCancellable *cancellable)
+{
+  MeloBrowserClass *bclass = MELO_BROWSER_GET_CLASS (source_object);
+  MeloBrowser *browser = MELO_BROWSER (source_object);
+  MeloBrowserAsyncData *d = task_data;
+  gpointer ret = NULL;
+
+  /* Make cancellable available to synchronous implementation */
+  if (cancellable)
+    g_cancellable_push_current (cancellable);
+
+  /* Call synchronous implementation */
+  switch (d->type) {
+    case MELO_BROWSER_ASYNC_GET_LIST:
+      if (bclass->get_list)
+        ret = melo_browser_get_list (browser, d->path, &d->params);
+      break;
+    case MELO_BROWSER_ASYNC_SEARCH:
+      if (bclass->search)
+        ret = bclass->search (browser, d->path, &d->params);
+      break;
+    case MELO_BROWSER_ASYNC_GET_TAGS:
+      if (bclass->get_tags)
+        ret = bclass->get_tags (browser, d->path, d->fields);
+      break;
+  }
+
+  if (cancellable)
+    g_cancellable_pop_current (cancellable);
+
+  /* Return result: it is released if task has already returned */
+  if (ret)
+    g_task_return_pointer (task, ret,
+                           d->type == MELO_BROWSER_ASYNC_GET_TAGS ?
+                             (GDestroyNotify) melo_tags_unref :
+                             (GDestroyNotify) melo_browser_list_free);
+  else if (!g_task_return_error_if_cancelled (task))
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                             "No result available");
+}
+
+static void
+melo_browser_async_run (MeloBrowser *browser, MeloBrowserAsyncData *d,
+                        GCancellable *cancellable, GAsyncReadyCallback callback,
+                        gpointer user_data)
+{
+  GTask *task;
+
+  /* Create task */
+  task = g_task_new (browser, cancellable, callback, user_data);
+  g_task_set_task_data (task, d, melo_browser_async_data_free);
+  g_task_set_return_on_cancel (task, TRUE);
+
+  /* Run in thread */
+  g_task_run_in_thread (task, melo_browser_async_thread);
+  g_object_unref (task);
+}
+
+static void
+melo_browser_real_list_async (MeloBrowser *browser, MeloBrowserAsyncType type,
+                              const gchar *path,
+                              const MeloBrowserGetListParams *params,
+                              GCancellable *cancellable,
+                              GAsyncReadyCallback callback, gpointer user_data)
+{
+  MeloBrowserAsyncData *d;
+
+  /* Copy parameters */
+  d = g_slice_new0 (MeloBrowserAsyncData);
+  d->type = type;
+  d->path = g_strdup (path);
+  if (params) {
+    d->params = *params;
+    d->token = g_strdup (params->token);
+    d->params.token = d->token;
+  }
+
+  melo_browser_async_run (browser, d, cancellable, callback, user_data);
+}
+
+static void
+melo_browser_real_get_list_async (MeloBrowser *browser, const gchar *path,
+                                  const MeloBrowserGetListParams *params,
+                                  GCancellable *cancellable,
+                                  GAsyncReadyCallback callback,
+                                  gpointer user_data)
+{
+  melo_browser_real_list_async (browser, MELO_BROWSER_ASYNC_GET_LIST, path,
+                                params, cancellable, callback, user_data);
+}
+
+static void
+melo_browser_real_search_async (MeloBrowser *browser, const gchar *input,
+                                const MeloBrowserSearchParams *params,
+                                GCancellable *cancellable,
+                                GAsyncReadyCallback callback,
+                                gpointer user_data)
+{
+  melo_browser_real_list_async (browser, MELO_BROWSER_ASYNC_SEARCH, input,
+                                params, cancellable, callback, user_data);
+}
+
+static MeloBrowserList *
+melo_browser_real_list_finish (MeloBrowser *browser, GAsyncResult *result,
+                               GError **error)
+{
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+static void
+melo_browser_real_get_tags_async (MeloBrowser *browser, const gchar *path,
+                                  MeloTagsFields fields,
+                                  GCancellable *cancellable,
+                                  GAsyncReadyCallback callback,
+                                  gpointer user_data)
+{
+  MeloBrowserAsyncData *d;
+
+  /* Copy parameters */
+  d = g_slice_new0 (MeloBrowserAsyncData);
+  d->type = MELO_BROWSER_ASYNC_GET_TAGS;
+  d->path = g_strdup (path);
+  d->fields = fields;
+
+  melo_browser_async_run (browser, d, cancellable, callback, user_data);
+}
+
+static MeloTags *
+melo_browser_real_get_tags_finish (MeloBrowser *browser, GAsyncResult *result,
+                                   GError **error)
+{
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
 static void
 melo_browser_finalize (GObject *gobject)
 {
@@ -90,6 +281,10 @@ melo_browser_finalize (GObject *gobject)
   /* Unlock browser list */
   G_UNLOCK (melo_browser_mutex);
 
+  /* Release prefetched pages */
+  if (priv->prefetch)
+    melo_browser_flush_prefetch (browser);
+
   if (priv->id)
     g_free (priv->id);
 
@@ -111,6 +306,14 @@ melo_browser_class_init (MeloBrowserClass *klass)
   object_class->set_property = melo_browser_set_property;
   object_class->get_property = melo_browser_get_property;
 
+  /* Default asynchronous implementations */
+  klass->get_list_async = melo_browser_real_get_list_async;
+  klass->get_list_finish = melo_browser_real_list_finish;
+  klass->search_async = melo_browser_real_search_async;
+  klass->search_finish = melo_browser_real_list_finish;
+  klass->get_tags_async = melo_browser_real_get_tags_async;
+  klass->get_tags_finish = melo_browser_real_get_tags_finish;
+
   /**
    * MeloBrowser:id:
    *
@@ -216,6 +419,14 @@ melo_browser_get_browser_by_id (const gchar *id)
   /* Find browser by id */
   bro = g_hash_table_lookup (melo_browser_hash, id);
 
+  /* Not found: activate plugin providing it and retry */
+  if (!bro) {
+    G_UNLOCK (melo_browser_mutex);
+    melo_plugin_activate (MELO_PLUGIN_PROVIDE_BROWSER, id);
+    G_LOCK (melo_browser_mutex);
+    bro = g_hash_table_lookup (melo_browser_hash, id);
+  }
+
   /* Increment reference count */
   if (bro)
     g_object_ref (bro);
@@ -226,6 +437,34 @@ melo_browser_get_browser_by_id (const gchar *id)
   return bro;
 }
 
+/**
+ * melo_browser_get_browser_list:
+ *
+ * Get a #GList of all #MeloBrowser instance registered.
+ *
+ * Returns: (transfer full): a #GList of all #MeloBrowser instance. You must
+ * free list and its data when you are done with it. You can use
+ * g_list_free_full() with g_object_unref() to do this.
+ */
+GList *
+melo_browser_get_browser_list (void)
+{
+  GList *list = NULL;
+
+  /* Lock browser list */
+  G_LOCK (melo_browser_mutex);
+
+  /* Copy list */
+  if (melo_browser_list)
+    list = g_list_copy_deep (melo_browser_list, (GCopyFunc) g_object_ref,
+                             NULL);
+
+  /* Unlock browser list */
+  G_UNLOCK (melo_browser_mutex);
+
+  return list;
+}
+
 /**
  * melo_browser_new:
  * @type: the type ID of the #MeloBrowser subtype to instantiate
@@ -311,6 +550,297 @@ melo_browser_get_player (MeloBrowser *browser)
   return g_object_ref (browser->player);
 }
 
+static void
+melo_browser_prefetch_free (gpointer data)
+{
+  MeloBrowserPrefetch *p = data;
+
+  if (p->list)
+    melo_browser_list_free (p->list);
+  g_slice_free (MeloBrowserPrefetch, p);
+}
+
+static gchar *
+melo_browser_prefetch_key (MeloBrowser *browser, const gchar *path,
+                           const MeloBrowserGetListParams *params, gint offset,
+                           const gchar *token)
+{
+  /* With a token, the offset is relative to the token position */
+  return g_strdup_printf ("%s\n%s\n%d\n%d\n%d\n%d\n%u\n%s",
+                          browser->priv->id, path ? path : "",
+                          token ? 0 : offset, params->count, params->sort,
+                          params->tags_mode, (guint) params->tags_fields,
+                          token ? token : "");
+}
+
+static void
+melo_browser_prefetch_cover (const gchar *id, GBytes *cover,
+                             gpointer user_data)
+{
+}
+
+static void
+melo_browser_prefetch_func (gpointer data, gpointer user_data)
+{
+  MeloBrowserPrefetchJob *job = data;
+  MeloBrowserClass *bclass = MELO_BROWSER_GET_CLASS (job->browser);
+  MeloBrowserPrefetch *p;
+  MeloBrowserList *list;
+  GList *l;
+
+  /* Get next page */
+  list = bclass->get_list (job->browser, job->path, &job->params);
+
+  /* Load covers of page into cover cache */
+  if (list) {
+    for (l = list->items; l != NULL; l = l->next) {
+      MeloBrowserItem *item = l->data;
+
+      if (item->tags && item->tags->cover)
+        melo_tags_get_cover_by_id_async (item->tags->cover,
+                                         melo_browser_prefetch_cover, NULL);
+    }
+  }
+
+  /* Store page, if still expected */
+  G_LOCK (melo_browser_prefetch_mutex);
+  p = g_hash_table_lookup (melo_browser_prefetch_hash, job->key);
+  if (p && !p->list) {
+    if (list) {
+      p->list = list;
+      p->time = g_get_monotonic_time ();
+      list = NULL;
+    } else
+      g_hash_table_remove (melo_browser_prefetch_hash, job->key);
+  }
+  G_UNLOCK (melo_browser_prefetch_mutex);
+
+  /* Free job */
+  if (list)
+    melo_browser_list_free (list);
+  g_object_unref (job->browser);
+  g_free (job->key);
+  g_free (job->path);
+  g_free (job->token);
+  g_slice_free (MeloBrowserPrefetchJob, job);
+}
+
+static gboolean
+melo_browser_prefetch_expired (gpointer key, gpointer value,
+                               gpointer user_data)
+{
+  MeloBrowserPrefetch *p = value;
+
+  return p->list && *((gint64 *) user_data) - p->time >=
+                    MELO_BROWSER_PREFETCH_TTL;
+}
+
+static MeloBrowserList *
+melo_browser_prefetch_take (MeloBrowser *browser, const gchar *path,
+                            const MeloBrowserGetListParams *params)
+{
+  MeloBrowserList *list = NULL;
+  MeloBrowserPrefetch *p;
+  gchar *key;
+
+  /* Find page */
+  key = melo_browser_prefetch_key (browser, path, params, params->offset,
+                                   params->token);
+  G_LOCK (melo_browser_prefetch_mutex);
+  if (melo_browser_prefetch_hash) {
+    p = g_hash_table_lookup (melo_browser_prefetch_hash, key);
+
+    /* Take page if still valid: a pending page is dropped since it is now
+     * fetched by caller
+     */
+    if (p) {
+      if (p->list &&
+          g_get_monotonic_time () - p->time < MELO_BROWSER_PREFETCH_TTL) {
+        list = p->list;
+        p->list = NULL;
+      }
+      g_hash_table_remove (melo_browser_prefetch_hash, key);
+    }
+  }
+  G_UNLOCK (melo_browser_prefetch_mutex);
+  g_free (key);
+
+  return list;
+}
+
+static void
+melo_browser_prefetch_next (MeloBrowser *browser, const gchar *path,
+                            const MeloBrowserGetListParams *params,
+                            const MeloBrowserList *list)
+{
+  const gchar *token = params->token;
+  MeloBrowserPrefetchJob *job;
+  MeloBrowserPrefetch *p;
+  gint64 now;
+  gchar *key;
+
+  /* Last page reached */
+  if (params->count <= 0 ||
+      (!list->next_token &&
+       g_list_length (list->items) < (guint) params->count))
+    return;
+
+  /* Generate key of next page: use cursor when provided */
+  if (list->next_token)
+    token = list->next_token;
+  key = melo_browser_prefetch_key (browser, path, params,
+                                   params->offset + params->count, token);
+
+  G_LOCK (melo_browser_prefetch_mutex);
+
+  /* Create cache and low priority thread pool */
+  if (!melo_browser_prefetch_hash)
+    melo_browser_prefetch_hash = g_hash_table_new_full (g_str_hash,
+                                                     g_str_equal, g_free,
+                                                     melo_browser_prefetch_free);
+  if (!melo_browser_prefetch_pool)
+    melo_browser_prefetch_pool = g_thread_pool_new (melo_browser_prefetch_func,
+                                                    NULL, 1, FALSE, NULL);
+
+  /* Release expired pages */
+  now = g_get_monotonic_time ();
+  g_hash_table_foreach_remove (melo_browser_prefetch_hash,
+                               melo_browser_prefetch_expired, &now);
+
+  /* Page already available, cache or queue full */
+  if (!melo_browser_prefetch_pool ||
+      g_hash_table_contains (melo_browser_prefetch_hash, key) ||
+      g_hash_table_size (melo_browser_prefetch_hash) >=
+                                                   MELO_BROWSER_PREFETCH_MAX ||
+      g_thread_pool_unprocessed (melo_browser_prefetch_pool) >=
+                                                 MELO_BROWSER_PREFETCH_QUEUE) {
+    G_UNLOCK (melo_browser_prefetch_mutex);
+    g_free (key);
+    return;
+  }
+
+  /* Add pending page */
+  p = g_slice_new0 (MeloBrowserPrefetch);
+  g_hash_table_insert (melo_browser_prefetch_hash, g_strdup (key), p);
+
+  /* Queue prefetch */
+  job = g_slice_new0 (MeloBrowserPrefetchJob);
+  job->browser = g_object_ref (browser);
+  job->key = key;
+  job->path = g_strdup (path);
+  job->token = g_strdup (token);
+  job->params = *params;
+  job->params.offset = params->offset + params->count;
+  job->params.token = job->token;
+  g_thread_pool_push (melo_browser_prefetch_pool, job, NULL);
+
+  G_UNLOCK (melo_browser_prefetch_mutex);
+}
+
+static gboolean
+melo_browser_prefetch_match (gpointer key, gpointer value, gpointer user_data)
+{
+  return g_str_has_prefix (key, user_data);
+}
+
+/**
+ * melo_browser_set_prefetch:
+ * @browser: the browser
+ * @enable: %TRUE to enable prefetch
+ *
+ * Enable prefetch of the next page for @browser: after each call to
+ * melo_browser_get_list() returning a full page, the next page is generated in
+ * a low priority background thread with the same parameters (including tags)
+ * and the covers of its items are loaded into the cover cache. The next call
+ * to melo_browser_get_list() for this page is then served immediately.
+ *
+ * A prefetched page is kept at most a few seconds: a #MeloBrowser which knows
+ * that its content has changed should call melo_browser_flush_prefetch().
+ */
+void
+melo_browser_set_prefetch (MeloBrowser *browser, gboolean enable)
+{
+  browser->priv->prefetch = enable;
+  if (!enable)
+    melo_browser_flush_prefetch (browser);
+}
+
+/**
+ * melo_browser_flush_prefetch:
+ * @browser: the browser
+ *
+ * Drop all pages prefetched for @browser.
+ */
+void
+melo_browser_flush_prefetch (MeloBrowser *browser)
+{
+  gchar *prefix;
+
+  prefix = g_strdup_printf ("%s\n", browser->priv->id);
+  G_LOCK (melo_browser_prefetch_mutex);
+  if (melo_browser_prefetch_hash)
+    g_hash_table_foreach_remove (melo_browser_prefetch_hash,
+                                 melo_browser_prefetch_match, prefix);
+  G_UNLOCK (melo_browser_prefetch_mutex);
+  g_free (prefix);
+}
+
+/**
+ * melo_browser_trim_prefetch:
+ *
+ * Drop all pages prefetched for all #MeloBrowser instances.
+ */
+void
+melo_browser_trim_prefetch (void)
+{
+  G_LOCK (melo_browser_prefetch_mutex);
+  if (melo_browser_prefetch_hash)
+    g_hash_table_remove_all (melo_browser_prefetch_hash);
+  G_UNLOCK (melo_browser_prefetch_mutex);
+}
+
+/**
+ * melo_browser_get_prefetch_memory_usage:
+ * @usage: the #MeloMemoryUsage to fill
+ *
+ * Get the number of items held by the pages prefetched for all #MeloBrowser
+ * instances. The tags of the items are accounted with the live #MeloTags.
+ */
+void
+melo_browser_get_prefetch_memory_usage (MeloMemoryUsage *usage)
+{
+  GHashTableIter iter;
+  MeloBrowserPrefetch *p;
+  guint pages = 0;
+  guint64 items = 0;
+  gsize arena = 0;
+
+  G_LOCK (melo_browser_prefetch_mutex);
+  if (melo_browser_prefetch_hash) {
+    g_hash_table_iter_init (&iter, melo_browser_prefetch_hash);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &p)) {
+      guint count;
+
+      if (!p->list)
+        continue;
+      count = g_list_length (p->list->items);
+      if (p->list->arena)
+        arena += melo_arena_get_size (p->list->arena);
+      else
+        items += count;
+      usage->count += count;
+      pages++;
+    }
+  }
+  G_UNLOCK (melo_browser_prefetch_mutex);
+
+  /* Estimate size of items: arena size is used when available */
+  usage->bytes = pages * sizeof (MeloBrowserList) +
+                 items * sizeof (MeloBrowserItem) + arena;
+  usage->details = json_object_new ();
+  json_object_set_int_member (usage->details, "pages", pages);
+}
+
 /**
  * melo_browser_get_list:
  * @browser: the browser
@@ -329,10 +859,23 @@ melo_browser_get_list (MeloBrowser *browser, const gchar *path,
                        const MeloBrowserGetListParams *params)
 {
   MeloBrowserClass *bclass = MELO_BROWSER_GET_CLASS (browser);
+  MeloBrowserList *list = NULL;
 
   g_return_val_if_fail (bclass->get_list, NULL);
 
-  return bclass->get_list (browser, path, params);
+  /* Get prefetched page */
+  if (browser->priv->prefetch)
+    list = melo_browser_prefetch_take (browser, path, params);
+
+  /* Get list */
+  if (!list)
+    list = bclass->get_list (browser, path, params);
+
+  /* Prefetch next page */
+  if (list && browser->priv->prefetch)
+    melo_browser_prefetch_next (browser, path, params, list);
+
+  return list;
 }
 
 /**
@@ -429,6 +972,144 @@ melo_browser_action (MeloBrowser *browser, const gchar *path,
   return bclass->action (browser, path, action, params);
 }
 
+/**
+ * melo_browser_get_list_async:
+ * @browser: the browser
+ * @path: the path to get content list
+ * @params: parameters to generate list
+ * @cancellable: (nullable): a #GCancellable
+ * @callback: the function to call when the list is available
+ * @user_data: the data to pass to @callback
+ *
+ * Asynchronous version of melo_browser_get_list(): @callback is called from
+ * the thread-default main context of the caller, and it should call
+ * melo_browser_get_list_finish() to get the list. The @path and @params are
+ * copied and can be released after the call.
+ *
+ * When @cancellable is cancelled, @callback is called immediately with a
+ * %G_IO_ERROR_CANCELLED error.
+ */
+void
+melo_browser_get_list_async (MeloBrowser *browser, const gchar *path,
+                             const MeloBrowserGetListParams *params,
+                             GCancellable *cancellable,
+                             GAsyncReadyCallback callback, gpointer user_data)
+{
+  MeloBrowserClass *bclass = MELO_BROWSER_GET_CLASS (browser);
+
+  bclass->get_list_async (browser, path, params, cancellable, callback,
+                          user_data);
+}
+
+/**
+ * melo_browser_get_list_finish:
+ * @browser: the browser
+ * @result: the #GAsyncResult passed to the callback
+ * @error: a pointer to store an error, or %NULL
+ *
+ * Finish an operation started with melo_browser_get_list_async().
+ *
+ * Returns: (transfer full): a #MeloBrowserList or %NULL if an error has
+ * occurred or if the operation has been cancelled.
+ * Use melo_browser_list_free() after usage.
+ */
+MeloBrowserList *
+melo_browser_get_list_finish (MeloBrowser *browser, GAsyncResult *result,
+                              GError **error)
+{
+  MeloBrowserClass *bclass = MELO_BROWSER_GET_CLASS (browser);
+
+  return bclass->get_list_finish (browser, result, error);
+}
+
+/**
+ * melo_browser_search_async:
+ * @browser: the browser
+ * @input: the input keywords to use
+ * @params: parameters to generate list
+ * @cancellable: (nullable): a #GCancellable
+ * @callback: the function to call when the list is available
+ * @user_data: the data to pass to @callback
+ *
+ * Asynchronous version of melo_browser_search(). See
+ * melo_browser_get_list_async() for details.
+ */
+void
+melo_browser_search_async (MeloBrowser *browser, const gchar *input,
+                           const MeloBrowserSearchParams *params,
+                           GCancellable *cancellable,
+                           GAsyncReadyCallback callback, gpointer user_data)
+{
+  MeloBrowserClass *bclass = MELO_BROWSER_GET_CLASS (browser);
+
+  bclass->search_async (browser, input, params, cancellable, callback,
+                        user_data);
+}
+
+/**
+ * melo_browser_search_finish:
+ * @browser: the browser
+ * @result: the #GAsyncResult passed to the callback
+ * @error: a pointer to store an error, or %NULL
+ *
+ * Finish an operation started with melo_browser_search_async().
+ *
+ * Returns: (transfer full): a #MeloBrowserList or %NULL if an error has
+ * occurred or if the operation has been cancelled.
+ * Use melo_browser_list_free() after usage.
+ */
+MeloBrowserList *
+melo_browser_search_finish (MeloBrowser *browser, GAsyncResult *result,
+                            GError **error)
+{
+  MeloBrowserClass *bclass = MELO_BROWSER_GET_CLASS (browser);
+
+  return bclass->search_finish (browser, result, error);
+}
+
+/**
+ * melo_browser_get_tags_async:
+ * @browser: the browser
+ * @path: the item path
+ * @fields: the tag fields to get
+ * @cancellable: (nullable): a #GCancellable
+ * @callback: the function to call when the tags are available
+ * @user_data: the data to pass to @callback
+ *
+ * Asynchronous version of melo_browser_get_tags(). See
+ * melo_browser_get_list_async() for details.
+ */
+void
+melo_browser_get_tags_async (MeloBrowser *browser, const gchar *path,
+                             MeloTagsFields fields, GCancellable *cancellable,
+                             GAsyncReadyCallback callback, gpointer user_data)
+{
+  MeloBrowserClass *bclass = MELO_BROWSER_GET_CLASS (browser);
+
+  bclass->get_tags_async (browser, path, fields, cancellable, callback,
+                          user_data);
+}
+
+/**
+ * melo_browser_get_tags_finish:
+ * @browser: the browser
+ * @result: the #GAsyncResult passed to the callback
+ * @error: a pointer to store an error, or %NULL
+ *
+ * Finish an operation started with melo_browser_get_tags_async().
+ *
+ * Returns: (transfer full): a #MeloTags or %NULL if an error has occurred or
+ * if the operation has been cancelled. Use melo_tags_unref() after usage.
+ */
+MeloTags *
+melo_browser_get_tags_finish (MeloBrowser *browser, GAsyncResult *result,
+                              GError **error)
+{
+  MeloBrowserClass *bclass = MELO_BROWSER_GET_CLASS (browser);
+
+  return bclass->get_tags_finish (browser, result, error);
+}
+
 /**
  * melo_browser_list_new:
  * @path: the path of the current list
@@ -464,13 +1145,159 @@ melo_browser_list_new (const gchar *path)
 void
 melo_browser_list_free (MeloBrowserList *list)
 {
-  g_free (list->path);
+  GList *l;
+
   g_free (list->prev_token);
   g_free (list->next_token);
-  g_list_free_full (list->items, (GDestroyNotify) melo_browser_item_free);
+
+  /* Items, strings and nodes are released with the arena */
+  if (list->arena) {
+    for (l = list->items; l != NULL; l = l->next) {
+      MeloBrowserItem *item = l->data;
+
+      if (item->tags)
+        melo_tags_unref (item->tags);
+    }
+    melo_arena_free (list->arena);
+  } else {
+    g_free (list->path);
+    g_list_free_full (list->items, (GDestroyNotify) melo_browser_item_free);
+  }
   g_slice_free (MeloBrowserList, list);
 }
 
+/**
+ * melo_browser_list_new_with_arena:
+ * @path: the path of the list
+ *
+ * Create a new #MeloBrowserList instance with its own #MeloArena. It should be
+ * used for big listings, in order to replace the thousands of small
+ * allocations done for the items by a few large ones.
+ *
+ * Returns: (transfer full): a new #MeloBrowserList instance or %NULL if an
+ * error occurred. After usage, it should be freed with
+ * melo_browser_list_free().
+ */
+MeloBrowserList *
+melo_browser_list_new_with_arena (const gchar *path)
+{
+  MeloBrowserList *list;
+
+  /* Create browser list */
+  list = g_slice_new0 (MeloBrowserList);
+  if (!list)
+    return NULL;
+
+  /* Create arena and set path */
+  list->arena = melo_arena_new (0);
+  list->path = melo_arena_strdup (list->arena, path);
+
+  return list;
+}
+
+/**
+ * melo_browser_list_new_item:
+ * @list: the list
+ * @id: the ID of the item
+ * @type: the type of the item
+ *
+ * Create a new #MeloBrowserItem for @list: it is allocated from the arena of
+ * @list when available, or with melo_browser_item_new() otherwise. The item is
+ * not added to @list.
+ *
+ * Returns: (transfer none): a new #MeloBrowserItem, owned by @list once added
+ * with melo_browser_list_prepend().
+ */
+MeloBrowserItem *
+melo_browser_list_new_item (MeloBrowserList *list, const gchar *id,
+                            MeloBrowserItemType type)
+{
+  MeloBrowserItem *item;
+
+  if (!list->arena)
+    return melo_browser_item_new (id, type);
+
+  /* Allocate item from arena */
+  item = melo_arena_new0 (list->arena, MeloBrowserItem);
+  item->id = melo_arena_strdup (list->arena, id);
+  item->type = type;
+
+  return item;
+}
+
+/**
+ * melo_browser_list_strdup:
+ * @list: the list
+ * @str: (allow-none): the string to duplicate
+ *
+ * Duplicate a string for an item of @list, as its name: it is allocated from
+ * the arena of @list when available, or with g_strdup() otherwise.
+ *
+ * Returns: a copy of @str, or %NULL if @str is %NULL.
+ */
+gchar *
+melo_browser_list_strdup (MeloBrowserList *list, const gchar *str)
+{
+  if (!list->arena)
+    return g_strdup (str);
+  return melo_arena_strdup (list->arena, str);
+}
+
+/**
+ * melo_browser_list_strdup_printf:
+ * @list: the list
+ * @format: a standard printf() format string
+ * @...: the parameters to insert into the format string
+ *
+ * Format a new string for an item of @list, as g_strdup_printf(): it is
+ * allocated from the arena of @list when available.
+ *
+ * Returns: a new string.
+ */
+gchar *
+melo_browser_list_strdup_printf (MeloBrowserList *list, const gchar *format,
+                                 ...)
+{
+  va_list args;
+  gchar *str;
+
+  va_start (args, format);
+  if (list->arena)
+    str = melo_arena_strdup_vprintf (list->arena, format, args);
+  else
+    str = g_strdup_vprintf (format, args);
+  va_end (args);
+
+  return str;
+}
+
+/**
+ * melo_browser_list_prepend:
+ * @list: the list
+ * @item: (transfer full): the item to add
+ *
+ * Add an item at start of @list. With an arena, the node of the #GList is
+ * also allocated from the arena.
+ */
+void
+melo_browser_list_prepend (MeloBrowserList *list, MeloBrowserItem *item)
+{
+  GList *node;
+
+  if (!list->arena) {
+    list->items = g_list_prepend (list->items, item);
+    return;
+  }
+
+  /* Allocate node from arena */
+  node = melo_arena_new0 (list->arena, GList);
+  node->data = item;
+  node->next = list->items;
+  if (list->items)
+    list->items->prev = node;
+  list->items = node;
+}
+
 static const gchar *melo_browser_item_type_map[MELO_BROWSER_ITEM_TYPE_COUNT] = {
   [MELO_BROWSER_ITEM_TYPE_MEDIA] = "media",
   [MELO_BROWSER_ITEM_TYPE_CATEGORY] = "category",
@@ -23,7 +23,9 @@
 #define __MELO_BROWSER_H__
 
 #include <glib-object.h>
+#include <gio/gio.h>
 
+#include "melo_arena.h"
 #include "melo_player.h"
 
 G_BEGIN_DECLS
@@ -78,9 +80,19 @@ struct _MeloBrowser {
  * @search_hint: Help user by completing its input
  * @get_tags: Provide a #MeloTags containing details on an item
  * @action: Do an action on an item
+ * @get_list_async: Start an asynchronous get_list
+ * @get_list_finish: Finish an asynchronous get_list
+ * @search_async: Start an asynchronous search
+ * @search_finish: Finish an asynchronous search
+ * @get_tags_async: Start an asynchronous get_tags
+ * @get_tags_finish: Finish an asynchronous get_tags
  *
  * Subclasses must override at least the get_info virtual method. Others can be
  * kept undefined but functionalities will be reduced.
+ *
+ * The asynchronous virtual methods are implemented by default with the
+ * synchronous ones, called from a thread: a subclass doing non-blocking I/O
+ * can override them.
  */
 struct _MeloBrowserClass {
   GObjectClass parent_class;
@@ -96,6 +108,24 @@ struct _MeloBrowserClass {
   gboolean (*action) (MeloBrowser *browser, const gchar *path,
                       MeloBrowserItemAction action,
                       const MeloBrowserActionParams *params);
+
+  void (*get_list_async) (MeloBrowser *browser, const gchar *path,
+                          const MeloBrowserGetListParams *params,
+                          GCancellable *cancellable,
+                          GAsyncReadyCallback callback, gpointer user_data);
+  MeloBrowserList *(*get_list_finish) (MeloBrowser *browser,
+                                       GAsyncResult *result, GError **error);
+  void (*search_async) (MeloBrowser *browser, const gchar *input,
+                        const MeloBrowserSearchParams *params,
+                        GCancellable *cancellable,
+                        GAsyncReadyCallback callback, gpointer user_data);
+  MeloBrowserList *(*search_finish) (MeloBrowser *browser,
+                                     GAsyncResult *result, GError **error);
+  void (*get_tags_async) (MeloBrowser *browser, const gchar *path,
+                          MeloTagsFields fields, GCancellable *cancellable,
+                          GAsyncReadyCallback callback, gpointer user_data);
+  MeloTags *(*get_tags_finish) (MeloBrowser *browser, GAsyncResult *result,
+                                GError **error);
 };
 
 /**
@@ -164,6 +194,15 @@ struct _MeloBrowserInfo {
  * tokens are provided: @prev_token and @next_token to respectively get the
  * previous items and next items in the list for next call to
  * melo_browser_get_list() / melo_browser_search().
+ *
+ * A list created with melo_browser_list_new_with_arena() allocates its items,
+ * their strings and the nodes of @items from a #MeloArena, released in a
+ * single operation by melo_browser_list_free(). In this mode, the items must be
+ * created with melo_browser_list_new_item(), the strings with
+ * melo_browser_list_strdup() and the items added with
+ * melo_browser_list_prepend(). The nodes of @items must not be freed, so
+ * functions as g_list_remove() cannot be used. The tokens are still allocated
+ * with g_malloc().
  */
 struct _MeloBrowserList {
   gchar *path;
@@ -171,6 +210,9 @@ struct _MeloBrowserList {
   gchar *prev_token;
   gchar *next_token;
   GList *items;
+
+  /*< private >*/
+  MeloArena *arena;
 };
 
 /**
@@ -374,10 +416,16 @@ MeloBrowser *melo_browser_new (GType type, const gchar *id);
 const gchar *melo_browser_get_id (MeloBrowser *browser);
 const MeloBrowserInfo *melo_browser_get_info (MeloBrowser *browser);
 MeloBrowser *melo_browser_get_browser_by_id (const gchar *id);
+GList *melo_browser_get_browser_list (void);
 
 void melo_browser_set_player (MeloBrowser *browser, MeloPlayer *player);
 MeloPlayer *melo_browser_get_player (MeloBrowser *browser);
 
+void melo_browser_set_prefetch (MeloBrowser *browser, gboolean enable);
+void melo_browser_flush_prefetch (MeloBrowser *browser);
+void melo_browser_trim_prefetch (void);
+void melo_browser_get_prefetch_memory_usage (MeloMemoryUsage *usage);
+
 MeloBrowserList *melo_browser_get_list (MeloBrowser *browser, const gchar *path,
                                         const MeloBrowserGetListParams *params);
 MeloBrowserList *melo_browser_search (MeloBrowser *browser, const gchar *input,
@@ -389,9 +437,43 @@ gboolean melo_browser_action (MeloBrowser *browser, const gchar *path,
                               MeloBrowserItemAction action,
                               const MeloBrowserActionParams *params);
 
+void melo_browser_get_list_async (MeloBrowser *browser, const gchar *path,
+                                  const MeloBrowserGetListParams *params,
+                                  GCancellable *cancellable,
+                                  GAsyncReadyCallback callback,
+                                  gpointer user_data);
+MeloBrowserList *melo_browser_get_list_finish (MeloBrowser *browser,
+                                               GAsyncResult *result,
+                                               GError **error);
+void melo_browser_search_async (MeloBrowser *browser, const gchar *input,
+                                const MeloBrowserSearchParams *params,
+                                GCancellable *cancellable,
+                                GAsyncReadyCallback callback,
+                                gpointer user_data);
+MeloBrowserList *melo_browser_search_finish (MeloBrowser *browser,
+                                             GAsyncResult *result,
+                                             GError **error);
+void melo_browser_get_tags_async (MeloBrowser *browser, const gchar *path,
+                                  MeloTagsFields fields,
+                                  GCancellable *cancellable,
+                                  GAsyncReadyCallback callback,
+                                  gpointer user_data);
+MeloTags *melo_browser_get_tags_finish (MeloBrowser *browser,
+                                        GAsyncResult *result, GError **error);
+
 MeloBrowserList *melo_browser_list_new (const gchar *path);
+MeloBrowserList *melo_browser_list_new_with_arena (const gchar *path);
 void melo_browser_list_free (MeloBrowserList *list);
 
+MeloBrowserItem *melo_browser_list_new_item (MeloBrowserList *list,
+                                             const gchar *id,
+                                             MeloBrowserItemType type);
+gchar *melo_browser_list_strdup (MeloBrowserList *list, const gchar *str);
+gchar *melo_browser_list_strdup_printf (MeloBrowserList *list,
+                                        const gchar *format,
+                                        ...) G_GNUC_PRINTF (2, 3);
+void melo_browser_list_prepend (MeloBrowserList *list, MeloBrowserItem *item);
+
 MeloBrowserItemType melo_browser_item_type_from_string (const gchar *type);
 const gchar *melo_browser_item_type_to_string (MeloBrowserItemType type);
 
@@ -19,6 +19,7 @@
  * Boston, MA  02110-1301, USA.
  */
 
+#include "melo_event.h"
 #include "melo_browser_jsonrpc.h"
 
 /**
@@ -54,6 +55,36 @@ typedef enum {
   MELO_BROWSER_JSONRPC_TAGS_FULL,
 } MeloBrowserJSONRPCTags;
 
+/* Federated search: every browser is searched concurrently in a shared
+ * thread pool and results are returned as soon as they are available.
+ */
+#define MELO_BROWSER_JSONRPC_SEARCH_THREADS 8
+#define MELO_BROWSER_JSONRPC_SEARCH_TIMEOUT 5000
+
+typedef struct {
+  GMutex mutex;
+  GCond cond;
+  gint ref_count;
+
+  /* Search parameters */
+  gchar *input;
+  MeloBrowserSearchParams params;
+
+  /* Completed jobs */
+  GQueue done;
+  guint pending;
+  gboolean closed;
+} MeloBrowserJSONRPCSearch;
+
+typedef struct {
+  MeloBrowserJSONRPCSearch *search;
+  MeloBrowser *browser;
+  MeloBrowserList *list;
+} MeloBrowserJSONRPCSearchJob;
+
+G_LOCK_DEFINE_STATIC (melo_browser_jsonrpc_search_mutex);
+static GThreadPool *melo_browser_jsonrpc_search_pool = NULL;
+
 static MeloBrowser *
 melo_browser_jsonrpc_get_browser (JsonObject *obj, JsonNode **error)
 {
@@ -231,6 +262,70 @@ melo_browser_jsonrpc_get_list_fields (JsonObject *obj)
   return fields;
 }
 
+static JsonObject *
+melo_browser_jsonrpc_item_to_object (const MeloBrowserItem *item,
+                                     MeloBrowserJSONRPCListFields fields,
+                                     MeloTagsFields tags_fields)
+{
+  JsonObject *obj = json_object_new ();
+
+  if (fields & MELO_BROWSER_JSONRPC_LIST_FIELDS_ID)
+    json_object_set_string_member (obj, "id", item->id);
+  if (fields & MELO_BROWSER_JSONRPC_LIST_FIELDS_NAME)
+    json_object_set_string_member (obj, "name", item->name);
+  if (fields & MELO_BROWSER_JSONRPC_LIST_FIELDS_TAGS) {
+    if (item->tags) {
+      JsonObject *tags = melo_tags_get_json_object (item->tags, tags_fields);
+      json_object_set_object_member (obj, "tags", tags);
+    } else
+      json_object_set_null_member (obj, "tags");
+  }
+  if (fields & MELO_BROWSER_JSONRPC_LIST_FIELDS_TYPE) {
+    json_object_set_string_member (obj, "type",
+                                 melo_browser_item_type_to_string (item->type));
+    if (item->type == MELO_BROWSER_ITEM_TYPE_CUSTOM)
+      json_object_set_string_member (obj, "type_custom", item->type_custom);
+  }
+  if (fields & MELO_BROWSER_JSONRPC_LIST_FIELDS_ACTIONS) {
+    const MeloBrowserItemActionCustom *custom;
+    JsonArray *actions;
+
+    /* Generate action list */
+    actions = json_array_new ();
+    if (actions) {
+      gint i;
+
+      for (i = 0; i < MELO_BROWSER_ITEM_ACTION_COUNT; i++)
+        if (item->actions & (1 << i))
+          json_array_add_string_element (actions,
+                                        melo_browser_item_action_to_string (i));
+
+      json_object_set_array_member (obj, "actions", actions);
+    }
+
+    /* Generate custom action list */
+    if (item->actions_custom) {
+      actions = json_array_new ();
+      if (actions) {
+        JsonObject *o;
+
+        for (custom = item->actions_custom; custom->id; custom++) {
+          o = json_object_new ();
+          if (o) {
+            json_object_set_string_member (o, "id", custom->id);
+            json_object_set_string_member (o, "name", custom->name);
+            json_array_add_object_element (actions, o);
+          }
+        }
+
+        json_object_set_array_member (obj, "actions_custom", actions);
+      }
+    }
+  }
+
+  return obj;
+}
+
 JsonObject *
 melo_browser_jsonrpc_list_to_object (const MeloBrowserList *list,
                                      MeloBrowserJSONRPCListFields fields,
@@ -253,68 +348,47 @@ melo_browser_jsonrpc_list_to_object (const MeloBrowserList *list,
 
   /* Parse list and create array */
   array = json_array_new ();
-  for (l = list->items; l != NULL; l = l->next) {
-    MeloBrowserItem *item = (MeloBrowserItem *) l->data;
-    JsonObject *obj = json_object_new ();
-    if (fields & MELO_BROWSER_JSONRPC_LIST_FIELDS_ID)
-      json_object_set_string_member (obj, "id", item->id);
-    if (fields & MELO_BROWSER_JSONRPC_LIST_FIELDS_NAME)
-      json_object_set_string_member (obj, "name", item->name);
-    if (fields & MELO_BROWSER_JSONRPC_LIST_FIELDS_TAGS) {
-      if (item->tags) {
-        JsonObject *tags = melo_tags_to_json_object (item->tags, tags_fields);
-        json_object_set_object_member (obj, "tags", tags);
-      } else
-        json_object_set_null_member (obj, "tags");
-    }
-    if (fields & MELO_BROWSER_JSONRPC_LIST_FIELDS_TYPE) {
-      json_object_set_string_member (obj, "type",
-                                 melo_browser_item_type_to_string (item->type));
-      if (item->type == MELO_BROWSER_ITEM_TYPE_CUSTOM)
-        json_object_set_string_member (obj, "type_custom", item->type_custom);
-    }
-    if (fields & MELO_BROWSER_JSONRPC_LIST_FIELDS_ACTIONS) {
-      JsonArray *actions;
-
-      /* Generate action list */
-      actions = json_array_new ();
-      if (actions) {
-        gint i;
-
-        for (i = 0; i < MELO_BROWSER_ITEM_ACTION_COUNT; i++)
-          if (item->actions & (1 << i))
-            json_array_add_string_element (actions,
-                                        melo_browser_item_action_to_string (i));
+  for (l = list->items; l != NULL; l = l->next)
+    json_array_add_object_element (array,
+                                   melo_browser_jsonrpc_item_to_object (l->data,
+                                                                        fields,
+                                                                  tags_fields));
+  json_object_set_array_member (object, "items", array);
 
-        json_object_set_array_member (obj, "actions", actions);
-      }
+  return object;
+}
 
-      /* Generate custom action list */
-      if (item->actions_custom) {
-        actions = json_array_new ();
-        if (actions) {
-          JsonObject *o;
-
-          while (item->actions_custom->id) {
-            o = json_object_new ();
-            if (o) {
-              json_object_set_string_member (o, "id", item->actions_custom->id);
-              json_object_set_string_member (o, "name",
-                                             item->actions_custom->name);
-              json_array_add_object_element (actions, o);
-            }
-            item->actions_custom++;
-          }
+/* Write list with a writer: the JSON tree of the full list is never built */
+static void
+melo_browser_jsonrpc_list_write (MeloJSONRPCWriter *w,
+                                 const MeloBrowserList *list,
+                                 MeloBrowserJSONRPCListFields fields,
+                                 MeloTagsFields tags_fields)
+{
+  JsonObject *obj;
+  const GList *l;
 
-          json_object_set_array_member (obj, "actions_custom", actions);
-        }
-      }
-    }
-    json_array_add_object_element (array, obj);
+  /* Write list properties */
+  melo_jsonrpc_writer_begin_object (w);
+  melo_jsonrpc_writer_set_member_name (w, "path");
+  melo_jsonrpc_writer_add_string_value (w, list->path);
+  melo_jsonrpc_writer_set_member_name (w, "count");
+  melo_jsonrpc_writer_add_int_value (w, list->count);
+  melo_jsonrpc_writer_set_member_name (w, "prev_token");
+  melo_jsonrpc_writer_add_string_value (w, list->prev_token);
+  melo_jsonrpc_writer_set_member_name (w, "next_token");
+  melo_jsonrpc_writer_add_string_value (w, list->next_token);
+
+  /* Write items */
+  melo_jsonrpc_writer_set_member_name (w, "items");
+  melo_jsonrpc_writer_begin_array (w);
+  for (l = list->items; l != NULL; l = l->next) {
+    obj = melo_browser_jsonrpc_item_to_object (l->data, fields, tags_fields);
+    melo_jsonrpc_writer_add_object (w, obj);
+    json_object_unref (obj);
   }
-  json_object_set_array_member (object, "items", array);
-
-  return object;
+  melo_jsonrpc_writer_end_array (w);
+  melo_jsonrpc_writer_end_object (w);
 }
 
 static void
@@ -357,6 +431,60 @@ melo_browser_jsonrpc_get_tags_mode (JsonObject *obj, MeloBrowserTagsMode *mode,
   }
 }
 
+/* Asynchronous calls: the request is run with the asynchronous browser API in
+ * a private main context, with the cancellable set by the transport (see
+ * g_cancellable_get_current()). When the client goes away, the request is
+ * cancelled and the worker thread is released immediately.
+ */
+static void
+melo_browser_jsonrpc_async_done (GObject *source_object, GAsyncResult *res,
+                                 gpointer user_data)
+{
+  *((GAsyncResult **) user_data) = g_object_ref (res);
+}
+
+static GMainContext *
+melo_browser_jsonrpc_async_begin (void)
+{
+  GMainContext *context;
+
+  /* Use a private context for the call */
+  context = g_main_context_new ();
+  g_main_context_push_thread_default (context);
+
+  return context;
+}
+
+static void
+melo_browser_jsonrpc_async_wait (GMainContext *context, GAsyncResult **res)
+{
+  /* Wait end of call */
+  while (!*res)
+    g_main_context_iteration (context, TRUE);
+
+  /* Release private context */
+  g_main_context_pop_thread_default (context);
+  g_main_context_unref (context);
+}
+
+static JsonNode *
+melo_browser_jsonrpc_async_error (GError *err)
+{
+  JsonNode *node;
+
+  /* Request has been cancelled */
+  if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    node = melo_jsonrpc_build_error_node (MELO_JSONRPC_ERROR_INTERNAL_ERROR,
+                                          "Request cancelled!");
+  else
+    node = melo_jsonrpc_build_error_node (MELO_JSONRPC_ERROR_INVALID_REQUEST,
+                                          "Method not available!");
+  if (err)
+    g_error_free (err);
+
+  return node;
+}
+
 /* Method callbacks */
 static void
 melo_browser_jsonrpc_get_info (const gchar *method,
@@ -405,9 +533,13 @@ melo_browser_jsonrpc_get_list (const gchar *method,
   MeloBrowserTagsMode tags_mode = MELO_BROWSER_TAGS_MODE_NONE;
   MeloTagsFields tags_fields = MELO_TAGS_FIELDS_NONE;
   MeloSort sort = MELO_SORT_NONE;
+  GAsyncResult *res = NULL;
+  GMainContext *context;
   MeloBrowserList *list;
+  MeloJSONRPCWriter *w;
   MeloBrowser *bro;
   JsonObject *obj;
+  GError *err = NULL;
   const gchar *path = NULL, *input = NULL;
   const gchar *token = NULL;
   gint offset, count;
@@ -450,28 +582,45 @@ melo_browser_jsonrpc_get_list (const gchar *method,
     melo_browser_jsonrpc_get_tags_mode (obj, &tags_mode, &tags_fields);
 
   /* Get browser list */
+  context = melo_browser_jsonrpc_async_begin ();
   if (!g_strcmp0 (method, "browser.search")) {
     MeloBrowserSearchParams params = {
       .offset = offset, .count = count, .sort = sort,
       .token = token, .tags_mode = tags_mode, .tags_fields = tags_fields,
     };
 
-    list = melo_browser_search (bro, input, &params);
+    melo_browser_search_async (bro, input, &params,
+                               g_cancellable_get_current (),
+                               melo_browser_jsonrpc_async_done, &res);
+    melo_browser_jsonrpc_async_wait (context, &res);
+    list = melo_browser_search_finish (bro, res, &err);
   } else {
     MeloBrowserGetListParams params = {
       .offset = offset, .count = count, .sort = sort,
       .token = token, .tags_mode = tags_mode, .tags_fields = tags_fields,
     };
 
-    list = melo_browser_get_list (bro, path, &params);
+    melo_browser_get_list_async (bro, path, &params,
+                                 g_cancellable_get_current (),
+                                 melo_browser_jsonrpc_async_done, &res);
+    melo_browser_jsonrpc_async_wait (context, &res);
+    list = melo_browser_get_list_finish (bro, res, &err);
   }
+  g_object_unref (res);
   json_object_unref (obj);
   g_object_unref (bro);
 
   /* No list provided */
   if (!list) {
-    *error = melo_jsonrpc_build_error_node (MELO_JSONRPC_ERROR_INVALID_REQUEST,
-                                            "Method not available!");
+    *error = melo_browser_jsonrpc_async_error (err);
+    return;
+  }
+
+  /* Stream response with item list */
+  w = melo_jsonrpc_begin_result ();
+  if (w) {
+    melo_browser_jsonrpc_list_write (w, list, fields, tags_fields);
+    melo_browser_list_free (list);
     return;
   }
 
@@ -486,6 +635,238 @@ melo_browser_jsonrpc_get_list (const gchar *method,
   json_node_take_object (*result, obj);
 }
 
+static void
+melo_browser_jsonrpc_search_unref (MeloBrowserJSONRPCSearch *search)
+{
+  if (!g_atomic_int_dec_and_test (&search->ref_count))
+    return;
+
+  g_queue_clear (&search->done);
+  g_cond_clear (&search->cond);
+  g_mutex_clear (&search->mutex);
+  g_free (search->input);
+  g_slice_free (MeloBrowserJSONRPCSearch, search);
+}
+
+static void
+melo_browser_jsonrpc_search_job_free (MeloBrowserJSONRPCSearchJob *job)
+{
+  if (job->list)
+    melo_browser_list_free (job->list);
+  g_object_unref (job->browser);
+  g_slice_free (MeloBrowserJSONRPCSearchJob, job);
+}
+
+static void
+melo_browser_jsonrpc_search_func (gpointer data, gpointer user_data)
+{
+  MeloBrowserJSONRPCSearchJob *job = data;
+  MeloBrowserJSONRPCSearch *search = job->search;
+
+  /* Search in browser */
+  job->list = melo_browser_search (job->browser, search->input,
+                                   &search->params);
+
+  /* Add to completed jobs */
+  g_mutex_lock (&search->mutex);
+  if (!search->closed) {
+    g_queue_push_tail (&search->done, job);
+    job = NULL;
+  }
+  search->pending--;
+  g_cond_signal (&search->cond);
+  g_mutex_unlock (&search->mutex);
+
+  /* Result is too late: drop it */
+  if (job)
+    melo_browser_jsonrpc_search_job_free (job);
+  melo_browser_jsonrpc_search_unref (search);
+}
+
+static void
+melo_browser_jsonrpc_search_cancelled (GCancellable *cancellable,
+                                       gpointer user_data)
+{
+  MeloBrowserJSONRPCSearch *search = user_data;
+
+  /* Wake up waiting thread */
+  g_mutex_lock (&search->mutex);
+  g_cond_signal (&search->cond);
+  g_mutex_unlock (&search->mutex);
+}
+
+static void
+melo_browser_jsonrpc_search_all (const gchar *method,
+                                 JsonArray *s_params, JsonNode *params,
+                                 JsonNode **result, JsonNode **error,
+                                 gpointer user_data)
+{
+  MeloBrowserJSONRPCListFields fields;
+  MeloBrowserJSONRPCSearchJob *job;
+  MeloBrowserJSONRPCSearch *search;
+  MeloJSONRPCWriter *w;
+  JsonArray *array = NULL;
+  JsonObject *obj;
+  GList *browsers, *l;
+  gint64 timeout = MELO_BROWSER_JSONRPC_SEARCH_TIMEOUT;
+  GCancellable *cancellable;
+  gboolean complete;
+  gulong cancel_id;
+  gint64 deadline;
+
+  /* Get parameters */
+  obj = melo_jsonrpc_get_object (s_params, params, error);
+  if (!obj)
+    return;
+
+  /* Create search context */
+  search = g_slice_new0 (MeloBrowserJSONRPCSearch);
+  g_mutex_init (&search->mutex);
+  g_cond_init (&search->cond);
+  g_queue_init (&search->done);
+  search->ref_count = 1;
+  search->input = g_strdup (json_object_get_string_member (obj, "input"));
+  search->params.offset = json_object_get_int_member (obj, "offset");
+  search->params.count = json_object_get_int_member (obj, "count");
+
+  /* Get fields */
+  fields = melo_browser_jsonrpc_get_list_fields (obj);
+
+  /* Get sort */
+  if (json_object_has_member (obj, "sort"))
+    search->params.sort = melo_sort_from_string (
+                                json_object_get_string_member (obj, "sort"));
+
+  /* Get tags if needed */
+  if (fields & MELO_BROWSER_JSONRPC_LIST_FIELDS_TAGS)
+    melo_browser_jsonrpc_get_tags_mode (obj, &search->params.tags_mode,
+                                        &search->params.tags_fields);
+
+  /* Get deadline for each browser */
+  if (json_object_has_member (obj, "timeout"))
+    timeout = json_object_get_int_member (obj, "timeout");
+  json_object_unref (obj);
+
+  /* Create thread pool */
+  G_LOCK (melo_browser_jsonrpc_search_mutex);
+  if (!melo_browser_jsonrpc_search_pool)
+    melo_browser_jsonrpc_search_pool = g_thread_pool_new (
+                                            melo_browser_jsonrpc_search_func,
+                                            NULL,
+                                            MELO_BROWSER_JSONRPC_SEARCH_THREADS,
+                                            FALSE, NULL);
+  G_UNLOCK (melo_browser_jsonrpc_search_mutex);
+
+  /* Fan out search to all browsers supporting it */
+  browsers = melo_browser_get_browser_list ();
+  for (l = browsers; l != NULL; l = l->next) {
+    MeloBrowser *bro = l->data;
+    const MeloBrowserInfo *info = melo_browser_get_info (bro);
+
+    if (!info || !info->search_support)
+      continue;
+
+    /* Create job */
+    job = g_slice_new0 (MeloBrowserJSONRPCSearchJob);
+    job->search = search;
+    job->browser = g_object_ref (bro);
+
+    /* Search in thread pool or serially if not available */
+    g_atomic_int_inc (&search->ref_count);
+    g_mutex_lock (&search->mutex);
+    search->pending++;
+    g_mutex_unlock (&search->mutex);
+    if (melo_browser_jsonrpc_search_pool)
+      g_thread_pool_push (melo_browser_jsonrpc_search_pool, job, NULL);
+    else
+      melo_browser_jsonrpc_search_func (job, NULL);
+  }
+  g_list_free_full (browsers, g_object_unref);
+
+  /* Start response: stream if possible */
+  w = melo_jsonrpc_begin_result ();
+  if (w) {
+    melo_jsonrpc_writer_begin_object (w);
+    melo_jsonrpc_writer_set_member_name (w, "results");
+    melo_jsonrpc_writer_begin_array (w);
+    melo_jsonrpc_writer_flush (w);
+  } else
+    array = json_array_new ();
+
+  /* Stop waiting when client goes away */
+  cancellable = g_cancellable_get_current ();
+  cancel_id = g_cancellable_connect (cancellable,
+                                     G_CALLBACK (
+                                       melo_browser_jsonrpc_search_cancelled),
+                                     search, NULL);
+
+  /* Return results as they complete, until deadline */
+  deadline = g_get_monotonic_time () + timeout * G_TIME_SPAN_MILLISECOND;
+  g_mutex_lock (&search->mutex);
+  while (!g_cancellable_is_cancelled (cancellable)) {
+    /* Wait next result */
+    job = g_queue_pop_head (&search->done);
+    if (!job) {
+      if (!search->pending ||
+          !g_cond_wait_until (&search->cond, &search->mutex, deadline))
+        break;
+      continue;
+    }
+    g_mutex_unlock (&search->mutex);
+
+    /* Add result */
+    if (job->list) {
+      const gchar *id = melo_browser_get_id (job->browser);
+
+      if (w) {
+        melo_jsonrpc_writer_begin_object (w);
+        melo_jsonrpc_writer_set_member_name (w, "id");
+        melo_jsonrpc_writer_add_string_value (w, id);
+        melo_jsonrpc_writer_set_member_name (w, "list");
+        melo_browser_jsonrpc_list_write (w, job->list, fields,
+                                         search->params.tags_fields);
+        melo_jsonrpc_writer_end_object (w);
+        melo_jsonrpc_writer_flush (w);
+      } else {
+        obj = json_object_new ();
+        json_object_set_string_member (obj, "id", id);
+        json_object_set_object_member (obj, "list",
+                        melo_browser_jsonrpc_list_to_object (job->list, fields,
+                                                 search->params.tags_fields));
+        json_array_add_object_element (array, obj);
+      }
+    }
+    melo_browser_jsonrpc_search_job_free (job);
+
+    g_mutex_lock (&search->mutex);
+  }
+
+  /* Drop late results */
+  complete = !search->pending;
+  search->closed = TRUE;
+  while ((job = g_queue_pop_head (&search->done)))
+    melo_browser_jsonrpc_search_job_free (job);
+  g_mutex_unlock (&search->mutex);
+  g_cancellable_disconnect (cancellable, cancel_id);
+
+  /* Finish response */
+  if (w) {
+    melo_jsonrpc_writer_end_array (w);
+    melo_jsonrpc_writer_set_member_name (w, "complete");
+    melo_jsonrpc_writer_add_boolean_value (w, complete);
+    melo_jsonrpc_writer_end_object (w);
+  } else {
+    obj = json_object_new ();
+    json_object_set_array_member (obj, "results", array);
+    json_object_set_boolean_member (obj, "complete", complete);
+    *result = json_node_new (JSON_NODE_OBJECT);
+    json_node_take_object (*result, obj);
+  }
+
+  /* Release search context */
+  melo_browser_jsonrpc_search_unref (search);
+}
+
 static void
 melo_browser_jsonrpc_search_hint (const gchar *method,
                                   JsonArray *s_params, JsonNode *params,
@@ -534,10 +915,13 @@ melo_browser_jsonrpc_get_tags (const gchar *method,
                                gpointer user_data)
 {
   MeloTagsFields fields = MELO_TAGS_FIELDS_FULL;
+  GAsyncResult *res = NULL;
+  GMainContext *context;
   MeloTags *tags = NULL;
   MeloBrowser *bro;
   JsonArray *array;
   JsonObject *obj;
+  GError *err = NULL;
   const gchar *path;
 
   /* Get parameters */
@@ -564,12 +948,24 @@ melo_browser_jsonrpc_get_tags (const gchar *method,
   }
 
   /* Get tags from path */
-  tags = melo_browser_get_tags (bro, path, fields);
+  context = melo_browser_jsonrpc_async_begin ();
+  melo_browser_get_tags_async (bro, path, fields, g_cancellable_get_current (),
+                               melo_browser_jsonrpc_async_done, &res);
+  melo_browser_jsonrpc_async_wait (context, &res);
+  tags = melo_browser_get_tags_finish (bro, res, &err);
+  g_object_unref (res);
   json_object_unref (obj);
   g_object_unref (bro);
 
+  /* Request has been cancelled */
+  if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    *error = melo_browser_jsonrpc_async_error (err);
+    return;
+  }
+  g_clear_error (&err);
+
   /* Parse list and create array */
-  obj = melo_tags_to_json_object (tags, fields);
+  obj = melo_tags_get_json_object (tags, fields);
   if (tags)
     melo_tags_unref (tags);
 
@@ -649,6 +1045,9 @@ static MeloJSONRPCMethod melo_browser_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_browser_jsonrpc_get_info,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONCURRENT | MELO_JSONRPC_FLAGS_CACHE,
+    .cache_events = (1 << MELO_EVENT_TYPE_MODULE) |
+                    (1 << MELO_EVENT_TYPE_BROWSER),
   },
   {
     .method = "get_list",
@@ -674,6 +1073,7 @@ static MeloJSONRPCMethod melo_browser_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_browser_jsonrpc_get_list,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONCURRENT | MELO_JSONRPC_FLAGS_BULK,
   },
   {
     .method = "search",
@@ -699,6 +1099,35 @@ static MeloJSONRPCMethod melo_browser_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_browser_jsonrpc_get_list,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_BULK,
+  },
+  {
+    .method = "search_all",
+    .params = "["
+              "  {\"name\": \"input\", \"type\": \"string\"},"
+              "  {\"name\": \"offset\", \"type\": \"integer\"},"
+              "  {\"name\": \"count\", \"type\": \"integer\"},"
+              "  {"
+              "    \"name\": \"fields\", \"type\": \"array\","
+              "    \"required\": false"
+              "  },"
+              "  {"
+              "    \"name\": \"sort\", \"type\": \"string\","
+              "    \"required\": false"
+              "  },"
+              "  {"
+              "    \"name\": \"tags\", \"type\": \"object\","
+              "    \"required\": false"
+              "  },"
+              "  {"
+              "    \"name\": \"timeout\", \"type\": \"integer\","
+              "    \"required\": false"
+              "  }"
+              "]",
+    .result = "{\"type\":\"object\"}",
+    .callback = melo_browser_jsonrpc_search_all,
+    .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_BULK,
   },
   {
     .method = "search_hint",
@@ -709,6 +1138,7 @@ static MeloJSONRPCMethod melo_browser_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_browser_jsonrpc_search_hint,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_BULK,
   },
   {
     .method = "get_tags",
@@ -723,6 +1153,7 @@ static MeloJSONRPCMethod melo_browser_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_browser_jsonrpc_get_tags,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONCURRENT | MELO_JSONRPC_FLAGS_BULK,
   },
   {
     .method = "action",
@@ -742,6 +1173,7 @@ static MeloJSONRPCMethod melo_browser_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_browser_jsonrpc_item_action,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_BULK,
   },
 };
 
@@ -0,0 +1,505 @@
+/*
+ * melo_cbor.c: CBOR encoding of JSON nodes
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "melo_cbor.h"
+
+/**
+ * SECTION:melo_cbor
+ * @title: MeloCbor
+ * @short_description: CBOR encoder and decoder for JSON nodes
+ *
+ * The CBOR (Concise Binary Object Representation, RFC 7049) is a binary
+ * serialization of the JSON data model which is faster to parse and smaller
+ * than the textual JSON.
+ *
+ * melo_cbor_decode() converts a CBOR item into a #JsonNode tree, and
+ * melo_cbor_encode() serializes a #JsonNode tree into CBOR. The map keys must
+ * be text strings, the byte strings are converted to base64 strings, the tags
+ * are ignored and the undefined value is converted to null.
+ */
+
+#define MELO_CBOR_DEPTH_MAX 64
+#define MELO_CBOR_INDEFINITE 31
+#define MELO_CBOR_BREAK 0xff
+
+/* Major types */
+#define MELO_CBOR_UINT 0
+#define MELO_CBOR_NINT 1
+#define MELO_CBOR_BYTES 2
+#define MELO_CBOR_TEXT 3
+#define MELO_CBOR_ARRAY 4
+#define MELO_CBOR_MAP 5
+#define MELO_CBOR_TAG 6
+#define MELO_CBOR_SIMPLE 7
+
+/* Simple values */
+#define MELO_CBOR_FALSE 20
+#define MELO_CBOR_TRUE 21
+#define MELO_CBOR_NULL 22
+#define MELO_CBOR_UNDEFINED 23
+#define MELO_CBOR_HALF 25
+#define MELO_CBOR_FLOAT 26
+#define MELO_CBOR_DOUBLE 27
+
+typedef struct {
+  const guint8 *data;
+  gsize size;
+  gsize pos;
+} MeloCborReader;
+
+static JsonNode *melo_cbor_read_item (MeloCborReader *r, guint depth);
+
+static gboolean
+melo_cbor_read_head (MeloCborReader *r, guint8 *major, guint8 *info,
+                     guint64 *value)
+{
+  guint n;
+
+  if (r->pos >= r->size)
+    return FALSE;
+
+  /* Get major type and additional information */
+  *major = r->data[r->pos] >> 5;
+  *info = r->data[r->pos++] & 0x1f;
+  *value = *info;
+
+  /* Small value or indefinite length */
+  if (*info < 24)
+    return TRUE;
+  if (*info == MELO_CBOR_INDEFINITE)
+    return *major >= MELO_CBOR_BYTES && *major <= MELO_CBOR_MAP;
+  if (*info > 27)
+    return FALSE;
+
+  /* Get big-endian value */
+  n = 1 << (*info - 24);
+  if (r->size - r->pos < n)
+    return FALSE;
+  for (*value = 0; n; n--)
+    *value = (*value << 8) | r->data[r->pos++];
+
+  return TRUE;
+}
+
+static gboolean
+melo_cbor_read_break (MeloCborReader *r, gboolean *end)
+{
+  if (r->pos >= r->size)
+    return FALSE;
+
+  *end = r->data[r->pos] == MELO_CBOR_BREAK;
+  if (*end)
+    r->pos++;
+  return TRUE;
+}
+
+static gboolean
+melo_cbor_read_string (MeloCborReader *r, guint8 major, guint8 info,
+                       guint64 len, GString *str)
+{
+  gboolean end;
+
+  /* Definite length */
+  if (info != MELO_CBOR_INDEFINITE) {
+    if (len > r->size - r->pos)
+      return FALSE;
+    g_string_append_len (str, (const gchar *) r->data + r->pos, len);
+    r->pos += len;
+    return TRUE;
+  }
+
+  /* Indefinite length: concatenate definite chunks of the same type */
+  while (melo_cbor_read_break (r, &end)) {
+    guint8 m, i;
+
+    if (end)
+      return TRUE;
+    if (!melo_cbor_read_head (r, &m, &i, &len) || m != major ||
+        i == MELO_CBOR_INDEFINITE ||
+        !melo_cbor_read_string (r, major, i, len, str))
+      return FALSE;
+  }
+
+  return FALSE;
+}
+
+static JsonNode *
+melo_cbor_read_array (MeloCborReader *r, guint8 info, guint64 count,
+                      guint depth)
+{
+  gboolean indefinite = info == MELO_CBOR_INDEFINITE;
+  JsonArray *array;
+  JsonNode *node;
+  gboolean end;
+  guint64 i;
+
+  /* Each element takes at least one byte */
+  if (!indefinite && count > r->size - r->pos)
+    return NULL;
+
+  array = json_array_sized_new (indefinite ? 0 : count);
+  for (i = 0; indefinite || i < count; i++) {
+    /* End of indefinite array */
+    if (indefinite) {
+      if (!melo_cbor_read_break (r, &end))
+        goto failed;
+      if (end)
+        break;
+    }
+
+    node = melo_cbor_read_item (r, depth + 1);
+    if (!node)
+      goto failed;
+    json_array_add_element (array, node);
+  }
+
+  node = json_node_new (JSON_NODE_ARRAY);
+  json_node_take_array (node, array);
+  return node;
+
+failed:
+  json_array_unref (array);
+  return NULL;
+}
+
+static JsonNode *
+melo_cbor_read_map (MeloCborReader *r, guint8 info, guint64 count,
+                    guint depth)
+{
+  gboolean indefinite = info == MELO_CBOR_INDEFINITE;
+  JsonNode *node, *key;
+  JsonObject *obj;
+  gboolean end;
+  guint64 i;
+
+  /* Each pair takes at least two bytes */
+  if (!indefinite && count > (r->size - r->pos) / 2)
+    return NULL;
+
+  obj = json_object_new ();
+  for (i = 0; indefinite || i < count; i++) {
+    /* End of indefinite map */
+    if (indefinite) {
+      if (!melo_cbor_read_break (r, &end))
+        goto failed;
+      if (end)
+        break;
+    }
+
+    /* Only text keys are supported */
+    key = melo_cbor_read_item (r, depth + 1);
+    if (!key)
+      goto failed;
+    if (!JSON_NODE_HOLDS_VALUE (key) ||
+        json_node_get_value_type (key) != G_TYPE_STRING) {
+      json_node_free (key);
+      goto failed;
+    }
+
+    /* Get value */
+    node = melo_cbor_read_item (r, depth + 1);
+    if (!node) {
+      json_node_free (key);
+      goto failed;
+    }
+    json_object_set_member (obj, json_node_get_string (key), node);
+    json_node_free (key);
+  }
+
+  node = json_node_new (JSON_NODE_OBJECT);
+  json_node_take_object (node, obj);
+  return node;
+
+failed:
+  json_object_unref (obj);
+  return NULL;
+}
+
+static JsonNode *
+melo_cbor_read_simple (guint8 info, guint64 value)
+{
+  union { guint32 u; gfloat f; } f;
+  union { guint64 u; gdouble d; } d;
+  JsonNode *node;
+
+  switch (info) {
+    case MELO_CBOR_FALSE:
+    case MELO_CBOR_TRUE:
+      node = json_node_new (JSON_NODE_VALUE);
+      json_node_set_boolean (node, info == MELO_CBOR_TRUE);
+      return node;
+    case MELO_CBOR_NULL:
+    case MELO_CBOR_UNDEFINED:
+      return json_node_new (JSON_NODE_NULL);
+    case MELO_CBOR_HALF: {
+      guint exp = (value >> 10) & 0x1f;
+      guint mant = value & 0x3ff;
+
+      /* Infinity and NaN cannot be represented in JSON */
+      if (exp == 0x1f)
+        return json_node_new (JSON_NODE_NULL);
+
+      /* Convert half-precision float */
+      if (exp)
+        d.d = (mant + 1024) * (gdouble) (1 << exp) / (1 << 25);
+      else
+        d.d = mant / (gdouble) (1 << 24);
+      if (value & 0x8000)
+        d.d = -d.d;
+      break;
+    }
+    case MELO_CBOR_FLOAT:
+      f.u = value;
+      d.d = f.f;
+      break;
+    case MELO_CBOR_DOUBLE:
+      d.u = value;
+      break;
+    default:
+      return NULL;
+  }
+
+  node = json_node_new (JSON_NODE_VALUE);
+  json_node_set_double (node, d.d);
+  return node;
+}
+
+static JsonNode *
+melo_cbor_read_item (MeloCborReader *r, guint depth)
+{
+  JsonNode *node;
+  guint8 major, info;
+  guint64 value;
+  GString *str;
+
+  if (depth > MELO_CBOR_DEPTH_MAX ||
+      !melo_cbor_read_head (r, &major, &info, &value))
+    return NULL;
+
+  switch (major) {
+    case MELO_CBOR_UINT:
+    case MELO_CBOR_NINT:
+      if (value > G_MAXINT64)
+        return NULL;
+      node = json_node_new (JSON_NODE_VALUE);
+      if (major == MELO_CBOR_UINT)
+        json_node_set_int (node, value);
+      else
+        json_node_set_int (node, -1 - (gint64) value);
+      return node;
+    case MELO_CBOR_BYTES:
+    case MELO_CBOR_TEXT:
+      /* Get complete string */
+      str = g_string_new (NULL);
+      if (!melo_cbor_read_string (r, major, info, value, str) ||
+          (major == MELO_CBOR_TEXT &&
+           !g_utf8_validate (str->str, str->len, NULL))) {
+        g_string_free (str, TRUE);
+        return NULL;
+      }
+
+      /* Byte strings are converted to base64 */
+      node = json_node_new (JSON_NODE_VALUE);
+      if (major == MELO_CBOR_BYTES) {
+        gchar *b64 = g_base64_encode ((const guchar *) str->str, str->len);
+        json_node_set_string (node, b64);
+        g_free (b64);
+      } else
+        json_node_set_string (node, str->str);
+      g_string_free (str, TRUE);
+      return node;
+    case MELO_CBOR_ARRAY:
+      return melo_cbor_read_array (r, info, value, depth);
+    case MELO_CBOR_MAP:
+      return melo_cbor_read_map (r, info, value, depth);
+    case MELO_CBOR_TAG:
+      /* Ignore tag */
+      return melo_cbor_read_item (r, depth + 1);
+    default:
+      return melo_cbor_read_simple (info, value);
+  }
+}
+
+/**
+ * melo_cbor_decode:
+ * @data: the CBOR data
+ * @size: the size of @data
+ *
+ * Decode a single CBOR item into a #JsonNode tree. The decoding fails if
+ * @data is malformed, if a map key is not a text string or if the item is
+ * followed by some more data.
+ *
+ * Returns: (transfer full): a new #JsonNode or %NULL if @data is not valid.
+ * Use json_node_free() after usage.
+ */
+JsonNode *
+melo_cbor_decode (gconstpointer data, gsize size)
+{
+  MeloCborReader r = { data, size, 0 };
+  JsonNode *node;
+
+  if (!data)
+    return NULL;
+
+  /* Decode item: trailing data are not accepted */
+  node = melo_cbor_read_item (&r, 0);
+  if (node && r.pos != r.size) {
+    json_node_free (node);
+    return NULL;
+  }
+
+  return node;
+}
+
+static void
+melo_cbor_write_head (GByteArray *out, guint8 major, guint64 value)
+{
+  guint8 buf[9];
+  guint n, i;
+
+  /* Select smallest encoding */
+  major <<= 5;
+  if (value < 24) {
+    buf[0] = major | value;
+    n = 0;
+  } else if (value <= G_MAXUINT8) {
+    buf[0] = major | 24;
+    n = 1;
+  } else if (value <= G_MAXUINT16) {
+    buf[0] = major | 25;
+    n = 2;
+  } else if (value <= G_MAXUINT32) {
+    buf[0] = major | 26;
+    n = 4;
+  } else {
+    buf[0] = major | 27;
+    n = 8;
+  }
+
+  /* Write big-endian value */
+  for (i = n; i > 0; i--, value >>= 8)
+    buf[i] = value & 0xff;
+  g_byte_array_append (out, buf, n + 1);
+}
+
+static void
+melo_cbor_write_string (GByteArray *out, const gchar *str)
+{
+  gsize len = str ? strlen (str) : 0;
+
+  melo_cbor_write_head (out, MELO_CBOR_TEXT, len);
+  g_byte_array_append (out, (const guint8 *) str, len);
+}
+
+static void
+melo_cbor_write_simple (GByteArray *out, guint8 value)
+{
+  guint8 c = (MELO_CBOR_SIMPLE << 5) | value;
+
+  g_byte_array_append (out, &c, 1);
+}
+
+static void
+melo_cbor_write_node (GByteArray *out, JsonNode *node)
+{
+  union { guint64 u; gdouble d; } d;
+  JsonObject *obj;
+  JsonArray *array;
+  GList *members, *l;
+  gint64 val;
+  guint count, i;
+
+  switch (JSON_NODE_TYPE (node)) {
+    case JSON_NODE_OBJECT:
+      obj = json_node_get_object (node);
+      members = json_object_get_members (obj);
+      melo_cbor_write_head (out, MELO_CBOR_MAP, json_object_get_size (obj));
+      for (l = members; l != NULL; l = l->next) {
+        melo_cbor_write_string (out, l->data);
+        melo_cbor_write_node (out, json_object_get_member (obj, l->data));
+      }
+      g_list_free (members);
+      break;
+    case JSON_NODE_ARRAY:
+      array = json_node_get_array (node);
+      count = json_array_get_length (array);
+      melo_cbor_write_head (out, MELO_CBOR_ARRAY, count);
+      for (i = 0; i < count; i++)
+        melo_cbor_write_node (out, json_array_get_element (array, i));
+      break;
+    case JSON_NODE_VALUE:
+      switch (json_node_get_value_type (node)) {
+        case G_TYPE_INT64:
+          val = json_node_get_int (node);
+          if (val >= 0)
+            melo_cbor_write_head (out, MELO_CBOR_UINT, val);
+          else
+            melo_cbor_write_head (out, MELO_CBOR_NINT, -(val + 1));
+          break;
+        case G_TYPE_DOUBLE:
+          d.d = json_node_get_double (node);
+          d.u = GUINT64_TO_BE (d.u);
+          melo_cbor_write_simple (out, MELO_CBOR_DOUBLE);
+          g_byte_array_append (out, (const guint8 *) &d.u, sizeof (d.u));
+          break;
+        case G_TYPE_BOOLEAN:
+          melo_cbor_write_simple (out, json_node_get_boolean (node) ?
+                                       MELO_CBOR_TRUE : MELO_CBOR_FALSE);
+          break;
+        case G_TYPE_STRING:
+          melo_cbor_write_string (out, json_node_get_string (node));
+          break;
+        default:
+          melo_cbor_write_simple (out, MELO_CBOR_NULL);
+      }
+      break;
+    case JSON_NODE_NULL:
+    default:
+      melo_cbor_write_simple (out, MELO_CBOR_NULL);
+  }
+}
+
+/**
+ * melo_cbor_encode:
+ * @node: the #JsonNode to encode
+ *
+ * Encode a #JsonNode tree into a CBOR item. The integers, lengths and sizes
+ * use the shortest encoding and the floating-point numbers are always encoded
+ * in double precision.
+ *
+ * Returns: (transfer full): a #GBytes containing the CBOR item. Use
+ * g_bytes_unref() after usage.
+ */
+GBytes *
+melo_cbor_encode (JsonNode *node)
+{
+  GByteArray *out;
+
+  out = g_byte_array_new ();
+  if (node)
+    melo_cbor_write_node (out, node);
+  else
+    melo_cbor_write_simple (out, MELO_CBOR_NULL);
+
+  return g_byte_array_free_to_bytes (out);
+}
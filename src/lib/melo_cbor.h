@@ -0,0 +1,31 @@
+/*
+ * melo_cbor.h: CBOR encoding of JSON nodes
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __MELO_CBOR_H__
+#define __MELO_CBOR_H__
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+JsonNode *melo_cbor_decode (gconstpointer data, gsize size);
+GBytes *melo_cbor_encode (JsonNode *node);
+
+#endif /* __MELO_CBOR_H__ */
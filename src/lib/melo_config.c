@@ -22,12 +22,31 @@
 #include <string.h>
 
 #include "melo_config.h"
+#include "melo_jsonrpc.h"
 
 /* Internal config list */
 G_LOCK_DEFINE_STATIC (melo_config_mutex);
 static GHashTable *melo_config_hash = NULL;
 static GList *melo_config_list = NULL;
 
+/* Deferred file writer: writes are delayed until no update has been made
+ * during MELO_CONFIG_SAVE_DELAY ms, but never more than
+ * MELO_CONFIG_SAVE_MAX_DELAY ms after the first pending update.
+ */
+#define MELO_CONFIG_SAVE_DELAY 1000
+#define MELO_CONFIG_SAVE_MAX_DELAY 10000
+
+typedef struct {
+  MeloConfigSaveFunc func;
+  gpointer user_data;
+  GDestroyNotify destroy;
+} MeloConfigDeferred;
+
+G_LOCK_DEFINE_STATIC (melo_config_deferred_mutex);
+static GHashTable *melo_config_deferred_hash = NULL;
+static guint melo_config_deferred_timer;
+static gint64 melo_config_deferred_first;
+
 static const gchar *melo_config_types[MELO_CONFIG_TYPE_COUNT] = {
   [MELO_CONFIG_TYPE_NONE] = "none",
   [MELO_CONFIG_TYPE_BOOLEAN] = "boolean",
@@ -350,20 +369,21 @@ melo_config_load_from_file (MeloConfig *config, const gchar *filename)
   /* Close file */
   g_key_file_unref (kfile);
 
+  /* Invalidate cached configurations */
+  melo_jsonrpc_cache_invalidate ("config", NULL);
+
   return TRUE;
 }
 
-gboolean
-melo_config_save_to_file (MeloConfig *config, const gchar *filename)
+static GKeyFile *
+melo_config_to_key_file (MeloConfig *config)
 {
   MeloConfigValues *groups_values = config->priv->values;
   const MeloConfigGroup *groups = config->priv->groups;
-  gboolean ret = FALSE;
   GKeyFile *kfile;
-  gchar *path;
   gint i, j;
 
-  /* Load file */
+  /* Create key file */
   kfile = g_key_file_new ();
 
   /* Lock config access */
@@ -406,6 +426,19 @@ melo_config_save_to_file (MeloConfig *config, const gchar *filename)
   /* Unlock config access */
   g_mutex_unlock (&config->priv->mutex);
 
+  return kfile;
+}
+
+gboolean
+melo_config_save_to_file (MeloConfig *config, const gchar *filename)
+{
+  gboolean ret = FALSE;
+  GKeyFile *kfile;
+  gchar *path;
+
+  /* Get values */
+  kfile = melo_config_to_key_file (config);
+
   /* Save to file (create direcory if necessary) */
   path = g_path_get_dirname (filename);
   if (!g_mkdir_with_parents (path, 0700))
@@ -418,6 +451,20 @@ melo_config_save_to_file (MeloConfig *config, const gchar *filename)
   return ret;
 }
 
+static gchar *
+melo_config_save_func (gpointer user_data, gsize *length)
+{
+  GKeyFile *kfile;
+  gchar *data;
+
+  /* Serialize current values */
+  kfile = melo_config_to_key_file (MELO_CONFIG (user_data));
+  data = g_key_file_to_data (kfile, length, NULL);
+  g_key_file_unref (kfile);
+
+  return data;
+}
+
 static inline gchar *
 melo_config_get_def_file (MeloConfig *config)
 {
@@ -459,6 +506,174 @@ melo_config_save_to_def_file_at_update (MeloConfig *config, gboolean save)
   config->priv->save_to_def = save;
 }
 
+static void
+melo_config_deferred_free (gpointer data)
+{
+  MeloConfigDeferred *def = data;
+
+  if (def->destroy)
+    def->destroy (def->user_data);
+  g_slice_free (MeloConfigDeferred, def);
+}
+
+static gboolean
+melo_config_deferred_timeout (gpointer user_data)
+{
+  GSource *source = g_main_current_source ();
+  gboolean expired;
+
+  /* Timer has expired: clear its ID only if it has not been restarted */
+  G_LOCK (melo_config_deferred_mutex);
+  expired = source &&
+            melo_config_deferred_timer == g_source_get_id (source);
+  if (expired)
+    melo_config_deferred_timer = 0;
+  G_UNLOCK (melo_config_deferred_mutex);
+
+  /* Write pending files, unless the new timer will do it */
+  if (expired)
+    melo_config_flush_deferred ();
+
+  return FALSE;
+}
+
+/**
+ * melo_config_save_deferred:
+ * @filename: the file to write
+ * @func: the function returning the serialized file content
+ * @user_data: the data to pass to @func
+ * @destroy: the function to call to release @user_data
+ *
+ * Schedule a write of @filename. Successive requests on the same file are
+ * coalesced into a single write, done from the main loop once the updates
+ * have settled. The content is generated by @func at write time and the file
+ * is replaced atomically, so a crash during the write never leaves a
+ * truncated file behind.
+ *
+ * If a write is already pending for @filename, @user_data is released
+ * immediately with @destroy.
+ */
+void
+melo_config_save_deferred (const gchar *filename, MeloConfigSaveFunc func,
+                           gpointer user_data, GDestroyNotify destroy)
+{
+  MeloConfigDeferred *def;
+  gint64 now;
+  guint delay;
+
+  /* Lock deferred writer */
+  G_LOCK (melo_config_deferred_mutex);
+
+  /* Create pending list */
+  if (!melo_config_deferred_hash)
+    melo_config_deferred_hash = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                     g_free,
+                                                     melo_config_deferred_free);
+
+  /* Add file to pending list */
+  if (!g_hash_table_contains (melo_config_deferred_hash, filename)) {
+    def = g_slice_new (MeloConfigDeferred);
+    def->func = func;
+    def->user_data = user_data;
+    def->destroy = destroy;
+    g_hash_table_insert (melo_config_deferred_hash, g_strdup (filename), def);
+  } else if (destroy)
+    destroy (user_data);
+
+  /* Restart timer, bounded by maximum delay since first pending update */
+  now = g_get_monotonic_time () / 1000;
+  if (melo_config_deferred_timer)
+    g_source_remove (melo_config_deferred_timer);
+  else
+    melo_config_deferred_first = now;
+  delay = MIN (MELO_CONFIG_SAVE_DELAY,
+               MAX (melo_config_deferred_first + MELO_CONFIG_SAVE_MAX_DELAY -
+                    now, 0));
+  melo_config_deferred_timer = g_timeout_add (delay,
+                                              melo_config_deferred_timeout,
+                                              NULL);
+
+  /* Unlock deferred writer */
+  G_UNLOCK (melo_config_deferred_mutex);
+}
+
+/**
+ * melo_config_cancel_deferred:
+ * @filename: the file
+ *
+ * Cancel a pending write of @filename, if any.
+ */
+void
+melo_config_cancel_deferred (const gchar *filename)
+{
+  MeloConfigDeferred *def = NULL;
+  gpointer key;
+
+  /* Remove file from pending list */
+  G_LOCK (melo_config_deferred_mutex);
+  if (melo_config_deferred_hash)
+    g_hash_table_steal_extended (melo_config_deferred_hash, filename, &key,
+                                 (gpointer *) &def);
+  G_UNLOCK (melo_config_deferred_mutex);
+
+  /* Release outside of lock */
+  if (def) {
+    melo_config_deferred_free (def);
+    g_free (key);
+  }
+}
+
+/**
+ * melo_config_flush_deferred:
+ *
+ * Write immediately all pending files scheduled with
+ * melo_config_save_deferred(). It should be called before exiting.
+ */
+void
+melo_config_flush_deferred (void)
+{
+  MeloConfigDeferred *def;
+  GHashTableIter iter;
+  const gchar *filename;
+  GHashTable *hash;
+
+  /* Take pending list */
+  G_LOCK (melo_config_deferred_mutex);
+  hash = melo_config_deferred_hash;
+  melo_config_deferred_hash = NULL;
+  if (melo_config_deferred_timer) {
+    g_source_remove (melo_config_deferred_timer);
+    melo_config_deferred_timer = 0;
+  }
+  G_UNLOCK (melo_config_deferred_mutex);
+
+  if (!hash)
+    return;
+
+  /* Write files outside of lock */
+  g_hash_table_iter_init (&iter, hash);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &filename,
+                                 (gpointer *) &def)) {
+    gchar *data, *path;
+    gsize len = 0;
+
+    /* Serialize content */
+    data = def->func (def->user_data, &len);
+    if (!data)
+      continue;
+
+    /* Replace file (create directory if necessary) */
+    path = g_path_get_dirname (filename);
+    if (!g_mkdir_with_parents (path, 0700))
+      g_file_set_contents (filename, data, len, NULL);
+    g_free (path);
+    g_free (data);
+  }
+
+  /* Release pending list */
+  g_hash_table_unref (hash);
+}
+
 static inline gboolean
 melo_config_find (MeloConfigPrivate *priv, const gchar *group, const gchar *id,
                   gint *group_idx, gint *item_idx)
@@ -598,6 +813,9 @@ melo_config_set_value (MeloConfig *config, const gchar *group, const gchar *id,
   /* Unlock config access */
   g_mutex_unlock (&priv->mutex);
 
+  /* Invalidate cached configurations */
+  melo_jsonrpc_cache_invalidate ("config", NULL);
+
   return ret;
 }
 
@@ -715,6 +933,55 @@ melo_config_parse (MeloConfig *config, MeloConfigFunc callback,
   return ret;
 }
 
+static gboolean
+melo_config_value_equal (MeloConfigType type, MeloConfigValue *a,
+                         MeloConfigValue *b)
+{
+  switch (type) {
+    case MELO_CONFIG_TYPE_BOOLEAN:
+      return !a->_boolean == !b->_boolean;
+    case MELO_CONFIG_TYPE_INTEGER:
+      return a->_integer == b->_integer;
+    case MELO_CONFIG_TYPE_DOUBLE:
+      return a->_double == b->_double;
+    case MELO_CONFIG_TYPE_STRING:
+      return !g_strcmp0 (a->_string, b->_string);
+    default:
+      ;
+  }
+  return FALSE;
+}
+
+static gboolean
+melo_config_group_changed (MeloConfigContext *context)
+{
+  gint j;
+
+  for (j = 0; j < context->group->items_count; j++)
+    if (context->values->updated_values[j])
+      return TRUE;
+  return FALSE;
+}
+
+/**
+ * melo_config_update:
+ * @config: the configuration
+ * @callback: the function which fills the new values
+ * @user_data: the data to pass to @callback
+ * @error: a pointer to store an error message, or %NULL
+ *
+ * Update a set of values as a single transaction: @callback stages all the
+ * new values, then the check callback of each modified group validates the
+ * whole change set. If all checks succeed, the update callback of each
+ * modified group is called once with all its changes and the values are
+ * committed, otherwise nothing is modified.
+ *
+ * Values equal to the current ones are dropped from the change set (except
+ * for write only items), so groups which are not modified are left untouched
+ * and no file is written when nothing has changed.
+ *
+ * Returns: %TRUE if the values have been updated, %FALSE otherwise.
+ */
 gboolean
 melo_config_update (MeloConfig *config, MeloConfigUpFunc callback,
                     gpointer user_data, gchar **error)
@@ -725,6 +992,7 @@ melo_config_update (MeloConfig *config, MeloConfigUpFunc callback,
     .group_idx = 0,
     .update = TRUE,
   };
+  gboolean changed = FALSE;
   gint i, j;
 
   /* Lock config access */
@@ -740,18 +1008,43 @@ melo_config_update (MeloConfig *config, MeloConfigUpFunc callback,
   if (callback && !callback (&context, user_data, error))
     goto failed;
 
-  /* Check new values */
+  /* Drop values which are not modified (write only items are kept since
+   * they can't be compared with their current value)
+   */
   context.group_idx = 0;
   while (melo_config_next_group (&context, NULL, NULL)) {
-    if (context.values->check_cb &&
+    for (j = 0; j < context.group->items_count; j++) {
+      MeloConfigType type = context.group->items[j].type;
+
+      if (!context.values->updated_values[j] ||
+          context.group->items[j].flags & MELO_CONFIG_FLAGS_WRITE_ONLY ||
+          !melo_config_value_equal (type, &context.values->values[j],
+                                    &context.values->new_values[j]))
+        continue;
+
+      if (type == MELO_CONFIG_TYPE_STRING)
+        g_clear_pointer (&context.values->new_values[j]._string, g_free);
+      context.values->updated_values[j] = FALSE;
+    }
+  }
+
+  /* Check new values of modified groups */
+  context.group_idx = 0;
+  while (melo_config_next_group (&context, NULL, NULL)) {
+    if (context.values->check_cb && melo_config_group_changed (&context) &&
         !context.values->check_cb (&context, context.values->check_data, error))
       goto failed;
   }
 
-  /* Copy updated values */
+  /* Apply modified groups */
   context.group_idx = 0;
   while (melo_config_next_group (&context, NULL, NULL)) {
-    /* Call update callback */
+    /* Group not modified (a check callback can remove updates) */
+    if (!melo_config_group_changed (&context))
+      continue;
+    changed = TRUE;
+
+    /* Call update callback once with all changes of the group */
     if (context.values->update_cb)
       context.values->update_cb (&context, context.values->update_data);
 
@@ -768,12 +1061,30 @@ melo_config_update (MeloConfig *config, MeloConfigUpFunc callback,
   /* Unlock config access */
   g_mutex_unlock (&priv->mutex);
 
-  /* Save to default file */
-  if (priv->save_to_def)
-    melo_config_save_to_def_file (config);
+  /* Nothing has changed */
+  if (!changed)
+    return TRUE;
+
+  /* Invalidate cached configurations */
+  melo_jsonrpc_cache_invalidate ("config", NULL);
+
+  /* Save to default file (deferred) */
+  if (priv->save_to_def) {
+    gchar *filename = melo_config_get_def_file (config);
+    melo_config_save_deferred (filename, melo_config_save_func,
+                               g_object_ref (config), g_object_unref);
+    g_free (filename);
+  }
 
   return TRUE;
 failed:
+  /* Release staged strings */
+  for (i = 0; i < priv->groups_count; i++) {
+    for (j = 0; j < priv->groups[i].items_count; j++) {
+      if (priv->groups[i].items[j].type == MELO_CONFIG_TYPE_STRING)
+        g_clear_pointer (&priv->values[i].new_values[j]._string, g_free);
+    }
+  }
   g_mutex_unlock (&priv->mutex);
   return FALSE;
 }
@@ -971,3 +1282,25 @@ DEFINE_GET_UPDATED(gboolean, boolean)
 DEFINE_GET_UPDATED(gint64, integer)
 DEFINE_GET_UPDATED(gdouble, double)
 DEFINE_GET_UPDATED(const gchar *, string)
+
+#define DEFINE_GET_NEW(_type, _field) \
+gboolean \
+melo_config_get_new_##_field (MeloConfigContext *context, const gchar *id, \
+                             _type *value) \
+{ \
+  MeloConfigValue val; \
+ \
+  if (!context->update || !melo_config_find_item (context, id, NULL, &val)) \
+    return FALSE; \
+ \
+  if (*context->updated_value) \
+    *value = context->new_value->_ ##_field; \
+  else \
+    *value = val._##_field; \
+  return TRUE; \
+}
+
+DEFINE_GET_NEW(gboolean, boolean)
+DEFINE_GET_NEW(gint64, integer)
+DEFINE_GET_NEW(gdouble, double)
+DEFINE_GET_NEW(const gchar *, string)
@@ -123,6 +123,13 @@ gboolean melo_config_save_to_def_file (MeloConfig *config);
 
 void melo_config_save_to_def_file_at_update (MeloConfig *config, gboolean save);
 
+/* Deferred file writer */
+typedef gchar *(*MeloConfigSaveFunc) (gpointer user_data, gsize *length);
+void melo_config_save_deferred (const gchar *filename, MeloConfigSaveFunc func,
+                                gpointer user_data, GDestroyNotify destroy);
+void melo_config_cancel_deferred (const gchar *filename);
+void melo_config_flush_deferred (void);
+
 gboolean melo_config_get_boolean (MeloConfig *config, const gchar *group,
                                  const gchar *id, gboolean *value);
 gboolean melo_config_get_integer (MeloConfig *config, const gchar *group,
@@ -199,6 +206,15 @@ gboolean melo_config_get_updated_string (MeloConfigContext *context,
                                          const gchar **value,
                                          const gchar **old_value);
 
+gboolean melo_config_get_new_boolean (MeloConfigContext *context,
+                                      const gchar *id, gboolean *value);
+gboolean melo_config_get_new_integer (MeloConfigContext *context,
+                                      const gchar *id, gint64 *value);
+gboolean melo_config_get_new_double (MeloConfigContext *context,
+                                     const gchar *id, gdouble *value);
+gboolean melo_config_get_new_string (MeloConfigContext *context,
+                                     const gchar *id, const gchar **value);
+
 G_END_DECLS
 
 #endif /* __MELO_CONFIG_H__ */
@@ -374,6 +374,7 @@ static MeloJSONRPCMethod melo_config_jsonrpc_methods[] = {
     .result = "{\"type\":\"array\"}",
     .callback = melo_config_jsonrpc_get,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONCURRENT | MELO_JSONRPC_FLAGS_CACHE,
   },
   {
     .method = "set",
@@ -19,6 +19,8 @@
  * Boston, MA  02110-1301, USA.
  */
 
+#include <string.h>
+
 #include "melo_event.h"
 
 /**
@@ -46,17 +48,96 @@
  * comprehensible information.
  * The callback is not threaded and long operation or blocking calls should not
  * be done in a callback implementation.
+ *
+ * A client registered with melo_event_register() is called synchronously from
+ * the thread which generates the event. To not slow down the event producers,
+ * a client can be registered with melo_event_register_async() instead: the
+ * events are then queued and delivered later from a #GMainContext.
+ *
+ * For asynchronous clients which don't need every intermediate value of
+ * high-frequency events (as a remote user interface),
+ * melo_event_client_set_coalescing() can be used to limit the delivery rate of
+ * these events.
+ *
+ * When an event is sent to many clients, melo_event_render() can be used from
+ * the callbacks to serialize it only once for all of them.
+ *
+ * Finally, an event journal can be enabled with melo_event_journal_set_size()
+ * to keep the last serialized events with a sequence number: a client which
+ * cannot receive events in real time can then fetch the events it missed with
+ * melo_event_journal_get_since().
  */
 
-/* Event client list */
+/* Event client list: the list is a NULL-terminated array which is never
+ * modified once published. Writers replace the whole array under the lock and
+ * wait for all readers of the previous array to leave before freeing it, so
+ * publishing an event never takes a lock.
+ */
 G_LOCK_DEFINE_STATIC (melo_event_mutex);
-static GList *melo_event_clients = NULL;
+static MeloEventClient **melo_event_clients = NULL;
+static gint melo_event_epoch = 0;
+static gint melo_event_readers[2];
+
+/* Default size of an asynchronous client queue */
+#define MELO_EVENT_QUEUE_SIZE 256
+
+typedef struct {
+  MeloEventRenderFunc func;
+  GBytes *bytes;
+} MeloEventRendered;
+
+typedef struct {
+  gint ref_count;
+  MeloEventType type;
+  guint event;
+  gchar *id;
+  gpointer data;
+  GDestroyNotify free_data_func;
+  MeloEventRendered *rendered;
+} MeloEventRecord;
+
+/* Event currently delivered in this thread */
+static GPrivate melo_event_current = G_PRIVATE_INIT (NULL);
+
+typedef struct {
+  gint seq;
+  MeloEventRecord *rec;
+} MeloEventCell;
+
+typedef struct {
+  GSource source;
+  MeloEventClient *client;
+} MeloEventSource;
 
 struct _MeloEventClient {
   MeloEventCallback callback;
   gpointer user_data;
+
+  /* Asynchronous delivery */
+  GSource *source;
+  MeloEventCell *cells;
+  guint mask;
+  gint tail;
+  guint head;
+  gint scheduled;
+
+  /* Coalescing */
+  guint interval;
+  GHashTable *pending_hash;
+  GQueue pending;
+  gint64 last_flush;
+
+  /* Statistics */
+  gint delivered;
+  gint dropped;
 };
 
+typedef struct {
+  gpointer (*copy) (gconstpointer data);
+  GDestroyNotify free;
+  gboolean coalesce;
+} MeloEventDataFuncs;
+
 typedef struct {
   MeloPlayerState state;
   guint percent;
@@ -67,13 +148,366 @@ typedef struct {
   gboolean has_next;
 } MeloEventPlayerPlaylist;
 
+typedef struct {
+  gint pos;
+  gint64 timestamp;
+} MeloEventPlayerPos;
+
+typedef struct {
+  guint scanned;
+  guint added;
+  guint pending;
+  gboolean done;
+} MeloEventBrowserScan;
+
+typedef struct {
+  guint count;
+  gint64 timestamp;
+} MeloEventNetworkWifiScan;
+
+static const MeloEventDataFuncs *melo_event_get_data_funcs (MeloEventType type,
+                                                            guint event);
+
+static MeloEventClient **
+melo_event_clients_acquire (gint *epoch)
+{
+  gint e;
+
+  /* Enter current epoch: retry if it changed while entering */
+  do {
+    e = g_atomic_int_get (&melo_event_epoch);
+    g_atomic_int_inc (&melo_event_readers[e]);
+    if (g_atomic_int_get (&melo_event_epoch) == e)
+      break;
+    g_atomic_int_add (&melo_event_readers[e], -1);
+  } while (1);
+
+  *epoch = e;
+  return g_atomic_pointer_get (&melo_event_clients);
+}
+
+static void
+melo_event_clients_release (gint epoch)
+{
+  g_atomic_int_add (&melo_event_readers[epoch], -1);
+}
+
+/* Must be called with melo_event_mutex locked */
+static void
+melo_event_clients_replace (MeloEventClient **clients)
+{
+  MeloEventClient **old;
+  gint e;
+
+  /* Publish new list and move readers to next epoch */
+  old = g_atomic_pointer_get (&melo_event_clients);
+  g_atomic_pointer_set (&melo_event_clients, clients);
+  e = g_atomic_int_get (&melo_event_epoch);
+  g_atomic_int_set (&melo_event_epoch, !e);
+
+  /* Wait for readers of previous list */
+  while (g_atomic_int_get (&melo_event_readers[e]))
+    g_thread_yield ();
+
+  g_free (old);
+}
+
+static MeloEventRecord *
+melo_event_record_new (MeloEventType type, guint event, const gchar *id,
+                       gpointer data, GDestroyNotify free_data_func)
+{
+  const MeloEventDataFuncs *funcs;
+  MeloEventRecord *rec;
+
+  rec = g_slice_new (MeloEventRecord);
+  rec->ref_count = 1;
+  rec->type = type;
+  rec->event = event;
+  rec->id = g_strdup (id);
+  rec->rendered = NULL;
+
+  /* Take ownership of data when possible, otherwise use a private copy */
+  funcs = melo_event_get_data_funcs (type, event);
+  if (free_data_func || !funcs) {
+    rec->data = data;
+    rec->free_data_func = free_data_func;
+  } else {
+    rec->data = funcs->copy (data);
+    rec->free_data_func = funcs->free;
+  }
+
+  return rec;
+}
+
+static MeloEventRecord *
+melo_event_record_ref (MeloEventRecord *rec)
+{
+  g_atomic_int_inc (&rec->ref_count);
+  return rec;
+}
+
+static void
+melo_event_record_free_rendered (MeloEventRecord *rec)
+{
+  if (!rec->rendered)
+    return;
+
+  g_bytes_unref (rec->rendered->bytes);
+  g_slice_free (MeloEventRendered, rec->rendered);
+}
+
+static void
+melo_event_record_unref (MeloEventRecord *rec)
+{
+  if (!g_atomic_int_dec_and_test (&rec->ref_count))
+    return;
+
+  if (rec->free_data_func)
+    rec->free_data_func (rec->data);
+  melo_event_record_free_rendered (rec);
+  g_free (rec->id);
+  g_slice_free (MeloEventRecord, rec);
+}
+
+static void
+melo_event_record_call (MeloEventClient *client, MeloEventRecord *rec)
+{
+  gpointer prev;
+
+  /* Save event for melo_event_render(): callbacks can generate events */
+  prev = g_private_get (&melo_event_current);
+  g_private_set (&melo_event_current, rec);
+
+  /* Call event callback */
+  client->callback (client, rec->type, rec->event, rec->id, rec->data,
+                    client->user_data);
+  g_atomic_int_inc (&client->delivered);
+
+  g_private_set (&melo_event_current, prev);
+}
+
+static guint
+melo_event_record_hash (gconstpointer key)
+{
+  const MeloEventRecord *rec = key;
+
+  return (rec->id ? g_str_hash (rec->id) : 0) ^ (rec->type << 16 | rec->event);
+}
+
+static gboolean
+melo_event_record_equal (gconstpointer a, gconstpointer b)
+{
+  const MeloEventRecord *ra = a, *rb = b;
+
+  return ra->type == rb->type && ra->event == rb->event &&
+         !g_strcmp0 (ra->id, rb->id);
+}
+
+/* Can be called from any thread: multiple producers are allowed */
+static gboolean
+melo_event_queue_push (MeloEventClient *client, MeloEventRecord *rec)
+{
+  MeloEventCell *cell;
+  gint pos, seq;
+
+  /* Reserve a cell */
+  do {
+    pos = g_atomic_int_get (&client->tail);
+    cell = &client->cells[pos & client->mask];
+    seq = g_atomic_int_get (&cell->seq);
+
+    /* Queue is full */
+    if (seq - pos < 0)
+      return FALSE;
+  } while (seq != pos ||
+           !g_atomic_int_compare_and_exchange (&client->tail, pos, pos + 1));
+
+  /* Publish record */
+  cell->rec = rec;
+  g_atomic_int_set (&cell->seq, pos + 1);
+
+  return TRUE;
+}
+
+/* Must be called only from the client context (single consumer) */
+static MeloEventRecord *
+melo_event_queue_pop (MeloEventClient *client)
+{
+  MeloEventCell *cell;
+  MeloEventRecord *rec;
+  gint pos = client->head;
+
+  /* Cell is not yet published */
+  cell = &client->cells[pos & client->mask];
+  if (g_atomic_int_get (&cell->seq) != pos + 1)
+    return NULL;
+
+  /* Release cell for next round */
+  rec = cell->rec;
+  cell->rec = NULL;
+  g_atomic_int_set (&cell->seq, pos + client->mask + 1);
+  client->head++;
+
+  return rec;
+}
+
+static void
+melo_event_client_deliver (MeloEventClient *client, MeloEventRecord *rec)
+{
+  melo_event_record_call (client, rec);
+  melo_event_record_unref (rec);
+}
+
+static void
+melo_event_client_flush (MeloEventClient *client)
+{
+  MeloEventRecord *rec;
+
+  /* Send all pending events in order of arrival */
+  while ((rec = g_queue_pop_head (&client->pending))) {
+    g_hash_table_remove (client->pending_hash, rec);
+    melo_event_client_deliver (client, rec);
+  }
+
+  /* Save last delivery time */
+  client->last_flush = g_get_monotonic_time ();
+}
+
+static void
+melo_event_client_coalesce (MeloEventClient *client, MeloEventRecord *rec)
+{
+  GList *link;
+
+  /* Replace value of a pending event or add a new one */
+  link = g_hash_table_lookup (client->pending_hash, rec);
+  if (link) {
+    MeloEventRecord *old = link->data;
+
+    link->data = rec;
+    g_hash_table_replace (client->pending_hash, rec, link);
+    melo_event_record_unref (old);
+  } else {
+    g_queue_push_tail (&client->pending, rec);
+    g_hash_table_insert (client->pending_hash, rec, client->pending.tail);
+  }
+}
+
+static gboolean
+melo_event_source_dispatch (GSource *source, GSourceFunc callback,
+                            gpointer user_data)
+{
+  MeloEventClient *client = ((MeloEventSource *) source)->client;
+  const MeloEventDataFuncs *funcs;
+  MeloEventRecord *rec;
+  gint64 next;
+
+  /* Reset wake up before draining to not miss a new event */
+  g_source_set_ready_time (source, -1);
+  g_atomic_int_set (&client->scheduled, 0);
+
+  /* Deliver queued events */
+  while ((rec = melo_event_queue_pop (client))) {
+    /* Coalesce event */
+    funcs = melo_event_get_data_funcs (rec->type, rec->event);
+    if (client->interval && funcs && funcs->coalesce) {
+      melo_event_client_coalesce (client, rec);
+      continue;
+    }
+
+    /* Send pending events first */
+    if (!g_queue_is_empty (&client->pending))
+      melo_event_client_flush (client);
+
+    melo_event_client_deliver (client, rec);
+  }
+
+  /* Nothing is pending */
+  if (g_queue_is_empty (&client->pending))
+    return G_SOURCE_CONTINUE;
+
+  /* Last delivery is old enough: send now */
+  next = client->last_flush + (gint64) client->interval * 1000;
+  if (g_get_monotonic_time () >= next) {
+    melo_event_client_flush (client);
+    return G_SOURCE_CONTINUE;
+  }
+
+  /* Schedule next delivery, unless a new event has been queued meanwhile */
+  g_source_set_ready_time (source, next);
+  if (g_atomic_int_get (&client->scheduled))
+    g_source_set_ready_time (source, 0);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+melo_event_client_free (MeloEventClient *client)
+{
+  MeloEventRecord *rec;
+
+  /* Free queued events */
+  if (client->cells) {
+    while ((rec = melo_event_queue_pop (client)))
+      melo_event_record_unref (rec);
+    g_free (client->cells);
+  }
+
+  /* Free pending events */
+  g_queue_foreach (&client->pending, (GFunc) melo_event_record_unref, NULL);
+  g_queue_clear (&client->pending);
+  if (client->pending_hash)
+    g_hash_table_unref (client->pending_hash);
+
+  /* Free client */
+  g_slice_free (MeloEventClient, client);
+}
+
+static void
+melo_event_source_finalize (GSource *source)
+{
+  melo_event_client_free (((MeloEventSource *) source)->client);
+}
+
+static GSourceFuncs melo_event_source_funcs = {
+  NULL,
+  NULL,
+  melo_event_source_dispatch,
+  melo_event_source_finalize,
+};
+
+static void
+melo_event_client_add (MeloEventClient *client)
+{
+  MeloEventClient **clients, **old;
+  guint count = 0;
+
+  G_LOCK (melo_event_mutex);
+
+  /* Copy current list and append new client */
+  old = melo_event_clients;
+  while (old && old[count])
+    count++;
+  clients = g_new (MeloEventClient *, count + 2);
+  if (count)
+    memcpy (clients, old, count * sizeof (*clients));
+  clients[count++] = client;
+  clients[count] = NULL;
+
+  /* Replace list */
+  melo_event_clients_replace (clients);
+
+  G_UNLOCK (melo_event_mutex);
+}
+
 /**
  * melo_event_register:
  * @callback: a function to call for new events
  * @user_data: a pointer to associate with @callback
  *
  * Create and register a new event client to receive and parse events coming
- * from Melo objects.
+ * from Melo objects. The @callback is called synchronously from the thread
+ * which has generated the event, so it can be called concurrently from
+ * multiple threads.
  *
  * Returns: (transfer full): a new #MeloEventClient instance or %NULL if failed.
  */
@@ -87,96 +521,743 @@ melo_event_register (MeloEventCallback callback, gpointer user_data)
   if (!client)
     return NULL;
 
-  /* Fill client context */
-  client->callback = callback;
-  client->user_data = user_data;
+  /* Fill client context */
+  client->callback = callback;
+  client->user_data = user_data;
+
+  /* Add client to list */
+  melo_event_client_add (client);
+
+  return client;
+}
+
+/**
+ * melo_event_register_async:
+ * @callback: a function to call for new events
+ * @user_data: a pointer to associate with @callback
+ * @context: (nullable): the #GMainContext used to deliver events, or %NULL for
+ *    the default main context
+ * @queue_size: the maximum number of events waiting for delivery, or 0 to use
+ *    the default size
+ *
+ * Create and register a new asynchronous event client. Unlike with
+ * melo_event_register(), the events are not delivered from the thread which
+ * has generated them: a copy of each event is pushed in a bounded lock-free
+ * queue which is drained by @context. The @callback is then always called
+ * from the thread running @context, and a slow client never delays the event
+ * producers.
+ *
+ * When the queue is full, new events are dropped and counted: the counters
+ * can be retrieved with melo_event_client_get_stats().
+ *
+ * The @queue_size is rounded up to the next power of two.
+ *
+ * Returns: (transfer full): a new #MeloEventClient instance or %NULL if failed.
+ */
+MeloEventClient *
+melo_event_register_async (MeloEventCallback callback, gpointer user_data,
+                           GMainContext *context, guint queue_size)
+{
+  MeloEventClient *client;
+  GSource *source;
+  guint size, i;
+
+  /* Create new client context */
+  client = g_slice_new0 (MeloEventClient);
+  if (!client)
+    return NULL;
+
+  /* Fill client context */
+  client->callback = callback;
+  client->user_data = user_data;
+
+  /* Create event queue */
+  if (!queue_size)
+    queue_size = MELO_EVENT_QUEUE_SIZE;
+  for (size = 1; size < queue_size; size <<= 1);
+  client->cells = g_new (MeloEventCell, size);
+  for (i = 0; i < size; i++) {
+    client->cells[i].seq = i;
+    client->cells[i].rec = NULL;
+  }
+  client->mask = size - 1;
+
+  /* Create delivery source: it owns the client */
+  source = g_source_new (&melo_event_source_funcs, sizeof (MeloEventSource));
+  ((MeloEventSource *) source)->client = client;
+  g_source_set_name (source, "MeloEvent client");
+  g_source_attach (source, context);
+  client->source = source;
+
+  /* Add client to list */
+  melo_event_client_add (client);
+
+  return client;
+}
+
+/**
+ * melo_event_unregister:
+ * @client: an event client
+ *
+ * Unregister and destroy an event client. When the function returns, the
+ * callback of @client is not called anymore.
+ *
+ * This function must not be called from the callback of a client registered
+ * with melo_event_register(). For a client registered with
+ * melo_event_register_async(), it must be called from the thread running the
+ * delivery context.
+ */
+void
+melo_event_unregister (MeloEventClient *client)
+{
+  MeloEventClient **clients, **old;
+  guint i, j;
+
+  G_LOCK (melo_event_mutex);
+
+  /* Copy current list without client */
+  old = melo_event_clients;
+  for (i = 0; old && old[i]; i++);
+  clients = i > 1 ? g_new (MeloEventClient *, i) : NULL;
+  for (i = 0, j = 0; clients && old[i]; i++)
+    if (old[i] != client)
+      clients[j++] = old[i];
+  if (clients)
+    clients[j] = NULL;
+
+  /* Replace list: no more event is pushed on client after */
+  melo_event_clients_replace (clients);
+
+  G_UNLOCK (melo_event_mutex);
+
+  /* Free client */
+  if (client->source) {
+    g_source_destroy (client->source);
+    g_source_unref (client->source);
+  } else
+    melo_event_client_free (client);
+}
+
+/**
+ * melo_event_client_set_coalescing:
+ * @client: an asynchronous event client
+ * @interval: the minimal interval between two deliveries (in ms), or 0 to
+ *    disable coalescing
+ *
+ * Enable the coalescing of high-frequency events for @client, which must have
+ * been registered with melo_event_register_async(). When enabled, the events
+ * which only report a new value (as #MELO_EVENT_PLAYER_SEEK or
+ * #MELO_EVENT_PLAYER_BUFFERING) are delivered at most once every @interval ms:
+ * between two deliveries, only the latest value of each (type, event, id) is
+ * kept and older values are dropped.
+ *
+ * Other events are never coalesced: they are delivered immediately, just after
+ * all pending coalesced events, in order to keep the event order consistent.
+ *
+ * This function must be called from the thread running the delivery context of
+ * @client.
+ */
+void
+melo_event_client_set_coalescing (MeloEventClient *client, guint interval)
+{
+  g_return_if_fail (client->source);
+
+  /* Deliver pending events with previous settings */
+  if (!g_queue_is_empty (&client->pending))
+    melo_event_client_flush (client);
+
+  /* Create pending event list */
+  if (interval && !client->pending_hash)
+    client->pending_hash = g_hash_table_new (melo_event_record_hash,
+                                             melo_event_record_equal);
+  client->interval = interval;
+}
+
+/**
+ * melo_event_client_get_stats:
+ * @client: an event client
+ * @delivered: (out) (nullable): a pointer to hold the count of events
+ *    delivered to the callback, or %NULL
+ * @dropped: (out) (nullable): a pointer to hold the count of events dropped
+ *    because the queue was full, or %NULL
+ *
+ * Get the delivery counters of @client. Events replaced by coalescing are not
+ * counted in @delivered nor in @dropped.
+ */
+void
+melo_event_client_get_stats (MeloEventClient *client, guint *delivered,
+                             guint *dropped)
+{
+  if (delivered)
+    *delivered = g_atomic_int_get (&client->delivered);
+  if (dropped)
+    *dropped = g_atomic_int_get (&client->dropped);
+}
+
+/* Event journal: a ring buffer of the last serialized events, indexed by their
+ * sequence number modulo the journal size.
+ */
+typedef struct {
+  guint64 seq;
+  GBytes *event;
+} MeloEventJournalEntry;
+
+static GMutex melo_event_journal_mutex;
+static GCond melo_event_journal_cond;
+static MeloEventJournalEntry *melo_event_journal = NULL;
+static guint melo_event_journal_size = 0;
+static guint64 melo_event_journal_seq = 0;
+static guint64 melo_event_journal_first = 1;
+
+/**
+ * melo_event_journal_set_size:
+ * @size: the maximum number of events kept in the journal, or 0 to disable it
+ *
+ * Enable and resize the event journal. The journal keeps the last @size events
+ * added with melo_event_journal_add(), in order to let a client which cannot
+ * receive events in real time catch up on what it missed with
+ * melo_event_journal_get_since().
+ *
+ * The current content of the journal is dropped, but the sequence numbers are
+ * never reset, so a client will detect the missed events.
+ */
+void
+melo_event_journal_set_size (guint size)
+{
+  guint i;
+
+  g_mutex_lock (&melo_event_journal_mutex);
+
+  /* Free previous journal */
+  for (i = 0; i < melo_event_journal_size; i++)
+    if (melo_event_journal[i].event)
+      g_bytes_unref (melo_event_journal[i].event);
+  g_free (melo_event_journal);
+
+  /* Create new journal */
+  melo_event_journal = size ? g_new0 (MeloEventJournalEntry, size) : NULL;
+  melo_event_journal_size = size;
+  melo_event_journal_first = melo_event_journal_seq + 1;
+
+  /* Wake up waiting clients */
+  g_cond_broadcast (&melo_event_journal_cond);
+
+  g_mutex_unlock (&melo_event_journal_mutex);
+}
+
+/**
+ * melo_event_journal_add:
+ * @event: a serialized event, as returned by melo_event_render()
+ *
+ * Add a serialized event to the journal and wake up all clients waiting in
+ * melo_event_journal_get_since(). The oldest event is dropped when the journal
+ * is full.
+ *
+ * Returns: the sequence number of the new event, or 0 if the journal is
+ * disabled.
+ */
+guint64
+melo_event_journal_add (GBytes *event)
+{
+  MeloEventJournalEntry *entry;
+  guint64 seq = 0;
+
+  g_mutex_lock (&melo_event_journal_mutex);
+
+  /* Replace oldest entry */
+  if (melo_event_journal_size) {
+    seq = ++melo_event_journal_seq;
+    entry = &melo_event_journal[seq % melo_event_journal_size];
+    if (entry->event)
+      g_bytes_unref (entry->event);
+    entry->seq = seq;
+    entry->event = g_bytes_ref (event);
+
+    /* Wake up waiting clients */
+    g_cond_broadcast (&melo_event_journal_cond);
+  }
+
+  g_mutex_unlock (&melo_event_journal_mutex);
+
+  return seq;
+}
+
+static void
+melo_event_journal_cancelled (GCancellable *cancellable, gpointer user_data)
+{
+  /* Wake up waiting clients */
+  g_mutex_lock (&melo_event_journal_mutex);
+  g_cond_broadcast (&melo_event_journal_cond);
+  g_mutex_unlock (&melo_event_journal_mutex);
+}
+
+/**
+ * melo_event_journal_get_since:
+ * @seq: the sequence number of the last event already received, or 0
+ * @timeout: the maximum time to wait for a new event (in ms)
+ * @cancellable: (nullable): a #GCancellable to stop waiting, or %NULL
+ * @last_seq: (out): a pointer to hold the sequence number of the last event
+ *    returned
+ * @missed: (out) (nullable): a pointer to hold %TRUE if some events newer than
+ *    @seq have already been dropped from the journal, or %NULL
+ *
+ * Get all events of the journal newer than @seq. If no event is available, the
+ * function blocks until a new event is added, @timeout expires or @cancellable
+ * is cancelled (as when the client is disconnected): it should not be called
+ * from a main loop.
+ *
+ * The events are returned in order: the sequence number of the last one is
+ * stored in @last_seq and should be used for the next call. If @seq is newer
+ * than the journal (as after a restart), all events are returned and @missed is
+ * set.
+ *
+ * Returns: (transfer full) (element-type GBytes): a #GPtrArray of serialized
+ * events. After use, call g_ptr_array_unref().
+ */
+GPtrArray *
+melo_event_journal_get_since (guint64 seq, guint timeout,
+                              GCancellable *cancellable, guint64 *last_seq,
+                              gboolean *missed)
+{
+  MeloEventJournalEntry *entry;
+  gboolean miss = FALSE;
+  GPtrArray *events;
+  guint64 first, s;
+  gulong id;
+  gint64 end;
+
+  /* Wake up on cancellation */
+  id = g_cancellable_connect (cancellable,
+                              G_CALLBACK (melo_event_journal_cancelled), NULL,
+                              NULL);
+
+  g_mutex_lock (&melo_event_journal_mutex);
+
+  /* Sequence number comes from a previous instance */
+  if (seq > melo_event_journal_seq) {
+    seq = 0;
+    miss = TRUE;
+  }
+
+  /* Wait for new events */
+  end = g_get_monotonic_time () + timeout * G_TIME_SPAN_MILLISECOND;
+  while (melo_event_journal_size && seq == melo_event_journal_seq &&
+         !g_cancellable_is_cancelled (cancellable) &&
+         g_cond_wait_until (&melo_event_journal_cond,
+                            &melo_event_journal_mutex, end));
+
+  /* Get first event available: events older than the last resize are lost */
+  first = melo_event_journal_seq + 1;
+  if (melo_event_journal_size)
+    first = melo_event_journal_seq >= melo_event_journal_size ?
+            melo_event_journal_seq - melo_event_journal_size + 1 : 1;
+  first = MAX (first, melo_event_journal_first);
+  if (seq + 1 < first) {
+    seq = first - 1;
+    miss = TRUE;
+  }
+
+  /* Get events */
+  events = g_ptr_array_new_full (melo_event_journal_seq - seq,
+                                 (GDestroyNotify) g_bytes_unref);
+  for (s = seq + 1; s <= melo_event_journal_seq; s++) {
+    entry = &melo_event_journal[s % melo_event_journal_size];
+    g_ptr_array_add (events, g_bytes_ref (entry->event));
+  }
+  *last_seq = melo_event_journal_seq;
+
+  g_mutex_unlock (&melo_event_journal_mutex);
+
+  /* Stop watching cancellation */
+  g_cancellable_disconnect (cancellable, id);
+
+  if (missed)
+    *missed = miss;
+
+  return events;
+}
+
+static const gchar *melo_event_type_string[] = {
+  [MELO_EVENT_TYPE_GENERAL] = "general",
+  [MELO_EVENT_TYPE_MODULE] = "module",
+  [MELO_EVENT_TYPE_BROWSER] = "browser",
+  [MELO_EVENT_TYPE_PLAYER] = "player",
+  [MELO_EVENT_TYPE_PLAYLIST] = "playlist",
+  [MELO_EVENT_TYPE_SERVICE] = "service",
+  [MELO_EVENT_TYPE_SINK] = "sink",
+  [MELO_EVENT_TYPE_NETWORK] = "network",
+};
+
+/**
+ * melo_event_type_to_string:
+ * @type: an event type
+ *
+ * Convert a #MeloEventType to a string.
+ *
+ * Returns: a string with the translated #MeloEventType, %NULL otherwise.
+ */
+const gchar *
+melo_event_type_to_string (MeloEventType type)
+{
+  if (type < MELO_EVENT_TYPE_COUNT)
+    return melo_event_type_string[type];
+  return NULL;
+}
+
+/**
+ * melo_event_new:
+ * @type: the event type
+ * @event: the sub-type of the event
+ * @id: the ID of the object instance
+ * @data: the event data
+ * @free_data_func: a function called to free @data
+ *
+ * Create a new event and forward it to all registered clients. This function
+ * should be used only for custom or global events with
+ * #MELO_EVENT_TYPE_GENERAL. For other event types, please consider using
+ * function already defined.
+ *
+ * Since asynchronous clients receive the event later, @data of a custom event
+ * must remain valid until @free_data_func is called: it should not point to a
+ * temporary variable.
+ */
+void
+melo_event_new (MeloEventType type, guint event, const gchar *id, gpointer data,
+                GDestroyNotify free_data_func)
+{
+  MeloEventRecord tmp = {
+    .ref_count = 1, .type = type, .event = event, .id = (gchar *) id,
+    .data = data, .free_data_func = NULL, .rendered = NULL,
+  };
+  MeloEventClient **clients;
+  MeloEventRecord *rec = &tmp;
+  gint epoch;
+  guint i;
+
+  /* Get current client list */
+  clients = melo_event_clients_acquire (&epoch);
+
+  /* Asynchronous clients need a shared copy of the event */
+  for (i = 0; clients && clients[i]; i++) {
+    if (clients[i]->source) {
+      rec = melo_event_record_new (type, event, id, data, free_data_func);
+      break;
+    }
+  }
+
+  /* Send event to all registered clients */
+  for (i = 0; clients && clients[i]; i++) {
+    MeloEventClient *client = clients[i];
+
+    /* Asynchronous client: queue the shared copy */
+    if (client->source) {
+      if (!melo_event_queue_push (client, melo_event_record_ref (rec))) {
+        melo_event_record_unref (rec);
+        g_atomic_int_inc (&client->dropped);
+        continue;
+      }
+
+      /* Wake up client context */
+      if (g_atomic_int_compare_and_exchange (&client->scheduled, 0, 1))
+        g_source_set_ready_time (client->source, 0);
+      continue;
+    }
+
+    /* Call event callback */
+    melo_event_record_call (client, rec);
+  }
+
+  /* Release client list */
+  melo_event_clients_release (epoch);
+
+  /* Free event data: the shared copy owns it when created */
+  if (rec != &tmp) {
+    melo_event_record_unref (rec);
+    return;
+  }
+  melo_event_record_free_rendered (&tmp);
+  if (free_data_func)
+    free_data_func (data);
+}
+
+/**
+ * melo_event_render:
+ * @func: the function used to render the event
+ *
+ * Get a rendering of the event currently delivered, as a serialized JSON
+ * object. The event is rendered by @func on first call only: the result is
+ * then shared by all clients which receive the same event, so it is rendered
+ * only once whatever the number of clients.
+ *
+ * Only one rendering is kept per event: if another @func is used for the same
+ * event, the result is not shared.
+ *
+ * This function must be called only from a #MeloEventCallback.
+ *
+ * Returns: (transfer full): a #GBytes holding the rendering of the event, or
+ * %NULL on error. The data is always nul-terminated but the nul character is
+ * not included in the size. After use, call g_bytes_unref().
+ */
+GBytes *
+melo_event_render (MeloEventRenderFunc func)
+{
+  MeloEventRendered *rendered;
+  MeloEventRecord *rec;
+  GBytes *bytes;
+  gchar *str;
+
+  /* Not called from a callback */
+  rec = g_private_get (&melo_event_current);
+  g_return_val_if_fail (rec, NULL);
+
+  /* Event has already been rendered */
+  rendered = g_atomic_pointer_get (&rec->rendered);
+  if (rendered && rendered->func == func)
+    return g_bytes_ref (rendered->bytes);
+
+  /* Render event */
+  str = func (rec->type, rec->event, rec->id, rec->data);
+  if (!str)
+    return NULL;
+  bytes = g_bytes_new_take (str, strlen (str));
+  if (rendered)
+    return bytes;
+
+  /* Share rendering: another thread can render the event in same time */
+  rendered = g_slice_new (MeloEventRendered);
+  rendered->func = func;
+  rendered->bytes = g_bytes_ref (bytes);
+  if (!g_atomic_pointer_compare_and_exchange (&rec->rendered, NULL,
+                                              rendered)) {
+    g_bytes_unref (rendered->bytes);
+    g_slice_free (MeloEventRendered, rendered);
+  }
+
+  return bytes;
+}
+
+/* Copy functions of queued events */
+static gpointer
+melo_event_copy_value (gconstpointer data)
+{
+  return (gpointer) data;
+}
+
+typedef struct {
+  MeloPlayerInfo info;
+  gchar *name;
+  gchar *playlist_id;
+} MeloEventPlayerInfo;
+
+static gpointer
+melo_event_copy_info (gconstpointer data)
+{
+  const MeloPlayerInfo *info = data;
+  MeloEventPlayerInfo *evt;
+
+  if (!info)
+    return NULL;
+
+  /* Copy info and its strings: the structure can be parsed as MeloPlayerInfo */
+  evt = g_slice_new (MeloEventPlayerInfo);
+  evt->info = *info;
+  evt->info.name = evt->name = g_strdup (info->name);
+  evt->info.playlist_id = evt->playlist_id = g_strdup (info->playlist_id);
+
+  return evt;
+}
+
+static void
+melo_event_free_info (gpointer data)
+{
+  MeloEventPlayerInfo *evt = data;
+
+  if (!evt)
+    return;
+
+  g_free (evt->name);
+  g_free (evt->playlist_id);
+  g_slice_free (MeloEventPlayerInfo, evt);
+}
+
+static gpointer
+melo_event_copy_state (gconstpointer data)
+{
+  return g_memdup (data, sizeof (MeloPlayerState));
+}
+
+static gpointer
+melo_event_copy_buffering (gconstpointer data)
+{
+  return g_memdup (data, sizeof (MeloEventPlayerBuffering));
+}
+
+static gpointer
+melo_event_copy_playlist (gconstpointer data)
+{
+  return g_memdup (data, sizeof (MeloEventPlayerPlaylist));
+}
+
+static gpointer
+melo_event_copy_pos (gconstpointer data)
+{
+  return g_memdup (data, sizeof (MeloEventPlayerPos));
+}
+
+static gpointer
+melo_event_copy_scan (gconstpointer data)
+{
+  return g_memdup (data, sizeof (MeloEventBrowserScan));
+}
+
+static gpointer
+melo_event_copy_sink_stats (gconstpointer data)
+{
+  return g_memdup (data, sizeof (MeloSinkStats));
+}
+
+static gpointer
+melo_event_copy_wifi_scan (gconstpointer data)
+{
+  return g_memdup (data, sizeof (MeloEventNetworkWifiScan));
+}
+
+static gpointer
+melo_event_copy_change (gconstpointer data)
+{
+  return melo_playlist_change_copy ((const MeloPlaylistChange *) data);
+}
+
+static void
+melo_event_free_change (gpointer data)
+{
+  melo_playlist_change_free ((MeloPlaylistChange *) data);
+}
+
+static gpointer
+melo_event_copy_double (gconstpointer data)
+{
+  return g_memdup (data, sizeof (gdouble));
+}
+
+static gpointer
+melo_event_copy_boolean (gconstpointer data)
+{
+  return g_memdup (data, sizeof (gboolean));
+}
+
+static gpointer
+melo_event_copy_string (gconstpointer data)
+{
+  return g_strdup (data);
+}
 
-  /* Add client to list */
-  G_LOCK (melo_event_mutex);
-  melo_event_clients = g_list_prepend (melo_event_clients, client);
-  G_UNLOCK (melo_event_mutex);
+static gpointer
+melo_event_copy_status (gconstpointer data)
+{
+  return data ? melo_player_status_ref ((MeloPlayerStatus *) data) : NULL;
+}
 
-  return client;
+static void
+melo_event_free_status (gpointer data)
+{
+  if (data)
+    melo_player_status_unref ((MeloPlayerStatus *) data);
 }
 
-/**
- * melo_event_unregister:
- * @client: an event client
- *
- * Unregister and destroy an event client.
- */
-void
-melo_event_unregister (MeloEventClient *client)
+static gpointer
+melo_event_copy_tags (gconstpointer data)
 {
-  /* Remove from list */
-  G_LOCK (melo_event_mutex);
-  melo_event_clients = g_list_remove (melo_event_clients, client);
-  G_UNLOCK (melo_event_mutex);
+  return data ? melo_tags_ref ((MeloTags *) data) : NULL;
+}
 
-  /* Free client */
-  g_slice_free (MeloEventClient, client);
+static void
+melo_event_free_tags (gpointer data)
+{
+  if (data)
+    melo_tags_unref ((MeloTags *) data);
 }
 
-static const gchar *melo_event_type_string[] = {
-  [MELO_EVENT_TYPE_GENERAL] = "general",
-  [MELO_EVENT_TYPE_MODULE] = "module",
-  [MELO_EVENT_TYPE_BROWSER] = "browser",
-  [MELO_EVENT_TYPE_PLAYER] = "player",
-  [MELO_EVENT_TYPE_PLAYLIST] = "playlist",
-};
+static gpointer
+melo_event_copy_service (gconstpointer data)
+{
+  return melo_avahi_service_copy ((const MeloAvahiService *) data);
+}
 
-/**
- * melo_event_type_to_string:
- * @type: an event type
- *
- * Convert a #MeloEventType to a string.
- *
- * Returns: a string with the translated #MeloEventType, %NULL otherwise.
- */
-const gchar *
-melo_event_type_to_string (MeloEventType type)
+static void
+melo_event_free_service (gpointer data)
 {
-  if (type < MELO_EVENT_TYPE_COUNT)
-    return melo_event_type_string[type];
-  return NULL;
+  melo_avahi_service_free ((MeloAvahiService *) data);
 }
 
-/**
- * melo_event_new:
- * @type: the event type
- * @event: the sub-type of the event
- * @id: the ID of the object instance
- * @data: the event data
- * @free_data_func: a function called to free @data
- *
- * Create a new event and forward it to all registered clients. This function
- * should be used only for custom or global events with
- * #MELO_EVENT_TYPE_GENERAL. For other event types, please consider using
- * function already defined.
+/* Player event copy functions: events which only report a new value (only the
+ * last one is useful) can be coalesced.
  */
-void
-melo_event_new (MeloEventType type, guint event, const gchar *id, gpointer data,
-                GDestroyNotify free_data_func)
-{
-  GList *l;
+static const MeloEventDataFuncs melo_event_player_funcs[] = {
+  [MELO_EVENT_PLAYER_NEW] = { melo_event_copy_info, melo_event_free_info,
+                              FALSE },
+  [MELO_EVENT_PLAYER_DELETE] = { melo_event_copy_value, NULL, FALSE },
+  [MELO_EVENT_PLAYER_STATUS] = { melo_event_copy_status,
+                                 melo_event_free_status, TRUE },
+  [MELO_EVENT_PLAYER_STATE] = { melo_event_copy_state, g_free, TRUE },
+  [MELO_EVENT_PLAYER_BUFFERING] = { melo_event_copy_buffering, g_free, TRUE },
+  [MELO_EVENT_PLAYER_SEEK] = { melo_event_copy_value, NULL, TRUE },
+  [MELO_EVENT_PLAYER_DURATION] = { melo_event_copy_value, NULL, TRUE },
+  [MELO_EVENT_PLAYER_PLAYLIST] = { melo_event_copy_playlist, g_free, TRUE },
+  [MELO_EVENT_PLAYER_VOLUME] = { melo_event_copy_double, g_free, TRUE },
+  [MELO_EVENT_PLAYER_MUTE] = { melo_event_copy_boolean, g_free, TRUE },
+  [MELO_EVENT_PLAYER_NAME] = { melo_event_copy_string, g_free, TRUE },
+  [MELO_EVENT_PLAYER_ERROR] = { melo_event_copy_string, g_free, FALSE },
+  [MELO_EVENT_PLAYER_TAGS] = { melo_event_copy_tags, melo_event_free_tags,
+                               TRUE },
+  [MELO_EVENT_PLAYER_POS] = { melo_event_copy_pos, g_free, TRUE },
+};
 
-  /* Lock client list */
-  G_LOCK (melo_event_mutex);
+static const MeloEventDataFuncs melo_event_browser_funcs[] = {
+  [MELO_EVENT_BROWSER_SCAN] = { melo_event_copy_scan, g_free, TRUE },
+};
 
-  /* Send event to all registered clients */
-  for (l = melo_event_clients; l != NULL; l = l->next) {
-    MeloEventClient *client = (MeloEventClient *) l->data;
+/* Playlist changes must all be delivered, in order */
+static const MeloEventDataFuncs melo_event_playlist_funcs[] = {
+  [MELO_EVENT_PLAYLIST_CHANGE] = { melo_event_copy_change,
+                                   melo_event_free_change, FALSE },
+  [MELO_EVENT_PLAYLIST_RESET] = { melo_event_copy_value, NULL, TRUE },
+};
 
-    /* Call event callback */
-    client->callback(client, type, event, id, data, client->user_data);
-  }
+/* Service changes must all be delivered, in order */
+static const MeloEventDataFuncs melo_event_service_funcs[] = {
+  [MELO_EVENT_SERVICE_ADD] = { melo_event_copy_service,
+                               melo_event_free_service, FALSE },
+  [MELO_EVENT_SERVICE_UPDATE] = { melo_event_copy_service,
+                                  melo_event_free_service, FALSE },
+  [MELO_EVENT_SERVICE_REMOVE] = { melo_event_copy_service,
+                                  melo_event_free_service, FALSE },
+};
 
-  /* Unlock client list */
-  G_UNLOCK (melo_event_mutex);
+static const MeloEventDataFuncs melo_event_sink_funcs[] = {
+  [MELO_EVENT_SINK_STATS] = { melo_event_copy_sink_stats, g_free, TRUE },
+};
 
-  /* Free event data */
-  if (free_data_func)
-    free_data_func (data);
+static const MeloEventDataFuncs melo_event_network_funcs[] = {
+  [MELO_EVENT_NETWORK_WIFI_SCAN] = { melo_event_copy_wifi_scan, g_free, TRUE },
+};
+
+static const MeloEventDataFuncs *
+melo_event_get_data_funcs (MeloEventType type, guint event)
+{
+  if (type == MELO_EVENT_TYPE_PLAYER && event < MELO_EVENT_PLAYER_COUNT)
+    return &melo_event_player_funcs[event];
+  if (type == MELO_EVENT_TYPE_BROWSER && event < MELO_EVENT_BROWSER_COUNT)
+    return &melo_event_browser_funcs[event];
+  if (type == MELO_EVENT_TYPE_PLAYLIST && event < MELO_EVENT_PLAYLIST_COUNT)
+    return &melo_event_playlist_funcs[event];
+  if (type == MELO_EVENT_TYPE_SERVICE && event < MELO_EVENT_SERVICE_COUNT)
+    return &melo_event_service_funcs[event];
+  if (type == MELO_EVENT_TYPE_SINK && event < MELO_EVENT_SINK_COUNT)
+    return &melo_event_sink_funcs[event];
+  if (type == MELO_EVENT_TYPE_NETWORK && event < MELO_EVENT_NETWORK_COUNT)
+    return &melo_event_network_funcs[event];
+  return NULL;
 }
 
 #define melo_event_player(event, id, data, free) \
@@ -358,6 +1439,22 @@ melo_event_player_tags (const gchar *id, MeloTags *tags)
   melo_event_player (TAGS, id, tags, NULL);
 }
 
+/**
+ * melo_event_player_pos:
+ * @id: the #MeloPlayer ID
+ * @pos: the position in the media stream (in ms)
+ * @timestamp: the monotonic time at which @pos has been sampled (in ms)
+ *
+ * The position of the player has been sampled. While the player is playing,
+ * the position can be extrapolated from this event until the next one.
+ */
+void
+melo_event_player_pos (const gchar *id, gint pos, gint64 timestamp)
+{
+  MeloEventPlayerPos evt = { .pos = pos, .timestamp = timestamp };
+  melo_event_player (POS, id, &evt, NULL);
+}
+
 /**
  * melo_event_player_new_parse:
  * @data: the event data to parse
@@ -540,6 +1637,25 @@ melo_event_player_tags_parse (gpointer data)
   return (MeloTags *) data;
 }
 
+/**
+ * melo_event_player_pos_parse:
+ * @data: the event data to parse
+ * @timestamp: a pointer to store the time of the sample (in ms), or %NULL
+ *
+ * Parse the event data for a #MELO_EVENT_PLAYER_POS.
+ *
+ * Returns: the position in the media (in ms).
+ */
+gint
+melo_event_player_pos_parse (gpointer data, gint64 *timestamp)
+{
+  MeloEventPlayerPos *evt = (MeloEventPlayerPos *) data;
+
+  if (timestamp)
+    *timestamp = evt->timestamp;
+  return evt->pos;
+}
+
 static const gchar *melo_event_player_string[] = {
   [MELO_EVENT_PLAYER_NEW] = "new",
   [MELO_EVENT_PLAYER_DELETE] = "delete",
@@ -554,6 +1670,7 @@ static const gchar *melo_event_player_string[] = {
   [MELO_EVENT_PLAYER_NAME] = "name",
   [MELO_EVENT_PLAYER_ERROR] = "error",
   [MELO_EVENT_PLAYER_TAGS] = "tags",
+  [MELO_EVENT_PLAYER_POS] = "pos",
 };
 
 /**
@@ -571,3 +1688,332 @@ melo_event_player_to_string (MeloEventPlayer event)
     return melo_event_player_string[event];
   return NULL;
 }
+
+/**
+ * melo_event_browser_scan:
+ * @id: the #MeloBrowser ID
+ * @scanned: the number of files scanned
+ * @added: the number of files added or updated in library
+ * @pending: the number of files and folders still to scan
+ * @done: the scan is finished
+ *
+ * The progress of the library scan done for the browser has been updated.
+ */
+void
+melo_event_browser_scan (const gchar *id, guint scanned, guint added,
+                         guint pending, gboolean done)
+{
+  MeloEventBrowserScan evt = {
+    .scanned = scanned, .added = added, .pending = pending, .done = done,
+  };
+  melo_event_new (MELO_EVENT_TYPE_BROWSER, MELO_EVENT_BROWSER_SCAN, id, &evt,
+                  NULL);
+}
+
+/**
+ * melo_event_browser_scan_parse:
+ * @data: the event data to parse
+ * @scanned: a pointer to hold the number of files scanned, or %NULL
+ * @added: a pointer to hold the number of files added, or %NULL
+ * @pending: a pointer to hold the number of items to scan, or %NULL
+ * @done: a pointer to hold the end of scan flag, or %NULL
+ *
+ * Parse the event data for a #MELO_EVENT_BROWSER_SCAN.
+ */
+void
+melo_event_browser_scan_parse (gpointer data, guint *scanned, guint *added,
+                               guint *pending, gboolean *done)
+{
+  MeloEventBrowserScan *evt = (MeloEventBrowserScan *) data;
+  if (scanned)
+    *scanned = evt->scanned;
+  if (added)
+    *added = evt->added;
+  if (pending)
+    *pending = evt->pending;
+  if (done)
+    *done = evt->done;
+}
+
+static const gchar *melo_event_browser_string[] = {
+  [MELO_EVENT_BROWSER_SCAN] = "scan",
+};
+
+/**
+ * melo_event_browser_to_string:
+ * @event: a browser sub-type event
+ *
+ * Convert a #MeloEventBrowser to a string.
+ *
+ * Returns: a string with the translated #MeloEventBrowser, %NULL otherwise.
+ */
+const gchar *
+melo_event_browser_to_string (MeloEventBrowser event)
+{
+  if (event < MELO_EVENT_BROWSER_COUNT)
+    return melo_event_browser_string[event];
+  return NULL;
+}
+
+/**
+ * melo_event_playlist_change:
+ * @id: the #MeloPlaylist ID
+ * @change: the #MeloPlaylistChange done in playlist
+ *
+ * A media has been inserted, removed, moved or updated in the playlist.
+ */
+void
+melo_event_playlist_change (const gchar *id, const MeloPlaylistChange *change)
+{
+  melo_event_new (MELO_EVENT_TYPE_PLAYLIST, MELO_EVENT_PLAYLIST_CHANGE, id,
+                  (gpointer) change, NULL);
+}
+
+/**
+ * melo_event_playlist_reset:
+ * @id: the #MeloPlaylist ID
+ * @revision: the new revision of the playlist
+ *
+ * The playlist has been emptied or changed too much to be described with
+ * changes: the whole list must be retrieved again.
+ */
+void
+melo_event_playlist_reset (const gchar *id, guint revision)
+{
+  melo_event_new (MELO_EVENT_TYPE_PLAYLIST, MELO_EVENT_PLAYLIST_RESET, id,
+                  GUINT_TO_POINTER (revision), NULL);
+}
+
+/**
+ * melo_event_playlist_change_parse:
+ * @data: the event data to parse
+ *
+ * Parse the event data for a #MELO_EVENT_PLAYLIST_CHANGE.
+ *
+ * Returns: (transfer none): the #MeloPlaylistChange done in playlist.
+ */
+const MeloPlaylistChange *
+melo_event_playlist_change_parse (gpointer data)
+{
+  return (const MeloPlaylistChange *) data;
+}
+
+/**
+ * melo_event_playlist_reset_parse:
+ * @data: the event data to parse
+ *
+ * Parse the event data for a #MELO_EVENT_PLAYLIST_RESET.
+ *
+ * Returns: the new revision of the playlist.
+ */
+guint
+melo_event_playlist_reset_parse (gpointer data)
+{
+  return GPOINTER_TO_UINT (data);
+}
+
+static const gchar *melo_event_playlist_string[] = {
+  [MELO_EVENT_PLAYLIST_CHANGE] = "change",
+  [MELO_EVENT_PLAYLIST_RESET] = "reset",
+};
+
+/**
+ * melo_event_playlist_to_string:
+ * @event: a playlist sub-type event
+ *
+ * Convert a #MeloEventPlaylist to a string.
+ *
+ * Returns: a string with the translated #MeloEventPlaylist, %NULL otherwise.
+ */
+const gchar *
+melo_event_playlist_to_string (MeloEventPlaylist event)
+{
+  if (event < MELO_EVENT_PLAYLIST_COUNT)
+    return melo_event_playlist_string[event];
+  return NULL;
+}
+
+/**
+ * melo_event_service_add:
+ * @id: the service type
+ * @service: the #MeloAvahiService discovered
+ *
+ * A new service has been discovered and resolved on the network.
+ */
+void
+melo_event_service_add (const gchar *id, const MeloAvahiService *service)
+{
+  melo_event_new (MELO_EVENT_TYPE_SERVICE, MELO_EVENT_SERVICE_ADD, id,
+                  (gpointer) service, NULL);
+}
+
+/**
+ * melo_event_service_update:
+ * @id: the service type
+ * @service: the #MeloAvahiService updated
+ *
+ * The port, the address or the TXT record of a service has changed.
+ */
+void
+melo_event_service_update (const gchar *id, const MeloAvahiService *service)
+{
+  melo_event_new (MELO_EVENT_TYPE_SERVICE, MELO_EVENT_SERVICE_UPDATE, id,
+                  (gpointer) service, NULL);
+}
+
+/**
+ * melo_event_service_remove:
+ * @id: the service type
+ * @service: the #MeloAvahiService removed
+ *
+ * A service has disappeared from the network.
+ */
+void
+melo_event_service_remove (const gchar *id, const MeloAvahiService *service)
+{
+  melo_event_new (MELO_EVENT_TYPE_SERVICE, MELO_EVENT_SERVICE_REMOVE, id,
+                  (gpointer) service, NULL);
+}
+
+/**
+ * melo_event_service_parse:
+ * @data: the event data to parse
+ *
+ * Parse the event data for a #MELO_EVENT_TYPE_SERVICE event.
+ *
+ * Returns: (transfer none): the #MeloAvahiService of the event.
+ */
+const MeloAvahiService *
+melo_event_service_parse (gpointer data)
+{
+  return (const MeloAvahiService *) data;
+}
+
+static const gchar *melo_event_service_string[] = {
+  [MELO_EVENT_SERVICE_ADD] = "add",
+  [MELO_EVENT_SERVICE_UPDATE] = "update",
+  [MELO_EVENT_SERVICE_REMOVE] = "remove",
+};
+
+/**
+ * melo_event_service_to_string:
+ * @event: a service sub-type event
+ *
+ * Convert a #MeloEventService to a string.
+ *
+ * Returns: a string with the translated #MeloEventService, %NULL otherwise.
+ */
+const gchar *
+melo_event_service_to_string (MeloEventService event)
+{
+  if (event < MELO_EVENT_SERVICE_COUNT)
+    return melo_event_service_string[event];
+  return NULL;
+}
+
+/**
+ * melo_event_sink_stats:
+ * @id: the #MeloSink ID, or "main" for the main mixer
+ * @stats: the #MeloSinkStats of the sink
+ *
+ * The audio of the sink is degraded: new underruns, dropped or late buffers
+ * have been detected, or its main mixer input is almost full.
+ */
+void
+melo_event_sink_stats (const gchar *id, const MeloSinkStats *stats)
+{
+  melo_event_new (MELO_EVENT_TYPE_SINK, MELO_EVENT_SINK_STATS, id,
+                  (gpointer) stats, NULL);
+}
+
+/**
+ * melo_event_sink_stats_parse:
+ * @data: the event data to parse
+ *
+ * Parse the event data for a #MELO_EVENT_SINK_STATS.
+ *
+ * Returns: (transfer none): the #MeloSinkStats of the sink.
+ */
+const MeloSinkStats *
+melo_event_sink_stats_parse (gpointer data)
+{
+  return (const MeloSinkStats *) data;
+}
+
+static const gchar *melo_event_sink_string[] = {
+  [MELO_EVENT_SINK_STATS] = "stats",
+};
+
+/**
+ * melo_event_sink_to_string:
+ * @event: a sink sub-type event
+ *
+ * Convert a #MeloEventSink to a string.
+ *
+ * Returns: a string with the translated #MeloEventSink, %NULL otherwise.
+ */
+const gchar *
+melo_event_sink_to_string (MeloEventSink event)
+{
+  if (event < MELO_EVENT_SINK_COUNT)
+    return melo_event_sink_string[event];
+  return NULL;
+}
+
+/**
+ * melo_event_network_wifi_scan:
+ * @id: the Wifi interface name
+ * @count: the number of access points found
+ * @timestamp: the monotonic time of the scan (in us)
+ *
+ * A scan of the Wifi interface has completed and its access point list has
+ * been updated: the new list can be retrieved from the network control.
+ */
+void
+melo_event_network_wifi_scan (const gchar *id, guint count, gint64 timestamp)
+{
+  MeloEventNetworkWifiScan evt = {
+    .count = count, .timestamp = timestamp,
+  };
+  melo_event_new (MELO_EVENT_TYPE_NETWORK, MELO_EVENT_NETWORK_WIFI_SCAN, id,
+                  &evt, NULL);
+}
+
+/**
+ * melo_event_network_wifi_scan_parse:
+ * @data: the event data to parse
+ * @count: a pointer to hold the number of access points, or %NULL
+ * @timestamp: a pointer to hold the monotonic time of the scan, or %NULL
+ *
+ * Parse the event data for a #MELO_EVENT_NETWORK_WIFI_SCAN.
+ */
+void
+melo_event_network_wifi_scan_parse (gpointer data, guint *count,
+                                    gint64 *timestamp)
+{
+  MeloEventNetworkWifiScan *evt = (MeloEventNetworkWifiScan *) data;
+  if (count)
+    *count = evt->count;
+  if (timestamp)
+    *timestamp = evt->timestamp;
+}
+
+static const gchar *melo_event_network_string[] = {
+  [MELO_EVENT_NETWORK_WIFI_SCAN] = "wifi_scan",
+};
+
+/**
+ * melo_event_network_to_string:
+ * @event: a network sub-type event
+ *
+ * Convert a #MeloEventNetwork to a string.
+ *
+ * Returns: a string with the translated #MeloEventNetwork, %NULL otherwise.
+ */
+const gchar *
+melo_event_network_to_string (MeloEventNetwork event)
+{
+  if (event < MELO_EVENT_NETWORK_COUNT)
+    return melo_event_network_string[event];
+  return NULL;
+}
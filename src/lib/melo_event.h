@@ -26,11 +26,18 @@
 #include <json-glib/json-glib.h>
 
 #include "melo_player.h"
+#include "melo_avahi.h"
+#include "melo_sink.h"
 
 typedef enum _MeloEventType MeloEventType;
 typedef struct _MeloEventClient MeloEventClient;
 
 typedef enum _MeloEventPlayer MeloEventPlayer;
+typedef enum _MeloEventBrowser MeloEventBrowser;
+typedef enum _MeloEventPlaylist MeloEventPlaylist;
+typedef enum _MeloEventService MeloEventService;
+typedef enum _MeloEventSink MeloEventSink;
+typedef enum _MeloEventNetwork MeloEventNetwork;
 
 /**
  * MeloEventType:
@@ -39,6 +46,9 @@ typedef enum _MeloEventPlayer MeloEventPlayer;
  * @MELO_EVENT_TYPE_BROWSER: a browser event (from #MeloBrowser)
  * @MELO_EVENT_TYPE_PLAYER: a player event (from #MeloPlayer)
  * @MELO_EVENT_TYPE_PLAYLIST: a playlist event (from #MeloPlaylist)
+ * @MELO_EVENT_TYPE_SERVICE: a network service event (from #MeloAvahi)
+ * @MELO_EVENT_TYPE_SINK: an audio sink event (from #MeloSink)
+ * @MELO_EVENT_TYPE_NETWORK: a network control event (from #MeloNetwork)
  *
  * The #MeloEventType presents the source of an event. For custom or global
  * events, please use @MELO_EVENT_TYPE_GENERAL.
@@ -49,6 +59,9 @@ enum _MeloEventType {
   MELO_EVENT_TYPE_BROWSER,
   MELO_EVENT_TYPE_PLAYER,
   MELO_EVENT_TYPE_PLAYLIST,
+  MELO_EVENT_TYPE_SERVICE,
+  MELO_EVENT_TYPE_SINK,
+  MELO_EVENT_TYPE_NETWORK,
 
   /*< private >*/
   MELO_EVENT_TYPE_COUNT
@@ -69,6 +82,7 @@ enum _MeloEventType {
  * @MELO_EVENT_PLAYER_NAME: the status name of the player has changed
  * @MELO_EVENT_PLAYER_ERROR: an error occurred in the player
  * @MELO_EVENT_PLAYER_TAGS: the tags has been updated in the player
+ * @MELO_EVENT_PLAYER_POS: the position of the player has been sampled
  *
  * The #MeloEventPlayer describes the sub-type for an event coming from a
  * #MeloPlayer instance. For each types, a function is available to parse it.
@@ -87,11 +101,94 @@ enum _MeloEventPlayer {
   MELO_EVENT_PLAYER_NAME,
   MELO_EVENT_PLAYER_ERROR,
   MELO_EVENT_PLAYER_TAGS,
+  MELO_EVENT_PLAYER_POS,
 
   /*< private >*/
   MELO_EVENT_PLAYER_COUNT,
 };
 
+/**
+ * MeloEventBrowser:
+ * @MELO_EVENT_BROWSER_SCAN: the progress of a library scan has been updated
+ *
+ * The #MeloEventBrowser describes the sub-type for an event coming from a
+ * #MeloBrowser instance. For each types, a function is available to parse it.
+ */
+enum _MeloEventBrowser {
+  MELO_EVENT_BROWSER_SCAN = 0,
+
+  /*< private >*/
+  MELO_EVENT_BROWSER_COUNT,
+};
+
+/**
+ * MeloEventPlaylist:
+ * @MELO_EVENT_PLAYLIST_CHANGE: a media has been inserted, removed, moved or
+ *    updated in the playlist
+ * @MELO_EVENT_PLAYLIST_RESET: the playlist has changed and the whole list
+ *    must be retrieved again
+ *
+ * The #MeloEventPlaylist describes the sub-type for an event coming from a
+ * #MeloPlaylist instance. For each types, a function is available to parse it.
+ */
+enum _MeloEventPlaylist {
+  MELO_EVENT_PLAYLIST_CHANGE = 0,
+  MELO_EVENT_PLAYLIST_RESET,
+
+  /*< private >*/
+  MELO_EVENT_PLAYLIST_COUNT,
+};
+
+/**
+ * MeloEventService:
+ * @MELO_EVENT_SERVICE_ADD: a service has been discovered on the network
+ * @MELO_EVENT_SERVICE_UPDATE: the port, address or TXT record of a service
+ *    has changed
+ * @MELO_EVENT_SERVICE_REMOVE: a service has disappeared from the network
+ *
+ * The #MeloEventService describes the sub-type for an event coming from a
+ * #MeloAvahi browser. For each types, a function is available to parse it.
+ */
+enum _MeloEventService {
+  MELO_EVENT_SERVICE_ADD = 0,
+  MELO_EVENT_SERVICE_UPDATE,
+  MELO_EVENT_SERVICE_REMOVE,
+
+  /*< private >*/
+  MELO_EVENT_SERVICE_COUNT,
+};
+
+/**
+ * MeloEventSink:
+ * @MELO_EVENT_SINK_STATS: the audio of a sink or of the main mixer is
+ *    degraded (underruns, dropped or late buffers, or full mixer input)
+ *
+ * The #MeloEventSink describes the sub-type for an event coming from a
+ * #MeloSink instance or from the main mixer. For each types, a function is
+ * available to parse it.
+ */
+enum _MeloEventSink {
+  MELO_EVENT_SINK_STATS = 0,
+
+  /*< private >*/
+  MELO_EVENT_SINK_COUNT,
+};
+
+/**
+ * MeloEventNetwork:
+ * @MELO_EVENT_NETWORK_WIFI_SCAN: the access point list of a Wifi interface
+ *    has been updated
+ *
+ * The #MeloEventNetwork describes the sub-type for an event coming from the
+ * network control. For each types, a function is available to parse it.
+ */
+enum _MeloEventNetwork {
+  MELO_EVENT_NETWORK_WIFI_SCAN = 0,
+
+  /*< private >*/
+  MELO_EVENT_NETWORK_COUNT,
+};
+
 /**
  * MeloEventCallback:
  * @client: the current client instance
@@ -106,10 +203,12 @@ enum _MeloEventPlayer {
  * correct sub-type held in @event should be selected: for a
  * #MELO_EVENT_TYPE_PLAYER, you should use #MeloEventPlayer.
  *
- * This callback during client creation with melo_event_register().
+ * This callback during client creation with melo_event_register() or
+ * melo_event_register_async().
  *
  * Note: this callback is not threaded and long operation or blocking calls
- * should be avoided!
+ * should be avoided! A callback registered with melo_event_register() can be
+ * called concurrently from multiple threads.
  *
  * Returns: %TRUE if the event has been handled successfully, %FALSE otherwise.
  */
@@ -118,15 +217,48 @@ typedef gboolean (*MeloEventCallback) (MeloEventClient *client,
                                        const gchar *id, gpointer data,
                                        gpointer user_data);
 
+/**
+ * MeloEventRenderFunc:
+ * @type: the event type
+ * @event: the sub-type of the event
+ * @id: the Melo object ID
+ * @data: the event data
+ *
+ * A function used by melo_event_render() to serialize an event.
+ *
+ * Returns: (transfer full): a new string with the serialized event, or %NULL
+ * on error.
+ */
+typedef gchar *(*MeloEventRenderFunc) (MeloEventType type, guint event,
+                                       const gchar *id, gpointer data);
+
 /* Event client registration */
 MeloEventClient *melo_event_register (MeloEventCallback callback,
                                       gpointer user_data);
+MeloEventClient *melo_event_register_async (MeloEventCallback callback,
+                                            gpointer user_data,
+                                            GMainContext *context,
+                                            guint queue_size);
 void melo_event_unregister (MeloEventClient *client);
+void melo_event_client_set_coalescing (MeloEventClient *client,
+                                       guint interval);
+void melo_event_client_get_stats (MeloEventClient *client, guint *delivered,
+                                  guint *dropped);
+
+/* Event journal */
+void melo_event_journal_set_size (guint size);
+guint64 melo_event_journal_add (GBytes *event);
+GPtrArray *melo_event_journal_get_since (guint64 seq, guint timeout,
+                                         GCancellable *cancellable,
+                                         guint64 *last_seq, gboolean *missed);
 
 /* Event generation */
 void melo_event_new (MeloEventType type, guint event, const gchar *id,
                      gpointer data, GDestroyNotify free_data_func);
 
+/* Event rendering */
+GBytes *melo_event_render (MeloEventRenderFunc func);
+
 /* Event helper */
 const gchar *melo_event_type_to_string (MeloEventType type);
 
@@ -146,6 +278,7 @@ void melo_event_player_mute (const gchar *id, gboolean mute);
 void melo_event_player_name (const gchar *id, const gchar *name);
 void melo_event_player_error (const gchar *id, const gchar *error);
 void melo_event_player_tags (const gchar *id, MeloTags *tags);
+void melo_event_player_pos (const gchar *id, gint pos, gint64 timestamp);
 
 const MeloPlayerInfo *melo_event_player_new_parse (gpointer data);
 MeloPlayerStatus *melo_event_player_status_parse (gpointer data);
@@ -161,7 +294,55 @@ gboolean melo_event_player_mute_parse (gpointer data);
 const gchar *melo_event_player_name_parse (gpointer data);
 const gchar *melo_event_player_error_parse (gpointer data);
 MeloTags *melo_event_player_tags_parse (gpointer data);
+gint melo_event_player_pos_parse (gpointer data, gint64 *timestamp);
 
 const gchar *melo_event_player_to_string (MeloEventPlayer event);
 
+/* Browser event helpers */
+void melo_event_browser_scan (const gchar *id, guint scanned, guint added,
+                              guint pending, gboolean done);
+
+void melo_event_browser_scan_parse (gpointer data, guint *scanned,
+                                    guint *added, guint *pending,
+                                    gboolean *done);
+
+const gchar *melo_event_browser_to_string (MeloEventBrowser event);
+
+/* Playlist event helpers */
+void melo_event_playlist_change (const gchar *id,
+                                 const MeloPlaylistChange *change);
+void melo_event_playlist_reset (const gchar *id, guint revision);
+
+const MeloPlaylistChange *melo_event_playlist_change_parse (gpointer data);
+guint melo_event_playlist_reset_parse (gpointer data);
+
+const gchar *melo_event_playlist_to_string (MeloEventPlaylist event);
+
+/* Service event helpers */
+void melo_event_service_add (const gchar *id, const MeloAvahiService *service);
+void melo_event_service_update (const gchar *id,
+                                const MeloAvahiService *service);
+void melo_event_service_remove (const gchar *id,
+                                const MeloAvahiService *service);
+
+const MeloAvahiService *melo_event_service_parse (gpointer data);
+
+const gchar *melo_event_service_to_string (MeloEventService event);
+
+/* Sink event helpers */
+void melo_event_sink_stats (const gchar *id, const MeloSinkStats *stats);
+
+const MeloSinkStats *melo_event_sink_stats_parse (gpointer data);
+
+const gchar *melo_event_sink_to_string (MeloEventSink event);
+
+/* Network event helpers */
+void melo_event_network_wifi_scan (const gchar *id, guint count,
+                                   gint64 timestamp);
+
+void melo_event_network_wifi_scan_parse (gpointer data, guint *count,
+                                         gint64 *timestamp);
+
+const gchar *melo_event_network_to_string (MeloEventNetwork event);
+
 #endif /* __MELO_EVENT_H__ */
@@ -20,6 +20,8 @@
  */
 
 #include "melo_player_jsonrpc.h"
+#include "melo_playlist_jsonrpc.h"
+#include "melo_sink_jsonrpc.h"
 
 #include "melo_event_jsonrpc.h"
 
@@ -29,8 +31,16 @@
  * @short_description: Basic JSON-RPC methods for Melo Event
  *
  * Helper which implements all basic JSON-RPC methods for #MeloEvent.
+ *
+ * The "event.get_since" method returns all events newer than a sequence number
+ * and waits for new events when none is available: a client which cannot use
+ * the WebSocket interface can keep one parked request instead of polling.
  */
 
+/* Size of the event journal and maximum timeout of event.get_since (in ms) */
+#define MELO_EVENT_JSONRPC_JOURNAL_SIZE 256
+#define MELO_EVENT_JSONRPC_TIMEOUT_MAX 60000
+
 typedef void (*MeloEventJsonrpcParser) (JsonObject *obj, gpointer data);
 typedef const gchar *(*MeloEventJsonrpcString) (guint event);
 
@@ -132,10 +142,19 @@ static void
 melo_event_jsonrpc_player_tags (JsonObject *obj, gpointer data)
 {
   MeloTags *tags = melo_event_player_tags_parse (data);
-  JsonObject *o = melo_tags_to_json_object (tags, MELO_TAGS_FIELDS_FULL);
+  JsonObject *o = melo_tags_get_json_object (tags, MELO_TAGS_FIELDS_FULL);
   json_object_set_object_member (obj, "tags", o);
 }
 
+static void
+melo_event_jsonrpc_player_pos (JsonObject *obj, gpointer data)
+{
+  gint64 timestamp;
+  gint pos = melo_event_player_pos_parse (data, &timestamp);
+  json_object_set_int_member (obj, "pos", pos);
+  json_object_set_int_member (obj, "timestamp", timestamp);
+}
+
 static MeloEventJsonrpcParser melo_event_jsonrpc_player_parsers[] = {
   [MELO_EVENT_PLAYER_NEW] = melo_event_jsonrpc_player_new,
   [MELO_EVENT_PLAYER_DELETE] = NULL,
@@ -150,23 +169,120 @@ static MeloEventJsonrpcParser melo_event_jsonrpc_player_parsers[] = {
   [MELO_EVENT_PLAYER_NAME] = melo_event_jsonrpc_player_name,
   [MELO_EVENT_PLAYER_ERROR] = melo_event_jsonrpc_player_error,
   [MELO_EVENT_PLAYER_TAGS] = melo_event_jsonrpc_player_tags,
+  [MELO_EVENT_PLAYER_POS] = melo_event_jsonrpc_player_pos,
+};
+
+/* Browser event parsers */
+static void
+melo_event_jsonrpc_browser_scan (JsonObject *obj, gpointer data)
+{
+  guint scanned, added, pending;
+  gboolean done;
+  melo_event_browser_scan_parse (data, &scanned, &added, &pending, &done);
+  json_object_set_int_member (obj, "scanned", scanned);
+  json_object_set_int_member (obj, "added", added);
+  json_object_set_int_member (obj, "pending", pending);
+  json_object_set_boolean_member (obj, "done", done);
+}
+
+static MeloEventJsonrpcParser melo_event_jsonrpc_browser_parsers[] = {
+  [MELO_EVENT_BROWSER_SCAN] = melo_event_jsonrpc_browser_scan,
+};
+
+/* Playlist event parsers */
+static void
+melo_event_jsonrpc_playlist_change (JsonObject *obj, gpointer data)
+{
+  const MeloPlaylistChange *change = melo_event_playlist_change_parse (data);
+  JsonObject *o = melo_playlist_jsonrpc_change_to_object (change,
+                                          MELO_PLAYLIST_JSONRPC_LIST_FIELDS_FULL,
+                                          MELO_TAGS_FIELDS_FULL);
+  json_object_set_object_member (obj, "change", o);
+}
+
+static void
+melo_event_jsonrpc_playlist_reset (JsonObject *obj, gpointer data)
+{
+  guint revision = melo_event_playlist_reset_parse (data);
+  json_object_set_int_member (obj, "revision", revision);
+}
+
+static MeloEventJsonrpcParser melo_event_jsonrpc_playlist_parsers[] = {
+  [MELO_EVENT_PLAYLIST_CHANGE] = melo_event_jsonrpc_playlist_change,
+  [MELO_EVENT_PLAYLIST_RESET] = melo_event_jsonrpc_playlist_reset,
+};
+
+/* Service event parsers */
+static void
+melo_event_jsonrpc_service (JsonObject *obj, gpointer data)
+{
+  const MeloAvahiService *s = melo_event_service_parse (data);
+  gchar *ip;
+
+  ip = g_strdup_printf ("%u.%u.%u.%u", s->ip[0], s->ip[1], s->ip[2], s->ip[3]);
+  json_object_set_string_member (obj, "name", s->name);
+  json_object_set_string_member (obj, "service", s->type);
+  json_object_set_string_member (obj, "ip", ip);
+  json_object_set_int_member (obj, "port", s->port);
+  json_object_set_int_member (obj, "iface", s->iface);
+  g_free (ip);
+}
+
+static MeloEventJsonrpcParser melo_event_jsonrpc_service_parsers[] = {
+  [MELO_EVENT_SERVICE_ADD] = melo_event_jsonrpc_service,
+  [MELO_EVENT_SERVICE_UPDATE] = melo_event_jsonrpc_service,
+  [MELO_EVENT_SERVICE_REMOVE] = melo_event_jsonrpc_service,
+};
+
+/* Sink event parsers */
+static void
+melo_event_jsonrpc_sink_stats (JsonObject *obj, gpointer data)
+{
+  const MeloSinkStats *stats = melo_event_sink_stats_parse (data);
+  json_object_set_object_member (obj, "stats",
+                                 melo_sink_jsonrpc_stats_to_object (stats));
+}
+
+static MeloEventJsonrpcParser melo_event_jsonrpc_sink_parsers[] = {
+  [MELO_EVENT_SINK_STATS] = melo_event_jsonrpc_sink_stats,
+};
+
+/* Network event parsers */
+static void
+melo_event_jsonrpc_network_wifi_scan (JsonObject *obj, gpointer data)
+{
+  gint64 timestamp;
+  guint count;
+  melo_event_network_wifi_scan_parse (data, &count, &timestamp);
+  json_object_set_int_member (obj, "count", count);
+  json_object_set_int_member (obj, "timestamp", timestamp);
+}
+
+static MeloEventJsonrpcParser melo_event_jsonrpc_network_parsers[] = {
+  [MELO_EVENT_NETWORK_WIFI_SCAN] = melo_event_jsonrpc_network_wifi_scan,
 };
 
 /* Melo event type persers */
 static MeloEventJsonrpcParser *melo_event_jsonrpc_parsers[] = {
   [MELO_EVENT_TYPE_GENERAL] = NULL,
   [MELO_EVENT_TYPE_MODULE] = NULL,
-  [MELO_EVENT_TYPE_BROWSER] = NULL,
+  [MELO_EVENT_TYPE_BROWSER] = melo_event_jsonrpc_browser_parsers,
   [MELO_EVENT_TYPE_PLAYER] = melo_event_jsonrpc_player_parsers,
-  [MELO_EVENT_TYPE_PLAYLIST] = NULL,
+  [MELO_EVENT_TYPE_PLAYLIST] = melo_event_jsonrpc_playlist_parsers,
+  [MELO_EVENT_TYPE_SERVICE] = melo_event_jsonrpc_service_parsers,
+  [MELO_EVENT_TYPE_SINK] = melo_event_jsonrpc_sink_parsers,
+  [MELO_EVENT_TYPE_NETWORK] = melo_event_jsonrpc_network_parsers,
 };
 
 static MeloEventJsonrpcString melo_event_jsonrpc_strings[] = {
   [MELO_EVENT_TYPE_GENERAL] = NULL,
   [MELO_EVENT_TYPE_MODULE] = NULL,
-  [MELO_EVENT_TYPE_BROWSER] = NULL,
+  [MELO_EVENT_TYPE_BROWSER] = melo_event_browser_to_string,
   [MELO_EVENT_TYPE_PLAYER] = melo_event_player_to_string,
-  [MELO_EVENT_TYPE_PLAYLIST] = NULL,
+  [MELO_EVENT_TYPE_PLAYLIST] = melo_event_playlist_to_string,
+  [MELO_EVENT_TYPE_SERVICE] = melo_event_service_to_string,
+  [MELO_EVENT_TYPE_SINK] = melo_event_sink_to_string,
+  [MELO_EVENT_TYPE_NETWORK] = melo_event_network_to_string,
 };
 
 /**
@@ -209,3 +325,228 @@ melo_event_jsonrpc_event_to_object (MeloEventType type, guint event,
 
   return obj;
 }
+
+/**
+ * melo_event_jsonrpc_event_to_string:
+ * @type: the event type
+ * @event: the event (depending on @type)
+ * @id: the ID of the Melo object (depending on @type)
+ * @data: the data associated to the event (depending on @event)
+ *
+ * Generate a serialized JSON object from a specific #MeloEventType and event
+ * ID, as done by melo_event_jsonrpc_event_to_object().
+ *
+ * Returns: (transfer full): a new string with the serialized event, or %NULL on
+ * error. After use, call g_free().
+ */
+gchar *
+melo_event_jsonrpc_event_to_string (MeloEventType type, guint event,
+                                    const gchar *id, gpointer data)
+{
+  JsonGenerator *gen;
+  JsonObject *obj;
+  JsonNode *node;
+  gchar *str;
+
+  /* Convert event to JSON object */
+  obj = melo_event_jsonrpc_event_to_object (type, event, id, data);
+  if (!obj)
+    return NULL;
+
+  /* Create node */
+  node = json_node_new (JSON_NODE_OBJECT);
+  json_node_take_object (node, obj);
+
+  /* Generate JSON string */
+  gen = json_generator_new ();
+  json_generator_set_root (gen, node);
+  str = json_generator_to_data (gen, NULL);
+  json_node_unref (node);
+  g_object_unref (gen);
+
+  return str;
+}
+
+/**
+ * melo_event_jsonrpc_render:
+ *
+ * Get the serialized JSON object of the event currently delivered, as
+ * generated by melo_event_jsonrpc_event_to_string(). The event is serialized
+ * only once and the result is shared with all other clients and transports.
+ *
+ * This function must be called only from a #MeloEventCallback.
+ *
+ * Returns: (transfer full): a #GBytes holding the serialized event, or %NULL
+ * on error. After use, call g_bytes_unref().
+ */
+GBytes *
+melo_event_jsonrpc_render (void)
+{
+  return melo_event_render (melo_event_jsonrpc_event_to_string);
+}
+
+/* Event journal client */
+static MeloEventClient *melo_event_jsonrpc_client;
+
+static gboolean
+melo_event_jsonrpc_journal_callback (MeloEventClient *client,
+                                     MeloEventType type, guint event,
+                                     const gchar *id, gpointer data,
+                                     gpointer user_data)
+{
+  GBytes *bytes;
+
+  /* Add serialized event to journal */
+  bytes = melo_event_jsonrpc_render ();
+  if (!bytes)
+    return FALSE;
+  melo_event_journal_add (bytes);
+  g_bytes_unref (bytes);
+
+  return TRUE;
+}
+
+/* Method callbacks */
+static void
+melo_event_jsonrpc_get_since (const gchar *method,
+                              JsonArray *s_params, JsonNode *params,
+                              JsonNode **result, JsonNode **error,
+                              gpointer user_data)
+{
+  MeloJSONRPCParams p;
+  MeloJSONRPCWriter *w;
+  JsonParser *parser;
+  JsonArray *array;
+  JsonObject *obj;
+  GPtrArray *events;
+  gboolean missed;
+  guint timeout;
+  guint64 seq;
+  gint64 val;
+  guint i;
+
+  /* Get parameters */
+  if (!melo_jsonrpc_params_init (&p, s_params, params, error))
+    return;
+
+  /* Get last sequence number and timeout */
+  val = melo_jsonrpc_params_get_int (&p, "seq");
+  seq = val > 0 ? val : 0;
+  val = melo_jsonrpc_params_get_int (&p, "timeout");
+  timeout = CLAMP (val, 0, MELO_EVENT_JSONRPC_TIMEOUT_MAX);
+
+  /* Wait for new events: the request is parked in the wait thread pool until
+   * an event is added, the timeout expires or the client is disconnected
+   */
+  events = melo_event_journal_get_since (seq, timeout,
+                                         g_cancellable_get_current (), &seq,
+                                         &missed);
+
+  /* Stream response with serialized events as is */
+  w = melo_jsonrpc_begin_result ();
+  if (w) {
+    melo_jsonrpc_writer_begin_object (w);
+    melo_jsonrpc_writer_set_member_name (w, "seq");
+    melo_jsonrpc_writer_add_int_value (w, seq);
+    melo_jsonrpc_writer_set_member_name (w, "missed");
+    melo_jsonrpc_writer_add_boolean_value (w, missed);
+    melo_jsonrpc_writer_set_member_name (w, "events");
+    melo_jsonrpc_writer_begin_array (w);
+    for (i = 0; i < events->len; i++) {
+      gconstpointer data;
+      gsize size;
+
+      data = g_bytes_get_data (g_ptr_array_index (events, i), &size);
+      melo_jsonrpc_writer_add_raw_value (w, data, size);
+    }
+    melo_jsonrpc_writer_end_array (w);
+    melo_jsonrpc_writer_end_object (w);
+    g_ptr_array_unref (events);
+    return;
+  }
+
+  /* Parse serialized events when streaming is not available (CBOR) */
+  array = json_array_new ();
+  parser = json_parser_new ();
+  for (i = 0; i < events->len; i++) {
+    gconstpointer data;
+    gsize size;
+
+    data = g_bytes_get_data (g_ptr_array_index (events, i), &size);
+    if (json_parser_load_from_data (parser, data, size, NULL))
+      json_array_add_element (array,
+                              json_node_copy (json_parser_get_root (parser)));
+  }
+  g_object_unref (parser);
+  g_ptr_array_unref (events);
+
+  /* Create response */
+  obj = json_object_new ();
+  json_object_set_int_member (obj, "seq", seq);
+  json_object_set_boolean_member (obj, "missed", missed);
+  json_object_set_array_member (obj, "events", array);
+
+  /* Return result */
+  *result = json_node_new (JSON_NODE_OBJECT);
+  json_node_take_object (*result, obj);
+}
+
+/* List of methods */
+static MeloJSONRPCMethod melo_event_jsonrpc_methods[] = {
+  {
+    .method = "get_since",
+    .params = "["
+              "  {\"name\": \"seq\", \"type\": \"integer\"},"
+              "  {"
+              "    \"name\": \"timeout\", \"type\": \"integer\","
+              "    \"required\": false, \"default\": 30000"
+              "  }"
+              "]",
+    .result = "{\"type\":\"object\"}",
+    .flags = MELO_JSONRPC_FLAGS_WAIT,
+    .callback = melo_event_jsonrpc_get_since,
+    .user_data = NULL,
+  },
+};
+
+/**
+ * melo_event_jsonrpc_register_methods:
+ *
+ * Register all JSON-RPC methods for #MeloEvent. The event journal is enabled
+ * and filled with all events until melo_event_jsonrpc_unregister_methods() is
+ * called.
+ *
+ * This function must be called from the thread running the default main
+ * context.
+ */
+void
+melo_event_jsonrpc_register_methods (void)
+{
+  /* Enable event journal */
+  melo_event_journal_set_size (MELO_EVENT_JSONRPC_JOURNAL_SIZE);
+  melo_event_jsonrpc_client = melo_event_register_async (
+                                           melo_event_jsonrpc_journal_callback,
+                                           NULL, NULL, 0);
+
+  melo_jsonrpc_register_methods ("event", melo_event_jsonrpc_methods,
+                                 G_N_ELEMENTS (melo_event_jsonrpc_methods));
+}
+
+/**
+ * melo_event_jsonrpc_unregister_methods:
+ *
+ * Unregister all JSON-RPC methods for #MeloEvent and disable the event
+ * journal.
+ */
+void
+melo_event_jsonrpc_unregister_methods (void)
+{
+  melo_jsonrpc_unregister_methods ("event", melo_event_jsonrpc_methods,
+                                   G_N_ELEMENTS (melo_event_jsonrpc_methods));
+
+  /* Disable event journal */
+  if (melo_event_jsonrpc_client)
+    melo_event_unregister (melo_event_jsonrpc_client);
+  melo_event_jsonrpc_client = NULL;
+  melo_event_journal_set_size (0);
+}
@@ -27,5 +27,12 @@
 
 JsonObject *melo_event_jsonrpc_event_to_object (MeloEventType type, guint event,
                                                 const gchar *id, gpointer data);
+GBytes *melo_event_jsonrpc_render (void);
+gchar *melo_event_jsonrpc_event_to_string (MeloEventType type, guint event,
+                                           const gchar *id, gpointer data);
+
+/* JSON-RPC methods */
+void melo_event_jsonrpc_register_methods (void);
+void melo_event_jsonrpc_unregister_methods (void);
 
 #endif /* __MELO_EVENT_JSONRPC_H__ */
@@ -21,7 +21,13 @@
 
 #include <string.h>
 
+#include "melo_cbor.h"
+#include "melo_tags.h"
+#include "melo_event.h"
 #include "melo_jsonrpc.h"
+#include "melo_plugin.h"
+#include "melo_trace.h"
+#include "melo_tracer.h"
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -47,41 +53,714 @@
  * application and not from any Melo object like #MeloModule.
  */
 
+typedef enum {
+  MELO_JSONRPC_PARAM_TYPE_BOOLEAN = 0,
+  MELO_JSONRPC_PARAM_TYPE_INTEGER,
+  MELO_JSONRPC_PARAM_TYPE_DOUBLE,
+  MELO_JSONRPC_PARAM_TYPE_STRING,
+  MELO_JSONRPC_PARAM_TYPE_OBJECT,
+  MELO_JSONRPC_PARAM_TYPE_ARRAY,
+} MeloJSONRPCParamType;
+
+typedef struct {
+  const gchar *name;
+  MeloJSONRPCParamType type;
+  JsonNode *def;
+} MeloJSONRPCParam;
+
+/* Compiled parameters schema */
+struct _MeloJSONRPCSchema {
+  gint ref_count;
+  JsonArray *array;
+  guint count;
+  guint32 required;
+  MeloJSONRPCParam params[];
+};
+
+/* Upper bounds of latency histogram buckets (in us) */
+static const guint melo_jsonrpc_stats_bounds[] = {
+  100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000,
+  500000, 1000000, 5000000
+};
+#define MELO_JSONRPC_STATS_BUCKETS (G_N_ELEMENTS (melo_jsonrpc_stats_bounds) + 1)
+
+typedef struct {
+  guint64 count;
+  guint64 total;
+  guint64 max;
+  guint64 buckets[MELO_JSONRPC_STATS_BUCKETS];
+} MeloJSONRPCHistogram;
+
+/* Statistics of a method: they are kept after method unregistration */
+typedef struct {
+  guint64 calls;
+  guint64 errors;
+  guint in_flight;
+  MeloJSONRPCHistogram parse;
+  MeloJSONRPCHistogram callback;
+  MeloJSONRPCHistogram serialize;
+} MeloJSONRPCStats;
+
 typedef struct _MeloJSONRPCInternalMethod {
   /* Schema nodes */
-  JsonArray *params;
+  MeloJSONRPCSchema *params;
   JsonObject *result;
   /* Callback */
   MeloJSONRPCCallback callback;
   gpointer user_data;
-
+  MeloJSONRPCFlags flags;
+  guint cache_events;
+  /* Statistics */
+  MeloJSONRPCStats *stats;
 } MeloJSONRPCInternalMethod;
 
+/* Maximum number of cached results */
+#define MELO_JSONRPC_CACHE_SIZE 256
+
+typedef struct {
+  JsonNode *result;
+  guint events;
+} MeloJSONRPCCacheEntry;
+
+/* Maximum number of threads used to run batch requests */
+#define MELO_JSONRPC_BATCH_THREADS 4
+
+typedef struct {
+  GMutex mutex;
+  GCond cond;
+  guint pending;
+  GCancellable *cancellable;
+} MeloJSONRPCBatch;
+
+typedef struct {
+  MeloJSONRPCBatch *batch;
+  gboolean concurrent;
+  JsonNode *req;
+  JsonNode *res;
+} MeloJSONRPCBatchItem;
+
 /* List of groups and methods */
 G_LOCK_DEFINE_STATIC (melo_jsonrpc_mutex);
 static GHashTable *melo_jsonrpc_methods = NULL;
 
+/* Schema of the method currently called in this thread */
+static GPrivate melo_jsonrpc_current = G_PRIVATE_INIT (NULL);
+
+/* Statistics of methods and of transport queue */
+G_LOCK_DEFINE_STATIC (melo_jsonrpc_stats_mutex);
+static GHashTable *melo_jsonrpc_stats = NULL;
+static MeloJSONRPCHistogram melo_jsonrpc_stats_queue;
+
+/* Statistics of the last single request parsed in this thread */
+static GPrivate melo_jsonrpc_last = G_PRIVATE_INIT (NULL);
+
+/* Results cache: the generation is incremented on each invalidation */
+G_LOCK_DEFINE_STATIC (melo_jsonrpc_cache_mutex);
+static GHashTable *melo_jsonrpc_cache = NULL;
+static guint64 melo_jsonrpc_cache_generation;
+static MeloEventClient *melo_jsonrpc_cache_client;
+
+/* Result of the method currently called in this thread cannot be cached */
+static GPrivate melo_jsonrpc_uncached = G_PRIVATE_INIT (NULL);
+
+/* Requests in progress and size of their buffers */
+static gint melo_jsonrpc_requests;
+static gsize melo_jsonrpc_request_bytes;
+
+/* Thread pool for batch requests */
+G_LOCK_DEFINE_STATIC (melo_jsonrpc_batch_mutex);
+static GThreadPool *melo_jsonrpc_batch_pool = NULL;
+
 /* Helpers */
+static gboolean melo_jsonrpc_register_method_internal (const gchar *group,
+                                                       const gchar *method,
+                                                       JsonArray *params,
+                                                       JsonObject *result,
+                                                   MeloJSONRPCCallback callback,
+                                                       gpointer user_data,
+                                                       MeloJSONRPCFlags flags,
+                                                       guint cache_events);
 static gchar *melo_jsonrpc_node_to_string (JsonNode *node);
 static JsonNode *melo_jsonrpc_build_error (const char *id, gint64 nid,
                                            MeloJSONRPCError error_code,
                                            const char *error_format, ...);
-static gchar *melo_jsonrpc_build_error_str (MeloJSONRPCError error_code,
-                                            const char *error_format, ...);
 static JsonNode *melo_jsonrpc_build_response_node (JsonNode *result,
                                                    JsonNode *error,
                                                    const gchar *id,
                                                    gint64 nid);
 
+/* Compile parameters schema */
+static const gchar *
+melo_jsonrpc_schema_get_string (JsonObject *obj, const gchar *name)
+{
+  JsonNode *node;
+
+  node = json_object_get_member (obj, name);
+  if (!node || !JSON_NODE_HOLDS_VALUE (node) ||
+      json_node_get_value_type (node) != G_TYPE_STRING)
+    return NULL;
+
+  return json_node_get_string (node);
+}
+
+static gboolean
+melo_jsonrpc_param_check (const MeloJSONRPCParam *param, JsonNode *node)
+{
+  GType vtype = G_TYPE_INVALID;
+  JsonNodeType type;
+
+  /* Get type */
+  type = json_node_get_node_type (node);
+  if (type == JSON_NODE_VALUE)
+    vtype = json_node_get_value_type (node);
+
+  /* Check type */
+  switch (param->type) {
+    case MELO_JSONRPC_PARAM_TYPE_BOOLEAN:
+      return vtype == G_TYPE_BOOLEAN;
+    case MELO_JSONRPC_PARAM_TYPE_INTEGER:
+      return vtype == G_TYPE_INT64;
+    case MELO_JSONRPC_PARAM_TYPE_DOUBLE:
+      return vtype == G_TYPE_DOUBLE;
+    case MELO_JSONRPC_PARAM_TYPE_STRING:
+      return vtype == G_TYPE_STRING;
+    case MELO_JSONRPC_PARAM_TYPE_OBJECT:
+      return type == JSON_NODE_OBJECT;
+    case MELO_JSONRPC_PARAM_TYPE_ARRAY:
+      return type == JSON_NODE_ARRAY;
+  }
+
+  return FALSE;
+}
+
+static MeloJSONRPCSchema *
+melo_jsonrpc_schema_ref (MeloJSONRPCSchema *schema)
+{
+  g_atomic_int_inc (&schema->ref_count);
+  return schema;
+}
+
+static void
+melo_jsonrpc_schema_unref (MeloJSONRPCSchema *schema)
+{
+  guint i;
+
+  if (!g_atomic_int_dec_and_test (&schema->ref_count))
+    return;
+
+  /* Free default values */
+  for (i = 0; i < schema->count; i++)
+    if (schema->params[i].def)
+      json_node_free (schema->params[i].def);
+
+  /* Free schema */
+  json_array_unref (schema->array);
+  g_free (schema);
+}
+
+static MeloJSONRPCSchema *
+melo_jsonrpc_schema_new (JsonArray *array)
+{
+  MeloJSONRPCSchema *schema;
+  guint count, i;
+
+  /* Too many parameters */
+  count = json_array_get_length (array);
+  if (count > MELO_JSONRPC_PARAMS_MAX)
+    return NULL;
+
+  /* Create schema */
+  schema = g_malloc0 (sizeof (*schema) + count * sizeof (MeloJSONRPCParam));
+  schema->ref_count = 1;
+  schema->array = json_array_ref (array);
+  schema->count = count;
+
+  /* Compile each parameter */
+  for (i = 0; i < count; i++) {
+    MeloJSONRPCParam *param = &schema->params[i];
+    const gchar *name, *type;
+    JsonObject *obj;
+    JsonNode *node;
+
+    /* Get parameter description */
+    node = json_array_get_element (array, i);
+    if (json_node_get_node_type (node) != JSON_NODE_OBJECT)
+      goto failed;
+    obj = json_node_get_object (node);
+
+    /* Get name and type */
+    name = melo_jsonrpc_schema_get_string (obj, "name");
+    type = melo_jsonrpc_schema_get_string (obj, "type");
+    if (!name || !type)
+      goto failed;
+    param->name = g_intern_string (name);
+
+    /* Get type: we check only first letter of the type string */
+    switch (type[0]) {
+      case 'b':
+        param->type = MELO_JSONRPC_PARAM_TYPE_BOOLEAN;
+        break;
+      case 'i':
+        param->type = MELO_JSONRPC_PARAM_TYPE_INTEGER;
+        break;
+      case 'd':
+        param->type = MELO_JSONRPC_PARAM_TYPE_DOUBLE;
+        break;
+      case 's':
+        param->type = MELO_JSONRPC_PARAM_TYPE_STRING;
+        break;
+      case 'o':
+        param->type = MELO_JSONRPC_PARAM_TYPE_OBJECT;
+        break;
+      case 'a':
+        param->type = MELO_JSONRPC_PARAM_TYPE_ARRAY;
+        break;
+      default:
+        goto failed;
+    }
+
+    /* Get required flag: parameter is required if not defined or TRUE */
+    node = json_object_get_member (obj, "required");
+    if (!node || json_node_get_boolean (node))
+      schema->required |= 1U << i;
+
+    /* Get default value */
+    node = json_object_get_member (obj, "default");
+    if (node) {
+      if (!melo_jsonrpc_param_check (param, node))
+        goto failed;
+      param->def = json_node_copy (node);
+    }
+  }
+
+  return schema;
+
+failed:
+  melo_jsonrpc_schema_unref (schema);
+  return NULL;
+}
+
+/* Get nodes of parameters in schema order: a missing parameter is NULL */
+static gboolean
+melo_jsonrpc_schema_parse (const MeloJSONRPCSchema *schema, JsonNode *params,
+                           JsonNode **nodes)
+{
+  JsonNode *node;
+  guint i;
+
+  /* Reset nodes */
+  memset (nodes, 0, schema->count * sizeof (*nodes));
+
+  /* Get params from object */
+  if (json_node_get_node_type (params) == JSON_NODE_OBJECT) {
+    JsonObject *o = json_node_get_object (params);
+
+    for (i = 0; i < schema->count; i++) {
+      node = json_object_get_member (o, schema->params[i].name);
+      if (!node) {
+        if (schema->required & (1U << i))
+          return FALSE;
+        continue;
+      }
+
+      /* Check node type */
+      if (!melo_jsonrpc_param_check (&schema->params[i], node))
+        return FALSE;
+      nodes[i] = node;
+    }
+  } else if (json_node_get_node_type (params) == JSON_NODE_ARRAY) {
+    JsonArray *a = json_node_get_array (params);
+    guint count = json_array_get_length (a);
+
+    for (i = 0; i < schema->count; i++) {
+      /* No more parameters available */
+      if (i >= count) {
+        if (schema->required & (1U << i))
+          return FALSE;
+        break;
+      }
+
+      /* Check node type */
+      node = json_array_get_element (a, i);
+      if (!node || !melo_jsonrpc_param_check (&schema->params[i], node))
+        return FALSE;
+      nodes[i] = node;
+    }
+
+    /* Check remaining parameters are not required */
+    for (; i < schema->count; i++)
+      if (schema->required & (1U << i))
+        return FALSE;
+  } else
+    return FALSE;
+
+  return TRUE;
+}
+
+/* Statistics */
+static MeloJSONRPCStats *
+melo_jsonrpc_stats_get (const gchar *method)
+{
+  MeloJSONRPCStats *stats;
+
+  G_LOCK (melo_jsonrpc_stats_mutex);
+
+  /* Create hash table if not yet created */
+  if (!melo_jsonrpc_stats)
+    melo_jsonrpc_stats = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                g_free, NULL);
+
+  /* Find or create method statistics */
+  stats = g_hash_table_lookup (melo_jsonrpc_stats, method);
+  if (!stats) {
+    stats = g_slice_new0 (MeloJSONRPCStats);
+    g_hash_table_insert (melo_jsonrpc_stats, g_strdup (method), stats);
+  }
+
+  G_UNLOCK (melo_jsonrpc_stats_mutex);
+
+  return stats;
+}
+
+static void
+melo_jsonrpc_histogram_add (MeloJSONRPCHistogram *h, gint64 time)
+{
+  guint i;
+
+  if (time < 0)
+    time = 0;
+
+  /* Find bucket */
+  for (i = 0; i < G_N_ELEMENTS (melo_jsonrpc_stats_bounds); i++)
+    if (time <= melo_jsonrpc_stats_bounds[i])
+      break;
+
+  /* Update histogram */
+  h->buckets[i]++;
+  h->count++;
+  h->total += time;
+  if ((guint64) time > h->max)
+    h->max = time;
+}
+
+static JsonObject *
+melo_jsonrpc_histogram_to_object (const MeloJSONRPCHistogram *h)
+{
+  JsonArray *array;
+  JsonObject *obj;
+  guint i;
+
+  obj = json_object_new ();
+  json_object_set_int_member (obj, "count", h->count);
+  json_object_set_int_member (obj, "total", h->total);
+  json_object_set_int_member (obj, "max", h->max);
+  array = json_array_sized_new (MELO_JSONRPC_STATS_BUCKETS);
+  for (i = 0; i < MELO_JSONRPC_STATS_BUCKETS; i++)
+    json_array_add_int_element (array, h->buckets[i]);
+  json_object_set_array_member (obj, "buckets", array);
+
+  return obj;
+}
+
+/**
+ * melo_jsonrpc_add_queue_time:
+ * @time: the time spent by a request in a queue, in microseconds
+ *
+ * Record the time spent by a request between its reception by a transport
+ * (like the HTTP server) and the start of its parsing, generally because all
+ * the threads handling the requests are busy. The corresponding histogram is
+ * reported by the method "system.get_stats".
+ */
+void
+melo_jsonrpc_add_queue_time (gint64 time)
+{
+  G_LOCK (melo_jsonrpc_stats_mutex);
+  melo_jsonrpc_histogram_add (&melo_jsonrpc_stats_queue, time);
+  G_UNLOCK (melo_jsonrpc_stats_mutex);
+}
+
+/**
+ * melo_jsonrpc_get_stats:
+ *
+ * Get the statistics of all methods registered at least once since the
+ * start, and of the transport queue. For each method, the number of calls,
+ * the number of calls which failed, the number of calls in progress and the
+ * latency histograms of the request parsing, the callback and the response
+ * serialization are reported. When a method streams its result with
+ * melo_jsonrpc_begin_result(), the serialization is included in the callback
+ * time. For batch requests, the serialization of the response is not reported.
+ *
+ * A latency histogram contains the number of samples, the total and maximum
+ * times in microseconds, and the number of samples of each bucket: the upper
+ * bounds of the buckets are listed in the "bounds" array, and the last bucket
+ * holds all samples above the last bound.
+ *
+ * Returns: (transfer full): a new #JsonObject with the statistics. Use
+ * json_object_unref() after usage.
+ */
+JsonObject *
+melo_jsonrpc_get_stats (void)
+{
+  GHashTableIter iter;
+  JsonArray *methods;
+  JsonArray *bounds;
+  JsonObject *obj, *o;
+  gpointer key, value;
+  guint i;
+
+  /* Create object */
+  obj = json_object_new ();
+  bounds = json_array_sized_new (G_N_ELEMENTS (melo_jsonrpc_stats_bounds));
+  for (i = 0; i < G_N_ELEMENTS (melo_jsonrpc_stats_bounds); i++)
+    json_array_add_int_element (bounds, melo_jsonrpc_stats_bounds[i]);
+  json_object_set_array_member (obj, "bounds", bounds);
+  methods = json_array_new ();
+
+  G_LOCK (melo_jsonrpc_stats_mutex);
+
+  /* Add queue histogram */
+  json_object_set_object_member (obj, "queue",
+                  melo_jsonrpc_histogram_to_object (&melo_jsonrpc_stats_queue));
+
+  /* Add methods statistics */
+  if (melo_jsonrpc_stats) {
+    g_hash_table_iter_init (&iter, melo_jsonrpc_stats);
+    while (g_hash_table_iter_next (&iter, &key, &value)) {
+      const MeloJSONRPCStats *stats = value;
+
+      o = json_object_new ();
+      json_object_set_string_member (o, "method", key);
+      json_object_set_int_member (o, "calls", stats->calls);
+      json_object_set_int_member (o, "errors", stats->errors);
+      json_object_set_int_member (o, "in_flight", stats->in_flight);
+      json_object_set_object_member (o, "parse",
+                                melo_jsonrpc_histogram_to_object (&stats->parse));
+      json_object_set_object_member (o, "callback",
+                             melo_jsonrpc_histogram_to_object (&stats->callback));
+      json_object_set_object_member (o, "serialize",
+                            melo_jsonrpc_histogram_to_object (&stats->serialize));
+      json_array_add_object_element (methods, o);
+    }
+  }
+
+  G_UNLOCK (melo_jsonrpc_stats_mutex);
+
+  json_object_set_array_member (obj, "methods", methods);
+
+  return obj;
+}
+
+/* Results cache */
+static void
+melo_jsonrpc_cache_entry_free (gpointer data)
+{
+  MeloJSONRPCCacheEntry *entry = data;
+
+  json_node_free (entry->result);
+  g_slice_free (MeloJSONRPCCacheEntry, entry);
+}
+
+static gboolean
+melo_jsonrpc_cache_match_events (gpointer key, gpointer value,
+                                 gpointer user_data)
+{
+  const MeloJSONRPCCacheEntry *entry = value;
+
+  return entry->events & GPOINTER_TO_UINT (user_data);
+}
+
+static gboolean
+melo_jsonrpc_cache_match_prefix (gpointer key, gpointer value,
+                                 gpointer user_data)
+{
+  return g_str_has_prefix (key, user_data);
+}
+
+static gboolean
+melo_jsonrpc_cache_event_cb (MeloEventClient *client, MeloEventType type,
+                             guint event, const gchar *id, gpointer data,
+                             gpointer user_data)
+{
+  /* Invalidate results depending on this event type */
+  G_LOCK (melo_jsonrpc_cache_mutex);
+  if (melo_jsonrpc_cache &&
+      g_hash_table_foreach_remove (melo_jsonrpc_cache,
+                                   melo_jsonrpc_cache_match_events,
+                                   GUINT_TO_POINTER (1 << type)))
+    melo_jsonrpc_cache_generation++;
+  G_UNLOCK (melo_jsonrpc_cache_mutex);
+
+  return TRUE;
+}
+
+static void
+melo_jsonrpc_cache_init (void)
+{
+  G_LOCK (melo_jsonrpc_cache_mutex);
+  if (!melo_jsonrpc_cache) {
+    melo_jsonrpc_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                g_free,
+                                                melo_jsonrpc_cache_entry_free);
+    melo_jsonrpc_cache_client = melo_event_register (
+                                                    melo_jsonrpc_cache_event_cb,
+                                                    NULL);
+  }
+  G_UNLOCK (melo_jsonrpc_cache_mutex);
+}
+
+/* Generate cache key: the parameters are presented in schema order */
+static gchar *
+melo_jsonrpc_cache_key (const gchar *method, const MeloJSONRPCSchema *schema,
+                        JsonNode *params)
+{
+  JsonNode *nodes[MELO_JSONRPC_PARAMS_MAX];
+  GString *key;
+  guint i;
+
+  /* Invalid parameters are not cached */
+  if (schema && (!params || !melo_jsonrpc_schema_parse (schema, params, nodes)))
+    return NULL;
+
+  /* Add method and each parameter value, or its default value */
+  key = g_string_new (method);
+  for (i = 0; schema && i < schema->count; i++) {
+    JsonNode *node = nodes[i] ? nodes[i] : schema->params[i].def;
+
+    g_string_append_c (key, '\n');
+    if (node) {
+      gchar *str = melo_jsonrpc_node_to_string (node);
+      g_string_append (key, str);
+      g_free (str);
+    }
+  }
+
+  return g_string_free (key, FALSE);
+}
+
+static JsonNode *
+melo_jsonrpc_cache_lookup (const gchar *key, guint64 *generation)
+{
+  MeloJSONRPCCacheEntry *entry = NULL;
+  JsonNode *result = NULL;
+
+  G_LOCK (melo_jsonrpc_cache_mutex);
+  if (melo_jsonrpc_cache)
+    entry = g_hash_table_lookup (melo_jsonrpc_cache, key);
+  if (entry)
+    result = json_node_copy (entry->result);
+  *generation = melo_jsonrpc_cache_generation;
+  G_UNLOCK (melo_jsonrpc_cache_mutex);
+
+  return result;
+}
+
+static void
+melo_jsonrpc_cache_store (gchar *key, JsonNode *result, guint events,
+                          guint64 generation)
+{
+  MeloJSONRPCCacheEntry *entry;
+
+  G_LOCK (melo_jsonrpc_cache_mutex);
+
+  /* Cache has been invalidated during the call: result can be outdated */
+  if (!melo_jsonrpc_cache || generation != melo_jsonrpc_cache_generation) {
+    G_UNLOCK (melo_jsonrpc_cache_mutex);
+    g_free (key);
+    return;
+  }
+
+  /* Cache is full: flush it */
+  if (g_hash_table_size (melo_jsonrpc_cache) >= MELO_JSONRPC_CACHE_SIZE)
+    g_hash_table_remove_all (melo_jsonrpc_cache);
+
+  /* Add result */
+  entry = g_slice_new (MeloJSONRPCCacheEntry);
+  entry->result = json_node_copy (result);
+  entry->events = events;
+  g_hash_table_replace (melo_jsonrpc_cache, key, entry);
+
+  G_UNLOCK (melo_jsonrpc_cache_mutex);
+}
+
+/**
+ * melo_jsonrpc_disable_cache:
+ *
+ * Prevent the result of the current method call from being cached, when it
+ * depends on a state which is not covered by the invalidation of the cache,
+ * as a playing position.
+ *
+ * This function must be called only from a #MeloJSONRPCCallback.
+ */
+void
+melo_jsonrpc_disable_cache (void)
+{
+  g_private_set (&melo_jsonrpc_uncached, GINT_TO_POINTER (TRUE));
+}
+
+/**
+ * melo_jsonrpc_cache_invalidate:
+ * @group: the prefix of the methods
+ * @method: (allow-none): the method name, or %NULL for all methods of @group
+ *
+ * Invalidate the cached results of the methods registered with
+ * #MELO_JSONRPC_FLAGS_CACHE. This function should be called each time the
+ * state presented by these methods is updated, when no #MeloEvent is emitted
+ * for it.
+ */
+void
+melo_jsonrpc_cache_invalidate (const gchar *group, const gchar *method)
+{
+  gchar *prefix;
+
+  /* Generate prefix of cache keys */
+  if (method)
+    prefix = g_strdup_printf ("%s.%s\n", group, method);
+  else
+    prefix = g_strdup_printf ("%s.", group);
+
+  /* Remove matching results */
+  G_LOCK (melo_jsonrpc_cache_mutex);
+  if (melo_jsonrpc_cache) {
+    g_hash_table_foreach_remove (melo_jsonrpc_cache,
+                                 melo_jsonrpc_cache_match_prefix, prefix);
+    if (method) {
+      g_free (prefix);
+      prefix = g_strdup_printf ("%s.%s", group, method);
+      g_hash_table_remove (melo_jsonrpc_cache, prefix);
+    }
+    melo_jsonrpc_cache_generation++;
+  }
+  G_UNLOCK (melo_jsonrpc_cache_mutex);
+
+  g_free (prefix);
+}
+
+/**
+ * melo_jsonrpc_flush_cache:
+ *
+ * Drop all the cached results of the methods registered with
+ * #MELO_JSONRPC_FLAGS_CACHE, to release memory.
+ */
+void
+melo_jsonrpc_flush_cache (void)
+{
+  G_LOCK (melo_jsonrpc_cache_mutex);
+  if (melo_jsonrpc_cache) {
+    g_hash_table_remove_all (melo_jsonrpc_cache);
+    melo_jsonrpc_cache_generation++;
+  }
+  G_UNLOCK (melo_jsonrpc_cache_mutex);
+}
+
 /* Register a JSON-RPC method */
 static void
 melo_jsonrpc_free_method (gpointer data)
 {
   MeloJSONRPCInternalMethod *m = data;
 
-  /* Free nodes */
+  /* Free schemas */
   if (m->params)
-    json_array_unref (m->params);
+    melo_jsonrpc_schema_unref (m->params);
   if (m->result)
     json_object_unref (m->result);
 
@@ -99,9 +778,9 @@ melo_jsonrpc_free_method (gpointer data)
  *    @params and @result are matching
  * @user_data: the user data to use when calling @callback
  *
- * Register one JSON-RPC method named @method and prefixed with @group.
- * The final method will be as "@group.@name".
- * For more details on the @params and @method, please see #MeloJSONRPCMethod.
+ * Register one JSON-RPC method named @method and prefixed with @group, with
+ * no particular flags. See melo_jsonrpc_register_method_full() for more
+ * details.
  *
  * Returns: %TRUE if method has been registered, %FALSE otherwise.
  */
@@ -111,12 +790,72 @@ melo_jsonrpc_register_method (const gchar *group, const gchar *method,
                               MeloJSONRPCCallback callback,
                               gpointer user_data)
 {
+  return melo_jsonrpc_register_method_full (group, method, params, result,
+                                            callback, user_data,
+                                            MELO_JSONRPC_FLAGS_NONE);
+}
+
+/**
+ * melo_jsonrpc_register_method_full:
+ * @group: prefix of the method
+ * @method: the method name
+ * @params: the schema of the parameters accepted as JSON
+ * @result: the schema of the result provided as JSON
+ * @callback: the callback of type #MeloJSONRPCCallback to call when @method,
+ *    @params and @result are matching
+ * @user_data: the user data to use when calling @callback
+ * @flags: the #MeloJSONRPCFlags of the method
+ *
+ * Register one JSON-RPC method named @method and prefixed with @group.
+ * The final method will be as "@group.@name".
+ * For more details on the @params and @method, please see #MeloJSONRPCMethod.
+ *
+ * The @params schema is compiled during registration, so it is never parsed
+ * again when the method is called. On success, the ownership of @params and
+ * @result is taken.
+ *
+ * Returns: %TRUE if method has been registered, %FALSE otherwise.
+ */
+gboolean
+melo_jsonrpc_register_method_full (const gchar *group, const gchar *method,
+                                   JsonArray *params, JsonObject *result,
+                                   MeloJSONRPCCallback callback,
+                                   gpointer user_data, MeloJSONRPCFlags flags)
+{
+  return melo_jsonrpc_register_method_internal (group, method, params, result,
+                                                callback, user_data, flags, 0);
+}
+
+static gboolean
+melo_jsonrpc_register_method_internal (const gchar *group, const gchar *method,
+                                       JsonArray *params, JsonObject *result,
+                                       MeloJSONRPCCallback callback,
+                                       gpointer user_data,
+                                       MeloJSONRPCFlags flags,
+                                       guint cache_events)
+{
+  MeloJSONRPCSchema *schema = NULL;
   MeloJSONRPCInternalMethod *m;
+  MeloJSONRPCStats *stats;
   gchar *complete_method;
 
+  /* Compile parameters schema */
+  if (params) {
+    schema = melo_jsonrpc_schema_new (params);
+    if (!schema)
+      return FALSE;
+  }
+
   /* Create complete method */
   complete_method = g_strdup_printf ("%s.%s", group, method);
 
+  /* Get method statistics */
+  stats = melo_jsonrpc_stats_get (complete_method);
+
+  /* Results will be cached */
+  if (flags & MELO_JSONRPC_FLAGS_CACHE)
+    melo_jsonrpc_cache_init ();
+
   /* Lock method list access */
   G_LOCK (melo_jsonrpc_mutex);
 
@@ -137,10 +876,13 @@ melo_jsonrpc_register_method (const gchar *group, const gchar *method,
     goto failed;
 
   /* Fill handler */
-  m->params = params;
+  m->params = schema;
   m->result = result;
   m->callback = callback;
   m->user_data = user_data;
+  m->flags = flags;
+  m->cache_events = cache_events;
+  m->stats = stats;
 
   /* Add method */
   g_hash_table_insert (melo_jsonrpc_methods, complete_method, m);
@@ -148,10 +890,16 @@ melo_jsonrpc_register_method (const gchar *group, const gchar *method,
   /* Unlock method list access */
   G_UNLOCK (melo_jsonrpc_mutex);
 
+  /* Schema holds a reference on parameters */
+  if (params)
+    json_array_unref (params);
+
   return TRUE;
 
 failed:
   G_UNLOCK (melo_jsonrpc_mutex);
+  if (schema)
+    melo_jsonrpc_schema_unref (schema);
   g_free (complete_method);
   return FALSE;
 }
@@ -188,6 +936,9 @@ melo_jsonrpc_unregister_method (const gchar *group, const gchar *method)
 
   /* Free complete method */
   g_free (complete_method);
+
+  /* Remove cached results */
+  melo_jsonrpc_cache_invalidate (group, method);
 }
 
 /**
@@ -247,9 +998,12 @@ melo_jsonrpc_register_methods (const gchar *group, MeloJSONRPCMethod *methods,
       result = NULL;
 
     /* Register method */
-    ret = melo_jsonrpc_register_method (group, methods[i].method, params,
-                                        result, methods[i].callback,
-                                        methods[i].user_data);
+    ret = melo_jsonrpc_register_method_internal (group, methods[i].method,
+                                                 params, result,
+                                                 methods[i].callback,
+                                                 methods[i].user_data,
+                                                 methods[i].flags,
+                                                 methods[i].cache_events);
 
     /* Failed to register method */
     if (!ret) {
@@ -261,29 +1015,693 @@ melo_jsonrpc_register_methods (const gchar *group, MeloJSONRPCMethod *methods,
     }
   }
 
-  /* Release parser */
-  g_object_unref (parser);
+  /* Release parser */
+  g_object_unref (parser);
+
+  return errors;
+}
+
+/**
+ * melo_jsonrpc_unregister_methods:
+ * @group: prefix of the method
+ * @methods: an array of #MeloJSONRPCMethod
+ * @count: the number of methods in @methods
+ *
+ * Unregister multiple JSON-RPC method named with the same prefix @group.
+ */
+void
+melo_jsonrpc_unregister_methods (const gchar *group, MeloJSONRPCMethod *methods,
+                                 guint count)
+{
+  guint i;
+
+  /* Unregister all methods */
+  for (i = 0; i < count; i++)
+    melo_jsonrpc_unregister_method (group, methods[i].method);
+}
+
+/* Request priority */
+#define MELO_JSONRPC_PRIORITY_NAME_SIZE 128
+
+static MeloJSONRPCPriority
+melo_jsonrpc_method_priority (const gchar *method, gsize len)
+{
+  gchar name[MELO_JSONRPC_PRIORITY_NAME_SIZE];
+  MeloJSONRPCInternalMethod *m;
+
+  /* Method name is too long */
+  if (len >= sizeof (name) || !melo_jsonrpc_methods)
+    return MELO_JSONRPC_PRIORITY_NORMAL;
+  memcpy (name, method, len);
+  name[len] = '\0';
+
+  /* Get priority from method flags */
+  m = g_hash_table_lookup (melo_jsonrpc_methods, name);
+  if (m && m->flags & MELO_JSONRPC_FLAGS_WAIT)
+    return MELO_JSONRPC_PRIORITY_WAIT;
+  if (m && m->flags & MELO_JSONRPC_FLAGS_BULK)
+    return MELO_JSONRPC_PRIORITY_BULK;
+  if (m && m->flags & MELO_JSONRPC_FLAGS_CONTROL)
+    return MELO_JSONRPC_PRIORITY_CONTROL;
+  return MELO_JSONRPC_PRIORITY_NORMAL;
+}
+
+/* Merge priority of a method in priority of request */
+static gboolean
+melo_jsonrpc_priority_merge (MeloJSONRPCPriority *ret,
+                             MeloJSONRPCPriority prio)
+{
+  /* A wait method is enough to block the request */
+  if (prio == MELO_JSONRPC_PRIORITY_WAIT) {
+    *ret = prio;
+    return FALSE;
+  }
+
+  /* A bulk method is enough to slow down the request */
+  if (prio == MELO_JSONRPC_PRIORITY_BULK ||
+      *ret == MELO_JSONRPC_PRIORITY_BULK) {
+    *ret = MELO_JSONRPC_PRIORITY_BULK;
+    return TRUE;
+  }
+  if (prio == MELO_JSONRPC_PRIORITY_NORMAL ||
+      *ret == MELO_JSONRPC_PRIORITY_COUNT)
+    *ret = prio;
+  return TRUE;
+}
+
+/**
+ * melo_jsonrpc_get_priority:
+ * @request: the JSON-RPC request serialized in a string
+ * @length: the length of @request, can be -1 for null-terminated string
+ *
+ * Get the priority of a JSON-RPC request from the flags of the methods it
+ * calls, without parsing it: only the "method" members are looked up in the
+ * serialized @request. It can be used to select a thread pool before calling
+ * melo_jsonrpc_parse_request().
+ *
+ * A batch request is #MELO_JSONRPC_PRIORITY_WAIT if one of its methods is
+ * registered with #MELO_JSONRPC_FLAGS_WAIT, #MELO_JSONRPC_PRIORITY_BULK if
+ * one of its methods is registered with #MELO_JSONRPC_FLAGS_BULK, and
+ * #MELO_JSONRPC_PRIORITY_CONTROL only if all its methods are registered with
+ * #MELO_JSONRPC_FLAGS_CONTROL.
+ *
+ * Returns: the #MeloJSONRPCPriority of the request.
+ */
+MeloJSONRPCPriority
+melo_jsonrpc_get_priority (const gchar *request, gsize length)
+{
+  MeloJSONRPCPriority ret = MELO_JSONRPC_PRIORITY_COUNT;
+  MeloJSONRPCPriority prio;
+  const gchar *end, *name;
+
+  if (!request)
+    return MELO_JSONRPC_PRIORITY_NORMAL;
+  if (length == (gsize) -1)
+    length = strlen (request);
+  end = request + length;
+
+  G_LOCK (melo_jsonrpc_mutex);
+
+  /* Find all method names */
+  while ((request = g_strstr_len (request, end - request, "\"method\""))) {
+    request += 8;
+
+    /* Skip to method name */
+    while (request < end && g_ascii_isspace (*request))
+      request++;
+    if (request >= end || *request++ != ':')
+      continue;
+    while (request < end && g_ascii_isspace (*request))
+      request++;
+    if (request >= end || *request++ != '"')
+      continue;
+
+    /* Find end of name: escaped names are not supported */
+    for (name = request; request < end && *request != '"' &&
+         *request != '\\'; request++);
+    if (request >= end)
+      break;
+    if (*request == '\\')
+      prio = MELO_JSONRPC_PRIORITY_NORMAL;
+    else
+      prio = melo_jsonrpc_method_priority (name, request - name);
+    if (!melo_jsonrpc_priority_merge (&ret, prio))
+      break;
+  }
+
+  G_UNLOCK (melo_jsonrpc_mutex);
+
+  /* No method found */
+  if (ret == MELO_JSONRPC_PRIORITY_COUNT)
+    ret = MELO_JSONRPC_PRIORITY_NORMAL;
+
+  return ret;
+}
+
+/**
+ * melo_jsonrpc_get_priority_cbor:
+ * @request: the JSON-RPC request encoded in CBOR
+ * @length: the length of @request
+ *
+ * Same as melo_jsonrpc_get_priority() for a request encoded in CBOR, as
+ * accepted by melo_jsonrpc_parse_request_cbor().
+ *
+ * Returns: the #MeloJSONRPCPriority of the request.
+ */
+MeloJSONRPCPriority
+melo_jsonrpc_get_priority_cbor (gconstpointer request, gsize length)
+{
+  static const guint8 key[] = { 0x66, 'm', 'e', 't', 'h', 'o', 'd' };
+  MeloJSONRPCPriority ret = MELO_JSONRPC_PRIORITY_COUNT;
+  MeloJSONRPCPriority prio;
+  const guint8 *p = request, *end;
+  gsize len;
+
+  if (!request)
+    return MELO_JSONRPC_PRIORITY_NORMAL;
+  end = p + length;
+
+  G_LOCK (melo_jsonrpc_mutex);
+
+  /* Find all "method" text keys */
+  while ((p = memchr (p, key[0], end - p))) {
+    if ((gsize) (end - p) < sizeof (key) + 1 ||
+        memcmp (p, key, sizeof (key))) {
+      p++;
+      continue;
+    }
+    p += sizeof (key);
+
+    /* Get length of method name: short text strings only */
+    if (*p >= 0x60 && *p < 0x78)
+      len = *p++ - 0x60;
+    else if (*p == 0x78 && end - p > 1) {
+      len = p[1];
+      p += 2;
+    } else
+      continue;
+    if ((gsize) (end - p) < len)
+      break;
+
+    /* Get method priority */
+    prio = melo_jsonrpc_method_priority ((const gchar *) p, len);
+    if (!melo_jsonrpc_priority_merge (&ret, prio))
+      break;
+    p += len;
+  }
+
+  G_UNLOCK (melo_jsonrpc_mutex);
+
+  /* No method found */
+  if (ret == MELO_JSONRPC_PRIORITY_COUNT)
+    ret = MELO_JSONRPC_PRIORITY_NORMAL;
+
+  return ret;
+}
+
+/* Streaming writer */
+#define MELO_JSONRPC_WRITER_DEPTH 64
+#define MELO_JSONRPC_WRITER_CHUNK_SIZE 16384
+
+struct _MeloJSONRPCWriter {
+  MeloJSONRPCWriteFunc func;
+  gpointer user_data;
+  GString *buf;
+  guint depth;
+  gboolean member;
+  gboolean first[MELO_JSONRPC_WRITER_DEPTH];
+};
+
+typedef struct {
+  MeloJSONRPCWriter *writer;
+  gboolean ready;
+  gboolean started;
+  const gchar *id;
+  gint64 nid;
+} MeloJSONRPCStream;
+
+/* Streamed request currently parsed in this thread */
+static GPrivate melo_jsonrpc_stream = G_PRIVATE_INIT (NULL);
+
+/**
+ * melo_jsonrpc_writer_new:
+ * @func: the function called with each chunk of serialized JSON
+ * @user_data: the user data to pass to @func
+ *
+ * Create a new streaming JSON writer. Unlike a #JsonGenerator, the JSON data is
+ * not serialized in one string: the data is written in a small buffer which is
+ * passed to @func each time it is full, so a large result can be sent while it
+ * is produced.
+ *
+ * Returns: (transfer full): a new #MeloJSONRPCWriter. After use, call
+ * melo_jsonrpc_writer_free().
+ */
+MeloJSONRPCWriter *
+melo_jsonrpc_writer_new (MeloJSONRPCWriteFunc func, gpointer user_data)
+{
+  MeloJSONRPCWriter *w;
+
+  w = g_slice_new0 (MeloJSONRPCWriter);
+  w->func = func;
+  w->user_data = user_data;
+  w->buf = g_string_sized_new (MELO_JSONRPC_WRITER_CHUNK_SIZE);
+
+  return w;
+}
+
+/**
+ * melo_jsonrpc_writer_flush:
+ * @w: a #MeloJSONRPCWriter
+ *
+ * Pass the current buffered data to the write function.
+ */
+void
+melo_jsonrpc_writer_flush (MeloJSONRPCWriter *w)
+{
+  gsize len = w->buf->len;
+
+  if (!len)
+    return;
+
+  /* Pass buffer to write function and allocate a new one */
+  w->func (g_string_free (w->buf, FALSE), len, w->user_data);
+  w->buf = g_string_sized_new (MELO_JSONRPC_WRITER_CHUNK_SIZE);
+}
+
+/**
+ * melo_jsonrpc_writer_free:
+ * @w: a #MeloJSONRPCWriter
+ *
+ * Flush the remaining data and free the writer.
+ */
+void
+melo_jsonrpc_writer_free (MeloJSONRPCWriter *w)
+{
+  melo_jsonrpc_writer_flush (w);
+  g_string_free (w->buf, TRUE);
+  g_slice_free (MeloJSONRPCWriter, w);
+}
+
+static void
+melo_jsonrpc_writer_prefix (MeloJSONRPCWriter *w)
+{
+  /* Value of a member */
+  if (w->member) {
+    w->member = FALSE;
+    return;
+  }
+
+  /* Add separator */
+  if (w->depth) {
+    if (!w->first[w->depth - 1])
+      g_string_append_c (w->buf, ',');
+    w->first[w->depth - 1] = FALSE;
+  }
+}
+
+static void
+melo_jsonrpc_writer_check (MeloJSONRPCWriter *w)
+{
+  if (w->buf->len >= MELO_JSONRPC_WRITER_CHUNK_SIZE)
+    melo_jsonrpc_writer_flush (w);
+}
+
+static void
+melo_jsonrpc_writer_escape (MeloJSONRPCWriter *w, const gchar *str)
+{
+  const gchar *p;
+
+  g_string_append_c (w->buf, '"');
+  for (p = str; *p; p++) {
+    switch (*p) {
+      case '"':
+        g_string_append (w->buf, "\\\"");
+        break;
+      case '\\':
+        g_string_append (w->buf, "\\\\");
+        break;
+      case '\b':
+        g_string_append (w->buf, "\\b");
+        break;
+      case '\f':
+        g_string_append (w->buf, "\\f");
+        break;
+      case '\n':
+        g_string_append (w->buf, "\\n");
+        break;
+      case '\r':
+        g_string_append (w->buf, "\\r");
+        break;
+      case '\t':
+        g_string_append (w->buf, "\\t");
+        break;
+      default:
+        if ((guchar) *p < 0x20)
+          g_string_append_printf (w->buf, "\\u%04x", *p);
+        else
+          g_string_append_c (w->buf, *p);
+    }
+  }
+  g_string_append_c (w->buf, '"');
+}
+
+static void
+melo_jsonrpc_writer_begin (MeloJSONRPCWriter *w, gchar c)
+{
+  g_return_if_fail (w->depth < MELO_JSONRPC_WRITER_DEPTH);
+
+  melo_jsonrpc_writer_prefix (w);
+  g_string_append_c (w->buf, c);
+  w->first[w->depth++] = TRUE;
+}
+
+static void
+melo_jsonrpc_writer_end (MeloJSONRPCWriter *w, gchar c)
+{
+  g_return_if_fail (w->depth);
+
+  g_string_append_c (w->buf, c);
+  w->depth--;
+  melo_jsonrpc_writer_check (w);
+}
+
+/**
+ * melo_jsonrpc_writer_begin_object:
+ * @w: a #MeloJSONRPCWriter
+ *
+ * Begin a new JSON object.
+ */
+void
+melo_jsonrpc_writer_begin_object (MeloJSONRPCWriter *w)
+{
+  melo_jsonrpc_writer_begin (w, '{');
+}
+
+/**
+ * melo_jsonrpc_writer_end_object:
+ * @w: a #MeloJSONRPCWriter
+ *
+ * End the current JSON object.
+ */
+void
+melo_jsonrpc_writer_end_object (MeloJSONRPCWriter *w)
+{
+  melo_jsonrpc_writer_end (w, '}');
+}
+
+/**
+ * melo_jsonrpc_writer_begin_array:
+ * @w: a #MeloJSONRPCWriter
+ *
+ * Begin a new JSON array.
+ */
+void
+melo_jsonrpc_writer_begin_array (MeloJSONRPCWriter *w)
+{
+  melo_jsonrpc_writer_begin (w, '[');
+}
+
+/**
+ * melo_jsonrpc_writer_end_array:
+ * @w: a #MeloJSONRPCWriter
+ *
+ * End the current JSON array.
+ */
+void
+melo_jsonrpc_writer_end_array (MeloJSONRPCWriter *w)
+{
+  melo_jsonrpc_writer_end (w, ']');
+}
+
+/**
+ * melo_jsonrpc_writer_set_member_name:
+ * @w: a #MeloJSONRPCWriter
+ * @name: the member name
+ *
+ * Set the name of the next member of the current object. It must be followed
+ * by a value, an object or an array.
+ */
+void
+melo_jsonrpc_writer_set_member_name (MeloJSONRPCWriter *w, const gchar *name)
+{
+  melo_jsonrpc_writer_prefix (w);
+  melo_jsonrpc_writer_escape (w, name);
+  g_string_append_c (w->buf, ':');
+  w->member = TRUE;
+}
+
+/**
+ * melo_jsonrpc_writer_add_string_value:
+ * @w: a #MeloJSONRPCWriter
+ * @value: (nullable): the string value
+ *
+ * Add a string value, or null if @value is %NULL.
+ */
+void
+melo_jsonrpc_writer_add_string_value (MeloJSONRPCWriter *w, const gchar *value)
+{
+  melo_jsonrpc_writer_prefix (w);
+  if (value)
+    melo_jsonrpc_writer_escape (w, value);
+  else
+    g_string_append (w->buf, "null");
+  melo_jsonrpc_writer_check (w);
+}
+
+/**
+ * melo_jsonrpc_writer_add_int_value:
+ * @w: a #MeloJSONRPCWriter
+ * @value: the integer value
+ *
+ * Add an integer value.
+ */
+void
+melo_jsonrpc_writer_add_int_value (MeloJSONRPCWriter *w, gint64 value)
+{
+  melo_jsonrpc_writer_prefix (w);
+  g_string_append_printf (w->buf, "%" G_GINT64_FORMAT, value);
+  melo_jsonrpc_writer_check (w);
+}
+
+/**
+ * melo_jsonrpc_writer_add_double_value:
+ * @w: a #MeloJSONRPCWriter
+ * @value: the double value
+ *
+ * Add a double value.
+ */
+void
+melo_jsonrpc_writer_add_double_value (MeloJSONRPCWriter *w, gdouble value)
+{
+  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+  melo_jsonrpc_writer_prefix (w);
+  g_string_append (w->buf, g_ascii_dtostr (buf, sizeof (buf), value));
+  melo_jsonrpc_writer_check (w);
+}
+
+/**
+ * melo_jsonrpc_writer_add_boolean_value:
+ * @w: a #MeloJSONRPCWriter
+ * @value: the boolean value
+ *
+ * Add a boolean value.
+ */
+void
+melo_jsonrpc_writer_add_boolean_value (MeloJSONRPCWriter *w, gboolean value)
+{
+  melo_jsonrpc_writer_prefix (w);
+  g_string_append (w->buf, value ? "true" : "false");
+  melo_jsonrpc_writer_check (w);
+}
+
+/**
+ * melo_jsonrpc_writer_add_null_value:
+ * @w: a #MeloJSONRPCWriter
+ *
+ * Add a null value.
+ */
+void
+melo_jsonrpc_writer_add_null_value (MeloJSONRPCWriter *w)
+{
+  melo_jsonrpc_writer_prefix (w);
+  g_string_append (w->buf, "null");
+  melo_jsonrpc_writer_check (w);
+}
+
+/**
+ * melo_jsonrpc_writer_add_raw_value:
+ * @w: a #MeloJSONRPCWriter
+ * @data: a complete serialized JSON value
+ * @size: the size of @data, can be -1 for null-terminated string
+ *
+ * Add a value which is already serialized: @data is copied as is, so it must
+ * be a valid JSON value. It can be used to send stored values without parsing
+ * them again.
+ */
+void
+melo_jsonrpc_writer_add_raw_value (MeloJSONRPCWriter *w, const gchar *data,
+                                   gssize size)
+{
+  melo_jsonrpc_writer_prefix (w);
+  g_string_append_len (w->buf, data, size);
+  melo_jsonrpc_writer_check (w);
+}
+
+static void
+melo_jsonrpc_writer_add_member (JsonObject *object, const gchar *name,
+                                JsonNode *node, gpointer user_data)
+{
+  melo_jsonrpc_writer_set_member_name (user_data, name);
+  melo_jsonrpc_writer_add_node (user_data, node);
+}
 
-  return errors;
+static void
+melo_jsonrpc_writer_add_element (JsonArray *array, guint index, JsonNode *node,
+                                 gpointer user_data)
+{
+  melo_jsonrpc_writer_add_node (user_data, node);
 }
 
 /**
- * melo_jsonrpc_unregister_methods:
- * @group: prefix of the method
- * @methods: an array of #MeloJSONRPCMethod
- * @count: the number of methods in @methods
+ * melo_jsonrpc_writer_add_node:
+ * @w: a #MeloJSONRPCWriter
+ * @node: the #JsonNode to serialize
  *
- * Unregister multiple JSON-RPC method named with the same prefix @group.
+ * Serialize a complete #JsonNode tree.
  */
 void
-melo_jsonrpc_unregister_methods (const gchar *group, MeloJSONRPCMethod *methods,
-                                 guint count)
+melo_jsonrpc_writer_add_node (MeloJSONRPCWriter *w, JsonNode *node)
 {
-  guint i;
+  switch (json_node_get_node_type (node)) {
+    case JSON_NODE_OBJECT:
+      melo_jsonrpc_writer_begin_object (w);
+      json_object_foreach_member (json_node_get_object (node),
+                                  melo_jsonrpc_writer_add_member, w);
+      melo_jsonrpc_writer_end_object (w);
+      break;
+    case JSON_NODE_ARRAY:
+      melo_jsonrpc_writer_begin_array (w);
+      json_array_foreach_element (json_node_get_array (node),
+                                  melo_jsonrpc_writer_add_element, w);
+      melo_jsonrpc_writer_end_array (w);
+      break;
+    case JSON_NODE_VALUE:
+      switch (json_node_get_value_type (node)) {
+        case G_TYPE_INT64:
+          melo_jsonrpc_writer_add_int_value (w, json_node_get_int (node));
+          break;
+        case G_TYPE_DOUBLE:
+          melo_jsonrpc_writer_add_double_value (w, json_node_get_double (node));
+          break;
+        case G_TYPE_BOOLEAN:
+          melo_jsonrpc_writer_add_boolean_value (w,
+                                                 json_node_get_boolean (node));
+          break;
+        case G_TYPE_STRING:
+          melo_jsonrpc_writer_add_string_value (w, json_node_get_string (node));
+          break;
+        default:
+          melo_jsonrpc_writer_add_null_value (w);
+      }
+      break;
+    case JSON_NODE_NULL:
+      melo_jsonrpc_writer_add_null_value (w);
+      break;
+  }
+}
 
-  /* Unregister all methods */
-  for (i = 0; i < count; i++)
-    melo_jsonrpc_unregister_method (group, methods[i].method);
+/**
+ * melo_jsonrpc_writer_add_object:
+ * @w: a #MeloJSONRPCWriter
+ * @object: the #JsonObject to serialize
+ *
+ * Serialize a complete #JsonObject.
+ */
+void
+melo_jsonrpc_writer_add_object (MeloJSONRPCWriter *w, JsonObject *object)
+{
+  melo_jsonrpc_writer_begin_object (w);
+  json_object_foreach_member (object, melo_jsonrpc_writer_add_member, w);
+  melo_jsonrpc_writer_end_object (w);
+}
+
+/**
+ * melo_jsonrpc_begin_result:
+ *
+ * Start to stream the result of the current method call. When the request is
+ * parsed with melo_jsonrpc_parse_request_stream(), a #MeloJSONRPCCallback can
+ * write its result directly with the returned writer, instead of building a
+ * #JsonNode tree: the response is then sent while the result is produced.
+ *
+ * Exactly one value (generally an object) must be written and the callback
+ * must then return without setting its result or error. Since the response is
+ * already started, no error can be reported after calling this function.
+ *
+ * This function must be called only from a #MeloJSONRPCCallback.
+ *
+ * Returns: (transfer none): a #MeloJSONRPCWriter to use for the result, or
+ * %NULL if the result cannot be streamed. In this case, the result must be
+ * set as usual.
+ */
+MeloJSONRPCWriter *
+melo_jsonrpc_begin_result (void)
+{
+  MeloJSONRPCStream *stream;
+  MeloJSONRPCWriter *w;
+
+  /* Streaming is not available */
+  stream = g_private_get (&melo_jsonrpc_stream);
+  if (!stream || !stream->ready || stream->started)
+    return NULL;
+  w = stream->writer;
+
+  /* Write response header: we assume ID cannot be negative */
+  melo_jsonrpc_writer_begin_object (w);
+  melo_jsonrpc_writer_set_member_name (w, "jsonrpc");
+  melo_jsonrpc_writer_add_string_value (w, "2.0");
+  melo_jsonrpc_writer_set_member_name (w, "id");
+  if (stream->nid < 0 || stream->id)
+    melo_jsonrpc_writer_add_string_value (w, stream->id);
+  else
+    melo_jsonrpc_writer_add_int_value (w, stream->nid);
+  melo_jsonrpc_writer_set_member_name (w, "result");
+  stream->started = TRUE;
+
+  return w;
+}
+
+/* Update statistics at end of method call */
+static void
+melo_jsonrpc_stats_end (MeloJSONRPCStats *stats, gint64 start,
+                        gboolean failed)
+{
+  gint64 now;
+
+  if (!stats)
+    return;
+
+  now = g_get_monotonic_time ();
+  G_LOCK (melo_jsonrpc_stats_mutex);
+  melo_jsonrpc_histogram_add (&stats->callback, now - start);
+  stats->in_flight--;
+  if (failed)
+    stats->errors++;
+  G_UNLOCK (melo_jsonrpc_stats_mutex);
+}
+
+static void
+melo_jsonrpc_stats_serialize (MeloJSONRPCStats *stats, gint64 start)
+{
+  gint64 now;
+
+  if (!stats)
+    return;
+
+  now = g_get_monotonic_time ();
+  G_LOCK (melo_jsonrpc_stats_mutex);
+  melo_jsonrpc_histogram_add (&stats->serialize, now - start);
+  G_UNLOCK (melo_jsonrpc_stats_mutex);
 }
 
 /* Parse JSON-RPC request */
@@ -292,16 +1710,32 @@ melo_jsonrpc_parse_node (JsonNode *node)
 {
   MeloJSONRPCInternalMethod *m;
   MeloJSONRPCCallback callback = NULL;
+  MeloJSONRPCSchema *schema = NULL;
+  MeloJSONRPCStats *stats = NULL;
+  MeloJSONRPCStream *stream;
+  MeloJSONRPCFlags flags = 0;
   gpointer user_data = NULL;
+  guint cache_events = 0;
+  guint64 generation = 0;
+  gchar *key = NULL;
   JsonArray *s_params = NULL;
+  gint64 trace;
+  gpointer prev;
   JsonNode *result = NULL;
   JsonNode *error = NULL;
+  JsonNode *res = NULL;
   JsonNode *params;
   JsonObject *obj;
   const char *version;
   const char *method;
   const char *id = NULL;
   gint64 nid = -1;
+  gint64 start, now;
+
+  /* Get start time */
+  start = g_get_monotonic_time ();
+  trace = melo_trace_begin ();
+  g_private_set (&melo_jsonrpc_last, NULL);
 
   /* Not an object */
   if (JSON_NODE_TYPE (node) != JSON_NODE_OBJECT)
@@ -343,30 +1777,66 @@ melo_jsonrpc_parse_node (JsonNode *node)
 
   /* Get registered method */
   G_LOCK (melo_jsonrpc_mutex);
+  m = melo_jsonrpc_methods ?
+      g_hash_table_lookup (melo_jsonrpc_methods, method) : NULL;
+
+  /* Not found: activate plugin providing method group and retry */
+  if (!m) {
+    const gchar *dot = strrchr (method, '.');
+
+    G_UNLOCK (melo_jsonrpc_mutex);
+    if (dot) {
+      gchar *group = g_strndup (method, dot - method);
+      melo_plugin_activate (MELO_PLUGIN_PROVIDE_JSONRPC, group);
+      g_free (group);
+    }
+    G_LOCK (melo_jsonrpc_mutex);
+  }
+
   if (melo_jsonrpc_methods) {
     m = g_hash_table_lookup (melo_jsonrpc_methods, method);
     if (m) {
       callback = m->callback;
       user_data = m->user_data;
+      stats = m->stats;
+      flags = m->flags;
+      cache_events = m->cache_events;
       if (m->params)
-        s_params = json_array_ref (m->params);
+        schema = melo_jsonrpc_schema_ref (m->params);
     }
   }
   G_UNLOCK (melo_jsonrpc_mutex);
 
+  /* Update statistics: method is called */
+  if (stats) {
+    now = g_get_monotonic_time ();
+    G_LOCK (melo_jsonrpc_stats_mutex);
+    melo_jsonrpc_histogram_add (&stats->parse, now - start);
+    stats->calls++;
+    stats->in_flight++;
+    G_UNLOCK (melo_jsonrpc_stats_mutex);
+    start = now;
+  }
+
+  /* Save compiled schema for parameters utils */
+  if (schema)
+    s_params = schema->array;
+  prev = g_private_get (&melo_jsonrpc_current);
+  g_private_set (&melo_jsonrpc_current, schema);
+
   /* Check if id is present */
   if (!json_object_has_member (obj, "id")) {
     /* This is a notification: try to call callback */
     if (callback) {
       callback (method, s_params, params, &result, &error, user_data);
-      if (s_params)
-        json_array_unref (s_params);
+      melo_jsonrpc_stats_end (stats, start, error != NULL);
+      melo_trace_end ("jsonrpc", method, trace);
       if (error)
         json_node_free (error);
       if (result)
         json_node_free (result);
     }
-    return NULL;
+    goto end;
   }
 
   /* Get id */
@@ -377,23 +1847,82 @@ melo_jsonrpc_parse_node (JsonNode *node)
   if (!callback)
     goto not_found;
 
+  /* Get cached result */
+  if (flags & MELO_JSONRPC_FLAGS_CACHE) {
+    key = melo_jsonrpc_cache_key (method, schema, params);
+    if (key) {
+      result = melo_jsonrpc_cache_lookup (key, &generation);
+      if (result) {
+        melo_jsonrpc_stats_end (stats, start, FALSE);
+        g_private_set (&melo_jsonrpc_last, stats);
+        res = melo_jsonrpc_build_response_node (result, NULL, id, nid);
+        goto end;
+      }
+    }
+  }
+
+  /* Allow result streaming */
+  g_private_set (&melo_jsonrpc_uncached, NULL);
+  stream = g_private_get (&melo_jsonrpc_stream);
+  if (stream) {
+    stream->id = id;
+    stream->nid = nid;
+    stream->ready = TRUE;
+  }
+
   /* Call user callback */
   callback (method, s_params, params, &result, &error, user_data);
-  if (s_params)
-    json_array_unref (s_params);
+  melo_jsonrpc_stats_end (stats, start,
+                          error || (!result && !(stream && stream->started)));
+  melo_trace_end ("jsonrpc", method, trace);
+  g_private_set (&melo_jsonrpc_last, stats);
+
+  /* Result has been streamed: close response */
+  if (stream) {
+    stream->ready = FALSE;
+    if (stream->started) {
+      if (result || error)
+        g_warning ("JSON-RPC: %s result has already been streamed", method);
+      if (result)
+        json_node_free (result);
+      if (error)
+        json_node_free (error);
+      melo_jsonrpc_writer_end_object (stream->writer);
+      goto end;
+    }
+  }
+
+  /* Save result in cache */
+  if (key) {
+    if (result && !error && !g_private_get (&melo_jsonrpc_uncached))
+      melo_jsonrpc_cache_store (key, result, cache_events, generation);
+    else
+      g_free (key);
+    key = NULL;
+  }
 
   /* No error or result */
   if (!error && !result)
     goto not_found;
 
   /* Build response */
-  return melo_jsonrpc_build_response_node (result, error, id, nid);
+  res = melo_jsonrpc_build_response_node (result, error, id, nid);
+
+end:
+  g_private_set (&melo_jsonrpc_current, prev);
+  if (schema)
+    melo_jsonrpc_schema_unref (schema);
+  g_free (key);
+  return res;
 
 invalid:
   return melo_jsonrpc_build_error (NULL, -1,
                                         MELO_JSONRPC_ERROR_INVALID_REQUEST,
                                         "Invalid request");
 not_found:
+  g_private_set (&melo_jsonrpc_current, prev);
+  if (schema)
+    melo_jsonrpc_schema_unref (schema);
   return melo_jsonrpc_build_error (id, nid,
                                         MELO_JSONRPC_ERROR_METHOD_NOT_FOUND,
                                         "Method not found");
@@ -403,45 +1932,112 @@ internal:
                                         "Internal error");
 }
 
-/**
- * melo_jsonrpc_parse_request:
- * @request: the JSON-RPC requrest serialized in a string
- * @length: the length og @request, can be -1 for null-terminated string
- * @error: a pointer to a #GError which is set if an error occurred
- *
- * Parse a string @request containing a JSON-RPC serialized request, call the
- * registered callback which match the request method and present the result
- * as a JSON-RPC response serialized in a string.
- * If the method is not registered, a JSON-RPC response is generated with the
- * error MELO_JSONRPC_ERROR_METHOD_NOT_FOUND.
- *
- * Returns: (transfer full): a string containing the serialized #JsonNode
- * corresponding to the respond to the JSON-RPC request. Use g_free() after
- * usage.
- */
-gchar *
-melo_jsonrpc_parse_request (const gchar *request, gsize length, GError **error)
+/* Batch requests */
+static gboolean
+melo_jsonrpc_is_concurrent (JsonNode *node)
 {
-  JsonParser *parser;
-  JsonNodeType type;
-  JsonNode *req;
-  JsonNode *res;
-  GError *err = NULL;
-  gchar *str;
+  MeloJSONRPCInternalMethod *m;
+  gboolean ret = FALSE;
+  const gchar *method;
+  JsonNode *member;
 
-  /* Create parser */
-  parser = json_parser_new ();
-  if (!parser)
-    return melo_jsonrpc_build_error_str (MELO_JSONRPC_ERROR_INTERNAL_ERROR,
-                                         "Internal error");
+  /* Get method name */
+  if (JSON_NODE_TYPE (node) != JSON_NODE_OBJECT)
+    return FALSE;
+  member = json_object_get_member (json_node_get_object (node), "method");
+  if (!member || !JSON_NODE_HOLDS_VALUE (member) ||
+      json_node_get_value_type (member) != G_TYPE_STRING)
+    return FALSE;
+  method = json_node_get_string (member);
 
-  /* Parse request */
-  if (!json_parser_load_from_data (parser, request, length, &err) ||
-      (req = json_parser_get_root (parser)) == NULL) {
-    g_clear_error (&err);
-    goto parse_error;
+  /* Get method flags */
+  G_LOCK (melo_jsonrpc_mutex);
+  if (melo_jsonrpc_methods) {
+    m = g_hash_table_lookup (melo_jsonrpc_methods, method);
+    if (m)
+      ret = m->flags & MELO_JSONRPC_FLAGS_CONCURRENT;
+  }
+  G_UNLOCK (melo_jsonrpc_mutex);
+
+  return ret;
+}
+
+static void
+melo_jsonrpc_batch_func (gpointer data, gpointer user_data)
+{
+  MeloJSONRPCBatchItem *item = data;
+  MeloJSONRPCBatch *batch = item->batch;
+
+  /* Process request with cancellable of batch */
+  if (batch->cancellable)
+    g_cancellable_push_current (batch->cancellable);
+  item->res = melo_jsonrpc_parse_node (item->req);
+  if (batch->cancellable)
+    g_cancellable_pop_current (batch->cancellable);
+
+  /* Signal end of request */
+  g_mutex_lock (&batch->mutex);
+  if (!--batch->pending)
+    g_cond_signal (&batch->cond);
+  g_mutex_unlock (&batch->mutex);
+}
+
+static void
+melo_jsonrpc_parse_batch (MeloJSONRPCBatchItem *items, guint count)
+{
+  MeloJSONRPCBatch batch;
+  guint i;
+
+  /* Create thread pool */
+  G_LOCK (melo_jsonrpc_batch_mutex);
+  if (!melo_jsonrpc_batch_pool)
+    melo_jsonrpc_batch_pool = g_thread_pool_new (melo_jsonrpc_batch_func, NULL,
+                                                 MELO_JSONRPC_BATCH_THREADS,
+                                                 FALSE, NULL);
+  G_UNLOCK (melo_jsonrpc_batch_mutex);
+
+  /* Thread pool is not available: parse serially */
+  if (!melo_jsonrpc_batch_pool) {
+    for (i = 0; i < count; i++)
+      items[i].res = melo_jsonrpc_parse_node (items[i].req);
+    return;
+  }
+
+  /* Initialize batch */
+  g_mutex_init (&batch.mutex);
+  g_cond_init (&batch.cond);
+  batch.pending = count - 1;
+  batch.cancellable = g_cancellable_get_current ();
+
+  /* Fan out requests to thread pool, except first one */
+  for (i = 1; i < count; i++) {
+    items[i].batch = &batch;
+    g_thread_pool_push (melo_jsonrpc_batch_pool, &items[i], NULL);
   }
 
+  /* Process first request in current thread */
+  items[0].res = melo_jsonrpc_parse_node (items[0].req);
+
+  /* Wait end of all requests */
+  g_mutex_lock (&batch.mutex);
+  while (batch.pending)
+    g_cond_wait (&batch.cond, &batch.mutex);
+  g_mutex_unlock (&batch.mutex);
+
+  /* Release batch */
+  g_cond_clear (&batch.cond);
+  g_mutex_clear (&batch.mutex);
+}
+
+static JsonNode *
+melo_jsonrpc_parse_root (JsonNode *req)
+{
+  JsonNodeType type;
+  JsonNode *res;
+
+  /* Reset statistics of last request */
+  g_private_set (&melo_jsonrpc_last, NULL);
+
   /* Get node type */
   type = json_node_get_node_type (req);
 
@@ -451,10 +2047,11 @@ melo_jsonrpc_parse_request (const gchar *request, gsize length, GError **error)
     res = melo_jsonrpc_parse_node (req);
   } else if (type == JSON_NODE_ARRAY) {
     /* Parse multiple requests: batch */
+    MeloJSONRPCBatchItem *items;
+    MeloJSONRPCStream *stream;
     JsonArray *req_array;
     JsonArray *res_array;
-    JsonNode *node;
-    guint count, i;
+    guint count, i, j;
 
     /* Get array from node */
     req_array = json_node_get_array (req);
@@ -462,179 +2059,335 @@ melo_jsonrpc_parse_request (const gchar *request, gsize length, GError **error)
     if (!count)
       goto invalid;
 
+    /* Results of a batch cannot be streamed */
+    stream = g_private_get (&melo_jsonrpc_stream);
+    g_private_set (&melo_jsonrpc_stream, NULL);
+
     /* Create a new array for response */
     res_array = json_array_sized_new (count);
     res = json_node_new (JSON_NODE_ARRAY);
     json_node_take_array (res, res_array);
 
-    /* Parse each elements of array */
+    /* Get each elements of array */
+    items = g_new0 (MeloJSONRPCBatchItem, count);
     for (i = 0; i < count; i++) {
-      /* Get element */
-      node = json_array_get_element (req_array, i);
-
-      /* Process requesit */
-      node = melo_jsonrpc_parse_node (node);
+      items[i].req = json_array_get_element (req_array, i);
+      items[i].concurrent = melo_jsonrpc_is_concurrent (items[i].req);
+    }
 
-      /* Add new response to array */
-      if (node)
-        json_array_add_element (res_array, node);
+    /* Process requests: consecutive concurrent requests are run in parallel */
+    for (i = 0; i < count; i = j) {
+      for (j = i + 1; items[i].concurrent && j < count && items[j].concurrent;
+           j++);
+      if (j - i > 1)
+        melo_jsonrpc_parse_batch (&items[i], j - i);
+      else
+        items[i].res = melo_jsonrpc_parse_node (items[i].req);
     }
 
+    /* Add responses to array in order */
+    for (i = 0; i < count; i++)
+      if (items[i].res)
+        json_array_add_element (res_array, items[i].res);
+    g_free (items);
+    g_private_set (&melo_jsonrpc_stream, stream);
+    g_private_set (&melo_jsonrpc_last, NULL);
+
     /* Check if array is empty */
     count = json_array_get_length (res_array);
     if (!count) {
       json_node_free (res);
-      goto empty;
+      res = NULL;
     }
   } else
     goto invalid;
 
-  /* No response */
-  if (!res)
-    goto empty;
+  return res;
+
+invalid:
+  return melo_jsonrpc_build_error (NULL, -1, MELO_JSONRPC_ERROR_INVALID_REQUEST,
+                                   "Invalid request");
+}
+
+/* Requests accounting */
+static gsize
+melo_jsonrpc_request_begin (const gchar *request, gsize length)
+{
+  if (length == (gsize) -1)
+    length = strlen (request);
+
+  g_atomic_int_inc (&melo_jsonrpc_requests);
+  g_atomic_pointer_add (&melo_jsonrpc_request_bytes, length);
+
+  return length;
+}
+
+static void
+melo_jsonrpc_request_end (gsize length)
+{
+  g_atomic_pointer_add (&melo_jsonrpc_request_bytes, -(gssize) length);
+  g_atomic_int_add (&melo_jsonrpc_requests, -1);
+}
+
+/**
+ * melo_jsonrpc_get_memory_usage:
+ * @usage: the #MeloMemoryUsage to fill
+ *
+ * Get the number and the size of the JSON-RPC requests in progress, with the
+ * number of cached results in the details.
+ */
+void
+melo_jsonrpc_get_memory_usage (MeloMemoryUsage *usage)
+{
+  guint cached = 0;
+
+  /* Get requests in progress */
+  usage->count = g_atomic_int_get (&melo_jsonrpc_requests);
+  usage->bytes = (gsize) g_atomic_pointer_get (&melo_jsonrpc_request_bytes);
+
+  /* Get cached results */
+  G_LOCK (melo_jsonrpc_cache_mutex);
+  if (melo_jsonrpc_cache)
+    cached = g_hash_table_size (melo_jsonrpc_cache);
+  G_UNLOCK (melo_jsonrpc_cache_mutex);
+  usage->details = json_object_new ();
+  json_object_set_int_member (usage->details, "cached_results", cached);
+}
+
+static JsonNode *
+melo_jsonrpc_parse (const gchar *request, gsize length)
+{
+  JsonParser *parser;
+  JsonNode *req;
+  JsonNode *res;
+
+  /* Create parser */
+  parser = json_parser_new ();
+  if (!parser)
+    return melo_jsonrpc_build_error (NULL, -1,
+                                     MELO_JSONRPC_ERROR_INTERNAL_ERROR,
+                                     "Internal error");
+
+  /* Parse request */
+  if (!json_parser_load_from_data (parser, request, length, NULL) ||
+      (req = json_parser_get_root (parser)) == NULL) {
+    g_private_set (&melo_jsonrpc_last, NULL);
+    g_object_unref (parser);
+    return melo_jsonrpc_build_error (NULL, -1, MELO_JSONRPC_ERROR_PARSE_ERROR,
+                                     "Parse error");
+  }
+
+  /* Process request */
+  res = melo_jsonrpc_parse_root (req);
+  g_object_unref (parser);
+
+  return res;
+}
+
+/**
+ * melo_jsonrpc_parse_request:
+ * @request: the JSON-RPC requrest serialized in a string
+ * @length: the length og @request, can be -1 for null-terminated string
+ * @error: a pointer to a #GError which is set if an error occurred
+ *
+ * Parse a string @request containing a JSON-RPC serialized request, call the
+ * registered callback which match the request method and present the result
+ * as a JSON-RPC response serialized in a string.
+ * If the method is not registered, a JSON-RPC response is generated with the
+ * error MELO_JSONRPC_ERROR_METHOD_NOT_FOUND.
+ *
+ * In a batch request, consecutive calls to methods registered with
+ * #MELO_JSONRPC_FLAGS_CONCURRENT are executed in parallel. Other calls are
+ * executed alone, in order of presentation. The responses are always
+ * presented in the same order than in the request.
+ *
+ * Returns: (transfer full): a string containing the serialized #JsonNode
+ * corresponding to the respond to the JSON-RPC request. Use g_free() after
+ * usage.
+ */
+gchar *
+melo_jsonrpc_parse_request (const gchar *request, gsize length, GError **error)
+{
+  gint64 start;
+  JsonNode *res;
+  gchar *str;
+
+  /* Parse request */
+  length = melo_jsonrpc_request_begin (request, length);
+  res = melo_jsonrpc_parse (request, length);
+  if (!res) {
+    melo_jsonrpc_request_end (length);
+    return NULL;
+  }
 
   /* Generate final string */
+  start = g_get_monotonic_time ();
   str = melo_jsonrpc_node_to_string (res);
-
-  /* Free parser and root node */
   json_node_free (res);
-  g_object_unref (parser);
+  melo_jsonrpc_stats_serialize (g_private_get (&melo_jsonrpc_last), start);
+  melo_jsonrpc_request_end (length);
 
   return str;
-
-parse_error:
-  g_object_unref (parser);
-  return melo_jsonrpc_build_error_str (MELO_JSONRPC_ERROR_PARSE_ERROR,
-                                       "Parse error");
-invalid:
-  g_object_unref (parser);
-  return melo_jsonrpc_build_error_str (MELO_JSONRPC_ERROR_INVALID_REQUEST,
-                                       "Invalid request");
-empty:
-  g_object_unref (parser);
-  return NULL;
 }
 
-/* Params utils */
-static gboolean
-melo_jsonrpc_add_node (JsonNode *node, JsonObject *schema,
-                       JsonObject *obj, JsonArray *array)
+/**
+ * melo_jsonrpc_parse_request_stream:
+ * @request: the JSON-RPC requrest serialized in a string
+ * @length: the length og @request, can be -1 for null-terminated string
+ * @func: the function called with each chunk of the serialized response
+ * @user_data: the user data to pass to @func
+ * @error: a pointer to a #GError which is set if an error occurred
+ *
+ * Same as melo_jsonrpc_parse_request() but the response is serialized
+ * progressively and passed by chunks to @func, in order to reduce the memory
+ * usage and the latency of large responses. A method callback can also stream
+ * its result with melo_jsonrpc_begin_result().
+ *
+ * Returns: %TRUE if a response has been written, %FALSE otherwise.
+ */
+gboolean
+melo_jsonrpc_parse_request_stream (const gchar *request, gsize length,
+                                   MeloJSONRPCWriteFunc func,
+                                   gpointer user_data, GError **error)
 {
-  GType vtype = G_TYPE_INVALID;
-  const gchar *s_name;
-  const gchar *s_type;
-  JsonNodeType type;
+  MeloJSONRPCStream stream = { 0 };
+  gboolean ret;
+  JsonNode *res;
 
-  /* Get name and type from schema */
-  s_name = json_object_get_string_member (schema, "name");
-  s_type = json_object_get_string_member (schema, "type");
-  if (!s_name || !s_type)
-    return FALSE;
+  /* Create writer */
+  stream.writer = melo_jsonrpc_writer_new (func, user_data);
 
-  /* Get type */
-  type = json_node_get_node_type (node);
-  if (type == JSON_NODE_VALUE)
-    vtype = json_node_get_value_type (node);
+  /* Parse request */
+  length = melo_jsonrpc_request_begin (request, length);
+  g_private_set (&melo_jsonrpc_stream, &stream);
+  res = melo_jsonrpc_parse (request, length);
+  g_private_set (&melo_jsonrpc_stream, NULL);
+
+  /* Write response */
+  if (res) {
+    gint64 start = g_get_monotonic_time ();
+
+    melo_jsonrpc_writer_add_node (stream.writer, res);
+    json_node_free (res);
+    melo_jsonrpc_stats_serialize (g_private_get (&melo_jsonrpc_last), start);
+  }
+  ret = res || stream.started;
+
+  /* Flush and free writer */
+  melo_jsonrpc_writer_free (stream.writer);
+  melo_jsonrpc_request_end (length);
+
+  return ret;
+}
+
+/**
+ * melo_jsonrpc_parse_request_cbor:
+ * @request: the JSON-RPC request encoded in CBOR
+ * @length: the length of @request
+ * @error: a pointer to a #GError which is set if an error occurred
+ *
+ * Same as melo_jsonrpc_parse_request() but the request and the response are
+ * encoded in CBOR (RFC 7049) instead of textual JSON, see melo_cbor_decode().
+ * The results of the methods are never streamed.
+ *
+ * Returns: (transfer full): a #GBytes containing the JSON-RPC response encoded
+ * in CBOR, or %NULL if there is no response. Use g_bytes_unref() after usage.
+ */
+GBytes *
+melo_jsonrpc_parse_request_cbor (gconstpointer request, gsize length,
+                                 GError **error)
+{
+  JsonNode *req, *res;
+  GBytes *bytes;
+  gint64 start;
+
+  /* Decode request */
+  melo_jsonrpc_request_begin ((const gchar *) request, length);
+  req = melo_cbor_decode (request, length);
+  if (req) {
+    res = melo_jsonrpc_parse_root (req);
+    json_node_free (req);
+  } else {
+    g_private_set (&melo_jsonrpc_last, NULL);
+    res = melo_jsonrpc_build_error (NULL, -1, MELO_JSONRPC_ERROR_PARSE_ERROR,
+                                    "Parse error");
+  }
+  if (!res) {
+    melo_jsonrpc_request_end (length);
+    return NULL;
+  }
 
-  /* Check type:
-   * We check only first letter of the type string.
-   */
-  switch (s_type[0]) {
-    case 'b':
-      /* Boolean: check type */
-      if (vtype != G_TYPE_BOOLEAN)
-        return FALSE;
+  /* Encode response */
+  start = g_get_monotonic_time ();
+  bytes = melo_cbor_encode (res);
+  json_node_free (res);
+  melo_jsonrpc_stats_serialize (g_private_get (&melo_jsonrpc_last), start);
+  melo_jsonrpc_request_end (length);
 
-      /* Add to object / array */
-      if (obj || array) {
-        gboolean v;
-        v = json_node_get_boolean (node);
-        if (obj)
-          json_object_set_boolean_member (obj, s_name, v);
-        else
-          json_array_add_boolean_element (array, v);
-        break;
-      }
-      break;
-    case 'i':
-      /* Integer: check type */
-      if (vtype != G_TYPE_INT64)
-        return FALSE;
+  return bytes;
+}
 
-      /* Add to object / array */
-      if (obj || array) {
-        gint64 v;
-        v = json_node_get_int (node);
-        if (obj)
-          json_object_set_int_member (obj, s_name, v);
-        else
-          json_array_add_int_element (array, v);
-      }
+/* Params utils */
+static void
+melo_jsonrpc_add_node (JsonNode *node, const MeloJSONRPCParam *param,
+                       JsonObject *obj, JsonArray *array)
+{
+  switch (param->type) {
+    case MELO_JSONRPC_PARAM_TYPE_BOOLEAN:
+      if (obj)
+        json_object_set_boolean_member (obj, param->name,
+                                        json_node_get_boolean (node));
+      else
+        json_array_add_boolean_element (array, json_node_get_boolean (node));
       break;
-    case 'd':
-      /* Double: check type */
-      if (vtype != G_TYPE_DOUBLE)
-        return FALSE;
-
-      /* Add to object / array */
-      if (obj || array) {
-        gdouble v;
-        v = json_node_get_double (node);
-        if (obj)
-          json_object_set_double_member (obj, s_name, v);
-        else
-          json_array_add_double_element (array, v);
-      }
+    case MELO_JSONRPC_PARAM_TYPE_INTEGER:
+      if (obj)
+        json_object_set_int_member (obj, param->name, json_node_get_int (node));
+      else
+        json_array_add_int_element (array, json_node_get_int (node));
       break;
-    case 's':
-      /* String: check type */
-      if (vtype != G_TYPE_STRING)
-        return FALSE;
-
-      /* Add to object / array */
-      if (obj || array) {
-        const gchar *v;
-        v = json_node_get_string (node);
-        if (obj)
-          json_object_set_string_member (obj, s_name, v);
-        else
-          json_array_add_string_element (array, v);
-      }
+    case MELO_JSONRPC_PARAM_TYPE_DOUBLE:
+      if (obj)
+        json_object_set_double_member (obj, param->name,
+                                       json_node_get_double (node));
+      else
+        json_array_add_double_element (array, json_node_get_double (node));
       break;
-    case 'o':
-      /* Object: check type */
-      if (type != JSON_NODE_OBJECT)
-        return FALSE;
-
-      /* Add to object / array */
-      if (obj || array) {
-        JsonObject *v;
-        v = json_node_dup_object (node);
-        if (obj)
-          json_object_set_object_member (obj, s_name, v);
-        else
-          json_array_add_object_element (array, v);
-      }
+    case MELO_JSONRPC_PARAM_TYPE_STRING:
+      if (obj)
+        json_object_set_string_member (obj, param->name,
+                                       json_node_get_string (node));
+      else
+        json_array_add_string_element (array, json_node_get_string (node));
       break;
-    case 'a':
-      /* Array: check type */
-      if (type != JSON_NODE_ARRAY)
-        return FALSE;
-
-      /* Add to object / array */
-      if (obj || array) {
-        JsonArray *v;
-        v = json_node_dup_array (node);
-        if (obj)
-          json_object_set_array_member (obj, s_name, v);
-        else
-          json_array_add_array_element (array, v);
-      }
+    case MELO_JSONRPC_PARAM_TYPE_OBJECT:
+      if (obj)
+        json_object_set_object_member (obj, param->name,
+                                       json_node_dup_object (node));
+      else
+        json_array_add_object_element (array, json_node_dup_object (node));
+      break;
+    case MELO_JSONRPC_PARAM_TYPE_ARRAY:
+      if (obj)
+        json_object_set_array_member (obj, param->name,
+                                      json_node_dup_array (node));
+      else
+        json_array_add_array_element (array, json_node_dup_array (node));
       break;
-    default:
-      return FALSE;
   }
-  return TRUE;
+}
+
+static const MeloJSONRPCSchema *
+melo_jsonrpc_get_schema (JsonArray *schema_params)
+{
+  const MeloJSONRPCSchema *schema;
+
+  /* Use compiled schema of current method */
+  schema = g_private_get (&melo_jsonrpc_current);
+  if (schema && schema->array == schema_params)
+    return schema;
+
+  return NULL;
 }
 
 static gboolean
@@ -642,10 +2395,11 @@ melo_jsonrpc_get_json_node (JsonArray *schema_params, JsonNode *params,
                             JsonObject *obj, JsonArray *array,
                             JsonNode **error)
 {
-  JsonObject *schema;
-  JsonNodeType type;
-  JsonNode *node;
-  guint count, i;
+  JsonNode *nodes[MELO_JSONRPC_PARAMS_MAX];
+  const MeloJSONRPCSchema *schema;
+  MeloJSONRPCSchema *tmp = NULL;
+  gboolean ret;
+  guint i;
 
   /* Check schema */
   if (!schema_params)
@@ -660,97 +2414,31 @@ melo_jsonrpc_get_json_node (JsonArray *schema_params, JsonNode *params,
     return FALSE;
   }
 
-  /* Get element count from schema */
-  count = json_array_get_length (schema_params);
-
-  /* Get type */
-  type = json_node_get_node_type (params);
-
-  /* Already an object */
-  if (type == JSON_NODE_OBJECT) {
-    const gchar *name;
-    JsonObject *o;
-
-    /* Get object */
-    o = json_node_get_object (params);
-
-    /* Parse object */
-    for (i = 0; i < count; i++) {
-      /* Get next schema object */
-      schema = json_array_get_object_element (schema_params, i);
-      if (!schema)
-        goto failed;
-
-      /* Get parameter name */
-      name = json_object_get_string_member (schema, "name");
-      if (!name)
-        goto failed;
-
-      /* Get node */
-      node = json_object_get_member (o, name);
-      if (!node) {
-        /* Get required flag: failed if not defined or TRUE */
-        node = json_object_get_member (schema, "required");
-        if (!node || (node && json_node_get_boolean (node)))
-          goto failed;
-
-        /* When not required:
-         *  - skip when converting to an object,
-         *  - stop when converting to an array.
-         */
-        if (obj)
-            continue;
-        if (array)
-        return TRUE;
-      }
-
-      /* Check node type */
-      if (!melo_jsonrpc_add_node (node, schema, obj, array))
-        goto failed;
-    }
-  } else if (type == JSON_NODE_ARRAY) {
-    guint params_count;
-    JsonArray *a;
-
-    /* Get array */
-    a = json_node_get_array (params);
-    params_count = json_array_get_length (a);
+  /* Get compiled schema or compile it now */
+  schema = melo_jsonrpc_get_schema (schema_params);
+  if (!schema)
+    schema = tmp = melo_jsonrpc_schema_new (schema_params);
 
-    /* Parse object */
-    for (i = 0; i < count; i++) {
-      /* Get next schema object */
-      schema = json_array_get_object_element (schema_params, i);
-      if (!schema)
-        goto failed;
-
-      /* No more parameters available */
-      if (i >= params_count) {
-        /* Get required flag: failed if not defined or TRUE */
-        node = json_object_get_member (schema, "required");
-        if (!node || (node && json_node_get_boolean (node)))
-          goto failed;
-
-        /* If this parameter was not required: stop conversion */
-        return TRUE;
-      }
-
-      /* Get node */
-      node = json_array_get_element (a, i);
-      if (!node)
-        goto failed;
+  /* Check parameters */
+  ret = schema && melo_jsonrpc_schema_parse (schema, params, nodes);
 
-      /* Check node type */
-      if (!melo_jsonrpc_add_node (node, schema, obj, array))
-        goto failed;
+  /* Convert parameters: a missing parameter stops array conversion */
+  for (i = 0; ret && (obj || array) && i < schema->count; i++) {
+    if (!nodes[i]) {
+      if (array)
+        break;
+      continue;
     }
+    melo_jsonrpc_add_node (nodes[i], &schema->params[i], obj, array);
   }
-  return TRUE;
 
-failed:
-  if (error && *error == NULL)
+  if (tmp)
+    melo_jsonrpc_schema_unref (tmp);
+
+  if (!ret && error && *error == NULL)
     *error = melo_jsonrpc_build_error_node (MELO_JSONRPC_ERROR_INVALID_PARAMS,
                                             "Invalid params");
-  return FALSE;
+  return ret;
 }
 
 /**
@@ -842,6 +2530,211 @@ melo_jsonrpc_get_array (JsonArray *schema_params, JsonNode *params,
   return array;
 }
 
+/**
+ * melo_jsonrpc_params_init:
+ * @p: a #MeloJSONRPCParams to initialize
+ * @schema_params: the schema provided to the #MeloJSONRPCCallback
+ * @params: the parameters provided to the #MeloJSONRPCCallback
+ * @error: a pointer to a #JsonNode which is set with a valid JSON-RPC error if
+ *    an error has occurred
+ *
+ * Check the parameters of the current method call with its compiled schema
+ * and initialize @p to get their values with the typed accessors as
+ * melo_jsonrpc_params_get_string(). Unlike melo_jsonrpc_get_object(), no
+ * allocation is done and the values are not copied.
+ *
+ * This function must be called only from a #MeloJSONRPCCallback and @p is
+ * valid until the callback returns.
+ *
+ * Returns: %TRUE if the parameters are valid, %FALSE otherwise.
+ */
+gboolean
+melo_jsonrpc_params_init (MeloJSONRPCParams *p, JsonArray *schema_params,
+                          JsonNode *params, JsonNode **error)
+{
+  const MeloJSONRPCSchema *schema;
+
+  /* Get compiled schema */
+  schema = melo_jsonrpc_get_schema (schema_params);
+  if (!schema) {
+    if (error && *error == NULL)
+      *error = melo_jsonrpc_build_error_node (
+                                              MELO_JSONRPC_ERROR_INTERNAL_ERROR,
+                                              "Internal error");
+    return FALSE;
+  }
+
+  /* Check parameters */
+  if (!params || !melo_jsonrpc_schema_parse (schema, params, p->nodes)) {
+    if (error && *error == NULL)
+      *error = melo_jsonrpc_build_error_node (
+                                              MELO_JSONRPC_ERROR_INVALID_PARAMS,
+                                              "Invalid params");
+    return FALSE;
+  }
+  p->schema = schema;
+
+  return TRUE;
+}
+
+static JsonNode *
+melo_jsonrpc_params_get_node (const MeloJSONRPCParams *p, const gchar *name,
+                              MeloJSONRPCParamType type)
+{
+  const MeloJSONRPCParam *param;
+  guint i;
+
+  /* Find parameter */
+  for (i = 0; i < p->schema->count; i++) {
+    param = &p->schema->params[i];
+    if (param->type == type && !strcmp (param->name, name))
+      return p->nodes[i] ? p->nodes[i] : param->def;
+  }
+
+  return NULL;
+}
+
+/**
+ * melo_jsonrpc_params_has:
+ * @p: a #MeloJSONRPCParams
+ * @name: the parameter name
+ *
+ * Check if the parameter @name has been provided in the request.
+ *
+ * Returns: %TRUE if the parameter is present, %FALSE otherwise.
+ */
+gboolean
+melo_jsonrpc_params_has (const MeloJSONRPCParams *p, const gchar *name)
+{
+  guint i;
+
+  for (i = 0; i < p->schema->count; i++)
+    if (!strcmp (p->schema->params[i].name, name))
+      return p->nodes[i] != NULL;
+
+  return FALSE;
+}
+
+/**
+ * melo_jsonrpc_params_get_boolean:
+ * @p: a #MeloJSONRPCParams
+ * @name: the parameter name
+ *
+ * Get the value of a boolean parameter, or its default value when not
+ * provided.
+ *
+ * Returns: the parameter value, or %FALSE if not available.
+ */
+gboolean
+melo_jsonrpc_params_get_boolean (const MeloJSONRPCParams *p, const gchar *name)
+{
+  JsonNode *node;
+
+  node = melo_jsonrpc_params_get_node (p, name,
+                                       MELO_JSONRPC_PARAM_TYPE_BOOLEAN);
+  return node ? json_node_get_boolean (node) : FALSE;
+}
+
+/**
+ * melo_jsonrpc_params_get_int:
+ * @p: a #MeloJSONRPCParams
+ * @name: the parameter name
+ *
+ * Get the value of an integer parameter, or its default value when not
+ * provided.
+ *
+ * Returns: the parameter value, or 0 if not available.
+ */
+gint64
+melo_jsonrpc_params_get_int (const MeloJSONRPCParams *p, const gchar *name)
+{
+  JsonNode *node;
+
+  node = melo_jsonrpc_params_get_node (p, name,
+                                       MELO_JSONRPC_PARAM_TYPE_INTEGER);
+  return node ? json_node_get_int (node) : 0;
+}
+
+/**
+ * melo_jsonrpc_params_get_double:
+ * @p: a #MeloJSONRPCParams
+ * @name: the parameter name
+ *
+ * Get the value of a double parameter, or its default value when not
+ * provided.
+ *
+ * Returns: the parameter value, or 0.0 if not available.
+ */
+gdouble
+melo_jsonrpc_params_get_double (const MeloJSONRPCParams *p, const gchar *name)
+{
+  JsonNode *node;
+
+  node = melo_jsonrpc_params_get_node (p, name,
+                                       MELO_JSONRPC_PARAM_TYPE_DOUBLE);
+  return node ? json_node_get_double (node) : 0.0;
+}
+
+/**
+ * melo_jsonrpc_params_get_string:
+ * @p: a #MeloJSONRPCParams
+ * @name: the parameter name
+ *
+ * Get the value of a string parameter, or its default value when not
+ * provided.
+ *
+ * Returns: (transfer none): the parameter value, or %NULL if not available.
+ */
+const gchar *
+melo_jsonrpc_params_get_string (const MeloJSONRPCParams *p, const gchar *name)
+{
+  JsonNode *node;
+
+  node = melo_jsonrpc_params_get_node (p, name,
+                                       MELO_JSONRPC_PARAM_TYPE_STRING);
+  return node ? json_node_get_string (node) : NULL;
+}
+
+/**
+ * melo_jsonrpc_params_get_object:
+ * @p: a #MeloJSONRPCParams
+ * @name: the parameter name
+ *
+ * Get the value of an object parameter, or its default value when not
+ * provided.
+ *
+ * Returns: (transfer none): the parameter value, or %NULL if not available.
+ */
+JsonObject *
+melo_jsonrpc_params_get_object (const MeloJSONRPCParams *p, const gchar *name)
+{
+  JsonNode *node;
+
+  node = melo_jsonrpc_params_get_node (p, name,
+                                       MELO_JSONRPC_PARAM_TYPE_OBJECT);
+  return node ? json_node_get_object (node) : NULL;
+}
+
+/**
+ * melo_jsonrpc_params_get_array:
+ * @p: a #MeloJSONRPCParams
+ * @name: the parameter name
+ *
+ * Get the value of an array parameter, or its default value when not
+ * provided.
+ *
+ * Returns: (transfer none): the parameter value, or %NULL if not available.
+ */
+JsonArray *
+melo_jsonrpc_params_get_array (const MeloJSONRPCParams *p, const gchar *name)
+{
+  JsonNode *node;
+
+  node = melo_jsonrpc_params_get_node (p, name,
+                                       MELO_JSONRPC_PARAM_TYPE_ARRAY);
+  return node ? json_node_get_array (node) : NULL;
+}
+
 /* Helpers */
 static gchar *
 melo_jsonrpc_node_to_string (JsonNode *node)
@@ -965,29 +2858,6 @@ melo_jsonrpc_build_error (const char *id, gint64 nid,
   return melo_jsonrpc_build_response_node (NULL, node, id, nid);
 }
 
-static gchar *
-melo_jsonrpc_build_error_str (MeloJSONRPCError error_code,
-                              const char *error_format, ...)
-{
-  JsonNode *node;
-  va_list args;
-  gchar *str;
-
-  /* Generate error node */
-  va_start (args, error_format);
-  node = melo_jsonrpc_build_error_nodev (error_code, error_format, args);
-  va_end (args);
-
-  /* Generate final response */
-  node = melo_jsonrpc_build_response_node (NULL, node, NULL, -1);
-
-  /* Generate string */
-  str = melo_jsonrpc_node_to_string (node);
-  json_node_free (node);
-
-  return str;
-}
-
 /**
  * melo_jsonrpc_build_error_node:
  * @error_code: the JSON-RPC error code
@@ -1014,3 +2884,230 @@ melo_jsonrpc_build_error_node (MeloJSONRPCError error_code,
 
   return node;
 }
+
+/* System methods */
+static void
+melo_jsonrpc_system_get_stats (const gchar *method,
+                               JsonArray *s_params, JsonNode *params,
+                               JsonNode **result, JsonNode **error,
+                               gpointer user_data)
+{
+  JsonObject *obj;
+
+  /* Add cover cache statistics and element processing times */
+  obj = melo_jsonrpc_get_stats ();
+  json_object_set_object_member (obj, "covers",
+                                 melo_tags_get_cover_cache_stats ());
+  json_object_set_object_member (obj, "tracer", melo_tracer_get_stats ());
+
+  *result = json_node_new (JSON_NODE_OBJECT);
+  json_node_take_object (*result, obj);
+}
+
+static void
+melo_jsonrpc_system_set_trace (const gchar *method,
+                               JsonArray *s_params, JsonNode *params,
+                               JsonNode **result, JsonNode **error,
+                               gpointer user_data)
+{
+  JsonObject *obj;
+  gboolean enable;
+
+  /* Get parameters */
+  obj = melo_jsonrpc_get_object (s_params, params, error);
+  if (!obj)
+    return;
+
+  /* Enable or disable tracing */
+  enable = json_object_get_boolean_member (obj, "enable");
+  if (json_object_has_member (obj, "clear") &&
+      json_object_get_boolean_member (obj, "clear"))
+    melo_trace_clear ();
+  melo_trace_set_enabled (enable);
+  json_object_unref (obj);
+
+  *result = json_node_new (JSON_NODE_VALUE);
+  json_node_set_boolean (*result, melo_trace_is_enabled ());
+}
+
+static void
+melo_jsonrpc_system_get_trace (const gchar *method,
+                               JsonArray *s_params, JsonNode *params,
+                               JsonNode **result, JsonNode **error,
+                               gpointer user_data)
+{
+  /* Export recorded spans */
+  *result = melo_trace_export ();
+}
+
+static void
+melo_jsonrpc_system_set_tracer (const gchar *method,
+                                JsonArray *s_params, JsonNode *params,
+                                JsonNode **result, JsonNode **error,
+                                gpointer user_data)
+{
+  const gchar *name;
+  JsonObject *obj;
+  gboolean enable;
+
+  /* Get parameters */
+  obj = melo_jsonrpc_get_object (s_params, params, error);
+  if (!obj)
+    return;
+
+  /* Enable or disable tracer */
+  name = json_object_get_string_member (obj, "name");
+  enable = json_object_get_boolean_member (obj, "enable");
+  if (json_object_has_member (obj, "clear") &&
+      json_object_get_boolean_member (obj, "clear"))
+    melo_tracer_clear ();
+  if (!melo_tracer_set_enabled (name, enable)) {
+    *error = melo_jsonrpc_build_error_node (MELO_JSONRPC_ERROR_INVALID_PARAMS,
+                                            "Failed to %s tracer '%s'",
+                                            enable ? "enable" : "disable",
+                                            name);
+    json_object_unref (obj);
+    return;
+  }
+  json_object_unref (obj);
+
+  *result = json_node_new (JSON_NODE_OBJECT);
+  json_node_take_object (*result, melo_tracer_get_stats ());
+}
+
+static void
+melo_jsonrpc_system_get_memory (const gchar *method,
+                                JsonArray *s_params, JsonNode *params,
+                                JsonNode **result, JsonNode **error,
+                                gpointer user_data)
+{
+  /* Get memory usage of all subsystems */
+  *result = json_node_new (JSON_NODE_OBJECT);
+  json_node_take_object (*result, melo_memory_get_usage ());
+}
+
+static void
+melo_jsonrpc_system_set_memory_budget (const gchar *method,
+                                       JsonArray *s_params, JsonNode *params,
+                                       JsonNode **result, JsonNode **error,
+                                       gpointer user_data)
+{
+  const gchar *name;
+  JsonObject *obj;
+  gint64 budget;
+
+  /* Get parameters */
+  obj = melo_jsonrpc_get_object (s_params, params, error);
+  if (!obj)
+    return;
+
+  /* Set budget: 0 removes it */
+  name = json_object_get_string_member (obj, "name");
+  budget = json_object_get_int_member (obj, "budget");
+  melo_memory_set_budget (name, budget > 0 ? budget : 0);
+
+  *result = json_node_new (JSON_NODE_VALUE);
+  json_node_set_int (*result, melo_memory_get_budget (name));
+  json_object_unref (obj);
+}
+
+static MeloJSONRPCMethod melo_jsonrpc_system_methods[] = {
+  {
+    .method = "get_stats",
+    .params = "[]",
+    .result = "{\"type\":\"object\"}",
+    .callback = melo_jsonrpc_system_get_stats,
+    .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONCURRENT,
+  },
+  {
+    .method = "set_trace",
+    .params = "["
+              "  {\"name\": \"enable\", \"type\": \"boolean\"},"
+              "  {"
+              "    \"name\": \"clear\", \"type\": \"boolean\","
+              "    \"required\": false"
+              "  }"
+              "]",
+    .result = "{\"type\":\"boolean\"}",
+    .callback = melo_jsonrpc_system_set_trace,
+    .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONTROL,
+  },
+  {
+    .method = "get_trace",
+    .params = "[]",
+    .result = "{\"type\":\"object\"}",
+    .callback = melo_jsonrpc_system_get_trace,
+    .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONCURRENT | MELO_JSONRPC_FLAGS_BULK,
+  },
+  {
+    .method = "set_tracer",
+    .params = "["
+              "  {\"name\": \"name\", \"type\": \"string\"},"
+              "  {\"name\": \"enable\", \"type\": \"boolean\"},"
+              "  {"
+              "    \"name\": \"clear\", \"type\": \"boolean\","
+              "    \"required\": false"
+              "  }"
+              "]",
+    .result = "{\"type\":\"object\"}",
+    .callback = melo_jsonrpc_system_set_tracer,
+    .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONTROL,
+  },
+  {
+    .method = "get_memory",
+    .params = "[]",
+    .result = "{\"type\":\"object\"}",
+    .callback = melo_jsonrpc_system_get_memory,
+    .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONCURRENT,
+  },
+  {
+    .method = "set_memory_budget",
+    .params = "["
+              "  {\"name\": \"name\", \"type\": \"string\"},"
+              "  {\"name\": \"budget\", \"type\": \"integer\"}"
+              "]",
+    .result = "{\"type\":\"integer\"}",
+    .callback = melo_jsonrpc_system_set_memory_budget,
+    .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONTROL,
+  },
+};
+
+/**
+ * melo_jsonrpc_register_system_methods:
+ *
+ * Register the JSON-RPC methods of the "system" group, which are handled by
+ * the JSON-RPC parser itself, as "system.get_stats" which returns the object
+ * generated by melo_jsonrpc_get_stats(), with the cover cache statistics from
+ * melo_tags_get_cover_cache_stats() in the "covers" member.
+ * The "system.set_trace" and "system.get_trace" methods enable #MeloTrace and
+ * return the recorded spans generated by melo_trace_export().
+ * The "system.set_tracer" method enables a GStreamer tracer with #MeloTracer,
+ * and the element processing times are added to "system.get_stats" in the
+ * "tracer" member.
+ * The "system.get_memory" and "system.set_memory_budget" methods report the
+ * memory usage of the subsystems and set their budgets with #MeloMemory.
+ */
+void
+melo_jsonrpc_register_system_methods (void)
+{
+  melo_jsonrpc_register_methods ("system", melo_jsonrpc_system_methods,
+                                 G_N_ELEMENTS (melo_jsonrpc_system_methods));
+}
+
+/**
+ * melo_jsonrpc_unregister_system_methods:
+ *
+ * Unregister the JSON-RPC methods of the "system" group.
+ */
+void
+melo_jsonrpc_unregister_system_methods (void)
+{
+  melo_jsonrpc_unregister_methods ("system", melo_jsonrpc_system_methods,
+                                   G_N_ELEMENTS (melo_jsonrpc_system_methods));
+}
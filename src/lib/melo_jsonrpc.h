@@ -25,6 +25,8 @@
 #include <glib.h>
 #include <json-glib/json-glib.h>
 
+#include "melo_memory.h"
+
 /**
  * MeloJSONRPCError:
  * @MELO_JSONRPC_ERROR_PARSE_ERROR: parse error
@@ -45,6 +47,88 @@ typedef enum {
   MELO_JSONRPC_ERROR_SERVER_ERROR = -32000,
 } MeloJSONRPCError;
 
+/**
+ * MeloJSONRPCFlags:
+ * @MELO_JSONRPC_FLAGS_NONE: no flags
+ * @MELO_JSONRPC_FLAGS_CONCURRENT: the method is side-effect free and can be
+ *    run concurrently with other concurrent methods of a batch request
+ * @MELO_JSONRPC_FLAGS_CACHE: the result of the method only depends on its
+ *    parameters and on a state which rarely changes: it is cached until the
+ *    state is updated, see #MeloJSONRPCMethod
+ * @MELO_JSONRPC_FLAGS_CONTROL: the method is a short control call (as play or
+ *    volume) which should be handled with a low latency
+ * @MELO_JSONRPC_FLAGS_BULK: the method can take a long time to complete (as
+ *    browsing a network share) and should not delay the other calls
+ * @MELO_JSONRPC_FLAGS_WAIT: the method waits for an event (as a long-poll)
+ *    and can block for a long time without using any resource
+ *
+ * The #MeloJSONRPCFlags describe the behavior of a JSON-RPC method.
+ */
+typedef enum {
+  MELO_JSONRPC_FLAGS_NONE = 0,
+  MELO_JSONRPC_FLAGS_CONCURRENT = (1 << 0),
+  MELO_JSONRPC_FLAGS_CACHE = (1 << 1),
+  MELO_JSONRPC_FLAGS_CONTROL = (1 << 2),
+  MELO_JSONRPC_FLAGS_BULK = (1 << 3),
+  MELO_JSONRPC_FLAGS_WAIT = (1 << 4),
+} MeloJSONRPCFlags;
+
+/**
+ * MeloJSONRPCPriority:
+ * @MELO_JSONRPC_PRIORITY_NORMAL: the request has no particular priority
+ * @MELO_JSONRPC_PRIORITY_CONTROL: the request only calls control methods
+ * @MELO_JSONRPC_PRIORITY_BULK: the request calls at least one bulk method
+ * @MELO_JSONRPC_PRIORITY_WAIT: the request calls at least one wait method
+ * @MELO_JSONRPC_PRIORITY_COUNT: the number of priorities
+ *
+ * The #MeloJSONRPCPriority is the class of a request returned by
+ * melo_jsonrpc_get_priority(), from the #MeloJSONRPCFlags of its methods.
+ */
+typedef enum {
+  MELO_JSONRPC_PRIORITY_NORMAL = 0,
+  MELO_JSONRPC_PRIORITY_CONTROL,
+  MELO_JSONRPC_PRIORITY_BULK,
+  MELO_JSONRPC_PRIORITY_WAIT,
+
+  MELO_JSONRPC_PRIORITY_COUNT
+} MeloJSONRPCPriority;
+
+typedef struct _MeloJSONRPCSchema MeloJSONRPCSchema;
+typedef struct _MeloJSONRPCWriter MeloJSONRPCWriter;
+
+/**
+ * MeloJSONRPCWriteFunc:
+ * @data: (transfer full): a chunk of serialized JSON, to free with g_free()
+ * @size: the size of @data
+ * @user_data: the user data passed to melo_jsonrpc_writer_new()
+ *
+ * A function called by a #MeloJSONRPCWriter each time a chunk of serialized
+ * JSON is available.
+ */
+typedef void (*MeloJSONRPCWriteFunc) (gchar *data, gsize size,
+                                      gpointer user_data);
+
+/**
+ * MELO_JSONRPC_PARAMS_MAX:
+ *
+ * The maximum number of parameters in a #MeloJSONRPCMethod schema.
+ */
+#define MELO_JSONRPC_PARAMS_MAX 32
+
+/**
+ * MeloJSONRPCParams:
+ *
+ * The #MeloJSONRPCParams holds the parameters of a method call checked with
+ * the compiled schema of the method. It should be allocated on the stack,
+ * initialized with melo_jsonrpc_params_init() and then used with the typed
+ * accessors as melo_jsonrpc_params_get_string().
+ */
+typedef struct {
+  /*< private >*/
+  const MeloJSONRPCSchema *schema;
+  JsonNode *nodes[MELO_JSONRPC_PARAMS_MAX];
+} MeloJSONRPCParams;
+
 /**
  * MeloJSONRPCCallback:
  * @method: the current method name
@@ -66,7 +150,9 @@ typedef enum {
  *
  * The @params can be converted into a #JsonArray with melo_jsonrpc_get_array()
  * or into a #JsonObject with  melo_jsonrpc_get_object(). It uses the
- * @schema_params to present the #JsonNode as a more readable object.
+ * @schema_params to present the #JsonNode as a more readable object. To avoid
+ * any copy, melo_jsonrpc_params_init() and the typed accessors can be used
+ * instead.
  *
  * The @result or @error should be set before returning, in order to prevent a
  * default MELO_JSONRPC_ERROR_METHOD_NOT_FOUND error.
@@ -84,6 +170,9 @@ typedef void (*MeloJSONRPCCallback) (const gchar *method,
  * @callback: the callback of type #MeloJSONRPCCallback to call when @method,
  *    @params and @result are matching
  * @user_data: the user data to use when calling @callback
+ * @flags: the #MeloJSONRPCFlags of the method
+ * @cache_events: a mask of #MeloEventType (as 1 << MELO_EVENT_TYPE_PLAYER)
+ *    invalidating the cached results of the method
  *
  * The #MeloJSONRPCMethod describe a JSON-RPC method to register in JSON-RPC
  * parser. The registration is done with melo_jsonrpc_register_method() or
@@ -102,6 +191,9 @@ typedef void (*MeloJSONRPCCallback) (const gchar *method,
  *            "boolean", "double", "object", "array")
  *  - "required": the parameter is not optional (a boolean). This field can be
  *                omitted if the parameter is required
+ *  - "default": the value returned by the typed accessors as
+ *               melo_jsonrpc_params_get_int() when the parameter is not
+ *               provided (must match "type"). This field is optional
  *
  * Example of a @params definition:
  * |[<!-- language="JSON" -->
@@ -122,7 +214,14 @@ typedef void (*MeloJSONRPCCallback) (const gchar *method,
  * ]|
  *
  * If the @params or @result cannot be parsed, the registration function will
- * fail.
+ * fail. The @params schema is compiled once during registration and is limited
+ * to #MELO_JSONRPC_PARAMS_MAX parameters.
+ *
+ * When @flags contains #MELO_JSONRPC_FLAGS_CACHE, the successful results are
+ * kept in memory, keyed by the method and its parameters: the next calls with
+ * the same parameters return a copy of the result without calling @callback.
+ * The results are invalidated when an event matching @cache_events is emitted
+ * or when melo_jsonrpc_cache_invalidate() is called.
  */
 typedef struct _MeloJSONRPCMethod {
   const gchar *method;
@@ -130,6 +229,8 @@ typedef struct _MeloJSONRPCMethod {
   const gchar *result;
   MeloJSONRPCCallback callback;
   gpointer user_data;
+  MeloJSONRPCFlags flags;
+  guint cache_events;
 } MeloJSONRPCMethod;
 
 /* Register a JSON-RPC method */
@@ -137,6 +238,13 @@ gboolean melo_jsonrpc_register_method (const gchar *group, const gchar *method,
                                        JsonArray *params, JsonObject *result,
                                        MeloJSONRPCCallback callback,
                                        gpointer user_data);
+gboolean melo_jsonrpc_register_method_full (const gchar *group,
+                                            const gchar *method,
+                                            JsonArray *params,
+                                            JsonObject *result,
+                                            MeloJSONRPCCallback callback,
+                                            gpointer user_data,
+                                            MeloJSONRPCFlags flags);
 void melo_jsonrpc_unregister_method (const gchar *group, const gchar *method);
 
 /* Register an array of JSON-RPC methods */
@@ -145,9 +253,48 @@ guint melo_jsonrpc_register_methods (const gchar *group,
 void melo_jsonrpc_unregister_methods (const gchar *group,
                                      MeloJSONRPCMethod *methods, guint count);
 
+/* Get priority of a JSON-RPC request */
+MeloJSONRPCPriority melo_jsonrpc_get_priority (const gchar *request,
+                                               gsize length);
+MeloJSONRPCPriority melo_jsonrpc_get_priority_cbor (gconstpointer request,
+                                                    gsize length);
+
 /* Parse a JSON-RPC request */
 gchar *melo_jsonrpc_parse_request (const gchar *request, gsize length,
                                    GError **error);
+gboolean melo_jsonrpc_parse_request_stream (const gchar *request, gsize length,
+                                            MeloJSONRPCWriteFunc func,
+                                            gpointer user_data,
+                                            GError **error);
+GBytes *melo_jsonrpc_parse_request_cbor (gconstpointer request, gsize length,
+                                         GError **error);
+
+/* Streaming writer */
+MeloJSONRPCWriter *melo_jsonrpc_writer_new (MeloJSONRPCWriteFunc func,
+                                            gpointer user_data);
+void melo_jsonrpc_writer_flush (MeloJSONRPCWriter *w);
+void melo_jsonrpc_writer_free (MeloJSONRPCWriter *w);
+void melo_jsonrpc_writer_begin_object (MeloJSONRPCWriter *w);
+void melo_jsonrpc_writer_end_object (MeloJSONRPCWriter *w);
+void melo_jsonrpc_writer_begin_array (MeloJSONRPCWriter *w);
+void melo_jsonrpc_writer_end_array (MeloJSONRPCWriter *w);
+void melo_jsonrpc_writer_set_member_name (MeloJSONRPCWriter *w,
+                                          const gchar *name);
+void melo_jsonrpc_writer_add_string_value (MeloJSONRPCWriter *w,
+                                           const gchar *value);
+void melo_jsonrpc_writer_add_int_value (MeloJSONRPCWriter *w, gint64 value);
+void melo_jsonrpc_writer_add_double_value (MeloJSONRPCWriter *w,
+                                           gdouble value);
+void melo_jsonrpc_writer_add_boolean_value (MeloJSONRPCWriter *w,
+                                            gboolean value);
+void melo_jsonrpc_writer_add_null_value (MeloJSONRPCWriter *w);
+void melo_jsonrpc_writer_add_raw_value (MeloJSONRPCWriter *w,
+                                        const gchar *data, gssize size);
+void melo_jsonrpc_writer_add_node (MeloJSONRPCWriter *w, JsonNode *node);
+void melo_jsonrpc_writer_add_object (MeloJSONRPCWriter *w, JsonObject *object);
+
+/* Stream result of current method */
+MeloJSONRPCWriter *melo_jsonrpc_begin_result (void);
 
 /* Parameters utils */
 gboolean melo_jsonrpc_check_params (JsonArray *schema_params, JsonNode *params,
@@ -157,6 +304,41 @@ JsonArray *melo_jsonrpc_get_array (JsonArray *schema_params, JsonNode *params,
 JsonObject *melo_jsonrpc_get_object (JsonArray *schema_params,
                                      JsonNode *params, JsonNode **error);
 
+/* Typed parameters accessors */
+gboolean melo_jsonrpc_params_init (MeloJSONRPCParams *p,
+                                   JsonArray *schema_params, JsonNode *params,
+                                   JsonNode **error);
+gboolean melo_jsonrpc_params_has (const MeloJSONRPCParams *p,
+                                  const gchar *name);
+gboolean melo_jsonrpc_params_get_boolean (const MeloJSONRPCParams *p,
+                                          const gchar *name);
+gint64 melo_jsonrpc_params_get_int (const MeloJSONRPCParams *p,
+                                    const gchar *name);
+gdouble melo_jsonrpc_params_get_double (const MeloJSONRPCParams *p,
+                                        const gchar *name);
+const gchar *melo_jsonrpc_params_get_string (const MeloJSONRPCParams *p,
+                                             const gchar *name);
+JsonObject *melo_jsonrpc_params_get_object (const MeloJSONRPCParams *p,
+                                            const gchar *name);
+JsonArray *melo_jsonrpc_params_get_array (const MeloJSONRPCParams *p,
+                                          const gchar *name);
+
+/* Results cache */
+void melo_jsonrpc_disable_cache (void);
+void melo_jsonrpc_cache_invalidate (const gchar *group, const gchar *method);
+void melo_jsonrpc_flush_cache (void);
+
+/* Statistics */
+void melo_jsonrpc_add_queue_time (gint64 time);
+JsonObject *melo_jsonrpc_get_stats (void);
+
+/* Memory accounting */
+void melo_jsonrpc_get_memory_usage (MeloMemoryUsage *usage);
+
+/* System JSON-RPC methods */
+void melo_jsonrpc_register_system_methods (void);
+void melo_jsonrpc_unregister_system_methods (void);
+
 /* Utils */
 JsonNode *melo_jsonrpc_build_error_node (MeloJSONRPCError error_code,
                                          const char *error_format, ...);
@@ -0,0 +1,399 @@
+/*
+ * melo_memory.c: Memory accounting of Melo subsystems
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "melo_tags.h"
+#include "melo_browser.h"
+#include "melo_playlist.h"
+#include "melo_jsonrpc.h"
+
+#include "melo_memory.h"
+
+/**
+ * SECTION:melo_memory
+ * @title: MeloMemory
+ * @short_description: Memory accounting of Melo subsystems
+ *
+ * #MeloMemory reports the memory held by the main subsystems of Melo, in order
+ * to find which one is responsible when the resident size of the process
+ * grows over time.
+ *
+ * The following subsystems are always accounted:
+ *  - "tags": the live #MeloTags and the pool of interned strings,
+ *  - "covers": the cover data kept in memory and the cover URLs,
+ *  - "playlists": the medias of each #MeloPlaylist,
+ *  - "browser_prefetch": the pages prefetched by the #MeloBrowser,
+ *  - "jsonrpc": the JSON-RPC requests in progress and the cached results.
+ * Other subsystems, as a module, can add their own account with
+ * melo_memory_register().
+ *
+ * A budget can be set for a subsystem with melo_memory_set_budget(): the
+ * usages are checked periodically and when a subsystem exceeds its budget, its
+ * #MeloMemoryTrimFunc is called to release its caches.
+ *
+ * The reported sizes are estimations: they include the main data held but not
+ * the allocator overhead.
+ */
+
+/* Period of budget checks (in s) */
+#define MELO_MEMORY_CHECK_PERIOD 10
+
+typedef struct {
+  gchar *name;
+  MeloMemoryUsageFunc usage;
+  MeloMemoryTrimFunc trim;
+  gpointer user_data;
+} MeloMemoryAccount;
+
+/* Accounts and budgets */
+G_LOCK_DEFINE_STATIC (melo_memory_mutex);
+static GList *melo_memory_accounts;
+static GHashTable *melo_memory_budgets;
+static guint melo_memory_timer;
+
+/* Built-in accounts */
+static void
+melo_memory_tags_usage (MeloMemoryUsage *usage, gpointer user_data)
+{
+  melo_tags_get_memory_usage (usage);
+}
+
+static void
+melo_memory_covers_usage (MeloMemoryUsage *usage, gpointer user_data)
+{
+  melo_tags_get_cover_memory_usage (usage);
+}
+
+static void
+melo_memory_covers_trim (gsize budget, gpointer user_data)
+{
+  melo_tags_trim_cover_cache (budget);
+}
+
+static void
+melo_memory_playlists_usage (MeloMemoryUsage *usage, gpointer user_data)
+{
+  melo_playlist_get_memory_usage (usage);
+}
+
+static void
+melo_memory_browser_usage (MeloMemoryUsage *usage, gpointer user_data)
+{
+  melo_browser_get_prefetch_memory_usage (usage);
+}
+
+static void
+melo_memory_browser_trim (gsize budget, gpointer user_data)
+{
+  melo_browser_trim_prefetch ();
+}
+
+static void
+melo_memory_jsonrpc_usage (MeloMemoryUsage *usage, gpointer user_data)
+{
+  melo_jsonrpc_get_memory_usage (usage);
+}
+
+static void
+melo_memory_jsonrpc_trim (gsize budget, gpointer user_data)
+{
+  melo_jsonrpc_flush_cache ();
+}
+
+static const struct {
+  const gchar *name;
+  MeloMemoryUsageFunc usage;
+  MeloMemoryTrimFunc trim;
+} melo_memory_builtins[] = {
+  { "tags", melo_memory_tags_usage, NULL },
+  { "covers", melo_memory_covers_usage, melo_memory_covers_trim },
+  { "playlists", melo_memory_playlists_usage, NULL },
+  { "browser_prefetch", melo_memory_browser_usage, melo_memory_browser_trim },
+  { "jsonrpc", melo_memory_jsonrpc_usage, melo_memory_jsonrpc_trim },
+};
+
+static void
+melo_memory_account_free (MeloMemoryAccount *account)
+{
+  g_free (account->name);
+  g_slice_free (MeloMemoryAccount, account);
+}
+
+/* Must be called with memory locked */
+static void
+melo_memory_add (const gchar *name, MeloMemoryUsageFunc usage,
+                 MeloMemoryTrimFunc trim, gpointer user_data)
+{
+  MeloMemoryAccount *account;
+  GList *l;
+
+  /* Remove previous account with same name */
+  for (l = melo_memory_accounts; l != NULL; l = l->next) {
+    account = l->data;
+    if (!g_strcmp0 (account->name, name)) {
+      melo_memory_accounts = g_list_delete_link (melo_memory_accounts, l);
+      melo_memory_account_free (account);
+      break;
+    }
+  }
+
+  /* Add account */
+  if (usage) {
+    account = g_slice_new (MeloMemoryAccount);
+    account->name = g_strdup (name);
+    account->usage = usage;
+    account->trim = trim;
+    account->user_data = user_data;
+    melo_memory_accounts = g_list_append (melo_memory_accounts, account);
+  }
+}
+
+/* Must be called with memory locked */
+static void
+melo_memory_init (void)
+{
+  guint i;
+
+  if (melo_memory_budgets)
+    return;
+
+  /* Create budgets and add built-in accounts */
+  melo_memory_budgets = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                               g_free, NULL);
+  for (i = 0; i < G_N_ELEMENTS (melo_memory_builtins); i++)
+    melo_memory_add (melo_memory_builtins[i].name,
+                     melo_memory_builtins[i].usage,
+                     melo_memory_builtins[i].trim, NULL);
+}
+
+/**
+ * melo_memory_register:
+ * @name: the name of the subsystem
+ * @usage: the function to call to get the memory usage
+ * @trim: (allow-none): the function to call when the budget is exceeded
+ * @user_data: the data to pass to @usage and @trim
+ *
+ * Register a new memory account. @usage and @trim are called with the accounts
+ * lock held, so they must not call other functions of #MeloMemory. If an
+ * account with the same @name is already registered, it is replaced.
+ */
+void
+melo_memory_register (const gchar *name, MeloMemoryUsageFunc usage,
+                      MeloMemoryTrimFunc trim, gpointer user_data)
+{
+  g_return_if_fail (name && usage);
+
+  G_LOCK (melo_memory_mutex);
+  melo_memory_init ();
+  melo_memory_add (name, usage, trim, user_data);
+  G_UNLOCK (melo_memory_mutex);
+}
+
+/**
+ * melo_memory_unregister:
+ * @name: the name of the subsystem
+ *
+ * Unregister a memory account registered with melo_memory_register(). Its
+ * budget is kept, in case the subsystem registers again.
+ */
+void
+melo_memory_unregister (const gchar *name)
+{
+  G_LOCK (melo_memory_mutex);
+  melo_memory_add (name, NULL, NULL, NULL);
+  G_UNLOCK (melo_memory_mutex);
+}
+
+static gboolean
+melo_memory_timer_cb (gpointer user_data)
+{
+  melo_memory_enforce ();
+  return G_SOURCE_CONTINUE;
+}
+
+/**
+ * melo_memory_set_budget:
+ * @name: the name of the subsystem
+ * @budget: the maximum memory to use (in bytes), or 0 to remove the budget
+ *
+ * Set the memory budget of a subsystem. The budget is enforced immediately and
+ * then checked every few seconds from the default main context.
+ */
+void
+melo_memory_set_budget (const gchar *name, gsize budget)
+{
+  g_return_if_fail (name);
+
+  G_LOCK (melo_memory_mutex);
+  melo_memory_init ();
+
+  /* Update budget */
+  if (budget)
+    g_hash_table_insert (melo_memory_budgets, g_strdup (name),
+                         GSIZE_TO_POINTER (budget));
+  else
+    g_hash_table_remove (melo_memory_budgets, name);
+
+  /* Start or stop periodic check */
+  if (g_hash_table_size (melo_memory_budgets) && !melo_memory_timer)
+    melo_memory_timer = g_timeout_add_seconds (MELO_MEMORY_CHECK_PERIOD,
+                                               melo_memory_timer_cb, NULL);
+  else if (!g_hash_table_size (melo_memory_budgets) && melo_memory_timer) {
+    g_source_remove (melo_memory_timer);
+    melo_memory_timer = 0;
+  }
+  G_UNLOCK (melo_memory_mutex);
+
+  /* Enforce new budget */
+  melo_memory_enforce ();
+}
+
+/**
+ * melo_memory_get_budget:
+ * @name: the name of the subsystem
+ *
+ * Get the memory budget of a subsystem.
+ *
+ * Returns: the budget (in bytes), or 0 if no budget is set.
+ */
+gsize
+melo_memory_get_budget (const gchar *name)
+{
+  gsize budget = 0;
+
+  G_LOCK (melo_memory_mutex);
+  if (melo_memory_budgets)
+    budget = GPOINTER_TO_SIZE (g_hash_table_lookup (melo_memory_budgets,
+                                                    name));
+  G_UNLOCK (melo_memory_mutex);
+
+  return budget;
+}
+
+/**
+ * melo_memory_enforce:
+ *
+ * Check the memory usage of all subsystems with a budget, and call the
+ * #MeloMemoryTrimFunc of the ones which exceed it.
+ */
+void
+melo_memory_enforce (void)
+{
+  GList *l;
+
+  G_LOCK (melo_memory_mutex);
+  for (l = melo_memory_accounts; l != NULL; l = l->next) {
+    MeloMemoryAccount *account = l->data;
+    MeloMemoryUsage usage = { 0 };
+    gsize budget;
+
+    /* No budget or no way to release memory */
+    budget = GPOINTER_TO_SIZE (g_hash_table_lookup (melo_memory_budgets,
+                                                    account->name));
+    if (!budget || !account->trim)
+      continue;
+
+    /* Release memory when budget is exceeded */
+    account->usage (&usage, account->user_data);
+    if (usage.details)
+      json_object_unref (usage.details);
+    if (usage.bytes > budget) {
+      g_debug ("memory: %s uses %" G_GSIZE_FORMAT " bytes, trim to %"
+               G_GSIZE_FORMAT, account->name, usage.bytes, budget);
+      account->trim (budget, account->user_data);
+    }
+  }
+  G_UNLOCK (melo_memory_mutex);
+}
+
+static gint64
+melo_memory_get_rss (void)
+{
+  unsigned long pages;
+  gint64 rss = -1;
+  gchar *data;
+
+  /* Get resident pages from /proc */
+  if (!g_file_get_contents ("/proc/self/statm", &data, NULL, NULL))
+    return -1;
+  if (sscanf (data, "%*lu %lu", &pages) == 1)
+    rss = (gint64) pages * sysconf (_SC_PAGESIZE);
+  g_free (data);
+
+  return rss;
+}
+
+/**
+ * melo_memory_get_usage:
+ *
+ * Get the memory usage of all subsystems. The returned object contains the
+ * resident size of the process in "rss" (or -1), the sum of the subsystem
+ * usages in "total", and an object per subsystem in "subsystems", with the
+ * "bytes" and "count" held, the "budget" if set, and the subsystem "details".
+ *
+ * Returns: (transfer full): a new #JsonObject. Use json_object_unref() after
+ * usage.
+ */
+JsonObject *
+melo_memory_get_usage (void)
+{
+  JsonObject *obj, *subsystems;
+  gsize total = 0;
+  GList *l;
+
+  /* Get usage of all subsystems */
+  subsystems = json_object_new ();
+  G_LOCK (melo_memory_mutex);
+  melo_memory_init ();
+  for (l = melo_memory_accounts; l != NULL; l = l->next) {
+    MeloMemoryAccount *account = l->data;
+    MeloMemoryUsage usage = { 0 };
+    JsonObject *o;
+    gsize budget;
+
+    account->usage (&usage, account->user_data);
+    total += usage.bytes;
+
+    /* Add subsystem */
+    o = json_object_new ();
+    json_object_set_int_member (o, "bytes", usage.bytes);
+    json_object_set_int_member (o, "count", usage.count);
+    budget = GPOINTER_TO_SIZE (g_hash_table_lookup (melo_memory_budgets,
+                                                    account->name));
+    if (budget)
+      json_object_set_int_member (o, "budget", budget);
+    if (usage.details)
+      json_object_set_object_member (o, "details", usage.details);
+    json_object_set_object_member (subsystems, account->name, o);
+  }
+  G_UNLOCK (melo_memory_mutex);
+
+  /* Create object */
+  obj = json_object_new ();
+  json_object_set_int_member (obj, "rss", melo_memory_get_rss ());
+  json_object_set_int_member (obj, "total", total);
+  json_object_set_object_member (obj, "subsystems", subsystems);
+
+  return obj;
+}
@@ -0,0 +1,78 @@
+/*
+ * melo_memory.h: Memory accounting of Melo subsystems
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef __MELO_MEMORY_H__
+#define __MELO_MEMORY_H__
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+/**
+ * MeloMemoryUsage:
+ * @bytes: the estimated memory held by the subsystem (in bytes)
+ * @count: the number of objects held by the subsystem
+ * @details: (allow-none): a #JsonObject with subsystem specific details, or
+ *    %NULL (transfer full)
+ *
+ * The memory usage of a subsystem, filled by a #MeloMemoryUsageFunc.
+ */
+typedef struct {
+  gsize bytes;
+  guint64 count;
+  JsonObject *details;
+} MeloMemoryUsage;
+
+/**
+ * MeloMemoryUsageFunc:
+ * @usage: the #MeloMemoryUsage to fill, initialized to zero
+ * @user_data: the user data passed to melo_memory_register()
+ *
+ * A function called to get the memory usage of a subsystem.
+ */
+typedef void (*MeloMemoryUsageFunc) (MeloMemoryUsage *usage,
+                                     gpointer user_data);
+
+/**
+ * MeloMemoryTrimFunc:
+ * @budget: the budget of the subsystem (in bytes)
+ * @user_data: the user data passed to melo_memory_register()
+ *
+ * A function called when the memory usage of a subsystem exceeds its budget:
+ * it should release cached data until the usage is under @budget, if
+ * possible.
+ */
+typedef void (*MeloMemoryTrimFunc) (gsize budget, gpointer user_data);
+
+/* Memory accounts */
+void melo_memory_register (const gchar *name, MeloMemoryUsageFunc usage,
+                           MeloMemoryTrimFunc trim, gpointer user_data);
+void melo_memory_unregister (const gchar *name);
+
+/* Budgets */
+void melo_memory_set_budget (const gchar *name, gsize budget);
+gsize melo_memory_get_budget (const gchar *name);
+void melo_memory_enforce (void);
+
+/* Report */
+JsonObject *melo_memory_get_usage (void);
+
+#endif /* __MELO_MEMORY_H__ */
@@ -0,0 +1,545 @@
+/*
+ * melo_metrics.c: Metrics export in Prometheus text format
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#include <string.h>
+#include <stdarg.h>
+
+#include "melo_player.h"
+#include "melo_playlist.h"
+#include "melo_sink.h"
+#include "melo_tags.h"
+#include "melo_jsonrpc.h"
+#include "melo_tracer.h"
+
+#include "melo_metrics.h"
+
+/**
+ * SECTION:melo_metrics
+ * @title: MeloMetrics
+ * @short_description: Metrics export in Prometheus text format
+ *
+ * #MeloMetrics exports counters and gauges from all over Melo in the
+ * Prometheus text exposition format, in order to scrape them with an existing
+ * monitoring system.
+ *
+ * melo_metrics_render() always exports the metrics of the JSON-RPC methods,
+ * of the cover cache, of the players and their playlists and the health
+ * statistics of the sinks. Other subsystems, as a module or the HTTP server,
+ * can add their own metrics by registering a #MeloMetricsFunc with
+ * melo_metrics_register(): it is called during each export and it should use
+ * melo_metrics_add_header() and melo_metrics_add_value() to append its
+ * metrics.
+ *
+ * All metric names should start with "melo_", and durations are exported in
+ * seconds, as expected by Prometheus.
+ */
+
+typedef struct {
+  gchar *name;
+  MeloMetricsFunc func;
+  gpointer user_data;
+} MeloMetricsSource;
+
+/* Registered metrics sources */
+G_LOCK_DEFINE_STATIC (melo_metrics_mutex);
+static GList *melo_metrics_sources;
+
+static void
+melo_metrics_source_free (MeloMetricsSource *source)
+{
+  g_free (source->name);
+  g_slice_free (MeloMetricsSource, source);
+}
+
+/**
+ * melo_metrics_register:
+ * @name: the name of the source
+ * @func: the function to call on export
+ * @user_data: the data to pass to @func
+ *
+ * Register a new source of metrics: @func is called on each call of
+ * melo_metrics_render(), with the sources lock held, so it must not call
+ * melo_metrics_register() or melo_metrics_unregister(). If a source with the
+ * same @name is already registered, it is replaced.
+ */
+void
+melo_metrics_register (const gchar *name, MeloMetricsFunc func,
+                       gpointer user_data)
+{
+  MeloMetricsSource *source;
+
+  /* Create source */
+  source = g_slice_new (MeloMetricsSource);
+  source->name = g_strdup (name);
+  source->func = func;
+  source->user_data = user_data;
+
+  /* Add or replace source */
+  melo_metrics_unregister (name);
+  G_LOCK (melo_metrics_mutex);
+  melo_metrics_sources = g_list_append (melo_metrics_sources, source);
+  G_UNLOCK (melo_metrics_mutex);
+}
+
+/**
+ * melo_metrics_unregister:
+ * @name: the name of the source
+ *
+ * Unregister a source of metrics registered with melo_metrics_register(). When
+ * this function returns, the #MeloMetricsFunc of the source will not be called
+ * anymore.
+ */
+void
+melo_metrics_unregister (const gchar *name)
+{
+  GList *l;
+
+  G_LOCK (melo_metrics_mutex);
+  for (l = melo_metrics_sources; l != NULL; l = l->next) {
+    MeloMetricsSource *source = l->data;
+
+    /* Remove source */
+    if (!g_strcmp0 (source->name, name)) {
+      melo_metrics_sources = g_list_delete_link (melo_metrics_sources, l);
+      melo_metrics_source_free (source);
+      break;
+    }
+  }
+  G_UNLOCK (melo_metrics_mutex);
+}
+
+/**
+ * melo_metrics_add_header:
+ * @out: the #GString on which to append the header
+ * @name: the metric name
+ * @type: the metric type ("counter", "gauge" or "histogram")
+ * @help: a short description of the metric
+ *
+ * Append the HELP and TYPE lines of a metric. It must be called once, before
+ * the values of the metric.
+ */
+void
+melo_metrics_add_header (GString *out, const gchar *name, const gchar *type,
+                         const gchar *help)
+{
+  g_string_append_printf (out, "# HELP %s %s\n# TYPE %s %s\n", name, help,
+                          name, type);
+}
+
+static void
+melo_metrics_add_valuev (GString *out, const gchar *name, gdouble value,
+                         va_list args)
+{
+  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+  const gchar *label, *v;
+  gboolean first = TRUE;
+
+  /* Add name */
+  g_string_append (out, name);
+
+  /* Add labels: value is escaped */
+  while ((label = va_arg (args, const gchar *)) != NULL) {
+    v = va_arg (args, const gchar *);
+    g_string_append_printf (out, "%s%s=\"", first ? "{" : ",", label);
+    for (; v && *v; v++) {
+      if (*v == '\\' || *v == '"')
+        g_string_append_c (out, '\\');
+      if (*v == '\n')
+        g_string_append (out, "\\n");
+      else
+        g_string_append_c (out, *v);
+    }
+    g_string_append_c (out, '"');
+    first = FALSE;
+  }
+  if (!first)
+    g_string_append_c (out, '}');
+
+  /* Add value: decimal point does not depend on locale */
+  g_string_append_c (out, ' ');
+  g_string_append (out, g_ascii_dtostr (buf, sizeof (buf), value));
+  g_string_append_c (out, '\n');
+}
+
+/**
+ * melo_metrics_add_value:
+ * @out: the #GString on which to append the value
+ * @name: the metric name
+ * @value: the value
+ * @...: a %NULL-terminated list of label names and values
+ *
+ * Append a value of a metric, with its labels given as pairs of strings. The
+ * label values are escaped.
+ */
+void
+melo_metrics_add_value (GString *out, const gchar *name, gdouble value, ...)
+{
+  va_list args;
+
+  va_start (args, value);
+  melo_metrics_add_valuev (out, name, value, args);
+  va_end (args);
+}
+
+/* JSON-RPC metrics */
+static void
+melo_metrics_add_histogram (GString *out, const gchar *name, JsonArray *bounds,
+                            JsonObject *h, const gchar *method,
+                            const gchar *stage)
+{
+  gchar *bucket, *sum, *count;
+  gchar le[G_ASCII_DTOSTR_BUF_SIZE];
+  JsonArray *buckets;
+  gint64 total = 0;
+  guint i, len;
+
+  bucket = g_strconcat (name, "_bucket", NULL);
+  sum = g_strconcat (name, "_sum", NULL);
+  count = g_strconcat (name, "_count", NULL);
+
+  /* Add cumulative buckets: bounds are in us */
+  buckets = json_object_get_array_member (h, "buckets");
+  len = json_array_get_length (bounds);
+  for (i = 0; i <= len && i < json_array_get_length (buckets); i++) {
+    total += json_array_get_int_element (buckets, i);
+    if (i < len)
+      g_ascii_dtostr (le, sizeof (le),
+                      json_array_get_int_element (bounds, i) / 1000000.0);
+    else
+      g_strlcpy (le, "+Inf", sizeof (le));
+
+    if (method)
+      melo_metrics_add_value (out, bucket, total, "method", method, "stage",
+                              stage, "le", le, NULL);
+    else
+      melo_metrics_add_value (out, bucket, total, "le", le, NULL);
+  }
+
+  /* Add sum (in s) and count */
+  if (method) {
+    melo_metrics_add_value (out, sum,
+                            json_object_get_int_member (h, "total") / 1000000.0,
+                            "method", method, "stage", stage, NULL);
+    melo_metrics_add_value (out, count, json_object_get_int_member (h, "count"),
+                            "method", method, "stage", stage, NULL);
+  } else {
+    melo_metrics_add_value (out, sum,
+                            json_object_get_int_member (h, "total") / 1000000.0,
+                            NULL);
+    melo_metrics_add_value (out, count, json_object_get_int_member (h, "count"),
+                            NULL);
+  }
+
+  g_free (bucket);
+  g_free (sum);
+  g_free (count);
+}
+
+static void
+melo_metrics_jsonrpc (GString *out)
+{
+  static const gchar *stages[] = { "parse", "callback", "serialize" };
+  JsonArray *bounds, *methods;
+  JsonObject *obj;
+  guint i, j, len;
+
+  /* Get JSON-RPC statistics */
+  obj = melo_jsonrpc_get_stats ();
+  bounds = json_object_get_array_member (obj, "bounds");
+  methods = json_object_get_array_member (obj, "methods");
+  len = json_array_get_length (methods);
+
+  /* Add queue time */
+  melo_metrics_add_header (out, "melo_jsonrpc_queue_seconds", "histogram",
+                           "Time spent by requests waiting for a thread");
+  melo_metrics_add_histogram (out, "melo_jsonrpc_queue_seconds", bounds,
+                              json_object_get_object_member (obj, "queue"),
+                              NULL, NULL);
+
+  /* Add method counters */
+  melo_metrics_add_header (out, "melo_jsonrpc_calls_total", "counter",
+                           "Number of calls of a JSON-RPC method");
+  for (i = 0; i < len; i++) {
+    JsonObject *o = json_array_get_object_element (methods, i);
+    melo_metrics_add_value (out, "melo_jsonrpc_calls_total",
+                            json_object_get_int_member (o, "calls"),
+                            "method", json_object_get_string_member (o, "method"),
+                            NULL);
+  }
+  melo_metrics_add_header (out, "melo_jsonrpc_errors_total", "counter",
+                           "Number of failed calls of a JSON-RPC method");
+  for (i = 0; i < len; i++) {
+    JsonObject *o = json_array_get_object_element (methods, i);
+    melo_metrics_add_value (out, "melo_jsonrpc_errors_total",
+                            json_object_get_int_member (o, "errors"),
+                            "method", json_object_get_string_member (o, "method"),
+                            NULL);
+  }
+  melo_metrics_add_header (out, "melo_jsonrpc_in_flight", "gauge",
+                           "Number of calls of a JSON-RPC method in progress");
+  for (i = 0; i < len; i++) {
+    JsonObject *o = json_array_get_object_element (methods, i);
+    melo_metrics_add_value (out, "melo_jsonrpc_in_flight",
+                            json_object_get_int_member (o, "in_flight"),
+                            "method", json_object_get_string_member (o, "method"),
+                            NULL);
+  }
+
+  /* Add method latencies */
+  melo_metrics_add_header (out, "melo_jsonrpc_duration_seconds", "histogram",
+                           "Time spent in each stage of a JSON-RPC call");
+  for (i = 0; i < len; i++) {
+    JsonObject *o = json_array_get_object_element (methods, i);
+    const gchar *method = json_object_get_string_member (o, "method");
+
+    for (j = 0; j < G_N_ELEMENTS (stages); j++)
+      melo_metrics_add_histogram (out, "melo_jsonrpc_duration_seconds", bounds,
+                                  json_object_get_object_member (o, stages[j]),
+                                  method, stages[j]);
+  }
+
+  json_object_unref (obj);
+}
+
+/* Cover cache metrics */
+static void
+melo_metrics_covers (GString *out)
+{
+  gint64 hits, misses;
+  JsonObject *obj;
+
+  /* Get cover cache statistics */
+  obj = melo_tags_get_cover_cache_stats ();
+  hits = json_object_get_int_member (obj, "hits");
+  misses = json_object_get_int_member (obj, "misses");
+
+  melo_metrics_add_header (out, "melo_cover_cache_hits_total", "counter",
+                           "Number of covers served from memory");
+  melo_metrics_add_value (out, "melo_cover_cache_hits_total", hits, NULL);
+  melo_metrics_add_header (out, "melo_cover_cache_misses_total", "counter",
+                           "Number of covers loaded from disk");
+  melo_metrics_add_value (out, "melo_cover_cache_misses_total", misses, NULL);
+  melo_metrics_add_header (out, "melo_cover_cache_hit_ratio", "gauge",
+                           "Ratio of covers served from memory");
+  melo_metrics_add_value (out, "melo_cover_cache_hit_ratio",
+                          hits + misses ? (gdouble) hits / (hits + misses) : 0,
+                          NULL);
+  melo_metrics_add_header (out, "melo_cover_cache_evictions_total", "counter",
+                           "Number of covers evicted from memory");
+  melo_metrics_add_value (out, "melo_cover_cache_evictions_total",
+                          json_object_get_int_member (obj, "evictions"), NULL);
+  melo_metrics_add_header (out, "melo_cover_cache_bytes", "gauge",
+                           "Size of cover data in memory");
+  melo_metrics_add_value (out, "melo_cover_cache_bytes",
+                          json_object_get_int_member (obj, "resident_bytes"),
+                          NULL);
+  melo_metrics_add_header (out, "melo_cover_cache_max_bytes", "gauge",
+                           "Maximum size of cover data in memory");
+  melo_metrics_add_value (out, "melo_cover_cache_max_bytes",
+                          json_object_get_int_member (obj, "max_bytes"), NULL);
+
+  json_object_unref (obj);
+}
+
+/* Player and playlist metrics */
+static void
+melo_metrics_players (GString *out)
+{
+  GList *list, *l;
+  guint s;
+
+  /* Get player list */
+  list = melo_player_get_list ();
+
+  /* Add player states: current state is set to 1 */
+  melo_metrics_add_header (out, "melo_player_state", "gauge",
+                           "Current state of a player");
+  for (l = list; l != NULL; l = l->next) {
+    MeloPlayer *player = l->data;
+    MeloPlayerState state = melo_player_get_state (player);
+
+    for (s = 0; s < MELO_PLAYER_STATE_COUNT; s++)
+      melo_metrics_add_value (out, "melo_player_state", s == state,
+                              "player", melo_player_get_id (player),
+                              "state", melo_player_state_to_string (s), NULL);
+  }
+
+  /* Add playlist sizes */
+  melo_metrics_add_header (out, "melo_playlist_medias", "gauge",
+                           "Number of medias in the playlist of a player");
+  for (l = list; l != NULL; l = l->next) {
+    MeloPlayer *player = l->data;
+    MeloPlaylistList *plist;
+    MeloPlaylist *playlist;
+
+    if (!player->playlist)
+      continue;
+
+    /* Get only playlist size */
+    playlist = melo_player_get_playlist (player);
+    plist = melo_playlist_get_list (playlist, 0, 0, MELO_TAGS_FIELDS_NONE);
+    if (plist) {
+      melo_metrics_add_value (out, "melo_playlist_medias", plist->total,
+                              "player", melo_player_get_id (player),
+                              "playlist", melo_playlist_get_id (playlist),
+                              NULL);
+      melo_playlist_list_free (plist);
+    }
+    g_object_unref (playlist);
+  }
+
+  g_list_free_full (list, g_object_unref);
+}
+
+/* Sink metrics */
+static void
+melo_metrics_sink_add (GString *out, const gchar *id, MeloSinkStats *stats)
+{
+  melo_metrics_add_value (out, "melo_sink_buffers_total", stats->buffers,
+                          "sink", id, NULL);
+  melo_metrics_add_value (out, "melo_sink_underruns_total", stats->underruns,
+                          "sink", id, NULL);
+  melo_metrics_add_value (out, "melo_sink_dropped_total", stats->dropped,
+                          "sink", id, NULL);
+  melo_metrics_add_value (out, "melo_sink_late_total", stats->late,
+                          "sink", id, NULL);
+  if (stats->latency >= 0)
+    melo_metrics_add_value (out, "melo_sink_latency_seconds",
+                            stats->latency / 1000000.0, "sink", id, NULL);
+  if (stats->level >= 0)
+    melo_metrics_add_value (out, "melo_sink_level_ratio", stats->level / 100.0,
+                            "sink", id, NULL);
+  melo_metrics_add_value (out, "melo_sink_cpu_seconds_total",
+                          stats->cpu_time / 1000000.0, "sink", id, NULL);
+}
+
+static void
+melo_metrics_sinks (GString *out)
+{
+  MeloSinkStats stats;
+  GString *values;
+  GList *list, *l;
+
+  /* Values are grouped by sink, so they are generated before headers */
+  values = g_string_new (NULL);
+
+  /* Add main mixer */
+  if (melo_sink_get_stats (NULL, &stats))
+    melo_metrics_sink_add (values, "main", &stats);
+
+  /* Add sinks */
+  list = melo_sink_get_sink_list ();
+  for (l = list; l != NULL; l = l->next) {
+    MeloSink *sink = l->data;
+
+    if (melo_sink_get_stats (sink, &stats))
+      melo_metrics_sink_add (values, melo_sink_get_id (sink), &stats);
+  }
+  g_list_free_full (list, g_object_unref);
+
+  /* Add headers and values */
+  melo_metrics_add_header (out, "melo_sink_buffers_total", "counter",
+                           "Number of buffers played by a sink");
+  melo_metrics_add_header (out, "melo_sink_underruns_total", "counter",
+                           "Number of times the audio ran dry");
+  melo_metrics_add_header (out, "melo_sink_dropped_total", "counter",
+                           "Number of buffers dropped by a sink");
+  melo_metrics_add_header (out, "melo_sink_late_total", "counter",
+                           "Number of buffers rendered too late");
+  melo_metrics_add_header (out, "melo_sink_latency_seconds", "gauge",
+                           "Latency reported by the audio sink");
+  melo_metrics_add_header (out, "melo_sink_level_ratio", "gauge",
+                           "Fill level of the main mixer input");
+  melo_metrics_add_header (out, "melo_sink_cpu_seconds_total", "counter",
+                           "CPU time of the streaming thread");
+  g_string_append_len (out, values->str, values->len);
+  g_string_free (values, TRUE);
+}
+
+/* GStreamer element metrics */
+static void
+melo_metrics_elements (GString *out)
+{
+  JsonArray *elements;
+  JsonObject *obj;
+  guint i, len;
+
+  /* Get element processing times: only available with "proctime" tracer */
+  obj = melo_tracer_get_stats ();
+  elements = json_object_get_array_member (obj, "elements");
+  len = json_array_get_length (elements);
+  if (!len) {
+    json_object_unref (obj);
+    return;
+  }
+
+  melo_metrics_add_header (out, "melo_gst_element_buffers_total", "counter",
+                           "Number of buffers received by an element");
+  for (i = 0; i < len; i++) {
+    JsonObject *o = json_array_get_object_element (elements, i);
+    melo_metrics_add_value (out, "melo_gst_element_buffers_total",
+                            json_object_get_int_member (o, "buffers"),
+                            "element",
+                            json_object_get_string_member (o, "element"), NULL);
+  }
+  melo_metrics_add_header (out, "melo_gst_element_seconds_total", "counter",
+                           "Time spent by an element to process its buffers");
+  for (i = 0; i < len; i++) {
+    JsonObject *o = json_array_get_object_element (elements, i);
+    melo_metrics_add_value (out, "melo_gst_element_seconds_total",
+                            json_object_get_int_member (o, "total") / 1000000.0,
+                            "element",
+                            json_object_get_string_member (o, "element"), NULL);
+  }
+
+  json_object_unref (obj);
+}
+
+/**
+ * melo_metrics_render:
+ * @out: the #GString on which to append the metrics
+ *
+ * Append the metrics of the JSON-RPC methods, the cover cache, the players,
+ * the playlists, the sinks, the GStreamer elements (when the "proctime" tracer
+ * of #MeloTracer has been enabled) and of all the sources registered with
+ * melo_metrics_register(), in the Prometheus text exposition format.
+ */
+void
+melo_metrics_render (GString *out)
+{
+  GList *l;
+
+  /* Add built-in metrics */
+  melo_metrics_jsonrpc (out);
+  melo_metrics_covers (out);
+  melo_metrics_players (out);
+  melo_metrics_sinks (out);
+  melo_metrics_elements (out);
+
+  /* Add metrics of registered sources */
+  G_LOCK (melo_metrics_mutex);
+  for (l = melo_metrics_sources; l != NULL; l = l->next) {
+    MeloMetricsSource *source = l->data;
+    source->func (out, source->user_data);
+  }
+  G_UNLOCK (melo_metrics_mutex);
+}
@@ -0,0 +1,52 @@
+/*
+ * melo_metrics.h: Metrics export in Prometheus text format
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef __MELO_METRICS_H__
+#define __MELO_METRICS_H__
+
+#include <glib.h>
+
+/**
+ * MeloMetricsFunc:
+ * @out: the #GString on which to append the metrics
+ * @user_data: the user data passed to melo_metrics_register()
+ *
+ * A function called by melo_metrics_render() to append the metrics of a
+ * subsystem, with melo_metrics_add_header() and melo_metrics_add_value().
+ */
+typedef void (*MeloMetricsFunc) (GString *out, gpointer user_data);
+
+/* Metrics sources */
+void melo_metrics_register (const gchar *name, MeloMetricsFunc func,
+                            gpointer user_data);
+void melo_metrics_unregister (const gchar *name);
+
+/* Metrics export */
+void melo_metrics_render (GString *out);
+
+/* Text format helpers */
+void melo_metrics_add_header (GString *out, const gchar *name,
+                              const gchar *type, const gchar *help);
+void melo_metrics_add_value (GString *out, const gchar *name, gdouble value,
+                             ...) G_GNUC_NULL_TERMINATED;
+
+#endif /* __MELO_METRICS_H__ */
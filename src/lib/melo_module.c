@@ -20,6 +20,9 @@
  */
 
 #include "melo_module.h"
+#include "melo_plugin.h"
+#include "melo_trace.h"
+#include "melo_jsonrpc.h"
 
 /**
  * SECTION:melo_module
@@ -273,6 +276,15 @@ melo_module_get_info (MeloModule *module)
   return mclass->get_info (module);
 }
 
+/* Invalidate cached JSON-RPC results listing modules, browsers and players */
+static void
+melo_module_invalidate_cache (void)
+{
+  melo_jsonrpc_cache_invalidate ("module", NULL);
+  melo_jsonrpc_cache_invalidate ("browser", NULL);
+  melo_jsonrpc_cache_invalidate ("player", NULL);
+}
+
 /**
  * melo_module_register_browser:
  * @module: the module
@@ -304,6 +316,7 @@ melo_module_register_browser (MeloModule *module, MeloBrowser *browser)
 
   /* Unlock browser list */
   g_mutex_unlock (&priv->browser_mutex);
+  melo_module_invalidate_cache ();
 
   return TRUE;
 
@@ -341,6 +354,7 @@ melo_module_unregister_browser (MeloModule *module, const char *id)
   priv->browser_list = g_list_remove (priv->browser_list, bro);
   g_object_unref (bro);
   g_object_unref (bro);
+  melo_module_invalidate_cache ();
 
 unlock:
   /* Unlock browser list */
@@ -407,6 +421,7 @@ melo_module_register_player (MeloModule *module, MeloPlayer *player)
 
   /* Unlock player list */
   g_mutex_unlock (&priv->player_mutex);
+  melo_module_invalidate_cache ();
 
   return TRUE;
 
@@ -444,6 +459,7 @@ melo_module_unregister_player (MeloModule *module, const char *id)
   priv->player_list = g_list_remove (priv->player_list, play);
   g_object_unref (play);
   g_object_unref (play);
+  melo_module_invalidate_cache ();
 
 unlock:
   /* Unlock player list */
@@ -493,6 +509,7 @@ melo_module_get_player_list (MeloModule *module)
 gboolean
 melo_module_register (GType type, const gchar *id)
 {
+  gint64 trace = melo_trace_begin ();
   MeloModule *mod;
 
   g_return_val_if_fail (g_type_is_a (type, MELO_TYPE_MODULE), FALSE);
@@ -520,6 +537,8 @@ melo_module_register (GType type, const gchar *id)
 
   /* Unlock module list */
   G_UNLOCK (melo_module_mutex);
+  melo_module_invalidate_cache ();
+  melo_trace_end ("module", id, trace);
 
   return TRUE;
 
@@ -551,6 +570,7 @@ melo_module_unregister (const gchar *id)
   /* Remove module from list */
   melo_modules_list = g_list_remove (melo_modules_list, mod);
   g_hash_table_remove (melo_modules_hash, id);
+  melo_module_invalidate_cache ();
 
   /* Module list is empty */
   if (!g_hash_table_size (melo_modules_hash)) {
@@ -610,6 +630,14 @@ melo_module_get_module_by_id (const gchar *id)
   /* Get module by id */
   mod = g_hash_table_lookup (melo_modules_hash, id);
 
+  /* Not found: activate plugin providing it and retry */
+  if (!mod) {
+    G_UNLOCK (melo_module_mutex);
+    melo_plugin_activate (MELO_PLUGIN_PROVIDE_MODULE, id);
+    G_LOCK (melo_module_mutex);
+    mod = g_hash_table_lookup (melo_modules_hash, id);
+  }
+
   /* Increment ref count */
   if (mod)
     g_object_ref (mod);
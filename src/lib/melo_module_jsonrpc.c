@@ -19,6 +19,7 @@
  * Boston, MA  02110-1301, USA.
  */
 
+#include "melo_event.h"
 #include "melo_module_jsonrpc.h"
 #include "melo_browser_jsonrpc.h"
 #include "melo_player_jsonrpc.h"
@@ -462,6 +463,7 @@ static MeloJSONRPCMethod melo_module_jsonrpc_methods[] = {
     .result = "{\"type\":\"array\"}",
     .callback = melo_module_jsonrpc_get_list,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONCURRENT,
   },
   {
     .method = "get_info",
@@ -475,6 +477,7 @@ static MeloJSONRPCMethod melo_module_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_module_jsonrpc_get_info,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONCURRENT,
   },
   {
     .method = "get_browser_list",
@@ -488,6 +491,7 @@ static MeloJSONRPCMethod melo_module_jsonrpc_methods[] = {
     .result = "{\"type\":\"array\"}",
     .callback = melo_module_jsonrpc_get_browser_list,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONCURRENT,
   },
   {
     .method = "get_player_list",
@@ -501,6 +505,7 @@ static MeloJSONRPCMethod melo_module_jsonrpc_methods[] = {
     .result = "{\"type\":\"array\"}",
     .callback = melo_module_jsonrpc_get_player_list,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONCURRENT,
   },
   {
     .method = "get_full_list",
@@ -521,6 +526,8 @@ static MeloJSONRPCMethod melo_module_jsonrpc_methods[] = {
     .result = "{\"type\":\"array\"}",
     .callback = melo_module_jsonrpc_get_full_list,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONCURRENT | MELO_JSONRPC_FLAGS_CACHE,
+    .cache_events = (1 << MELO_EVENT_TYPE_MODULE),
   },
 };
 
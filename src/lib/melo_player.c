@@ -21,6 +21,8 @@
 
 #include "melo_event.h"
 #include "melo_player.h"
+#include "melo_plugin.h"
+#include "melo_trace.h"
 
 /**
  * SECTION:melo_player
@@ -54,6 +56,9 @@
  * instantiation with melo_player_new().
  */
 
+/* Default position sampling interval (in ms) */
+#define MELO_PLAYER_POS_INTERVAL 1000
+
 /* Internal player list */
 G_LOCK_DEFINE_STATIC (melo_player_mutex);
 static GHashTable *melo_player_hash = NULL;
@@ -71,6 +76,10 @@ struct _MeloPlayerStatusPrivate {
   MeloTags *tags;
 };
 
+/* Status pointer without its lock bit */
+#define MELO_PLAYER_STATUS_PTR(p) \
+  ((MeloPlayerStatus *) ((gsize) (p) & ~((gsize) 1)))
+
 struct _MeloPlayerPrivate {
   GMutex mutex;
   gchar *id;
@@ -78,6 +87,13 @@ struct _MeloPlayerPrivate {
   MeloPlayerInfo info;
   MeloPlayerStatus *status;
   gint64 last_update;
+
+  /* Position ticker */
+  guint pos_interval;
+  guint pos_source;
+
+  /* Start of last play request (for tracing) */
+  gint64 play_trace;
 };
 
 enum {
@@ -95,6 +111,11 @@ static void melo_player_get_property (GObject *object, guint property_id,
 static MeloPlayerStatus *melo_player_status_new (MeloPlayerState state,
                                                  const gchar *name,
                                                  MeloTags *tags);
+static MeloPlayerStatus *melo_player_status_copy (const MeloPlayerStatus *st);
+static MeloPlayerStatus *melo_player_status_get (MeloPlayerPrivate *priv);
+static gint melo_player_status_get_pos (MeloPlayer *player,
+                                        const MeloPlayerStatus *status);
+static void melo_player_pos_restart (MeloPlayer *player);
 
 G_DEFINE_ABSTRACT_TYPE_WITH_PRIVATE (MeloPlayer, melo_player, G_TYPE_OBJECT)
 
@@ -104,8 +125,12 @@ melo_player_finalize (GObject *gobject)
   MeloPlayer *player = MELO_PLAYER (gobject);
   MeloPlayerPrivate *priv = melo_player_get_instance_private (player);
 
+  /* Stop position ticker */
+  if (priv->pos_source)
+    g_source_remove (priv->pos_source);
+
   /* Free player status */
-  melo_player_status_unref (priv->status);
+  melo_player_status_unref (MELO_PLAYER_STATUS_PTR (priv->status));
 
   /* Send a delete player event */
   melo_event_player_delete (priv->id);
@@ -178,6 +203,7 @@ melo_player_init (MeloPlayer *self)
   priv->name = NULL;
   priv->info.playlist_id = NULL;
   priv->status = melo_player_status_new (MELO_PLAYER_STATE_NONE, NULL, NULL);
+  priv->pos_interval = MELO_PLAYER_POS_INTERVAL;
 
   /* Init player mutex */
   g_mutex_init (&priv->mutex);
@@ -310,6 +336,14 @@ melo_player_get_player_by_id (const gchar *id)
   /* Find player by id */
   play = g_hash_table_lookup (melo_player_hash, id);
 
+  /* Not found: activate plugin providing it and retry */
+  if (!play) {
+    G_UNLOCK (melo_player_mutex);
+    melo_plugin_activate (MELO_PLUGIN_PROVIDE_PLAYER, id);
+    G_LOCK (melo_player_mutex);
+    play = g_hash_table_lookup (melo_player_hash, id);
+  }
+
   /* Increment reference count */
   if (play)
     g_object_ref (play);
@@ -464,6 +498,42 @@ melo_player_add (MeloPlayer *player, const gchar *path, const gchar *name,
   return pclass->add (player, path, name, tags);
 }
 
+/**
+ * melo_player_add_many:
+ * @player: the player
+ * @items: a #GList of #MeloPlaylistItem describing the medias to add
+ *
+ * Add a list of medias to the player, as done by melo_player_add() for each
+ * #MeloPlaylistItem of @items with its @path, @name and @tags, but in only one
+ * operation when it is supported by the player. The display name of an item
+ * can be set by the player when not provided.
+ *
+ * Returns: %TRUE if all medias have been successfully added; %FALSE otherwise.
+ */
+gboolean
+melo_player_add_many (MeloPlayer *player, GList *items)
+{
+  MeloPlayerClass *pclass = MELO_PLAYER_GET_CLASS (player);
+  gboolean ret = TRUE;
+  GList *l;
+
+  /* Add medias at once */
+  if (pclass->add_many)
+    return pclass->add_many (player, items);
+
+  g_return_val_if_fail (pclass->add, FALSE);
+
+  /* Add medias one by one */
+  for (l = items; l; l = l->next) {
+    MeloPlaylistItem *item = l->data;
+
+    if (!pclass->add (player, item->path, item->name, item->tags))
+      ret = FALSE;
+  }
+
+  return ret;
+}
+
 /**
  * melo_player_load:
  * @player: the player
@@ -512,10 +582,25 @@ melo_player_play (MeloPlayer *player, const gchar *path, const gchar *name,
                   MeloTags *tags, gboolean insert)
 {
   MeloPlayerClass *pclass = MELO_PLAYER_GET_CLASS (player);
+  MeloPlayerPrivate *priv = player->priv;
+  gboolean ret;
+  gint64 trace;
 
   g_return_val_if_fail (pclass->play, FALSE);
 
-  return pclass->play (player, path, name, tags, insert);
+  /* Play media */
+  trace = melo_trace_begin ();
+  ret = pclass->play (player, path, name, tags, insert);
+  melo_trace_end ("player.play", priv->id, trace);
+
+  /* Media loading is traced until playing state */
+  if (ret && trace) {
+    g_mutex_lock (&priv->mutex);
+    priv->play_trace = trace;
+    g_mutex_unlock (&priv->mutex);
+  }
+
+  return ret;
 }
 
 /**
@@ -669,6 +754,8 @@ melo_player_set_mute (MeloPlayer *player, gboolean mute)
  * To use correctly the @timestamp value, for the first call, it should be set
  * to zero, than it should be the same value as returned in the
  * #MeloPlayerStatus.
+ * The position is extrapolated from the last sample done by the position
+ * ticker (see melo_player_set_pos_interval()).
  *
  * Returns: (transfer full): a reference to a #MeloPlayerStatus containing the
  * last player status. After use, call melo_player_status_unref().
@@ -678,6 +765,7 @@ melo_player_get_status (MeloPlayer *player, gint64 *timestamp)
 {
   MeloPlayerPrivate *priv = player->priv;
   MeloPlayerStatus *status;
+  gint pos;
 
   /* */
   if (timestamp) {
@@ -686,13 +774,19 @@ melo_player_get_status (MeloPlayer *player, gint64 *timestamp)
     *timestamp = priv->last_update;
   }
 
-  /* Copy status */
-  g_mutex_lock (&priv->mutex);
-  status = melo_player_status_ref (priv->status);
-  g_mutex_unlock (&priv->mutex);
+  /* Get current status snapshot */
+  status = melo_player_status_get (priv);
 
-  /* Update position */
-  status->pos = melo_player_get_pos (player);
+  /* Update position: snapshot is shared and must not be modified */
+  pos = melo_player_status_get_pos (player, status);
+  if (pos != status->pos) {
+    MeloPlayerStatus *copy;
+
+    copy = melo_player_status_copy (status);
+    copy->pos = pos;
+    melo_player_status_unref (status);
+    status = copy;
+  }
 
   return status;
 }
@@ -709,12 +803,13 @@ MeloPlayerState
 melo_player_get_state (MeloPlayer *player)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
   MeloPlayerState state;
 
   /* Get player state */
-  g_mutex_lock (&priv->mutex);
-  state = priv->status->state;
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_get (priv);
+  state = status->state;
+  melo_player_status_unref (status);
 
   return state;
 }
@@ -732,12 +827,13 @@ gchar *
 melo_player_get_media_name (MeloPlayer *player)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
   gchar *name;
 
   /* Copy media name */
-  g_mutex_lock (&priv->mutex);
-  name = melo_player_status_get_name (priv->status);
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_get (priv);
+  name = melo_player_status_get_name (status);
+  melo_player_status_unref (status);
 
   return name;
 }
@@ -760,6 +856,48 @@ melo_player_get_pos (MeloPlayer *player)
   return pclass->get_pos (player);
 }
 
+static gint
+melo_player_status_get_pos (MeloPlayer *player, const MeloPlayerStatus *status)
+{
+  MeloPlayerPrivate *priv = player->priv;
+  gint pos;
+
+  /* No position ticker: query player */
+  if (!priv->pos_interval)
+    return melo_player_get_pos (player);
+
+  /* Extrapolate last sampled position while playing */
+  pos = status->pos;
+  if (status->state == MELO_PLAYER_STATE_PLAYING && status->pos_time) {
+    pos += (g_get_monotonic_time () - status->pos_time) / 1000;
+    if (status->duration > 0 && pos > status->duration)
+      pos = status->duration;
+  }
+
+  return pos;
+}
+
+/**
+ * melo_player_set_pos_interval:
+ * @player: the player
+ * @interval: the position sampling interval (in ms), or 0
+ *
+ * Set the interval between two samples of the stream position while the
+ * player is playing. Each sample is cached in the internal #MeloPlayerStatus
+ * with its timestamp and sent with a #MELO_EVENT_PLAYER_POS event, so the
+ * position returned by melo_player_get_status() is extrapolated from the last
+ * sample instead of being queried to the player on each call. If @interval is
+ * 0, the ticker is disabled and the position is queried on each call.
+ *
+ * The default interval is 1000 ms.
+ */
+void
+melo_player_set_pos_interval (MeloPlayer *player, guint interval)
+{
+  player->priv->pos_interval = interval;
+  melo_player_pos_restart (player);
+}
+
 /**
  * melo_player_get_volume:
  * @player: the player
@@ -772,12 +910,13 @@ gdouble
 melo_player_get_volume (MeloPlayer *player)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
   gdouble volume;
 
   /* Get current volume */
-  g_mutex_lock (&priv->mutex);
-  volume = priv->status->volume;
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_get (priv);
+  volume = status->volume;
+  melo_player_status_unref (status);
 
   return volume;
 }
@@ -794,12 +933,13 @@ gboolean
 melo_player_get_mute (MeloPlayer *player)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
   gboolean mute;
 
   /* Get current mute */
-  g_mutex_lock (&priv->mutex);
-  mute = priv->status->mute;
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_get (priv);
+  mute = status->mute;
+  melo_player_status_unref (status);
 
   return mute;
 }
@@ -817,12 +957,13 @@ MeloTags *
 melo_player_get_tags (MeloPlayer *player)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
   MeloTags *tags;
 
   /* Get tags */
-  g_mutex_lock (&priv->mutex);
-  tags = melo_player_status_get_tags (priv->status);
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_get (priv);
+  tags = melo_player_status_get_tags (status);
+  melo_player_status_unref (status);
 
   return tags;
 }
@@ -860,6 +1001,152 @@ melo_player_status_new (MeloPlayerState state, const gchar *name,
   return status;
 }
 
+static MeloPlayerStatus *
+melo_player_status_copy (const MeloPlayerStatus *status)
+{
+  MeloPlayerStatusPrivate *priv;
+  MeloPlayerStatus *copy;
+
+  /* Create a new status with same strings and tags */
+  copy = melo_player_status_new (status->state, status->priv->name,
+                                 status->priv->tags ?
+                                   melo_tags_ref (status->priv->tags) : NULL);
+  copy->priv->error = g_strdup (status->priv->error);
+
+  /* Copy values */
+  priv = copy->priv;
+  *copy = *status;
+  copy->priv = priv;
+
+  return copy;
+}
+
+/* Get a reference to the current status snapshot: the lock bit of the pointer
+ * is only held while the reference is taken.
+ */
+static MeloPlayerStatus *
+melo_player_status_get (MeloPlayerPrivate *priv)
+{
+  MeloPlayerStatus *status;
+
+  g_pointer_bit_lock (&priv->status, 0);
+  status = melo_player_status_ref (MELO_PLAYER_STATUS_PTR (priv->status));
+  g_pointer_bit_unlock (&priv->status, 0);
+
+  return status;
+}
+
+/* Lock status update and get a private copy of current status */
+static MeloPlayerStatus *
+melo_player_status_edit (MeloPlayerPrivate *priv)
+{
+  g_mutex_lock (&priv->mutex);
+  return melo_player_status_copy (MELO_PLAYER_STATUS_PTR (priv->status));
+}
+
+/* Publish a new status snapshot and unlock status update */
+static void
+melo_player_status_commit (MeloPlayerPrivate *priv, MeloPlayerStatus *status)
+{
+  MeloPlayerStatus *old;
+
+  /* Replace snapshot: the lock bit is set with the new pointer */
+  g_pointer_bit_lock (&priv->status, 0);
+  old = MELO_PLAYER_STATUS_PTR (priv->status);
+  g_atomic_pointer_set (&priv->status, (gpointer) ((gsize) status | 1));
+  g_pointer_bit_unlock (&priv->status, 0);
+  g_mutex_unlock (&priv->mutex);
+
+  /* Release previous snapshot when last reader is done */
+  melo_player_status_unref (old);
+}
+
+/* Sample current position into status and send a 'player pos' event */
+static MeloPlayerState
+melo_player_pos_sample (MeloPlayer *player)
+{
+  MeloPlayerClass *pclass = MELO_PLAYER_GET_CLASS (player);
+  MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
+  MeloPlayerState state;
+  gint64 now;
+  gint pos;
+
+  /* Get position from player */
+  pos = pclass->get_pos ? pclass->get_pos (player) : 0;
+  now = g_get_monotonic_time ();
+
+  /* Update position */
+  status = melo_player_status_edit (priv);
+  status->pos = pos;
+  status->pos_time = now;
+  state = status->state;
+  melo_player_status_commit (priv, status);
+
+  /* Send 'player pos' event */
+  melo_event_player_pos (priv->id, pos, now / 1000);
+
+  return state;
+}
+
+static gboolean
+melo_player_pos_timer (gpointer user_data)
+{
+  MeloPlayer *player = user_data;
+  MeloPlayerPrivate *priv = player->priv;
+  guint id;
+
+  /* Sample position while playing */
+  if (melo_player_pos_sample (player) == MELO_PLAYER_STATE_PLAYING)
+    return G_SOURCE_CONTINUE;
+
+  /* Stop ticker */
+  id = g_source_get_id (g_main_current_source ());
+  g_mutex_lock (&priv->mutex);
+  if (priv->pos_source == id)
+    priv->pos_source = 0;
+  g_mutex_unlock (&priv->mutex);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+melo_player_pos_start (gpointer user_data)
+{
+  MeloPlayer *player = user_data;
+  MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerState state;
+  guint id;
+
+  /* Sample position after state change */
+  state = melo_player_pos_sample (player);
+
+  /* Start ticker while playing */
+  id = g_source_get_id (g_main_current_source ());
+  g_mutex_lock (&priv->mutex);
+  if (priv->pos_source == id)
+    priv->pos_source = state == MELO_PLAYER_STATE_PLAYING ?
+                       g_timeout_add (priv->pos_interval,
+                                      melo_player_pos_timer, player) : 0;
+  g_mutex_unlock (&priv->mutex);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Restart position ticker from main loop: it can be called from any thread */
+static void
+melo_player_pos_restart (MeloPlayer *player)
+{
+  MeloPlayerPrivate *priv = player->priv;
+
+  g_mutex_lock (&priv->mutex);
+  if (priv->pos_source)
+    g_source_remove (priv->pos_source);
+  priv->pos_source = priv->pos_interval ?
+                     g_idle_add (melo_player_pos_start, player) : 0;
+  g_mutex_unlock (&priv->mutex);
+}
+
 static void
 melo_player_updated (MeloPlayerPrivate *priv)
 {
@@ -885,28 +1172,28 @@ melo_player_reset_status (MeloPlayer *player, MeloPlayerState state,
                           const gchar *name, MeloTags *tags)
 {
   MeloPlayerPrivate *priv = player->priv;
-  MeloPlayerStatus *status;
+  MeloPlayerStatus *status, *current;
 
   /* Create a new status */
   status = melo_player_status_new (state, name, tags);
   if (!status)
     return FALSE;
 
-  /* Lock player status access */
+  /* Lock player status update */
   g_mutex_lock (&priv->mutex);
 
   /* Copy values from previous status */
-  status->volume = priv->status->volume;
-  status->mute = priv->status->mute;
-  status->has_prev = priv->status->has_prev;
-  status->has_next = priv->status->has_next;
+  current = MELO_PLAYER_STATUS_PTR (priv->status);
+  status->volume = current->volume;
+  status->mute = current->mute;
+  status->has_prev = current->has_prev;
+  status->has_next = current->has_next;
 
-  /* Set new player status */
-  melo_player_status_unref (priv->status);
-  priv->status = status;
+  /* Publish new player status */
+  melo_player_status_commit (priv, status);
 
-  /* Unlock player status access */
-  g_mutex_unlock (&priv->mutex);
+  /* Sample position of new media */
+  melo_player_pos_restart (player);
 
   return TRUE;
 }
@@ -923,11 +1210,31 @@ void
 melo_player_set_status_state (MeloPlayer *player, MeloPlayerState state)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
+  gboolean changed;
 
   /* Update state */
-  g_mutex_lock (&priv->mutex);
-  priv-> status->state = state;
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_edit (priv);
+  changed = status->state != state;
+  status->state = state;
+  melo_player_status_commit (priv, status);
+
+  /* Start or stop position ticker */
+  if (changed)
+    melo_player_pos_restart (player);
+
+  /* End of media loading */
+  if (priv->play_trace && (state == MELO_PLAYER_STATE_PLAYING ||
+      state == MELO_PLAYER_STATE_STOPPED || state == MELO_PLAYER_STATE_ERROR)) {
+    gint64 trace;
+
+    g_mutex_lock (&priv->mutex);
+    trace = priv->play_trace;
+    priv->play_trace = 0;
+    g_mutex_unlock (&priv->mutex);
+    if (state == MELO_PLAYER_STATE_PLAYING)
+      melo_trace_end ("player.load", priv->id, trace);
+  }
 
   /* Send 'player state' event */
   melo_event_player_state (priv->id, state);
@@ -948,12 +1255,19 @@ melo_player_set_status_buffering (MeloPlayer *player, MeloPlayerState state,
                                   guint percent)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
+  gboolean changed;
 
   /* Update state and buffer percent */
-  g_mutex_lock (&priv->mutex);
-  priv->status->state = state;
-  priv->status->buffer_percent = percent;
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_edit (priv);
+  changed = status->state != state;
+  status->state = state;
+  status->buffer_percent = percent;
+  melo_player_status_commit (priv, status);
+
+  /* Start or stop position ticker */
+  if (changed)
+    melo_player_pos_restart (player);
 
   /* Send 'player buffering' event */
   melo_event_player_buffering (priv->id, state, percent);
@@ -973,11 +1287,13 @@ void
 melo_player_set_status_pos (MeloPlayer *player, gint pos)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
 
   /* Update position */
-  g_mutex_lock (&priv->mutex);
-  priv->status->pos = pos;
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_edit (priv);
+  status->pos = pos;
+  status->pos_time = g_get_monotonic_time ();
+  melo_player_status_commit (priv, status);
 
   /* Send 'player seek' event */
   melo_event_player_seek (priv->id, pos);
@@ -996,11 +1312,12 @@ void
 melo_player_set_status_duration (MeloPlayer *player, gint duration)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
 
   /* Update duration */
-  g_mutex_lock (&priv->mutex);
-  priv->status->duration = duration;
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_edit (priv);
+  status->duration = duration;
+  melo_player_status_commit (priv, status);
 
   /* Send 'player duration' event */
   melo_event_player_duration (priv->id, duration);
@@ -1022,12 +1339,13 @@ melo_player_set_status_playlist (MeloPlayer *player, gboolean has_prev,
                                  gboolean has_next)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
 
   /* Update playlist */
-  g_mutex_lock (&priv->mutex);
-  priv->status->has_prev = has_prev;
-  priv->status->has_next = has_next;
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_edit (priv);
+  status->has_prev = has_prev;
+  status->has_next = has_next;
+  melo_player_status_commit (priv, status);
 
   /* Send 'player playlist' event */
   melo_event_player_playlist (priv->id, has_prev, has_next);
@@ -1046,11 +1364,12 @@ void
 melo_player_set_status_volume (MeloPlayer *player, gdouble volume)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
 
   /* Update volume */
-  g_mutex_lock (&priv->mutex);
-  priv->status->volume = volume;
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_edit (priv);
+  status->volume = volume;
+  melo_player_status_commit (priv, status);
 
   /* Send 'player volume' event */
   melo_event_player_volume (priv->id, volume);
@@ -1069,17 +1388,42 @@ void
 melo_player_set_status_mute (MeloPlayer *player, gboolean mute)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
 
   /* Update mute */
-  g_mutex_lock (&priv->mutex);
-  priv->status->mute = mute;
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_edit (priv);
+  status->mute = mute;
+  melo_player_status_commit (priv, status);
 
   /* Send 'player mute' event */
   melo_event_player_mute (priv->id, mute);
   melo_player_updated (priv);
 }
 
+/**
+ * melo_player_set_status_load_time:
+ * @player: the player
+ * @load_time: the time needed to get the first audio buffer (in ms)
+ *
+ * Set the time elapsed between the load of the current media and its first
+ * audio buffer in the internal #MeloPlayerStatus.
+ * This function should be only called by the #MeloPlayer subclass or by the
+ * attached #MeloSink.
+ */
+void
+melo_player_set_status_load_time (MeloPlayer *player, gint load_time)
+{
+  MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
+
+  /* Update load time */
+  status = melo_player_status_edit (priv);
+  status->load_time = load_time;
+  melo_player_status_commit (priv, status);
+
+  melo_player_updated (priv);
+}
+
 static void
 melo_player_status_set_name (MeloPlayerStatus *status, const gchar *name)
 {
@@ -1108,11 +1452,12 @@ void
 melo_player_set_status_name (MeloPlayer *player, const gchar *name)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
 
   /* Update name */
-  g_mutex_lock (&priv->mutex);
-  melo_player_status_set_name (priv->status, name);
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_edit (priv);
+  melo_player_status_set_name (status, name);
+  melo_player_status_commit (priv, status);
 
   /* Send 'player name' event */
   melo_event_player_name (priv->id, name);
@@ -1149,11 +1494,15 @@ void
 melo_player_set_status_error (MeloPlayer *player, const gchar *error)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
 
   /* Update error */
-  g_mutex_lock (&priv->mutex);
-  melo_player_status_set_error (priv->status, error);
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_edit (priv);
+  melo_player_status_set_error (status, error);
+  melo_player_status_commit (priv, status);
+
+  /* Stop position ticker */
+  melo_player_pos_restart (player);
 
   /* Send 'player error' event */
   melo_event_player_error (priv->id, error);
@@ -1195,11 +1544,12 @@ void
 melo_player_take_status_tags (MeloPlayer *player, MeloTags *tags)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
 
   /* Set new tags */
-  g_mutex_lock (&priv->mutex);
-  melo_player_status_take_tags (priv->status, tags);
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_edit (priv);
+  melo_player_status_take_tags (status, tags);
+  melo_player_status_commit (priv, status);
 
   /* Send 'player tags' event */
   melo_event_player_tags (priv->id, tags);
@@ -1236,7 +1586,7 @@ melo_player_set_status_tags (MeloPlayer *player, MeloTags *tags)
 MeloPlayerStatus *
 melo_player_status_ref (MeloPlayerStatus *status)
 {
-  status->priv->ref_count++;
+  g_atomic_int_inc (&status->priv->ref_count);
   return status;
 }
 
@@ -1250,8 +1600,7 @@ melo_player_status_ref (MeloPlayerStatus *status)
 void
 melo_player_status_unref (MeloPlayerStatus *status)
 {
-  status->priv->ref_count--;
-  if (status->priv->ref_count)
+  if (!g_atomic_int_dec_and_test (&status->priv->ref_count))
     return;
 
   /* Free status */
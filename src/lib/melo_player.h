@@ -97,6 +97,7 @@ struct _MeloPlayer {
  * @parent_class: Object parent class
  * @get_info: Provide the #MeloPlayerInfo defined by the #MeloPlayer
  * @add: Add a media by path to the player (and then playlist if used)
+ * @add_many: Add a list of medias by path to the player at once
  * @load: Load a media by path with the player in pause / stopped state
  * @play: Play a media by path with the player
  * @set_state: Set player state (playing / paused / stopped)
@@ -117,6 +118,7 @@ struct _MeloPlayerClass {
 
   gboolean (*add) (MeloPlayer *player, const gchar *path, const gchar *name,
                    MeloTags *tags);
+  gboolean (*add_many) (MeloPlayer *player, GList *items);
   gboolean (*load) (MeloPlayer *player, const gchar *path, const gchar *name,
                     MeloTags *tags, gboolean insert, gboolean stopped);
   gboolean (*play) (MeloPlayer *player, const gchar *path, const gchar *name,
@@ -158,11 +160,14 @@ struct _MeloPlayerInfo {
  * @buffer_percent: buffering percentage when @state is
  *    MELO_PLAYER_STATE_BUFFERING or MELO_PLAYER_STATE_PAUSED_BUFFERING
  * @pos: current position of the stream (in ms)
+ * @pos_time: monotonic time at which @pos has been sampled (in us)
  * @duration: duration of the current media (in ms)
  * @has_prev: a media is available before the current one in playlist
  * @has_next: a media is available after the current one in playlist
  * @volume: current volume
  * @mute: current mute state
+ * @load_time: time between the load of the current media and its first audio
+ *    buffer (in ms), 0 if not yet available
  *
  * #MeloPlayerStatus handles all details about the current status of the
  * player and the media its playing. Some other informations are provided by the
@@ -172,16 +177,22 @@ struct _MeloPlayerInfo {
  *
  * All the data handled by the #MeloPlayerStatus can also be retrieved directly
  * from the #MeloPlayer instance.
+ *
+ * A #MeloPlayerStatus returned by melo_player_get_status() is an immutable
+ * snapshot: each status update publishes a new snapshot, so readers never wait
+ * for the player to update its status.
  */
 struct _MeloPlayerStatus {
   MeloPlayerState state;
   gint buffer_percent;
   gint pos;
+  gint64 pos_time;
   gint duration;
   gboolean has_prev;
   gboolean has_next;
   gdouble volume;
   gboolean mute;
+  gint load_time;
 
   /*< private >*/
   MeloPlayerStatusPrivate *priv;
@@ -203,6 +214,7 @@ MeloPlaylist *melo_player_get_playlist (MeloPlayer *player);
 /* Player control */
 gboolean melo_player_add (MeloPlayer *player, const gchar *path,
                           const gchar *name, MeloTags *tags);
+gboolean melo_player_add_many (MeloPlayer *player, GList *items);
 gboolean melo_player_load (MeloPlayer *player, const gchar *path,
                            const gchar *name, MeloTags *tags, gboolean insert,
                            gboolean stopped);
@@ -222,6 +234,7 @@ MeloPlayerStatus *melo_player_get_status (MeloPlayer *player,
 MeloPlayerState melo_player_get_state (MeloPlayer *player);
 gchar *melo_player_get_media_name (MeloPlayer *player);
 gint melo_player_get_pos (MeloPlayer *player);
+void melo_player_set_pos_interval (MeloPlayer *player, guint interval);
 gdouble melo_player_get_volume (MeloPlayer *player);
 gboolean melo_player_get_mute (MeloPlayer *player);
 MeloTags *melo_player_get_tags (MeloPlayer *player);
@@ -238,6 +251,7 @@ void melo_player_set_status_playlist (MeloPlayer *player, gboolean has_prev,
                                       gboolean has_next);
 void melo_player_set_status_volume (MeloPlayer *player, gdouble volume);
 void melo_player_set_status_mute (MeloPlayer *player, gboolean mute);
+void melo_player_set_status_load_time (MeloPlayer *player, gint load_time);
 void melo_player_set_status_name (MeloPlayer *player, const gchar *name);
 void melo_player_set_status_error (MeloPlayer *player, const gchar *error);
 void melo_player_set_status_tags (MeloPlayer *player, MeloTags *tags);
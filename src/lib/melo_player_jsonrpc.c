@@ -19,6 +19,8 @@
  * Boston, MA  02110-1301, USA.
  */
 
+#include "melo_event.h"
+#include "melo_sink.h"
 #include "melo_player_jsonrpc.h"
 
 /**
@@ -185,6 +187,8 @@ melo_player_jsonrpc_get_status_fields (JsonObject *obj, const char *name)
       fields |= MELO_PLAYER_JSONRPC_STATUS_FIELDS_MUTE;
     else if (!g_strcmp0 (field, "tags"))
       fields |= MELO_PLAYER_JSONRPC_STATUS_FIELDS_TAGS;
+    else if (!g_strcmp0 (field, "load_time"))
+      fields |= MELO_PLAYER_JSONRPC_STATUS_FIELDS_LOAD_TIME;
   }
 
   return fields;
@@ -248,12 +252,14 @@ melo_player_jsonrpc_status_to_object (const MeloPlayerStatus *status,
     if (tags) {
       if (tags_timestamp <= 0 || melo_tags_updated (tags, tags_timestamp))
         json_object_set_object_member (obj, "tags",
-                                       melo_tags_to_json_object (tags,
-                                                                 tags_fields));
+                                       melo_tags_get_json_object (tags,
+                                                                  tags_fields));
       melo_tags_unref (tags);
     } else
       json_object_set_null_member (obj, "tags");
   }
+  if (fields & MELO_PLAYER_JSONRPC_STATUS_FIELDS_LOAD_TIME)
+    json_object_set_int_member (obj, "load_time", status->load_time);
   return obj;
 }
 
@@ -350,6 +356,10 @@ melo_player_jsonrpc_get_list (const gchar *method,
   }
   json_object_unref (obj);
 
+  /* Position is updated continuously without any event */
+  if (sfields & MELO_PLAYER_JSONRPC_STATUS_FIELDS_POS)
+    melo_jsonrpc_disable_cache ();
+
   /* Get player list */
   list = melo_player_get_list ();
 
@@ -657,6 +667,112 @@ melo_player_jsonrpc_action (const gchar *method,
   json_node_take_object (*result, obj);
 }
 
+static void
+melo_player_jsonrpc_add (const gchar *method,
+                         JsonArray *s_params, JsonNode *params,
+                         JsonNode **result, JsonNode **error,
+                         gpointer user_data)
+{
+  MeloPlaylistItem *item;
+  GList *items = NULL;
+  MeloPlayer *play;
+  JsonObject *obj, *o;
+  JsonArray *array;
+  gboolean ret = FALSE;
+  guint count, i;
+
+  /* Get parameters */
+  obj = melo_jsonrpc_get_object (s_params, params, error);
+  if (!obj)
+    return;
+
+  /* Get player from id */
+  play = melo_player_jsonrpc_get_player (obj, error);
+  if (!play) {
+    json_object_unref (obj);
+    return;
+  }
+
+  /* Create item list from medias */
+  array = json_object_get_array_member (obj, "medias");
+  count = array ? json_array_get_length (array) : 0;
+  for (i = 0; i < count; i++) {
+    o = json_array_get_object_element (array, i);
+    if (!o || !json_object_has_member (o, "path"))
+      continue;
+
+    /* Create new item */
+    item = melo_playlist_item_new (NULL,
+                                   json_object_has_member (o, "name") ?
+                                     json_object_get_string_member (o, "name") :
+                                     NULL,
+                                   json_object_get_string_member (o, "path"),
+                                   NULL);
+    if (item)
+      items = g_list_prepend (items, item);
+  }
+  json_object_unref (obj);
+
+  /* Add all medias at once */
+  if (items) {
+    items = g_list_reverse (items);
+    ret = melo_player_add_many (play, items);
+    g_list_free_full (items, (GDestroyNotify) melo_playlist_item_unref);
+  }
+  g_object_unref (play);
+
+  /* Create answer */
+  obj = json_object_new ();
+  json_object_set_boolean_member (obj, "done", ret);
+
+  /* Return result */
+  *result = json_node_new (JSON_NODE_OBJECT);
+  json_node_take_object (*result, obj);
+}
+
+static void
+melo_player_jsonrpc_dump_pipeline (const gchar *method,
+                                   JsonArray *s_params, JsonNode *params,
+                                   JsonNode **result, JsonNode **error,
+                                   gpointer user_data)
+{
+  MeloPlayer *play;
+  JsonObject *obj;
+  gchar *dot = NULL;
+  GList *list, *l;
+
+  /* Get parameters */
+  obj = melo_jsonrpc_get_object (s_params, params, error);
+  if (!obj)
+    return;
+
+  /* Get player from id */
+  play = melo_player_jsonrpc_get_player (obj, error);
+  json_object_unref (obj);
+  if (!play)
+    return;
+
+  /* Dump pipeline of the first sink of the player */
+  list = melo_sink_get_sink_list ();
+  for (l = list; l != NULL && !dot; l = l->next)
+    if (melo_sink_get_player (l->data) == play)
+      dot = melo_sink_dump_pipeline (l->data);
+  g_list_free_full (list, g_object_unref);
+  g_object_unref (play);
+
+  /* No pipeline dumped */
+  if (!dot) {
+    *error = melo_jsonrpc_build_error_node (MELO_JSONRPC_ERROR_INTERNAL_ERROR,
+                                            "Failed to dump pipeline");
+    return;
+  }
+
+  /* Return graph */
+  *result = json_node_new (JSON_NODE_VALUE);
+  json_node_set_string (*result, dot);
+  g_free (dot);
+}
+
 /* List of methods */
 static MeloJSONRPCMethod melo_player_jsonrpc_methods[] = {
   {
@@ -682,6 +798,9 @@ static MeloJSONRPCMethod melo_player_jsonrpc_methods[] = {
     .result = "{\"type\":\"array\"}",
     .callback = melo_player_jsonrpc_get_list,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONCURRENT | MELO_JSONRPC_FLAGS_CACHE,
+    .cache_events = (1 << MELO_EVENT_TYPE_MODULE) |
+                    (1 << MELO_EVENT_TYPE_PLAYER),
   },
   {
     .method = "get_info",
@@ -695,6 +814,7 @@ static MeloJSONRPCMethod melo_player_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_player_jsonrpc_get_info,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONCURRENT,
   },
   {
     .method = "set_state",
@@ -705,6 +825,7 @@ static MeloJSONRPCMethod melo_player_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_player_jsonrpc_set_state,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONTROL,
   },
   {
     .method = "set_pos",
@@ -715,6 +836,7 @@ static MeloJSONRPCMethod melo_player_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_player_jsonrpc_set_pos,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONTROL,
   },
   {
     .method = "set_volume",
@@ -725,6 +847,7 @@ static MeloJSONRPCMethod melo_player_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_player_jsonrpc_set_volume,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONTROL,
   },
   {
     .method = "set_mute",
@@ -735,6 +858,7 @@ static MeloJSONRPCMethod melo_player_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_player_jsonrpc_set_mute,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONTROL,
   },
   {
     .method = "get_status",
@@ -756,6 +880,7 @@ static MeloJSONRPCMethod melo_player_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_player_jsonrpc_get_status,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONCURRENT | MELO_JSONRPC_FLAGS_CONTROL,
   },
   {
     .method = "prev",
@@ -765,6 +890,7 @@ static MeloJSONRPCMethod melo_player_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_player_jsonrpc_action,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONTROL,
   },
   {
     .method = "next",
@@ -774,6 +900,28 @@ static MeloJSONRPCMethod melo_player_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_player_jsonrpc_action,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONTROL,
+  },
+  {
+    .method = "add",
+    .params = "["
+              "  {\"name\": \"id\", \"type\": \"string\"},"
+              "  {\"name\": \"medias\", \"type\": \"array\"}"
+              "]",
+    .result = "{\"type\":\"object\"}",
+    .callback = melo_player_jsonrpc_add,
+    .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_BULK,
+  },
+  {
+    .method = "dump_pipeline",
+    .params = "["
+              "  {\"name\": \"id\", \"type\": \"string\"}"
+              "]",
+    .result = "{\"type\":\"string\"}",
+    .callback = melo_player_jsonrpc_dump_pipeline,
+    .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONCURRENT | MELO_JSONRPC_FLAGS_BULK,
   },
 };
 
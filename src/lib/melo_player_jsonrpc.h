@@ -58,6 +58,7 @@ typedef enum {
  * @MELO_PLAYER_JSONRPC_STATUS_FIELDS_VOLUME: get current volume
  * @MELO_PLAYER_JSONRPC_STATUS_FIELDS_MUTE: get current mute status
  * @MELO_PLAYER_JSONRPC_STATUS_FIELDS_TAGS: get media tags
+ * @MELO_PLAYER_JSONRPC_STATUS_FIELDS_LOAD_TIME: get time to first audio (in ms)
  * @MELO_PLAYER_JSONRPC_STATUS_FIELDS_FULL: get everything
  *
  * MeloPlayerJSONRPCStatusFields is a bit field to list which details must be
@@ -74,6 +75,7 @@ typedef enum {
   MELO_PLAYER_JSONRPC_STATUS_FIELDS_VOLUME = 32,
   MELO_PLAYER_JSONRPC_STATUS_FIELDS_MUTE = 64,
   MELO_PLAYER_JSONRPC_STATUS_FIELDS_TAGS = 128,
+  MELO_PLAYER_JSONRPC_STATUS_FIELDS_LOAD_TIME = 256,
 
   MELO_PLAYER_JSONRPC_STATUS_FIELDS_FULL = ~0,
 } MeloPlayerJSONRPCStatusFields;
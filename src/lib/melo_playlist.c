@@ -19,6 +19,7 @@
  * Boston, MA  02110-1301, USA.
  */
 
+#include "melo_event.h"
 #include "melo_playlist.h"
 
 /**
@@ -36,6 +37,11 @@
  * A list of the medias can be retrieved through melo_playlist_get_list() and
  * modified (sort, move, remove, ...) with many functions as
  * melo_playlist_sort(), melo_playlist_move(), melo_playlist_remove(), ...
+ * A client can then follow the playlist with melo_playlist_get_changes(), which
+ * provides only the modifications done since the revision of its list, or with
+ * the #MELO_EVENT_TYPE_PLAYLIST events. When the playlist implementation
+ * doesn't provide its changes, a #MELO_EVENT_PLAYLIST_RESET event is sent
+ * after each modification.
  */
 
 /* Internal playlist list */
@@ -190,6 +196,46 @@ melo_playlist_get_playlist_by_id (const gchar *id)
   return plist;
 }
 
+/**
+ * melo_playlist_get_memory_usage:
+ * @usage: the #MeloMemoryUsage to fill
+ *
+ * Get the number of medias held by all #MeloPlaylist instances, with the count
+ * of each playlist in the details. The tags of the medias are accounted with
+ * the live #MeloTags.
+ */
+void
+melo_playlist_get_memory_usage (MeloMemoryUsage *usage)
+{
+  GList *list, *l;
+
+  /* Get a reference on all playlists */
+  G_LOCK (melo_playlist_mutex);
+  list = g_list_copy_deep (melo_playlist_list, (GCopyFunc) g_object_ref, NULL);
+  G_UNLOCK (melo_playlist_mutex);
+
+  /* Get media count of each playlist */
+  usage->details = json_object_new ();
+  for (l = list; l != NULL; l = l->next) {
+    MeloPlaylist *playlist = l->data;
+    MeloPlaylistList *plist;
+
+    if (!MELO_PLAYLIST_GET_CLASS (playlist)->get_list)
+      continue;
+    plist = melo_playlist_get_list (playlist, 0, 0, MELO_TAGS_FIELDS_NONE);
+    if (!plist)
+      continue;
+    json_object_set_int_member (usage->details,
+                                melo_playlist_get_id (playlist), plist->total);
+    usage->count += plist->total;
+    melo_playlist_list_free (plist);
+  }
+  g_list_free_full (list, g_object_unref);
+
+  /* Estimate size of items */
+  usage->bytes = usage->count * sizeof (MeloPlaylistItem);
+}
+
 /**
  * melo_playlist_new:
  * @type: the type ID of the #MeloPlaylist subtype to instantiate
@@ -269,25 +315,63 @@ melo_playlist_get_player (MeloPlaylist *playlist)
   return g_object_ref (playlist->player);
 }
 
+/* Playlists without changes log only notify that the list must be refreshed */
+static inline gboolean
+melo_playlist_changed (MeloPlaylist *playlist, MeloPlaylistClass *pclass,
+                       gboolean ret)
+{
+  if (ret && !pclass->get_changes)
+    melo_event_playlist_reset (playlist->priv->id, 0);
+  return ret;
+}
+
 /**
  * melo_playlist_get_list:
  * @playlist: the playlist
+ * @offset: the number of medias to skip in the playlist
+ * @count: the number of medias to get, -1 for all medias
  * @tags_fields: the tag fields to fill in #MeloTags of the media items
  *
- * Get the list of media in the playlist.
+ * Get the list of media in the playlist. Only @count medias starting at
+ * @offset are added to the list.
  *
  * Returns: (transfer full): a #MeloPlaylistList with the current media
  * playlist or %NULL if an error has occurred.
  * Use melo_playlist_list_free() after usage.
  */
 MeloPlaylistList *
-melo_playlist_get_list (MeloPlaylist *playlist, MeloTagsFields tags_fields)
+melo_playlist_get_list (MeloPlaylist *playlist, gint offset, gint count,
+                        MeloTagsFields tags_fields)
 {
   MeloPlaylistClass *pclass = MELO_PLAYLIST_GET_CLASS (playlist);
 
   g_return_val_if_fail (pclass->get_list, NULL);
 
-  return pclass->get_list (playlist, tags_fields);
+  return pclass->get_list (playlist, offset, count, tags_fields);
+}
+
+/**
+ * melo_playlist_get_changes:
+ * @playlist: the playlist
+ * @since: the revision from which the changes are requested
+ *
+ * Get the list of changes done in the playlist after the revision @since. The
+ * revision is returned by melo_playlist_get_list() and
+ * melo_playlist_get_changes().
+ *
+ * Returns: (transfer full): a #MeloPlaylistChanges with all changes done after
+ * @since or %NULL if not supported by the playlist.
+ * Use melo_playlist_changes_free() after usage.
+ */
+MeloPlaylistChanges *
+melo_playlist_get_changes (MeloPlaylist *playlist, guint since)
+{
+  MeloPlaylistClass *pclass = MELO_PLAYLIST_GET_CLASS (playlist);
+
+  if (!pclass->get_changes)
+    return NULL;
+
+  return pclass->get_changes (playlist, since);
 }
 
 /**
@@ -334,7 +418,46 @@ melo_playlist_add (MeloPlaylist *playlist, const gchar *path, const gchar *name,
 
   g_return_val_if_fail (pclass->add, FALSE);
 
-  return pclass->add (playlist, path, name, tags, is_current);
+  return melo_playlist_changed (playlist, pclass,
+                                pclass->add (playlist, path, name, tags,
+                                             is_current));
+}
+
+/**
+ * melo_playlist_add_many:
+ * @playlist: the playlist
+ * @items: a #GList of #MeloPlaylistItem to add
+ *
+ * Add a list of medias to the playlist, as done by melo_playlist_add() for each
+ * media, but in only one operation. The @path, @name and @tags of each
+ * #MeloPlaylistItem are used, the media ID is generated by the playlist. The
+ * list is not modified and should be freed by the caller.
+ *
+ * Returns: %TRUE if all medias have been added to the list, %FALSE otherwise.
+ */
+gboolean
+melo_playlist_add_many (MeloPlaylist *playlist, GList *items)
+{
+  MeloPlaylistClass *pclass = MELO_PLAYLIST_GET_CLASS (playlist);
+  gboolean ret = TRUE;
+  GList *l;
+
+  /* Add medias at once */
+  if (pclass->add_many)
+    return melo_playlist_changed (playlist, pclass,
+                                  pclass->add_many (playlist, items));
+
+  g_return_val_if_fail (pclass->add, FALSE);
+
+  /* Add medias one by one */
+  for (l = items; l; l = l->next) {
+    MeloPlaylistItem *item = l->data;
+
+    if (!pclass->add (playlist, item->path, item->name, item->tags, FALSE))
+      ret = FALSE;
+  }
+
+  return melo_playlist_changed (playlist, pclass, items != NULL);
 }
 
 /**
@@ -429,6 +552,50 @@ melo_playlist_has_next (MeloPlaylist *playlist)
   return pclass->has_next (playlist);
 }
 
+/**
+ * melo_playlist_set_shuffle:
+ * @playlist: the playlist
+ * @enable: set to %TRUE to play medias in a random order
+ *
+ * Enable or disable the shuffle play order of the playlist. When enabled,
+ * melo_playlist_get_prev() and melo_playlist_get_next() follow a random order
+ * of the medias, starting from the current playing media, while the list of
+ * the playlist is left untouched.
+ *
+ * Returns: %TRUE if the play order has been changed, %FALSE otherwise.
+ */
+gboolean
+melo_playlist_set_shuffle (MeloPlaylist *playlist, gboolean enable)
+{
+  MeloPlaylistClass *pclass = MELO_PLAYLIST_GET_CLASS (playlist);
+
+  /* Not supported */
+  if (!pclass->set_shuffle)
+    return FALSE;
+
+  return pclass->set_shuffle (playlist, enable);
+}
+
+/**
+ * melo_playlist_get_shuffle:
+ * @playlist: the playlist
+ *
+ * Check if the shuffle play order of the playlist is enabled.
+ *
+ * Returns: %TRUE if medias are played in a random order, %FALSE otherwise.
+ */
+gboolean
+melo_playlist_get_shuffle (MeloPlaylist *playlist)
+{
+  MeloPlaylistClass *pclass = MELO_PLAYLIST_GET_CLASS (playlist);
+
+  /* Not supported */
+  if (!pclass->get_shuffle)
+    return FALSE;
+
+  return pclass->get_shuffle (playlist);
+}
+
 /**
  * melo_playlist_play:
  * @playlist: the playlist
@@ -449,6 +616,31 @@ melo_playlist_play (MeloPlaylist *playlist, const gchar *id)
   return pclass->play (playlist, id);
 }
 
+/**
+ * melo_playlist_set_current:
+ * @playlist: the playlist
+ * @id: the media ID
+ *
+ * Set the media identified with @id as the current playing media, without
+ * playing it with the associated #MeloPlayer. It is used by a player which has
+ * already started the media on its own, as for a gapless transition, to keep
+ * the playlist in sync with the audio output.
+ *
+ * Returns: %TRUE if the media has been found and set as current, %FALSE
+ * otherwise.
+ */
+gboolean
+melo_playlist_set_current (MeloPlaylist *playlist, const gchar *id)
+{
+  MeloPlaylistClass *pclass = MELO_PLAYLIST_GET_CLASS (playlist);
+
+  /* Not supported */
+  if (!pclass->set_current || !id)
+    return FALSE;
+
+  return pclass->set_current (playlist, id);
+}
+
 /**
  * melo_playlist_sort:
  * @playlist: the playlist
@@ -468,7 +660,8 @@ melo_playlist_sort (MeloPlaylist *playlist, const gchar *id, guint count,
 
   g_return_val_if_fail (pclass->sort, FALSE);
 
-  return pclass->sort (playlist, id, count, sort);
+  return melo_playlist_changed (playlist, pclass,
+                                pclass->sort (playlist, id, count, sort));
 }
 
 /**
@@ -496,7 +689,8 @@ melo_playlist_move (MeloPlaylist *playlist, const gchar *id, gint up,
 
   g_return_val_if_fail (pclass->move, FALSE);
 
-  return pclass->move (playlist, id, up, count);
+  return melo_playlist_changed (playlist, pclass,
+                                pclass->move (playlist, id, up, count));
 }
 
 /**
@@ -523,7 +717,8 @@ melo_playlist_move_to (MeloPlaylist *playlist, const gchar *id,
 
   g_return_val_if_fail (pclass->move_to, FALSE);
 
-  return pclass->move_to (playlist, id, before, count);
+  return melo_playlist_changed (playlist, pclass,
+                                pclass->move_to (playlist, id, before, count));
 }
 
 /**
@@ -542,7 +737,8 @@ melo_playlist_remove (MeloPlaylist *playlist, const gchar *id)
 
   g_return_val_if_fail (pclass->remove, FALSE);
 
-  return pclass->remove (playlist, id);
+  return melo_playlist_changed (playlist, pclass,
+                                pclass->remove (playlist, id));
 }
 
 /**
@@ -556,8 +752,10 @@ melo_playlist_empty (MeloPlaylist *playlist)
 {
   MeloPlaylistClass *pclass = MELO_PLAYLIST_GET_CLASS (playlist);
 
-  if (pclass->empty)
+  if (pclass->empty) {
     pclass->empty (playlist);
+    melo_playlist_changed (playlist, pclass, TRUE);
+  }
 }
 
 /**
@@ -584,11 +782,177 @@ melo_playlist_list_new ()
 void
 melo_playlist_list_free (MeloPlaylistList *list)
 {
-  g_free (list->current);
-  g_list_free_full (list->items, (GDestroyNotify) melo_playlist_item_unref);
+  /* Current ID and nodes are released with the arena */
+  if (list->arena) {
+    g_list_foreach (list->items, (GFunc) melo_playlist_item_unref, NULL);
+    melo_arena_free (list->arena);
+  } else {
+    g_free (list->current);
+    g_list_free_full (list->items, (GDestroyNotify) melo_playlist_item_unref);
+  }
   g_slice_free (MeloPlaylistList, list);
 }
 
+/**
+ * melo_playlist_list_new_with_arena:
+ *
+ * Create a new #MeloPlaylistList with its own #MeloArena, in order to replace
+ * the allocation of each node of the list by a few large ones.
+ *
+ * Returns: (transfer full): a new #MeloPlaylistList or %NULL if an error
+ * occurred. After usage, it should be freed with melo_playlist_list_free().
+ */
+MeloPlaylistList *
+melo_playlist_list_new_with_arena (void)
+{
+  MeloPlaylistList *list;
+
+  list = g_slice_new0 (MeloPlaylistList);
+  if (list)
+    list->arena = melo_arena_new (0);
+
+  return list;
+}
+
+/**
+ * melo_playlist_list_strdup:
+ * @list: the list
+ * @str: (allow-none): the string to duplicate
+ *
+ * Duplicate a string for @list, as the current media ID: it is allocated from
+ * the arena of @list when available, or with g_strdup() otherwise.
+ *
+ * Returns: a copy of @str, or %NULL if @str is %NULL.
+ */
+gchar *
+melo_playlist_list_strdup (MeloPlaylistList *list, const gchar *str)
+{
+  if (!list->arena)
+    return g_strdup (str);
+  return melo_arena_strdup (list->arena, str);
+}
+
+/**
+ * melo_playlist_list_prepend:
+ * @list: the list
+ * @item: (transfer full): the item to add
+ *
+ * Add an item at start of @list. With an arena, the node of the #GList is
+ * allocated from the arena.
+ */
+void
+melo_playlist_list_prepend (MeloPlaylistList *list, MeloPlaylistItem *item)
+{
+  GList *node;
+
+  if (!list->arena) {
+    list->items = g_list_prepend (list->items, item);
+    return;
+  }
+
+  /* Allocate node from arena */
+  node = melo_arena_new0 (list->arena, GList);
+  node->data = item;
+  node->next = list->items;
+  if (list->items)
+    list->items->prev = node;
+  list->items = node;
+}
+
+/**
+ * melo_playlist_change_new:
+ * @type: the #MeloPlaylistChangeType
+ * @revision: the playlist revision after the change
+ * @id: the media ID
+ * @position: the position of the media
+ * @count: the number of medias changed
+ * @item: the #MeloPlaylistItem inserted or updated, can be %NULL
+ *
+ * Create a new #MeloPlaylistChange to describe a playlist modification.
+ *
+ * Returns: (transfer full): a new #MeloPlaylistChange. After usage, it should
+ * be freed with melo_playlist_change_free().
+ */
+MeloPlaylistChange *
+melo_playlist_change_new (MeloPlaylistChangeType type, guint revision,
+                          const gchar *id, gint position, gint count,
+                          MeloPlaylistItem *item)
+{
+  MeloPlaylistChange *change;
+
+  change = g_slice_new (MeloPlaylistChange);
+  change->type = type;
+  change->revision = revision;
+  change->id = g_strdup (id);
+  change->position = position;
+  change->count = count;
+  change->item = item ? melo_playlist_item_ref (item) : NULL;
+
+  return change;
+}
+
+/**
+ * melo_playlist_change_copy:
+ * @change: the change to copy
+ *
+ * Copy a #MeloPlaylistChange.
+ *
+ * Returns: (transfer full): a copy of @change. After usage, it should be freed
+ * with melo_playlist_change_free().
+ */
+MeloPlaylistChange *
+melo_playlist_change_copy (const MeloPlaylistChange *change)
+{
+  return melo_playlist_change_new (change->type, change->revision, change->id,
+                                   change->position, change->count,
+                                   change->item);
+}
+
+/**
+ * melo_playlist_change_free:
+ * @change: the change to free
+ *
+ * Free the #MeloPlaylistChange instance.
+ */
+void
+melo_playlist_change_free (MeloPlaylistChange *change)
+{
+  if (change->item)
+    melo_playlist_item_unref (change->item);
+  g_free (change->id);
+  g_slice_free (MeloPlaylistChange, change);
+}
+
+/**
+ * melo_playlist_changes_new:
+ *
+ * Create a new #MeloPlaylistChanges which will contain the modifications of a
+ * playlist since a revision.
+ *
+ * Returns: (transfer full): a new #MeloPlaylistChanges. After usage, it should
+ * be freed with melo_playlist_changes_free().
+ */
+MeloPlaylistChanges *
+melo_playlist_changes_new (void)
+{
+  return g_slice_new0 (MeloPlaylistChanges);
+}
+
+/**
+ * melo_playlist_changes_free:
+ * @changes: the changes to free
+ *
+ * Free the #MeloPlaylistChanges instance.
+ */
+void
+melo_playlist_changes_free (MeloPlaylistChanges *changes)
+{
+  g_free (changes->current);
+  g_list_free_full (changes->changes,
+                    (GDestroyNotify) melo_playlist_change_free);
+  g_slice_free (MeloPlaylistChanges, changes);
+}
+
 /**
  * melo_playlist_item_new:
  * @id: the ID of the media. Can be set to %NULL and set later with g_strdup()
@@ -699,8 +1063,7 @@ melo_playlist_item_list_sort (GList *list, MeloSort sort)
 
   switch (melo_sort_set_asc (sort)) {
     case MELO_SORT_SHUFFLE:
-      func = melo_sort_cmp_shuffle;
-      break;
+      return melo_sort_list_shuffle (list);
     case MELO_SORT_FILE:
       func = melo_sort_is_desc (sort) ? melo_playlist_item_cmp_file_desc :
                                         melo_playlist_item_cmp_file;
@@ -25,6 +25,7 @@
 #include <glib-object.h>
 
 #include "melo_tags.h"
+#include "melo_arena.h"
 #include "melo_sort.h"
 
 G_BEGIN_DECLS
@@ -46,6 +47,10 @@ typedef struct _MeloPlaylistPrivate MeloPlaylistPrivate;
 typedef struct _MeloPlaylistList MeloPlaylistList;
 typedef struct _MeloPlaylistItem MeloPlaylistItem;
 
+typedef enum _MeloPlaylistChangeType MeloPlaylistChangeType;
+typedef struct _MeloPlaylistChange MeloPlaylistChange;
+typedef struct _MeloPlaylistChanges MeloPlaylistChanges;
+
 /**
  * MeloPlaylist:
  *
@@ -65,15 +70,20 @@ struct _MeloPlaylist {
  * MeloPlaylistClass:
  * @parent_class: Object parent class
  * @get_list: Provide the list of media in the playlist
+ * @get_changes: Provide the changes done in the playlist since a revision
  * @get_tags: Provide the #MeloTags of one media in the playlist
  * @add: Add a new media to the playlist
+ * @add_many: Add a list of medias to the playlist at once
  * @get_prev: Get the media in the playlist before the current playing
  * @get_next: Get the media in the playlist to play after the current playing
  * @has_prev: Check if a media can be played in playlist before the current
  *    playing
  * @has_next: Check if a media can be played in playlist after the current
  *    playing
+ * @set_shuffle: Enable or disable the random play order of the playlist
+ * @get_shuffle: Check if the random play order of the playlist is enabled
  * @play: Play a media in playlist with the associated #MeloPlayer
+ * @set_current: Set the current media in playlist without playing it
  * @sort: Sort one or more media(s) in the playlist
  * @move: Move one or more media(s) in the playlist
  * @move_to: Move one or more media(s) in the playlist before one item
@@ -87,19 +97,24 @@ struct _MeloPlaylist {
 struct _MeloPlaylistClass {
   GObjectClass parent_class;
 
-  MeloPlaylistList *(*get_list) (MeloPlaylist *playlist,
-                                 MeloTagsFields tags_fields);
+  MeloPlaylistList *(*get_list) (MeloPlaylist *playlist, gint offset,
+                                 gint count, MeloTagsFields tags_fields);
+  MeloPlaylistChanges *(*get_changes) (MeloPlaylist *playlist, guint since);
   MeloTags *(*get_tags) (MeloPlaylist *playlist, const gchar *id,
                          MeloTagsFields fields);
   gboolean (*add) (MeloPlaylist *playlist, const gchar *path, const gchar *name,
                    MeloTags *tags, gboolean is_current);
+  gboolean (*add_many) (MeloPlaylist *playlist, GList *items);
   gchar *(*get_prev) (MeloPlaylist *playlist, gchar **id, MeloTags **tags,
                       gboolean set);
   gchar *(*get_next) (MeloPlaylist *playlist, gchar **id, MeloTags **tags,
                       gboolean set);
   gboolean (*has_prev) (MeloPlaylist *playlist);
   gboolean (*has_next) (MeloPlaylist *playlist);
+  gboolean (*set_shuffle) (MeloPlaylist *playlist, gboolean enable);
+  gboolean (*get_shuffle) (MeloPlaylist *playlist);
   gboolean (*play) (MeloPlaylist *playlist, const gchar *id);
+  gboolean (*set_current) (MeloPlaylist *playlist, const gchar *id);
   gboolean (*sort) (MeloPlaylist *playlist, const gchar *id, guint count,
                     MeloSort sort);
   gboolean (*move) (MeloPlaylist *playlist, const gchar *id, gint up,
@@ -114,14 +129,91 @@ struct _MeloPlaylistClass {
  * MeloPlaylistList:
  * @current: the media ID of the current playing media
  * @items: a #GList of #MeloPlaylistItem
+ * @offset: the position in playlist of the first item of @items
+ * @total: the number of medias in the whole playlist
+ * @revision: the revision of the playlist when the list has been generated
  *
  * A #MeloPlaylistList contains the current media list of a #MeloPlaylist
  * presented with a #GList of #MeloPlaylistItem and the current media playing
  * in associated #MeloPlayer, identified with @current.
+ * The list can be only a part of the playlist, starting at @offset. The
+ * @revision can be used with melo_playlist_get_changes() to get only the next
+ * modifications of the playlist.
+ *
+ * A list created with melo_playlist_list_new_with_arena() allocates @current
+ * and the nodes of @items from a #MeloArena, released in a single operation
+ * by melo_playlist_list_free(). In this mode, @current must be set with
+ * melo_playlist_list_strdup() and the items added with
+ * melo_playlist_list_prepend(). The nodes of @items must not be freed.
  */
 struct _MeloPlaylistList {
   gchar *current;
   GList *items;
+  gint offset;
+  gint total;
+  guint revision;
+
+  /*< private >*/
+  MeloArena *arena;
+};
+
+/**
+ * MeloPlaylistChangeType:
+ * @MELO_PLAYLIST_CHANGE_INSERT: a media has been inserted at @position
+ * @MELO_PLAYLIST_CHANGE_REMOVE: the media at @position has been removed
+ * @MELO_PLAYLIST_CHANGE_MOVE: @count medias starting with @id have been moved,
+ *    the first one is now at @position
+ * @MELO_PLAYLIST_CHANGE_UPDATE: the media at @position has been updated (it
+ *    became the current media for example)
+ *
+ * MeloPlaylistChangeType defines the type of a #MeloPlaylistChange.
+ */
+enum _MeloPlaylistChangeType {
+  MELO_PLAYLIST_CHANGE_INSERT = 0,
+  MELO_PLAYLIST_CHANGE_REMOVE,
+  MELO_PLAYLIST_CHANGE_MOVE,
+  MELO_PLAYLIST_CHANGE_UPDATE,
+};
+
+/**
+ * MeloPlaylistChange:
+ * @type: the #MeloPlaylistChangeType of the change
+ * @revision: the playlist revision after the change
+ * @id: the media ID of the (first) media changed
+ * @position: the position of the media in playlist after the change, or the
+ *    position before removal for @MELO_PLAYLIST_CHANGE_REMOVE
+ * @count: the number of medias moved
+ * @item: the #MeloPlaylistItem inserted or updated, %NULL otherwise
+ *
+ * A #MeloPlaylistChange describes one modification of a #MeloPlaylist. Applying
+ * the changes in order on a list retrieved with melo_playlist_get_list() gives
+ * the same list as the playlist at the last revision.
+ */
+struct _MeloPlaylistChange {
+  MeloPlaylistChangeType type;
+  guint revision;
+  gchar *id;
+  gint position;
+  gint count;
+  MeloPlaylistItem *item;
+};
+
+/**
+ * MeloPlaylistChanges:
+ * @current: the media ID of the current playing media
+ * @revision: the current revision of the playlist
+ * @reset: %TRUE if changes since requested revision are not available anymore,
+ *    then the list must be retrieved again with melo_playlist_get_list()
+ * @changes: a #GList of #MeloPlaylistChange
+ *
+ * A #MeloPlaylistChanges contains all modifications done in a #MeloPlaylist
+ * since a revision.
+ */
+struct _MeloPlaylistChanges {
+  gchar *current;
+  guint revision;
+  gboolean reset;
+  GList *changes;
 };
 
 /**
@@ -153,24 +245,32 @@ GType melo_playlist_get_type (void);
 MeloPlaylist *melo_playlist_new (GType type, const gchar *id);
 const gchar *melo_playlist_get_id (MeloPlaylist *playlist);
 MeloPlaylist *melo_playlist_get_playlist_by_id (const gchar *id);
+void melo_playlist_get_memory_usage (MeloMemoryUsage *usage);
 
 void melo_playlist_set_player (MeloPlaylist *playlist, MeloPlayer *player);
 MeloPlayer *melo_playlist_get_player (MeloPlaylist *playlist);
 
-MeloPlaylistList *melo_playlist_get_list (MeloPlaylist *playlist,
+MeloPlaylistList *melo_playlist_get_list (MeloPlaylist *playlist, gint offset,
+                                          gint count,
                                           MeloTagsFields tags_fields);
+MeloPlaylistChanges *melo_playlist_get_changes (MeloPlaylist *playlist,
+                                                guint since);
 MeloTags *melo_playlist_get_tags (MeloPlaylist *playlist, const gchar *id,
                                   MeloTagsFields fields);
 gboolean melo_playlist_add (MeloPlaylist *playlist, const gchar *path,
                             const gchar *name, MeloTags *tags,
                             gboolean is_current);
+gboolean melo_playlist_add_many (MeloPlaylist *playlist, GList *items);
 gchar *melo_playlist_get_prev (MeloPlaylist *playlist, gchar **id,
                                MeloTags **tags, gboolean set);
 gchar *melo_playlist_get_next (MeloPlaylist *playlist, gchar **id,
                                MeloTags **tags, gboolean set);
 gboolean melo_playlist_has_prev (MeloPlaylist *playlist);
 gboolean melo_playlist_has_next (MeloPlaylist *playlist);
+gboolean melo_playlist_set_shuffle (MeloPlaylist *playlist, gboolean enable);
+gboolean melo_playlist_get_shuffle (MeloPlaylist *playlist);
 gboolean melo_playlist_play (MeloPlaylist *playlist, const gchar *id);
+gboolean melo_playlist_set_current (MeloPlaylist *playlist, const gchar *id);
 gboolean melo_playlist_sort (MeloPlaylist *playlist, const gchar *id,
                              guint count, MeloSort sort);
 gboolean melo_playlist_move (MeloPlaylist *playlist, const gchar *id, gint up,
@@ -181,7 +281,21 @@ gboolean melo_playlist_remove (MeloPlaylist *playlist, const gchar *id);
 void melo_playlist_empty (MeloPlaylist *playlist);
 
 MeloPlaylistList *melo_playlist_list_new (void);
+MeloPlaylistList *melo_playlist_list_new_with_arena (void);
 void melo_playlist_list_free (MeloPlaylistList *list);
+gchar *melo_playlist_list_strdup (MeloPlaylistList *list, const gchar *str);
+void melo_playlist_list_prepend (MeloPlaylistList *list,
+                                 MeloPlaylistItem *item);
+
+MeloPlaylistChange *melo_playlist_change_new (MeloPlaylistChangeType type,
+                                              guint revision, const gchar *id,
+                                              gint position, gint count,
+                                              MeloPlaylistItem *item);
+MeloPlaylistChange *melo_playlist_change_copy (const MeloPlaylistChange *change);
+void melo_playlist_change_free (MeloPlaylistChange *change);
+
+MeloPlaylistChanges *melo_playlist_changes_new (void);
+void melo_playlist_changes_free (MeloPlaylistChanges *changes);
 
 MeloPlaylistItem *melo_playlist_item_new (const gchar *id,
                                           const gchar *name,
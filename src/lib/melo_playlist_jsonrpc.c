@@ -29,16 +29,6 @@
  * Helper which implements all basic JSON-RPC methods for #MeloPlaylist.
  */
 
-typedef enum {
-  MELO_PLAYLIST_JSONRPC_LIST_FIELDS_NONE = 0,
-  MELO_PLAYLIST_JSONRPC_LIST_FIELDS_ID = 1,
-  MELO_PLAYLIST_JSONRPC_LIST_FIELDS_NAME = 2,
-  MELO_PLAYLIST_JSONRPC_LIST_FIELDS_CMDS = 4,
-  MELO_PLAYLIST_JSONRPC_LIST_FIELDS_TAGS = 8,
-
-  MELO_PLAYLIST_JSONRPC_LIST_FIELDS_FULL = ~0,
-} MeloPlaylistJSONRPCListFields;
-
 static MeloPlaylist *
 melo_playlist_jsonrpc_get_playlist (JsonObject *obj, JsonNode **error)
 {
@@ -99,6 +89,32 @@ melo_playlist_jsonrpc_get_list_fields (JsonObject *obj)
   return fields;
 }
 
+static JsonObject *
+melo_playlist_jsonrpc_item_to_object (const MeloPlaylistItem *item,
+                                      MeloPlaylistJSONRPCListFields fields,
+                                      MeloTagsFields tags_fields)
+{
+  JsonObject *obj = json_object_new ();
+
+  if (fields & MELO_PLAYLIST_JSONRPC_LIST_FIELDS_ID)
+    json_object_set_string_member (obj, "id", item->id);
+  if (fields & MELO_PLAYLIST_JSONRPC_LIST_FIELDS_NAME)
+    json_object_set_string_member (obj, "name", item->name);
+  if (fields & MELO_PLAYLIST_JSONRPC_LIST_FIELDS_CMDS) {
+    json_object_set_boolean_member (obj, "can_play", item->can_play);
+    json_object_set_boolean_member (obj, "can_remove", item->can_remove);
+  }
+  if (fields & MELO_PLAYLIST_JSONRPC_LIST_FIELDS_TAGS) {
+    if (item->tags) {
+      JsonObject *tags = melo_tags_get_json_object (item->tags, tags_fields);
+      json_object_set_object_member (obj, "tags", tags);
+    } else
+      json_object_set_null_member (obj, "tags");
+  }
+
+  return obj;
+}
+
 JsonArray *
 melo_playlist_jsonrpc_list_to_array (const GList *list,
                                      MeloPlaylistJSONRPCListFields fields,
@@ -111,28 +127,76 @@ melo_playlist_jsonrpc_list_to_array (const GList *list,
   array = json_array_new ();
   for (l = list; l != NULL; l = l->next) {
     MeloPlaylistItem *item = (MeloPlaylistItem *) l->data;
-    JsonObject *obj = json_object_new ();
-    if (fields & MELO_PLAYLIST_JSONRPC_LIST_FIELDS_ID)
-      json_object_set_string_member (obj, "id", item->id);
-    if (fields & MELO_PLAYLIST_JSONRPC_LIST_FIELDS_NAME)
-      json_object_set_string_member (obj, "name", item->name);
-    if (fields & MELO_PLAYLIST_JSONRPC_LIST_FIELDS_CMDS) {
-      json_object_set_boolean_member (obj, "can_play", item->can_play);
-      json_object_set_boolean_member (obj, "can_remove", item->can_remove);
-    }
-    if (fields & MELO_PLAYLIST_JSONRPC_LIST_FIELDS_TAGS) {
-      if (item->tags) {
-        JsonObject *tags = melo_tags_to_json_object (item->tags, tags_fields);
-        json_object_set_object_member (obj, "tags", tags);
-      } else
-        json_object_set_null_member (obj, "tags");
-    }
-    json_array_add_object_element (array, obj);
+    json_array_add_object_element (array,
+                                   melo_playlist_jsonrpc_item_to_object (item,
+                                                                  fields,
+                                                                  tags_fields));
   }
 
   return array;
 }
 
+static const gchar *melo_playlist_jsonrpc_change_types[] = {
+  [MELO_PLAYLIST_CHANGE_INSERT] = "insert",
+  [MELO_PLAYLIST_CHANGE_REMOVE] = "remove",
+  [MELO_PLAYLIST_CHANGE_MOVE] = "move",
+  [MELO_PLAYLIST_CHANGE_UPDATE] = "update",
+};
+
+/**
+ * melo_playlist_jsonrpc_change_to_object:
+ * @change: the #MeloPlaylistChange to convert
+ * @fields: the #MeloPlaylistJSONRPCListFields to fill for inserted or updated
+ *    media
+ * @tags_fields: the #MeloTagsFields to fill for inserted or updated media
+ *
+ * Generate a #JsonObject from a #MeloPlaylistChange.
+ *
+ * Returns: (transfer full): a new #JsonObject describing the change.
+ */
+JsonObject *
+melo_playlist_jsonrpc_change_to_object (const MeloPlaylistChange *change,
+                                        MeloPlaylistJSONRPCListFields fields,
+                                        MeloTagsFields tags_fields)
+{
+  JsonObject *obj = json_object_new ();
+
+  json_object_set_string_member (obj, "op",
+                              melo_playlist_jsonrpc_change_types[change->type]);
+  json_object_set_int_member (obj, "revision", change->revision);
+  json_object_set_string_member (obj, "media_id", change->id);
+  json_object_set_int_member (obj, "position", change->position);
+  if (change->type == MELO_PLAYLIST_CHANGE_MOVE)
+    json_object_set_int_member (obj, "count", change->count);
+  if (change->item)
+    json_object_set_object_member (obj, "item",
+                                   melo_playlist_jsonrpc_item_to_object (
+                                                                  change->item,
+                                                                  fields,
+                                                                  tags_fields));
+
+  return obj;
+}
+
+static JsonArray *
+melo_playlist_jsonrpc_changes_to_array (const GList *list,
+                                        MeloPlaylistJSONRPCListFields fields,
+                                        MeloTagsFields tags_fields)
+{
+  JsonArray *array;
+  const GList *l;
+
+  /* Parse changes and create array */
+  array = json_array_new ();
+  for (l = list; l != NULL; l = l->next)
+    json_array_add_object_element (array,
+                           melo_playlist_jsonrpc_change_to_object (l->data,
+                                                                   fields,
+                                                                   tags_fields));
+
+  return array;
+}
+
 /* Method callbacks */
 static void
 melo_playlist_jsonrpc_get_list (const gchar *method,
@@ -146,6 +210,7 @@ melo_playlist_jsonrpc_get_list (const gchar *method,
   JsonArray *array;
   JsonObject *obj;
   MeloPlaylistList *list;
+  gint offset = 0, count = -1;
 
   /* Get parameters */
   obj = melo_jsonrpc_get_object (s_params, params, error);
@@ -170,8 +235,14 @@ melo_playlist_jsonrpc_get_list (const gchar *method,
       tags_fields = melo_tags_get_fields_from_json_array (array);
   }
 
+  /* Get optional window */
+  if (json_object_has_member (obj, "offset"))
+    offset = json_object_get_int_member (obj, "offset");
+  if (json_object_has_member (obj, "count"))
+    count = json_object_get_int_member (obj, "count");
+
   /* Get list */
-  list = melo_playlist_get_list (plist, tags_fields);
+  list = melo_playlist_get_list (plist, offset, count, tags_fields);
   json_object_unref (obj);
   g_object_unref (plist);
 
@@ -185,6 +256,9 @@ melo_playlist_jsonrpc_get_list (const gchar *method,
   /* Create a new object */
   obj = json_object_new ();
   json_object_set_string_member (obj, "current", list->current);
+  json_object_set_int_member (obj, "revision", list->revision);
+  json_object_set_int_member (obj, "offset", list->offset);
+  json_object_set_int_member (obj, "total", list->total);
 
   /* Create array from list */
   array = melo_playlist_jsonrpc_list_to_array (list->items, fields,
@@ -199,6 +273,73 @@ melo_playlist_jsonrpc_get_list (const gchar *method,
   json_node_take_object (*result, obj);
 }
 
+static void
+melo_playlist_jsonrpc_get_changes (const gchar *method,
+                                   JsonArray *s_params, JsonNode *params,
+                                   JsonNode **result, JsonNode **error,
+                                   gpointer user_data)
+{
+  MeloPlaylistJSONRPCListFields fields = MELO_PLAYLIST_JSONRPC_LIST_FIELDS_NONE;
+  MeloTagsFields tags_fields = MELO_TAGS_FIELDS_NONE;
+  MeloPlaylistChanges *changes;
+  MeloPlaylist *plist;
+  JsonArray *array;
+  JsonObject *obj;
+  guint since;
+
+  /* Get parameters */
+  obj = melo_jsonrpc_get_object (s_params, params, error);
+  if (!obj)
+    return;
+
+  /* Get playlist from ID */
+  plist = melo_playlist_jsonrpc_get_playlist (obj, error);
+  if (!plist) {
+    json_object_unref (obj);
+    return;
+  }
+
+  /* Get revision and fields of inserted / updated medias */
+  since = json_object_get_int_member (obj, "since");
+  fields = melo_playlist_jsonrpc_get_list_fields (obj);
+  if (fields & MELO_PLAYLIST_JSONRPC_LIST_FIELDS_TAGS &&
+      json_object_has_member (obj, "tags_fields")) {
+    array = json_object_get_array_member (obj, "tags_fields");
+    if (array)
+      tags_fields = melo_tags_get_fields_from_json_array (array);
+  }
+
+  /* Get changes */
+  changes = melo_playlist_get_changes (plist, since);
+  json_object_unref (obj);
+  g_object_unref (plist);
+
+  /* No changes provided */
+  if (!changes) {
+    *error = melo_jsonrpc_build_error_node (MELO_JSONRPC_ERROR_INVALID_REQUEST,
+                                            "Method not available!");
+    return;
+  }
+
+  /* Create a new object */
+  obj = json_object_new ();
+  json_object_set_string_member (obj, "current", changes->current);
+  json_object_set_int_member (obj, "revision", changes->revision);
+  json_object_set_boolean_member (obj, "reset", changes->reset);
+
+  /* Create array from changes */
+  array = melo_playlist_jsonrpc_changes_to_array (changes->changes, fields,
+                                                  tags_fields);
+  json_object_set_array_member (obj, "changes", array);
+
+  /* Free playlist changes */
+  melo_playlist_changes_free (changes);
+
+  /* Return object */
+  *result = json_node_new (JSON_NODE_OBJECT);
+  json_node_take_object (*result, obj);
+}
+
 static void
 melo_playlist_jsonrpc_get_tags (const gchar *method,
                                 JsonArray *s_params, JsonNode *params,
@@ -241,7 +382,7 @@ melo_playlist_jsonrpc_get_tags (const gchar *method,
   g_object_unref (plist);
 
   /* Parse list and create array */
-  obj = melo_tags_to_json_object (tags, fields);
+  obj = melo_tags_get_json_object (tags, fields);
   melo_tags_unref (tags);
 
   /* Return object */
@@ -434,6 +575,49 @@ melo_playlist_jsonrpc_empty (const gchar *method,
   json_node_take_object (*result, obj);
 }
 
+static void
+melo_playlist_jsonrpc_shuffle (const gchar *method,
+                               JsonArray *s_params, JsonNode *params,
+                               JsonNode **result, JsonNode **error,
+                               gpointer user_data)
+{
+  MeloPlaylist *plist;
+  JsonObject *obj;
+  gboolean enable, ret;
+
+  /* Get parameters */
+  obj = melo_jsonrpc_get_object (s_params, params, error);
+  if (!obj)
+    return;
+
+  /* Get playlist from ID */
+  plist = melo_playlist_jsonrpc_get_playlist (obj, error);
+  if (!plist) {
+    json_object_unref (obj);
+    return;
+  }
+
+  /* Set or get shuffle play order */
+  if (g_str_equal (method, "playlist.set_shuffle")) {
+    enable = json_object_get_boolean_member (obj, "shuffle");
+    ret = melo_playlist_set_shuffle (plist, enable);
+  } else
+    ret = melo_playlist_get_shuffle (plist);
+  json_object_unref (obj);
+  g_object_unref (plist);
+
+  /* Create result object */
+  obj = json_object_new ();
+  if (g_str_equal (method, "playlist.set_shuffle"))
+    json_object_set_boolean_member (obj, "done", ret);
+  else
+    json_object_set_boolean_member (obj, "shuffle", ret);
+
+  /* Return array */
+  *result = json_node_new (JSON_NODE_OBJECT);
+  json_node_take_object (*result, obj);
+}
+
 /* List of methods */
 static MeloJSONRPCMethod melo_playlist_jsonrpc_methods[] = {
   {
@@ -447,11 +631,39 @@ static MeloJSONRPCMethod melo_playlist_jsonrpc_methods[] = {
               "  {"
               "    \"name\": \"tags_fields\", \"type\": \"array\","
               "    \"required\": false"
+              "  },"
+              "  {"
+              "    \"name\": \"offset\", \"type\": \"integer\","
+              "    \"required\": false"
+              "  },"
+              "  {"
+              "    \"name\": \"count\", \"type\": \"integer\","
+              "    \"required\": false"
               "  }"
               "]",
     .result = "{\"type\":\"object\"}",
     .callback = melo_playlist_jsonrpc_get_list,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONCURRENT,
+  },
+  {
+    .method = "get_changes",
+    .params = "["
+              "  {\"name\": \"id\", \"type\": \"string\"},"
+              "  {\"name\": \"since\", \"type\": \"integer\"},"
+              "  {"
+              "    \"name\": \"fields\", \"type\": \"array\","
+              "    \"required\": false"
+              "  },"
+              "  {"
+              "    \"name\": \"tags_fields\", \"type\": \"array\","
+              "    \"required\": false"
+              "  }"
+              "]",
+    .result = "{\"type\":\"object\"}",
+    .callback = melo_playlist_jsonrpc_get_changes,
+    .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONCURRENT,
   },
   {
     .method = "get_tags",
@@ -466,6 +678,7 @@ static MeloJSONRPCMethod melo_playlist_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_playlist_jsonrpc_get_tags,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONCURRENT | MELO_JSONRPC_FLAGS_BULK,
   },
   {
     .method = "play",
@@ -476,6 +689,7 @@ static MeloJSONRPCMethod melo_playlist_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_playlist_jsonrpc_item_action,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONTROL,
   },
   {
     .method = "sort",
@@ -509,6 +723,7 @@ static MeloJSONRPCMethod melo_playlist_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_playlist_jsonrpc_move,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONTROL,
   },
   {
     .method = "move_to",
@@ -524,6 +739,7 @@ static MeloJSONRPCMethod melo_playlist_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_playlist_jsonrpc_move,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONTROL,
   },
   {
     .method = "remove",
@@ -534,6 +750,7 @@ static MeloJSONRPCMethod melo_playlist_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_playlist_jsonrpc_item_action,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONTROL,
   },
   {
     .method = "empty",
@@ -543,6 +760,28 @@ static MeloJSONRPCMethod melo_playlist_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_playlist_jsonrpc_empty,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONTROL,
+  },
+  {
+    .method = "set_shuffle",
+    .params = "["
+              "  {\"name\": \"id\", \"type\": \"string\"},"
+              "  {\"name\": \"shuffle\", \"type\": \"boolean\"}"
+              "]",
+    .result = "{\"type\":\"object\"}",
+    .callback = melo_playlist_jsonrpc_shuffle,
+    .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONTROL,
+  },
+  {
+    .method = "get_shuffle",
+    .params = "["
+              "  {\"name\": \"id\", \"type\": \"string\"}"
+              "]",
+    .result = "{\"type\":\"object\"}",
+    .callback = melo_playlist_jsonrpc_shuffle,
+    .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONCURRENT | MELO_JSONRPC_FLAGS_CONTROL,
   },
 };
 
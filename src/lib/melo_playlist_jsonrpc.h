@@ -25,6 +25,35 @@
 #include "melo_playlist.h"
 #include "melo_jsonrpc.h"
 
+/**
+ * MeloPlaylistJSONRPCListFields:
+ * @MELO_PLAYLIST_JSONRPC_LIST_FIELDS_NONE: get nothing
+ * @MELO_PLAYLIST_JSONRPC_LIST_FIELDS_ID: get media ID
+ * @MELO_PLAYLIST_JSONRPC_LIST_FIELDS_NAME: get media display name
+ * @MELO_PLAYLIST_JSONRPC_LIST_FIELDS_CMDS: get available commands (play and
+ *    remove)
+ * @MELO_PLAYLIST_JSONRPC_LIST_FIELDS_TAGS: get media tags
+ * @MELO_PLAYLIST_JSONRPC_LIST_FIELDS_FULL: get everything
+ *
+ * MeloPlaylistJSONRPCListFields is a bit field to list which details must be
+ * filled in the #JsonObject generated from a #MeloPlaylistItem.
+ */
+typedef enum {
+  MELO_PLAYLIST_JSONRPC_LIST_FIELDS_NONE = 0,
+  MELO_PLAYLIST_JSONRPC_LIST_FIELDS_ID = 1,
+  MELO_PLAYLIST_JSONRPC_LIST_FIELDS_NAME = 2,
+  MELO_PLAYLIST_JSONRPC_LIST_FIELDS_CMDS = 4,
+  MELO_PLAYLIST_JSONRPC_LIST_FIELDS_TAGS = 8,
+
+  MELO_PLAYLIST_JSONRPC_LIST_FIELDS_FULL = ~0,
+} MeloPlaylistJSONRPCListFields;
+
+/* JSON-RPC helpers */
+JsonObject *melo_playlist_jsonrpc_change_to_object (
+                                        const MeloPlaylistChange *change,
+                                        MeloPlaylistJSONRPCListFields fields,
+                                        MeloTagsFields tags_fields);
+
 /* JSON-RPC methods */
 void melo_playlist_jsonrpc_register_methods (void);
 void melo_playlist_jsonrpc_unregister_methods (void);
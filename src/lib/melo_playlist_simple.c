@@ -19,8 +19,10 @@
  * Boston, MA  02110-1301, USA.
  */
 
+#include <stdio.h>
 #include <string.h>
 
+#include "melo_event.h"
 #include "melo_player.h"
 #include "melo_playlist_simple.h"
 
@@ -31,25 +33,52 @@
  *
  * #MeloPlaylistSimple is a basic implementation of a #MeloPlaylist with most
  * common needs for playlist handling.
- * It uses a simple internal #GList of #MeloPlaylistItem to handle the media
- * list and provide the list through melo_playlist_get_list() faster.
+ * It stores the #MeloPlaylistItem in a tree ordered by position (a treap with
+ * sub-tree sizes), so finding, adding, removing and moving medias stay in
+ * logarithmic time, even with very long playlists.
+ * Each modification increments the playlist revision and is kept in a short
+ * log, used by melo_playlist_get_changes(). It is also sent as a
+ * #MELO_EVENT_PLAYLIST_CHANGE event, once the playlist is unlocked.
  *
  * The default behavior can be controlled with #MeloPlaylistSimple:playable and
  * #MeloPlaylistSimple:removable which respectively indicates if a media can be
  * played (with the associated #MeloPlayer) or if a media can be removed from
  * the playlist.
+ *
+ * A playlist can be saved on disk with melo_playlist_simple_set_persist(): the
+ * modifications are appended to a journal file, which is regularly compacted
+ * into a binary snapshot of the whole playlist. Both files are memory-mapped
+ * to restore the playlist quickly at startup, without discovering the tags of
+ * each media again.
+ *
+ * The medias to play can also be provided progressively by a feed function set
+ * with melo_playlist_simple_set_feed(): only a short window of medias after
+ * the current one is added to the playlist, and more medias are requested when
+ * the playback comes close to its end. It is convenient to play a long
+ * list of results from a database query.
  */
 
-#define MELO_PLAYLIST_SIMPLE_ID_EXT_SIZE 10
+#define MELO_PLAYLIST_SIMPLE_CHANGES_MAX 512
+#define MELO_PLAYLIST_SIMPLE_FEED_WINDOW 64
+
+#define MELO_PLAYLIST_SIMPLE_PERSIST_MAGIC 0x534c504d
+#define MELO_PLAYLIST_SIMPLE_PERSIST_VERSION 1
+#define MELO_PLAYLIST_SIMPLE_PERSIST_RECORDS_MAX 1024
 
 static MeloPlaylistList *melo_playlist_simple_get_list (MeloPlaylist *playlist,
+                                                    gint offset, gint count,
                                                     MeloTagsFields tags_fields);
+static MeloPlaylistChanges *melo_playlist_simple_get_changes (
+                                                         MeloPlaylist *playlist,
+                                                         guint since);
 static MeloTags *melo_playlist_simple_get_tags (MeloPlaylist *playlist,
                                                 const gchar *id,
                                                 MeloTagsFields fields);
 static gboolean melo_playlist_simple_add (MeloPlaylist *playlist,
                                           const gchar *path, const gchar *name,
                                           MeloTags *tags, gboolean is_current);
+static gboolean melo_playlist_simple_add_many (MeloPlaylist *playlist,
+                                               GList *items);
 static gchar *melo_playlist_simple_get_prev (MeloPlaylist *playlist,
                                              gchar **id, MeloTags **tags,
                                              gboolean set);
@@ -58,8 +87,13 @@ static gchar *melo_playlist_simple_get_next (MeloPlaylist *playlist,
                                              gboolean set);
 static gboolean melo_playlist_simple_has_prev (MeloPlaylist *playlist);
 static gboolean melo_playlist_simple_has_next (MeloPlaylist *playlist);
+static gboolean melo_playlist_simple_set_shuffle (MeloPlaylist *playlist,
+                                                  gboolean enable);
+static gboolean melo_playlist_simple_get_shuffle (MeloPlaylist *playlist);
 static gboolean melo_playlist_simple_play (MeloPlaylist *playlist,
                                            const gchar *id);
+static gboolean melo_playlist_simple_set_current (MeloPlaylist *playlist,
+                                                  const gchar *id);
 static gboolean melo_playlist_simple_sort (MeloPlaylist *playlist,
                                            const gchar *id, guint count,
                                            MeloSort sort);
@@ -73,6 +107,9 @@ static gboolean melo_playlist_simple_remove (MeloPlaylist *playlist,
                                              const gchar *id);
 static void melo_playlist_simple_empty (MeloPlaylist *playlist);
 
+static void melo_playlist_simple_feed (MeloPlaylistSimplePrivate *priv);
+static void melo_playlist_simple_feed_clear (MeloPlaylistSimplePrivate *priv);
+
 static void melo_playlist_simple_set_property (GObject *object,
                                                guint property_id,
                                                const GValue *value,
@@ -88,17 +125,798 @@ enum {
   PROP_LAST
 };
 
+typedef struct _MeloPlaylistSimpleNode MeloPlaylistSimpleNode;
+
+struct _MeloPlaylistSimpleNode {
+  MeloPlaylistItem *item;
+  MeloPlaylistSimpleNode *parent;
+  MeloPlaylistSimpleNode *left;
+  MeloPlaylistSimpleNode *right;
+  guint32 priority;
+  guint size;
+  GSequenceIter *shuffle;
+};
+
 struct _MeloPlaylistSimplePrivate {
   GMutex mutex;
-  GList *playlist;
+  MeloPlaylistSimpleNode *playlist;
   GHashTable *ids;
-  GList *current;
+  GHashTable *suffixes;
+  MeloPlaylistSimpleNode *current;
   gboolean playable;
   gboolean removable;
+
+  /* Shuffle play order */
+  GSequence *shuffle;
+
+  /* Changes log */
+  guint revision;
+  guint changes_base;
+  GQueue changes;
+
+  /* Pending events */
+  GRecMutex events_mutex;
+  GList *events;
+  gboolean events_reset;
+  guint events_revision;
+
+  /* Persistence */
+  gchar *persist_file;
+  gchar *persist_log;
+  GString *persist_journal;
+  guint persist_records;
+  guint persist_generation;
+  gboolean persist_compact;
+
+  /* Feed of next medias */
+  MeloPlaylistSimpleFeedFunc feed_func;
+  gpointer feed_data;
+  GDestroyNotify feed_destroy;
+  guint feed_offset;
 };
 
+typedef struct {
+  const gchar *data;
+  gsize size;
+  gsize pos;
+} MeloPlaylistSimpleReader;
+
 G_DEFINE_TYPE_WITH_PRIVATE (MeloPlaylistSimple, melo_playlist_simple, MELO_TYPE_PLAYLIST)
 
+/*
+ * The playlist is an implicit treap: nodes are ordered by their position in
+ * the playlist (first node is the last added media) and each node stores the
+ * size of its sub-tree. The parent pointer is used to find the position of a
+ * node returned by the IDs hash table.
+ *
+ * When shuffle is enabled, the play order is kept in a separated sequence of
+ * nodes, so the list itself is never reordered: the medias before the current
+ * one are already played and new medias are inserted randomly after it.
+ */
+
+static inline guint
+melo_playlist_simple_node_size (MeloPlaylistSimpleNode *node)
+{
+  return node ? node->size : 0;
+}
+
+static inline void
+melo_playlist_simple_node_update (MeloPlaylistSimpleNode *node)
+{
+  node->size = 1 + melo_playlist_simple_node_size (node->left) +
+               melo_playlist_simple_node_size (node->right);
+  if (node->left)
+    node->left->parent = node;
+  if (node->right)
+    node->right->parent = node;
+}
+
+static MeloPlaylistSimpleNode *
+melo_playlist_simple_node_new (MeloPlaylistItem *item)
+{
+  MeloPlaylistSimpleNode *node;
+
+  node = g_slice_new0 (MeloPlaylistSimpleNode);
+  node->item = item;
+  node->priority = g_random_int ();
+  node->size = 1;
+
+  return node;
+}
+
+static void
+melo_playlist_simple_node_free (MeloPlaylistSimpleNode *node)
+{
+  if (!node)
+    return;
+
+  melo_playlist_simple_node_free (node->left);
+  melo_playlist_simple_node_free (node->right);
+  melo_playlist_item_unref (node->item);
+  g_slice_free (MeloPlaylistSimpleNode, node);
+}
+
+/* Concatenate two trees */
+static MeloPlaylistSimpleNode *
+melo_playlist_simple_node_merge (MeloPlaylistSimpleNode *left,
+                                 MeloPlaylistSimpleNode *right)
+{
+  MeloPlaylistSimpleNode *root;
+
+  if (!left || !right)
+    root = left ? left : right;
+  else if (left->priority > right->priority) {
+    left->right = melo_playlist_simple_node_merge (left->right, right);
+    root = left;
+  } else {
+    right->left = melo_playlist_simple_node_merge (left, right->left);
+    root = right;
+  }
+
+  if (root) {
+    melo_playlist_simple_node_update (root);
+    root->parent = NULL;
+  }
+
+  return root;
+}
+
+/* Split a tree: the first nodes (up to index) are put in left tree */
+static void
+melo_playlist_simple_node_split (MeloPlaylistSimpleNode *node, guint index,
+                                 MeloPlaylistSimpleNode **left,
+                                 MeloPlaylistSimpleNode **right)
+{
+  guint size;
+
+  if (!node) {
+    *left = *right = NULL;
+    return;
+  }
+
+  size = melo_playlist_simple_node_size (node->left);
+  if (size < index) {
+    melo_playlist_simple_node_split (node->right, index - size - 1,
+                                     &node->right, right);
+    *left = node;
+  } else {
+    melo_playlist_simple_node_split (node->left, index, left, &node->left);
+    *right = node;
+  }
+
+  melo_playlist_simple_node_update (node);
+  node->parent = NULL;
+  if (*left)
+    (*left)->parent = NULL;
+  if (*right)
+    (*right)->parent = NULL;
+}
+
+static guint
+melo_playlist_simple_node_index (MeloPlaylistSimpleNode *node)
+{
+  guint index;
+
+  index = melo_playlist_simple_node_size (node->left);
+  for (; node->parent; node = node->parent)
+    if (node == node->parent->right)
+      index += melo_playlist_simple_node_size (node->parent->left) + 1;
+
+  return index;
+}
+
+static MeloPlaylistSimpleNode *
+melo_playlist_simple_node_nth (MeloPlaylistSimpleNode *node, guint index)
+{
+  guint size;
+
+  while (node) {
+    size = melo_playlist_simple_node_size (node->left);
+    if (index == size)
+      break;
+    if (index < size)
+      node = node->left;
+    else {
+      index -= size + 1;
+      node = node->right;
+    }
+  }
+
+  return node;
+}
+
+/* Get node of the older media added just before */
+static MeloPlaylistSimpleNode *
+melo_playlist_simple_node_next (MeloPlaylistSimpleNode *node)
+{
+  if (!node)
+    return NULL;
+
+  if (node->right) {
+    for (node = node->right; node->left; node = node->left);
+    return node;
+  }
+  while (node->parent && node == node->parent->right)
+    node = node->parent;
+
+  return node->parent;
+}
+
+/* Get node of the newer media added just after */
+static MeloPlaylistSimpleNode *
+melo_playlist_simple_node_prev (MeloPlaylistSimpleNode *node)
+{
+  if (!node)
+    return NULL;
+
+  if (node->left) {
+    for (node = node->left; node->right; node = node->right);
+    return node;
+  }
+  while (node->parent && node == node->parent->left)
+    node = node->parent;
+
+  return node->parent;
+}
+
+/* Get node of the media to play before current one */
+static MeloPlaylistSimpleNode *
+melo_playlist_simple_get_prev_node (MeloPlaylistSimplePrivate *priv)
+{
+  if (!priv->current)
+    return NULL;
+
+  /* Use shuffle play order */
+  if (priv->shuffle) {
+    if (g_sequence_iter_is_begin (priv->current->shuffle))
+      return NULL;
+    return g_sequence_get (g_sequence_iter_prev (priv->current->shuffle));
+  }
+
+  return melo_playlist_simple_node_next (priv->current);
+}
+
+/* Get node of the media to play after current one */
+static MeloPlaylistSimpleNode *
+melo_playlist_simple_get_next_node (MeloPlaylistSimplePrivate *priv)
+{
+  GSequenceIter *iter;
+
+  if (!priv->current)
+    return NULL;
+
+  /* Use shuffle play order */
+  if (priv->shuffle) {
+    iter = g_sequence_iter_next (priv->current->shuffle);
+    return g_sequence_iter_is_end (iter) ? NULL : g_sequence_get (iter);
+  }
+
+  return melo_playlist_simple_node_prev (priv->current);
+}
+
+/* Insert a new node at a random position after current in shuffle order */
+static void
+melo_playlist_simple_shuffle_insert (MeloPlaylistSimplePrivate *priv,
+                                     MeloPlaylistSimpleNode *node)
+{
+  gint start, pos;
+
+  if (!priv->shuffle)
+    return;
+
+  start = priv->current ?
+          g_sequence_iter_get_position (priv->current->shuffle) + 1 : 0;
+  pos = g_random_int_range (start, g_sequence_get_length (priv->shuffle) + 1);
+  node->shuffle = g_sequence_insert_before (
+                         g_sequence_get_iter_at_pos (priv->shuffle, pos), node);
+}
+
+static GList *
+melo_playlist_simple_node_to_list (MeloPlaylistSimpleNode *node, GList *list)
+{
+  if (!node)
+    return list;
+
+  /* Prepend items from last to first */
+  list = melo_playlist_simple_node_to_list (node->right, list);
+  list = g_list_prepend (list, node->item);
+  return melo_playlist_simple_node_to_list (node->left, list);
+}
+
+/* Must be called with playlist locked */
+static MeloPlaylistSimpleNode *
+melo_playlist_simple_cut (MeloPlaylistSimplePrivate *priv, guint index,
+                          guint count)
+{
+  MeloPlaylistSimpleNode *left, *middle, *right;
+
+  melo_playlist_simple_node_split (priv->playlist, index, &left, &right);
+  melo_playlist_simple_node_split (right, count, &middle, &right);
+  priv->playlist = melo_playlist_simple_node_merge (left, right);
+
+  return middle;
+}
+
+/* Must be called with playlist locked */
+static void
+melo_playlist_simple_insert (MeloPlaylistSimplePrivate *priv, guint index,
+                             MeloPlaylistSimpleNode *node)
+{
+  MeloPlaylistSimpleNode *left, *right;
+
+  melo_playlist_simple_node_split (priv->playlist, index, &left, &right);
+  left = melo_playlist_simple_node_merge (left, node);
+  priv->playlist = melo_playlist_simple_node_merge (left, right);
+}
+
+/* Must be called with playlist locked */
+static MeloPlaylistSimpleNode *
+melo_playlist_simple_add_node (MeloPlaylistSimplePrivate *priv,
+                               MeloPlaylistItem *item, guint index)
+{
+  MeloPlaylistSimpleNode *node;
+
+  /* Media ID already used */
+  if (g_hash_table_lookup (priv->ids, item->id)) {
+    melo_playlist_item_unref (item);
+    return NULL;
+  }
+
+  /* Insert a new node for item */
+  node = melo_playlist_simple_node_new (item);
+  melo_playlist_simple_insert (priv, index, node);
+  g_hash_table_insert (priv->ids, item->id, node);
+  melo_playlist_simple_shuffle_insert (priv, node);
+
+  return node;
+}
+
+/* Must be called with playlist locked */
+static void
+melo_playlist_simple_remove_node (MeloPlaylistSimplePrivate *priv,
+                                  MeloPlaylistSimpleNode *node)
+{
+  /* Remove from list, hash table and shuffle order */
+  node = melo_playlist_simple_cut (priv, melo_playlist_simple_node_index (node),
+                                   1);
+  g_hash_table_remove (priv->ids, node->item->id);
+  if (priv->shuffle)
+    g_sequence_remove (node->shuffle);
+  melo_playlist_simple_node_free (node);
+}
+
+static inline void
+melo_playlist_simple_put_uint (GString *buf, guint32 val)
+{
+  g_string_append_len (buf, (const gchar *) &val, sizeof (val));
+}
+
+static void
+melo_playlist_simple_put_string (GString *buf, const gchar *str)
+{
+  guint32 len = str ? strlen (str) + 1 : 0;
+
+  /* Length includes the nul character: 0 is used for a NULL string */
+  melo_playlist_simple_put_uint (buf, len);
+  g_string_append_len (buf, str, len);
+}
+
+static void
+melo_playlist_simple_put_item (GString *buf, MeloPlaylistItem *item)
+{
+  MeloTags *tags = item->tags;
+
+  melo_playlist_simple_put_string (buf, item->id);
+  melo_playlist_simple_put_string (buf, item->name);
+  melo_playlist_simple_put_string (buf, item->path);
+
+  /* Save tags: the cover is only saved by its ID */
+  melo_playlist_simple_put_uint (buf, tags != NULL);
+  if (!tags)
+    return;
+  melo_playlist_simple_put_string (buf, tags->title);
+  melo_playlist_simple_put_string (buf, tags->artist);
+  melo_playlist_simple_put_string (buf, tags->album);
+  melo_playlist_simple_put_string (buf, tags->genre);
+  melo_playlist_simple_put_uint (buf, tags->date);
+  melo_playlist_simple_put_uint (buf, tags->track);
+  melo_playlist_simple_put_uint (buf, tags->tracks);
+  melo_playlist_simple_put_string (buf, tags->cover);
+}
+
+static gboolean
+melo_playlist_simple_get_uint (MeloPlaylistSimpleReader *r, guint32 *val)
+{
+  if (r->size - r->pos < sizeof (*val))
+    return FALSE;
+
+  memcpy (val, r->data + r->pos, sizeof (*val));
+  r->pos += sizeof (*val);
+  return TRUE;
+}
+
+static gboolean
+melo_playlist_simple_get_string (MeloPlaylistSimpleReader *r,
+                                 const gchar **str)
+{
+  guint32 len;
+
+  /* String is used directly from mapped file */
+  if (!melo_playlist_simple_get_uint (r, &len) || r->size - r->pos < len ||
+      (len && r->data[r->pos + len - 1] != '\0'))
+    return FALSE;
+
+  *str = len ? r->data + r->pos : NULL;
+  r->pos += len;
+  return TRUE;
+}
+
+static MeloPlaylistItem *
+melo_playlist_simple_get_item (MeloPlaylistSimplePrivate *priv,
+                               MeloPlaylistSimpleReader *r)
+{
+  const gchar *id, *name, *path, *title, *artist, *album, *genre, *cover;
+  guint32 has_tags, date, track, tracks;
+  MeloPlaylistItem *item;
+  MeloTags *tags = NULL;
+
+  /* Read item */
+  if (!melo_playlist_simple_get_string (r, &id) || !id ||
+      !melo_playlist_simple_get_string (r, &name) ||
+      !melo_playlist_simple_get_string (r, &path) ||
+      !melo_playlist_simple_get_uint (r, &has_tags))
+    return NULL;
+
+  /* Read tags */
+  if (has_tags) {
+    if (!melo_playlist_simple_get_string (r, &title) ||
+        !melo_playlist_simple_get_string (r, &artist) ||
+        !melo_playlist_simple_get_string (r, &album) ||
+        !melo_playlist_simple_get_string (r, &genre) ||
+        !melo_playlist_simple_get_uint (r, &date) ||
+        !melo_playlist_simple_get_uint (r, &track) ||
+        !melo_playlist_simple_get_uint (r, &tracks) ||
+        !melo_playlist_simple_get_string (r, &cover))
+      return NULL;
+
+    tags = melo_tags_new ();
+    tags->title = melo_tags_intern_string (title);
+    tags->artist = melo_tags_intern_string (artist);
+    tags->album = melo_tags_intern_string (album);
+    tags->genre = melo_tags_intern_string (genre);
+    tags->date = (gint) date;
+    tags->track = track;
+    tags->tracks = tracks;
+    tags->cover = g_strdup (cover);
+  }
+
+  /* Create item */
+  item = melo_playlist_item_new (id, name, path, tags);
+  item->can_play = priv->playable;
+  item->can_remove = priv->removable;
+  if (tags)
+    melo_tags_unref (tags);
+
+  return item;
+}
+
+/* Must be called with playlist locked */
+static void
+melo_playlist_simple_journal (MeloPlaylistSimplePrivate *priv,
+                              MeloPlaylistChangeType type,
+                              MeloPlaylistSimpleNode *node, gint position,
+                              gint count)
+{
+  GString *buf = priv->persist_journal;
+
+  if (!priv->persist_file)
+    return;
+
+  /* Append a record to pending journal */
+  melo_playlist_simple_put_uint (buf, type);
+  melo_playlist_simple_put_string (buf, node->item->id);
+  melo_playlist_simple_put_uint (buf, position);
+  melo_playlist_simple_put_uint (buf, count);
+  if (type == MELO_PLAYLIST_CHANGE_INSERT)
+    melo_playlist_simple_put_item (buf, node->item);
+  priv->persist_records++;
+}
+
+/* Must be called with playlist locked */
+static GString *
+melo_playlist_simple_snapshot (MeloPlaylistSimplePrivate *priv)
+{
+  MeloPlaylistSimpleNode *node;
+  GString *buf;
+
+  /* Add header */
+  buf = g_string_sized_new (4096);
+  melo_playlist_simple_put_uint (buf, MELO_PLAYLIST_SIMPLE_PERSIST_MAGIC);
+  melo_playlist_simple_put_uint (buf, MELO_PLAYLIST_SIMPLE_PERSIST_VERSION);
+  melo_playlist_simple_put_uint (buf, ++priv->persist_generation);
+  melo_playlist_simple_put_uint (buf,
+                               melo_playlist_simple_node_size (priv->playlist));
+  melo_playlist_simple_put_uint (buf, priv->current ?
+                           melo_playlist_simple_node_index (priv->current) :
+                           G_MAXUINT32);
+
+  /* Add all items in playlist order */
+  node = melo_playlist_simple_node_nth (priv->playlist, 0);
+  for (; node; node = melo_playlist_simple_node_next (node))
+    melo_playlist_simple_put_item (buf, node->item);
+
+  /* Journal is now empty */
+  g_string_truncate (priv->persist_journal, 0);
+  priv->persist_records = 0;
+  priv->persist_compact = FALSE;
+
+  return buf;
+}
+
+/* Must be called with playlist unlocked */
+static void
+melo_playlist_simple_persist_write (MeloPlaylistSimplePrivate *priv,
+                                    GString *snapshot, guint generation)
+{
+  GString *header;
+
+  /* Replace snapshot and start a new journal: journal of a previous
+   * generation is ignored at load if the second write fails.
+   */
+  if (g_file_set_contents (priv->persist_file, snapshot->str, snapshot->len,
+                           NULL)) {
+    header = g_string_sized_new (12);
+    melo_playlist_simple_put_uint (header, MELO_PLAYLIST_SIMPLE_PERSIST_MAGIC);
+    melo_playlist_simple_put_uint (header,
+                                   MELO_PLAYLIST_SIMPLE_PERSIST_VERSION);
+    melo_playlist_simple_put_uint (header, generation);
+    g_file_set_contents (priv->persist_log, header->str, header->len, NULL);
+    g_string_free (header, TRUE);
+  }
+  g_string_free (snapshot, TRUE);
+}
+
+/* Must be called with playlist unlocked */
+static void
+melo_playlist_simple_persist_append (MeloPlaylistSimplePrivate *priv,
+                                     GString *journal)
+{
+  FILE *fp;
+
+  /* Append records to journal */
+  fp = fopen (priv->persist_log, "ab");
+  if (fp) {
+    fwrite (journal->str, 1, journal->len, fp);
+    fclose (fp);
+  }
+  g_string_free (journal, TRUE);
+}
+
+/* Must be called with playlist locked */
+static guint
+melo_playlist_simple_restore_snapshot (MeloPlaylistSimplePrivate *priv)
+{
+  MeloPlaylistSimpleReader r;
+  MeloPlaylistSimpleNode *node;
+  MeloPlaylistItem *item;
+  guint32 magic, version, generation = 0, count, current, i;
+  GMappedFile *map;
+
+  /* Map snapshot */
+  map = g_mapped_file_new (priv->persist_file, FALSE, NULL);
+  if (!map)
+    return 0;
+  r.data = g_mapped_file_get_contents (map);
+  r.size = g_mapped_file_get_length (map);
+  r.pos = 0;
+
+  /* Check header */
+  if (!melo_playlist_simple_get_uint (&r, &magic) ||
+      magic != MELO_PLAYLIST_SIMPLE_PERSIST_MAGIC ||
+      !melo_playlist_simple_get_uint (&r, &version) ||
+      version != MELO_PLAYLIST_SIMPLE_PERSIST_VERSION ||
+      !melo_playlist_simple_get_uint (&r, &generation) ||
+      !melo_playlist_simple_get_uint (&r, &count) ||
+      !melo_playlist_simple_get_uint (&r, &current))
+    goto end;
+
+  /* Add items at end of playlist */
+  for (i = 0; i < count; i++) {
+    item = melo_playlist_simple_get_item (priv, &r);
+    if (!item)
+      break;
+    node = melo_playlist_simple_add_node (priv, item,
+                               melo_playlist_simple_node_size (priv->playlist));
+    if (!node)
+      continue;
+    if (i == current)
+      priv->current = node;
+  }
+
+end:
+  g_mapped_file_unref (map);
+  return generation;
+}
+
+/* Must be called with playlist locked */
+static void
+melo_playlist_simple_restore_journal (MeloPlaylistSimplePrivate *priv,
+                                      guint32 generation)
+{
+  MeloPlaylistSimpleReader r;
+  MeloPlaylistSimpleNode *node;
+  MeloPlaylistItem *item;
+  guint32 magic, version, gen, type, position, count, index, size;
+  GMappedFile *map;
+  const gchar *id;
+
+  /* Map journal */
+  map = g_mapped_file_new (priv->persist_log, FALSE, NULL);
+  if (!map)
+    return;
+  r.data = g_mapped_file_get_contents (map);
+  r.size = g_mapped_file_get_length (map);
+  r.pos = 0;
+
+  /* Journal must follow the snapshot */
+  if (!melo_playlist_simple_get_uint (&r, &magic) ||
+      magic != MELO_PLAYLIST_SIMPLE_PERSIST_MAGIC ||
+      !melo_playlist_simple_get_uint (&r, &version) ||
+      version != MELO_PLAYLIST_SIMPLE_PERSIST_VERSION ||
+      !melo_playlist_simple_get_uint (&r, &gen) || gen != generation)
+    goto end;
+
+  /* Replay records until end or first incomplete record */
+  while (melo_playlist_simple_get_uint (&r, &type) &&
+         melo_playlist_simple_get_string (&r, &id) && id &&
+         melo_playlist_simple_get_uint (&r, &position) &&
+         melo_playlist_simple_get_uint (&r, &count)) {
+    size = melo_playlist_simple_node_size (priv->playlist);
+
+    /* Add a new media */
+    if (type == MELO_PLAYLIST_CHANGE_INSERT) {
+      item = melo_playlist_simple_get_item (priv, &r);
+      if (!item)
+        break;
+      melo_playlist_simple_add_node (priv, item, MIN (position, size));
+      continue;
+    }
+
+    /* Find media */
+    node = g_hash_table_lookup (priv->ids, id);
+    if (!node)
+      continue;
+
+    switch (type) {
+      case MELO_PLAYLIST_CHANGE_REMOVE:
+        if (node == priv->current)
+          priv->current = NULL;
+        melo_playlist_simple_remove_node (priv, node);
+        break;
+      case MELO_PLAYLIST_CHANGE_MOVE:
+        index = melo_playlist_simple_node_index (node);
+        count = MIN (count, size - index);
+        node = melo_playlist_simple_cut (priv, index, count);
+        melo_playlist_simple_insert (priv, MIN (position, size - count), node);
+        break;
+      case MELO_PLAYLIST_CHANGE_UPDATE:
+        priv->current = node;
+        break;
+      default:
+        ;
+    }
+  }
+
+end:
+  g_mapped_file_unref (map);
+}
+
+/* Must be called with playlist locked */
+static void
+melo_playlist_simple_log (MeloPlaylistSimplePrivate *priv,
+                          MeloPlaylistChangeType type,
+                          MeloPlaylistSimpleNode *node, gint position,
+                          gint count)
+{
+  MeloPlaylistChange *change;
+
+  /* Add change with a new revision */
+  change = melo_playlist_change_new (type, ++priv->revision, node->item->id,
+                                     position, count,
+                                     type == MELO_PLAYLIST_CHANGE_INSERT ||
+                                     type == MELO_PLAYLIST_CHANGE_UPDATE ?
+                                     node->item : NULL);
+  g_queue_push_tail (&priv->changes, change);
+  priv->events = g_list_prepend (priv->events,
+                                 melo_playlist_change_copy (change));
+
+  /* Save change in journal */
+  melo_playlist_simple_journal (priv, type, node, position, count);
+
+  /* Drop oldest changes */
+  while (g_queue_get_length (&priv->changes) >
+         MELO_PLAYLIST_SIMPLE_CHANGES_MAX) {
+    change = g_queue_pop_head (&priv->changes);
+    priv->changes_base = change->revision;
+    melo_playlist_change_free (change);
+  }
+}
+
+/* Must be called with playlist locked */
+static void
+melo_playlist_simple_log_reset (MeloPlaylistSimplePrivate *priv)
+{
+  MeloPlaylistChange *change;
+
+  /* Clients must get the whole list again */
+  while ((change = g_queue_pop_head (&priv->changes)))
+    melo_playlist_change_free (change);
+  priv->changes_base = ++priv->revision;
+
+  /* Replace pending events by a reset */
+  g_list_free_full (priv->events, (GDestroyNotify) melo_playlist_change_free);
+  priv->events = NULL;
+  priv->events_reset = TRUE;
+  priv->events_revision = priv->revision;
+
+  /* Playlist must be saved entirely */
+  if (priv->persist_file) {
+    g_string_truncate (priv->persist_journal, 0);
+    priv->persist_compact = TRUE;
+  }
+}
+
+/* Must be called with playlist unlocked */
+static void
+melo_playlist_simple_flush (MeloPlaylistSimple *plsimple)
+{
+  MeloPlaylistSimplePrivate *priv = plsimple->priv;
+  const gchar *id = melo_playlist_get_id (MELO_PLAYLIST (plsimple));
+  GString *snapshot = NULL, *journal = NULL;
+  gboolean reset;
+  guint revision, generation;
+  GList *events, *l;
+
+  /* Send events in order of revision */
+  g_rec_mutex_lock (&priv->events_mutex);
+
+  /* Get pending events */
+  g_mutex_lock (&priv->mutex);
+  events = g_list_reverse (priv->events);
+  priv->events = NULL;
+  reset = priv->events_reset;
+  revision = priv->events_revision;
+  priv->events_reset = FALSE;
+
+  /* Get changes to save: journal is compacted when it becomes too long */
+  if (priv->persist_file) {
+    if (priv->persist_compact ||
+        priv->persist_records > MELO_PLAYLIST_SIMPLE_PERSIST_RECORDS_MAX)
+      snapshot = melo_playlist_simple_snapshot (priv);
+    else if (priv->persist_journal->len) {
+      journal = priv->persist_journal;
+      priv->persist_journal = g_string_new (NULL);
+    }
+  }
+  generation = priv->persist_generation;
+  g_mutex_unlock (&priv->mutex);
+
+  /* Save playlist */
+  if (snapshot)
+    melo_playlist_simple_persist_write (priv, snapshot, generation);
+  else if (journal)
+    melo_playlist_simple_persist_append (priv, journal);
+
+  /* Send events */
+  if (reset)
+    melo_event_playlist_reset (id, revision);
+  for (l = events; l; l = l->next)
+    melo_event_playlist_change (id, l->data);
+  g_list_free_full (events, (GDestroyNotify) melo_playlist_change_free);
+
+  g_rec_mutex_unlock (&priv->events_mutex);
+}
+
 static void
 melo_playlist_simple_finalize (GObject *gobject)
 {
@@ -106,15 +924,37 @@ melo_playlist_simple_finalize (GObject *gobject)
   MeloPlaylistSimplePrivate *priv =
                     melo_playlist_simple_get_instance_private (playlist_simple);
 
-  /* Clear mutex */
+  /* Save playlist */
+  if (priv->persist_file) {
+    melo_playlist_simple_persist_write (priv,
+                                        melo_playlist_simple_snapshot (priv),
+                                        priv->persist_generation);
+    g_string_free (priv->persist_journal, TRUE);
+    g_free (priv->persist_log);
+    g_free (priv->persist_file);
+    priv->persist_file = NULL;
+  }
+
+  /* Clear mutexes */
+  g_rec_mutex_clear (&priv->events_mutex);
   g_mutex_clear (&priv->mutex);
 
   /* Free hash table */
   g_hash_table_remove_all (priv->ids);
   g_hash_table_unref (priv->ids);
+  g_hash_table_unref (priv->suffixes);
+
+  /* Free shuffle play order */
+  if (priv->shuffle)
+    g_sequence_free (priv->shuffle);
+
+  /* Release feed */
+  melo_playlist_simple_feed_clear (priv);
 
-  /* Free playlist */
-  g_list_free_full (priv->playlist, (GDestroyNotify) melo_playlist_item_unref);
+  /* Free playlist, changes log and pending events */
+  melo_playlist_simple_node_free (priv->playlist);
+  melo_playlist_simple_log_reset (priv);
+  g_list_free_full (priv->events, (GDestroyNotify) melo_playlist_change_free);
 
   /* Chain up to the parent class */
   G_OBJECT_CLASS (melo_playlist_simple_parent_class)->finalize (gobject);
@@ -127,13 +967,18 @@ melo_playlist_simple_class_init (MeloPlaylistSimpleClass *klass)
   GObjectClass *oclass = G_OBJECT_CLASS (klass);
 
   plclass->get_list = melo_playlist_simple_get_list;
+  plclass->get_changes = melo_playlist_simple_get_changes;
   plclass->get_tags = melo_playlist_simple_get_tags;
   plclass->add = melo_playlist_simple_add;
+  plclass->add_many = melo_playlist_simple_add_many;
   plclass->get_prev = melo_playlist_simple_get_prev;
   plclass->get_next = melo_playlist_simple_get_next;
   plclass->has_prev = melo_playlist_simple_has_prev;
   plclass->has_next = melo_playlist_simple_has_next;
+  plclass->set_shuffle = melo_playlist_simple_set_shuffle;
+  plclass->get_shuffle = melo_playlist_simple_get_shuffle;
   plclass->play = melo_playlist_simple_play;
+  plclass->set_current = melo_playlist_simple_set_current;
   plclass->sort = melo_playlist_simple_sort;
   plclass->move = melo_playlist_simple_move;
   plclass->move_to = melo_playlist_simple_move_to;
@@ -180,11 +1025,19 @@ melo_playlist_simple_init (MeloPlaylistSimple *self)
   priv->playlist = NULL;
   priv->current = NULL;
 
-  /* Init mutex */
+  /* Init mutexes */
   g_mutex_init (&priv->mutex);
+  g_rec_mutex_init (&priv->events_mutex);
 
   /* Init Hash table for IDs */
   priv->ids = g_hash_table_new (g_str_hash, g_str_equal);
+
+  /* Init Hash table for next ID suffix of each duplicated name */
+  priv->suffixes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                          g_free);
+
+  /* Init changes log */
+  g_queue_init (&priv->changes);
 }
 
 static void
@@ -226,55 +1079,101 @@ melo_playlist_simple_get_property (GObject *object, guint property_id,
 }
 
 static MeloPlaylistList *
-melo_playlist_simple_get_list (MeloPlaylist *playlist,
+melo_playlist_simple_get_list (MeloPlaylist *playlist, gint offset, gint count,
                                MeloTagsFields tags_fields)
 {
   MeloPlaylistSimple *plsimple = MELO_PLAYLIST_SIMPLE (playlist);
   MeloPlaylistSimplePrivate *priv = plsimple->priv;
+  MeloPlaylistSimpleNode *node;
   MeloPlaylistList *list;
 
-  /* Create new list */
-  list = melo_playlist_list_new ();
+  /* Create new list: nodes are allocated in one go */
+  list = melo_playlist_list_new_with_arena ();
   if (!list)
     return NULL;
+  if (offset < 0)
+    offset = 0;
 
   /* Lock playlist */
   g_mutex_lock (&priv->mutex);
 
-  /* Copy playlist */
-  list->items = g_list_copy_deep (priv->playlist,
-                                  (GCopyFunc) melo_playlist_item_ref, NULL);
+  /* Get more medias from feed */
+  melo_playlist_simple_feed (priv);
+
+  /* Copy requested part of playlist */
+  node = melo_playlist_simple_node_nth (priv->playlist, offset);
+  for (; node && count; node = melo_playlist_simple_node_next (node), count--)
+    melo_playlist_list_prepend (list, melo_playlist_item_ref (node->item));
+  list->items = g_list_reverse (list->items);
+  list->offset = offset;
+  list->total = melo_playlist_simple_node_size (priv->playlist);
+  list->revision = priv->revision;
   if (priv->current)
-    list->current = g_strdup (((MeloPlaylistItem *) priv->current->data)->id);
+    list->current = melo_playlist_list_strdup (list, priv->current->item->id);
 
   /* Unlock playlist */
   g_mutex_unlock (&priv->mutex);
 
+  /* Send playlist events */
+  melo_playlist_simple_flush (plsimple);
+
   return list;
 }
 
+static MeloPlaylistChanges *
+melo_playlist_simple_get_changes (MeloPlaylist *playlist, guint since)
+{
+  MeloPlaylistSimple *plsimple = MELO_PLAYLIST_SIMPLE (playlist);
+  MeloPlaylistSimplePrivate *priv = plsimple->priv;
+  MeloPlaylistChanges *changes;
+  GList *l;
+
+  /* Create new changes list */
+  changes = melo_playlist_changes_new ();
+  if (!changes)
+    return NULL;
+
+  /* Lock playlist */
+  g_mutex_lock (&priv->mutex);
+
+  /* Copy changes done after revision */
+  if (since >= priv->changes_base && since <= priv->revision) {
+    for (l = priv->changes.tail; l; l = l->prev) {
+      MeloPlaylistChange *change = l->data;
+
+      if (change->revision <= since)
+        break;
+      changes->changes = g_list_prepend (changes->changes,
+                                         melo_playlist_change_copy (change));
+    }
+  } else
+    changes->reset = TRUE;
+  changes->revision = priv->revision;
+  if (priv->current)
+    changes->current = g_strdup (priv->current->item->id);
+
+  /* Unlock playlist */
+  g_mutex_unlock (&priv->mutex);
+
+  return changes;
+}
+
 static MeloTags *
 melo_playlist_simple_get_tags (MeloPlaylist *playlist, const gchar *id,
                                MeloTagsFields fields)
 {
   MeloPlaylistSimple *plsimple = MELO_PLAYLIST_SIMPLE (playlist);
   MeloPlaylistSimplePrivate *priv = plsimple->priv;
+  MeloPlaylistSimpleNode *node;
   MeloTags *tags = NULL;
-  GList *element;
 
   /* Lock playlist */
   g_mutex_lock (&priv->mutex);
 
   /* Find media in hash table */
-  element = g_hash_table_lookup (priv->ids, id);
-  if (element) {
-    MeloPlaylistItem *item;
-
-    /* Get tags from item */
-    item = (MeloPlaylistItem *) element->data;
-    if (item->tags)
-      tags = melo_tags_ref (item->tags);
-  }
+  node = g_hash_table_lookup (priv->ids, id);
+  if (node && node->item->tags)
+    tags = melo_tags_ref (node->item->tags);
 
   /* Unlock playlist */
   g_mutex_unlock (&priv->mutex);
@@ -290,37 +1189,48 @@ melo_playlist_simple_update_player_status (MeloPlaylistSimple *plsimple)
 
   if (playlist->player)
     melo_player_set_status_playlist (playlist->player,
-                                     priv->current && priv->current->next,
-                                     priv->current && priv->current->prev);
+                        melo_playlist_simple_get_prev_node (priv) != NULL,
+                        melo_playlist_simple_get_next_node (priv) != NULL);
 }
 
-static gboolean
-melo_playlist_simple_add (MeloPlaylist *playlist, const gchar *path,
-                          const gchar *name, MeloTags *tags,
-                          gboolean is_current)
+/* Must be called with playlist locked */
+static MeloPlaylistSimpleNode *
+melo_playlist_simple_add_item (MeloPlaylistSimplePrivate *priv,
+                               const gchar *path, const gchar *name,
+                               MeloTags *tags, gboolean log)
 {
-  MeloPlaylistSimple *plsimple = MELO_PLAYLIST_SIMPLE (playlist);
-  MeloPlaylistSimplePrivate *priv = plsimple->priv;
+  MeloPlaylistSimpleNode *node;
   MeloPlaylistItem *item;
-  gint len, i;
+  guint *next;
   gchar *id;
 
-  /* Lock playlist */
-  g_mutex_lock (&priv->mutex);
-
   /* Use path when media ID is not provided */
   if (!name)
     name = path;
 
-  /* Generate a new media ID if current doesn't exists */
-  len = strlen (name);
-  id = g_strndup (name, len + MELO_PLAYLIST_SIMPLE_ID_EXT_SIZE);
-  for (i = 1; i > 0 && g_hash_table_lookup (priv->ids, id); i++)
-    g_snprintf (id + len, MELO_PLAYLIST_SIMPLE_ID_EXT_SIZE, "_%d", i);
-  if (i < 0) {
-    g_mutex_unlock (&priv->mutex);
-    g_free (id);
-    return FALSE;
+  /* Generate a new media ID "name_N" when name is already used: the next
+   * suffix of each duplicated name is saved, so an ID is found directly
+   * instead of probing all suffixes already given.
+   */
+  id = g_strdup (name);
+  if (g_hash_table_lookup (priv->ids, id)) {
+    /* Get next suffix for this name */
+    next = g_hash_table_lookup (priv->suffixes, name);
+    if (!next) {
+      next = g_new (guint, 1);
+      *next = 1;
+      g_hash_table_insert (priv->suffixes, g_strdup (name), next);
+    }
+
+    /* Skip suffixes used by a media added with this exact name */
+    do {
+      g_free (id);
+      id = g_strdup_printf ("%s_%u", name, (*next)++);
+    } while (*next && g_hash_table_lookup (priv->ids, id));
+    if (!*next) {
+      g_free (id);
+      return NULL;
+    }
   }
 
   /* Add a new simple to playlist */
@@ -328,12 +1238,86 @@ melo_playlist_simple_add (MeloPlaylist *playlist, const gchar *path,
   item->id = id;
   item->can_play = priv->playable;
   item->can_remove = priv->removable;
-  priv->playlist = g_list_prepend (priv->playlist, item);
-  g_hash_table_insert (priv->ids, id, priv->playlist);
+  node = melo_playlist_simple_add_node (priv, item, 0);
+  if (node && log)
+    melo_playlist_simple_log (priv, MELO_PLAYLIST_CHANGE_INSERT, node, 0, 1);
+
+  return node;
+}
+
+static void
+melo_playlist_simple_feed_clear (MeloPlaylistSimplePrivate *priv)
+{
+  if (priv->feed_destroy)
+    priv->feed_destroy (priv->feed_data);
+  priv->feed_func = NULL;
+  priv->feed_data = NULL;
+  priv->feed_destroy = NULL;
+  priv->feed_offset = 0;
+}
+
+/* Must be called with playlist locked */
+static void
+melo_playlist_simple_feed (MeloPlaylistSimplePrivate *priv)
+{
+  GList *items, *l;
+  guint ahead, count = 0;
+
+  if (!priv->feed_func)
+    return;
+
+  /* Enough medias to play after current */
+  if (!priv->current)
+    ahead = melo_playlist_simple_node_size (priv->playlist);
+  else if (priv->shuffle)
+    ahead = g_sequence_get_length (priv->shuffle) -
+            g_sequence_iter_get_position (priv->current->shuffle) - 1;
+  else
+    ahead = melo_playlist_simple_node_index (priv->current);
+  if (ahead >= MELO_PLAYLIST_SIMPLE_FEED_WINDOW / 2)
+    return;
+
+  /* Add next medias in play order */
+  items = priv->feed_func (priv->feed_offset, MELO_PLAYLIST_SIMPLE_FEED_WINDOW,
+                           priv->feed_data);
+  for (l = items; l; l = l->next, count++) {
+    MeloPlaylistItem *item = l->data;
+
+    melo_playlist_simple_add_item (priv, item->path, item->name, item->tags,
+                                   TRUE);
+  }
+  g_list_free_full (items, (GDestroyNotify) melo_playlist_item_unref);
+  priv->feed_offset += count;
+
+  /* End of feed */
+  if (count < MELO_PLAYLIST_SIMPLE_FEED_WINDOW)
+    melo_playlist_simple_feed_clear (priv);
+}
+
+static gboolean
+melo_playlist_simple_add (MeloPlaylist *playlist, const gchar *path,
+                          const gchar *name, MeloTags *tags,
+                          gboolean is_current)
+{
+  MeloPlaylistSimple *plsimple = MELO_PLAYLIST_SIMPLE (playlist);
+  MeloPlaylistSimplePrivate *priv = plsimple->priv;
+  MeloPlaylistSimpleNode *node;
+
+  /* Lock playlist */
+  g_mutex_lock (&priv->mutex);
+
+  /* Add media */
+  node = melo_playlist_simple_add_item (priv, path, name, tags, TRUE);
+  if (!node) {
+    g_mutex_unlock (&priv->mutex);
+    return FALSE;
+  }
 
   /* Set as current */
-  if (is_current)
-    priv->current = priv->playlist;
+  if (is_current) {
+    priv->current = node;
+    melo_playlist_simple_log (priv, MELO_PLAYLIST_CHANGE_UPDATE, node, 0, 1);
+  }
 
   /* Update player status */
   melo_playlist_simple_update_player_status (plsimple);
@@ -341,31 +1325,75 @@ melo_playlist_simple_add (MeloPlaylist *playlist, const gchar *path,
   /* Unlock playlist */
   g_mutex_unlock (&priv->mutex);
 
+  /* Send playlist events */
+  melo_playlist_simple_flush (plsimple);
+
   return TRUE;
 }
 
+static gboolean
+melo_playlist_simple_add_many (MeloPlaylist *playlist, GList *items)
+{
+  MeloPlaylistSimple *plsimple = MELO_PLAYLIST_SIMPLE (playlist);
+  MeloPlaylistSimplePrivate *priv = plsimple->priv;
+  gboolean ret = TRUE, log;
+  GList *l;
+
+  /* A long list of changes is replaced by a reset */
+  log = g_list_length (items) <= MELO_PLAYLIST_SIMPLE_CHANGES_MAX;
+
+  /* Lock playlist */
+  g_mutex_lock (&priv->mutex);
+
+  /* Add all medias */
+  for (l = items; l; l = l->next) {
+    MeloPlaylistItem *item = l->data;
+
+    if (!melo_playlist_simple_add_item (priv, item->path, item->name,
+                                        item->tags, log))
+      ret = FALSE;
+  }
+  if (!log)
+    melo_playlist_simple_log_reset (priv);
+
+  /* Update player status */
+  melo_playlist_simple_update_player_status (plsimple);
+
+  /* Unlock playlist */
+  g_mutex_unlock (&priv->mutex);
+
+  /* Send playlist events */
+  melo_playlist_simple_flush (plsimple);
+
+  return ret;
+}
+
 static gchar *
 melo_playlist_simple_get_prev (MeloPlaylist *playlist, gchar **id,
                                MeloTags **tags, gboolean set)
 {
   MeloPlaylistSimple *plsimple = MELO_PLAYLIST_SIMPLE (playlist);
   MeloPlaylistSimplePrivate *priv = plsimple->priv;
+  MeloPlaylistSimpleNode *node;
   MeloPlaylistItem *item;
   gchar *path = NULL;
 
   /* Lock playlist */
   g_mutex_lock (&priv->mutex);
 
-  /* Get next item after current */
-  if (priv->current && priv->current->next) {
-    item = (MeloPlaylistItem *) priv->current->next->data;
+  /* Get item to play before current */
+  node = melo_playlist_simple_get_prev_node (priv);
+  if (node) {
+    item = node->item;
     path = g_strdup (item->path);
     if (id)
       *id = g_strdup (item->id);
     if (tags && item->tags)
       *tags = melo_tags_ref (item->tags);
     if (set) {
-      priv->current = priv->current->next;
+      priv->current = node;
+      melo_playlist_simple_log (priv, MELO_PLAYLIST_CHANGE_UPDATE, node,
+                                melo_playlist_simple_node_index (node), 1);
       melo_playlist_simple_update_player_status (plsimple);
     }
   }
@@ -373,6 +1401,9 @@ melo_playlist_simple_get_prev (MeloPlaylist *playlist, gchar **id,
   /* Unlock playlist */
   g_mutex_unlock (&priv->mutex);
 
+  /* Send playlist events */
+  melo_playlist_simple_flush (plsimple);
+
   return path;
 }
 
@@ -382,22 +1413,29 @@ melo_playlist_simple_get_next (MeloPlaylist *playlist, gchar **id,
 {
   MeloPlaylistSimple *plsimple = MELO_PLAYLIST_SIMPLE (playlist);
   MeloPlaylistSimplePrivate *priv = plsimple->priv;
+  MeloPlaylistSimpleNode *node;
   MeloPlaylistItem *item;
   gchar *path = NULL;
 
   /* Lock playlist */
   g_mutex_lock (&priv->mutex);
 
-  /* Get previous item before current */
-  if (priv->current && priv->current->prev) {
-    item = (MeloPlaylistItem *) priv->current->prev->data;
+  /* Get more medias from feed */
+  melo_playlist_simple_feed (priv);
+
+  /* Get item to play after current */
+  node = melo_playlist_simple_get_next_node (priv);
+  if (node) {
+    item = node->item;
     path = g_strdup (item->path);
     if (id)
       *id = g_strdup (item->id);
     if (tags && item->tags)
       *tags = melo_tags_ref (item->tags);
     if (set) {
-      priv->current = priv->current->prev;
+      priv->current = node;
+      melo_playlist_simple_log (priv, MELO_PLAYLIST_CHANGE_UPDATE, node,
+                                melo_playlist_simple_node_index (node), 1);
       melo_playlist_simple_update_player_status (plsimple);
     }
   }
@@ -405,6 +1443,9 @@ melo_playlist_simple_get_next (MeloPlaylist *playlist, gchar **id,
   /* Unlock playlist */
   g_mutex_unlock (&priv->mutex);
 
+  /* Send playlist events */
+  melo_playlist_simple_flush (plsimple);
+
   return path;
 }
 
@@ -418,8 +1459,8 @@ melo_playlist_simple_has_prev (MeloPlaylist *playlist)
   /* Lock playlist */
   g_mutex_lock (&priv->mutex);
 
-  /* Have anitem after current */
-  val = priv->current && priv->current->next;
+  /* Have an item to play before current */
+  val = melo_playlist_simple_get_prev_node (priv) != NULL;
 
   /* Unlock playlist */
   g_mutex_unlock (&priv->mutex);
@@ -437,8 +1478,8 @@ melo_playlist_simple_has_next (MeloPlaylist *playlist)
   /* Lock playlist */
   g_mutex_lock (&priv->mutex);
 
-  /* Have anitem before current */
-  val = priv->current && priv->current->prev;
+  /* Have an item to play after current */
+  val = melo_playlist_simple_get_next_node (priv) != NULL;
 
   /* Unlock playlist */
   g_mutex_unlock (&priv->mutex);
@@ -446,13 +1487,75 @@ melo_playlist_simple_has_next (MeloPlaylist *playlist)
   return val;
 }
 
+static gboolean
+melo_playlist_simple_set_shuffle (MeloPlaylist *playlist, gboolean enable)
+{
+  MeloPlaylistSimple *plsimple = MELO_PLAYLIST_SIMPLE (playlist);
+  MeloPlaylistSimplePrivate *priv = plsimple->priv;
+  MeloPlaylistSimpleNode *node;
+  GHashTableIter iter;
+  gpointer *nodes;
+  guint len, i;
+
+  /* Lock playlist */
+  g_mutex_lock (&priv->mutex);
+
+  if (enable && !priv->shuffle) {
+    /* Shuffle all medias except current */
+    nodes = g_new (gpointer, g_hash_table_size (priv->ids));
+    g_hash_table_iter_init (&iter, priv->ids);
+    for (len = 0; g_hash_table_iter_next (&iter, NULL, (gpointer *) &node);)
+      if (node != priv->current)
+        nodes[len++] = node;
+    melo_sort_shuffle (nodes, len);
+
+    /* Create play order starting with current media */
+    priv->shuffle = g_sequence_new (NULL);
+    if (priv->current)
+      priv->current->shuffle = g_sequence_append (priv->shuffle,
+                                                  priv->current);
+    for (i = 0; i < len; i++) {
+      node = nodes[i];
+      node->shuffle = g_sequence_append (priv->shuffle, node);
+    }
+    g_free (nodes);
+  } else if (!enable && priv->shuffle) {
+    /* Back to playlist order */
+    g_sequence_free (priv->shuffle);
+    priv->shuffle = NULL;
+  }
+
+  /* Update player status */
+  melo_playlist_simple_update_player_status (plsimple);
+
+  /* Unlock playlist */
+  g_mutex_unlock (&priv->mutex);
+
+  return TRUE;
+}
+
+static gboolean
+melo_playlist_simple_get_shuffle (MeloPlaylist *playlist)
+{
+  MeloPlaylistSimple *plsimple = MELO_PLAYLIST_SIMPLE (playlist);
+  MeloPlaylistSimplePrivate *priv = plsimple->priv;
+  gboolean val;
+
+  /* Lock playlist */
+  g_mutex_lock (&priv->mutex);
+  val = priv->shuffle != NULL;
+  g_mutex_unlock (&priv->mutex);
+
+  return val;
+}
+
 static gboolean
 melo_playlist_simple_play (MeloPlaylist *playlist, const gchar *id)
 {
   MeloPlaylistSimple *plsimple = MELO_PLAYLIST_SIMPLE (playlist);
   MeloPlaylistSimplePrivate *priv = plsimple->priv;
+  MeloPlaylistSimpleNode *node;
   MeloPlaylistItem *item = NULL;
-  GList *element;
 
   /* Cannot be played */
   if (!priv->playable)
@@ -462,11 +1565,13 @@ melo_playlist_simple_play (MeloPlaylist *playlist, const gchar *id)
   g_mutex_lock (&priv->mutex);
 
   /* Find media in hash table */
-  element = g_hash_table_lookup (priv->ids, id);
-  if (element) {
-    item = (MeloPlaylistItem *) element->data;
-    melo_playlist_item_ref (item);
-    priv->current = element;
+  node = g_hash_table_lookup (priv->ids, id);
+  if (node) {
+    item = melo_playlist_item_ref (node->item);
+    priv->current = node;
+    melo_playlist_simple_log (priv, MELO_PLAYLIST_CHANGE_UPDATE, node,
+                              melo_playlist_simple_node_index (node), 1);
+    melo_playlist_simple_feed (priv);
   }
 
   /* Update player status */
@@ -475,6 +1580,9 @@ melo_playlist_simple_play (MeloPlaylist *playlist, const gchar *id)
   /* Unlock playlist */
   g_mutex_unlock (&priv->mutex);
 
+  /* Send playlist events */
+  melo_playlist_simple_flush (plsimple);
+
   /* No item found */
   if (!item)
     return FALSE;
@@ -488,13 +1596,44 @@ melo_playlist_simple_play (MeloPlaylist *playlist, const gchar *id)
   return TRUE;
 }
 
+static gboolean
+melo_playlist_simple_set_current (MeloPlaylist *playlist, const gchar *id)
+{
+  MeloPlaylistSimple *plsimple = MELO_PLAYLIST_SIMPLE (playlist);
+  MeloPlaylistSimplePrivate *priv = plsimple->priv;
+  MeloPlaylistSimpleNode *node;
+
+  /* Lock playlist */
+  g_mutex_lock (&priv->mutex);
+
+  /* Find media in hash table */
+  node = g_hash_table_lookup (priv->ids, id);
+  if (node && node != priv->current) {
+    priv->current = node;
+    melo_playlist_simple_log (priv, MELO_PLAYLIST_CHANGE_UPDATE, node,
+                              melo_playlist_simple_node_index (node), 1);
+    melo_playlist_simple_feed (priv);
+    melo_playlist_simple_update_player_status (plsimple);
+  }
+
+  /* Unlock playlist */
+  g_mutex_unlock (&priv->mutex);
+
+  /* Send playlist events */
+  melo_playlist_simple_flush (plsimple);
+
+  return node != NULL;
+}
+
 static gboolean
 melo_playlist_simple_sort (MeloPlaylist *playlist, const gchar *id, guint count,
                            MeloSort sort)
 {
   MeloPlaylistSimple *plsimple = MELO_PLAYLIST_SIMPLE (playlist);
   MeloPlaylistSimplePrivate *priv = plsimple->priv;
-  GList *head, *tail, *list;
+  MeloPlaylistSimpleNode *tail, *head, *middle, *node;
+  GList *list, *l;
+  guint start, end, i;
 
   /* Lock playlist (current by default) */
   g_mutex_lock (&priv->mutex);
@@ -504,46 +1643,59 @@ melo_playlist_simple_sort (MeloPlaylist *playlist, const gchar *id, guint count,
     tail = g_hash_table_lookup (priv->ids, id);
     if (!tail)
       goto failed;
-    tail = tail->next;
+    tail = melo_playlist_simple_node_next (tail);
   } else
     tail = priv->current;
 
   /* Find end of list */
-  list = count ? g_list_nth_prev (tail, count) : priv->playlist;
-  if (!list)
+  if (!priv->playlist || (count && !tail))
+    goto failed;
+  end = tail ? melo_playlist_simple_node_index (tail) :
+               melo_playlist_simple_node_size (priv->playlist);
+  if (count > end)
     goto failed;
-  head = list->prev;
+  if (!end)
+    goto done;
 
   /* Separate playlist to sort */
-  if (tail) {
-    if (!tail->prev)
-      goto done;
-    tail->prev->next = NULL;
-    tail->prev = NULL;
-  }
-  if (head) {
-    head->next = NULL;
-    list->prev = NULL;
-  }
+  start = count ? end - count : 0;
+  melo_playlist_simple_node_split (priv->playlist, end, &head, &tail);
+  melo_playlist_simple_node_split (head, start, &head, &middle);
 
-  /* Sort randomly playlist */
+  /* Sort playlist */
+  list = melo_playlist_simple_node_to_list (middle, NULL);
   list = melo_playlist_item_list_sort (list, sort);
 
-  /* Restore playlist */
-  if (head) {
-    head->next = list;
-    list->prev = head;
+  /* Rebuild sorted part with same nodes */
+  for (middle = NULL, l = list; l; l = l->next) {
+    node = g_hash_table_lookup (priv->ids, ((MeloPlaylistItem *) l->data)->id);
+    node->left = node->right = NULL;
+    node->size = 1;
+    middle = melo_playlist_simple_node_merge (middle, node);
   }
-  if (tail) {
-    tail->prev = g_list_last (list);
-    tail->prev->next = tail;
-  }
-  priv->playlist = head ? head : list;
+
+  /* Restore playlist */
+  head = melo_playlist_simple_node_merge (head, middle);
+  priv->playlist = melo_playlist_simple_node_merge (head, tail);
+
+  /* Log sort as a move of each media to its new position */
+  if (end - start <= MELO_PLAYLIST_SIMPLE_CHANGES_MAX) {
+    for (i = start, l = list; l; l = l->next, i++) {
+      node = g_hash_table_lookup (priv->ids,
+                                  ((MeloPlaylistItem *) l->data)->id);
+      melo_playlist_simple_log (priv, MELO_PLAYLIST_CHANGE_MOVE, node, i, 1);
+    }
+  } else
+    melo_playlist_simple_log_reset (priv);
+  g_list_free (list);
 
 done:
   /* Unlock playlist */
   g_mutex_unlock (&priv->mutex);
 
+  /* Send playlist events */
+  melo_playlist_simple_flush (plsimple);
+
   return TRUE;
 
 failed:
@@ -551,45 +1703,35 @@ failed:
   return FALSE;
 }
 
-static GList *
-melo_playlist_simple_move_list (GList *list, GList *start, GList *end,
-                                GList *after)
+/* Must be called with playlist locked */
+static void
+melo_playlist_simple_move_list (MeloPlaylistSimplePrivate *priv, guint start,
+                                guint count, MeloPlaylistSimpleNode *after)
 {
-  /* Do not move */
-  if (!start || !end || (!after && start == list))
-    return list;
+  MeloPlaylistSimpleNode *list, *first;
 
-  /* Remove link first */
-  if (start->prev)
-    start->prev->next = end->next;
-  if (end->next)
-    end->next->prev = start->prev;
-
-  /* Move list into list */
-  if (after == NULL) {
-    start->prev = NULL;
-    end->next = list;
-    list->prev = end;
-    list = start;
-  } else {
-    if (list == start)
-      list = end->next;
-    end->next = after->next;
-    if (after->next)
-      after->next->prev = end;
-    after->next = start;
-    start->prev = after;
-  }
-
-  return list;
+  /* Do not move */
+  if (!after && !start)
+    return;
+
+  /* Remove medias and insert them after media */
+  first = melo_playlist_simple_node_nth (priv->playlist, start);
+  list = melo_playlist_simple_cut (priv, start, count);
+  melo_playlist_simple_insert (priv,
+                         after ? melo_playlist_simple_node_index (after) + 1 : 0,
+                         list);
+  melo_playlist_simple_log (priv, MELO_PLAYLIST_CHANGE_MOVE, first,
+                            melo_playlist_simple_node_index (first), count);
 }
 
 static gboolean
 melo_playlist_simple_move (MeloPlaylist *playlist, const gchar *id, gint up,
                            gint count)
 {
-  MeloPlaylistSimplePrivate *priv = (MELO_PLAYLIST_SIMPLE (playlist))->priv;
-  GList *start, *end, *after;
+  MeloPlaylistSimple *plsimple = MELO_PLAYLIST_SIMPLE (playlist);
+  MeloPlaylistSimplePrivate *priv = plsimple->priv;
+  MeloPlaylistSimpleNode *node, *after = NULL;
+  guint start, size;
 
   /* Cannot be moved */
   if (!priv->removable)
@@ -603,28 +1745,32 @@ melo_playlist_simple_move (MeloPlaylist *playlist, const gchar *id, gint up,
   g_mutex_lock (&priv->mutex);
 
   /* Find media in hash table */
-  start = g_hash_table_lookup (priv->ids, id);
-  if (!start)
+  node = g_hash_table_lookup (priv->ids, id);
+  if (!node || count < 0)
     goto failed;
-  end = g_list_nth (start, --count);
-  if (!end)
+  start = melo_playlist_simple_node_index (node);
+  size = melo_playlist_simple_node_size (priv->playlist);
+  if (start + count > size)
     goto failed;
 
   /* Get media before which we add our medias */
   if (up < 0) {
-    after = g_list_nth (end, -up);
-    if (!after)
+    if (start + count - 1 - up >= size)
       goto failed;
-  } else
-    after = g_list_nth_prev (start, ++up);
+    after = melo_playlist_simple_node_nth (priv->playlist,
+                                           start + count - 1 - up);
+  } else if (start > (guint) up)
+    after = melo_playlist_simple_node_nth (priv->playlist, start - up - 1);
 
   /* move list */
-  priv->playlist = melo_playlist_simple_move_list (priv->playlist, start, end,
-                                                   after);
+  melo_playlist_simple_move_list (priv, start, count, after);
 
   /* Unlock playlist */
   g_mutex_unlock (&priv->mutex);
 
+  /* Send playlist events */
+  melo_playlist_simple_flush (plsimple);
+
   return TRUE;
 
 failed:
@@ -636,8 +1782,10 @@ static gboolean
 melo_playlist_simple_move_to (MeloPlaylist *playlist, const gchar *id,
                               const gchar *before, gint count)
 {
-  MeloPlaylistSimplePrivate *priv = (MELO_PLAYLIST_SIMPLE (playlist))->priv;
-  GList *start, *end, *after = NULL;
+  MeloPlaylistSimple *plsimple = MELO_PLAYLIST_SIMPLE (playlist);
+  MeloPlaylistSimplePrivate *priv = plsimple->priv;
+  MeloPlaylistSimpleNode *node, *after = NULL;
+  guint start, index;
 
   /* Cannot be moved */
   if (priv->removable)
@@ -651,11 +1799,11 @@ melo_playlist_simple_move_to (MeloPlaylist *playlist, const gchar *id,
   g_mutex_lock (&priv->mutex);
 
   /* Find media in hash table */
-  start = g_hash_table_lookup (priv->ids, id);
-  if (!start)
+  node = g_hash_table_lookup (priv->ids, id);
+  if (!node || count < 0)
     goto failed;
-  end = g_list_nth (start, --count);
-  if (!end)
+  start = melo_playlist_simple_node_index (node);
+  if (start + count > melo_playlist_simple_node_size (priv->playlist))
     goto failed;
 
   /* Get media before which we add our medias */
@@ -663,15 +1811,22 @@ melo_playlist_simple_move_to (MeloPlaylist *playlist, const gchar *id,
     after = g_hash_table_lookup (priv->ids, before);
     if (!after)
       goto failed;
+
+    /* Media cannot be in moved part */
+    index = melo_playlist_simple_node_index (after);
+    if (index >= start && index < start + count)
+      goto failed;
   }
 
   /* move list */
-  priv->playlist = melo_playlist_simple_move_list (priv->playlist, start, end,
-                                                   after);
+  melo_playlist_simple_move_list (priv, start, count, after);
 
   /* Unlock playlist */
   g_mutex_unlock (&priv->mutex);
 
+  /* Send playlist events */
+  melo_playlist_simple_flush (plsimple);
+
   return TRUE;
 
 failed:
@@ -684,8 +1839,8 @@ melo_playlist_simple_remove (MeloPlaylist *playlist, const gchar *id)
 {
   MeloPlaylistSimple *plsimple = MELO_PLAYLIST_SIMPLE (playlist);
   MeloPlaylistSimplePrivate *priv = plsimple->priv;
-  MeloPlaylistItem *item;
-  GList *element;
+  MeloPlaylistSimpleNode *node;
+  guint index;
 
   /* Cannot be removed */
   if (!priv->removable)
@@ -695,24 +1850,23 @@ melo_playlist_simple_remove (MeloPlaylist *playlist, const gchar *id)
   g_mutex_lock (&priv->mutex);
 
   /* Find media in hash table */
-  element = g_hash_table_lookup (priv->ids, id);
-  if (!element) {
+  node = g_hash_table_lookup (priv->ids, id);
+  if (!node) {
     g_mutex_unlock (&priv->mutex);
     return FALSE;
   }
-  item = (MeloPlaylistItem *) element->data;
 
   /* Stop play */
-  if (element == priv->current) {
+  if (node == priv->current) {
     if (playlist->player)
       melo_player_set_state (playlist->player, MELO_PLAYER_STATE_NONE);
     priv->current = NULL;
   }
 
   /* Remove from list and hash table */
-  priv->playlist = g_list_remove (priv->playlist, item);
-  g_hash_table_remove (priv->ids, id);
-  melo_playlist_item_unref (item);
+  index = melo_playlist_simple_node_index (node);
+  melo_playlist_simple_log (priv, MELO_PLAYLIST_CHANGE_REMOVE, node, index, 1);
+  melo_playlist_simple_remove_node (priv, node);
 
   /* Update player status */
   melo_playlist_simple_update_player_status (plsimple);
@@ -720,6 +1874,9 @@ melo_playlist_simple_remove (MeloPlaylist *playlist, const gchar *id)
   /* Unlock playlist */
   g_mutex_unlock (&priv->mutex);
 
+  /* Send playlist events */
+  melo_playlist_simple_flush (plsimple);
+
   return TRUE;
 }
 
@@ -740,13 +1897,139 @@ melo_playlist_simple_empty (MeloPlaylist *playlist)
   }
 
   /* Remove and free all items */
-  g_list_free_full (priv->playlist, (GDestroyNotify) melo_playlist_item_unref);
+  melo_playlist_simple_feed_clear (priv);
   g_hash_table_remove_all (priv->ids);
+  g_hash_table_remove_all (priv->suffixes);
+  if (priv->shuffle)
+    g_sequence_remove_range (g_sequence_get_begin_iter (priv->shuffle),
+                             g_sequence_get_end_iter (priv->shuffle));
+  melo_playlist_simple_node_free (priv->playlist);
   priv->playlist = NULL;
+  melo_playlist_simple_log_reset (priv);
+
+  /* Update player status */
+  melo_playlist_simple_update_player_status (plsimple);
+
+  /* Unlock playlist */
+  g_mutex_unlock (&priv->mutex);
+
+  /* Send playlist events */
+  melo_playlist_simple_flush (plsimple);
+}
+
+/**
+ * melo_playlist_simple_set_persist:
+ * @plsimple: the playlist
+ * @file: the path of the file to use to save the playlist
+ *
+ * Restore the playlist previously saved in @file and save all the next
+ * modifications. The changes are appended to a journal (@file with a ".log"
+ * suffix), which is compacted into @file when it becomes too long. The tags of
+ * the medias are saved with the playlist, so they are not discovered again at
+ * restore.
+ * This function should be called once, just after setting the properties of
+ * the playlist.
+ *
+ * Returns: %TRUE if the playlist is now persistent, %FALSE otherwise.
+ */
+gboolean
+melo_playlist_simple_set_persist (MeloPlaylistSimple *plsimple,
+                                  const gchar *file)
+{
+  MeloPlaylistSimplePrivate *priv;
+  guint generation;
+  gchar *dir;
+
+  g_return_val_if_fail (MELO_IS_PLAYLIST_SIMPLE (plsimple) && file, FALSE);
+  priv = plsimple->priv;
+
+  /* Lock playlist */
+  g_mutex_lock (&priv->mutex);
+
+  /* Already persistent */
+  if (priv->persist_file) {
+    g_mutex_unlock (&priv->mutex);
+    return FALSE;
+  }
+
+  /* Create folder */
+  dir = g_path_get_dirname (file);
+  g_mkdir_with_parents (dir, 0700);
+  g_free (dir);
+
+  /* Restore snapshot and replay its journal */
+  priv->persist_file = g_strdup (file);
+  priv->persist_log = g_strconcat (file, ".log", NULL);
+  priv->persist_journal = g_string_new (NULL);
+  generation = melo_playlist_simple_restore_snapshot (priv);
+  melo_playlist_simple_restore_journal (priv, generation);
+  priv->persist_generation = generation;
+
+  /* Clients must get the whole list and a new snapshot is saved */
+  melo_playlist_simple_log_reset (priv);
 
   /* Update player status */
   melo_playlist_simple_update_player_status (plsimple);
 
   /* Unlock playlist */
   g_mutex_unlock (&priv->mutex);
+
+  /* Send playlist events and save playlist */
+  melo_playlist_simple_flush (plsimple);
+
+  return TRUE;
+}
+
+/**
+ * melo_playlist_simple_set_feed:
+ * @plsimple: the playlist
+ * @func: (nullable): the function to call to get the next medias to play
+ * @user_data: the data to pass to @func
+ * @destroy: (nullable): the function to call to release @user_data
+ *
+ * Set a feed to provide the next medias to play after the last one added to
+ * the playlist. The medias are requested by windows of some medias when
+ * less than half a window is left to play after the current media, so a very long list of medias can be played without creating all
+ * the #MeloPlaylistItem at once.
+ * The feed is released when @func returns less medias than requested, when
+ * playlist is emptied, or when a new feed is set. Setting @func to %NULL only
+ * releases the current feed.
+ *
+ * @func is called with playlist locked, so it must not call any function of
+ * the playlist.
+ *
+ * Returns: %TRUE if the feed has been set, %FALSE otherwise.
+ */
+gboolean
+melo_playlist_simple_set_feed (MeloPlaylistSimple *plsimple,
+                               MeloPlaylistSimpleFeedFunc func,
+                               gpointer user_data, GDestroyNotify destroy)
+{
+  MeloPlaylistSimplePrivate *priv;
+
+  g_return_val_if_fail (MELO_IS_PLAYLIST_SIMPLE (plsimple), FALSE);
+  priv = plsimple->priv;
+
+  /* Lock playlist */
+  g_mutex_lock (&priv->mutex);
+
+  /* Replace feed */
+  melo_playlist_simple_feed_clear (priv);
+  priv->feed_func = func;
+  priv->feed_data = user_data;
+  priv->feed_destroy = destroy;
+
+  /* Get first medias */
+  melo_playlist_simple_feed (priv);
+
+  /* Update player status */
+  melo_playlist_simple_update_player_status (plsimple);
+
+  /* Unlock playlist */
+  g_mutex_unlock (&priv->mutex);
+
+  /* Send playlist events */
+  melo_playlist_simple_flush (plsimple);
+
+  return TRUE;
 }
@@ -59,8 +59,30 @@ struct _MeloPlaylistSimpleClass {
   MeloPlaylistClass parent_class;
 };
 
+/**
+ * MeloPlaylistSimpleFeedFunc:
+ * @offset: the number of medias already provided by the feed
+ * @count: the number of medias to provide
+ * @user_data: the user data passed to melo_playlist_simple_set_feed()
+ *
+ * The function called to get the next medias to add to a #MeloPlaylistSimple.
+ *
+ * Returns: (transfer full): a #GList of #MeloPlaylistItem in play order, with
+ * at most @count items. When less than @count items are returned, the feed is
+ * ended.
+ */
+typedef GList *(*MeloPlaylistSimpleFeedFunc) (guint offset, guint count,
+                                              gpointer user_data);
+
 GType melo_playlist_simple_get_type (void);
 
+gboolean melo_playlist_simple_set_persist (MeloPlaylistSimple *plsimple,
+                                           const gchar *file);
+gboolean melo_playlist_simple_set_feed (MeloPlaylistSimple *plsimple,
+                                        MeloPlaylistSimpleFeedFunc func,
+                                        gpointer user_data,
+                                        GDestroyNotify destroy);
+
 G_END_DECLS
 
 #endif /* __MELO_PLAYLIST_SIMPLE_H__ */
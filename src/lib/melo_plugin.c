@@ -44,14 +44,43 @@
  *
  * Several functions are available to load and unload one or more plugins and it
  * must be used only by the main program.
+ *
+ * A plugin can also be shipped with a manifest, a key file named
+ * "<name>.plugin" and installed next to the plugin library, which lists the
+ * IDs of the #MeloModule, #MeloBrowser and #MeloPlayer it provides and the
+ * JSON-RPC groups it registers:
+ * |[
+ * [Plugin]
+ * Name=My plugin
+ * Description=A plugin providing something
+ * Modules=my_module;
+ * Browsers=my_module_browser;
+ * Players=my_module_player;
+ * JSONRPC=my_group;
+ * ]|
+ * When plugins are loaded with melo_plugin_load_all_lazy(), the library of a
+ * plugin with a manifest is not opened: it is opened and enabled on first use
+ * of one of the objects or JSON-RPC groups listed (see melo_plugin_activate())
+ * or when melo_plugin_activate_all() is called, once startup is done.
  */
 
 #ifndef MELO_PLUGIN_PATH
 #define MELO_PLUGIN_PATH "/usr/local/lib/melo"
 #endif
 
-/* Global plugin list */
-G_LOCK_DEFINE_STATIC (melo_plugin_mutex);
+/* Plugin manifest */
+#define MELO_PLUGIN_MANIFEST_GROUP "Plugin"
+static const gchar *melo_plugin_manifest_keys[MELO_PLUGIN_PROVIDE_COUNT] = {
+  [MELO_PLUGIN_PROVIDE_MODULE] = "Modules",
+  [MELO_PLUGIN_PROVIDE_BROWSER] = "Browsers",
+  [MELO_PLUGIN_PROVIDE_PLAYER] = "Players",
+  [MELO_PLUGIN_PROVIDE_JSONRPC] = "JSONRPC",
+};
+
+/* Global plugin list: a recursive lock is used since a plugin can trigger
+ * activation of another plugin during its enable callback.
+ */
+static GRecMutex melo_plugin_mutex;
 static GList *melo_plugin_list;
 
 typedef struct _MeloPluginContext {
@@ -59,6 +88,13 @@ typedef struct _MeloPluginContext {
   GModule *module;
   const MeloPlugin *plugin;
   gboolean is_enabled;
+
+  /* Lazy activation */
+  gboolean is_lazy;
+  gboolean is_activating;
+  gchar *title;
+  gchar *description;
+  gchar **provides[MELO_PLUGIN_PROVIDE_COUNT];
 } MeloPluginContext;
 
 static MeloPluginContext *
@@ -98,21 +134,19 @@ melo_plugin_context_enable (MeloPluginContext *ctx)
 }
 
 static gboolean
-melo_plugin_load_unclock (const gchar *name, gboolean enable)
+melo_plugin_context_open (MeloPluginContext *ctx)
 {
-  MeloPluginContext *ctx;
   MeloPlugin *plugin;
   GModule *module;
   gchar *full_name;
   gchar *path;
 
-  /* Check if module is already open */
-  ctx = melo_plugin_find (name);
-  if (ctx)
+  /* Already open */
+  if (ctx->module)
     return TRUE;
 
   /* Build plugin path */
-  full_name = g_strdup_printf ("libmelo_%s", name);
+  full_name = g_strdup_printf ("libmelo_%s", ctx->name);
   path = g_module_build_path (MELO_PLUGIN_PATH, full_name);
   g_free (full_name);
 
@@ -130,13 +164,121 @@ melo_plugin_load_unclock (const gchar *name, gboolean enable)
   if (plugin->api_version != MELO_API_VERSION)
     goto err_close;
 
-  /* Add plugin to list */
+  /* Set plugin */
+  ctx->module = module;
+  ctx->plugin = plugin;
+
+  return TRUE;
+err_close:
+  g_module_close (module);
+err_free:
+  return FALSE;
+}
+
+static void
+melo_plugin_context_free (MeloPluginContext *ctx)
+{
+  guint i;
+
+  for (i = 0; i < MELO_PLUGIN_PROVIDE_COUNT; i++)
+    g_strfreev (ctx->provides[i]);
+  g_free (ctx->description);
+  g_free (ctx->title);
+  g_free (ctx->name);
+  g_slice_free (MeloPluginContext, ctx);
+}
+
+static MeloPluginContext *
+melo_plugin_context_new_from_manifest (const gchar *name)
+{
+  MeloPluginContext *ctx;
+  GKeyFile *kfile;
+  gchar *file, *path;
+  guint i;
+
+  /* Build manifest path */
+  file = g_strdup_printf ("%s.plugin", name);
+  path = g_build_filename (MELO_PLUGIN_PATH, file, NULL);
+  g_free (file);
+
+  /* Load manifest */
+  kfile = g_key_file_new ();
+  if (!g_key_file_load_from_file (kfile, path, G_KEY_FILE_NONE, NULL) ||
+      !g_key_file_has_group (kfile, MELO_PLUGIN_MANIFEST_GROUP)) {
+    g_key_file_free (kfile);
+    g_free (path);
+    return NULL;
+  }
+  g_free (path);
+
+  /* Create plugin context */
+  ctx = g_slice_new0 (MeloPluginContext);
+  ctx->name = g_strdup (name);
+  ctx->is_lazy = TRUE;
+  ctx->title = g_key_file_get_string (kfile, MELO_PLUGIN_MANIFEST_GROUP,
+                                      "Name", NULL);
+  ctx->description = g_key_file_get_string (kfile, MELO_PLUGIN_MANIFEST_GROUP,
+                                            "Description", NULL);
+
+  /* Get provided objects and JSON-RPC groups */
+  for (i = 0; i < MELO_PLUGIN_PROVIDE_COUNT; i++)
+    ctx->provides[i] = g_key_file_get_string_list (kfile,
+                                                MELO_PLUGIN_MANIFEST_GROUP,
+                                                melo_plugin_manifest_keys[i],
+                                                NULL, NULL);
+  g_key_file_free (kfile);
+
+  return ctx;
+}
+
+static gboolean
+melo_plugin_context_activate (MeloPluginContext *ctx)
+{
+  gboolean ret = FALSE;
+
+  /* Plugin is already being activated by this thread */
+  if (ctx->is_activating)
+    return FALSE;
+  ctx->is_activating = TRUE;
+
+  /* Open plugin and enable it: the activation is tried only once */
+  if (melo_plugin_context_open (ctx))
+    ret = melo_plugin_context_enable (ctx);
+  else
+    g_warning ("failed to open plugin '%s'", ctx->name);
+  ctx->is_lazy = FALSE;
+
+  ctx->is_activating = FALSE;
+  return ret;
+}
+
+static gboolean
+melo_plugin_load_unclock (const gchar *name, gboolean enable)
+{
+  MeloPluginContext *ctx;
+
+  /* Check if module is already open */
+  ctx = melo_plugin_find (name);
+  if (ctx) {
+    /* Activate a pending plugin */
+    if (ctx->is_lazy && enable)
+      melo_plugin_context_activate (ctx);
+    return TRUE;
+  }
+
+  /* Create plugin context */
   ctx = g_slice_new0 (MeloPluginContext);
   if (!ctx)
-    goto err_close;
+    return FALSE;
   ctx->name = g_strdup (name);
-  ctx->module = module;
-  ctx->plugin = plugin;
+
+  /* Open plugin */
+  if (!melo_plugin_context_open (ctx)) {
+    melo_plugin_context_free (ctx);
+    return FALSE;
+  }
+
+  /* Add plugin to list */
   melo_plugin_list = g_list_prepend (melo_plugin_list, ctx);
 
   /* Enable plugin */
@@ -144,15 +286,15 @@ melo_plugin_load_unclock (const gchar *name, gboolean enable)
     melo_plugin_context_enable (ctx);
 
   return TRUE;
-err_close:
-  g_module_close (module);
-err_free:
-  return FALSE;
 }
 
 static gboolean
 melo_plugin_context_unload (MeloPluginContext *ctx)
 {
+  /* Plugin has never been opened */
+  if (!ctx->module)
+    return TRUE;
+
   /* Disable MeloModule */
   if (ctx->is_enabled && ctx->plugin && ctx->plugin->disable)
     ctx->plugin->disable ();
@@ -177,12 +319,12 @@ melo_plugin_load (const gchar *name, gboolean enable)
 {
   gboolean ret;
 
-  G_LOCK (melo_plugin_mutex);
+  g_rec_mutex_lock (&melo_plugin_mutex);
 
   /* Load plugin */
   ret = melo_plugin_load_unclock (name, enable);
 
-  G_UNLOCK (melo_plugin_mutex);
+  g_rec_mutex_unlock (&melo_plugin_mutex);
 
   return ret;
 }
@@ -202,7 +344,7 @@ melo_plugin_unload (const gchar *name)
   MeloPluginContext *ctx;
   gboolean ret = FALSE;
 
-  G_LOCK (melo_plugin_mutex);
+  g_rec_mutex_lock (&melo_plugin_mutex);
 
   /* Find plugin */
   ctx = melo_plugin_find (name);
@@ -211,12 +353,11 @@ melo_plugin_unload (const gchar *name)
   if (ctx && melo_plugin_context_unload (ctx)) {
     /* Remove plugin from list */
     melo_plugin_list = g_list_remove (melo_plugin_list, ctx);
-    g_free (ctx->name);
-    g_slice_free (MeloPluginContext, ctx);
+    melo_plugin_context_free (ctx);
     ret = TRUE;
   }
 
-  G_UNLOCK (melo_plugin_mutex);
+  g_rec_mutex_unlock (&melo_plugin_mutex);
 
   return ret;
 }
@@ -236,16 +377,18 @@ melo_plugin_enable (const gchar *name)
   MeloPluginContext *ctx;
   gboolean ret = FALSE;
 
-  G_LOCK (melo_plugin_mutex);
+  g_rec_mutex_lock (&melo_plugin_mutex);
 
   /* Find plugin */
   ctx = melo_plugin_find (name);
 
   /* Enable plugin */
-  if (ctx)
+  if (ctx && ctx->is_lazy)
+    ret = melo_plugin_context_activate (ctx);
+  else if (ctx)
     ret = melo_plugin_context_enable (ctx);
 
-  G_UNLOCK (melo_plugin_mutex);
+  g_rec_mutex_unlock (&melo_plugin_mutex);
 
   return ret;
 }
@@ -266,7 +409,7 @@ melo_plugin_disable (const gchar *name)
   MeloPluginContext *ctx;
   gboolean ret = FALSE;
 
-  G_LOCK (melo_plugin_mutex);
+  g_rec_mutex_lock (&melo_plugin_mutex);
 
   /* Find plugin */
   ctx = melo_plugin_find (name);
@@ -278,11 +421,54 @@ melo_plugin_disable (const gchar *name)
       ctx->is_enabled = FALSE;
   }
 
-  G_UNLOCK (melo_plugin_mutex);
+  g_rec_mutex_unlock (&melo_plugin_mutex);
 
   return ret;
 }
 
+static void
+melo_plugin_scan (gboolean enable, gboolean lazy)
+{
+  MeloPluginContext *ctx;
+  const gchar *d_name;
+  gchar *name, *n;
+  GDir *dir;
+
+  /* List all plugins in directory */
+  dir = g_dir_open (MELO_PLUGIN_PATH, 0, NULL);
+  if (!dir)
+    return;
+
+  /* List all entries in directory exceopt . and .. */
+  while ((d_name = g_dir_read_name (dir))) {
+    if ((!strcmp (d_name, "..")) || !strcmp (d_name, "."))
+      continue;
+
+    /* Extract plugin name from filename */
+    if (strncmp (d_name, "libmelo_", 8))
+      continue;
+    name = g_strdup (d_name + 8);
+    n = strchr (name, '.');
+    if (n)
+      *n = '\0';
+
+    /* Register plugin with a manifest for later activation */
+    if (lazy && !melo_plugin_find (name) &&
+        (ctx = melo_plugin_context_new_from_manifest (name))) {
+      melo_plugin_list = g_list_prepend (melo_plugin_list, ctx);
+      g_free (name);
+      continue;
+    }
+
+    /* Add plugin */
+    melo_plugin_load_unclock (name, enable);
+    g_free (name);
+  }
+
+  /* Close directory */
+  g_dir_close (dir);
+}
+
 /**
  * melo_plugin_load_all:
  * @enable: set %TRUE if the plugins must be enabled
@@ -297,38 +483,95 @@ melo_plugin_disable (const gchar *name)
 void
 melo_plugin_load_all (gboolean enable)
 {
-  const gchar *d_name;
-  gchar *name, *n;
-  GDir *dir;
+  g_rec_mutex_lock (&melo_plugin_mutex);
 
-  G_LOCK (melo_plugin_mutex);
+  /* Load all plugins */
+  melo_plugin_scan (enable, FALSE);
 
-  /* List all plugins in directory */
-  dir = g_dir_open (MELO_PLUGIN_PATH, 0, NULL);
-  if (dir) {
-    /* List all entries in directory exceopt . and .. */
-    while ((d_name = g_dir_read_name (dir))) {
-      if ((!strcmp (d_name, "..")) || !strcmp (d_name, "."))
-        continue;
-
-      /* Extract plugin name from filename */
-      if (strncmp (d_name, "libmelo_", 8))
-        continue;
-      name = g_strdup (d_name + 8);
-      n = strchr (name, '.');
-      if (n)
-        *n = '\0';
-
-      /* Add plugin */
-      melo_plugin_load_unclock (name, enable);
-      g_free (name);
+  g_rec_mutex_unlock (&melo_plugin_mutex);
+}
+
+/**
+ * melo_plugin_load_all_lazy:
+ *
+ * Register all plugins from Melo plugin directory. The plugins shipped with a
+ * manifest are not loaded: they are only listed and will be loaded and enabled
+ * on first use of one of the objects they provide, with melo_plugin_activate(),
+ * or by melo_plugin_activate_all(). The plugins without manifest are loaded and
+ * enabled immediately, as with melo_plugin_load_all().
+ */
+void
+melo_plugin_load_all_lazy (void)
+{
+  g_rec_mutex_lock (&melo_plugin_mutex);
+
+  /* Register all plugins */
+  melo_plugin_scan (TRUE, TRUE);
+
+  g_rec_mutex_unlock (&melo_plugin_mutex);
+}
+
+/**
+ * melo_plugin_activate:
+ * @provide: the type of object to look for
+ * @id: the ID of the object or the JSON-RPC group name
+ *
+ * Load and enable the pending plugin which provides the object or the JSON-RPC
+ * group @id, as listed in its manifest. This function is called when a
+ * #MeloModule, a #MeloBrowser, a #MeloPlayer or a JSON-RPC method cannot be
+ * found, before failing.
+ *
+ * Returns: %TRUE if a plugin has been activated, %FALSE otherwise.
+ */
+gboolean
+melo_plugin_activate (MeloPluginProvide provide, const gchar *id)
+{
+  gboolean ret = FALSE;
+  GList *l;
+
+  if (provide >= MELO_PLUGIN_PROVIDE_COUNT || !id)
+    return FALSE;
+
+  g_rec_mutex_lock (&melo_plugin_mutex);
+
+  /* Find pending plugin providing the object */
+  for (l = melo_plugin_list; l != NULL; l = l->next) {
+    MeloPluginContext *ctx = l->data;
+
+    if (ctx->is_lazy && ctx->provides[provide] &&
+        g_strv_contains ((const gchar * const *) ctx->provides[provide], id)) {
+      ret = melo_plugin_context_activate (ctx);
+      break;
     }
+  }
+
+  g_rec_mutex_unlock (&melo_plugin_mutex);
+
+  return ret;
+}
+
+/**
+ * melo_plugin_activate_all:
+ *
+ * Load and enable all plugins still pending activation. It should be called
+ * by the main program once startup is done.
+ */
+void
+melo_plugin_activate_all (void)
+{
+  GList *l;
+
+  g_rec_mutex_lock (&melo_plugin_mutex);
+
+  /* Activate all pending plugins */
+  for (l = melo_plugin_list; l != NULL; l = l->next) {
+    MeloPluginContext *ctx = l->data;
 
-    /* Close directory */
-    g_dir_close (dir);
+    if (ctx->is_lazy)
+      melo_plugin_context_activate (ctx);
   }
 
-  G_UNLOCK (melo_plugin_mutex);
+  g_rec_mutex_unlock (&melo_plugin_mutex);
 }
 
 /**
@@ -345,7 +588,7 @@ melo_plugin_unload_all (void)
   MeloPluginContext *ctx;
   GList *list;
 
-  G_LOCK (melo_plugin_mutex);
+  g_rec_mutex_lock (&melo_plugin_mutex);
 
   /* Find plugin context */
   for (list = melo_plugin_list; list != NULL;) {
@@ -357,12 +600,11 @@ melo_plugin_unload_all (void)
     if (melo_plugin_context_unload (ctx)) {
       /* Remove plugin from list */
       melo_plugin_list = g_list_delete_link (melo_plugin_list, l);
-      g_free (ctx->name);
-      g_slice_free (MeloPluginContext, ctx);
+      melo_plugin_context_free (ctx);
     }
   }
 
-  G_UNLOCK (melo_plugin_mutex);
+  g_rec_mutex_unlock (&melo_plugin_mutex);
 }
 /**
  * melo_plugin_get_list:
@@ -382,7 +624,7 @@ melo_plugin_get_list (void)
   MeloPluginItem *item;
   GList *list = NULL, *l;
 
-  G_LOCK (melo_plugin_mutex);
+  g_rec_mutex_lock (&melo_plugin_mutex);
 
   /* Find plugin context */
   for (l = melo_plugin_list; l != NULL; l = l->next) {
@@ -399,11 +641,14 @@ melo_plugin_get_list (void)
     if (ctx->plugin) {
       item->name = g_strdup (ctx->plugin->name);
       item->description = g_strdup (ctx->plugin->description);
+    } else {
+      item->name = g_strdup (ctx->title);
+      item->description = g_strdup (ctx->description);
     }
     list = g_list_prepend (list, item);
   }
 
-  G_UNLOCK (melo_plugin_mutex);
+  g_rec_mutex_unlock (&melo_plugin_mutex);
 
   return list;
 }
@@ -30,6 +30,26 @@
 typedef struct _MeloPlugin MeloPlugin;
 typedef struct _MeloPluginItem MeloPluginItem;
 
+/**
+ * MeloPluginProvide:
+ * @MELO_PLUGIN_PROVIDE_MODULE: a #MeloModule ID
+ * @MELO_PLUGIN_PROVIDE_BROWSER: a #MeloBrowser ID
+ * @MELO_PLUGIN_PROVIDE_PLAYER: a #MeloPlayer ID
+ * @MELO_PLUGIN_PROVIDE_JSONRPC: a JSON-RPC group name
+ * @MELO_PLUGIN_PROVIDE_COUNT: number of provide types
+ *
+ * #MeloPluginProvide indicates the type of object listed in a plugin manifest
+ * and used to activate a plugin on first use.
+ */
+typedef enum {
+  MELO_PLUGIN_PROVIDE_MODULE = 0,
+  MELO_PLUGIN_PROVIDE_BROWSER,
+  MELO_PLUGIN_PROVIDE_PLAYER,
+  MELO_PLUGIN_PROVIDE_JSONRPC,
+
+  MELO_PLUGIN_PROVIDE_COUNT
+} MeloPluginProvide;
+
 /**
  * MeloPluginEnable:
  *
@@ -98,8 +118,12 @@ gboolean melo_plugin_enable (const gchar *name);
 gboolean melo_plugin_disable (const gchar *name);
 
 void melo_plugin_load_all (gboolean enable);
+void melo_plugin_load_all_lazy (void);
 void melo_plugin_unload_all ();
 
+gboolean melo_plugin_activate (MeloPluginProvide provide, const gchar *id);
+void melo_plugin_activate_all (void);
+
 GList *melo_plugin_get_list ();
 void melo_plugin_item_free (MeloPluginItem *item);
 
@@ -0,0 +1,689 @@
+/*
+ * melo_rtp.c: RTP audio receiver with jitter buffer
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <sys/socket.h>
+
+#include <gio/gio.h>
+#include <gst/app/app.h>
+
+#include "melo_rtp.h"
+
+/**
+ * SECTION:melo_rtp
+ * @title: MeloRTP
+ * @short_description: RTP audio receiver with jitter buffer
+ *
+ * #MeloRTP receives an RTP audio stream on a UDP port and plays it on a
+ * #MeloSink, so modules implementing a streaming protocol (AirPlay like) only
+ * have to handle the control channel, with #MeloRTSP for instance.
+ *
+ * The packets are received by batch with recvmmsg() in a dedicated thread,
+ * directly into a fixed pool of packets allocated at creation. They are then
+ * reordered in a jitter buffer: a missing packet is waited until the packets
+ * following it are older than the latency, and a #MeloRTPResend callback is
+ * called when a gap is detected, so the retransmitted packets can be pushed
+ * back with melo_rtp_push_packet().
+ *
+ * The packets leaving the jitter buffer are passed to the #MeloRTPDecode
+ * callback (or copied as is when not set) and pushed to the sink, timestamped
+ * from their RTP timestamp.
+ */
+
+/* Packet size, jitter buffer size (power of 2) and receive batch size */
+#define MELO_RTP_PACKET_SIZE 2048
+#define MELO_RTP_JITTER_SIZE 512
+#define MELO_RTP_BATCH_SIZE 32
+#define MELO_RTP_POOL_SIZE (MELO_RTP_JITTER_SIZE + MELO_RTP_BATCH_SIZE)
+
+/* Size of decoded buffers and receive timeout (in us) */
+#define MELO_RTP_DECODE_SIZE 16384
+#define MELO_RTP_TIMEOUT 10000
+
+typedef struct {
+  guint16 seq;
+  guint32 timestamp;
+  gint64 time;
+  gsize offset;
+  gsize size;
+  guchar data[MELO_RTP_PACKET_SIZE];
+} MeloRTPPacket;
+
+struct _MeloRTP {
+  /* Socket and receive thread */
+  GSocket *sock;
+  GThread *thread;
+  gboolean running;
+
+  /* Pipeline */
+  GstElement *pipeline;
+  GstElement *src;
+  GstBufferPool *pool;
+  guint clock_rate;
+
+  /* Packet pool */
+  GMutex mutex;
+  MeloRTPPacket *packets;
+  MeloRTPPacket *free[MELO_RTP_POOL_SIZE];
+  guint free_count;
+
+  /* Jitter buffer */
+  MeloRTPPacket *slots[MELO_RTP_JITTER_SIZE];
+  gboolean started;
+  guint16 next_seq;
+  guint16 last_seq;
+  gint64 latency;
+
+  /* Timestamps */
+  gboolean synced;
+  guint32 last_ts;
+  guint64 ext_ts;
+  GstClockTime base;
+
+  /* Callbacks */
+  MeloRTPDecode decode_cb;
+  gpointer decode_data;
+  MeloRTPResend resend_cb;
+  gpointer resend_data;
+};
+
+/**
+ * melo_rtp_new:
+ * @sink: the #MeloSink on which to play the stream
+ * @caps: the caps of the audio decoded by #MeloRTPDecode, as a string
+ * @clock_rate: the clock rate of the RTP timestamps
+ * @latency: the latency of the jitter buffer (in ms)
+ *
+ * Create a new RTP receiver playing on @sink. The receiver is started with
+ * melo_rtp_start().
+ *
+ * Returns: (transfer full): a new #MeloRTP or %NULL if failed. After use, call
+ * melo_rtp_free().
+ */
+MeloRTP *
+melo_rtp_new (MeloSink *sink, const gchar *caps, guint clock_rate,
+              guint latency)
+{
+  GstStructure *config;
+  GstElement *gsink;
+  GstCaps *gcaps;
+  MeloRTP *rtp;
+  guint i;
+
+  g_return_val_if_fail (sink && caps && clock_rate, NULL);
+
+  /* Parse caps */
+  gcaps = gst_caps_from_string (caps);
+  if (!gcaps)
+    return NULL;
+
+  /* Create receiver */
+  rtp = g_slice_new0 (MeloRTP);
+  rtp->clock_rate = clock_rate;
+  rtp->latency = latency * G_TIME_SPAN_MILLISECOND;
+  g_mutex_init (&rtp->mutex);
+
+  /* Allocate packet pool */
+  rtp->packets = g_new (MeloRTPPacket, MELO_RTP_POOL_SIZE);
+  for (i = 0; i < MELO_RTP_POOL_SIZE; i++)
+    rtp->free[i] = &rtp->packets[i];
+  rtp->free_count = MELO_RTP_POOL_SIZE;
+
+  /* Create pipeline */
+  rtp->pipeline = gst_pipeline_new ("rtp_pipeline");
+  rtp->src = gst_element_factory_make ("appsrc", NULL);
+  g_object_set (rtp->src, "is-live", TRUE, "format", GST_FORMAT_TIME,
+                "caps", gcaps, NULL);
+  gsink = melo_sink_get_gst_sink (sink);
+  gst_bin_add_many (GST_BIN (rtp->pipeline), rtp->src, gsink, NULL);
+  gst_element_link (rtp->src, gsink);
+  gst_object_unref (gsink);
+
+  /* Create pool for decoded buffers */
+  rtp->pool = gst_buffer_pool_new ();
+  config = gst_buffer_pool_get_config (rtp->pool);
+  gst_buffer_pool_config_set_params (config, gcaps, MELO_RTP_DECODE_SIZE, 16,
+                                     0);
+  gst_buffer_pool_set_config (rtp->pool, config);
+  gst_buffer_pool_set_active (rtp->pool, TRUE);
+  gst_caps_unref (gcaps);
+
+  return rtp;
+}
+
+/**
+ * melo_rtp_free:
+ * @rtp: the RTP receiver
+ *
+ * Stop and free the RTP receiver.
+ */
+void
+melo_rtp_free (MeloRTP *rtp)
+{
+  if (!rtp)
+    return;
+
+  /* Stop receiver */
+  melo_rtp_stop (rtp);
+
+  /* Free pipeline and pool */
+  gst_object_unref (rtp->pipeline);
+  gst_buffer_pool_set_active (rtp->pool, FALSE);
+  gst_object_unref (rtp->pool);
+
+  /* Free packets */
+  g_free (rtp->packets);
+  g_mutex_clear (&rtp->mutex);
+  g_slice_free (MeloRTP, rtp);
+}
+
+/**
+ * melo_rtp_set_decode_callback:
+ * @rtp: the RTP receiver
+ * @callback: the #MeloRTPDecode callback
+ * @user_data: a pointer to associate with the callback
+ *
+ * Set the callback used to decrypt and / or decode the packets. It must be set
+ * before melo_rtp_start().
+ */
+void
+melo_rtp_set_decode_callback (MeloRTP *rtp, MeloRTPDecode callback,
+                              gpointer user_data)
+{
+  rtp->decode_cb = callback;
+  rtp->decode_data = user_data;
+}
+
+/**
+ * melo_rtp_set_resend_callback:
+ * @rtp: the RTP receiver
+ * @callback: the #MeloRTPResend callback
+ * @user_data: a pointer to associate with the callback
+ *
+ * Set the callback used to request retransmission of missing packets. It must
+ * be set before melo_rtp_start().
+ */
+void
+melo_rtp_set_resend_callback (MeloRTP *rtp, MeloRTPResend callback,
+                              gpointer user_data)
+{
+  rtp->resend_cb = callback;
+  rtp->resend_data = user_data;
+}
+
+static inline void
+melo_rtp_release (MeloRTP *rtp, MeloRTPPacket *packet)
+{
+  rtp->free[rtp->free_count++] = packet;
+}
+
+static void
+melo_rtp_reset (MeloRTP *rtp)
+{
+  guint i;
+
+  /* Release all packets of jitter buffer */
+  for (i = 0; i < MELO_RTP_JITTER_SIZE; i++) {
+    if (rtp->slots[i]) {
+      melo_rtp_release (rtp, rtp->slots[i]);
+      rtp->slots[i] = NULL;
+    }
+  }
+  rtp->started = FALSE;
+}
+
+static GstClockTime
+melo_rtp_get_running_time (MeloRTP *rtp)
+{
+  GstClockTime time = 0;
+  GstClock *clock;
+
+  /* Get current running time of pipeline */
+  clock = gst_element_get_clock (rtp->pipeline);
+  if (clock) {
+    time = gst_clock_get_time (clock) -
+           gst_element_get_base_time (rtp->pipeline);
+    gst_object_unref (clock);
+  }
+
+  return time;
+}
+
+static void
+melo_rtp_play (MeloRTP *rtp, MeloRTPPacket *packet)
+{
+  const guchar *payload = packet->data + packet->offset;
+  GstBuffer *buffer;
+  GstMapInfo map;
+  gssize size;
+
+  /* Get a buffer from pool */
+  if (gst_buffer_pool_acquire_buffer (rtp->pool, &buffer, NULL) != GST_FLOW_OK)
+    return;
+
+  /* Decode packet */
+  gst_buffer_map (buffer, &map, GST_MAP_WRITE);
+  if (rtp->decode_cb)
+    size = rtp->decode_cb (rtp, packet->seq, packet->timestamp, payload,
+                           packet->size, map.data, map.size, rtp->decode_data);
+  else {
+    size = MIN (packet->size, map.size);
+    memcpy (map.data, payload, size);
+  }
+  gst_buffer_unmap (buffer, &map);
+  if (size <= 0) {
+    gst_buffer_unref (buffer);
+    return;
+  }
+  gst_buffer_set_size (buffer, size);
+
+  /* Extend timestamp to 64 bits and set base time on first packet */
+  if (!rtp->synced) {
+    rtp->base = melo_rtp_get_running_time (rtp) + rtp->latency * GST_USECOND;
+    rtp->ext_ts = 0;
+    rtp->synced = TRUE;
+  } else
+    rtp->ext_ts += (gint32) (packet->timestamp - rtp->last_ts);
+  rtp->last_ts = packet->timestamp;
+
+  /* Push buffer to sink */
+  GST_BUFFER_PTS (buffer) = rtp->base +
+      gst_util_uint64_scale (rtp->ext_ts, GST_SECOND, rtp->clock_rate);
+  gst_app_src_push_buffer (GST_APP_SRC (rtp->src), buffer);
+}
+
+static void
+melo_rtp_process (MeloRTP *rtp)
+{
+  MeloRTPPacket *packet;
+  gint64 now;
+  guint16 seq;
+
+  /* Nothing received */
+  if (!rtp->started)
+    return;
+
+  now = g_get_monotonic_time ();
+  while ((gint16) (rtp->last_seq - rtp->next_seq) >= 0) {
+    /* Play next packet */
+    packet = rtp->slots[rtp->next_seq % MELO_RTP_JITTER_SIZE];
+    if (packet) {
+      rtp->slots[rtp->next_seq % MELO_RTP_JITTER_SIZE] = NULL;
+      melo_rtp_play (rtp, packet);
+      melo_rtp_release (rtp, packet);
+      rtp->next_seq++;
+      continue;
+    }
+
+    /* Packet is missing: find next received packet */
+    for (seq = rtp->next_seq + 1;
+         !rtp->slots[seq % MELO_RTP_JITTER_SIZE]; seq++);
+
+    /* Wait until latency of next received packet is reached */
+    if (now - rtp->slots[seq % MELO_RTP_JITTER_SIZE]->time < rtp->latency)
+      break;
+
+    /* Skip lost packets */
+    rtp->next_seq = seq;
+  }
+}
+
+static gboolean
+melo_rtp_insert (MeloRTP *rtp, MeloRTPPacket *packet, gsize size,
+                 guint16 *missing_seq, guint16 *missing_count)
+{
+  const guchar *data = packet->data;
+  gint16 diff;
+  gsize offset;
+
+  /* Check RTP version and header size */
+  if (size < 12 || data[0] >> 6 != 2)
+    return FALSE;
+  offset = 12 + (data[0] & 0x0f) * 4;
+  if (data[0] & 0x10) {
+    if (size < offset + 4)
+      return FALSE;
+    offset += 4 + ((data[offset + 2] << 8) | data[offset + 3]) * 4;
+  }
+  if (offset > size)
+    return FALSE;
+
+  /* Remove padding: its length cannot exceed the payload */
+  if (data[0] & 0x20) {
+    if (data[size - 1] > size - offset)
+      return FALSE;
+    size -= data[size - 1];
+  }
+  if (size <= offset)
+    return FALSE;
+
+  /* Fill packet */
+  packet->seq = (data[2] << 8) | data[3];
+  packet->timestamp = GUINT32_FROM_BE (*((guint32 *) (data + 4)));
+  packet->time = g_get_monotonic_time ();
+  packet->offset = offset;
+  packet->size = size - offset;
+
+  /* First packet */
+  if (!rtp->started) {
+    rtp->next_seq = packet->seq;
+    rtp->last_seq = packet->seq - 1;
+    rtp->started = TRUE;
+  }
+
+  /* Packet is too late or duplicated */
+  diff = packet->seq - rtp->next_seq;
+  if (diff < 0 || rtp->slots[packet->seq % MELO_RTP_JITTER_SIZE])
+    return FALSE;
+
+  /* Packet is too far: restart jitter buffer from it */
+  if (diff >= MELO_RTP_JITTER_SIZE) {
+    melo_rtp_reset (rtp);
+    rtp->next_seq = packet->seq;
+    rtp->last_seq = packet->seq - 1;
+    rtp->started = TRUE;
+  }
+
+  /* Add packet and detect gap */
+  rtp->slots[packet->seq % MELO_RTP_JITTER_SIZE] = packet;
+  diff = packet->seq - rtp->last_seq;
+  if (diff > 0) {
+    if (diff > 1 && missing_seq) {
+      *missing_seq = rtp->last_seq + 1;
+      *missing_count = diff - 1;
+    }
+    rtp->last_seq = packet->seq;
+  }
+
+  return TRUE;
+}
+
+static void
+melo_rtp_add (MeloRTP *rtp, MeloRTPPacket *packet, gsize size)
+{
+  guint16 missing_seq = 0, missing_count = 0;
+
+  /* Insert packet in jitter buffer */
+  g_mutex_lock (&rtp->mutex);
+  if (!melo_rtp_insert (rtp, packet, size, &missing_seq, &missing_count))
+    melo_rtp_release (rtp, packet);
+  g_mutex_unlock (&rtp->mutex);
+
+  /* Request retransmission */
+  if (missing_count && rtp->resend_cb)
+    rtp->resend_cb (rtp, missing_seq, missing_count, rtp->resend_data);
+}
+
+static gpointer
+melo_rtp_thread_func (gpointer user_data)
+{
+  MeloRTPPacket *packets[MELO_RTP_BATCH_SIZE];
+  struct mmsghdr msgs[MELO_RTP_BATCH_SIZE];
+  struct iovec iovs[MELO_RTP_BATCH_SIZE];
+  MeloRTP *rtp = user_data;
+  gint fd, count, n, i;
+
+  /* Prepare messages */
+  memset (msgs, 0, sizeof (msgs));
+  for (i = 0; i < MELO_RTP_BATCH_SIZE; i++) {
+    iovs[i].iov_len = MELO_RTP_PACKET_SIZE;
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  fd = g_socket_get_fd (rtp->sock);
+
+  while (g_atomic_int_get (&rtp->running)) {
+    /* Wait for packets */
+    if (g_socket_condition_timed_wait (rtp->sock, G_IO_IN, MELO_RTP_TIMEOUT,
+                                       NULL, NULL)) {
+      /* Get packets from pool */
+      g_mutex_lock (&rtp->mutex);
+      n = MIN (rtp->free_count, MELO_RTP_BATCH_SIZE);
+      for (i = 0; i < n; i++) {
+        packets[i] = rtp->free[--rtp->free_count];
+        iovs[i].iov_base = packets[i]->data;
+      }
+      g_mutex_unlock (&rtp->mutex);
+
+      /* Receive a batch of packets */
+      count = n ? recvmmsg (fd, msgs, n, MSG_DONTWAIT, NULL) : 0;
+      for (i = 0; i < n; i++) {
+        if (i < count)
+          melo_rtp_add (rtp, packets[i], msgs[i].msg_len);
+        else {
+          g_mutex_lock (&rtp->mutex);
+          melo_rtp_release (rtp, packets[i]);
+          g_mutex_unlock (&rtp->mutex);
+        }
+      }
+    }
+
+    /* Play packets leaving jitter buffer */
+    g_mutex_lock (&rtp->mutex);
+    melo_rtp_process (rtp);
+    g_mutex_unlock (&rtp->mutex);
+  }
+
+  return NULL;
+}
+
+/**
+ * melo_rtp_start:
+ * @rtp: the RTP receiver
+ * @port: the UDP port on which to listen, or 0 to use any port
+ *
+ * Start to receive the RTP stream on @port and to play it on the sink. When
+ * @port is 0, the port can be retrieved with melo_rtp_get_port().
+ *
+ * Returns: %TRUE if the receiver has been started, %FALSE otherwise.
+ */
+gboolean
+melo_rtp_start (MeloRTP *rtp, guint port)
+{
+  GInetAddress *inet_addr;
+  GSocketAddress *addr;
+  gboolean ret;
+
+  g_return_val_if_fail (rtp, FALSE);
+
+  /* Already started */
+  if (rtp->sock)
+    return FALSE;
+
+  /* Open UDP socket */
+  rtp->sock = g_socket_new (G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_DATAGRAM,
+                            G_SOCKET_PROTOCOL_UDP, NULL);
+  if (!rtp->sock)
+    return FALSE;
+
+  /* Bind socket */
+  inet_addr = g_inet_address_new_any (G_SOCKET_FAMILY_IPV4);
+  addr = g_inet_socket_address_new (inet_addr, port);
+  ret = g_socket_bind (rtp->sock, addr, TRUE, NULL);
+  g_object_unref (inet_addr);
+  g_object_unref (addr);
+  if (!ret) {
+    g_clear_object (&rtp->sock);
+    return FALSE;
+  }
+  g_socket_set_blocking (rtp->sock, FALSE);
+
+  /* Start pipeline */
+  rtp->synced = FALSE;
+  gst_element_set_state (rtp->pipeline, GST_STATE_PLAYING);
+
+  /* Start receive thread */
+  rtp->running = TRUE;
+  rtp->thread = g_thread_new ("melo_rtp", melo_rtp_thread_func, rtp);
+
+  return TRUE;
+}
+
+/**
+ * melo_rtp_stop:
+ * @rtp: the RTP receiver
+ *
+ * Stop to receive the RTP stream and close the socket.
+ */
+void
+melo_rtp_stop (MeloRTP *rtp)
+{
+  g_return_if_fail (rtp);
+
+  /* Not started */
+  if (!rtp->sock)
+    return;
+
+  /* Stop receive thread */
+  g_atomic_int_set (&rtp->running, FALSE);
+  g_thread_join (rtp->thread);
+  rtp->thread = NULL;
+
+  /* Stop pipeline */
+  gst_element_set_state (rtp->pipeline, GST_STATE_NULL);
+
+  /* Close socket */
+  g_socket_close (rtp->sock, NULL);
+  g_clear_object (&rtp->sock);
+
+  /* Reset jitter buffer */
+  melo_rtp_reset (rtp);
+}
+
+/**
+ * melo_rtp_get_port:
+ * @rtp: the RTP receiver
+ *
+ * Get the UDP port on which the RTP stream is received.
+ *
+ * Returns: the port number, or 0 if the receiver is not started.
+ */
+guint
+melo_rtp_get_port (MeloRTP *rtp)
+{
+  GSocketAddress *addr;
+  guint port;
+
+  g_return_val_if_fail (rtp, 0);
+
+  if (!rtp->sock)
+    return 0;
+
+  /* Get local port */
+  addr = g_socket_get_local_address (rtp->sock, NULL);
+  if (!addr)
+    return 0;
+  port = g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (addr));
+  g_object_unref (addr);
+
+  return port;
+}
+
+/**
+ * melo_rtp_get_latency:
+ * @rtp: the RTP receiver
+ *
+ * Get the latency of the jitter buffer.
+ *
+ * Returns: the latency (in ms).
+ */
+guint
+melo_rtp_get_latency (MeloRTP *rtp)
+{
+  g_return_val_if_fail (rtp, 0);
+  return rtp->latency / G_TIME_SPAN_MILLISECOND;
+}
+
+/**
+ * melo_rtp_set_latency:
+ * @rtp: the RTP receiver
+ * @latency: the latency of the jitter buffer (in ms)
+ *
+ * Set the latency of the jitter buffer: it is the maximum time a missing packet
+ * is waited, and the delay between reception and playback of the stream. The
+ * new playback delay is applied on next melo_rtp_flush().
+ */
+void
+melo_rtp_set_latency (MeloRTP *rtp, guint latency)
+{
+  g_return_if_fail (rtp);
+
+  g_mutex_lock (&rtp->mutex);
+  rtp->latency = latency * G_TIME_SPAN_MILLISECOND;
+  g_mutex_unlock (&rtp->mutex);
+}
+
+/**
+ * melo_rtp_push_packet:
+ * @rtp: the RTP receiver
+ * @data: the RTP packet
+ * @size: the size of @data in bytes
+ *
+ * Add an RTP packet received by other means to the jitter buffer, such as a
+ * packet retransmitted on the control channel after a #MeloRTPResend call.
+ *
+ * Returns: %TRUE if the packet has been added, %FALSE otherwise.
+ */
+gboolean
+melo_rtp_push_packet (MeloRTP *rtp, const guchar *data, gsize size)
+{
+  MeloRTPPacket *packet;
+  gboolean ret;
+
+  g_return_val_if_fail (rtp && data, FALSE);
+
+  if (size > MELO_RTP_PACKET_SIZE)
+    return FALSE;
+
+  /* Copy packet and insert in jitter buffer */
+  g_mutex_lock (&rtp->mutex);
+  if (!rtp->free_count) {
+    g_mutex_unlock (&rtp->mutex);
+    return FALSE;
+  }
+  packet = rtp->free[--rtp->free_count];
+  memcpy (packet->data, data, size);
+  ret = melo_rtp_insert (rtp, packet, size, NULL, NULL);
+  if (!ret)
+    melo_rtp_release (rtp, packet);
+  g_mutex_unlock (&rtp->mutex);
+
+  return ret;
+}
+
+/**
+ * melo_rtp_flush:
+ * @rtp: the RTP receiver
+ *
+ * Drop all packets of the jitter buffer and restart timing from next packet,
+ * after a seek or a pause of the stream for instance.
+ */
+void
+melo_rtp_flush (MeloRTP *rtp)
+{
+  g_return_if_fail (rtp);
+
+  g_mutex_lock (&rtp->mutex);
+  melo_rtp_reset (rtp);
+  rtp->synced = FALSE;
+  g_mutex_unlock (&rtp->mutex);
+}
@@ -0,0 +1,90 @@
+/*
+ * melo_rtp.h: RTP audio receiver with jitter buffer
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __MELO_RTP_H__
+#define __MELO_RTP_H__
+
+#include <glib.h>
+
+#include "melo_sink.h"
+
+G_BEGIN_DECLS
+
+typedef struct _MeloRTP MeloRTP;
+
+/**
+ * MeloRTPDecode:
+ * @rtp: the RTP receiver
+ * @seq: the sequence number of the packet
+ * @timestamp: the RTP timestamp of the packet
+ * @payload: the payload of the packet
+ * @size: the size of @payload in bytes
+ * @out: the buffer to fill with decoded audio
+ * @out_size: the size of @out in bytes
+ * @user_data: the user data passed to melo_rtp_set_decode_callback()
+ *
+ * Called from the receive thread, in sequence order, for each packet leaving
+ * the jitter buffer. It should decrypt and / or decode @payload into @out, in
+ * the format set with melo_rtp_new().
+ *
+ * Returns: the size of decoded audio in bytes or -1 to drop the packet.
+ */
+typedef gssize (*MeloRTPDecode) (MeloRTP *rtp, guint16 seq, guint32 timestamp,
+                                 const guchar *payload, gsize size,
+                                 guchar *out, gsize out_size,
+                                 gpointer user_data);
+
+/**
+ * MeloRTPResend:
+ * @rtp: the RTP receiver
+ * @seq: the sequence number of the first missing packet
+ * @count: the count of missing packets
+ * @user_data: the user data passed to melo_rtp_set_resend_callback()
+ *
+ * Called from the receive thread when a gap is detected in the sequence. The
+ * implementation can request a retransmission of the missing packets on its
+ * control channel and feed them back with melo_rtp_push_packet().
+ */
+typedef void (*MeloRTPResend) (MeloRTP *rtp, guint16 seq, guint16 count,
+                               gpointer user_data);
+
+MeloRTP *melo_rtp_new (MeloSink *sink, const gchar *caps, guint clock_rate,
+                       guint latency);
+void melo_rtp_free (MeloRTP *rtp);
+
+void melo_rtp_set_decode_callback (MeloRTP *rtp, MeloRTPDecode callback,
+                                   gpointer user_data);
+void melo_rtp_set_resend_callback (MeloRTP *rtp, MeloRTPResend callback,
+                                   gpointer user_data);
+
+gboolean melo_rtp_start (MeloRTP *rtp, guint port);
+void melo_rtp_stop (MeloRTP *rtp);
+guint melo_rtp_get_port (MeloRTP *rtp);
+
+guint melo_rtp_get_latency (MeloRTP *rtp);
+void melo_rtp_set_latency (MeloRTP *rtp, guint latency);
+
+gboolean melo_rtp_push_packet (MeloRTP *rtp, const guchar *data, gsize size);
+void melo_rtp_flush (MeloRTP *rtp);
+
+G_END_DECLS
+
+#endif /* __MELO_RTP_H__ */
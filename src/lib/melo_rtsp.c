@@ -53,26 +53,40 @@
 
 #define MELO_DEFAULT_MAX_USER 5
 #define MELO_DEFAULT_BUFFER_SIZE 8192
+#define MELO_RTSP_MAX_HEADERS 32
 
 typedef enum {
   MELO_RTSP_STATE_WAIT_HEADER = 0,
   MELO_RTSP_STATE_WAIT_BODY,
-  MELO_RTSP_STATE_SEND_HEADER,
-  MELO_RTSP_STATE_SEND_BODY
+  MELO_RTSP_STATE_SEND
 } MeloRTSPSate;
 
+typedef struct {
+  const gchar *name;
+  const gchar *value;
+} MeloRTSPHeader;
+
+typedef struct {
+  GSource source;
+  MeloRTSPClient *client;
+  gpointer tag;
+} MeloRTSPSource;
+
 struct _MeloRTSPClient {
   /* Parent */
   MeloRTSP *parent;
   /* Client socket */
   GSocket *sock;
+  GSource *source;
+  GIOCondition condition;
   /* RTSP status */
   MeloRTSPSate state;
   /* RTSP variables */
   MeloRTSPMethod method;
   const gchar *method_name;
   const gchar *url;
-  GHashTable *headers;
+  MeloRTSPHeader headers[MELO_RTSP_MAX_HEADERS];
+  guint headers_count;
   guint seq;
   gsize content_length;
   gsize body_size;
@@ -84,14 +98,18 @@ struct _MeloRTSPClient {
   gchar *ip_string;
   guchar ip[4];
   guint port;
-  /* Input buffer */
+  /* Input ring buffer */
   gchar *buffer;
   gsize buffer_size;
+  gsize buffer_start;
   gsize buffer_len;
+  /* Request arena: used to unwrap ring buffer */
+  gchar *arena;
   /* Output buffer */
   gchar *out_buffer;
   gsize out_buffer_size;
   gsize out_buffer_len;
+  gsize out_sent;
   /* Packet buffer (response) */
   guchar *packet;
   gsize packet_len;
@@ -106,6 +124,9 @@ struct _MeloRTSPPrivate {
   /* Server socket */
   GSocket *sock;
   GMainContext *context;
+  /* Server thread */
+  GThread *thread;
+  GMainLoop *loop;
   /* Clients */
   GMutex mutex;
   gint users;
@@ -245,6 +266,30 @@ failed:
   return FALSE;
 }
 
+static void melo_rtsp_client_close (MeloRTSPClient *client);
+
+static void
+melo_rtsp_stop_thread (MeloRTSP *rtsp)
+{
+  MeloRTSPPrivate *priv = rtsp->priv;
+  GMainContext *context = g_main_loop_get_context (priv->loop);
+
+  /* Stop server loop */
+  g_main_loop_quit (priv->loop);
+  g_thread_join (priv->thread);
+  g_main_loop_unref (priv->loop);
+  priv->thread = NULL;
+  priv->loop = NULL;
+
+  /* Close remaining clients */
+  while (priv->clients)
+    melo_rtsp_client_close (priv->clients->data);
+
+  /* Release context: server source is destroyed and calls melo_rtsp_stop() */
+  g_main_context_unref (context);
+  priv->context = NULL;
+}
+
 /**
  * melo_rtsp_stop:
  * @rtsp: a RTSP server handle
@@ -258,6 +303,10 @@ melo_rtsp_stop (MeloRTSP *rtsp)
   MeloRTSPPrivate *priv = rtsp->priv;
   GError *err;
 
+  /* Stop server thread */
+  if (priv->thread && priv->thread != g_thread_self ())
+    melo_rtsp_stop_thread (rtsp);
+
   /* No server running */
   if (!priv->sock)
     return;
@@ -333,6 +382,10 @@ melo_rtsp_client_close (MeloRTSPClient *client)
   MeloRTSP *rtsp = client->parent;
   MeloRTSPPrivate *priv = rtsp->priv;
 
+  /* Remove client source */
+  g_source_destroy (client->source);
+  g_source_unref (client->source);
+
   /* Close client socket */
   if (client->sock) {
     g_socket_close (client->sock, NULL);
@@ -353,11 +406,9 @@ melo_rtsp_client_close (MeloRTSPClient *client)
   /* Unlock client list */
   g_mutex_unlock (&priv->mutex);
 
-  /* Free hash table for headers */
-  g_hash_table_unref (client->headers);
-
   /* Free buffers */
   g_slice_free1 (client->out_buffer_size, client->out_buffer);
+  g_slice_free1 (client->buffer_size, client->arena);
   g_slice_free1 (client->buffer_size, client->buffer);
   if (client->packet && client->packet_free)
     client->packet_free (client->packet);
@@ -398,10 +449,8 @@ melo_rtsp_extract_string (const gchar **dest, gchar **src, gsize *len,
 }
 
 static gboolean
-melo_rtsp_parse_request (MeloRTSPClient *client, gsize len)
+melo_rtsp_parse_request (MeloRTSPClient *client, gchar *buf, gsize len)
 {
-  gchar *buf = client->buffer;
-
   /* Get method name */
   if (!melo_rtsp_extract_string (&client->method_name, &buf, &len, " ", 1))
     return FALSE;
@@ -450,167 +499,292 @@ melo_rtsp_parse_request (MeloRTSPClient *client, gsize len)
     if (!melo_rtsp_extract_string (&value, &buf, &len, "\r\n", 2))
       return FALSE;
 
-    /* Add name / value pair to hash table */
-    g_hash_table_insert (client->headers, (gpointer) name, (gpointer) value);
+    /* Add name / value pair to header table (extra headers are ignored) */
+    if (client->headers_count < MELO_RTSP_MAX_HEADERS) {
+      client->headers[client->headers_count].name = name;
+      client->headers[client->headers_count++].value = value;
+    }
   }
 
   return TRUE;
 }
 
-static gboolean
-melo_rtsp_handle_client (GSocket *sock, GIOCondition condition,
-                         MeloRTSPClient *client)
+static inline gsize
+melo_rtsp_buffer_contiguous (MeloRTSPClient *client)
 {
-  MeloRTSPPrivate *priv = client->parent->priv;
-  GSource *source;
+  gsize len = client->buffer_size - client->buffer_start;
+
+  return client->buffer_len < len ? client->buffer_len : len;
+}
+
+static inline void
+melo_rtsp_buffer_consume (MeloRTSPClient *client, gsize len)
+{
+  client->buffer_len -= len;
+
+  /* Rewind ring when empty to avoid future wrapping */
+  if (!client->buffer_len)
+    client->buffer_start = 0;
+  else
+    client->buffer_start = (client->buffer_start + len) % client->buffer_size;
+}
+
+static void
+melo_rtsp_buffer_linearize (MeloRTSPClient *client)
+{
+  gsize first;
   gchar *buf;
-  gsize len;
 
-  /* Read from socket */
-  if (condition & G_IO_IN) {
-      /* Read data from socket */
-      len = g_socket_receive (sock, client->buffer + client->buffer_len,
-                              client->buffer_size - client->buffer_len,
-                              NULL, NULL);
-      if (len <= 0)
-        goto close;
-      client->buffer_len += len;
+  /* Data are already contiguous */
+  first = melo_rtsp_buffer_contiguous (client);
+  if (first == client->buffer_len)
+    return;
+
+  /* Unwrap data in arena and swap buffers: only with pipelined requests */
+  buf = client->arena;
+  memcpy (buf, client->buffer + client->buffer_start, first);
+  memcpy (buf + first, client->buffer, client->buffer_len - first);
+  client->arena = client->buffer;
+  client->buffer = buf;
+  client->buffer_start = 0;
+}
+
+static gssize
+melo_rtsp_buffer_receive (MeloRTSPClient *client)
+{
+  GInputVector vectors[2];
+  GError *err = NULL;
+  gsize end, space;
+  guint count = 1;
+  gssize len;
+
+  /* Buffer is full */
+  space = client->buffer_size - client->buffer_len;
+  if (!space)
+    return 0;
+
+  /* Fill free space of the ring, in two parts when it wraps */
+  end = (client->buffer_start + client->buffer_len) % client->buffer_size;
+  vectors[0].buffer = client->buffer + end;
+  vectors[0].size = client->buffer_size - end;
+  if (vectors[0].size >= space)
+    vectors[0].size = space;
+  else {
+    vectors[1].buffer = client->buffer;
+    vectors[1].size = space - vectors[0].size;
+    count++;
   }
 
-  /* Parse buffer */
-  switch (client->state) {
-    case MELO_RTSP_STATE_WAIT_HEADER:
-      /* Find end of header */
-      buf = g_strstr_len (client->buffer, client->buffer_len, "\r\n\r\n");
+  /* Receive data */
+  len = g_socket_receive_message (client->sock, NULL, vectors, count, NULL,
+                                  NULL, NULL, NULL, &err);
+  if (len < 0) {
+    if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK))
+      len = 0;
+    g_error_free (err);
+    return len < 0 ? -1 : 0;
+  } else if (!len)
+    return -1;
+
+  client->buffer_len += len;
+  return len;
+}
 
-      /* Not enough data to parse */
-      if (!buf)
-        break;
+static gint
+melo_rtsp_send_response (MeloRTSPClient *client)
+{
+  GOutputVector vectors[2];
+  GError *err = NULL;
+  guint count = 0;
+  gsize sent;
+  gssize len;
+
+  /* Send remaining part of header and packet in one call */
+  sent = client->out_sent;
+  if (sent < client->out_buffer_len) {
+    vectors[count].buffer = client->out_buffer + sent;
+    vectors[count++].size = client->out_buffer_len - sent;
+    sent = 0;
+  } else
+    sent -= client->out_buffer_len;
+  if (client->packet && sent < client->packet_len) {
+    vectors[count].buffer = client->packet + sent;
+    vectors[count++].size = client->packet_len - sent;
+  }
 
-      /* Parse request */
-      len = buf - client->buffer + 4;
-      if (!melo_rtsp_parse_request (client, len - 2))
-        goto failed;
+  if (count) {
+    len = g_socket_send_message (client->sock, NULL, vectors, count, NULL, 0,
+                                 0, NULL, &err);
+    if (len < 0) {
+      if (!g_error_matches (err, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK))
+        len = -1;
+      else
+        len = 0;
+      g_error_free (err);
+      if (len < 0)
+        return -1;
+    }
+    client->out_sent += len;
 
-      /* Get content length */
-      buf = g_hash_table_lookup (client->headers, "Content-Length");
-      if (buf)
-        client->content_length = strtoul (buf, NULL, 10);
-      client->body_size = client->content_length;
+    /* Not all data has been sent */
+    if (client->out_sent < client->out_buffer_len + client->packet_len)
+      return 0;
+  }
+
+  /* Free packet */
+  if (client->packet && client->packet_free)
+    client->packet_free (client->packet);
+  client->packet_free = NULL;
+  client->packet_len = 0;
+  client->packet = NULL;
 
-      /* Call request callback */
-      if (priv->request_cb)
-        priv->request_cb (client, client->method, client->url,
-                          priv->request_data, &client->user_data);
+  /* Reset output buffer */
+  client->out_buffer_len = 0;
+  client->out_sent = 0;
 
-      /* Reset request details (only available during request_cb call) */
-      g_hash_table_remove_all (client->headers);
-      client->method_name = NULL;
-      client->url = NULL;
+  return 1;
+}
 
-      /* Move body data to buffer start */
-      memmove (client->buffer, client->buffer + len, client->buffer_len - len);
-      client->buffer_len -= len;
+static gboolean
+melo_rtsp_client_watch (MeloRTSPClient *client, GIOCondition condition)
+{
+  MeloRTSPSource *source = (MeloRTSPSource *) client->source;
 
-      /* Go to next state: wait body */
-      client->state = MELO_RTSP_STATE_WAIT_BODY;
+  /* Update condition of persistent source */
+  if (client->condition != condition) {
+    client->condition = condition;
+    g_source_modify_unix_fd (client->source, source->tag, condition);
+  }
 
-      /* Not enough data yet */
-      if (client->content_length > client->buffer_len)
-        break;
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+melo_rtsp_handle_client (GSocket *sock, GIOCondition condition,
+                         MeloRTSPClient *client)
+{
+  MeloRTSPPrivate *priv = client->parent->priv;
+  gchar *buf;
+  gsize len;
+
+  /* Connection closed or in error */
+  if (condition & (G_IO_HUP | G_IO_ERR))
+    goto close;
+
+  /* Read from socket */
+  if (condition & G_IO_IN && melo_rtsp_buffer_receive (client) < 0)
+    goto close;
+
+  /* Parse buffer until more data is needed (requests can be pipelined) */
+  while (1) {
+    switch (client->state) {
+      case MELO_RTSP_STATE_WAIT_HEADER:
+        /* Header must be contiguous to be parsed in place */
+        melo_rtsp_buffer_linearize (client);
+
+        /* Find end of header */
+        buf = g_strstr_len (client->buffer + client->buffer_start,
+                            client->buffer_len, "\r\n\r\n");
+
+        /* Not enough data to parse */
+        if (!buf) {
+          /* Header is bigger than buffer */
+          if (client->buffer_len == client->buffer_size)
+            goto failed;
+          return melo_rtsp_client_watch (client, G_IO_IN | G_IO_PRI);
+        }
+
+        /* Parse request */
+        len = buf - (client->buffer + client->buffer_start) + 4;
+        if (!melo_rtsp_parse_request (client,
+                                      client->buffer + client->buffer_start,
+                                      len - 2))
+          goto failed;
+
+        /* Get content length */
+        client->content_length = 0;
+        buf = (gchar *) melo_rtsp_get_header (client, "Content-Length");
+        if (buf)
+          client->content_length = strtoul (buf, NULL, 10);
+        client->body_size = client->content_length;
+
+        /* Call request callback */
+        if (priv->request_cb)
+          priv->request_cb (client, client->method, client->url,
+                            priv->request_data, &client->user_data);
+
+        /* Reset request details (only available during request_cb call) */
+        client->headers_count = 0;
+        client->method_name = NULL;
+        client->url = NULL;
+
+        /* Release header from buffer */
+        melo_rtsp_buffer_consume (client, len);
+
+        /* Go to next state: wait body */
+        client->state = MELO_RTSP_STATE_WAIT_BODY;
+
+      case MELO_RTSP_STATE_WAIT_BODY:
+        if (client->body_size <= client->buffer_size) {
+          /* Body fits in buffer: provide it in one chunk */
+          if (client->content_length > client->buffer_len)
+            return melo_rtsp_client_watch (client, G_IO_IN | G_IO_PRI);
+
+          if (client->content_length) {
+            if (melo_rtsp_buffer_contiguous (client) < client->content_length)
+              melo_rtsp_buffer_linearize (client);
+
+            if (priv->read_cb)
+              priv->read_cb (client,
+                             (guchar *) client->buffer + client->buffer_start,
+                             client->content_length, TRUE, priv->read_data,
+                             &client->user_data);
+            melo_rtsp_buffer_consume (client, client->content_length);
+            client->content_length = 0;
+          }
+        } else {
+          /* Provide chunks directly from buffer as they are received */
+          while (client->content_length && client->buffer_len) {
+            len = melo_rtsp_buffer_contiguous (client);
+            if (len > client->content_length)
+              len = client->content_length;
+
+            if (priv->read_cb)
+              priv->read_cb (client,
+                             (guchar *) client->buffer + client->buffer_start,
+                             len, len == client->content_length,
+                             priv->read_data, &client->user_data);
+            melo_rtsp_buffer_consume (client, len);
+            client->content_length -= len;
+          }
+
+          if (client->content_length)
+            return melo_rtsp_client_watch (client, G_IO_IN | G_IO_PRI);
+        }
+
+        /* No response */
+        if (client->out_buffer_len == 0)
+          melo_rtsp_init_response (client, 404, "Not found");
 
-    case MELO_RTSP_STATE_WAIT_BODY:
-      if (client->content_length) {
-        /* Get body data */
-        if (client->content_length <= client->buffer_len) {
-          /* Last chunck */
-          if (priv->read_cb)
-            priv->read_cb (client, (guchar *) client->buffer,
-                           client->content_length, TRUE, priv->read_data,
-                           &client->user_data);
-
-          /* Move remaining data to buffer start */
-          memmove (client->buffer, client->buffer + client->content_length,
-                   client->buffer_len - client->content_length);
-          client->buffer_len -= client->content_length;
-          client->content_length = 0;
-        } else if (client->buffer_len == client->buffer_size) {
-          /* Next chunk */
-          if (priv->read_cb)
-            priv->read_cb (client, (guchar *) client->buffer,
-                           client->buffer_size, FALSE, priv->read_data,
-                           &client->user_data);
-
-          /* Reset buffer */
-          client->content_length -= client->buffer_size;
-          client->buffer_len = 0;
-          break;
-        } else
-          break;
-      }
-
-      /* No response */
-      if (client->out_buffer_len == 0)
-        melo_rtsp_init_response (client, 404, "Not found");
-
-      /* Go to next state: send reply header */
-      client->state = MELO_RTSP_STATE_SEND_HEADER;
-
-      /* Add source to wait socket becomes writable */
-      source = g_socket_create_source (sock, G_IO_OUT, NULL);
-      g_source_set_callback (source, (GSourceFunc) melo_rtsp_handle_client,
-                             client, NULL);
-      g_source_attach (source, priv->context);
-      return G_SOURCE_REMOVE;
-
-    case MELO_RTSP_STATE_SEND_HEADER:
-      if (client->out_buffer_len > 0) {
-        len = g_socket_send (sock, client->out_buffer, client->out_buffer_len,
-                             NULL, NULL);
-        if (len <= 0)
-          goto close;
-        client->out_buffer_len -= len;
-        if (client->out_buffer_len > 0)
-          break;
-      }
-
-      /* Go to next state: send reply body */
-      client->state = MELO_RTSP_STATE_SEND_BODY;
-      break;
-    case MELO_RTSP_STATE_SEND_BODY:
-      if (client->packet) {
-        if (client->packet_len > 0) {
-          len = g_socket_send (sock, (gchar *) client->packet,
-                               client->packet_len, NULL, NULL);
-          if (len <= 0)
+        /* Go to next state: send reply */
+        client->state = MELO_RTSP_STATE_SEND;
+        client->out_sent = 0;
+
+      case MELO_RTSP_STATE_SEND:
+        /* Try to send immediately: socket is generally writable */
+        switch (melo_rtsp_send_response (client)) {
+          case -1:
             goto close;
-          client->packet_len -= len;
-          if (client->packet_len > 0)
-            break;
+          case 0:
+            return melo_rtsp_client_watch (client, G_IO_OUT);
         }
 
-        /* Free packet */
-        if (client->packet_free)
-          client->packet_free (client->packet);
-        client->packet_free = NULL;
-        client->packet_len = 0;
-        client->packet = NULL;
-      }
-
-      /* Go to next state: wait for next request */
-      client->state = MELO_RTSP_STATE_WAIT_HEADER;
-
-      /* Add source to wait next incoming packet */
-      source = g_socket_create_source (sock, G_IO_IN | G_IO_PRI, NULL);
-      g_source_set_callback (source, (GSourceFunc) melo_rtsp_handle_client,
-                             client, NULL);
-      g_source_attach (source, priv->context);
-      g_source_unref (source);
-      return G_SOURCE_REMOVE;
+        /* Go to next state: wait for next request */
+        client->state = MELO_RTSP_STATE_WAIT_HEADER;
+        break;
+    }
   }
 
-  return G_SOURCE_CONTINUE;
-
 failed:
   g_socket_send (sock, "RTSP/1.0 400 Bad request\r\n\r\n", 28, NULL,
                  NULL);
@@ -619,6 +793,21 @@ close:
   return G_SOURCE_REMOVE;
 }
 
+static gboolean
+melo_rtsp_source_dispatch (GSource *source, GSourceFunc callback,
+                           gpointer user_data)
+{
+  MeloRTSPSource *rsource = (MeloRTSPSource *) source;
+
+  return melo_rtsp_handle_client (rsource->client->sock,
+                                  g_source_query_unix_fd (source, rsource->tag),
+                                  rsource->client);
+}
+
+static GSourceFuncs melo_rtsp_source_funcs = {
+  .dispatch = melo_rtsp_source_dispatch,
+};
+
 static gboolean
 melo_rtsp_get_address (GSocketAddress *addr, guchar *ip, gchar **ip_string,
                        guint *port, gchar **name)
@@ -707,7 +896,8 @@ melo_rtsp_accept (GSocket *server_sock, GIOCondition condition, MeloRTSP *rtsp)
                          &client->hostname);
   g_object_unref (addr);
 
-  /* Allocate buffer */
+  /* Allocate ring buffer */
+  client->buffer_start = 0;
   client->buffer_len = 0;
   client->buffer_size = MELO_DEFAULT_BUFFER_SIZE;
   client->buffer = g_slice_alloc (client->buffer_size);
@@ -717,8 +907,8 @@ melo_rtsp_accept (GSocket *server_sock, GIOCondition condition, MeloRTSP *rtsp)
   client->out_buffer_size = MELO_DEFAULT_BUFFER_SIZE;
   client->out_buffer = g_slice_alloc (client->out_buffer_size);
 
-  /* Create hash table for headers */
-  client->headers = g_hash_table_new (g_str_hash, g_str_equal);
+  /* Allocate request arena */
+  client->arena = g_slice_alloc (client->buffer_size);
 
   /* Lock client list */
   g_mutex_lock (&priv->mutex);
@@ -730,12 +920,15 @@ melo_rtsp_accept (GSocket *server_sock, GIOCondition condition, MeloRTSP *rtsp)
   /* Unlock client list */
   g_mutex_unlock (&priv->mutex);
 
-  /* Create and attach source to wait next incoming packet */
-  source = g_socket_create_source (sock, G_IO_IN | G_IO_PRI, NULL);
-  g_source_set_callback (source, (GSourceFunc) melo_rtsp_handle_client, client,
-                         NULL);
+  /* Create and attach persistent source to wait next incoming packet */
+  client->condition = G_IO_IN | G_IO_PRI;
+  source = g_source_new (&melo_rtsp_source_funcs, sizeof (MeloRTSPSource));
+  ((MeloRTSPSource *) source)->client = client;
+  ((MeloRTSPSource *) source)->tag = g_source_add_unix_fd (source,
+                                                 g_socket_get_fd (sock),
+                                                 client->condition);
   g_source_attach (source, priv->context);
-  g_source_unref (source);
+  client->source = source;
 
 exit:
   return G_SOURCE_CONTINUE;
@@ -785,6 +978,56 @@ melo_rtsp_attach (MeloRTSP *rtsp, GMainContext *context)
   return id;
 }
 
+static gpointer
+melo_rtsp_thread_func (gpointer user_data)
+{
+  GMainLoop *loop = user_data;
+  GMainContext *context = g_main_loop_get_context (loop);
+
+  /* Run server loop until stop */
+  g_main_context_push_thread_default (context);
+  g_main_loop_run (loop);
+  g_main_context_pop_thread_default (context);
+
+  return NULL;
+}
+
+/**
+ * melo_rtsp_attach_thread:
+ * @rtsp: a RTSP server handle
+ *
+ * Attach the RTSP server instance to a new #GMainContext run by a dedicated
+ * thread. The requests are then handled without going through the main loop
+ * of the application and all the callbacks are called from this thread.
+ * The thread is stopped with melo_rtsp_stop().
+ *
+ * Returns: %TRUE if the server thread has been started, %FALSE otherwise.
+ */
+gboolean
+melo_rtsp_attach_thread (MeloRTSP *rtsp)
+{
+  MeloRTSPPrivate *priv = rtsp->priv;
+  GMainContext *context;
+
+  /* Already attached */
+  if (priv->context)
+    return FALSE;
+
+  /* Attach server to a new context */
+  context = g_main_context_new ();
+  if (!melo_rtsp_attach (rtsp, context)) {
+    g_main_context_unref (context);
+    priv->context = NULL;
+    return FALSE;
+  }
+
+  /* Start server thread */
+  priv->loop = g_main_loop_new (context, FALSE);
+  priv->thread = g_thread_new ("melo_rtsp", melo_rtsp_thread_func, priv->loop);
+
+  return TRUE;
+}
+
 /**
  * melo_rtsp_get_method:
  * @client: a RTSP client handle
@@ -828,7 +1071,13 @@ melo_rtsp_get_method_name (MeloRTSPClient *client)
 const gchar *
 melo_rtsp_get_header (MeloRTSPClient *client, const gchar *name)
 {
-  return g_hash_table_lookup (client->headers, name);
+  guint i;
+
+  for (i = 0; i < client->headers_count; i++)
+    if (!g_ascii_strcasecmp (client->headers[i].name, name))
+      return client->headers[i].value;
+
+  return NULL;
 }
 
 /**
@@ -1024,6 +1273,7 @@ melo_rtsp_set_response (MeloRTSPClient *client, const gchar *response)
 
   /* Copy response */
   memcpy (client->out_buffer, response, len);
+  client->out_buffer_len = len;
 
   return TRUE;
 }
@@ -0,0 +1,524 @@
+/*
+ * melo_sched.c: Scheduling of audio and background threads
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include "melo_sched.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/**
+ * SECTION:melo_sched
+ * @title: MeloSched
+ * @short_description: Scheduling of audio and background threads
+ *
+ * #MeloSched gives the audio streaming threads a higher priority than the
+ * other threads of Melo, in order to avoid dropouts when the CPU is busy,
+ * during a library scan for instance.
+ *
+ * The streaming threads of a pipeline are promoted when they start, by
+ * watching the bus of the pipeline with melo_sched_watch_bus(): the
+ * #GST_MESSAGE_STREAM_STATUS messages are posted synchronously from the
+ * streaming thread, so the scheduling can be changed directly from the message
+ * handler. The audio threads can be moved to a real-time policy (SCHED_FIFO or
+ * SCHED_RR), or to a lower nice level, and pinned to some CPUs. The previous
+ * scheduling is restored when the thread leaves the pipeline, since the
+ * threads are shared between all GStreamer pipelines.
+ *
+ * The background threads, as the file indexer or the discoverer workers, can
+ * be demoted with melo_sched_demote_thread(): they are pinned to other CPUs
+ * and / or moved to the idle policy.
+ *
+ * The real-time policies need the CAP_SYS_NICE capability or a suitable
+ * RLIMIT_RTPRIO limit: on failure, a warning is printed once and the thread
+ * keeps its default scheduling. The settings are applied to the threads
+ * started after the call.
+ */
+
+/* Maximum number of CPUs supported for affinity */
+#define MELO_SCHED_CPUS_MAX 64
+
+/* Nice level of background threads when idle policy is not available */
+#define MELO_SCHED_BACKGROUND_NICE 19
+
+typedef struct {
+  int policy;
+  struct sched_param param;
+  gint nice;
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+  cpu_set_t cpus;
+#endif
+} MeloSchedState;
+
+static const gchar *melo_sched_policies[MELO_SCHED_POLICY_COUNT] = {
+  [MELO_SCHED_POLICY_NORMAL] = "normal",
+  [MELO_SCHED_POLICY_NICE] = "nice",
+  [MELO_SCHED_POLICY_FIFO] = "fifo",
+  [MELO_SCHED_POLICY_RR] = "rr",
+};
+
+/* Scheduling settings */
+G_LOCK_DEFINE_STATIC (melo_sched_mutex);
+static MeloSchedPolicy melo_sched_audio_policy = MELO_SCHED_POLICY_NORMAL;
+static gint melo_sched_audio_priority = 20;
+static gint melo_sched_audio_nice = -10;
+static guint64 melo_sched_audio_cpus;
+static guint64 melo_sched_background_cpus;
+static gboolean melo_sched_background_idle;
+static gboolean melo_sched_warned;
+
+/* Scheduling of promoted or demoted thread before change */
+static GPrivate melo_sched_state = G_PRIVATE_INIT (g_free);
+
+static void
+melo_sched_warn (const gchar *what, int err)
+{
+  gboolean warned;
+
+  /* Print warning only once */
+  G_LOCK (melo_sched_mutex);
+  warned = melo_sched_warned;
+  melo_sched_warned = TRUE;
+  G_UNLOCK (melo_sched_mutex);
+
+  if (!warned)
+    g_warning ("failed to set %s of thread: %s", what, g_strerror (err));
+}
+
+static gint
+melo_sched_get_nice (void)
+{
+#ifdef __linux__
+  /* On Linux, the nice level is a per-thread attribute */
+  return getpriority (PRIO_PROCESS, syscall (SYS_gettid));
+#else
+  return 0;
+#endif
+}
+
+static void
+melo_sched_set_nice (gint nice)
+{
+#ifdef __linux__
+  if (setpriority (PRIO_PROCESS, syscall (SYS_gettid), nice) < 0)
+    melo_sched_warn ("nice level", errno);
+#endif
+}
+
+static void
+melo_sched_set_policy (int policy, gint priority)
+{
+  struct sched_param param;
+  int ret;
+
+  /* Set policy and its priority */
+  memset (&param, 0, sizeof (param));
+  param.sched_priority = priority;
+  ret = pthread_setschedparam (pthread_self (), policy, &param);
+  if (ret)
+    melo_sched_warn ("scheduling policy", ret);
+}
+
+static void
+melo_sched_set_cpus (guint64 mask)
+{
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+  cpu_set_t cpus;
+  guint i;
+  int ret;
+
+  /* Keep current affinity */
+  if (!mask)
+    return;
+
+  /* Pin thread to CPUs */
+  CPU_ZERO (&cpus);
+  for (i = 0; i < MELO_SCHED_CPUS_MAX; i++)
+    if (mask & (G_GUINT64_CONSTANT (1) << i))
+      CPU_SET (i, &cpus);
+  ret = pthread_setaffinity_np (pthread_self (), sizeof (cpus), &cpus);
+  if (ret)
+    melo_sched_warn ("CPU affinity", ret);
+#endif
+}
+
+/**
+ * melo_sched_policy_to_string:
+ * @policy: the scheduling policy
+ *
+ * Get the name of a scheduling policy.
+ *
+ * Returns: the name of the scheduling policy, or %NULL if invalid.
+ */
+const gchar *
+melo_sched_policy_to_string (MeloSchedPolicy policy)
+{
+  if (policy >= MELO_SCHED_POLICY_COUNT)
+    return NULL;
+  return melo_sched_policies[policy];
+}
+
+/**
+ * melo_sched_policy_from_string:
+ * @name: the name of a scheduling policy
+ *
+ * Get a scheduling policy from its name ("normal", "nice", "fifo" or "rr").
+ *
+ * Returns: the scheduling policy, or MELO_SCHED_POLICY_NORMAL if @name is
+ * unknown.
+ */
+MeloSchedPolicy
+melo_sched_policy_from_string (const gchar *name)
+{
+  MeloSchedPolicy policy;
+
+  for (policy = 0; policy < MELO_SCHED_POLICY_COUNT; policy++)
+    if (!g_strcmp0 (name, melo_sched_policies[policy]))
+      return policy;
+
+  return MELO_SCHED_POLICY_NORMAL;
+}
+
+/**
+ * melo_sched_cpus_from_string:
+ * @cpus: a list of CPUs, as "1" or "0,2-3"
+ * @mask: a location for the CPU mask
+ *
+ * Parse a list of CPU numbers and ranges separated by commas into a CPU mask,
+ * where bit N is set for CPU N. An empty or %NULL list gives a mask of 0,
+ * meaning all CPUs.
+ *
+ * Returns: %TRUE if the list is valid, %FALSE otherwise.
+ */
+gboolean
+melo_sched_cpus_from_string (const gchar *cpus, guint64 *mask)
+{
+  gboolean ret = TRUE;
+  gchar **list, **l;
+  guint64 m = 0;
+
+  /* All CPUs */
+  *mask = 0;
+  if (!cpus || *cpus == '\0')
+    return TRUE;
+
+  /* Parse list */
+  list = g_strsplit (cpus, ",", -1);
+  for (l = list; *l; l++) {
+    guint64 first, last;
+    gchar *s, *end;
+
+    /* Parse first CPU */
+    s = g_strstrip (*l);
+    first = last = g_ascii_strtoull (s, &end, 10);
+    if (end == s) {
+      ret = FALSE;
+      break;
+    }
+
+    /* Parse last CPU of range */
+    if (*end == '-') {
+      s = end + 1;
+      last = g_ascii_strtoull (s, &end, 10);
+      if (end == s) {
+        ret = FALSE;
+        break;
+      }
+    }
+
+    /* Check range */
+    if (*end != '\0' || first > last || last >= MELO_SCHED_CPUS_MAX) {
+      ret = FALSE;
+      break;
+    }
+
+    /* Add CPUs to mask */
+    for (; first <= last; first++)
+      m |= G_GUINT64_CONSTANT (1) << first;
+  }
+  g_strfreev (list);
+
+  if (ret)
+    *mask = m;
+
+  return ret;
+}
+
+/**
+ * melo_sched_set_audio_policy:
+ * @policy: the scheduling policy of audio threads
+ * @priority: the real-time priority for #MELO_SCHED_POLICY_FIFO and
+ *    #MELO_SCHED_POLICY_RR, from 1 to 99
+ * @nice: the nice level for #MELO_SCHED_POLICY_NICE, from -20 to 19
+ *
+ * Set the scheduling applied by melo_sched_promote_thread() to the audio
+ * streaming threads.
+ */
+void
+melo_sched_set_audio_policy (MeloSchedPolicy policy, gint priority, gint nice)
+{
+  G_LOCK (melo_sched_mutex);
+  melo_sched_audio_policy = policy < MELO_SCHED_POLICY_COUNT ? policy :
+                                                      MELO_SCHED_POLICY_NORMAL;
+  melo_sched_audio_priority = CLAMP (priority, 1, 99);
+  melo_sched_audio_nice = CLAMP (nice, -20, 19);
+  melo_sched_warned = FALSE;
+  G_UNLOCK (melo_sched_mutex);
+}
+
+/**
+ * melo_sched_set_audio_cpus:
+ * @mask: the CPU mask of audio threads, or 0 for all CPUs
+ *
+ * Set the CPUs on which the audio streaming threads are pinned by
+ * melo_sched_promote_thread().
+ */
+void
+melo_sched_set_audio_cpus (guint64 mask)
+{
+  G_LOCK (melo_sched_mutex);
+  melo_sched_audio_cpus = mask;
+  melo_sched_warned = FALSE;
+  G_UNLOCK (melo_sched_mutex);
+}
+
+/**
+ * melo_sched_set_background_cpus:
+ * @mask: the CPU mask of background threads, or 0 for all CPUs
+ *
+ * Set the CPUs on which the background threads are pinned by
+ * melo_sched_demote_thread().
+ */
+void
+melo_sched_set_background_cpus (guint64 mask)
+{
+  G_LOCK (melo_sched_mutex);
+  melo_sched_background_cpus = mask;
+  melo_sched_warned = FALSE;
+  G_UNLOCK (melo_sched_mutex);
+}
+
+/**
+ * melo_sched_set_background_idle:
+ * @enable: set to %TRUE to run background threads at idle priority
+ *
+ * Set if melo_sched_demote_thread() moves the background threads to the idle
+ * policy (SCHED_IDLE), or to the lowest nice level when not available.
+ */
+void
+melo_sched_set_background_idle (gboolean enable)
+{
+  G_LOCK (melo_sched_mutex);
+  melo_sched_background_idle = enable;
+  melo_sched_warned = FALSE;
+  G_UNLOCK (melo_sched_mutex);
+}
+
+static void
+melo_sched_save_thread (void)
+{
+  MeloSchedState *state;
+
+  /* Save current scheduling, only once if thread is changed again */
+  if (g_private_get (&melo_sched_state))
+    return;
+
+  state = g_new0 (MeloSchedState, 1);
+  pthread_getschedparam (pthread_self (), &state->policy, &state->param);
+  state->nice = melo_sched_get_nice ();
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+  pthread_getaffinity_np (pthread_self (), sizeof (state->cpus), &state->cpus);
+#endif
+  g_private_set (&melo_sched_state, state);
+}
+
+/**
+ * melo_sched_promote_thread:
+ *
+ * Apply the audio scheduling to the calling thread. The previous scheduling is
+ * saved and can be restored with melo_sched_restore_thread().
+ */
+void
+melo_sched_promote_thread (void)
+{
+  MeloSchedPolicy policy;
+  gint priority, nice;
+  guint64 cpus;
+
+  /* Get audio scheduling */
+  G_LOCK (melo_sched_mutex);
+  policy = melo_sched_audio_policy;
+  priority = melo_sched_audio_priority;
+  nice = melo_sched_audio_nice;
+  cpus = melo_sched_audio_cpus;
+  G_UNLOCK (melo_sched_mutex);
+
+  /* Nothing to do */
+  if (policy == MELO_SCHED_POLICY_NORMAL && !cpus)
+    return;
+
+  /* Save current scheduling */
+  melo_sched_save_thread ();
+
+  /* Pin thread to audio CPUs */
+  melo_sched_set_cpus (cpus);
+
+  /* Set scheduling */
+  switch (policy) {
+    case MELO_SCHED_POLICY_NICE:
+      melo_sched_set_nice (nice);
+      break;
+    case MELO_SCHED_POLICY_FIFO:
+      melo_sched_set_policy (SCHED_FIFO, priority);
+      break;
+    case MELO_SCHED_POLICY_RR:
+      melo_sched_set_policy (SCHED_RR, priority);
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * melo_sched_restore_thread:
+ *
+ * Restore the scheduling of the calling thread saved by
+ * melo_sched_promote_thread() or melo_sched_demote_thread(). If the thread has
+ * not been promoted or demoted, nothing is done.
+ */
+void
+melo_sched_restore_thread (void)
+{
+  MeloSchedState *state;
+
+  /* Thread not promoted or demoted */
+  state = g_private_get (&melo_sched_state);
+  if (!state)
+    return;
+
+  /* Restore scheduling */
+  pthread_setschedparam (pthread_self (), state->policy, &state->param);
+#ifdef __linux__
+  setpriority (PRIO_PROCESS, syscall (SYS_gettid), state->nice);
+#endif
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+  pthread_setaffinity_np (pthread_self (), sizeof (state->cpus), &state->cpus);
+#endif
+
+  /* Free saved scheduling */
+  g_private_replace (&melo_sched_state, NULL);
+}
+
+/**
+ * melo_sched_demote_thread:
+ *
+ * Apply the background scheduling to the calling thread. It should be called
+ * at start of threads doing heavy work in background, as the file indexer. The
+ * previous scheduling is saved and can be restored with
+ * melo_sched_restore_thread(), for threads taken from a pool.
+ */
+void
+melo_sched_demote_thread (void)
+{
+  gboolean idle;
+  guint64 cpus;
+
+  /* Get background scheduling */
+  G_LOCK (melo_sched_mutex);
+  idle = melo_sched_background_idle;
+  cpus = melo_sched_background_cpus;
+  G_UNLOCK (melo_sched_mutex);
+
+  /* Save current scheduling */
+  melo_sched_save_thread ();
+
+  /* Pin thread to background CPUs */
+  melo_sched_set_cpus (cpus);
+
+  /* Run thread only when CPU is idle */
+  if (idle) {
+#ifdef SCHED_IDLE
+    struct sched_param param;
+
+    memset (&param, 0, sizeof (param));
+    if (!pthread_setschedparam (pthread_self (), SCHED_IDLE, &param))
+      return;
+#endif
+    melo_sched_set_nice (MELO_SCHED_BACKGROUND_NICE);
+  }
+}
+
+static void
+melo_sched_stream_status (GstBus *bus, GstMessage *msg, gpointer user_data)
+{
+  GstStreamStatusType type;
+  GstElement *owner;
+
+  /* Message is posted from the streaming thread */
+  gst_message_parse_stream_status (msg, &type, &owner);
+  if (type == GST_STREAM_STATUS_TYPE_ENTER)
+    melo_sched_promote_thread ();
+  else if (type == GST_STREAM_STATUS_TYPE_LEAVE)
+    melo_sched_restore_thread ();
+}
+
+/**
+ * melo_sched_watch_bus:
+ * @bus: the #GstBus of an audio pipeline
+ *
+ * Promote all streaming threads of the pipeline owning @bus with
+ * melo_sched_promote_thread() when they start, and restore their scheduling
+ * when they stop. The synchronous message emission is enabled on @bus.
+ */
+void
+melo_sched_watch_bus (GstBus *bus)
+{
+  gst_bus_enable_sync_message_emission (bus);
+  g_signal_connect (bus, "sync-message::stream-status",
+                    G_CALLBACK (melo_sched_stream_status), NULL);
+}
+
+/**
+ * melo_sched_unwatch_bus:
+ * @bus: a #GstBus watched with melo_sched_watch_bus()
+ *
+ * Stop promoting the streaming threads of the pipeline owning @bus.
+ */
+void
+melo_sched_unwatch_bus (GstBus *bus)
+{
+  g_signal_handlers_disconnect_by_func (bus,
+                                        G_CALLBACK (melo_sched_stream_status),
+                                        NULL);
+  gst_bus_disable_sync_message_emission (bus);
+}
@@ -0,0 +1,64 @@
+/*
+ * melo_sched.h: Scheduling of audio and background threads
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __MELO_SCHED_H__
+#define __MELO_SCHED_H__
+
+#include <glib.h>
+#include <gst/gst.h>
+
+/**
+ * MeloSchedPolicy:
+ * @MELO_SCHED_POLICY_NORMAL: keep default scheduling
+ * @MELO_SCHED_POLICY_NICE: raise the nice level of the thread
+ * @MELO_SCHED_POLICY_FIFO: use the real-time SCHED_FIFO policy
+ * @MELO_SCHED_POLICY_RR: use the real-time SCHED_RR policy
+ * @MELO_SCHED_POLICY_COUNT: number of scheduling policies
+ *
+ * The scheduling policy applied to audio streaming threads.
+ */
+typedef enum {
+  MELO_SCHED_POLICY_NORMAL = 0,
+  MELO_SCHED_POLICY_NICE,
+  MELO_SCHED_POLICY_FIFO,
+  MELO_SCHED_POLICY_RR,
+
+  /*< private >*/
+  MELO_SCHED_POLICY_COUNT
+} MeloSchedPolicy;
+
+const gchar *melo_sched_policy_to_string (MeloSchedPolicy policy);
+MeloSchedPolicy melo_sched_policy_from_string (const gchar *name);
+gboolean melo_sched_cpus_from_string (const gchar *cpus, guint64 *mask);
+
+void melo_sched_set_audio_policy (MeloSchedPolicy policy, gint priority,
+                                  gint nice);
+void melo_sched_set_audio_cpus (guint64 mask);
+void melo_sched_set_background_cpus (guint64 mask);
+void melo_sched_set_background_idle (gboolean enable);
+
+void melo_sched_promote_thread (void);
+void melo_sched_restore_thread (void);
+void melo_sched_demote_thread (void);
+void melo_sched_watch_bus (GstBus *bus);
+void melo_sched_unwatch_bus (GstBus *bus);
+
+#endif /* __MELO_SCHED_H__ */
@@ -19,7 +19,18 @@
  * Boston, MA  02110-1301, USA.
  */
 
+#include <string.h>
+#include <time.h>
+
+#include <gst/app/app.h>
+#include <gst/net/net.h>
+
+#include "melo_avahi.h"
+#include "melo_config.h"
+#include "melo_event.h"
+#include "melo_sched.h"
 #include "melo_sink.h"
+#include "melo_sink_stream.h"
 
 /**
  * SECTION:melo_sink
@@ -41,29 +52,116 @@
  *
  * The function melo_sink_get_gst_sink() is intended to provide a sink
  * compatible #GstElement to be embedded in a full audio pipeline. The audio
- * mixing and control is then hided by the #MeloSink implementation.
+ * mixing and control is then hided by the #MeloSink implementation: all the
+ * #MeloSink instances are fed into a single main pipeline where an audiomixer
+ * element mixes the streams before the only audio output of the program. Then,
+ * only one sound card device is opened, even if several players are playing at
+ * the same time.
  *
  * In addition to provide a common interface for all audio sinks, the #MeloSink
  * embed a mechanism to save and restore each individual volume / mute settings
  * of the #MeloSink instances. This settings are saved to a key file, 10 seconds
  * after value update in order to reduce file I/O.
  *
+ * Several Melo instances can play the same audio in sync with the multi-room
+ * mode (see melo_sink_set_main_multiroom()): a master instance streams its
+ * main mix over RTP to the receivers found with Zeroconf, and shares its clock
+ * with a #GstNetTimeProvider. The receivers mix the stream with their own
+ * sinks and play it with the same clock, base time and latency as the
+ * master.
+ *
+ * Health statistics are kept for each #MeloSink and for the main mixer (see
+ * melo_sink_get_stats()): underruns, dropped and late buffers, latency, fill
+ * level of the main mixer input and CPU time of the streaming thread. They are
+ * checked every second and a #MELO_EVENT_SINK_STATS event is sent when the
+ * audio is degraded, to help understanding a stutter.
+ *
  * Before any #MeloPlayer instantiation, the melo_sink_main_init() must be
  * called once in order to initialize internal mixer and main audio sink. After
  * user, when all instances of #MeloPlayer have been released, the function
  * melo_sink_main_release() should be called.
  */
 
+/* Latency profiles: buffer and period of sound card (in us) and maximum data
+ * queued between a sink and the main mixer (in ms)
+ */
+static const struct {
+  const gchar *name;
+  gint64 buffer_time;
+  gint64 latency_time;
+  guint queue_time;
+} melo_sink_latencies[MELO_SINK_LATENCY_COUNT] = {
+  [MELO_SINK_LATENCY_DEFAULT] = { "default", 200000, 10000, 100 },
+  [MELO_SINK_LATENCY_LOW] = { "low", 20000, 5000, 10 },
+  [MELO_SINK_LATENCY_POWER_SAVE] = { "power_save", 1000000, 50000, 500 },
+};
+
+/* Multi-room modes */
+static const gchar *melo_sink_multirooms[MELO_SINK_MULTIROOM_COUNT] = {
+  [MELO_SINK_MULTIROOM_NONE] = "none",
+  [MELO_SINK_MULTIROOM_MASTER] = "master",
+  [MELO_SINK_MULTIROOM_RECEIVER] = "receiver",
+};
+
+/* Multi-room network ports (RTCP is sent on RTP port + 1) and services */
+#define MELO_SINK_MULTIROOM_CLOCK_PORT 5640
+#define MELO_SINK_MULTIROOM_RTP_PORT 5642
+#define MELO_SINK_MULTIROOM_MASTER_TYPE "_melo-master._udp"
+#define MELO_SINK_MULTIROOM_RECEIVER_TYPE "_melo-room._udp"
+#define MELO_SINK_MULTIROOM_SCAN_PERIOD 2
+
 /* Main audio mixer pipeline */
 G_LOCK_DEFINE_STATIC (melo_sink_mutex);
+static GstElement *melo_sink_pipeline;
+static GstElement *melo_sink_mixer;
+static GstElement *melo_sink_filter;
+static GstElement *melo_sink_audiosink;
+static guint melo_sink_bus_watch;
+static MeloSinkLatency melo_sink_latency;
 static gdouble melo_sink_volume = 1.0;
 static gboolean melo_sink_mute;
 static GstCaps *melo_sink_caps;
+static gint melo_sink_rate;
+static gint melo_sink_channels;
+static gboolean melo_sink_passthrough;
+static GstCaps *melo_sink_passthrough_caps;
+static guint melo_sink_passthrough_id;
 static GHashTable *melo_sink_hash;
 static GList *melo_sink_list;
 static GKeyFile *melo_sink_store;
 static gchar *melo_sink_store_file;
-static guint melo_sink_store_timer;
+
+/* Multi-room output */
+static MeloSinkMultiroom melo_sink_multiroom;
+static gint melo_sink_multiroom_latency;
+static GstElement *melo_sink_tee;
+static GstElement *melo_sink_net_bin;
+static GstPad *melo_sink_net_pad;
+static GstClock *melo_sink_net_clock;
+static GstClockTime melo_sink_net_base_time;
+static GstNetTimeProvider *melo_sink_net_provider;
+static MeloAvahi *melo_sink_avahi;
+static const MeloAvahiService *melo_sink_avahi_service;
+static gchar *melo_sink_net_master;
+static guint melo_sink_net_timer;
+static guint melo_sink_net_generation;
+
+/* Health statistics: check period (in s), gap in a mixer input over which the
+ * audiomixer inserts silence and under which it is a pause (in ms), and fill
+ * level of a mixer input considered as too high (in percent)
+ */
+#define MELO_SINK_STATS_PERIOD 1
+#define MELO_SINK_STATS_GAP_MIN 40
+#define MELO_SINK_STATS_GAP_MAX 1000
+#define MELO_SINK_STATS_LEVEL_HIGH 90
+
+/* Main mixer health statistics */
+G_LOCK_DEFINE_STATIC (melo_sink_stats_mutex);
+static MeloSinkStats melo_sink_stats;
+static MeloSinkStats melo_sink_stats_last;
+static GstClockTime melo_sink_stats_latency = GST_CLOCK_TIME_NONE;
+static gboolean melo_sink_stats_dry;
+static guint melo_sink_stats_timer;
 
 struct _MeloSinkPrivate {
   /* Associated player */
@@ -75,13 +173,35 @@ struct _MeloSinkPrivate {
   GstElement *sink;
   GstElement *convert;
   GstElement *resample;
+  GstElement *tee;
   GstElement *filter;
   GstElement *audiosink;
 
+  /* Main mixer input */
+  GstElement *appsrc;
+  GstPad *mixer_pad;
+  MeloSinkLatency latency;
+
   /* Volume control */
   GstElement *volume;
   gdouble vol;
+  gdouble gain;
   gboolean mute;
+
+  /* Encoded stream */
+  MeloSinkStream *stream;
+  GstPad *stream_pad;
+
+  /* Time to first audio */
+  gint64 load_start;
+  gint load_pending;
+
+  /* Health statistics */
+  GMutex stats_mutex;
+  MeloSinkStats stats;
+  MeloSinkStats stats_last;
+  GstClockTime stats_next;
+  gboolean stats_level_high;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (MeloSink, melo_sink, G_TYPE_OBJECT)
@@ -95,9 +215,24 @@ melo_sink_finalize (GObject *gobject)
   /* Lock main pipeline */
   G_LOCK (melo_sink_mutex);
 
+  /* Close encoded stream */
+  if (priv->stream) {
+    melo_sink_stream_close (priv->stream);
+    melo_sink_stream_unref (priv->stream);
+    gst_object_unref (priv->stream_pad);
+  }
+
   /* Release sink */
   gst_object_unref (priv->sink);
 
+  /* Disconnect from main mixer */
+  if (priv->appsrc) {
+    gst_element_set_state (priv->appsrc, GST_STATE_NULL);
+    gst_element_release_request_pad (melo_sink_mixer, priv->mixer_pad);
+    gst_object_unref (priv->mixer_pad);
+    gst_bin_remove (GST_BIN (melo_sink_pipeline), priv->appsrc);
+  }
+
   /* Remove sink from main list */
   melo_sink_list = g_list_remove (melo_sink_list, sink);
   g_hash_table_remove (melo_sink_hash, priv->id);
@@ -106,6 +241,9 @@ melo_sink_finalize (GObject *gobject)
   g_free (priv->name);
   g_free (priv->id);
 
+  /* Free statistics lock */
+  g_mutex_clear (&priv->stats_mutex);
+
   /* Unlock main pipeline */
   G_UNLOCK (melo_sink_mutex);
 
@@ -128,6 +266,407 @@ melo_sink_init (MeloSink *self)
   MeloSinkPrivate *priv = melo_sink_get_instance_private (self);
 
   self->priv = priv;
+
+  /* Init statistics */
+  g_mutex_init (&priv->stats_mutex);
+  priv->stats_next = GST_CLOCK_TIME_NONE;
+}
+
+/* Must be called with main context locked */
+static guint64
+melo_sink_get_queue_size (MeloSinkLatency latency)
+{
+  GstStructure *str = gst_caps_get_structure (melo_sink_caps, 0);
+  gint rate = 0, channels = 0, width = 4;
+  const gchar *format;
+
+  /* Get sample size: S32LE is used when conversion is done */
+  format = gst_structure_get_string (str, "format");
+  if (!g_strcmp0 (format, "S16LE"))
+    width = 2;
+  else if (!g_strcmp0 (format, "S24LE"))
+    width = 3;
+  gst_structure_get_int (str, "rate", &rate);
+  gst_structure_get_int (str, "channels", &channels);
+
+  return (guint64) rate * channels * width *
+         melo_sink_latencies[latency].queue_time / 1000;
+}
+
+static void
+melo_sink_setup_audiosink (GstElement *element)
+{
+  MeloSinkLatency latency = melo_sink_latency;
+
+  /* Only audio sinks based on a ring buffer are configurable */
+  if (!g_object_class_find_property (G_OBJECT_GET_CLASS (element),
+                                     "buffer-time"))
+    return;
+
+  /* Set sound card buffer and period, and report late samples */
+  g_object_set (element,
+                "buffer-time", melo_sink_latencies[latency].buffer_time,
+                "latency-time", melo_sink_latencies[latency].latency_time,
+                "qos", TRUE,
+                NULL);
+}
+
+static void
+melo_sink_element_added (GstBin *bin, GstBin *sub_bin, GstElement *element,
+                         gpointer user_data)
+{
+  /* Real audio sink has been plugged by autoaudiosink */
+  melo_sink_setup_audiosink (element);
+}
+
+static gint64
+melo_sink_get_thread_cpu_time (void)
+{
+  struct timespec ts;
+
+  /* Get CPU time consumed by calling thread */
+  if (clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts))
+    return 0;
+
+  return (gint64) ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+static gboolean
+melo_sink_is_late (MeloSinkPrivate *priv, GstAppSink *appsink,
+                   GstSample *sample)
+{
+  GstElement *element = GST_ELEMENT (appsink);
+  GstClockTime running_time, now, max;
+  const GstSegment *segment;
+  GstBuffer *buffer;
+  GstClock *clock;
+
+  /* Get buffer running time */
+  segment = gst_sample_get_segment (sample);
+  buffer = gst_sample_get_buffer (sample);
+  if (!segment || segment->format != GST_FORMAT_TIME ||
+      !GST_BUFFER_PTS_IS_VALID (buffer))
+    return FALSE;
+  running_time = gst_segment_to_running_time (segment, GST_FORMAT_TIME,
+                                              GST_BUFFER_PTS (buffer));
+  if (!GST_CLOCK_TIME_IS_VALID (running_time))
+    return FALSE;
+
+  /* Get current running time of player pipeline */
+  clock = gst_element_get_clock (element);
+  if (!clock)
+    return FALSE;
+  now = gst_clock_get_time (clock) - gst_element_get_base_time (element);
+  gst_object_unref (clock);
+
+  /* Buffer should have been rendered more than one period ago */
+  max = running_time + gst_base_sink_get_latency (GST_BASE_SINK (appsink)) +
+        melo_sink_latencies[priv->latency].latency_time * GST_USECOND;
+  return now > max;
+}
+
+static GstFlowReturn
+melo_sink_new_sample (GstAppSink *appsink, gpointer user_data)
+{
+  MeloSinkPrivate *priv = user_data;
+  GstSample *sample;
+  GstBuffer *buffer;
+  GstFlowReturn ret;
+  gboolean late;
+
+  /* Get next sample */
+  sample = gst_app_sink_pull_sample (appsink);
+  if (!sample)
+    return GST_FLOW_EOS;
+
+  /* Check if sample is rendered too late */
+  late = melo_sink_is_late (priv, appsink, sample);
+
+  /* Forward buffer to main mixer: new timestamps are set by source */
+  buffer = gst_buffer_ref (gst_sample_get_buffer (sample));
+  ret = gst_app_src_push_buffer (GST_APP_SRC (priv->appsrc), buffer);
+  gst_sample_unref (sample);
+
+  /* Update statistics */
+  g_mutex_lock (&priv->stats_mutex);
+  if (late)
+    priv->stats.late++;
+  if (ret == GST_FLOW_FLUSHING)
+    priv->stats.dropped++;
+  priv->stats.cpu_time = melo_sink_get_thread_cpu_time ();
+  g_mutex_unlock (&priv->stats_mutex);
+
+  /* Main pipeline is flushing while reconfigured: drop buffer */
+  if (ret == GST_FLOW_FLUSHING) {
+    G_LOCK (melo_sink_stats_mutex);
+    melo_sink_stats.dropped++;
+    G_UNLOCK (melo_sink_stats_mutex);
+    ret = GST_FLOW_OK;
+  }
+
+  return ret;
+}
+
+static GstPadProbeReturn
+melo_sink_mixer_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+  MeloSinkPrivate *priv = user_data;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  GstClockTime pts, next;
+
+  /* Buffers are timestamped at reception by the mixer input */
+  pts = GST_BUFFER_PTS (buffer);
+
+  g_mutex_lock (&priv->stats_mutex);
+  next = priv->stats_next;
+
+  /* Buffer came after a gap: the mixer has mixed silence for this sink */
+  if (GST_CLOCK_TIME_IS_VALID (pts) && GST_CLOCK_TIME_IS_VALID (next) &&
+      pts > next + MELO_SINK_STATS_GAP_MIN * GST_MSECOND &&
+      pts < next + MELO_SINK_STATS_GAP_MAX * GST_MSECOND)
+    priv->stats.underruns++;
+
+  /* Save expected timestamp of next buffer */
+  if (GST_CLOCK_TIME_IS_VALID (pts) && GST_BUFFER_DURATION_IS_VALID (buffer))
+    priv->stats_next = pts + GST_BUFFER_DURATION (buffer);
+  else
+    priv->stats_next = GST_CLOCK_TIME_NONE;
+  priv->stats.buffers++;
+  g_mutex_unlock (&priv->stats_mutex);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+melo_sink_main_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  GstClockTime now = GST_CLOCK_TIME_NONE;
+  GstElement *element;
+  GstClock *clock;
+  gboolean dry;
+
+  /* Get current running time of main pipeline */
+  element = GST_PAD_PARENT (pad);
+  clock = gst_element_get_clock (element);
+  if (clock) {
+    now = gst_clock_get_time (clock) - gst_element_get_base_time (element);
+    gst_object_unref (clock);
+  }
+
+  G_LOCK (melo_sink_stats_mutex);
+
+  /* The mixer output starts at 0, so its timestamps are running times: when a
+   * buffer comes after its render time, the sound card has played silence
+   */
+  dry = GST_CLOCK_TIME_IS_VALID (now) && GST_BUFFER_PTS_IS_VALID (buffer) &&
+        GST_CLOCK_TIME_IS_VALID (melo_sink_stats_latency) &&
+        now > GST_BUFFER_PTS (buffer) + melo_sink_stats_latency;
+  if (dry && !melo_sink_stats_dry)
+    melo_sink_stats.underruns++;
+  melo_sink_stats_dry = dry;
+
+  /* Update counters */
+  melo_sink_stats.buffers++;
+  melo_sink_stats.cpu_time = melo_sink_get_thread_cpu_time ();
+
+  G_UNLOCK (melo_sink_stats_mutex);
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Must be called with main context locked */
+static void
+melo_sink_apply_caps (GstCaps *caps)
+{
+  GList *list;
+
+  /* Replace mixer caps */
+  gst_caps_replace (&melo_sink_caps, caps);
+
+  /* Stop main mixer while caps are changed */
+  gst_element_set_state (melo_sink_pipeline, GST_STATE_READY);
+  g_object_set (melo_sink_filter, "caps", melo_sink_caps, NULL);
+
+  /* Update sink caps */
+  for (list = melo_sink_list; list != NULL; list = list->next) {
+    MeloSink *sink = (MeloSink *) list->data;
+    g_object_set (sink->priv->filter, "caps", melo_sink_caps, NULL);
+    g_object_set (sink->priv->appsrc, "caps", melo_sink_caps, "max-bytes",
+                  melo_sink_get_queue_size (sink->priv->latency), NULL);
+  }
+
+  /* Restart main mixer */
+  gst_element_set_state (melo_sink_pipeline, GST_STATE_PLAYING);
+}
+
+/* Must be called with main context locked */
+static GstCaps *
+melo_sink_get_passthrough_caps (GstCaps *caps)
+{
+  const gchar *format;
+  GstStructure *str;
+  GstCaps *out = NULL, *dev;
+  gint rate, channels;
+  GstPad *pad;
+
+  /* Only integer interleaved formats are passed through */
+  str = gst_caps_get_structure (caps, 0);
+  format = gst_structure_get_string (str, "format");
+  if (!gst_structure_has_name (str, "audio/x-raw") ||
+      g_strcmp0 (gst_structure_get_string (str, "layout"), "interleaved") ||
+      (g_strcmp0 (format, "S16LE") && g_strcmp0 (format, "S24LE") &&
+       g_strcmp0 (format, "S32LE")) ||
+      !gst_structure_get_int (str, "rate", &rate) ||
+      !gst_structure_get_int (str, "channels", &channels))
+    return NULL;
+
+  /* Generate stream caps */
+  out = gst_caps_new_simple ("audio/x-raw",
+                             "format", G_TYPE_STRING, format,
+                             "layout", G_TYPE_STRING, "interleaved",
+                             "rate", G_TYPE_INT, rate,
+                             "channels", G_TYPE_INT, channels, NULL);
+
+  /* Check sound card accepts the stream format */
+  pad = gst_element_get_static_pad (melo_sink_filter, "src");
+  dev = gst_pad_peer_query_caps (pad, NULL);
+  gst_object_unref (pad);
+  if (!dev || !gst_caps_can_intersect (dev, out)) {
+    gst_caps_unref (out);
+    out = NULL;
+  }
+  if (dev)
+    gst_caps_unref (dev);
+
+  return out;
+}
+
+static gboolean
+melo_sink_passthrough_func (gpointer user_data)
+{
+  GstCaps *caps;
+
+  G_LOCK (melo_sink_mutex);
+
+  /* Get last stream format */
+  caps = melo_sink_passthrough_caps;
+  melo_sink_passthrough_caps = NULL;
+  melo_sink_passthrough_id = 0;
+
+  /* Switch sound card to stream format when it is supported: the sink caps
+   * then match the stream caps and the conversion elements are bypassed
+   */
+  if (caps && melo_sink_passthrough && melo_sink_caps) {
+    GstCaps *out = melo_sink_get_passthrough_caps (caps);
+    if (out) {
+      if (!gst_caps_is_equal (out, melo_sink_caps))
+        melo_sink_apply_caps (out);
+      gst_caps_unref (out);
+    }
+  }
+  if (caps)
+    gst_caps_unref (caps);
+
+  G_UNLOCK (melo_sink_mutex);
+
+  return G_SOURCE_REMOVE;
+}
+
+static GstPadProbeReturn
+melo_sink_event_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+  GstCaps *caps;
+
+  /* Only new stream format is handled */
+  if (GST_EVENT_TYPE (event) != GST_EVENT_CAPS)
+    return GST_PAD_PROBE_OK;
+  gst_event_parse_caps (event, &caps);
+
+  /* The main pipeline is reconfigured from the main context and only when
+   * the stream format differs from the current one: the streaming thread of
+   * a player must not change the state of the shared pipeline while other
+   * players may be blocked pushing into it
+   */
+  G_LOCK (melo_sink_mutex);
+  if (melo_sink_passthrough && melo_sink_caps &&
+      !gst_caps_is_subset (caps, melo_sink_caps)) {
+    gst_caps_replace (&melo_sink_passthrough_caps, caps);
+    if (!melo_sink_passthrough_id)
+      melo_sink_passthrough_id = g_idle_add (melo_sink_passthrough_func,
+                                             NULL);
+  }
+  G_UNLOCK (melo_sink_mutex);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static GstAppSinkCallbacks melo_sink_callbacks = {
+  .new_sample = melo_sink_new_sample,
+};
+
+static GstPadProbeReturn
+melo_sink_buffer_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+  MeloSinkPrivate *priv = user_data;
+  gint load_time;
+
+  /* First buffer since last load: report time to first audio */
+  if (g_atomic_int_compare_and_exchange (&priv->load_pending, TRUE, FALSE) &&
+      priv->player) {
+    load_time = (g_get_monotonic_time () - priv->load_start) / 1000;
+    melo_player_set_status_load_time (priv->player, load_time);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Must be called with main context locked */
+static gboolean
+melo_sink_add_stream (MeloSinkPrivate *priv, MeloSinkStreamFormat format)
+{
+  GstElement *bin;
+  GstPad *pad;
+
+  /* Create encoder */
+  priv->stream = melo_sink_stream_new (format);
+  if (!priv->stream)
+    return FALSE;
+
+  /* Connect encoder to tee */
+  bin = melo_sink_stream_get_gst_bin (priv->stream);
+  gst_bin_add (GST_BIN (priv->sink), bin);
+  priv->stream_pad = gst_element_get_request_pad (priv->tee, "src_%u");
+  pad = gst_element_get_static_pad (bin, "sink");
+  gst_pad_link (priv->stream_pad, pad);
+  gst_object_unref (pad);
+  gst_element_sync_state_with_parent (bin);
+
+  return TRUE;
+}
+
+/* Must be called with main context locked */
+static void
+melo_sink_remove_stream (MeloSinkPrivate *priv)
+{
+  GstElement *bin;
+
+  if (!priv->stream)
+    return;
+
+  /* Disconnect encoder: the tee releases the pad with its stream lock held */
+  bin = melo_sink_stream_get_gst_bin (priv->stream);
+  gst_element_release_request_pad (priv->tee, priv->stream_pad);
+  gst_object_unref (priv->stream_pad);
+  priv->stream_pad = NULL;
+  gst_element_set_state (bin, GST_STATE_NULL);
+  gst_bin_remove (GST_BIN (priv->sink), bin);
+
+  /* Close stream: the listeners keep their reference until they leave */
+  melo_sink_stream_close (priv->stream);
+  melo_sink_stream_unref (priv->stream);
+  priv->stream = NULL;
 }
 
 static inline gboolean
@@ -155,6 +694,7 @@ melo_sink_is_initialized (void)
 MeloSink *
 melo_sink_new (MeloPlayer *player, const gchar *id, const gchar *name)
 {
+  MeloSinkStreamFormat format = MELO_SINK_STREAM_NONE;
   MeloSinkPrivate *priv;
   MeloSink *sink;
   GstPad *gpad, *pad;
@@ -178,6 +718,7 @@ melo_sink_new (MeloPlayer *player, const gchar *id, const gchar *name)
   /* Init private structure */
   priv = sink->priv;
   priv->vol = 1.0;
+  priv->gain = 1.0;
   priv->player = player;
   priv->id = g_strdup (id);
   priv->name = g_strdup (name);
@@ -186,17 +727,22 @@ melo_sink_new (MeloPlayer *player, const gchar *id, const gchar *name)
   priv->sink = gst_bin_new (id);
   priv->convert = gst_element_factory_make ("audioconvert", NULL);
   priv->resample = gst_element_factory_make ("audioresample", NULL);
+  priv->tee = gst_element_factory_make ("tee", NULL);
   priv->volume = gst_element_factory_make ("volume", NULL);
   priv->filter = gst_element_factory_make ("capsfilter", NULL);
-  priv->audiosink = gst_element_factory_make ("autoaudiosink", NULL);
-  if (!priv->sink || !priv->convert || !priv->resample || !priv->volume ||
-      !priv->filter || !priv->audiosink) {
+  priv->audiosink = gst_element_factory_make ("appsink", NULL);
+  priv->appsrc = gst_element_factory_make ("appsrc", NULL);
+  if (!priv->sink || !priv->convert || !priv->resample || !priv->tee ||
+      !priv->volume || !priv->filter || !priv->audiosink || !priv->appsrc) {
     gst_object_unref (priv->sink);
     gst_object_unref (priv->convert);
     gst_object_unref (priv->resample);
+    gst_object_unref (priv->tee);
     gst_object_unref (priv->volume);
     gst_object_unref (priv->filter);
     gst_object_unref (priv->audiosink);
+    gst_object_unref (priv->appsrc);
+    priv->appsrc = NULL;
     g_object_unref (sink);
     goto failed;
   }
@@ -204,9 +750,27 @@ melo_sink_new (MeloPlayer *player, const gchar *id, const gchar *name)
   /* Setup caps for audio sink */
   g_object_set (priv->filter, "caps", melo_sink_caps, NULL);
 
+  /* Forward audio to main mixer */
+  g_object_set (priv->audiosink, "sync", TRUE, "enable-last-sample", FALSE,
+                NULL);
+  gst_app_sink_set_callbacks (GST_APP_SINK (priv->audiosink),
+                              &melo_sink_callbacks, priv, NULL);
+
+  /* Setup main mixer input: buffers are timestamped at reception */
+  g_object_set (priv->appsrc, "caps", melo_sink_caps, "format",
+                GST_FORMAT_TIME, "is-live", TRUE, "do-timestamp", TRUE,
+                "block", TRUE, NULL);
+  gst_bin_add (GST_BIN (melo_sink_pipeline), priv->appsrc);
+  priv->mixer_pad = gst_element_get_request_pad (melo_sink_mixer, "sink_%u");
+  pad = gst_element_get_static_pad (priv->appsrc, "src");
+  gst_pad_link (pad, priv->mixer_pad);
+  gst_object_unref (pad);
+  gst_element_sync_state_with_parent (priv->appsrc);
+
   /* Restore volume and mute from storage file */
   if (melo_sink_store) {
     GError *err = NULL;
+    gchar *latency, *stream;
     gdouble volume;
     gboolean mute;
 
@@ -222,6 +786,16 @@ melo_sink_new (MeloPlayer *player, const gchar *id, const gchar *name)
       priv->mute = mute;
     g_clear_error (&err);
 
+    /* Restore latency profile */
+    latency = g_key_file_get_string (melo_sink_store, id, "latency", NULL);
+    priv->latency = melo_sink_latency_from_string (latency);
+    g_free (latency);
+
+    /* Restore encoded stream */
+    stream = g_key_file_get_string (melo_sink_store, id, "stream", NULL);
+    format = melo_sink_stream_format_from_string (stream);
+    g_free (stream);
+
     /* Update player status */
     if (priv->player) {
       melo_player_set_status_volume (priv->player, priv->vol);
@@ -230,14 +804,28 @@ melo_sink_new (MeloPlayer *player, const gchar *id, const gchar *name)
   }
 
   /* Setup volume */
-  g_object_set (priv->volume, "volume", priv->vol * melo_sink_volume, "mute",
+  g_object_set (priv->volume, "volume",
+                priv->vol * priv->gain * melo_sink_volume, "mute",
                 priv->mute || melo_sink_mute, NULL);
 
-  /* Add and connect convert -> resample -> volume -> audiosink to sink bin */
+  /* Setup queue size of main mixer input */
+  g_object_set (priv->appsrc, "max-bytes",
+                melo_sink_get_queue_size (priv->latency), NULL);
+
+  /* Add and connect convert -> resample -> tee -> volume -> audiosink to sink
+   * bin: the encoded stream is taken from the tee, before the volume
+   */
   gst_bin_add_many (GST_BIN (priv->sink), priv->convert, priv->resample,
-                    priv->volume, priv->filter, priv->audiosink, NULL);
-  gst_element_link_many (priv->convert, priv->resample, priv->volume,
-                         priv->filter, priv->audiosink, NULL);
+                    priv->tee, priv->volume, priv->filter, priv->audiosink,
+                    NULL);
+  gst_element_link_many (priv->convert, priv->resample, priv->tee,
+                         priv->volume, priv->filter, priv->audiosink, NULL);
+
+  /* Watch main mixer input to detect underruns */
+  pad = gst_element_get_static_pad (priv->appsrc, "src");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, melo_sink_mixer_probe,
+                     priv, NULL);
+  gst_object_unref (pad);
 
   /* Create sink pad on bin and connect to sink pad of audioconver */
   pad = gst_element_get_static_pad (priv->convert, "sink");
@@ -245,6 +833,18 @@ melo_sink_new (MeloPlayer *player, const gchar *id, const gchar *name)
   gst_element_add_pad (priv->sink, gpad);
   gst_object_unref (pad);
 
+  /* Watch buffers to measure time to first audio */
+  gst_pad_add_probe (gpad, GST_PAD_PROBE_TYPE_BUFFER, melo_sink_buffer_probe,
+                     priv, NULL);
+
+  /* Watch stream format for passthrough mode */
+  gst_pad_add_probe (gpad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+                     melo_sink_event_probe, NULL, NULL);
+
+  /* Start encoded stream */
+  if (format != MELO_SINK_STREAM_NONE)
+    melo_sink_add_stream (priv, format);
+
   /* Add sink to global sink list */
   melo_sink_list = g_list_prepend (melo_sink_list, sink);
   g_hash_table_insert (melo_sink_hash, priv->id, sink);
@@ -287,6 +887,39 @@ melo_sink_get_name (MeloSink *sink)
   return sink->priv->name;
 }
 
+/**
+ * melo_sink_get_player:
+ * @sink: the sink
+ *
+ * Get the #MeloPlayer which created the sink.
+ *
+ * Returns: (transfer none): the #MeloPlayer of the sink, or %NULL.
+ */
+MeloPlayer *
+melo_sink_get_player (MeloSink *sink)
+{
+  g_return_val_if_fail (sink, NULL);
+  return sink->priv->player;
+}
+
+/**
+ * melo_sink_start_load:
+ * @sink: the sink
+ *
+ * Notify the #MeloSink that a new media is being loaded in the pipeline. When
+ * the first audio buffer of the media reaches the sink, the elapsed time is
+ * reported to the attached #MeloPlayer with
+ * melo_player_set_status_load_time().
+ */
+void
+melo_sink_start_load (MeloSink *sink)
+{
+  MeloSinkPrivate *priv = sink->priv;
+
+  priv->load_start = g_get_monotonic_time ();
+  g_atomic_int_set (&priv->load_pending, TRUE);
+}
+
 /**
  * melo_sink_get_gst_sink:
  * @sink: the sink
@@ -354,22 +987,25 @@ melo_sink_get_volume (MeloSink *sink)
   return sink->priv->vol;
 }
 
-static gboolean
-melo_sink_update_store_file_func (gpointer user_data)
+static gchar *
+melo_sink_update_store_file_func (gpointer user_data, gsize *length)
 {
+  gchar *data = NULL;
+
+  /* Serialize sink store */
   G_LOCK (melo_sink_mutex);
-  g_key_file_save_to_file (melo_sink_store, melo_sink_store_file, NULL);
-  melo_sink_store_timer = 0;
+  if (melo_sink_store)
+    data = g_key_file_to_data (melo_sink_store, length, NULL);
   G_UNLOCK (melo_sink_mutex);
 
-  return FALSE;
+  return data;
 }
 
 static void
 melo_sink_update_store_file (void)
 {
-  if (!melo_sink_store_timer)
-    g_timeout_add_seconds (10, melo_sink_update_store_file_func, NULL);
+  melo_config_save_deferred (melo_sink_store_file,
+                             melo_sink_update_store_file_func, NULL, NULL);
 }
 
 /**
@@ -393,7 +1029,8 @@ melo_sink_set_volume (MeloSink *sink, gdouble volume)
   /* Set volume */
   priv = sink->priv;
   priv->vol = volume;
-  g_object_set (priv->volume, "volume", volume * melo_sink_volume, NULL);
+  g_object_set (priv->volume, "volume", volume * priv->gain * melo_sink_volume,
+                NULL);
 
   /* Update player status */
   if (priv->player)
@@ -410,6 +1047,41 @@ melo_sink_set_volume (MeloSink *sink, gdouble volume)
   return volume;
 }
 
+/**
+ * melo_sink_get_gain:
+ * @sink: the sink
+ *
+ * Get current gain of the sink.
+ *
+ * Returns: the current linear gain applied on the sink.
+ */
+gdouble
+melo_sink_get_gain (MeloSink *sink)
+{
+  return sink->priv->gain;
+}
+
+/**
+ * melo_sink_set_gain:
+ * @sink: the sink
+ * @gain: the linear gain to use
+ *
+ * Set a gain applied on top of the volume of the sink, to match the level of
+ * the current media with a gain computed in advance. Unlike the volume, the
+ * gain is neither saved nor reported in the player status. This function can
+ * be called from a streaming thread.
+ */
+void
+melo_sink_set_gain (MeloSink *sink, gdouble gain)
+{
+  MeloSinkPrivate *priv = sink->priv;
+
+  /* Set gain */
+  priv->gain = gain;
+  g_object_set (priv->volume, "volume",
+                priv->vol * gain * melo_sink_volume, NULL);
+}
+
 /**
  * melo_sink_get_mute:
  * @sink: the sink
@@ -464,82 +1136,941 @@ melo_sink_set_mute (MeloSink *sink, gboolean mute)
   return mute;
 }
 
-/* Main pipeline control */
-static GstCaps *
-melo_sink_gen_caps (gint rate, gint channels)
+/**
+ * melo_sink_latency_to_string:
+ * @latency: the latency profile
+ *
+ * Get the name of a latency profile.
+ *
+ * Returns: the name of the latency profile, or %NULL if invalid.
+ */
+const gchar *
+melo_sink_latency_to_string (MeloSinkLatency latency)
 {
-  return gst_caps_new_simple ("audio/x-raw",
-                              "format", G_TYPE_STRING, "S32LE",
-                              "layout", G_TYPE_STRING, "interleaved",
-                              "rate", G_TYPE_INT, rate,
-                              "channels", G_TYPE_INT, channels, NULL);
+  if (latency >= MELO_SINK_LATENCY_COUNT)
+    return NULL;
+  return melo_sink_latencies[latency].name;
 }
 
 /**
- * melo_sink_main_init:
- * @rate: the sample rate to use for the sound card
- * @channels: the channel count to use for the sound card
+ * melo_sink_latency_from_string:
+ * @name: the name of a latency profile
  *
- * Initialize and configure the sound card and internal mixer with the settings
- * provided. This function must be called once before any #MeloPlayer
- * instantiation.
+ * Get a latency profile from its name ("default", "low" or "power_save").
  *
- * Returns: %TRUE if initialization has been done with success, %FALSE
- * otherwise.
+ * Returns: the latency profile, or MELO_SINK_LATENCY_DEFAULT if @name is
+ * unknown.
  */
-gboolean
-melo_sink_main_init (gint rate, gint channels)
+MeloSinkLatency
+melo_sink_latency_from_string (const gchar *name)
 {
-  gchar *path;
+  MeloSinkLatency latency;
 
-  /* Lock main context access */
-  G_LOCK (melo_sink_mutex);
-
-  /* Main context already initialized  */
-  if (melo_sink_is_initialized ())
-    goto failed;
+  for (latency = 0; latency < MELO_SINK_LATENCY_COUNT; latency++)
+    if (!g_strcmp0 (name, melo_sink_latencies[latency].name))
+      return latency;
 
-  /* Generate audio sink caps */
-  melo_sink_caps = melo_sink_gen_caps (rate, channels);
+  return MELO_SINK_LATENCY_DEFAULT;
+}
 
-  /* Create hash table */
-  melo_sink_hash = g_hash_table_new (g_str_hash, g_str_equal);
+/**
+ * melo_sink_get_latency:
+ * @sink: the sink
+ *
+ * Get the current latency profile of the sink. If @sink is %NULL, the latency
+ * profile of the sound card is returned.
+ *
+ * Returns: the current latency profile.
+ */
+MeloSinkLatency
+melo_sink_get_latency (MeloSink *sink)
+{
+  if (!sink)
+    return melo_sink_get_main_latency ();
+  return sink->priv->latency;
+}
 
-  /* Prepare filename to prepare sinks parameters storage */
-  melo_sink_store_file = g_strdup_printf ("%s/melo/sink_store.conf",
-                                          g_get_user_config_dir ());
-  path = g_path_get_dirname (melo_sink_store_file);
-  g_mkdir_with_parents (path, 0700);
-  g_free (path);
+/**
+ * melo_sink_set_latency:
+ * @sink: the sink
+ * @latency: the latency profile to use
+ *
+ * Set a new latency profile on the sink: it sets the maximum amount of audio
+ * queued between the sink and the main mixer. If @sink is %NULL,
+ * melo_sink_set_main_latency() is called.
+ *
+ * Returns: the actual latency profile applied on the sink.
+ */
+MeloSinkLatency
+melo_sink_set_latency (MeloSink *sink, MeloSinkLatency latency)
+{
+  MeloSinkPrivate *priv;
 
-  /* Create key file for volume/mute storage */
-  melo_sink_store = g_key_file_new ();
-  if (melo_sink_store) {
-    GError *err = NULL;
-    gdouble volume;
-    gboolean mute;
+  /* Set main latency */
+  if (!sink)
+    return melo_sink_set_main_latency (latency);
 
-    /* Restore settings from file */
-    g_key_file_load_from_file (melo_sink_store, melo_sink_store_file,
-                               G_KEY_FILE_NONE, NULL);
+  if (latency >= MELO_SINK_LATENCY_COUNT)
+    latency = MELO_SINK_LATENCY_DEFAULT;
 
-    /* Restore volume */
-    volume = g_key_file_get_double (melo_sink_store, "main", "volume", &err);
-    if (!err)
-      melo_sink_volume = volume;
-    g_clear_error (&err);
+  /* Set queue size */
+  priv = sink->priv;
+  G_LOCK (melo_sink_mutex);
+  priv->latency = latency;
+  g_object_set (priv->appsrc, "max-bytes", melo_sink_get_queue_size (latency),
+                NULL);
 
-    /* Restore mute */
-    mute = g_key_file_get_boolean (melo_sink_store, "main", "mute", &err);
-    if (!err)
-      melo_sink_mute = mute;
-    g_clear_error (&err);
+  /* Save latency */
+  if (melo_sink_store) {
+    g_key_file_set_string (melo_sink_store, priv->id, "latency",
+                           melo_sink_latencies[latency].name);
+    melo_sink_update_store_file ();
   }
-
-  /* Unlock main context access */
   G_UNLOCK (melo_sink_mutex);
 
-  return TRUE;
+  return latency;
+}
+
+/**
+ * melo_sink_get_latency_time:
+ * @sink: the sink
+ *
+ * Get the latency achieved between the input of the sink and the sound card
+ * output: it is the latency reported by the main pipeline, added to the
+ * maximum amount of audio queued in front of the main mixer for this sink. If
+ * @sink is %NULL, only the latency of the main pipeline is returned.
+ *
+ * Returns: the achieved latency (in ms), or -1 if not available.
+ */
+gint
+melo_sink_get_latency_time (MeloSink *sink)
+{
+  GstClockTime min = 0;
+  gboolean live;
+  GstQuery *query;
+  gint latency = -1;
+
+  /* Query main pipeline latency */
+  G_LOCK (melo_sink_mutex);
+  if (melo_sink_pipeline) {
+    query = gst_query_new_latency ();
+    if (gst_element_query (melo_sink_pipeline, query)) {
+      gst_query_parse_latency (query, &live, &min, NULL);
+      latency = min / GST_MSECOND;
+    }
+    gst_query_unref (query);
+  }
+  G_UNLOCK (melo_sink_mutex);
+
+  /* Add data queued by sink */
+  if (sink && latency >= 0)
+    latency += melo_sink_latencies[sink->priv->latency].queue_time;
+
+  return latency;
+}
+
+/**
+ * melo_sink_get_stream_format:
+ * @sink: the sink
+ *
+ * Get the encoding format of the stream of the sink.
+ *
+ * Returns: the current stream format, MELO_SINK_STREAM_NONE if disabled.
+ */
+MeloSinkStreamFormat
+melo_sink_get_stream_format (MeloSink *sink)
+{
+  MeloSinkStreamFormat format = MELO_SINK_STREAM_NONE;
+
+  G_LOCK (melo_sink_mutex);
+  if (sink->priv->stream)
+    format = melo_sink_stream_get_format (sink->priv->stream);
+  G_UNLOCK (melo_sink_mutex);
+
+  return format;
+}
+
+/**
+ * melo_sink_set_stream_format:
+ * @sink: the sink
+ * @format: the stream format to use
+ *
+ * Enable an encoded stream of the sink audio, or disable it with
+ * MELO_SINK_STREAM_NONE. The audio is encoded once, before the volume of the
+ * sink, and shared by all the listeners of the #MeloSinkStream returned by
+ * melo_sink_get_stream(). When the format is changed, the current listeners
+ * are closed.
+ *
+ * Returns: the actual stream format.
+ */
+MeloSinkStreamFormat
+melo_sink_set_stream_format (MeloSink *sink, MeloSinkStreamFormat format)
+{
+  MeloSinkPrivate *priv = sink->priv;
+
+  if (format >= MELO_SINK_STREAM_COUNT)
+    format = MELO_SINK_STREAM_NONE;
+
+  G_LOCK (melo_sink_mutex);
+
+  /* Replace encoder */
+  if (!priv->stream || melo_sink_stream_get_format (priv->stream) != format) {
+    melo_sink_remove_stream (priv);
+    if (format != MELO_SINK_STREAM_NONE && !melo_sink_add_stream (priv, format))
+      format = MELO_SINK_STREAM_NONE;
+  }
+
+  /* Save stream format */
+  if (melo_sink_store) {
+    g_key_file_set_string (melo_sink_store, priv->id, "stream",
+                           melo_sink_stream_format_to_string (format));
+    melo_sink_update_store_file ();
+  }
+
+  G_UNLOCK (melo_sink_mutex);
+
+  return format;
+}
+
+/**
+ * melo_sink_get_stream:
+ * @sink: the sink
+ *
+ * Get the encoded stream of the sink, in order to add listeners with
+ * melo_sink_stream_add_listener().
+ *
+ * Returns: (transfer full): the #MeloSinkStream of the sink, or %NULL if no
+ * stream is enabled. Use melo_sink_stream_unref() after usage.
+ */
+MeloSinkStream *
+melo_sink_get_stream (MeloSink *sink)
+{
+  MeloSinkStream *stream = NULL;
+
+  G_LOCK (melo_sink_mutex);
+  if (sink->priv->stream)
+    stream = melo_sink_stream_ref (sink->priv->stream);
+  G_UNLOCK (melo_sink_mutex);
+
+  return stream;
+}
+
+/**
+ * melo_sink_get_stats:
+ * @sink: the sink, or %NULL for the main mixer
+ * @stats: a pointer to a #MeloSinkStats to fill
+ *
+ * Get the health statistics of a #MeloSink, or of the main mixer and the sound
+ * card when @sink is %NULL.
+ *
+ * Returns: %TRUE if @stats has been filled, %FALSE otherwise.
+ */
+gboolean
+melo_sink_get_stats (MeloSink *sink, MeloSinkStats *stats)
+{
+  MeloSinkPrivate *priv;
+  GstClockTime latency;
+  guint64 max;
+
+  if (!stats)
+    return FALSE;
+
+  /* Get main mixer statistics */
+  if (!sink) {
+    G_LOCK (melo_sink_stats_mutex);
+    *stats = melo_sink_stats;
+    latency = melo_sink_stats_latency;
+    G_UNLOCK (melo_sink_stats_mutex);
+
+    stats->latency = GST_CLOCK_TIME_IS_VALID (latency) ?
+                     (gint64) GST_TIME_AS_USECONDS (latency) : -1;
+    stats->level = -1;
+    return TRUE;
+  }
+  priv = sink->priv;
+
+  /* Get counters */
+  g_mutex_lock (&priv->stats_mutex);
+  *stats = priv->stats;
+  g_mutex_unlock (&priv->stats_mutex);
+
+  /* Get latency of audio sink */
+  latency = gst_base_sink_get_latency (GST_BASE_SINK (priv->audiosink));
+  stats->latency = GST_TIME_AS_USECONDS (latency);
+
+  /* Get fill level of main mixer input */
+  max = gst_app_src_get_max_bytes (GST_APP_SRC (priv->appsrc));
+  stats->level = max ? gst_app_src_get_current_level_bytes (
+                                 GST_APP_SRC (priv->appsrc)) * 100 / max : -1;
+
+  return TRUE;
+}
+
+/**
+ * melo_sink_dump_pipeline:
+ * @sink: the sink, or %NULL for the main mixer
+ *
+ * Dump the graph of the pipeline in which the sink is used (the pipeline of
+ * its player), or of the main mixer pipeline when @sink is %NULL, in the
+ * Graphviz DOT format.
+ *
+ * With GStreamer older than 1.12, the graph can only be dumped when the
+ * GST_DEBUG_DUMP_DOT_DIR environment variable was set on startup: the graph is
+ * written in this directory and then read back.
+ *
+ * Returns: (transfer full): a string with the graph, or %NULL if the graph
+ * cannot be dumped. Use g_free() after usage.
+ */
+gchar *
+melo_sink_dump_pipeline (MeloSink *sink)
+{
+  GstObject *pipeline, *parent;
+  gchar *dot = NULL;
+
+  /* Get top-level pipeline of sink, or main pipeline */
+  if (sink) {
+    pipeline = gst_object_ref (sink->priv->sink);
+    while ((parent = gst_object_get_parent (pipeline))) {
+      gst_object_unref (pipeline);
+      pipeline = parent;
+    }
+  } else {
+    G_LOCK (melo_sink_mutex);
+    pipeline = melo_sink_pipeline ? gst_object_ref (melo_sink_pipeline) : NULL;
+    G_UNLOCK (melo_sink_mutex);
+  }
+  if (!pipeline || !GST_IS_BIN (pipeline))
+    goto end;
+
+#if GST_CHECK_VERSION (1, 12, 0)
+  /* Generate graph */
+  dot = gst_debug_bin_to_dot_data (GST_BIN (pipeline),
+                                   GST_DEBUG_GRAPH_SHOW_ALL);
+#else
+  {
+    const gchar *dir = g_getenv ("GST_DEBUG_DUMP_DOT_DIR");
+    gchar *name, *file;
+
+    /* Write graph to file and read it back */
+    if (dir) {
+      name = g_strdup_printf ("melo_%s", GST_OBJECT_NAME (pipeline));
+      file = g_strdup_printf ("%s/%s.dot", dir, name);
+      gst_debug_bin_to_dot_file (GST_BIN (pipeline), GST_DEBUG_GRAPH_SHOW_ALL,
+                                 name);
+      if (!g_file_get_contents (file, &dot, NULL, NULL))
+        dot = NULL;
+      g_free (file);
+      g_free (name);
+    }
+  }
+#endif
+
+end:
+  if (pipeline)
+    gst_object_unref (pipeline);
+
+  return dot;
+}
+
+/* Main pipeline control */
+static GstCaps *
+melo_sink_gen_caps (gint rate, gint channels)
+{
+  return gst_caps_new_simple ("audio/x-raw",
+                              "format", G_TYPE_STRING, "S32LE",
+                              "layout", G_TYPE_STRING, "interleaved",
+                              "rate", G_TYPE_INT, rate,
+                              "channels", G_TYPE_INT, channels, NULL);
+}
+
+static gboolean
+melo_sink_bus_call (GstBus *bus, GstMessage *msg, gpointer data)
+{
+  /* Latency of a mixer input has changed */
+  if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_LATENCY)
+    gst_bin_recalculate_latency (GST_BIN (melo_sink_pipeline));
+
+  /* Sound card has rendered samples too late */
+  if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_QOS) {
+    G_LOCK (melo_sink_stats_mutex);
+    melo_sink_stats.late++;
+    G_UNLOCK (melo_sink_stats_mutex);
+  }
+
+  return TRUE;
+}
+
+static inline gboolean
+melo_sink_stats_is_degraded (const MeloSinkStats *stats,
+                             const MeloSinkStats *last)
+{
+  return stats->underruns != last->underruns ||
+         stats->dropped != last->dropped || stats->late != last->late;
+}
+
+static gboolean
+melo_sink_stats_check (gpointer user_data)
+{
+  GstClockTime latency = GST_CLOCK_TIME_NONE;
+  GstElement *pipeline = NULL;
+  MeloSinkStats stats;
+  GList *list, *l;
+
+  /* Get main pipeline */
+  G_LOCK (melo_sink_mutex);
+  if (melo_sink_pipeline)
+    pipeline = gst_object_ref (melo_sink_pipeline);
+  G_UNLOCK (melo_sink_mutex);
+
+  /* Update latency reported by sound card */
+  if (pipeline) {
+    GstQuery *query = gst_query_new_latency ();
+    gboolean live;
+
+    if (gst_element_query (pipeline, query))
+      gst_query_parse_latency (query, &live, &latency, NULL);
+    gst_query_unref (query);
+    gst_object_unref (pipeline);
+
+    G_LOCK (melo_sink_stats_mutex);
+    melo_sink_stats_latency = latency;
+    G_UNLOCK (melo_sink_stats_mutex);
+  }
+
+  /* Check main mixer */
+  melo_sink_get_stats (NULL, &stats);
+  if (melo_sink_stats_is_degraded (&stats, &melo_sink_stats_last))
+    melo_event_sink_stats ("main", &stats);
+  melo_sink_stats_last = stats;
+
+  /* Check sinks: an event is sent when audio is degraded or when the mixer
+   * input becomes almost full
+   */
+  list = melo_sink_get_sink_list ();
+  for (l = list; l != NULL; l = l->next) {
+    MeloSink *sink = l->data;
+    MeloSinkPrivate *priv = sink->priv;
+    gboolean high;
+
+    melo_sink_get_stats (sink, &stats);
+    high = stats.level >= MELO_SINK_STATS_LEVEL_HIGH;
+    if (melo_sink_stats_is_degraded (&stats, &priv->stats_last) ||
+        high != priv->stats_level_high)
+      melo_event_sink_stats (priv->id, &stats);
+    priv->stats_level_high = high;
+    priv->stats_last = stats;
+  }
+  g_list_free_full (list, (GDestroyNotify) g_object_unref);
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* Multi-room output: must be called with main context locked */
+static void
+melo_sink_multiroom_remove_branch (void)
+{
+  if (!melo_sink_net_bin)
+    return;
+
+  /* Release tee or mixer pad */
+  if (melo_sink_multiroom == MELO_SINK_MULTIROOM_MASTER)
+    gst_element_release_request_pad (melo_sink_tee, melo_sink_net_pad);
+  else
+    gst_element_release_request_pad (melo_sink_mixer, melo_sink_net_pad);
+  gst_object_unref (melo_sink_net_pad);
+  melo_sink_net_pad = NULL;
+
+  /* Remove network branch */
+  gst_element_set_state (melo_sink_net_bin, GST_STATE_NULL);
+  gst_bin_remove (GST_BIN (melo_sink_pipeline), melo_sink_net_bin);
+  melo_sink_net_bin = NULL;
+}
+
+/* Must be called with main context locked */
+static gboolean
+melo_sink_multiroom_add_branch (const gchar *desc)
+{
+  GstElement *bin;
+  GError *err = NULL;
+  GstPad *pad;
+
+  /* Create network branch */
+  bin = gst_parse_bin_from_description (desc, TRUE, &err);
+  if (!bin) {
+    g_warning ("failed to create multi-room branch: %s", err->message);
+    g_error_free (err);
+    return FALSE;
+  }
+  gst_bin_add (GST_BIN (melo_sink_pipeline), bin);
+
+  /* Connect to main mix (master) or to main mixer (receiver) */
+  if (melo_sink_multiroom == MELO_SINK_MULTIROOM_MASTER) {
+    melo_sink_net_pad = gst_element_get_request_pad (melo_sink_tee, "src_%u");
+    pad = gst_element_get_static_pad (bin, "sink");
+    gst_pad_link (melo_sink_net_pad, pad);
+  } else {
+    melo_sink_net_pad = gst_element_get_request_pad (melo_sink_mixer,
+                                                     "sink_%u");
+    pad = gst_element_get_static_pad (bin, "src");
+    gst_pad_link (pad, melo_sink_net_pad);
+  }
+  gst_object_unref (pad);
+  melo_sink_net_bin = bin;
+
+  return TRUE;
+}
+
+/* Must be called with main context locked */
+static void
+melo_sink_multiroom_set_clock (GstClock *clock, GstClockTime base_time,
+                               gint latency)
+{
+  /* Use the shared clock and base time: the base time is not updated on
+   * state changes, so all instances render a sample at the same time
+   */
+  gst_pipeline_use_clock (GST_PIPELINE (melo_sink_pipeline), clock);
+  gst_element_set_start_time (melo_sink_pipeline, GST_CLOCK_TIME_NONE);
+  gst_element_set_base_time (melo_sink_pipeline, base_time);
+  gst_pipeline_set_latency (GST_PIPELINE (melo_sink_pipeline),
+                            latency * GST_MSECOND);
+}
+
+/* Must be called with main context locked */
+static void
+melo_sink_multiroom_update_clients (void)
+{
+  GString *rtp, *rtcp;
+  GstElement *sink;
+  gchar *old;
+  GList *list, *l;
+
+  /* Generate client lists from receivers */
+  rtp = g_string_new (NULL);
+  rtcp = g_string_new (NULL);
+  list = melo_avahi_list_services (melo_sink_avahi);
+  for (l = list; l != NULL; l = l->next) {
+    MeloAvahiService *s = l->data;
+
+    if (g_strcmp0 (s->type, MELO_SINK_MULTIROOM_RECEIVER_TYPE))
+      continue;
+
+    g_string_append_printf (rtp, "%s%u.%u.%u.%u:%d", rtp->len ? "," : "",
+                            s->ip[0], s->ip[1], s->ip[2], s->ip[3], s->port);
+    g_string_append_printf (rtcp, "%s%u.%u.%u.%u:%d", rtcp->len ? "," : "",
+                            s->ip[0], s->ip[1], s->ip[2], s->ip[3],
+                            s->port + 1);
+  }
+  g_list_free_full (list, (GDestroyNotify) melo_avahi_service_free);
+
+  /* Update RTP clients only when changed to not reset the sockets */
+  sink = gst_bin_get_by_name (GST_BIN (melo_sink_net_bin), "rtp");
+  g_object_get (sink, "clients", &old, NULL);
+  if (g_strcmp0 (old, rtp->str)) {
+    g_object_set (sink, "clients", rtp->str, NULL);
+    gst_object_unref (sink);
+    sink = gst_bin_get_by_name (GST_BIN (melo_sink_net_bin), "rtcp");
+    g_object_set (sink, "clients", rtcp->str, NULL);
+  }
+  gst_object_unref (sink);
+  g_free (old);
+
+  g_string_free (rtp, TRUE);
+  g_string_free (rtcp, TRUE);
+}
+
+static gint64
+melo_sink_multiroom_get_txt (const MeloAvahiService *s, const gchar *key)
+{
+  gchar *value;
+  gint64 ret;
+
+  value = melo_avahi_service_get_txt (s, key);
+  ret = value ? g_ascii_strtoll (value, NULL, 10) : -1;
+  g_free (value);
+
+  return ret;
+}
+
+/* Must be called with main context locked */
+static void
+melo_sink_multiroom_update_master (void)
+{
+  gint64 base_time = -1, latency = -1, rate = -1, channels = -1;
+  MeloAvahiService *master = NULL;
+  gchar *address = NULL, *key = NULL;
+  GList *list, *l;
+
+  /* Find first master on network */
+  list = melo_avahi_list_services (melo_sink_avahi);
+  for (l = list; l != NULL; l = l->next) {
+    MeloAvahiService *s = l->data;
+
+    if (!g_strcmp0 (s->type, MELO_SINK_MULTIROOM_MASTER_TYPE)) {
+      master = s;
+      break;
+    }
+  }
+
+  /* Get master settings */
+  if (master) {
+    base_time = melo_sink_multiroom_get_txt (master, "base_time");
+    latency = melo_sink_multiroom_get_txt (master, "latency");
+    rate = melo_sink_multiroom_get_txt (master, "rate");
+    channels = melo_sink_multiroom_get_txt (master, "channels");
+    if (base_time >= 0 && latency >= 0 && rate > 0 && channels > 0) {
+      address = g_strdup_printf ("%u.%u.%u.%u", master->ip[0], master->ip[1],
+                                 master->ip[2], master->ip[3]);
+      key = g_strdup_printf ("%s:%d:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT
+                             ":%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT,
+                             address, master->port, base_time, latency, rate,
+                             channels);
+    }
+  }
+
+  /* Master has not changed */
+  if (!g_strcmp0 (key, melo_sink_net_master))
+    goto end;
+  g_free (melo_sink_net_master);
+  melo_sink_net_master = g_strdup (key);
+
+  /* Stop receiving from previous master */
+  gst_element_set_state (melo_sink_pipeline, GST_STATE_READY);
+  melo_sink_multiroom_remove_branch ();
+
+  /* Synchronize on new master clock and receive its stream */
+  if (key) {
+    gchar *desc;
+
+    /* Create a client of the master clock */
+    if (melo_sink_net_clock)
+      gst_object_unref (melo_sink_net_clock);
+    melo_sink_net_clock = gst_net_client_clock_new ("melo_multiroom", address,
+                                                    master->port, 0);
+    melo_sink_multiroom_set_clock (melo_sink_net_clock, base_time, latency);
+
+    /* Receive stream: the jitter buffer outputs samples with the master
+     * running time, since both clocks are synchronized
+     */
+    desc = g_strdup_printf (
+        "udpsrc port=%d caps=\"application/x-rtp,media=audio,"
+          "clock-rate=%" G_GINT64_FORMAT ",encoding-name=L16,"
+          "encoding-params=%" G_GINT64_FORMAT ",channels=%" G_GINT64_FORMAT
+          ",payload=96\" ! rtpbin.recv_rtp_sink_0 "
+        "udpsrc port=%d ! rtpbin.recv_rtcp_sink_0 "
+        "rtpbin name=rtpbin latency=%" G_GINT64_FORMAT " ntp-sync=true "
+          "buffer-mode=synced ntp-time-source=clock-time "
+        "rtpbin. ! rtpL16depay ! audioconvert ! audioresample",
+        MELO_SINK_MULTIROOM_RTP_PORT, rate, channels, channels,
+        MELO_SINK_MULTIROOM_RTP_PORT + 1, latency);
+    melo_sink_multiroom_add_branch (desc);
+    g_free (desc);
+  }
+
+  /* Restart main mixer */
+  gst_element_set_state (melo_sink_pipeline, GST_STATE_PLAYING);
+
+end:
+  g_list_free_full (list, (GDestroyNotify) melo_avahi_service_free);
+  g_free (address);
+  g_free (key);
+}
+
+static gboolean
+melo_sink_multiroom_scan (gpointer user_data)
+{
+  guint generation;
+
+  G_LOCK (melo_sink_mutex);
+
+  /* Services have not changed since last scan */
+  generation = melo_avahi_get_generation (melo_sink_avahi);
+  if (generation == melo_sink_net_generation)
+    goto end;
+  melo_sink_net_generation = generation;
+
+  if (melo_sink_multiroom == MELO_SINK_MULTIROOM_MASTER)
+    melo_sink_multiroom_update_clients ();
+  else if (melo_sink_multiroom == MELO_SINK_MULTIROOM_RECEIVER)
+    melo_sink_multiroom_update_master ();
+
+end:
+  G_UNLOCK (melo_sink_mutex);
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* Must be called with main context locked */
+static void
+melo_sink_multiroom_stop (void)
+{
+  if (melo_sink_multiroom == MELO_SINK_MULTIROOM_NONE)
+    return;
+
+  /* Stop scanning and unpublish service */
+  if (melo_sink_net_timer)
+    g_source_remove (melo_sink_net_timer);
+  melo_sink_net_timer = 0;
+  if (melo_sink_avahi)
+    g_object_unref (melo_sink_avahi);
+  melo_sink_avahi = NULL;
+  melo_sink_avahi_service = NULL;
+  g_free (melo_sink_net_master);
+  melo_sink_net_master = NULL;
+
+  /* Remove network branch */
+  gst_element_set_state (melo_sink_pipeline, GST_STATE_READY);
+  melo_sink_multiroom_remove_branch ();
+
+  /* Remove tee in front of sound card */
+  if (melo_sink_tee) {
+    gst_element_unlink_many (melo_sink_filter, melo_sink_tee,
+                             melo_sink_audiosink, NULL);
+    gst_element_set_state (melo_sink_tee, GST_STATE_NULL);
+    gst_bin_remove (GST_BIN (melo_sink_pipeline), melo_sink_tee);
+    gst_element_link (melo_sink_filter, melo_sink_audiosink);
+    melo_sink_tee = NULL;
+  }
+
+  /* Stop clock sharing */
+  if (melo_sink_net_provider)
+    gst_object_unref (melo_sink_net_provider);
+  melo_sink_net_provider = NULL;
+  if (melo_sink_net_clock)
+    gst_object_unref (melo_sink_net_clock);
+  melo_sink_net_clock = NULL;
+
+  /* Restore default clock and latency */
+  gst_pipeline_auto_clock (GST_PIPELINE (melo_sink_pipeline));
+  gst_element_set_start_time (melo_sink_pipeline, 0);
+  gst_pipeline_set_latency (GST_PIPELINE (melo_sink_pipeline),
+                            GST_CLOCK_TIME_NONE);
+  melo_sink_multiroom = MELO_SINK_MULTIROOM_NONE;
+
+  /* Restart main mixer */
+  gst_element_set_state (melo_sink_pipeline, GST_STATE_PLAYING);
+}
+
+/* Must be called with main context locked */
+static gboolean
+melo_sink_multiroom_start_master (void)
+{
+  gchar *desc, *base, *latency, *rate, *channels;
+
+  /* Stop main mixer while reconfigured */
+  gst_element_set_state (melo_sink_pipeline, GST_STATE_READY);
+
+  /* Insert a tee in front of sound card */
+  melo_sink_tee = gst_element_factory_make ("tee", NULL);
+  if (!melo_sink_tee)
+    goto failed;
+  gst_bin_add (GST_BIN (melo_sink_pipeline), melo_sink_tee);
+  gst_element_unlink (melo_sink_filter, melo_sink_audiosink);
+  gst_element_link_many (melo_sink_filter, melo_sink_tee, melo_sink_audiosink,
+                         NULL);
+
+  /* Create RTP sender: packets are sent as soon as possible, the pipeline
+   * latency is left to the network and the receivers
+   */
+  desc = g_strdup_printf (
+      "queue ! audioconvert ! audioresample ! "
+        "audio/x-raw,format=S16BE,rate=%d,channels=%d ! "
+        "rtpL16pay pt=96 ! rtpbin.send_rtp_sink_0 "
+      "rtpbin name=rtpbin ntp-time-source=clock-time rtcp-sync-send-time=false "
+      "rtpbin.send_rtp_src_0 ! multiudpsink name=rtp sync=false async=false "
+      "rtpbin.send_rtcp_src_0 ! multiudpsink name=rtcp sync=false async=false",
+      melo_sink_rate, melo_sink_channels);
+  if (!melo_sink_multiroom_add_branch (desc)) {
+    g_free (desc);
+    goto failed;
+  }
+  g_free (desc);
+
+  /* Share system clock on network */
+  melo_sink_net_clock = gst_system_clock_obtain ();
+  melo_sink_net_provider = gst_net_time_provider_new (melo_sink_net_clock,
+                                            NULL,
+                                            MELO_SINK_MULTIROOM_CLOCK_PORT);
+  if (!melo_sink_net_provider)
+    goto failed;
+  melo_sink_net_base_time = gst_clock_get_time (melo_sink_net_clock);
+  melo_sink_multiroom_set_clock (melo_sink_net_clock, melo_sink_net_base_time,
+                                 melo_sink_multiroom_latency);
+
+  /* Publish master settings */
+  base = g_strdup_printf ("base_time=%" G_GUINT64_FORMAT,
+                          melo_sink_net_base_time);
+  latency = g_strdup_printf ("latency=%d", melo_sink_multiroom_latency);
+  rate = g_strdup_printf ("rate=%d", melo_sink_rate);
+  channels = g_strdup_printf ("channels=%d", melo_sink_channels);
+  melo_sink_avahi_service = melo_avahi_add_service (melo_sink_avahi,
+                                            g_get_host_name (),
+                                            MELO_SINK_MULTIROOM_MASTER_TYPE,
+                                            MELO_SINK_MULTIROOM_CLOCK_PORT,
+                                            base, latency, rate, channels,
+                                            NULL);
+  g_free (base);
+  g_free (latency);
+  g_free (rate);
+  g_free (channels);
+
+  /* Find receivers */
+  melo_avahi_add_browser (melo_sink_avahi, MELO_SINK_MULTIROOM_RECEIVER_TYPE);
+
+  /* Restart main mixer */
+  gst_element_set_state (melo_sink_pipeline, GST_STATE_PLAYING);
+
+  return TRUE;
+
+failed:
+  gst_element_set_state (melo_sink_pipeline, GST_STATE_PLAYING);
+  return FALSE;
+}
+
+/* Must be called with main context locked */
+static gboolean
+melo_sink_multiroom_start_receiver (void)
+{
+  /* Publish receiver: the master sends its stream to the service port */
+  melo_sink_avahi_service = melo_avahi_add_service (melo_sink_avahi,
+                                            g_get_host_name (),
+                                            MELO_SINK_MULTIROOM_RECEIVER_TYPE,
+                                            MELO_SINK_MULTIROOM_RTP_PORT, NULL);
+
+  /* Find masters: the stream is received when a master is found */
+  return melo_avahi_add_browser (melo_sink_avahi,
+                                 MELO_SINK_MULTIROOM_MASTER_TYPE);
+}
+
+/**
+ * melo_sink_main_init:
+ * @rate: the sample rate to use for the sound card
+ * @channels: the channel count to use for the sound card
+ *
+ * Initialize and configure the sound card and internal mixer with the settings
+ * provided. This function must be called once before any #MeloPlayer
+ * instantiation.
+ *
+ * Returns: %TRUE if initialization has been done with success, %FALSE
+ * otherwise.
+ */
+gboolean
+melo_sink_main_init (gint rate, gint channels)
+{
+  GstBus *bus;
+  GstPad *pad;
+  gchar *path;
+
+  /* Lock main context access */
+  G_LOCK (melo_sink_mutex);
+
+  /* Main context already initialized  */
+  if (melo_sink_is_initialized ())
+    goto failed;
+
+  /* Generate audio sink caps */
+  melo_sink_caps = melo_sink_gen_caps (rate, channels);
+  melo_sink_rate = rate;
+  melo_sink_channels = channels;
+
+  /* Create main pipeline: audiomixer -> capsfilter -> audiosink */
+  melo_sink_pipeline = gst_pipeline_new ("melo_sink_main");
+  melo_sink_mixer = gst_element_factory_make ("audiomixer", NULL);
+  melo_sink_filter = gst_element_factory_make ("capsfilter", NULL);
+  melo_sink_audiosink = gst_element_factory_make ("autoaudiosink", NULL);
+  if (!melo_sink_pipeline || !melo_sink_mixer || !melo_sink_filter ||
+      !melo_sink_audiosink) {
+    if (melo_sink_pipeline)
+      gst_object_unref (melo_sink_pipeline);
+    if (melo_sink_mixer)
+      gst_object_unref (melo_sink_mixer);
+    if (melo_sink_filter)
+      gst_object_unref (melo_sink_filter);
+    if (melo_sink_audiosink)
+      gst_object_unref (melo_sink_audiosink);
+    melo_sink_pipeline = melo_sink_mixer = melo_sink_filter = NULL;
+    melo_sink_audiosink = NULL;
+    gst_caps_unref (melo_sink_caps);
+    melo_sink_caps = NULL;
+    goto failed;
+  }
+  g_object_set (melo_sink_filter, "caps", melo_sink_caps, NULL);
+  g_object_set (melo_sink_mixer, "latency",
+                melo_sink_latencies[melo_sink_latency].latency_time *
+                GST_USECOND, NULL);
+  gst_bin_add_many (GST_BIN (melo_sink_pipeline), melo_sink_mixer,
+                    melo_sink_filter, melo_sink_audiosink, NULL);
+  gst_element_link_many (melo_sink_mixer, melo_sink_filter, melo_sink_audiosink,
+                         NULL);
+
+  /* Configure sound card when plugged by autoaudiosink */
+  g_signal_connect (melo_sink_pipeline, "deep-element-added",
+                    G_CALLBACK (melo_sink_element_added), NULL);
+
+  /* Add a message handler */
+  bus = gst_pipeline_get_bus (GST_PIPELINE (melo_sink_pipeline));
+  melo_sink_bus_watch = gst_bus_add_watch (bus, melo_sink_bus_call, NULL);
+
+  /* Promote streaming threads: the sound card is fed from them */
+  melo_sched_watch_bus (bus);
+  gst_object_unref (bus);
+
+  /* Watch sound card input to detect underruns */
+  pad = gst_element_get_static_pad (melo_sink_audiosink, "sink");
+  if (pad) {
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, melo_sink_main_probe,
+                       NULL, NULL);
+    gst_object_unref (pad);
+  }
+
+  /* Check health statistics periodically */
+  memset (&melo_sink_stats, 0, sizeof (melo_sink_stats));
+  memset (&melo_sink_stats_last, 0, sizeof (melo_sink_stats_last));
+  melo_sink_stats_latency = GST_CLOCK_TIME_NONE;
+  melo_sink_stats_dry = FALSE;
+  melo_sink_stats_timer = g_timeout_add_seconds (MELO_SINK_STATS_PERIOD,
+                                                 melo_sink_stats_check, NULL);
+
+  /* Start mixer: inputs are added when sinks are created */
+  gst_element_set_state (melo_sink_pipeline, GST_STATE_PLAYING);
+
+  /* Create hash table */
+  melo_sink_hash = g_hash_table_new (g_str_hash, g_str_equal);
+
+  /* Prepare filename to prepare sinks parameters storage */
+  melo_sink_store_file = g_strdup_printf ("%s/melo/sink_store.conf",
+                                          g_get_user_config_dir ());
+  path = g_path_get_dirname (melo_sink_store_file);
+  g_mkdir_with_parents (path, 0700);
+  g_free (path);
+
+  /* Create key file for volume/mute storage */
+  melo_sink_store = g_key_file_new ();
+  if (melo_sink_store) {
+    GError *err = NULL;
+    gdouble volume;
+    gboolean mute;
+
+    /* Restore settings from file */
+    g_key_file_load_from_file (melo_sink_store, melo_sink_store_file,
+                               G_KEY_FILE_NONE, NULL);
+
+    /* Restore volume */
+    volume = g_key_file_get_double (melo_sink_store, "main", "volume", &err);
+    if (!err)
+      melo_sink_volume = volume;
+    g_clear_error (&err);
+
+    /* Restore mute */
+    mute = g_key_file_get_boolean (melo_sink_store, "main", "mute", &err);
+    if (!err)
+      melo_sink_mute = mute;
+    g_clear_error (&err);
+  }
+
+  /* Unlock main context access */
+  G_UNLOCK (melo_sink_mutex);
+
+  return TRUE;
 
 failed:
   G_UNLOCK (melo_sink_mutex);
@@ -566,6 +2097,26 @@ melo_sink_main_release ()
     return FALSE;
   }
 
+  /* Stop multi-room output */
+  melo_sink_multiroom_stop ();
+
+  /* Stop health statistics check */
+  g_source_remove (melo_sink_stats_timer);
+  melo_sink_stats_timer = 0;
+
+  /* Cancel pending stream format switch */
+  if (melo_sink_passthrough_id)
+    g_source_remove (melo_sink_passthrough_id);
+  melo_sink_passthrough_id = 0;
+  gst_caps_replace (&melo_sink_passthrough_caps, NULL);
+
+  /* Stop and free main pipeline */
+  gst_element_set_state (melo_sink_pipeline, GST_STATE_NULL);
+  g_source_remove (melo_sink_bus_watch);
+  gst_object_unref (melo_sink_pipeline);
+  melo_sink_pipeline = melo_sink_mixer = melo_sink_filter = NULL;
+  melo_sink_audiosink = NULL;
+
   /* Free caps */
   gst_caps_unref (melo_sink_caps);
   melo_sink_caps = NULL;
@@ -576,9 +2127,8 @@ melo_sink_main_release ()
 
   /* Save sink store */
   if (melo_sink_store) {
-    /* Stop source */
-    if (melo_sink_store_timer)
-      g_source_remove (melo_sink_store_timer);
+    /* Cancel pending write */
+    melo_config_cancel_deferred (melo_sink_store_file);
 
     /* Save to file */
     g_key_file_save_to_file (melo_sink_store, melo_sink_store_file, NULL);
@@ -601,7 +2151,8 @@ melo_sink_main_release ()
  *
  * Set a new configuration on the sound card. An incremental update will be
  * done on all #MeloSink instances and then Gstreamer pipeline using the
- * #GstElement objects provided by melo_sink_get_gst_sink().
+ * #GstElement objects provided by melo_sink_get_gst_sink(). Since all sinks
+ * are mixed in a single main pipeline, only one device is reconfigured.
  *
  * Returns: %TRUE if new configuration has been applied with success, %FALSE
  * otherwise.
@@ -610,21 +2161,29 @@ gboolean
 melo_sink_set_main_config (gint rate, gint channels)
 {
   gboolean ret = FALSE;
-  GList *list;
 
   /* Lock main context access */
   G_LOCK (melo_sink_mutex);
 
   /* Get caps */
   if (melo_sink_caps) {
-    gst_caps_unref (melo_sink_caps);
-    melo_sink_caps = melo_sink_gen_caps (rate, channels);
+    GstCaps *caps = melo_sink_gen_caps (rate, channels);
+
+    /* Apply new caps on main mixer and all sinks */
+    melo_sink_rate = rate;
+    melo_sink_channels = channels;
+    melo_sink_apply_caps (caps);
+    gst_caps_unref (caps);
     ret = TRUE;
 
-    /* Update sink caps */
-    for (list = melo_sink_list; list != NULL; list = list->next) {
-      MeloSink *sink = (MeloSink *) list->data;
-      g_object_set (sink->priv->filter, "caps", melo_sink_caps, NULL);
+    /* Restart master to stream and publish the new format */
+    if (melo_sink_multiroom == MELO_SINK_MULTIROOM_MASTER) {
+      gint latency = melo_sink_multiroom_latency;
+
+      G_UNLOCK (melo_sink_mutex);
+      melo_sink_set_main_multiroom (MELO_SINK_MULTIROOM_NONE, 0);
+      melo_sink_set_main_multiroom (MELO_SINK_MULTIROOM_MASTER, latency);
+      return ret;
     }
   }
 
@@ -639,7 +2198,8 @@ melo_sink_set_main_config (gint rate, gint channels)
  * @rate: a pointer to a #gint to store the current sample rate
  * @channels: a pointer to a #gint to store the current channel count
  *
- * Get current configuration applied on the sound card.
+ * Get current configuration applied on the sound card. In passthrough mode, it
+ * can be the format of the last stream played instead of the configured one.
  *
  * Returns: %TRUE if configuration has been retrieved with success, %FALSE
  * otherwise.
@@ -667,6 +2227,258 @@ melo_sink_get_main_config (gint *rate, gint *channels)
   return ret;
 }
 
+/**
+ * melo_sink_get_main_passthrough:
+ *
+ * Get the passthrough mode of the sound card.
+ *
+ * Returns: %TRUE if passthrough mode is enabled, %FALSE otherwise.
+ */
+gboolean
+melo_sink_get_main_passthrough (void)
+{
+  return melo_sink_passthrough;
+}
+
+/**
+ * melo_sink_set_main_passthrough:
+ * @enable: set %TRUE to enable passthrough mode
+ *
+ * Enable or disable the passthrough mode. When enabled, the sound card is
+ * switched to the format of each new stream (16, 24 or 32 bits integer
+ * samples) and the format conversion and resampling of the #MeloSink are
+ * bypassed. The conversion is kept when the sound card doesn't support the
+ * stream format. As all sinks share the sound card, the other sinks are then
+ * converted to the format of the last stream.
+ *
+ * The volume processing is also bypassed when the sink volume, the sink gain
+ * and the main volume are set to 1.0 and not muted.
+ *
+ * When disabled, the configuration set with melo_sink_set_main_config() is
+ * restored.
+ *
+ * Returns: the actual passthrough mode.
+ */
+gboolean
+melo_sink_set_main_passthrough (gboolean enable)
+{
+  /* Lock main context access */
+  G_LOCK (melo_sink_mutex);
+
+  /* Restore configured format */
+  if (melo_sink_passthrough && !enable && melo_sink_caps) {
+    GstCaps *caps = melo_sink_gen_caps (melo_sink_rate, melo_sink_channels);
+    if (!gst_caps_is_equal (caps, melo_sink_caps))
+      melo_sink_apply_caps (caps);
+    gst_caps_unref (caps);
+  }
+  melo_sink_passthrough = enable;
+
+  /* Unlock main context access */
+  G_UNLOCK (melo_sink_mutex);
+
+  return enable;
+}
+
+/**
+ * melo_sink_get_main_latency:
+ *
+ * Get the latency profile applied on the sound card.
+ *
+ * Returns: the current latency profile of the sound card.
+ */
+MeloSinkLatency
+melo_sink_get_main_latency (void)
+{
+  return melo_sink_latency;
+}
+
+/**
+ * melo_sink_set_main_latency:
+ * @latency: the latency profile to use
+ *
+ * Set a new latency profile on the sound card: buffer and period sizes of the
+ * audio device are updated and the main mixer is restarted. A lower latency
+ * reduces the delay of volume and pause changes, when a higher latency reduces
+ * the CPU wake ups.
+ *
+ * Returns: the actual latency profile applied on the sound card.
+ */
+MeloSinkLatency
+melo_sink_set_main_latency (MeloSinkLatency latency)
+{
+  GstIterator *it;
+  GValue item = G_VALUE_INIT;
+
+  if (latency >= MELO_SINK_LATENCY_COUNT)
+    latency = MELO_SINK_LATENCY_DEFAULT;
+
+  /* Lock main context access */
+  G_LOCK (melo_sink_mutex);
+
+  /* Set new latency */
+  melo_sink_latency = latency;
+
+  /* Update sound card: ring buffer is allocated again in READY -> PAUSED */
+  if (melo_sink_pipeline) {
+    gst_element_set_state (melo_sink_pipeline, GST_STATE_READY);
+    g_object_set (melo_sink_mixer, "latency",
+                  melo_sink_latencies[latency].latency_time * GST_USECOND,
+                  NULL);
+    it = gst_bin_iterate_recurse (GST_BIN (melo_sink_pipeline));
+    while (gst_iterator_next (it, &item) == GST_ITERATOR_OK) {
+      melo_sink_setup_audiosink (g_value_get_object (&item));
+      g_value_reset (&item);
+    }
+    g_value_unset (&item);
+    gst_iterator_free (it);
+    gst_element_set_state (melo_sink_pipeline, GST_STATE_PLAYING);
+  }
+
+  /* Unlock main context access */
+  G_UNLOCK (melo_sink_mutex);
+
+  return latency;
+}
+
+/**
+ * melo_sink_multiroom_to_string:
+ * @mode: the multi-room mode
+ *
+ * Get the name of a multi-room mode.
+ *
+ * Returns: the name of the multi-room mode, or %NULL if invalid.
+ */
+const gchar *
+melo_sink_multiroom_to_string (MeloSinkMultiroom mode)
+{
+  if (mode >= MELO_SINK_MULTIROOM_COUNT)
+    return NULL;
+  return melo_sink_multirooms[mode];
+}
+
+/**
+ * melo_sink_multiroom_from_string:
+ * @name: the name of a multi-room mode
+ *
+ * Get a multi-room mode from its name ("none", "master" or "receiver").
+ *
+ * Returns: the multi-room mode, or MELO_SINK_MULTIROOM_NONE if @name is
+ * unknown.
+ */
+MeloSinkMultiroom
+melo_sink_multiroom_from_string (const gchar *name)
+{
+  MeloSinkMultiroom mode;
+
+  for (mode = 0; mode < MELO_SINK_MULTIROOM_COUNT; mode++)
+    if (!g_strcmp0 (name, melo_sink_multirooms[mode]))
+      return mode;
+
+  return MELO_SINK_MULTIROOM_NONE;
+}
+
+/**
+ * melo_sink_get_main_multiroom:
+ *
+ * Get the multi-room mode of the main mixer.
+ *
+ * Returns: the current multi-room mode.
+ */
+MeloSinkMultiroom
+melo_sink_get_main_multiroom (void)
+{
+  return melo_sink_multiroom;
+}
+
+/**
+ * melo_sink_get_main_multiroom_latency:
+ *
+ * Get the latency used by the main mixer in multi-room master mode.
+ *
+ * Returns: the multi-room latency (in ms).
+ */
+gint
+melo_sink_get_main_multiroom_latency (void)
+{
+  return melo_sink_multiroom_latency;
+}
+
+/**
+ * melo_sink_set_main_multiroom:
+ * @mode: the multi-room mode to use
+ * @latency: the latency between the master mixer and the sound cards (in ms)
+ *
+ * Set the multi-room mode of the main mixer.
+ *
+ * In master mode, the main mix is played on the sound card and it is also
+ * streamed over RTP to all receivers found with Zeroconf. The pipeline clock
+ * is shared on the network with a #GstNetTimeProvider, and its base time and
+ * @latency are published with the master service. The @latency must cover the
+ * network transfer and jitter: all instances play a sample @latency ms after
+ * it has been mixed by the master.
+ *
+ * In receiver mode, the instance publishes itself with Zeroconf and waits for
+ * a master. The main mixer is then slaved to the master clock, and the master
+ * stream is mixed with the local sinks. The latency published by the master
+ * is used instead of @latency.
+ *
+ * Returns: the actual multi-room mode.
+ */
+MeloSinkMultiroom
+melo_sink_set_main_multiroom (MeloSinkMultiroom mode, gint latency)
+{
+  gboolean ret = TRUE;
+
+  if (mode >= MELO_SINK_MULTIROOM_COUNT)
+    mode = MELO_SINK_MULTIROOM_NONE;
+
+  /* Lock main context access */
+  G_LOCK (melo_sink_mutex);
+
+  /* Main context not initialized */
+  if (!melo_sink_pipeline)
+    goto end;
+
+  /* Mode not changed: the latency is only used by a master */
+  if (mode == melo_sink_multiroom && (mode != MELO_SINK_MULTIROOM_MASTER ||
+      latency == melo_sink_multiroom_latency)) {
+    melo_sink_multiroom_latency = latency;
+    goto end;
+  }
+
+  /* Stop previous mode */
+  melo_sink_multiroom_stop ();
+  melo_sink_multiroom_latency = latency;
+  if (mode == MELO_SINK_MULTIROOM_NONE)
+    goto end;
+
+  /* Start new mode */
+  melo_sink_multiroom = mode;
+  melo_sink_avahi = melo_avahi_new ();
+  if (mode == MELO_SINK_MULTIROOM_MASTER)
+    ret = melo_sink_multiroom_start_master ();
+  else
+    ret = melo_sink_multiroom_start_receiver ();
+  if (!ret) {
+    melo_sink_multiroom_stop ();
+    goto end;
+  }
+
+  /* Follow receivers / master on the network */
+  melo_sink_net_generation = 0;
+  melo_sink_net_timer = g_timeout_add_seconds (MELO_SINK_MULTIROOM_SCAN_PERIOD,
+                                               melo_sink_multiroom_scan, NULL);
+
+end:
+  mode = melo_sink_multiroom;
+
+  /* Unlock main context access */
+  G_UNLOCK (melo_sink_mutex);
+
+  return mode;
+}
+
 /**
  * melo_sink_set_main_volume:
  *
@@ -703,7 +2515,8 @@ melo_sink_set_main_volume (gdouble volume)
   for (list = melo_sink_list; list != NULL; list = list->next) {
     MeloSink *sink = (MeloSink *) list->data;
     MeloSinkPrivate *priv = sink->priv;
-    g_object_set (priv->volume, "volume", priv->vol * volume, NULL);
+    g_object_set (priv->volume, "volume", priv->vol * priv->gain * volume,
+                  NULL);
   }
 
   /* Save volume */
@@ -26,6 +26,7 @@
 #include <gst/gst.h>
 
 #include "melo_player.h"
+#include "melo_sink_stream.h"
 
 G_BEGIN_DECLS
 
@@ -62,6 +63,70 @@ struct _MeloSinkClass {
   GObjectClass parent_class;
 };
 
+/**
+ * MeloSinkLatency:
+ * @MELO_SINK_LATENCY_DEFAULT: default buffering of the audio output
+ * @MELO_SINK_LATENCY_LOW: small buffers for fast volume / pause changes and
+ *    synchronized outputs, at the cost of more CPU wake ups
+ * @MELO_SINK_LATENCY_POWER_SAVE: large buffers to reduce CPU wake ups
+ * @MELO_SINK_LATENCY_COUNT: number of latency profiles
+ *
+ * Latency profiles of a #MeloSink and of the sound card.
+ */
+typedef enum {
+  MELO_SINK_LATENCY_DEFAULT = 0,
+  MELO_SINK_LATENCY_LOW,
+  MELO_SINK_LATENCY_POWER_SAVE,
+
+  MELO_SINK_LATENCY_COUNT
+} MeloSinkLatency;
+
+/**
+ * MeloSinkMultiroom:
+ * @MELO_SINK_MULTIROOM_NONE: the main mix is only played on the sound card
+ * @MELO_SINK_MULTIROOM_MASTER: the main mix is played on the sound card and
+ *    streamed to all receivers found on the network
+ * @MELO_SINK_MULTIROOM_RECEIVER: the stream of a master found on the network
+ *    is mixed and played in sync with the master
+ * @MELO_SINK_MULTIROOM_COUNT: number of multi-room modes
+ *
+ * Multi-room modes of the main mixer.
+ */
+typedef enum {
+  MELO_SINK_MULTIROOM_NONE = 0,
+  MELO_SINK_MULTIROOM_MASTER,
+  MELO_SINK_MULTIROOM_RECEIVER,
+
+  MELO_SINK_MULTIROOM_COUNT
+} MeloSinkMultiroom;
+
+/**
+ * MeloSinkStats:
+ * @buffers: number of buffers sent to the main mixer (or to the sound card for
+ *    the main mixer)
+ * @underruns: number of times the audio ran dry: the main mixer mixed silence
+ *    for the sink, or the sound card played silence for the main mixer
+ * @dropped: number of buffers dropped before reaching the main mixer
+ * @late: number of buffers rendered too late by the sink (or QoS messages
+ *    posted by the sound card for the main mixer)
+ * @latency: the latency reported by the audio sink (in us), or -1 if unknown
+ * @level: the fill level of the main mixer input queue (in percent), or -1 if
+ *    not available
+ * @cpu_time: the CPU time consumed by the current streaming thread (in us)
+ *
+ * Health statistics of a #MeloSink or of the main mixer, used to find the
+ * cause of an audio stutter. All counters are cumulative since creation.
+ */
+typedef struct {
+  guint64 buffers;
+  guint underruns;
+  guint dropped;
+  guint late;
+  gint64 latency;
+  gint level;
+  gint64 cpu_time;
+} MeloSinkStats;
+
 GType melo_sink_get_type (void);
 
 MeloSink *melo_sink_new (MeloPlayer *player, const gchar *id,
@@ -70,11 +135,13 @@ MeloSink *melo_sink_new (MeloPlayer *player, const gchar *id,
 /* Sink properties */
 const gchar *melo_sink_get_id (MeloSink *sink);
 const gchar *melo_sink_get_name (MeloSink *sink);
+MeloPlayer *melo_sink_get_player (MeloSink *sink);
 
 /* Sink control */
 GstElement *melo_sink_get_gst_sink (MeloSink *sink);
 gboolean melo_sink_get_sync (MeloSink *sink);
 void melo_sink_set_sync (MeloSink *sink, gboolean enable);
+void melo_sink_start_load (MeloSink *sink);
 
 /* Volume / mute control */
 gdouble melo_sink_get_volume (MeloSink *sink);
@@ -82,6 +149,30 @@ gdouble melo_sink_set_volume (MeloSink *sink, gdouble volume);
 gboolean melo_sink_get_mute (MeloSink *sink);
 gboolean melo_sink_set_mute (MeloSink *sink, gboolean mute);
 
+/* Level matching gain */
+gdouble melo_sink_get_gain (MeloSink *sink);
+void melo_sink_set_gain (MeloSink *sink, gdouble gain);
+
+/* Latency control */
+const gchar *melo_sink_latency_to_string (MeloSinkLatency latency);
+MeloSinkLatency melo_sink_latency_from_string (const gchar *name);
+MeloSinkLatency melo_sink_get_latency (MeloSink *sink);
+MeloSinkLatency melo_sink_set_latency (MeloSink *sink,
+                                       MeloSinkLatency latency);
+gint melo_sink_get_latency_time (MeloSink *sink);
+
+/* Encoded stream control */
+MeloSinkStreamFormat melo_sink_get_stream_format (MeloSink *sink);
+MeloSinkStreamFormat melo_sink_set_stream_format (MeloSink *sink,
+                                                  MeloSinkStreamFormat format);
+MeloSinkStream *melo_sink_get_stream (MeloSink *sink);
+
+/* Health statistics */
+gboolean melo_sink_get_stats (MeloSink *sink, MeloSinkStats *stats);
+
+/* Pipeline graph */
+gchar *melo_sink_dump_pipeline (MeloSink *sink);
+
 /* Main mixer control */
 gboolean melo_sink_main_init (gint rate, gint channels);
 gboolean melo_sink_main_release ();
@@ -96,6 +187,22 @@ gdouble melo_sink_set_main_volume (gdouble volume);
 gboolean melo_sink_get_main_mute ();
 gboolean melo_sink_set_main_mute (gboolean mute);
 
+/* Main mixer passthrough control */
+gboolean melo_sink_get_main_passthrough (void);
+gboolean melo_sink_set_main_passthrough (gboolean enable);
+
+/* Main mixer latency control */
+MeloSinkLatency melo_sink_get_main_latency (void);
+MeloSinkLatency melo_sink_set_main_latency (MeloSinkLatency latency);
+
+/* Main mixer multi-room control */
+const gchar *melo_sink_multiroom_to_string (MeloSinkMultiroom mode);
+MeloSinkMultiroom melo_sink_multiroom_from_string (const gchar *name);
+MeloSinkMultiroom melo_sink_get_main_multiroom (void);
+gint melo_sink_get_main_multiroom_latency (void);
+MeloSinkMultiroom melo_sink_set_main_multiroom (MeloSinkMultiroom mode,
+                                                gint latency);
+
 /* Main mixer sink list */
 MeloSink *melo_sink_get_sink_by_id (const gchar *id);
 GList *melo_sink_get_sink_list (void);
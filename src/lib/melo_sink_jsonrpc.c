@@ -31,12 +31,16 @@
 
 typedef enum {
   MELO_SINK_JSONRPC_FIELDS_NONE = 0,
-  MELO_SINK_JSONRPC_FIELDS_ID,
-  MELO_SINK_JSONRPC_FIELDS_NAME,
-  MELO_SINK_JSONRPC_FIELDS_VOLUME,
-  MELO_SINK_JSONRPC_FIELDS_MUTE,
-  MELO_SINK_JSONRPC_FIELDS_SAMPLERATE,
-  MELO_SINK_JSONRPC_FIELDS_CHANNELS,
+  MELO_SINK_JSONRPC_FIELDS_ID = 1,
+  MELO_SINK_JSONRPC_FIELDS_NAME = 2,
+  MELO_SINK_JSONRPC_FIELDS_VOLUME = 4,
+  MELO_SINK_JSONRPC_FIELDS_MUTE = 8,
+  MELO_SINK_JSONRPC_FIELDS_SAMPLERATE = 16,
+  MELO_SINK_JSONRPC_FIELDS_CHANNELS = 32,
+  MELO_SINK_JSONRPC_FIELDS_LATENCY = 64,
+  MELO_SINK_JSONRPC_FIELDS_LATENCY_TIME = 128,
+  MELO_SINK_JSONRPC_FIELDS_PASSTHROUGH = 256,
+  MELO_SINK_JSONRPC_FIELDS_STREAM = 512,
 
   MELO_SINK_JSONRPC_FIELDS_FULL = ~0
 } MeloSinkJSONRPCFields;
@@ -101,6 +105,14 @@ melo_sink_jsonrpc_get_fields (JsonObject *obj, const gchar *name)
       fields |= MELO_SINK_JSONRPC_FIELDS_SAMPLERATE;
     else if (!g_strcmp0 (field, "channels"))
       fields |= MELO_SINK_JSONRPC_FIELDS_CHANNELS;
+    else if (!g_strcmp0 (field, "latency"))
+      fields |= MELO_SINK_JSONRPC_FIELDS_LATENCY;
+    else if (!g_strcmp0 (field, "latency_time"))
+      fields |= MELO_SINK_JSONRPC_FIELDS_LATENCY_TIME;
+    else if (!g_strcmp0 (field, "passthrough"))
+      fields |= MELO_SINK_JSONRPC_FIELDS_PASSTHROUGH;
+    else if (!g_strcmp0 (field, "stream"))
+      fields |= MELO_SINK_JSONRPC_FIELDS_STREAM;
   }
 
   return fields;
@@ -109,11 +121,13 @@ melo_sink_jsonrpc_get_fields (JsonObject *obj, const gchar *name)
 static JsonObject *
 melo_sink_jsonrpc_main_to_object (MeloSinkJSONRPCFields fields)
 {
+  MeloSinkLatency latency;
   gint rate, channels;
   JsonObject *obj;
 
   /* Get main output settings */
   melo_sink_get_main_config (&rate, &channels);
+  latency = melo_sink_get_main_latency ();
 
   /* Generate object */
   obj = json_object_new ();
@@ -129,6 +143,15 @@ melo_sink_jsonrpc_main_to_object (MeloSinkJSONRPCFields fields)
       json_object_set_int_member (obj, "samplerate", rate);
     if (fields & MELO_SINK_JSONRPC_FIELDS_CHANNELS)
       json_object_set_int_member (obj, "channels", channels);
+    if (fields & MELO_SINK_JSONRPC_FIELDS_LATENCY)
+      json_object_set_string_member (obj, "latency",
+                                     melo_sink_latency_to_string (latency));
+    if (fields & MELO_SINK_JSONRPC_FIELDS_LATENCY_TIME)
+      json_object_set_int_member (obj, "latency_time",
+                                  melo_sink_get_latency_time (NULL));
+    if (fields & MELO_SINK_JSONRPC_FIELDS_PASSTHROUGH)
+      json_object_set_boolean_member (obj, "passthrough",
+                                      melo_sink_get_main_passthrough ());
   }
 
   return obj;
@@ -137,6 +160,7 @@ melo_sink_jsonrpc_main_to_object (MeloSinkJSONRPCFields fields)
 static JsonObject *
 melo_sink_jsonrpc_sink_to_object (MeloSink *sink, MeloSinkJSONRPCFields fields)
 {
+  MeloSinkLatency latency = melo_sink_get_latency (sink);
   JsonObject *obj;
 
   /* Generate object */
@@ -151,11 +175,50 @@ melo_sink_jsonrpc_sink_to_object (MeloSink *sink, MeloSinkJSONRPCFields fields)
                                      melo_sink_get_volume (sink));
     if (fields & MELO_SINK_JSONRPC_FIELDS_MUTE)
       json_object_set_boolean_member (obj, "mute", melo_sink_get_mute (sink));
+    if (fields & MELO_SINK_JSONRPC_FIELDS_LATENCY)
+      json_object_set_string_member (obj, "latency",
+                                     melo_sink_latency_to_string (latency));
+    if (fields & MELO_SINK_JSONRPC_FIELDS_LATENCY_TIME)
+      json_object_set_int_member (obj, "latency_time",
+                                  melo_sink_get_latency_time (sink));
+    if (fields & MELO_SINK_JSONRPC_FIELDS_STREAM)
+      json_object_set_string_member (obj, "stream",
+                                     melo_sink_stream_format_to_string (
+                                         melo_sink_get_stream_format (sink)));
   }
 
   return obj;
 }
 
+/**
+ * melo_sink_jsonrpc_stats_to_object:
+ * @stats: the #MeloSinkStats to convert
+ *
+ * Generate a #JsonObject from the health statistics of a #MeloSink. The
+ * latency and the level are not set when they are unknown.
+ *
+ * Returns: (transfer full): a new #JsonObject with the statistics.
+ */
+JsonObject *
+melo_sink_jsonrpc_stats_to_object (const MeloSinkStats *stats)
+{
+  JsonObject *obj;
+
+  /* Generate object */
+  obj = json_object_new ();
+  json_object_set_int_member (obj, "buffers", stats->buffers);
+  json_object_set_int_member (obj, "underruns", stats->underruns);
+  json_object_set_int_member (obj, "dropped", stats->dropped);
+  json_object_set_int_member (obj, "late", stats->late);
+  if (stats->latency >= 0)
+    json_object_set_int_member (obj, "latency", stats->latency);
+  if (stats->level >= 0)
+    json_object_set_int_member (obj, "level", stats->level);
+  json_object_set_int_member (obj, "cpu_time", stats->cpu_time);
+
+  return obj;
+}
+
 /* Method callbacks */
 static void
 melo_sink_jsonrpc_get_list (const gchar *method,
@@ -254,6 +317,41 @@ end:
   json_node_take_object (*result, obj);
 }
 
+static void
+melo_sink_jsonrpc_get_stats (const gchar *method,
+                             JsonArray *s_params, JsonNode *params,
+                             JsonNode **result, JsonNode **error,
+                             gpointer user_data)
+{
+  MeloSink *sink = NULL;
+  MeloSinkStats stats;
+  JsonObject *obj;
+
+  /* Get parameters */
+  obj = melo_jsonrpc_get_object (s_params, params, error);
+  if (!obj)
+    return;
+
+  /* Get sink from ID (NULL if ID = main) */
+  if (g_strcmp0 (json_object_get_string_member (obj, "id"), "main")) {
+    sink = melo_sink_jsonrpc_get_sink (obj, error);
+    if (!sink) {
+      json_object_unref (obj);
+      return;
+    }
+  }
+  json_object_unref (obj);
+
+  /* Get statistics */
+  melo_sink_get_stats (sink, &stats);
+  if (sink)
+    g_object_unref (sink);
+
+  /* Return result */
+  *result = json_node_new (JSON_NODE_OBJECT);
+  json_node_take_object (*result, melo_sink_jsonrpc_stats_to_object (&stats));
+}
+
 static void
 melo_sink_jsonrpc_set (const gchar *method,
                        JsonArray *s_params, JsonNode *params,
@@ -286,6 +384,30 @@ melo_sink_jsonrpc_set (const gchar *method,
     json_object_set_boolean_member (obj, "mute", mute);
   }
 
+  /* Set latency profile */
+  if (json_object_has_member (obj, "latency")) {
+    const gchar *name = json_object_get_string_member (obj, "latency");
+    MeloSinkLatency latency;
+
+    latency = melo_sink_set_latency (sink,
+                                     melo_sink_latency_from_string (name));
+    json_object_set_string_member (obj, "latency",
+                                   melo_sink_latency_to_string (latency));
+    json_object_set_int_member (obj, "latency_time",
+                                melo_sink_get_latency_time (sink));
+  }
+
+  /* Set encoded stream format */
+  if (sink && json_object_has_member (obj, "stream")) {
+    const gchar *name = json_object_get_string_member (obj, "stream");
+    MeloSinkStreamFormat format;
+
+    format = melo_sink_set_stream_format (sink,
+                                    melo_sink_stream_format_from_string (name));
+    json_object_set_string_member (obj, "stream",
+                                   melo_sink_stream_format_to_string (format));
+  }
+
   /* Unref sink */
   if (sink)
     g_object_unref (sink);
@@ -295,6 +417,47 @@ melo_sink_jsonrpc_set (const gchar *method,
   json_node_take_object (*result, obj);
 }
 
+static void
+melo_sink_jsonrpc_dump_pipeline (const gchar *method,
+                                 JsonArray *s_params, JsonNode *params,
+                                 JsonNode **result, JsonNode **error,
+                                 gpointer user_data)
+{
+  MeloSink *sink = NULL;
+  JsonObject *obj;
+  gchar *dot;
+
+  /* Get parameters */
+  obj = melo_jsonrpc_get_object (s_params, params, error);
+  if (!obj)
+    return;
+
+  /* Get sink from ID (NULL if ID = main) */
+  if (g_strcmp0 (json_object_get_string_member (obj, "id"), "main")) {
+    sink = melo_sink_jsonrpc_get_sink (obj, error);
+    if (!sink) {
+      json_object_unref (obj);
+      return;
+    }
+  }
+  json_object_unref (obj);
+
+  /* Dump pipeline graph */
+  dot = melo_sink_dump_pipeline (sink);
+  if (sink)
+    g_object_unref (sink);
+  if (!dot) {
+    *error = melo_jsonrpc_build_error_node (MELO_JSONRPC_ERROR_INTERNAL_ERROR,
+                                            "Failed to dump pipeline");
+    return;
+  }
+
+  /* Return graph */
+  *result = json_node_new (JSON_NODE_VALUE);
+  json_node_set_string (*result, dot);
+  g_free (dot);
+}
+
 /* List of methods */
 static MeloJSONRPCMethod melo_sink_jsonrpc_methods[] = {
   {
@@ -308,6 +471,7 @@ static MeloJSONRPCMethod melo_sink_jsonrpc_methods[] = {
     .result = "{\"type\":\"array\"}",
     .callback = melo_sink_jsonrpc_get_list,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONCURRENT,
   },
   {
     .method = "get",
@@ -321,6 +485,7 @@ static MeloJSONRPCMethod melo_sink_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_sink_jsonrpc_get,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONCURRENT | MELO_JSONRPC_FLAGS_CONTROL,
   },
   {
     .method = "set",
@@ -333,11 +498,40 @@ static MeloJSONRPCMethod melo_sink_jsonrpc_methods[] = {
               "  {"
               "    \"name\": \"mute\", \"type\": \"boolean\","
               "    \"required\": false"
+              "  },"
+              "  {"
+              "    \"name\": \"latency\", \"type\": \"string\","
+              "    \"required\": false"
+              "  },"
+              "  {"
+              "    \"name\": \"stream\", \"type\": \"string\","
+              "    \"required\": false"
               "  }"
               "]",
     .result = "{\"type\":\"object\"}",
     .callback = melo_sink_jsonrpc_set,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONTROL,
+  },
+  {
+    .method = "get_stats",
+    .params = "["
+              "  {\"name\": \"id\", \"type\": \"string\"}"
+              "]",
+    .result = "{\"type\":\"object\"}",
+    .callback = melo_sink_jsonrpc_get_stats,
+    .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONCURRENT,
+  },
+  {
+    .method = "dump_pipeline",
+    .params = "["
+              "  {\"name\": \"id\", \"type\": \"string\"}"
+              "]",
+    .result = "{\"type\":\"string\"}",
+    .callback = melo_sink_jsonrpc_dump_pipeline,
+    .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONCURRENT | MELO_JSONRPC_FLAGS_BULK,
   },
 };
 
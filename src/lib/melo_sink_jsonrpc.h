@@ -25,6 +25,9 @@
 #include "melo_sink.h"
 #include "melo_jsonrpc.h"
 
+/* Health statistics helper */
+JsonObject *melo_sink_jsonrpc_stats_to_object (const MeloSinkStats *stats);
+
 /* JSON-RPC methods */
 void melo_sink_jsonrpc_register_methods (void);
 void melo_sink_jsonrpc_unregister_methods (void);
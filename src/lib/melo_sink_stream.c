@@ -0,0 +1,526 @@
+/*
+ * melo_sink_stream.c: Encoded audio stream of a sink for many listeners
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <gst/app/app.h>
+
+#include "melo_sink_stream.h"
+
+/**
+ * SECTION:melo_sink_stream
+ * @title: MeloSinkStream
+ * @short_description: Encoded audio stream for many listeners
+ *
+ * #MeloSinkStream encodes the audio of a #MeloSink once and shares the encoded
+ * data with all its listeners, such as HTTP clients.
+ *
+ * The encoded buffers are kept in a fan-out ring of MELO_SINK_STREAM_CHUNKS
+ * chunks, shared by all listeners: each listener only holds its position in
+ * the ring, so a new listener costs neither a new encoder nor a copy of the
+ * data. A listener which is too slow to follow the stream skips the chunks
+ * which have been overwritten. The stream headers (Ogg and FLAC) are saved
+ * aside and sent first to each new listener.
+ *
+ * The encoder is fed only when at least one listener is attached.
+ */
+
+/* Size of fan-out ring (in chunks) and data sent at connection (in bytes) */
+#define MELO_SINK_STREAM_CHUNKS 256
+#define MELO_SINK_STREAM_BURST_SIZE 32768
+
+static const struct {
+  const gchar *name;
+  const gchar *mime_type;
+  const gchar *encoder;
+} melo_sink_stream_formats[MELO_SINK_STREAM_COUNT] = {
+  [MELO_SINK_STREAM_NONE] = { "none", NULL, NULL },
+  [MELO_SINK_STREAM_OPUS] = { "opus", "audio/ogg",
+                              "opusenc bitrate=128000 ! oggmux" },
+  [MELO_SINK_STREAM_MP3] = { "mp3", "audio/mpeg",
+                             "lamemp3enc target=bitrate cbr=true bitrate=192" },
+  [MELO_SINK_STREAM_FLAC] = { "flac", "audio/flac", "flacenc" },
+};
+
+struct _MeloSinkStream {
+  gint ref_count;
+  MeloSinkStreamFormat format;
+
+  /* Encoder */
+  GstElement *bin;
+  GstElement *valve;
+  GstCaps *caps;
+
+  /* Fan-out ring */
+  GMutex mutex;
+  GPtrArray *headers;
+  GBytes *chunks[MELO_SINK_STREAM_CHUNKS];
+  guint64 first;
+  guint64 last;
+  gboolean closed;
+
+  /* Listeners */
+  GList *listeners;
+  guint notify_id;
+};
+
+struct _MeloSinkListener {
+  MeloSinkStream *stream;
+  MeloSinkListenerFunc func;
+  gpointer user_data;
+
+  /* Position in stream */
+  guint header;
+  guint64 pos;
+};
+
+/**
+ * melo_sink_stream_format_to_string:
+ * @format: the stream format
+ *
+ * Get the name of a stream format.
+ *
+ * Returns: the name of the stream format, or %NULL if invalid.
+ */
+const gchar *
+melo_sink_stream_format_to_string (MeloSinkStreamFormat format)
+{
+  if (format >= MELO_SINK_STREAM_COUNT)
+    return NULL;
+  return melo_sink_stream_formats[format].name;
+}
+
+/**
+ * melo_sink_stream_format_from_string:
+ * @name: the name of a stream format
+ *
+ * Get a stream format from its name ("none", "opus", "mp3" or "flac").
+ *
+ * Returns: the stream format, or MELO_SINK_STREAM_NONE if @name is unknown.
+ */
+MeloSinkStreamFormat
+melo_sink_stream_format_from_string (const gchar *name)
+{
+  MeloSinkStreamFormat format;
+
+  for (format = 0; format < MELO_SINK_STREAM_COUNT; format++)
+    if (!g_strcmp0 (name, melo_sink_stream_formats[format].name))
+      return format;
+
+  return MELO_SINK_STREAM_NONE;
+}
+
+static gboolean
+melo_sink_stream_notify (gpointer user_data)
+{
+  MeloSinkStream *stream = user_data;
+  GList *list, *l;
+
+  /* Get listeners to notify */
+  g_mutex_lock (&stream->mutex);
+  stream->notify_id = 0;
+  list = g_list_copy (stream->listeners);
+  g_mutex_unlock (&stream->mutex);
+
+  /* Notify listeners */
+  for (l = list; l != NULL; l = l->next) {
+    MeloSinkListener *listener = l->data;
+    listener->func (listener, listener->user_data);
+  }
+  g_list_free (list);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Must be called with stream locked */
+static void
+melo_sink_stream_schedule_notify (MeloSinkStream *stream)
+{
+  /* Listeners are notified from main context: one notification is enough for
+   * all the chunks pushed in the meantime
+   */
+  if (!stream->notify_id && stream->listeners)
+    stream->notify_id = g_idle_add_full (G_PRIORITY_DEFAULT,
+                                         melo_sink_stream_notify,
+                                         melo_sink_stream_ref (stream),
+                                         (GDestroyNotify)
+                                           melo_sink_stream_unref);
+}
+
+/* Must be called with stream locked */
+static void
+melo_sink_stream_set_headers (MeloSinkStream *stream, GstCaps *caps)
+{
+  const GValue *headers;
+  GstStructure *str;
+  guint i;
+
+  /* Reset stream headers */
+  g_ptr_array_set_size (stream->headers, 0);
+  str = gst_caps_get_structure (caps, 0);
+  headers = gst_structure_get_value (str, "streamheader");
+  if (!headers || !GST_VALUE_HOLDS_ARRAY (headers))
+    return;
+
+  /* Save stream headers: they are sent first to each listener */
+  for (i = 0; i < gst_value_array_get_size (headers); i++) {
+    const GValue *value = gst_value_array_get_value (headers, i);
+    GstBuffer *buffer = gst_value_get_buffer (value);
+    GstMapInfo map;
+
+    if (!buffer || !gst_buffer_map (buffer, &map, GST_MAP_READ))
+      continue;
+    g_ptr_array_add (stream->headers, g_bytes_new (map.data, map.size));
+    gst_buffer_unmap (buffer, &map);
+  }
+}
+
+static GstFlowReturn
+melo_sink_stream_new_sample (GstAppSink *appsink, gpointer user_data)
+{
+  MeloSinkStream *stream = user_data;
+  GstSample *sample;
+  GstBuffer *buffer;
+  GstCaps *caps;
+  GstMapInfo map;
+  guint idx;
+
+  /* Get next sample */
+  sample = gst_app_sink_pull_sample (appsink);
+  if (!sample)
+    return GST_FLOW_EOS;
+  buffer = gst_sample_get_buffer (sample);
+  caps = gst_sample_get_caps (sample);
+
+  g_mutex_lock (&stream->mutex);
+
+  /* New stream format */
+  if (caps && caps != stream->caps) {
+    gst_caps_replace (&stream->caps, caps);
+    melo_sink_stream_set_headers (stream, caps);
+  }
+
+  /* Headers are already saved from caps */
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_HEADER) &&
+      stream->headers->len)
+    goto end;
+
+  /* Add a new chunk to the ring: the oldest chunk is dropped */
+  if (!gst_buffer_map (buffer, &map, GST_MAP_READ))
+    goto end;
+  idx = stream->last % MELO_SINK_STREAM_CHUNKS;
+  if (stream->chunks[idx])
+    g_bytes_unref (stream->chunks[idx]);
+  stream->chunks[idx] = g_bytes_new (map.data, map.size);
+  gst_buffer_unmap (buffer, &map);
+  stream->last++;
+  if (stream->last - stream->first > MELO_SINK_STREAM_CHUNKS)
+    stream->first = stream->last - MELO_SINK_STREAM_CHUNKS;
+
+  /* Wake up listeners */
+  melo_sink_stream_schedule_notify (stream);
+
+end:
+  g_mutex_unlock (&stream->mutex);
+  gst_sample_unref (sample);
+
+  return GST_FLOW_OK;
+}
+
+static GstAppSinkCallbacks melo_sink_stream_callbacks = {
+  .new_sample = melo_sink_stream_new_sample,
+};
+
+/**
+ * melo_sink_stream_new:
+ * @format: the encoding format
+ *
+ * Create a new #MeloSinkStream which encodes audio to @format. The #GstElement
+ * returned by melo_sink_stream_get_gst_bin() must be added to a pipeline and
+ * fed with raw audio.
+ *
+ * Returns: (transfer full): the new #MeloSinkStream, or %NULL if the encoder
+ * is not available. Use melo_sink_stream_unref() after usage.
+ */
+MeloSinkStream *
+melo_sink_stream_new (MeloSinkStreamFormat format)
+{
+  MeloSinkStream *stream;
+  GstElement *appsink;
+  GError *err = NULL;
+  gchar *desc;
+
+  if (format == MELO_SINK_STREAM_NONE || format >= MELO_SINK_STREAM_COUNT)
+    return NULL;
+
+  /* Create encoder: the valve drops audio when nobody listens */
+  stream = g_slice_new0 (MeloSinkStream);
+  desc = g_strdup_printf ("queue ! valve name=valve drop=true ! "
+                          "audioconvert ! audioresample ! %s ! "
+                          "appsink name=sink sync=false "
+                          "enable-last-sample=false",
+                          melo_sink_stream_formats[format].encoder);
+  stream->bin = gst_parse_bin_from_description (desc, TRUE, &err);
+  g_free (desc);
+  if (!stream->bin) {
+    g_warning ("failed to create %s stream: %s",
+               melo_sink_stream_formats[format].name, err->message);
+    g_error_free (err);
+    g_slice_free (MeloSinkStream, stream);
+    return NULL;
+  }
+  gst_object_ref_sink (stream->bin);
+  stream->valve = gst_bin_get_by_name (GST_BIN (stream->bin), "valve");
+
+  /* Init stream */
+  stream->ref_count = 1;
+  stream->format = format;
+  stream->headers = g_ptr_array_new_with_free_func (
+                                              (GDestroyNotify) g_bytes_unref);
+  g_mutex_init (&stream->mutex);
+
+  /* Get encoded buffers */
+  appsink = gst_bin_get_by_name (GST_BIN (stream->bin), "sink");
+  gst_app_sink_set_callbacks (GST_APP_SINK (appsink),
+                              &melo_sink_stream_callbacks, stream, NULL);
+  gst_object_unref (appsink);
+
+  return stream;
+}
+
+/**
+ * melo_sink_stream_ref:
+ * @stream: the stream
+ *
+ * Increment the reference counter of the #MeloSinkStream.
+ *
+ * Returns: (transfer full): the #MeloSinkStream.
+ */
+MeloSinkStream *
+melo_sink_stream_ref (MeloSinkStream *stream)
+{
+  g_atomic_int_inc (&stream->ref_count);
+  return stream;
+}
+
+/**
+ * melo_sink_stream_unref:
+ * @stream: the stream
+ *
+ * Decrement the reference counter of the #MeloSinkStream. When it reaches
+ * zero, the stream and its encoder are freed.
+ */
+void
+melo_sink_stream_unref (MeloSinkStream *stream)
+{
+  guint i;
+
+  if (!g_atomic_int_dec_and_test (&stream->ref_count))
+    return;
+
+  /* Free encoder */
+  gst_element_set_state (stream->bin, GST_STATE_NULL);
+  gst_object_unref (stream->valve);
+  gst_object_unref (stream->bin);
+  if (stream->caps)
+    gst_caps_unref (stream->caps);
+
+  /* Free ring */
+  for (i = 0; i < MELO_SINK_STREAM_CHUNKS; i++)
+    if (stream->chunks[i])
+      g_bytes_unref (stream->chunks[i]);
+  g_ptr_array_free (stream->headers, TRUE);
+  g_mutex_clear (&stream->mutex);
+
+  g_slice_free (MeloSinkStream, stream);
+}
+
+/**
+ * melo_sink_stream_get_format:
+ * @stream: the stream
+ *
+ * Get the encoding format of the stream.
+ *
+ * Returns: the encoding format.
+ */
+MeloSinkStreamFormat
+melo_sink_stream_get_format (MeloSinkStream *stream)
+{
+  return stream->format;
+}
+
+/**
+ * melo_sink_stream_get_mime_type:
+ * @stream: the stream
+ *
+ * Get the MIME type of the encoded data, to set in the HTTP Content-Type
+ * header.
+ *
+ * Returns: the MIME type of the stream.
+ */
+const gchar *
+melo_sink_stream_get_mime_type (MeloSinkStream *stream)
+{
+  return melo_sink_stream_formats[stream->format].mime_type;
+}
+
+/**
+ * melo_sink_stream_get_gst_bin:
+ * @stream: the stream
+ *
+ * Get the encoder bin of the stream, with a single "sink" pad.
+ *
+ * Returns: (transfer none): the #GstElement of the encoder.
+ */
+GstElement *
+melo_sink_stream_get_gst_bin (MeloSinkStream *stream)
+{
+  return stream->bin;
+}
+
+/**
+ * melo_sink_stream_close:
+ * @stream: the stream
+ *
+ * Close the stream: the listeners are notified and melo_sink_listener_pop()
+ * reports the end of the stream once the remaining data has been read.
+ */
+void
+melo_sink_stream_close (MeloSinkStream *stream)
+{
+  g_mutex_lock (&stream->mutex);
+  stream->closed = TRUE;
+  melo_sink_stream_schedule_notify (stream);
+  g_mutex_unlock (&stream->mutex);
+}
+
+/**
+ * melo_sink_stream_add_listener:
+ * @stream: the stream
+ * @func: the function to call when new data is available
+ * @user_data: the data to pass to @func
+ *
+ * Add a new listener on the stream. The listener starts with the stream
+ * headers, followed by the last MELO_SINK_STREAM_BURST_SIZE bytes of the
+ * stream, so a player can start quickly.
+ *
+ * Returns: (transfer full): the new #MeloSinkListener. Use
+ * melo_sink_stream_remove_listener() to remove it.
+ */
+MeloSinkListener *
+melo_sink_stream_add_listener (MeloSinkStream *stream,
+                               MeloSinkListenerFunc func, gpointer user_data)
+{
+  MeloSinkListener *listener;
+  gsize size = 0;
+
+  /* Create listener */
+  listener = g_slice_new0 (MeloSinkListener);
+  listener->stream = melo_sink_stream_ref (stream);
+  listener->func = func;
+  listener->user_data = user_data;
+
+  g_mutex_lock (&stream->mutex);
+
+  /* Start with the end of the ring */
+  listener->pos = stream->last;
+  while (listener->pos > stream->first && size < MELO_SINK_STREAM_BURST_SIZE) {
+    listener->pos--;
+    size += g_bytes_get_size (
+                  stream->chunks[listener->pos % MELO_SINK_STREAM_CHUNKS]);
+  }
+
+  /* Start encoder with first listener */
+  if (!stream->listeners)
+    g_object_set (stream->valve, "drop", FALSE, NULL);
+  stream->listeners = g_list_prepend (stream->listeners, listener);
+
+  /* Send buffered data */
+  melo_sink_stream_schedule_notify (stream);
+
+  g_mutex_unlock (&stream->mutex);
+
+  return listener;
+}
+
+/**
+ * melo_sink_stream_remove_listener:
+ * @listener: the listener
+ *
+ * Remove a listener from its stream and free it. The encoder is paused when
+ * the last listener is removed.
+ */
+void
+melo_sink_stream_remove_listener (MeloSinkListener *listener)
+{
+  MeloSinkStream *stream = listener->stream;
+
+  g_mutex_lock (&stream->mutex);
+  stream->listeners = g_list_remove (stream->listeners, listener);
+  if (!stream->listeners)
+    g_object_set (stream->valve, "drop", TRUE, NULL);
+  g_mutex_unlock (&stream->mutex);
+
+  melo_sink_stream_unref (stream);
+  g_slice_free (MeloSinkListener, listener);
+}
+
+/**
+ * melo_sink_listener_pop:
+ * @listener: the listener
+ * @closed: (out) (optional): set to %TRUE if the stream has been closed
+ *
+ * Get the next chunk of encoded data for @listener. The chunks are shared by
+ * all the listeners and must not be modified. It should be called until it
+ * returns %NULL, after each call of the #MeloSinkListenerFunc.
+ *
+ * Returns: (transfer full): the next chunk of data, or %NULL if no more data is
+ * available. Use g_bytes_unref() after usage.
+ */
+GBytes *
+melo_sink_listener_pop (MeloSinkListener *listener, gboolean *closed)
+{
+  MeloSinkStream *stream = listener->stream;
+  GBytes *chunk = NULL;
+
+  g_mutex_lock (&stream->mutex);
+
+  /* Send headers first */
+  if (listener->header < stream->headers->len) {
+    chunk = g_bytes_ref (g_ptr_array_index (stream->headers,
+                                            listener->header++));
+    goto end;
+  }
+
+  /* Listener is too slow: skip overwritten chunks */
+  if (listener->pos < stream->first)
+    listener->pos = stream->first;
+
+  /* Get next chunk */
+  if (listener->pos < stream->last)
+    chunk = g_bytes_ref (
+                  stream->chunks[listener->pos++ % MELO_SINK_STREAM_CHUNKS]);
+
+end:
+  if (closed)
+    *closed = stream->closed;
+  g_mutex_unlock (&stream->mutex);
+
+  return chunk;
+}
@@ -0,0 +1,85 @@
+/*
+ * melo_sink_stream.h: Encoded audio stream of a sink for many listeners
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __MELO_SINK_STREAM_H__
+#define __MELO_SINK_STREAM_H__
+
+#include <glib.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _MeloSinkStream MeloSinkStream;
+typedef struct _MeloSinkListener MeloSinkListener;
+
+/**
+ * MeloSinkStreamFormat:
+ * @MELO_SINK_STREAM_NONE: no stream
+ * @MELO_SINK_STREAM_OPUS: Opus in an Ogg container
+ * @MELO_SINK_STREAM_MP3: MP3 at a constant bitrate
+ * @MELO_SINK_STREAM_FLAC: lossless FLAC
+ * @MELO_SINK_STREAM_COUNT: number of stream formats
+ *
+ * Encoding formats of a #MeloSinkStream.
+ */
+typedef enum {
+  MELO_SINK_STREAM_NONE = 0,
+  MELO_SINK_STREAM_OPUS,
+  MELO_SINK_STREAM_MP3,
+  MELO_SINK_STREAM_FLAC,
+
+  MELO_SINK_STREAM_COUNT
+} MeloSinkStreamFormat;
+
+/**
+ * MeloSinkListenerFunc:
+ * @listener: the listener
+ * @user_data: the user data passed to melo_sink_stream_add_listener()
+ *
+ * Called from the main context when new data is available for @listener or
+ * when the stream has been closed. The data is then read with
+ * melo_sink_listener_pop().
+ */
+typedef void (*MeloSinkListenerFunc) (MeloSinkListener *listener,
+                                      gpointer user_data);
+
+const gchar *melo_sink_stream_format_to_string (MeloSinkStreamFormat format);
+MeloSinkStreamFormat melo_sink_stream_format_from_string (const gchar *name);
+
+MeloSinkStream *melo_sink_stream_new (MeloSinkStreamFormat format);
+MeloSinkStream *melo_sink_stream_ref (MeloSinkStream *stream);
+void melo_sink_stream_unref (MeloSinkStream *stream);
+
+MeloSinkStreamFormat melo_sink_stream_get_format (MeloSinkStream *stream);
+const gchar *melo_sink_stream_get_mime_type (MeloSinkStream *stream);
+GstElement *melo_sink_stream_get_gst_bin (MeloSinkStream *stream);
+void melo_sink_stream_close (MeloSinkStream *stream);
+
+/* Listeners */
+MeloSinkListener *melo_sink_stream_add_listener (MeloSinkStream *stream,
+                                                 MeloSinkListenerFunc func,
+                                                 gpointer user_data);
+void melo_sink_stream_remove_listener (MeloSinkListener *listener);
+GBytes *melo_sink_listener_pop (MeloSinkListener *listener, gboolean *closed);
+
+G_END_DECLS
+
+#endif /* __MELO_SINK_STREAM_H__ */
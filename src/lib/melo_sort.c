@@ -130,6 +130,9 @@ melo_sort_cmp_none (gconstpointer a, gconstpointer b)
  *
  * Generate a random number used to shuffle the media list.
  *
+ * This function is not a consistent compare function, so the resulting order
+ * is biased: melo_sort_list_shuffle() should be used instead.
+ *
  * Returns: a random integer between -10 and 10.
  */
 gint
@@ -137,3 +140,63 @@ melo_sort_cmp_shuffle (gconstpointer a, gconstpointer b)
 {
   return g_random_int_range (-10, 10);
 }
+
+/**
+ * melo_sort_shuffle:
+ * @array: an array of pointers
+ * @len: the number of elements in @array
+ *
+ * Shuffle an array of pointers in place with the Fisher-Yates algorithm: all
+ * the permutations are equally likely and it is done in linear time.
+ */
+void
+melo_sort_shuffle (gpointer *array, guint len)
+{
+  gpointer tmp;
+  guint i, j;
+
+  for (i = len; i > 1; i--) {
+    j = g_random_int_range (0, i);
+    tmp = array[i - 1];
+    array[i - 1] = array[j];
+    array[j] = tmp;
+  }
+}
+
+/**
+ * melo_sort_list_shuffle:
+ * @list: a #GList to shuffle
+ *
+ * Shuffle the elements of a #GList in linear time with melo_sort_shuffle(). No
+ * element is allocated: the links of @list are only reordered.
+ *
+ * Returns: (transfer none): the new start of the #GList.
+ */
+GList *
+melo_sort_list_shuffle (GList *list)
+{
+  GList **links;
+  GList *l;
+  guint len, i;
+
+  /* Nothing to shuffle */
+  len = g_list_length (list);
+  if (len < 2)
+    return list;
+
+  /* Shuffle links of list */
+  links = g_new (GList *, len);
+  for (i = 0, l = list; l; l = l->next)
+    links[i++] = l;
+  melo_sort_shuffle ((gpointer *) links, len);
+
+  /* Relink list */
+  for (i = 0; i < len; i++) {
+    links[i]->prev = i ? links[i - 1] : NULL;
+    links[i]->next = i < len - 1 ? links[i + 1] : NULL;
+  }
+  list = links[0];
+  g_free (links);
+
+  return list;
+}
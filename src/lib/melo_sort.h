@@ -180,6 +180,9 @@ MeloSort melo_sort_from_string (const gchar *name);
 gint melo_sort_cmp_none (gconstpointer a, gconstpointer b);
 gint melo_sort_cmp_shuffle (gconstpointer a, gconstpointer b);
 
+void melo_sort_shuffle (gpointer *array, guint len);
+GList *melo_sort_list_shuffle (GList *list);
+
 /**
  * melo_sort_cmp_file:
  * @a: a string containing file name
@@ -236,7 +239,7 @@ gint melo_sort_cmp_shuffle (gconstpointer a, gconstpointer b);
  * Returns: an integer less than, equal to, or greater than zero, if @a is <, ==
  * or > than @b.
  */
-#define melo_sort_cmp_artist(a,b) (g_strcmp0 (a, b))
+#define melo_sort_cmp_artist(a,b) ((a) == (b) ? 0 : g_strcmp0 (a, b))
 /**
  * melo_sort_cmp_artist_desc:
  * @a: a string containing artist name
@@ -247,7 +250,7 @@ gint melo_sort_cmp_shuffle (gconstpointer a, gconstpointer b);
  * Returns: an integer less than, equal to, or greater than zero, if @a is <, ==
  * or > than @b.
  */
-#define melo_sort_cmp_artist_desc(a,b) (-g_strcmp0 (a, b))
+#define melo_sort_cmp_artist_desc(a,b) ((a) == (b) ? 0 : -g_strcmp0 (a, b))
 
 /**
  * melo_sort_cmp_album:
@@ -259,7 +262,7 @@ gint melo_sort_cmp_shuffle (gconstpointer a, gconstpointer b);
  * Returns: an integer less than, equal to, or greater than zero, if @a is <, ==
  * or > than @b.
  */
-#define melo_sort_cmp_album(a,b) (g_strcmp0 (a, b))
+#define melo_sort_cmp_album(a,b) ((a) == (b) ? 0 : g_strcmp0 (a, b))
 /**
  * melo_sort_cmp_album_desc:
  * @a: a string containing album name
@@ -270,7 +273,7 @@ gint melo_sort_cmp_shuffle (gconstpointer a, gconstpointer b);
  * Returns: an integer less than, equal to, or greater than zero, if @a is <, ==
  * or > than @b.
  */
-#define melo_sort_cmp_album_desc(a,b) (-g_strcmp0 (a, b))
+#define melo_sort_cmp_album_desc(a,b) ((a) == (b) ? 0 : -g_strcmp0 (a, b))
 
 /**
  * melo_sort_cmp_genre:
@@ -282,7 +285,7 @@ gint melo_sort_cmp_shuffle (gconstpointer a, gconstpointer b);
  * Returns: an integer less than, equal to, or greater than zero, if @a is <, ==
  * or > than @b.
  */
-#define melo_sort_cmp_genre(a,b) (g_strcmp0 (a, b))
+#define melo_sort_cmp_genre(a,b) ((a) == (b) ? 0 : g_strcmp0 (a, b))
 /**
  * melo_sort_cmp_genre_desc:
  * @a: a string containing genre name
@@ -293,7 +296,7 @@ gint melo_sort_cmp_shuffle (gconstpointer a, gconstpointer b);
  * Returns: an integer less than, equal to, or greater than zero, if @a is <, ==
  * or > than @b.
  */
-#define melo_sort_cmp_genre_desc(a,b) (-g_strcmp0 (a, b))
+#define melo_sort_cmp_genre_desc(a,b) ((a) == (b) ? 0 : -g_strcmp0 (a, b))
 
 /**
  * melo_sort_cmp_date:
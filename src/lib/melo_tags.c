@@ -21,6 +21,7 @@
 
 #include <string.h>
 
+#include <glib/gstdio.h>
 #include <libsoup/soup.h>
 
 #include <gst/tag/tag.h>
@@ -52,22 +53,101 @@
  *    stored on disk and will be available at next startup of the application.
  *
  * A cover can then be retrieved from a #MeloTags with melo_tags_get_cover() or
- * with its unique ID with melo_tags_get_cover_by_id().
+ * with its unique ID with melo_tags_get_cover_by_id(). A cover set by URL is
+ * downloaded on first access: melo_tags_get_cover_by_id_async() can be used to
+ * not block the calling thread during the download.
+ *
+ * The cover data kept in memory are limited by a size budget, which can be
+ * changed with melo_tags_set_cover_cache_size(): when the budget is exceeded,
+ * the least recently used covers are moved to a temporary file on disk, and
+ * they are read back on next access. The statistics of this cache are
+ * available with melo_tags_get_cover_cache_stats().
+ *
+ * The covers saved on disk are written by a background thread and they are
+ * spread in sub-directories named from the first characters of their ID. The
+ * list of covers available on disk is loaded once, on first access.
+ *
+ * The title, artist, album and genre of a #MeloTags are shared between all
+ * the #MeloTags with the same values: they are stored in an internal pool with
+ * melo_tags_intern_string() and released with melo_tags_release_string(), so
+ * two equal values have the same pointer.
+ *
+ * A #MeloTags is shared by reference between the player status, the playlist
+ * items, the browser items and the events: it must be considered as read-only
+ * as soon as it has been handed to another component. Before modifying a
+ * #MeloTags which can be shared, melo_tags_make_writable() must be called: it
+ * returns the same #MeloTags if the caller holds the only reference, or a
+ * private copy otherwise. melo_tags_merge_ref() can be used to complete a
+ * #MeloTags from reference tags without copying anything when the values are
+ * the same.
  *
  * Many convert functions are also provided to fill a #MeloTags from a
  * #GstTagList with melo_tags_new_from_gst_tag_list() or to fill a #JsonObject
  * from a #MeloTags with melo_tags_add_to_json_object().
  */
 
+/* Maximum number of concurrent cover downloads */
+#define MELO_TAGS_COVER_FETCH_MAX 4
+
+/* Default size of cover data kept in memory */
+#define MELO_TAGS_COVER_CACHE_SIZE (8 * 1024 * 1024)
+
+/* Length of cover IDs: covers saved with MD5 IDs are still supported */
+#define MELO_TAGS_COVER_ID_LEN 16
+#define MELO_TAGS_COVER_LEGACY_ID_LEN 32
+
+/* Maximum number of JSON objects cached by MeloTags */
+#define MELO_TAGS_JSON_CACHE_MAX 4
+
+/* Cached JSON objects of MeloTags */
+G_LOCK_DEFINE_STATIC (melo_tags_json_mutex);
+
+typedef struct _MeloTagsJSON {
+  MeloTagsFields fields;
+  gint64 timestamp;
+  JsonObject *obj;
+} MeloTagsJSON;
+
+/* Interned strings pool: value is the reference count */
+G_LOCK_DEFINE_STATIC (melo_tags_strings_mutex);
+static GHashTable *melo_tags_strings = NULL;
+
+/* Number of live tags */
+static gint melo_tags_count;
+
 /* Internal cover cache */
+static GRecMutex melo_tags_cover_mutex;
 static GHashTable *melo_tags_cover_hash = NULL;
 static GHashTable *melo_tags_cover_url_hash = NULL;
 static SoupSession *melo_tags_cover_session = NULL;
 static gchar *melo_tags_cover_path = NULL;
 
+/* Least recently used covers in memory (most recent first) */
+static GQueue melo_tags_cover_lru = G_QUEUE_INIT;
+static gsize melo_tags_cover_lru_size = MELO_TAGS_COVER_CACHE_SIZE;
+static gsize melo_tags_cover_lru_bytes;
+static guint64 melo_tags_cover_lru_hits;
+static guint64 melo_tags_cover_lru_misses;
+static guint64 melo_tags_cover_lru_evictions;
+
+/* Disk cover store: IDs of covers on disk and pending writes by path */
+static GHashTable *melo_tags_cover_index = NULL;
+static GHashTable *melo_tags_cover_writes = NULL;
+static GThreadPool *melo_tags_cover_writer = NULL;
+
+/* Asynchronous cover downloads */
+static SoupSession *melo_tags_cover_async_session = NULL;
+static GQueue melo_tags_cover_fetch_queue = G_QUEUE_INIT;
+static guint melo_tags_cover_fetch_count;
+
 typedef struct _MeloTagsCover {
+  gchar *id;
   GBytes *data;
   gint ref_count;
+  /* LRU cache */
+  GList link;
+  gsize size;
+  gboolean spilled;
 } MeloTagsCover;
 
 typedef struct _MeloTagsCoverURL {
@@ -76,10 +156,100 @@ typedef struct _MeloTagsCoverURL {
   guint64 timestamp;
   MeloTagsCoverPersist persist;
   gint ref_count;
+  /* Pending download */
+  gboolean fetching;
+  GList *waiters;
 } MeloTagsCoverURL;
 
+typedef struct _MeloTagsCoverWaiter {
+  MeloTagsCoverCallback callback;
+  gpointer user_data;
+} MeloTagsCoverWaiter;
+
 static gchar *melo_tags_cover_ref (const gchar *id);
 
+/**
+ * melo_tags_intern_string:
+ * @str: (nullable): the string to intern
+ *
+ * Get a shared copy of @str from the internal pool of strings, to set the
+ * title, the artist, the album or the genre of a #MeloTags. All equal strings
+ * interned share the same pointer, so they can be compared by pointer instead
+ * of content.
+ *
+ * Returns: (transfer full): the interned string or %NULL if @str is %NULL. It
+ * must be released with melo_tags_release_string() (done by melo_tags_unref()
+ * for the fields of a #MeloTags).
+ */
+gchar *
+melo_tags_intern_string (const gchar *str)
+{
+  gpointer key, value;
+  gchar *istr;
+
+  if (!str)
+    return NULL;
+
+  G_LOCK (melo_tags_strings_mutex);
+
+  /* Create pool */
+  if (!melo_tags_strings)
+    melo_tags_strings = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                               NULL);
+
+  /* Find string in pool or add it */
+  if (g_hash_table_lookup_extended (melo_tags_strings, str, &key, &value)) {
+    istr = key;
+    g_hash_table_insert (melo_tags_strings, istr,
+                         GUINT_TO_POINTER (GPOINTER_TO_UINT (value) + 1));
+  } else {
+    istr = g_strdup (str);
+    g_hash_table_insert (melo_tags_strings, istr, GUINT_TO_POINTER (1));
+  }
+
+  G_UNLOCK (melo_tags_strings_mutex);
+
+  return istr;
+}
+
+/**
+ * melo_tags_release_string:
+ * @str: (nullable): the string to release
+ *
+ * Release a string returned by melo_tags_intern_string(). If @str is not an
+ * interned string (a private copy set directly in a #MeloTags), it is freed
+ * with g_free().
+ */
+void
+melo_tags_release_string (gchar *str)
+{
+  gpointer key, value;
+  guint count;
+
+  if (!str)
+    return;
+
+  G_LOCK (melo_tags_strings_mutex);
+
+  /* Not an interned string */
+  if (!melo_tags_strings ||
+      !g_hash_table_lookup_extended (melo_tags_strings, str, &key, &value) ||
+      key != str) {
+    G_UNLOCK (melo_tags_strings_mutex);
+    g_free (str);
+    return;
+  }
+
+  /* Release string */
+  count = GPOINTER_TO_UINT (value) - 1;
+  if (count)
+    g_hash_table_insert (melo_tags_strings, key, GUINT_TO_POINTER (count));
+  else
+    g_hash_table_remove (melo_tags_strings, key);
+
+  G_UNLOCK (melo_tags_strings_mutex);
+}
+
 /**
  * melo_tags_new:
  *
@@ -100,6 +270,7 @@ melo_tags_new (void)
 
   /* Set reference counter to 1 */
   tags->ref_count = 1;
+  g_atomic_int_inc (&melo_tags_count);
 
   /* Set initial timestamp */
   melo_tags_update (tags);
@@ -107,6 +278,13 @@ melo_tags_new (void)
   return tags;
 }
 
+static void
+melo_tags_json_free (MeloTagsJSON *json)
+{
+  json_object_unref (json->obj);
+  g_slice_free (MeloTagsJSON, json);
+}
+
 /**
  * melo_tags_update:
  * @tags: the tags
@@ -117,7 +295,15 @@ melo_tags_new (void)
 void
 melo_tags_update (MeloTags *tags)
 {
+  GSList *json;
+
+  /* Invalidate cached JSON objects */
+  G_LOCK (melo_tags_json_mutex);
   tags->timestamp = g_get_monotonic_time ();
+  json = tags->json;
+  tags->json = NULL;
+  G_UNLOCK (melo_tags_json_mutex);
+  g_slist_free_full (json, (GDestroyNotify) melo_tags_json_free);
 }
 
 /**
@@ -142,8 +328,9 @@ melo_tags_updated (MeloTags *tags, gint64 timestamp)
  * melo_tags_copy:
  * @tags: the tags
  *
- * Do a deep copy of the #MeloTags provided by @tags.It will be completely
- * independent from the original.
+ * Copy the #MeloTags provided by @tags. The new #MeloTags can be modified
+ * independently from the original, while the strings and the cover are shared
+ * with the original through the internal pools.
  *
  * Returns: (transfer full): a new #MeloTags with the same data than @tags.
  * After use, call melo_tags_unref().
@@ -159,10 +346,10 @@ melo_tags_copy (MeloTags *tags)
     return NULL;
 
   /* Copy values */
-  ntags->title = g_strdup (tags->title);
-  ntags->artist = g_strdup (tags->artist);
-  ntags->album = g_strdup (tags->album);
-  ntags->genre = g_strdup (tags->genre);
+  ntags->title = melo_tags_intern_string (tags->title);
+  ntags->artist = melo_tags_intern_string (tags->artist);
+  ntags->album = melo_tags_intern_string (tags->album);
+  ntags->genre = melo_tags_intern_string (tags->genre);
   ntags->date = tags->date;
   ntags->track = tags->track;
   ntags->tracks = tags->tracks;
@@ -183,13 +370,13 @@ melo_tags_merge (MeloTags *tags, MeloTags *ref_tags)
 {
   /* Copy values */
   if (!tags->title)
-    tags->title = g_strdup (ref_tags->title);
+    tags->title = melo_tags_intern_string (ref_tags->title);
   if (!tags->artist)
-    tags->artist = g_strdup (ref_tags->artist);
+    tags->artist = melo_tags_intern_string (ref_tags->artist);
   if (!tags->album)
-    tags->album = g_strdup (ref_tags->album);
+    tags->album = melo_tags_intern_string (ref_tags->album);
   if (!tags->genre)
-    tags->genre = g_strdup (ref_tags->genre);
+    tags->genre = melo_tags_intern_string (ref_tags->genre);
   if (!tags->date)
     tags->date = ref_tags->date;
   if (!tags->track)
@@ -203,6 +390,88 @@ melo_tags_merge (MeloTags *tags, MeloTags *ref_tags)
   melo_tags_update (tags);
 }
 
+/**
+ * melo_tags_merge_ref:
+ * @tags: (transfer full): the tags
+ * @ref_tags: the reference tags
+ *
+ * Same as melo_tags_merge() but the reference of @tags is taken: if all data
+ * set in @tags are the same than in @ref_tags, @tags is released and a new
+ * reference of @ref_tags is returned, so no copy is done. Otherwise, @tags is
+ * made writable with melo_tags_make_writable() and it is merged.
+ *
+ * Returns: (transfer full): the merged #MeloTags. After use, call
+ * melo_tags_unref().
+ */
+MeloTags *
+melo_tags_merge_ref (MeloTags *tags, MeloTags *ref_tags)
+{
+  if (!ref_tags)
+    return tags;
+  if (!tags)
+    return melo_tags_ref (ref_tags);
+
+  /* All set values are the same: share reference tags */
+  if ((!tags->title || !g_strcmp0 (tags->title, ref_tags->title)) &&
+      (!tags->artist || !g_strcmp0 (tags->artist, ref_tags->artist)) &&
+      (!tags->album || !g_strcmp0 (tags->album, ref_tags->album)) &&
+      (!tags->genre || !g_strcmp0 (tags->genre, ref_tags->genre)) &&
+      (!tags->date || tags->date == ref_tags->date) &&
+      (!tags->track || tags->track == ref_tags->track) &&
+      (!tags->tracks || tags->tracks == ref_tags->tracks) &&
+      (!tags->cover || !g_strcmp0 (tags->cover, ref_tags->cover))) {
+    melo_tags_unref (tags);
+    return melo_tags_ref (ref_tags);
+  }
+
+  /* Merge in a private copy */
+  tags = melo_tags_make_writable (tags);
+  melo_tags_merge (tags, ref_tags);
+
+  return tags;
+}
+
+/**
+ * melo_tags_is_writable:
+ * @tags: the tags
+ *
+ * Check if @tags can be modified: it is the case only when the caller holds
+ * the only reference of @tags.
+ *
+ * Returns: %TRUE if @tags is not shared, %FALSE otherwise.
+ */
+gboolean
+melo_tags_is_writable (MeloTags *tags)
+{
+  return g_atomic_int_get (&tags->ref_count) == 1;
+}
+
+/**
+ * melo_tags_make_writable:
+ * @tags: (transfer full): the tags
+ *
+ * Get a #MeloTags which can be modified. If @tags is not shared, it is
+ * returned as is, otherwise a copy is done with melo_tags_copy() and the
+ * reference on @tags is released.
+ *
+ * Returns: (transfer full): a writable #MeloTags. After use, call
+ * melo_tags_unref().
+ */
+MeloTags *
+melo_tags_make_writable (MeloTags *tags)
+{
+  MeloTags *ntags;
+
+  if (!tags || melo_tags_is_writable (tags))
+    return tags;
+
+  /* Copy shared tags */
+  ntags = melo_tags_copy (tags);
+  melo_tags_unref (tags);
+
+  return ntags;
+}
+
 /**
  * melo_tags_ref:
  * @tags: the tags
@@ -219,16 +488,395 @@ melo_tags_ref (MeloTags *tags)
   return tags;
 }
 
+/* XXH64 hash: much faster than MD5 on image data */
+#define MELO_TAGS_XXH_PRIME64_1 G_GUINT64_CONSTANT (0x9E3779B185EBCA87)
+#define MELO_TAGS_XXH_PRIME64_2 G_GUINT64_CONSTANT (0xC2B2AE3D27D4EB4F)
+#define MELO_TAGS_XXH_PRIME64_3 G_GUINT64_CONSTANT (0x165667B19E3779F9)
+#define MELO_TAGS_XXH_PRIME64_4 G_GUINT64_CONSTANT (0x85EBCA77C2B2AE63)
+#define MELO_TAGS_XXH_PRIME64_5 G_GUINT64_CONSTANT (0x27D4EB2F165667C5)
+#define MELO_TAGS_XXH_ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static inline guint64
+melo_tags_xxh64_read64 (const guint8 *p)
+{
+  guint64 v;
+
+  memcpy (&v, p, sizeof (v));
+  return GUINT64_FROM_LE (v);
+}
+
+static inline guint32
+melo_tags_xxh64_read32 (const guint8 *p)
+{
+  guint32 v;
+
+  memcpy (&v, p, sizeof (v));
+  return GUINT32_FROM_LE (v);
+}
+
+static inline guint64
+melo_tags_xxh64_round (guint64 acc, guint64 input)
+{
+  acc += input * MELO_TAGS_XXH_PRIME64_2;
+  acc = MELO_TAGS_XXH_ROTL64 (acc, 31);
+  return acc * MELO_TAGS_XXH_PRIME64_1;
+}
+
+static inline guint64
+melo_tags_xxh64_merge (guint64 acc, guint64 val)
+{
+  acc ^= melo_tags_xxh64_round (0, val);
+  return acc * MELO_TAGS_XXH_PRIME64_1 + MELO_TAGS_XXH_PRIME64_4;
+}
+
+static guint64
+melo_tags_xxh64 (const guint8 *p, gsize len)
+{
+  const guint8 *end = p + len;
+  guint64 h;
+
+  if (len >= 32) {
+    const guint8 *limit = end - 32;
+    guint64 v1 = MELO_TAGS_XXH_PRIME64_1 + MELO_TAGS_XXH_PRIME64_2;
+    guint64 v2 = MELO_TAGS_XXH_PRIME64_2;
+    guint64 v3 = 0;
+    guint64 v4 = -MELO_TAGS_XXH_PRIME64_1;
+
+    /* Process stripes of 32 bytes */
+    do {
+      v1 = melo_tags_xxh64_round (v1, melo_tags_xxh64_read64 (p));
+      v2 = melo_tags_xxh64_round (v2, melo_tags_xxh64_read64 (p + 8));
+      v3 = melo_tags_xxh64_round (v3, melo_tags_xxh64_read64 (p + 16));
+      v4 = melo_tags_xxh64_round (v4, melo_tags_xxh64_read64 (p + 24));
+      p += 32;
+    } while (p <= limit);
+
+    h = MELO_TAGS_XXH_ROTL64 (v1, 1) + MELO_TAGS_XXH_ROTL64 (v2, 7) +
+        MELO_TAGS_XXH_ROTL64 (v3, 12) + MELO_TAGS_XXH_ROTL64 (v4, 18);
+    h = melo_tags_xxh64_merge (h, v1);
+    h = melo_tags_xxh64_merge (h, v2);
+    h = melo_tags_xxh64_merge (h, v3);
+    h = melo_tags_xxh64_merge (h, v4);
+  } else
+    h = MELO_TAGS_XXH_PRIME64_5;
+  h += len;
+
+  /* Process remaining bytes */
+  for (; p + 8 <= end; p += 8) {
+    h ^= melo_tags_xxh64_round (0, melo_tags_xxh64_read64 (p));
+    h = MELO_TAGS_XXH_ROTL64 (h, 27) * MELO_TAGS_XXH_PRIME64_1 +
+        MELO_TAGS_XXH_PRIME64_4;
+  }
+  if (p + 4 <= end) {
+    h ^= (guint64) melo_tags_xxh64_read32 (p) * MELO_TAGS_XXH_PRIME64_1;
+    h = MELO_TAGS_XXH_ROTL64 (h, 23) * MELO_TAGS_XXH_PRIME64_2 +
+        MELO_TAGS_XXH_PRIME64_3;
+    p += 4;
+  }
+  for (; p < end; p++) {
+    h ^= *p * MELO_TAGS_XXH_PRIME64_5;
+    h = MELO_TAGS_XXH_ROTL64 (h, 11) * MELO_TAGS_XXH_PRIME64_1;
+  }
+
+  /* Final avalanche */
+  h ^= h >> 33;
+  h *= MELO_TAGS_XXH_PRIME64_2;
+  h ^= h >> 29;
+  h *= MELO_TAGS_XXH_PRIME64_3;
+  h ^= h >> 32;
+
+  return h;
+}
+
+static gchar *
+melo_tags_cover_gen_id (gconstpointer data, gsize size)
+{
+  return g_strdup_printf ("%016" G_GINT64_MODIFIER "x",
+                          melo_tags_xxh64 (data, size));
+}
+
+static const gchar *
+melo_tags_cover_get_dir (void)
+{
+  g_rec_mutex_lock (&melo_tags_cover_mutex);
+  if (!melo_tags_cover_path) {
+    melo_tags_cover_path = g_strdup_printf ("%s/melo/cover",
+                                            g_get_user_data_dir ());
+    g_mkdir_with_parents (melo_tags_cover_path, 0700);
+  }
+  g_rec_mutex_unlock (&melo_tags_cover_mutex);
+
+  return melo_tags_cover_path;
+}
+
+static gchar *
+melo_tags_cover_gen_file_path (const gchar *id)
+{
+  const gchar *dir = melo_tags_cover_get_dir ();
+
+  /* Covers saved with MD5 IDs are in the main directory */
+  if (strlen (id) == MELO_TAGS_COVER_LEGACY_ID_LEN)
+    return g_strdup_printf ("%s/%s", dir, id);
+
+  return g_strdup_printf ("%s/%.2s/%s", dir, id, id);
+}
+
+static gboolean
+melo_tags_cover_is_id (const gchar *name, gsize len)
+{
+  gsize i;
+
+  for (i = 0; i < len; i++)
+    if (!g_ascii_isxdigit (name[i]))
+      return FALSE;
+  return name[i] == '\0';
+}
+
+static void
+melo_tags_cover_index_add_dir (const gchar *path, const gchar *prefix)
+{
+  const gchar *name;
+  GDir *dir;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (!dir)
+    return;
+
+  while ((name = g_dir_read_name (dir)) != NULL) {
+    /* Cover in a sub-directory */
+    if (prefix) {
+      if (melo_tags_cover_is_id (name, MELO_TAGS_COVER_ID_LEN) &&
+          !strncmp (name, prefix, 2))
+        g_hash_table_add (melo_tags_cover_index, g_strdup (name));
+      continue;
+    }
+
+    /* Cover saved with an MD5 ID */
+    if (melo_tags_cover_is_id (name, MELO_TAGS_COVER_LEGACY_ID_LEN))
+      g_hash_table_add (melo_tags_cover_index, g_strdup (name));
+    else if (melo_tags_cover_is_id (name, 2)) {
+      gchar *sub;
+
+      /* Sub-directory of covers */
+      sub = g_build_filename (path, name, NULL);
+      melo_tags_cover_index_add_dir (sub, name);
+      g_free (sub);
+    }
+  }
+  g_dir_close (dir);
+}
+
+/* Must be called with cover mutex locked */
+static gboolean
+melo_tags_cover_index_contains (const gchar *id)
+{
+  /* Load index from disk */
+  if (!melo_tags_cover_index) {
+    melo_tags_cover_index = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                   g_free, NULL);
+    melo_tags_cover_index_add_dir (melo_tags_cover_get_dir (), NULL);
+  }
+
+  return g_hash_table_contains (melo_tags_cover_index, id);
+}
+
+static void
+melo_tags_cover_writer_func (gpointer data, gpointer user_data)
+{
+  gchar *path = data;
+  GBytes *bytes = NULL;
+  gchar *dir;
+
+  /* Get data to write */
+  g_rec_mutex_lock (&melo_tags_cover_mutex);
+  if (melo_tags_cover_writes)
+    bytes = g_hash_table_lookup (melo_tags_cover_writes, path);
+  if (bytes)
+    g_bytes_ref (bytes);
+  g_rec_mutex_unlock (&melo_tags_cover_mutex);
+
+  /* Write has been cancelled */
+  if (!bytes)
+    goto end;
+
+  /* Save data to disk */
+  dir = g_path_get_dirname (path);
+  g_mkdir_with_parents (dir, 0700);
+  g_free (dir);
+  if (!g_file_set_contents (path, g_bytes_get_data (bytes, NULL),
+                            g_bytes_get_size (bytes), NULL)) {
+    /* Keep data in memory */
+    g_warning ("failed to save cover to %s", path);
+    g_bytes_unref (bytes);
+    goto end;
+  }
+
+  /* Data is now available on disk */
+  g_rec_mutex_lock (&melo_tags_cover_mutex);
+  data = melo_tags_cover_writes ?
+                    g_hash_table_lookup (melo_tags_cover_writes, path) : NULL;
+  if (data == bytes)
+    g_hash_table_remove (melo_tags_cover_writes, path);
+  else if (!data)
+    g_unlink (path);
+  g_rec_mutex_unlock (&melo_tags_cover_mutex);
+  g_bytes_unref (bytes);
+
+end:
+  g_free (path);
+}
+
+/* Must be called with cover mutex locked */
+static void
+melo_tags_cover_write (const gchar *path, GBytes *data)
+{
+  /* Create writer */
+  if (!melo_tags_cover_writes)
+    melo_tags_cover_writes = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                    g_free,
+                                               (GDestroyNotify) g_bytes_unref);
+  if (!melo_tags_cover_writer)
+    melo_tags_cover_writer = g_thread_pool_new (melo_tags_cover_writer_func,
+                                                NULL, 1, FALSE, NULL);
+
+  /* Data is kept in memory until written */
+  g_hash_table_replace (melo_tags_cover_writes, g_strdup (path),
+                        g_bytes_ref (data));
+  g_thread_pool_push (melo_tags_cover_writer, g_strdup (path), NULL);
+}
+
+static GBytes *
+melo_tags_cover_read (const gchar *path)
+{
+  GMappedFile *file;
+  GBytes *data = NULL;
+
+  /* Data is not written yet */
+  g_rec_mutex_lock (&melo_tags_cover_mutex);
+  if (melo_tags_cover_writes)
+    data = g_hash_table_lookup (melo_tags_cover_writes, path);
+  if (data)
+    g_bytes_ref (data);
+  g_rec_mutex_unlock (&melo_tags_cover_mutex);
+  if (data)
+    return data;
+
+  /* Map file */
+  file = g_mapped_file_new (path, FALSE, NULL);
+  if (file) {
+    /* Generate GBytes */
+    data = g_mapped_file_get_bytes (file);
+    g_mapped_file_unref (file);
+  }
+
+  return data;
+}
+
+static void
+melo_tags_cover_remove_file (const gchar *path)
+{
+  /* Cancel pending write */
+  g_rec_mutex_lock (&melo_tags_cover_mutex);
+  if (melo_tags_cover_writes)
+    g_hash_table_remove (melo_tags_cover_writes, path);
+  g_rec_mutex_unlock (&melo_tags_cover_mutex);
+
+  g_unlink (path);
+}
+
+static gchar *
+melo_tags_cover_gen_spill_path (const gchar *id)
+{
+  static gboolean cleaned;
+  gchar *dir, *path;
+
+  /* Generate directory of evicted covers */
+  dir = g_strdup_printf ("%s/spill", melo_tags_cover_get_dir ());
+  if (!cleaned) {
+    const gchar *name;
+    GDir *d;
+
+    /* Remove files left by previous execution */
+    g_mkdir_with_parents (dir, 0700);
+    d = g_dir_open (dir, 0, NULL);
+    if (d) {
+      while ((name = g_dir_read_name (d)) != NULL) {
+        path = g_build_filename (dir, name, NULL);
+        g_unlink (path);
+        g_free (path);
+      }
+      g_dir_close (d);
+    }
+    cleaned = TRUE;
+  }
+
+  /* Generate file path */
+  path = g_strdup_printf ("%s/%s", dir, id);
+  g_free (dir);
+
+  return path;
+}
+
+static void
+melo_tags_cover_lru_evict (void)
+{
+  GList *l, *prev;
+
+  /* Budget not exceeded */
+  if (melo_tags_cover_lru_bytes <= melo_tags_cover_lru_size)
+    return;
+
+  /* Evict least recently used covers */
+  for (l = melo_tags_cover_lru.tail; l != NULL &&
+       melo_tags_cover_lru_bytes > melo_tags_cover_lru_size; l = prev) {
+    MeloTagsCover *cover = l->data;
+
+    prev = l->prev;
+
+    /* Save cover data on disk */
+    if (!cover->spilled) {
+      gchar *path;
+
+      path = melo_tags_cover_gen_spill_path (cover->id);
+      melo_tags_cover_write (path, cover->data);
+      cover->spilled = TRUE;
+      g_free (path);
+    }
+
+    /* Remove data from memory */
+    g_queue_unlink (&melo_tags_cover_lru, &cover->link);
+    melo_tags_cover_lru_bytes -= cover->size;
+    g_bytes_unref (cover->data);
+    cover->data = NULL;
+    melo_tags_cover_lru_evictions++;
+  }
+}
+
+static void
+melo_tags_cover_lru_add (MeloTagsCover *cover, GBytes *data)
+{
+  /* Keep data in memory */
+  cover->data = g_bytes_ref (data);
+  cover->size = g_bytes_get_size (data);
+  g_queue_push_head_link (&melo_tags_cover_lru, &cover->link);
+  melo_tags_cover_lru_bytes += cover->size;
+
+  /* Respect budget */
+  melo_tags_cover_lru_evict ();
+}
+
 static MeloTagsCover *
-melo_tags_cover_new (GBytes *data)
+melo_tags_cover_new (const gchar *id, GBytes *data)
 {
   MeloTagsCover *cover;
 
   /* Create new cover */
   cover = g_slice_new0 (MeloTagsCover);
   if (cover) {
-    cover->data = g_bytes_ref (data);
+    cover->id = g_strdup (id);
+    cover->link.data = cover;
     cover->ref_count = 1;
+    melo_tags_cover_lru_add (cover, data);
   }
 
    return cover;
@@ -237,7 +885,23 @@ melo_tags_cover_new (GBytes *data)
 static void
 melo_tags_cover_free (MeloTagsCover *cover)
 {
-  g_bytes_unref (cover->data);
+  /* Remove from memory */
+  if (cover->data) {
+    g_queue_unlink (&melo_tags_cover_lru, &cover->link);
+    melo_tags_cover_lru_bytes -= cover->size;
+    g_bytes_unref (cover->data);
+  }
+
+  /* Remove from disk */
+  if (cover->spilled) {
+    gchar *path;
+
+    path = melo_tags_cover_gen_spill_path (cover->id);
+    melo_tags_cover_remove_file (path);
+    g_free (path);
+  }
+
+  g_free (cover->id);
   g_slice_free (MeloTagsCover, cover);
 }
 
@@ -258,57 +922,55 @@ melo_tags_cover_url_new (const gchar *url, MeloTagsCoverPersist persist)
    return cover_url;
 }
 
+static void
+melo_tags_cover_waiter_free (MeloTagsCoverWaiter *waiter)
+{
+  g_slice_free (MeloTagsCoverWaiter, waiter);
+}
+
 static void
 melo_tags_cover_url_free (MeloTagsCoverURL *cover_url)
 {
+  /* Pending requests are dropped */
+  g_list_free_full (cover_url->waiters,
+                    (GDestroyNotify) melo_tags_cover_waiter_free);
   g_free (cover_url->id);
   g_free (cover_url->url);
   g_slice_free (MeloTagsCoverURL, cover_url);
 }
 
-static gchar *
-melo_tags_cover_gen_file_path (const gchar *id)
-{
-  if (!melo_tags_cover_path) {
-    melo_tags_cover_path = g_strdup_printf ("%s/melo/cover",
-                                            g_get_user_data_dir ());
-    g_mkdir_with_parents (melo_tags_cover_path, 0700);
-  }
-
-  return g_strdup_printf ("%s/%s", melo_tags_cover_path, id);
-}
-
 static gchar *
 melo_tags_cover_add_data (GBytes *data, MeloTagsCoverPersist persist)
 {
   MeloTagsCover *cover;
   gchar *file, *id;
 
-  /* Generate cover ID from md5 sum */
-  id = g_compute_checksum_for_bytes (G_CHECKSUM_MD5, data);
-
-  /* Generate file name on disk */
-  file = melo_tags_cover_gen_file_path (id);
+  /* Generate cover ID from hash */
+  id = melo_tags_cover_gen_id (g_bytes_get_data (data, NULL),
+                               g_bytes_get_size (data));
 
   /* Generate hash table if doesn't exist */
+  g_rec_mutex_lock (&melo_tags_cover_mutex);
   if (!melo_tags_cover_hash)
     melo_tags_cover_hash = g_hash_table_new_full (g_str_hash, g_str_equal,
                                          g_free,
                                          (GDestroyNotify) melo_tags_cover_free);
 
   /* Check disk persistence */
-  if (g_file_test (file, G_FILE_TEST_EXISTS)) {
+  if (melo_tags_cover_index_contains (id)) {
     /* Already on disk */
-    g_free (file);
+    g_rec_mutex_unlock (&melo_tags_cover_mutex);
     return id;
   } else if (persist == MELO_TAGS_COVER_PERSIST_DISK) {
-    /* Save image data to disk */
-    g_file_set_contents (file, g_bytes_get_data (data, NULL),
-                         g_bytes_get_size (data), NULL);
+    /* Save image data to disk in background */
+    file = melo_tags_cover_gen_file_path (id);
+    melo_tags_cover_write (file, data);
+    g_hash_table_add (melo_tags_cover_index, g_strdup (id));
     g_free (file);
 
     /* Remove any copy from hash table */
     g_hash_table_remove (melo_tags_cover_hash, id);
+    g_rec_mutex_unlock (&melo_tags_cover_mutex);
 
     return id;
   }
@@ -318,11 +980,15 @@ melo_tags_cover_add_data (GBytes *data, MeloTagsCoverPersist persist)
   if (cover) {
     /* Cover is already handled internally */
     g_atomic_int_inc (&cover->ref_count);
+
+    /* Move cover data back to memory */
+    if (!cover->data)
+      melo_tags_cover_lru_add (cover, data);
     goto end;
   }
 
   /* Create cover */
-  cover = melo_tags_cover_new (data);
+  cover = melo_tags_cover_new (id, data);
   if (!cover)
     goto failed;
 
@@ -334,10 +1000,12 @@ end:
   /* Force persistence until end of execution */
   if (persist == MELO_TAGS_COVER_PERSIST_EXIT)
     g_atomic_int_inc (&cover->ref_count);
+  g_rec_mutex_unlock (&melo_tags_cover_mutex);
 
   return id;
 
 failed:
+  g_rec_mutex_unlock (&melo_tags_cover_mutex);
   g_free (id);
   return NULL;
 }
@@ -348,11 +1016,12 @@ melo_tags_cover_add_url (const gchar *url, MeloTagsCoverPersist persist)
   MeloTagsCoverURL *cover_url;
   gchar *id, *url_id;
 
-  /* Generate cover ID from md5 sum */
-  id = g_compute_checksum_for_string (G_CHECKSUM_MD5, url, -1);
+  /* Generate cover ID from hash */
+  id = melo_tags_cover_gen_id (url, strlen (url));
   url_id = g_strdup_printf ("@%s", id);
 
   /* Generate URL hash table if doesn't exist */
+  g_rec_mutex_lock (&melo_tags_cover_mutex);
   if (!melo_tags_cover_url_hash)
     melo_tags_cover_url_hash = g_hash_table_new_full (g_str_hash, g_str_equal,
                                      g_free,
@@ -384,10 +1053,12 @@ end:
   /* Force persistence until end of execution */
   if (persist == MELO_TAGS_COVER_PERSIST_EXIT)
     g_atomic_int_inc (&cover_url->ref_count);
+  g_rec_mutex_unlock (&melo_tags_cover_mutex);
 
   return url_id;
 
 failed:
+  g_rec_mutex_unlock (&melo_tags_cover_mutex);
   g_free (id);
   g_free (url_id);
   return NULL;
@@ -463,7 +1134,7 @@ melo_tags_set_cover_by_url (MeloTags *tags, const gchar *url,
 }
 
 static gchar *
-melo_tags_cover_ref (const gchar *id)
+melo_tags_cover_ref_locked (const gchar *id)
 {
   MeloTagsCover *cover;
 
@@ -497,15 +1168,9 @@ melo_tags_cover_ref (const gchar *id)
   /* Find cover in hash table */
   cover = g_hash_table_lookup (melo_tags_cover_hash, id);
   if (!cover) {
-    gchar *file;
-
-    /* Generate file name on disk */
-    file = melo_tags_cover_gen_file_path (id);
-
-    /* Check file existence */
-    if (!g_file_test (file, G_FILE_TEST_EXISTS))
-      id = NULL;
-    g_free (file);
+    /* Check cover is on disk */
+    if (!melo_tags_cover_index_contains (id))
+      return NULL;
 
     return g_strdup (id);
   }
@@ -517,7 +1182,7 @@ melo_tags_cover_ref (const gchar *id)
 }
 
 static void
-melo_tags_cover_unref (const gchar *id)
+melo_tags_cover_unref_locked (const gchar *id)
 {
   MeloTagsCover *cover;
 
@@ -541,7 +1206,7 @@ melo_tags_cover_unref (const gchar *id)
     /* Unref the cover URL data */
     if (g_atomic_int_dec_and_test (&cover_url->ref_count)) {
       /* Unref the cover data */
-      melo_tags_cover_unref (cover_url->id);
+      melo_tags_cover_unref_locked (cover_url->id);
 
       /* Remove cover from hash table */
       g_hash_table_remove (melo_tags_cover_url_hash, id);
@@ -566,6 +1231,26 @@ melo_tags_cover_unref (const gchar *id)
   }
 }
 
+static gchar *
+melo_tags_cover_ref (const gchar *id)
+{
+  gchar *ref;
+
+  g_rec_mutex_lock (&melo_tags_cover_mutex);
+  ref = melo_tags_cover_ref_locked (id);
+  g_rec_mutex_unlock (&melo_tags_cover_mutex);
+
+  return ref;
+}
+
+static void
+melo_tags_cover_unref (const gchar *id)
+{
+  g_rec_mutex_lock (&melo_tags_cover_mutex);
+  melo_tags_cover_unref_locked (id);
+  g_rec_mutex_unlock (&melo_tags_cover_mutex);
+}
+
 /**
  * melo_tags_get_cover:
  * @tags: the tags
@@ -597,6 +1282,7 @@ GBytes *
 melo_tags_get_cover_by_id (const gchar *id)
 {
   MeloTagsCover *cover = NULL;
+  GBytes *data = NULL;
 
   /* No ID provided or no cover hash table */
   if (!id)
@@ -604,81 +1290,487 @@ melo_tags_get_cover_by_id (const gchar *id)
 
   /* Cover coming from an URL */
   if (*id == '@') {
-    MeloTagsCoverURL *cover_url;
-
-    /* No cover URL hash table */
-    if (!melo_tags_cover_url_hash)
-      return NULL;
+    MeloTagsCoverURL *cover_url = NULL;
+    MeloTagsCoverPersist persist;
+    SoupMessage *msg = NULL;
+    gchar *cover_id;
 
     /* Find in cover URL hash table */
-    cover_url = g_hash_table_lookup (melo_tags_cover_url_hash, ++id);
-    if (!cover_url)
+    g_rec_mutex_lock (&melo_tags_cover_mutex);
+    if (melo_tags_cover_url_hash)
+      cover_url = g_hash_table_lookup (melo_tags_cover_url_hash, id + 1);
+    if (!cover_url) {
+      g_rec_mutex_unlock (&melo_tags_cover_mutex);
       return NULL;
+    }
 
     /* Update access time */
     cover_url->timestamp = g_get_monotonic_time ();
 
-    /* Cover has not been downloaded yet */
-    if (!cover_url->id) {
-      SoupMessage *msg;
-      GBytes *data = NULL;
+    /* Cover has already been downloaded */
+    if (cover_url->id) {
+      cover_id = g_strdup (cover_url->id);
+      g_rec_mutex_unlock (&melo_tags_cover_mutex);
 
-      /* Create a new Soup session */
-      if (!melo_tags_cover_session)
-        melo_tags_cover_session = soup_session_new_with_options (
+      data = melo_tags_get_cover_by_id (cover_id);
+      g_free (cover_id);
+      return data;
+    }
+
+    /* Create a new Soup session */
+    if (!melo_tags_cover_session)
+      melo_tags_cover_session = soup_session_new_with_options (
                                                 SOUP_SESSION_USER_AGENT, "Melo",
                                                 NULL);
 
-      /* Prepare HTTP request */
-      msg = soup_message_new ("GET", cover_url->url);
-      if (msg) {
-        /* Download cover data */
-        if (soup_session_send_message (melo_tags_cover_session, msg) == 200)
-          g_object_get (msg, "response-body-data", &data, NULL);
-
-        /* Free message */
-        g_object_unref (msg);
-      }
+    /* Prepare HTTP request */
+    msg = soup_message_new ("GET", cover_url->url);
+    persist = cover_url->persist;
+    g_rec_mutex_unlock (&melo_tags_cover_mutex);
+    if (!msg)
+      return NULL;
 
-      /* Add data to internal cache */
-      if (data)
-        cover_url->id = melo_tags_cover_add_data (data, cover_url->persist);
+    /* Download cover data (without lock held) */
+    if (soup_session_send_message (melo_tags_cover_session, msg) == 200)
+      g_object_get (msg, "response-body-data", &data, NULL);
+    g_object_unref (msg);
+    if (!data)
+      return NULL;
 
-      return data;
+    /* Add data to internal cache */
+    cover_id = melo_tags_cover_add_data (data, persist);
+    g_rec_mutex_lock (&melo_tags_cover_mutex);
+    cover_url = NULL;
+    if (melo_tags_cover_url_hash)
+      cover_url = g_hash_table_lookup (melo_tags_cover_url_hash, id + 1);
+    if (cover_url && !cover_url->id) {
+      cover_url->id = cover_id;
+      cover_id = NULL;
     }
+    melo_tags_cover_unref_locked (cover_id);
+    g_rec_mutex_unlock (&melo_tags_cover_mutex);
+    g_free (cover_id);
 
-    return melo_tags_get_cover_by_id (cover_url->id);
+    return data;
   }
 
   /* Find in cover hash table */
+  g_rec_mutex_lock (&melo_tags_cover_mutex);
   if (melo_tags_cover_hash)
     cover = g_hash_table_lookup (melo_tags_cover_hash, id);
-  if (!cover) {
-    GBytes *data = NULL;
-    gchar *path;
-
-    /* Generate file name on disk */
-    path = melo_tags_cover_gen_file_path (id);
+  if (cover && cover->data) {
+    /* Move to head of LRU list */
+    g_queue_unlink (&melo_tags_cover_lru, &cover->link);
+    g_queue_push_head_link (&melo_tags_cover_lru, &cover->link);
+    data = g_bytes_ref (cover->data);
+    melo_tags_cover_lru_hits++;
+  } else
+    melo_tags_cover_lru_misses++;
+  g_rec_mutex_unlock (&melo_tags_cover_mutex);
+
+  if (!data) {
+    gboolean spilled = cover != NULL;
+    gchar *path = NULL;
+
+    /* Generate file name on disk (cover may have been evicted) */
+    g_rec_mutex_lock (&melo_tags_cover_mutex);
+    if (spilled)
+      path = melo_tags_cover_gen_spill_path (id);
+    else if (melo_tags_cover_index_contains (id))
+      path = melo_tags_cover_gen_file_path (id);
+    g_rec_mutex_unlock (&melo_tags_cover_mutex);
 
     /* Load image data from disk */
-    if (g_file_test (path, G_FILE_TEST_EXISTS)) {
-      GMappedFile *file;
-
-      /* Map file */
-      file = g_mapped_file_new (path, FALSE, NULL);
-      if (file) {
-        /* Generate GBytes */
-        data = g_mapped_file_get_bytes (file);
-        g_mapped_file_unref (file);
-      }
-    }
+    if (path)
+      data = melo_tags_cover_read (path);
     g_free (path);
 
+    /* Move evicted cover data back to memory */
+    if (data && spilled) {
+      g_rec_mutex_lock (&melo_tags_cover_mutex);
+      cover = NULL;
+      if (melo_tags_cover_hash)
+        cover = g_hash_table_lookup (melo_tags_cover_hash, id);
+      if (cover && !cover->data)
+        melo_tags_cover_lru_add (cover, data);
+      g_rec_mutex_unlock (&melo_tags_cover_mutex);
+    }
+  }
 
-    return data;
+  return data;
+}
+
+static void melo_tags_cover_fetch (const gchar *id);
+
+static void
+melo_tags_cover_fetch_done (gchar *id, GBytes *data)
+{
+  MeloTagsCoverURL *cover_url = NULL;
+  GList *waiters = NULL, *l;
+  gchar *next;
+
+  /* Add data to internal cache */
+  g_rec_mutex_lock (&melo_tags_cover_mutex);
+  if (melo_tags_cover_url_hash)
+    cover_url = g_hash_table_lookup (melo_tags_cover_url_hash, id + 1);
+  if (cover_url) {
+    if (data && !cover_url->id)
+      cover_url->id = melo_tags_cover_add_data (data, cover_url->persist);
+
+    /* Get waiting requests */
+    waiters = cover_url->waiters;
+    cover_url->waiters = NULL;
+    cover_url->fetching = FALSE;
+  }
+  melo_tags_cover_fetch_count--;
+  g_rec_mutex_unlock (&melo_tags_cover_mutex);
+
+  /* Complete waiting requests */
+  for (l = waiters; l != NULL; l = l->next) {
+    MeloTagsCoverWaiter *waiter = l->data;
+
+    waiter->callback (id, data, waiter->user_data);
+    melo_tags_cover_waiter_free (waiter);
+  }
+  g_list_free (waiters);
+
+  /* Release reference taken for the download */
+  melo_tags_cover_unref (id);
+  g_free (id);
+
+  /* Start next pending download */
+  g_rec_mutex_lock (&melo_tags_cover_mutex);
+  next = g_queue_pop_head (&melo_tags_cover_fetch_queue);
+  g_rec_mutex_unlock (&melo_tags_cover_mutex);
+  if (next) {
+    melo_tags_cover_fetch (next);
+    g_free (next);
+  }
+}
+
+static void
+melo_tags_cover_fetch_cb (SoupSession *session, SoupMessage *msg,
+                          gpointer user_data)
+{
+  GBytes *data = NULL;
+
+  /* Get downloaded data */
+  if (msg->status_code == SOUP_STATUS_OK)
+    g_object_get (msg, "response-body-data", &data, NULL);
+
+  melo_tags_cover_fetch_done (user_data, data);
+  if (data)
+    g_bytes_unref (data);
+}
+
+static void
+melo_tags_cover_fetch (const gchar *id)
+{
+  MeloTagsCoverURL *cover_url = NULL;
+  SoupMessage *msg = NULL;
+
+  g_rec_mutex_lock (&melo_tags_cover_mutex);
+
+  /* Too many downloads in progress: wait for a slot */
+  if (melo_tags_cover_fetch_count >= MELO_TAGS_COVER_FETCH_MAX) {
+    g_queue_push_tail (&melo_tags_cover_fetch_queue, g_strdup (id));
+    g_rec_mutex_unlock (&melo_tags_cover_mutex);
+    return;
   }
 
-  return g_bytes_ref (cover->data);
+  /* Create a new Soup session */
+  if (!melo_tags_cover_async_session)
+    melo_tags_cover_async_session = soup_session_new_with_options (
+                                SOUP_SESSION_USER_AGENT, "Melo",
+                                SOUP_SESSION_MAX_CONNS,
+                                MELO_TAGS_COVER_FETCH_MAX,
+                                SOUP_SESSION_MAX_CONNS_PER_HOST,
+                                MELO_TAGS_COVER_FETCH_MAX,
+                                NULL);
+
+  /* Prepare HTTP request */
+  if (melo_tags_cover_url_hash)
+    cover_url = g_hash_table_lookup (melo_tags_cover_url_hash, id + 1);
+  if (cover_url)
+    msg = soup_message_new ("GET", cover_url->url);
+  melo_tags_cover_fetch_count++;
+  g_rec_mutex_unlock (&melo_tags_cover_mutex);
+
+  /* Download cover data */
+  if (msg)
+    soup_session_queue_message (melo_tags_cover_async_session, msg,
+                                melo_tags_cover_fetch_cb, g_strdup (id));
+  else
+    melo_tags_cover_fetch_done (g_strdup (id), NULL);
+}
+
+/**
+ * melo_tags_get_cover_by_id_async:
+ * @id: the cover ID
+ * @callback: the function to call when the cover data is available
+ * @user_data: the data to pass to @callback
+ *
+ * Provide the image data of the cover identified by @id, as
+ * melo_tags_get_cover_by_id(), without blocking the calling thread.
+ * When the cover comes from an URL which has not been downloaded yet, the
+ * download is started in the thread-default main context of the calling
+ * thread and @callback is called from it when done. Concurrent requests for
+ * the same cover share the same download and only a few downloads are done in
+ * parallel: the next ones are started when a download ends.
+ * Otherwise, @callback is called immediately, before this function returns.
+ *
+ * The #GBytes passed to @callback is %NULL if the cover is not available and
+ * it must be referenced with g_bytes_ref() to be used after @callback returns.
+ */
+void
+melo_tags_get_cover_by_id_async (const gchar *id,
+                                 MeloTagsCoverCallback callback,
+                                 gpointer user_data)
+{
+  MeloTagsCoverURL *cover_url = NULL;
+  MeloTagsCoverWaiter *waiter;
+  gboolean start = FALSE;
+  GBytes *data;
+
+  /* Cover not coming from an URL */
+  if (!id || *id != '@')
+    goto get;
+
+  /* Find in cover URL hash table */
+  g_rec_mutex_lock (&melo_tags_cover_mutex);
+  if (melo_tags_cover_url_hash)
+    cover_url = g_hash_table_lookup (melo_tags_cover_url_hash, id + 1);
+  if (!cover_url || cover_url->id) {
+    g_rec_mutex_unlock (&melo_tags_cover_mutex);
+    goto get;
+  }
+
+  /* Update access time */
+  cover_url->timestamp = g_get_monotonic_time ();
+
+  /* Wait for download */
+  waiter = g_slice_new (MeloTagsCoverWaiter);
+  waiter->callback = callback;
+  waiter->user_data = user_data;
+  cover_url->waiters = g_list_append (cover_url->waiters, waiter);
+
+  /* Start download and keep cover URL until its end */
+  if (!cover_url->fetching) {
+    g_atomic_int_inc (&cover_url->ref_count);
+    cover_url->fetching = TRUE;
+    start = TRUE;
+  }
+  g_rec_mutex_unlock (&melo_tags_cover_mutex);
+
+  if (start)
+    melo_tags_cover_fetch (id);
+  return;
+
+get:
+  /* Cover is available */
+  data = melo_tags_get_cover_by_id (id);
+  callback (id, data, user_data);
+  if (data)
+    g_bytes_unref (data);
+}
+
+/**
+ * melo_tags_get_cover_thumbnail_path:
+ * @id: the cover ID
+ * @size: the size of the thumbnail (in pixels)
+ *
+ * Generate the path of the file where a thumbnail of the cover identified by
+ * @id can be stored. The thumbnails are stored next to the covers saved on
+ * disk, in a directory for each size.
+ *
+ * Returns: (transfer full): a string containing the thumbnail file path or
+ * %NULL if @id is not valid. After usage, call g_free().
+ */
+gchar *
+melo_tags_get_cover_thumbnail_path (const gchar *id, guint size)
+{
+  gchar *dir, *path;
+  const gchar *c;
+
+  /* Check ID: it is used as file name */
+  if (!id || !*id)
+    return NULL;
+  for (c = id; *c; c++)
+    if (!g_ascii_isalnum (*c) && *c != '@')
+      return NULL;
+
+  /* Generate thumbnail directory */
+  dir = g_strdup_printf ("%s/thumbnails/%u", melo_tags_cover_get_dir (), size);
+  g_mkdir_with_parents (dir, 0700);
+
+  /* Generate file path */
+  path = g_strdup_printf ("%s/%s", dir, id);
+  g_free (dir);
+
+  return path;
+}
+
+/**
+ * melo_tags_set_cover_cache_size:
+ * @size: the maximum size of cover data to keep in memory (in bytes)
+ *
+ * Set the size budget of the cover data kept in memory. When the budget is
+ * exceeded, the least recently used covers are evicted from memory and saved
+ * in a temporary file on disk, until they are used again. A @size of 0 keeps
+ * only the covers which are in use.
+ */
+void
+melo_tags_set_cover_cache_size (gsize size)
+{
+  g_rec_mutex_lock (&melo_tags_cover_mutex);
+  melo_tags_cover_lru_size = size;
+  melo_tags_cover_lru_evict ();
+  g_rec_mutex_unlock (&melo_tags_cover_mutex);
+}
+
+/**
+ * melo_tags_get_cover_cache_stats:
+ *
+ * Get the statistics of the in-memory cover cache: the number of accesses
+ * served from memory ("hits") and from disk ("misses"), the number of covers
+ * evicted from memory ("evictions"), the size of the cover data in memory
+ * ("resident_bytes") and the budget ("max_bytes").
+ *
+ * Returns: (transfer full): a new #JsonObject with the statistics. Use
+ * json_object_unref() after usage.
+ */
+JsonObject *
+melo_tags_get_cover_cache_stats (void)
+{
+  JsonObject *obj;
+
+  obj = json_object_new ();
+  g_rec_mutex_lock (&melo_tags_cover_mutex);
+  json_object_set_int_member (obj, "hits", melo_tags_cover_lru_hits);
+  json_object_set_int_member (obj, "misses", melo_tags_cover_lru_misses);
+  json_object_set_int_member (obj, "evictions", melo_tags_cover_lru_evictions);
+  json_object_set_int_member (obj, "resident_bytes", melo_tags_cover_lru_bytes);
+  json_object_set_int_member (obj, "max_bytes", melo_tags_cover_lru_size);
+  g_rec_mutex_unlock (&melo_tags_cover_mutex);
+
+  return obj;
+}
+
+/**
+ * melo_tags_get_memory_usage:
+ * @usage: the #MeloMemoryUsage to fill
+ *
+ * Get the memory held by the live #MeloTags and by the pool of interned
+ * strings. The cover of each #MeloTags is not counted.
+ */
+void
+melo_tags_get_memory_usage (MeloMemoryUsage *usage)
+{
+  GHashTableIter iter;
+  gsize strings_bytes = 0;
+  guint strings = 0;
+  gpointer key;
+  guint count;
+
+  /* Get interned strings size */
+  G_LOCK (melo_tags_strings_mutex);
+  if (melo_tags_strings) {
+    strings = g_hash_table_size (melo_tags_strings);
+    g_hash_table_iter_init (&iter, melo_tags_strings);
+    while (g_hash_table_iter_next (&iter, &key, NULL))
+      strings_bytes += strlen (key) + 1;
+  }
+  G_UNLOCK (melo_tags_strings_mutex);
+
+  /* Fill usage */
+  count = g_atomic_int_get (&melo_tags_count);
+  usage->count = count;
+  usage->bytes = count * sizeof (MeloTags) + strings_bytes;
+  usage->details = json_object_new ();
+  json_object_set_int_member (usage->details, "strings", strings);
+  json_object_set_int_member (usage->details, "strings_bytes", strings_bytes);
+}
+
+/* Must be called with cover locked */
+static gsize
+melo_tags_cover_url_bytes (void)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  gsize bytes = 0;
+
+  if (!melo_tags_cover_url_hash)
+    return 0;
+
+  /* Add size of IDs and URLs */
+  g_hash_table_iter_init (&iter, melo_tags_cover_url_hash);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    MeloTagsCoverURL *cover_url = value;
+
+    bytes += sizeof (*cover_url) + strlen (key) + 1;
+    if (cover_url->url)
+      bytes += strlen (cover_url->url) + 1;
+  }
+
+  return bytes;
+}
+
+/**
+ * melo_tags_get_cover_memory_usage:
+ * @usage: the #MeloMemoryUsage to fill
+ *
+ * Get the memory held by the cover cache: the cover data kept in memory and
+ * the cover URLs.
+ */
+void
+melo_tags_get_cover_memory_usage (MeloMemoryUsage *usage)
+{
+  gsize url_bytes;
+  guint covers, urls;
+
+  g_rec_mutex_lock (&melo_tags_cover_mutex);
+  covers = melo_tags_cover_hash ? g_hash_table_size (melo_tags_cover_hash) : 0;
+  urls = melo_tags_cover_url_hash ?
+         g_hash_table_size (melo_tags_cover_url_hash) : 0;
+  url_bytes = melo_tags_cover_url_bytes ();
+  usage->bytes = melo_tags_cover_lru_bytes + url_bytes;
+  usage->details = json_object_new ();
+  json_object_set_int_member (usage->details, "covers", covers);
+  json_object_set_int_member (usage->details, "resident_covers",
+                              melo_tags_cover_lru.length);
+  json_object_set_int_member (usage->details, "resident_bytes",
+                              melo_tags_cover_lru_bytes);
+  json_object_set_int_member (usage->details, "urls", urls);
+  json_object_set_int_member (usage->details, "url_bytes", url_bytes);
+  g_rec_mutex_unlock (&melo_tags_cover_mutex);
+
+  usage->count = covers + urls;
+}
+
+/**
+ * melo_tags_trim_cover_cache:
+ * @size: the maximum size of the cover cache (in bytes)
+ *
+ * Evict the least recently used covers from memory until the cover data and
+ * the cover URLs fit in @size, if possible. Unlike
+ * melo_tags_set_cover_cache_size(), the budget of the cover data is not
+ * changed.
+ */
+void
+melo_tags_trim_cover_cache (gsize size)
+{
+  gsize url_bytes, max;
+
+  g_rec_mutex_lock (&melo_tags_cover_mutex);
+
+  /* Evict cover data with a temporary budget */
+  url_bytes = melo_tags_cover_url_bytes ();
+  max = melo_tags_cover_lru_size;
+  melo_tags_cover_lru_size = MIN (max, size > url_bytes ? size - url_bytes : 0);
+  melo_tags_cover_lru_evict ();
+  melo_tags_cover_lru_size = max;
+
+  g_rec_mutex_unlock (&melo_tags_cover_mutex);
 }
 
 /**
@@ -691,7 +1783,18 @@ melo_tags_get_cover_by_id (const gchar *id)
 void
 melo_tags_flush_cover_cache (void)
 {
-  /* Destroy cover URL hash table */
+  /* Wait for pending writes */
+  if (melo_tags_cover_writer) {
+    g_thread_pool_free (melo_tags_cover_writer, FALSE, TRUE);
+    melo_tags_cover_writer = NULL;
+  }
+
+  /* Drop pending downloads */
+  g_queue_foreach (&melo_tags_cover_fetch_queue, (GFunc) g_free, NULL);
+  g_queue_clear (&melo_tags_cover_fetch_queue);
+
+  /* Destroy cover URL hash table (waiting requests are dropped) */
+  g_rec_mutex_lock (&melo_tags_cover_mutex);
   if (melo_tags_cover_url_hash) {
     g_hash_table_destroy (melo_tags_cover_url_hash);
     melo_tags_cover_url_hash = NULL;
@@ -703,15 +1806,45 @@ melo_tags_flush_cover_cache (void)
     melo_tags_cover_hash = NULL;
   }
 
+  /* Destroy disk store index and remaining writes */
+  if (melo_tags_cover_index) {
+    g_hash_table_destroy (melo_tags_cover_index);
+    melo_tags_cover_index = NULL;
+  }
+  if (melo_tags_cover_writes) {
+    g_hash_table_destroy (melo_tags_cover_writes);
+    melo_tags_cover_writes = NULL;
+  }
+
   /* Free cover path on disk */
   g_free (melo_tags_cover_path);
   melo_tags_cover_path = NULL;
+  g_rec_mutex_unlock (&melo_tags_cover_mutex);
 
   /* Free Soup session */
   if (melo_tags_cover_session) {
     g_object_unref (melo_tags_cover_session);
     melo_tags_cover_session = NULL;
   }
+
+  /* Abort downloads in progress and free asynchronous Soup session */
+  if (melo_tags_cover_async_session) {
+    soup_session_abort (melo_tags_cover_async_session);
+    g_object_unref (melo_tags_cover_async_session);
+    melo_tags_cover_async_session = NULL;
+  }
+}
+
+static gchar *
+melo_tags_get_gst_string (const GstTagList *tlist, const gchar *tag)
+{
+  const gchar *str;
+
+  /* Get first string without copy and intern it */
+  if (!gst_tag_list_peek_string_index (tlist, tag, 0, &str))
+    return NULL;
+
+  return melo_tags_intern_string (str);
 }
 
 /**
@@ -742,13 +1875,13 @@ melo_tags_new_from_gst_tag_list (const GstTagList *tlist, MeloTagsFields fields,
 
   /* Fill MeloTags from GstTagList */
   if (fields & MELO_TAGS_FIELDS_TITLE)
-    gst_tag_list_get_string (tlist, GST_TAG_TITLE, &tags->title);
+    tags->title = melo_tags_get_gst_string (tlist, GST_TAG_TITLE);
   if (fields & MELO_TAGS_FIELDS_ARTIST)
-    gst_tag_list_get_string (tlist, GST_TAG_ARTIST, &tags->artist);
+    tags->artist = melo_tags_get_gst_string (tlist, GST_TAG_ARTIST);
   if (fields & MELO_TAGS_FIELDS_ALBUM)
-    gst_tag_list_get_string (tlist, GST_TAG_ALBUM, &tags->album);
+    tags->album = melo_tags_get_gst_string (tlist, GST_TAG_ALBUM);
   if (fields & MELO_TAGS_FIELDS_GENRE)
-    gst_tag_list_get_string (tlist, GST_TAG_GENRE, &tags->genre);
+    tags->genre = melo_tags_get_gst_string (tlist, GST_TAG_GENRE);
   if (fields & MELO_TAGS_FIELDS_TRACK)
     gst_tag_list_get_uint (tlist, GST_TAG_TRACK_NUMBER, &tags->track);
   if (fields & MELO_TAGS_FIELDS_TRACKS)
@@ -952,6 +2085,71 @@ melo_tags_to_json_object (MeloTags *tags, MeloTagsFields fields)
   return obj;
 }
 
+/**
+ * melo_tags_get_json_object:
+ * @tags: the tags
+ * @fields: the tags to add to the #JsonObject
+ *
+ * Get a #JsonObject with many members containing all data requested in
+ * @fields, as melo_tags_to_json_object(). The object is cached in the
+ * #MeloTags for each @fields, until next call to melo_tags_update(): the same
+ * object is returned to all callers, so it must not be modified.
+ *
+ * Returns: (transfer full): a reference to a #JsonObject filled with #MeloTags
+ * data or %NULL if an error occurred. After use, call json_object_unref().
+ */
+JsonObject *
+melo_tags_get_json_object (MeloTags *tags, MeloTagsFields fields)
+{
+  MeloTagsJSON *json;
+  GSList *l, *next;
+  JsonObject *obj;
+  guint count = 0;
+
+  if (!tags)
+    return melo_tags_to_json_object (NULL, fields);
+
+  /* Find cached object */
+  G_LOCK (melo_tags_json_mutex);
+  for (l = tags->json; l != NULL; l = l->next) {
+    json = l->data;
+    if (json->fields == fields && json->timestamp == tags->timestamp) {
+      obj = json_object_ref (json->obj);
+      G_UNLOCK (melo_tags_json_mutex);
+      return obj;
+    }
+  }
+  G_UNLOCK (melo_tags_json_mutex);
+
+  /* Create object */
+  obj = melo_tags_to_json_object (tags, fields);
+  if (!obj)
+    return NULL;
+
+  /* Add object to cache */
+  json = g_slice_new (MeloTagsJSON);
+  json->fields = fields;
+  json->timestamp = tags->timestamp;
+  json->obj = json_object_ref (obj);
+  G_LOCK (melo_tags_json_mutex);
+  tags->json = g_slist_prepend (tags->json, json);
+
+  /* Remove outdated and oldest objects */
+  for (l = tags->json->next; l != NULL; l = next) {
+    MeloTagsJSON *old = l->data;
+
+    next = l->next;
+    if (old->fields == fields || old->timestamp != tags->timestamp ||
+        ++count >= MELO_TAGS_JSON_CACHE_MAX) {
+      tags->json = g_slist_delete_link (tags->json, l);
+      melo_tags_json_free (old);
+    }
+  }
+  G_UNLOCK (melo_tags_json_mutex);
+
+  return obj;
+}
+
 /**
  * melo_tags_unref:
  * @tags: the tags
@@ -972,11 +2170,15 @@ melo_tags_unref (MeloTags *tags)
   /* Remove cover reference */
   melo_tags_cover_unref (tags->cover);
 
+  /* Free cached JSON objects */
+  g_slist_free_full (tags->json, (GDestroyNotify) melo_tags_json_free);
+
   /* Free tags */
-  g_free (tags->title);
-  g_free (tags->artist);
-  g_free (tags->album);
-  g_free (tags->genre);
+  melo_tags_release_string (tags->title);
+  melo_tags_release_string (tags->artist);
+  melo_tags_release_string (tags->album);
+  melo_tags_release_string (tags->genre);
   g_free (tags->cover);
   g_slice_free (MeloTags, tags);
+  g_atomic_int_add (&melo_tags_count, -1);
 }
@@ -26,6 +26,8 @@
 #include <gst/gst.h>
 #include <json-glib/json-glib.h>
 
+#include "melo_memory.h"
+
 typedef struct _MeloTags MeloTags;
 typedef enum _MeloTagsFields MeloTagsFields;
 typedef enum _MeloTagsCoverPersist MeloTagsCoverPersist;
@@ -43,6 +45,8 @@ typedef enum _MeloTagsCoverPersist MeloTagsCoverPersist;
  *
  * #MeloTags contains all details on a media such as its title, the related
  * artist and album.
+ * The @title, @artist, @album and @genre strings should be set with
+ * melo_tags_intern_string() to share them between all the #MeloTags.
  * To retrieve the image cover data from its ID, the melo_tags_get_cover() can
  * be used with a #MeloTags or melo_tags_get_cover_by_id() can be used with the
  * cover ID only, when the #MeloTags is not available.
@@ -60,6 +64,7 @@ struct _MeloTags {
   /*< private >*/
   gint64 timestamp;
   gint ref_count;
+  GSList *json;
 };
 
 /**
@@ -119,14 +124,33 @@ enum _MeloTagsCoverPersist {
   MELO_TAGS_COVER_PERSIST_COUNT
 };
 
+/**
+ * MeloTagsCoverCallback:
+ * @id: the cover ID
+ * @cover: (nullable): the image data of the cover or %NULL if not available
+ * @user_data: the user data passed to melo_tags_get_cover_by_id_async()
+ *
+ * The function called when the image data of a cover requested with
+ * melo_tags_get_cover_by_id_async() is available.
+ */
+typedef void (*MeloTagsCoverCallback) (const gchar *id, GBytes *cover,
+                                       gpointer user_data);
+
 MeloTags *melo_tags_new (void);
 void melo_tags_update (MeloTags *tags);
 gboolean melo_tags_updated (MeloTags *tags, gint64 timestamp);
 MeloTags *melo_tags_copy (MeloTags *tags);
 void melo_tags_merge (MeloTags *tags, MeloTags *ref_tags);
+MeloTags *melo_tags_merge_ref (MeloTags *tags, MeloTags *ref_tags);
+gboolean melo_tags_is_writable (MeloTags *tags);
+MeloTags *melo_tags_make_writable (MeloTags *tags);
 MeloTags *melo_tags_ref (MeloTags *tags);
 void melo_tags_unref (MeloTags *tags);
 
+/* Shared strings for title, artist, album and genre */
+gchar *melo_tags_intern_string (const gchar *str);
+void melo_tags_release_string (gchar *str);
+
 /* Set an image cover to MeloTags */
 const gchar *melo_tags_set_cover_by_data (MeloTags *tags, GBytes *cover,
                                           MeloTagsCoverPersist persist);
@@ -136,6 +160,19 @@ const gchar *melo_tags_set_cover_by_url (MeloTags *tags, const gchar *url,
 /* Get an image cover */
 GBytes *melo_tags_get_cover (MeloTags *tags);
 GBytes *melo_tags_get_cover_by_id (const gchar *id);
+void melo_tags_get_cover_by_id_async (const gchar *id,
+                                      MeloTagsCoverCallback callback,
+                                      gpointer user_data);
+gchar *melo_tags_get_cover_thumbnail_path (const gchar *id, guint size);
+
+/* Image cover cache in memory */
+void melo_tags_set_cover_cache_size (gsize size);
+JsonObject *melo_tags_get_cover_cache_stats (void);
+void melo_tags_trim_cover_cache (gsize size);
+
+/* Memory accounting */
+void melo_tags_get_memory_usage (MeloMemoryUsage *usage);
+void melo_tags_get_cover_memory_usage (MeloMemoryUsage *usage);
 
 /* Flush image cover cache (to call at end of program) */
 void melo_tags_flush_cover_cache (void);
@@ -150,5 +187,6 @@ MeloTagsFields melo_tags_get_fields_from_json_array (JsonArray *array);
 void melo_tags_add_to_json_object (MeloTags *tags, JsonObject *object,
                                    MeloTagsFields fields);
 JsonObject *melo_tags_to_json_object (MeloTags *tags, MeloTagsFields fields);
+JsonObject *melo_tags_get_json_object (MeloTags *tags, MeloTagsFields fields);
 
 #endif /* __MELO_TAGS_H__ */
@@ -0,0 +1,311 @@
+/*
+ * melo_trace.c: Lightweight tracing of startup and hot paths
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include "melo_trace.h"
+
+/**
+ * SECTION:melo_trace
+ * @title: MeloTrace
+ * @short_description: Lightweight tracing of startup and hot paths
+ *
+ * #MeloTrace records timed spans to find where time goes during startup or
+ * in a hot path, as a JSON-RPC call or a player loading a media.
+ *
+ * A span is opened with melo_trace_begin() which returns a monotonic
+ * timestamp, and closed with melo_trace_end() which records the span in a ring
+ * buffer of the calling thread. A span can be closed from another thread than
+ * the one which opened it. When tracing is disabled, melo_trace_begin()
+ * returns 0 and melo_trace_end() does nothing, so the instrumentation can stay
+ * in place at no cost.
+ *
+ * The spans of all threads can be exported with melo_trace_export() or
+ * melo_trace_export_to_file() in the Chrome trace event format, which can be
+ * loaded in chrome://tracing or in Perfetto.
+ */
+
+/* Number of spans kept per thread */
+#define MELO_TRACE_BUFFER_SIZE 1024
+
+/* Maximum length of a span name */
+#define MELO_TRACE_NAME_SIZE 48
+
+typedef struct {
+  const gchar *category;
+  gchar name[MELO_TRACE_NAME_SIZE];
+  gint64 ts;
+  gint64 dur;
+} MeloTraceEvent;
+
+typedef struct {
+  GMutex mutex;
+  guint tid;
+  guint head;
+  guint count;
+  MeloTraceEvent events[MELO_TRACE_BUFFER_SIZE];
+} MeloTraceBuffer;
+
+static void melo_trace_buffer_free (gpointer data);
+
+/* Tracing state */
+static gint melo_trace_enabled;
+
+/* Per-thread buffers */
+G_LOCK_DEFINE_STATIC (melo_trace_mutex);
+static GList *melo_trace_buffers;
+static guint melo_trace_next_tid = 1;
+static GPrivate melo_trace_buffer = G_PRIVATE_INIT (melo_trace_buffer_free);
+
+static MeloTraceBuffer *
+melo_trace_buffer_get (void)
+{
+  MeloTraceBuffer *buf;
+
+  /* Get buffer of current thread */
+  buf = g_private_get (&melo_trace_buffer);
+  if (buf)
+    return buf;
+
+  /* Create a new buffer */
+  buf = g_slice_new0 (MeloTraceBuffer);
+  g_mutex_init (&buf->mutex);
+
+  /* Add buffer to list */
+  G_LOCK (melo_trace_mutex);
+  buf->tid = melo_trace_next_tid++;
+  melo_trace_buffers = g_list_prepend (melo_trace_buffers, buf);
+  G_UNLOCK (melo_trace_mutex);
+
+  g_private_set (&melo_trace_buffer, buf);
+
+  return buf;
+}
+
+static void
+melo_trace_buffer_free (gpointer data)
+{
+  MeloTraceBuffer *buf = data;
+
+  /* Remove buffer from list */
+  G_LOCK (melo_trace_mutex);
+  melo_trace_buffers = g_list_remove (melo_trace_buffers, buf);
+  G_UNLOCK (melo_trace_mutex);
+
+  /* Free buffer */
+  g_mutex_clear (&buf->mutex);
+  g_slice_free (MeloTraceBuffer, buf);
+}
+
+/**
+ * melo_trace_set_enabled:
+ * @enable: set to %TRUE to record spans
+ *
+ * Enable or disable tracing. The spans already recorded are kept until
+ * melo_trace_clear() is called.
+ */
+void
+melo_trace_set_enabled (gboolean enable)
+{
+  g_atomic_int_set (&melo_trace_enabled, enable);
+}
+
+/**
+ * melo_trace_is_enabled:
+ *
+ * Check if tracing is enabled.
+ *
+ * Returns: %TRUE if spans are recorded, %FALSE otherwise.
+ */
+gboolean
+melo_trace_is_enabled (void)
+{
+  return g_atomic_int_get (&melo_trace_enabled);
+}
+
+/**
+ * melo_trace_begin:
+ *
+ * Open a new span. The returned value must be passed to melo_trace_end() to
+ * close and record the span.
+ *
+ * Returns: the start time of the span in microseconds, or 0 if tracing is
+ * disabled.
+ */
+gint64
+melo_trace_begin (void)
+{
+  if (!g_atomic_int_get (&melo_trace_enabled))
+    return 0;
+
+  return g_get_monotonic_time ();
+}
+
+/**
+ * melo_trace_end:
+ * @category: a static string with the category of the span
+ * @name: the name of the span
+ * @start: the value returned by melo_trace_begin()
+ *
+ * Close a span opened with melo_trace_begin() and record it in the ring buffer
+ * of the calling thread. The @category is not copied and must be a static
+ * string, while @name is copied and truncated if too long.
+ * If @start is 0, nothing is recorded.
+ */
+void
+melo_trace_end (const gchar *category, const gchar *name, gint64 start)
+{
+  MeloTraceBuffer *buf;
+  MeloTraceEvent *ev;
+  gint64 now;
+
+  /* Span not opened or tracing disabled in between */
+  if (!start || !g_atomic_int_get (&melo_trace_enabled))
+    return;
+  now = g_get_monotonic_time ();
+
+  /* Get thread buffer */
+  buf = melo_trace_buffer_get ();
+
+  /* Record span: oldest span is overwritten when buffer is full */
+  g_mutex_lock (&buf->mutex);
+  ev = &buf->events[buf->head];
+  ev->category = category;
+  g_strlcpy (ev->name, name ? name : "", sizeof (ev->name));
+  ev->ts = start;
+  ev->dur = now - start;
+  buf->head = (buf->head + 1) % MELO_TRACE_BUFFER_SIZE;
+  if (buf->count < MELO_TRACE_BUFFER_SIZE)
+    buf->count++;
+  g_mutex_unlock (&buf->mutex);
+}
+
+/**
+ * melo_trace_clear:
+ *
+ * Drop all recorded spans.
+ */
+void
+melo_trace_clear (void)
+{
+  GList *l;
+
+  G_LOCK (melo_trace_mutex);
+  for (l = melo_trace_buffers; l != NULL; l = l->next) {
+    MeloTraceBuffer *buf = l->data;
+
+    g_mutex_lock (&buf->mutex);
+    buf->head = buf->count = 0;
+    g_mutex_unlock (&buf->mutex);
+  }
+  G_UNLOCK (melo_trace_mutex);
+}
+
+/**
+ * melo_trace_export:
+ *
+ * Export all recorded spans in the Chrome trace event format: an object with
+ * a "traceEvents" array containing one complete event per span.
+ *
+ * Returns: (transfer full): a new #JsonNode containing the trace. Use
+ * json_node_free() after usage.
+ */
+JsonNode *
+melo_trace_export (void)
+{
+  JsonObject *obj;
+  JsonArray *array;
+  JsonNode *node;
+  gint pid;
+  GList *l;
+
+  /* Create trace events array */
+  array = json_array_new ();
+  pid = getpid ();
+
+  /* Add spans of all threads */
+  G_LOCK (melo_trace_mutex);
+  for (l = melo_trace_buffers; l != NULL; l = l->next) {
+    MeloTraceBuffer *buf = l->data;
+    guint i, idx;
+
+    g_mutex_lock (&buf->mutex);
+    idx = (buf->head + MELO_TRACE_BUFFER_SIZE - buf->count) %
+          MELO_TRACE_BUFFER_SIZE;
+    for (i = 0; i < buf->count; i++) {
+      MeloTraceEvent *ev = &buf->events[(idx + i) % MELO_TRACE_BUFFER_SIZE];
+      JsonObject *o;
+
+      /* Add a complete event */
+      o = json_object_new ();
+      json_object_set_string_member (o, "name", ev->name);
+      json_object_set_string_member (o, "cat", ev->category);
+      json_object_set_string_member (o, "ph", "X");
+      json_object_set_int_member (o, "ts", ev->ts);
+      json_object_set_int_member (o, "dur", ev->dur);
+      json_object_set_int_member (o, "pid", pid);
+      json_object_set_int_member (o, "tid", buf->tid);
+      json_array_add_object_element (array, o);
+    }
+    g_mutex_unlock (&buf->mutex);
+  }
+  G_UNLOCK (melo_trace_mutex);
+
+  /* Create trace object */
+  obj = json_object_new ();
+  json_object_set_array_member (obj, "traceEvents", array);
+  json_object_set_string_member (obj, "displayTimeUnit", "ms");
+  node = json_node_new (JSON_NODE_OBJECT);
+  json_node_take_object (node, obj);
+
+  return node;
+}
+
+/**
+ * melo_trace_export_to_file:
+ * @filename: the path of the file to write
+ * @error: a location for a #GError, or %NULL
+ *
+ * Export all recorded spans with melo_trace_export() and write the trace to
+ * @filename.
+ *
+ * Returns: %TRUE if the trace has been written, %FALSE otherwise.
+ */
+gboolean
+melo_trace_export_to_file (const gchar *filename, GError **error)
+{
+  JsonGenerator *gen;
+  JsonNode *node;
+  gboolean ret;
+
+  /* Export trace */
+  node = melo_trace_export ();
+
+  /* Write trace to file */
+  gen = json_generator_new ();
+  json_generator_set_root (gen, node);
+  ret = json_generator_to_file (gen, filename, error);
+  g_object_unref (gen);
+  json_node_free (node);
+
+  return ret;
+}
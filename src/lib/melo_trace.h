@@ -0,0 +1,38 @@
+/*
+ * melo_trace.h: Lightweight tracing of startup and hot paths
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __MELO_TRACE_H__
+#define __MELO_TRACE_H__
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+void melo_trace_set_enabled (gboolean enable);
+gboolean melo_trace_is_enabled (void);
+
+gint64 melo_trace_begin (void);
+void melo_trace_end (const gchar *category, const gchar *name, gint64 start);
+
+void melo_trace_clear (void);
+JsonNode *melo_trace_export (void);
+gboolean melo_trace_export_to_file (const gchar *filename, GError **error);
+
+#endif /* __MELO_TRACE_H__ */
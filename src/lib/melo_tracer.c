@@ -0,0 +1,504 @@
+/*
+ * melo_tracer.c: Runtime GStreamer tracers and element processing times
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#include <gst/gst.h>
+
+#include "melo_tracer.h"
+
+/**
+ * SECTION:melo_tracer
+ * @title: MeloTracer
+ * @short_description: Runtime GStreamer tracers and element processing times
+ *
+ * #MeloTracer enables GStreamer tracers at runtime, without setting the
+ * GST_TRACERS environment variable and restarting Melo, in order to profile
+ * the pipelines of a running instance.
+ *
+ * The following tracers are available:
+ *  - "latency", "stats", "leaks" and "rusage": the core tracers of GStreamer,
+ *    which write their records in the GST_TRACER debug category, so its
+ *    threshold is raised to TRACE when one of them is enabled. A core tracer
+ *    cannot be removed from GStreamer, so once enabled, it stays enabled until
+ *    Melo is restarted.
+ *  - "proctime": a tracer of Melo which measures, for each element of all
+ *    pipelines, the number of buffers and bytes received, and the time spent
+ *    to process them (excluding the time spent by the downstream elements
+ *    called from the same thread). It can be disabled at any time and its
+ *    results are returned by melo_tracer_get_stats().
+ */
+
+/* Maximum depth of nested pad pushes followed per thread */
+#define MELO_TRACER_STACK_SIZE 32
+
+/* Core tracers */
+typedef enum {
+  MELO_TRACER_CORE_LATENCY = 0,
+  MELO_TRACER_CORE_STATS,
+  MELO_TRACER_CORE_LEAKS,
+  MELO_TRACER_CORE_RUSAGE,
+
+  MELO_TRACER_CORE_COUNT
+} MeloTracerCore;
+
+static const struct {
+  const gchar *name;
+  const gchar *type_name;
+} melo_tracer_cores[MELO_TRACER_CORE_COUNT] = {
+  [MELO_TRACER_CORE_LATENCY] = { "latency", "GstLatencyTracer" },
+  [MELO_TRACER_CORE_STATS] = { "stats", "GstStatsTracer" },
+  [MELO_TRACER_CORE_LEAKS] = { "leaks", "GstLeaksTracer" },
+  [MELO_TRACER_CORE_RUSAGE] = { "rusage", "GstRUsageTracer" },
+};
+
+/* Processing time tracer */
+typedef struct {
+  GstTracer parent;
+} MeloTracerProc;
+
+typedef struct {
+  GstTracerClass parent_class;
+} MeloTracerProcClass;
+
+typedef struct {
+  GstElement *element;
+  guint64 bytes;
+  GstClockTime start;
+  GstClockTime child;
+} MeloTracerFrame;
+
+typedef struct {
+  guint depth;
+  MeloTracerFrame frames[MELO_TRACER_STACK_SIZE];
+} MeloTracerStack;
+
+typedef struct {
+  gchar *name;
+  guint64 buffers;
+  guint64 bytes;
+  GstClockTime total;
+  GstClockTime max;
+} MeloTracerElement;
+
+static GType melo_tracer_proc_get_type (void);
+G_DEFINE_TYPE (MeloTracerProc, melo_tracer_proc, GST_TYPE_TRACER)
+
+/* Tracers state */
+G_LOCK_DEFINE_STATIC (melo_tracer_mutex);
+static GstTracer *melo_tracer_core_tracers[MELO_TRACER_CORE_COUNT];
+static GstTracer *melo_tracer_proc_tracer;
+static gint melo_tracer_proc_enabled;
+static gint64 melo_tracer_proc_start;
+
+/* Element statistics */
+G_LOCK_DEFINE_STATIC (melo_tracer_stats_mutex);
+static GHashTable *melo_tracer_elements;
+static GPrivate melo_tracer_stack = G_PRIVATE_INIT (g_free);
+
+static void
+melo_tracer_element_free (MeloTracerElement *el)
+{
+  g_free (el->name);
+  g_slice_free (MeloTracerElement, el);
+}
+
+static void
+melo_tracer_element_finalized (gpointer data, GObject *object)
+{
+  /* Remove statistics of destroyed element */
+  G_LOCK (melo_tracer_stats_mutex);
+  if (melo_tracer_elements)
+    g_hash_table_remove (melo_tracer_elements, object);
+  G_UNLOCK (melo_tracer_stats_mutex);
+}
+
+static void
+melo_tracer_element_remove_ref (gpointer key, gpointer value, gpointer data)
+{
+  g_object_weak_unref (key, melo_tracer_element_finalized, NULL);
+}
+
+static void
+melo_tracer_proc_record (GstElement *element, guint buffers, guint64 bytes,
+                         GstClockTime time)
+{
+  MeloTracerElement *el;
+
+  G_LOCK (melo_tracer_stats_mutex);
+
+  /* Create element statistics on first buffer */
+  if (!melo_tracer_elements)
+    melo_tracer_elements = g_hash_table_new_full (NULL, NULL, NULL,
+                                   (GDestroyNotify) melo_tracer_element_free);
+  el = g_hash_table_lookup (melo_tracer_elements, element);
+  if (!el) {
+    el = g_slice_new0 (MeloTracerElement);
+    el->name = gst_object_get_path_string (GST_OBJECT (element));
+    g_hash_table_insert (melo_tracer_elements, element, el);
+    g_object_weak_ref (G_OBJECT (element), melo_tracer_element_finalized, NULL);
+  }
+
+  /* Update statistics */
+  el->buffers += buffers;
+  el->bytes += bytes;
+  el->total += time;
+  if (time > el->max)
+    el->max = time;
+
+  G_UNLOCK (melo_tracer_stats_mutex);
+}
+
+static void
+melo_tracer_proc_push_pre (GstTracer *self, GstClockTime ts, GstPad *pad,
+                           guint64 bytes)
+{
+  GstElement *element = NULL;
+  MeloTracerStack *stack;
+  MeloTracerFrame *frame;
+  GstObject *parent;
+  GstPad *peer;
+
+  if (!g_atomic_int_get (&melo_tracer_proc_enabled))
+    return;
+
+  /* Get stack of current thread */
+  stack = g_private_get (&melo_tracer_stack);
+  if (!stack) {
+    stack = g_new0 (MeloTracerStack, 1);
+    g_private_set (&melo_tracer_stack, stack);
+  }
+  if (stack->depth >= MELO_TRACER_STACK_SIZE)
+    return;
+
+  /* Get element receiving the buffer: ghost pads and bins are skipped */
+  peer = GST_PAD_PEER (pad);
+  parent = peer ? GST_OBJECT_PARENT (peer) : NULL;
+  if (parent && GST_IS_ELEMENT (parent) && !GST_IS_BIN (parent))
+    element = GST_ELEMENT (parent);
+
+  /* Push a new frame */
+  frame = &stack->frames[stack->depth++];
+  frame->element = element;
+  frame->bytes = bytes;
+  frame->start = ts;
+  frame->child = 0;
+}
+
+static MeloTracerFrame *
+melo_tracer_proc_push_post (GstTracer *self, GstClockTime ts,
+                            GstClockTime *time)
+{
+  MeloTracerStack *stack;
+  MeloTracerFrame *frame;
+  GstClockTime dur;
+
+  /* No frame pushed */
+  stack = g_private_get (&melo_tracer_stack);
+  if (!stack || !stack->depth)
+    return NULL;
+
+  /* Pop frame: the time spent by the downstream elements is removed */
+  frame = &stack->frames[--stack->depth];
+  dur = ts > frame->start ? ts - frame->start : 0;
+  *time = dur > frame->child ? dur - frame->child : 0;
+  if (stack->depth)
+    stack->frames[stack->depth - 1].child += dur;
+
+  /* Tracer disabled in between */
+  if (!frame->element || !g_atomic_int_get (&melo_tracer_proc_enabled))
+    return NULL;
+
+  return frame;
+}
+
+static void
+melo_tracer_proc_pad_push_pre (GstTracer *self, GstClockTime ts, GstPad *pad,
+                               GstBuffer *buffer)
+{
+  melo_tracer_proc_push_pre (self, ts, pad, gst_buffer_get_size (buffer));
+}
+
+static void
+melo_tracer_proc_pad_push_post (GstTracer *self, GstClockTime ts, GstPad *pad,
+                                GstFlowReturn res)
+{
+  MeloTracerFrame *frame;
+  GstClockTime time;
+
+  /* Record one buffer */
+  frame = melo_tracer_proc_push_post (self, ts, &time);
+  if (frame)
+    melo_tracer_proc_record (frame->element, 1, frame->bytes, time);
+}
+
+static void
+melo_tracer_proc_pad_push_list_pre (GstTracer *self, GstClockTime ts,
+                                    GstPad *pad, GstBufferList *list)
+{
+  melo_tracer_proc_push_pre (self, ts, pad, 0);
+}
+
+static void
+melo_tracer_proc_pad_push_list_post (GstTracer *self, GstClockTime ts,
+                                     GstPad *pad, GstFlowReturn res)
+{
+  MeloTracerFrame *frame;
+  GstClockTime time;
+
+  /* Record a buffer list as one buffer: its size is not computed */
+  frame = melo_tracer_proc_push_post (self, ts, &time);
+  if (frame)
+    melo_tracer_proc_record (frame->element, 1, 0, time);
+}
+
+static void
+melo_tracer_proc_class_init (MeloTracerProcClass *klass)
+{
+}
+
+static void
+melo_tracer_proc_init (MeloTracerProc *self)
+{
+  GstTracer *tracer = GST_TRACER (self);
+
+  /* Follow all buffer pushes */
+  gst_tracing_register_hook (tracer, "pad-push-pre",
+                             G_CALLBACK (melo_tracer_proc_pad_push_pre));
+  gst_tracing_register_hook (tracer, "pad-push-post",
+                             G_CALLBACK (melo_tracer_proc_pad_push_post));
+  gst_tracing_register_hook (tracer, "pad-push-list-pre",
+                             G_CALLBACK (melo_tracer_proc_pad_push_list_pre));
+  gst_tracing_register_hook (tracer, "pad-push-list-post",
+                             G_CALLBACK (melo_tracer_proc_pad_push_list_post));
+}
+
+static gboolean
+melo_tracer_core_enable (MeloTracerCore core)
+{
+  GstPluginFeature *feature;
+  GstPluginFeature *loaded;
+  GstTracer *tracer;
+  GType type;
+
+  /* Find tracer factory */
+  feature = gst_registry_find_feature (gst_registry_get (),
+                                       melo_tracer_cores[core].name,
+                                       GST_TYPE_TRACER_FACTORY);
+  if (!feature) {
+    g_warning ("tracer '%s' not found", melo_tracer_cores[core].name);
+    return FALSE;
+  }
+
+  /* Load plugin to register the tracer type */
+  loaded = gst_plugin_feature_load (feature);
+  gst_object_unref (feature);
+  if (!loaded)
+    return FALSE;
+  gst_object_unref (loaded);
+  type = g_type_from_name (melo_tracer_cores[core].type_name);
+  if (!type)
+    return FALSE;
+
+  /* Create tracer: hooks are registered on instance creation */
+  tracer = g_object_new (type, NULL);
+  melo_tracer_core_tracers[core] = gst_object_ref_sink (tracer);
+
+  /* Core tracers log their records in the GST_TRACER category */
+  gst_debug_set_threshold_for_name ("GST_TRACER", GST_LEVEL_TRACE);
+
+  return TRUE;
+}
+
+/**
+ * melo_tracer_set_enabled:
+ * @name: the name of the tracer
+ * @enable: set to %TRUE to enable the tracer
+ *
+ * Enable or disable a tracer. The core tracers of GStreamer ("latency",
+ * "stats", "leaks" and "rusage") cannot be disabled once enabled, only the
+ * "proctime" tracer can be.
+ *
+ * Returns: %TRUE if the tracer state has been changed as requested, %FALSE
+ * otherwise.
+ */
+gboolean
+melo_tracer_set_enabled (const gchar *name, gboolean enable)
+{
+  gboolean ret = FALSE;
+  guint i;
+
+  g_return_val_if_fail (name, FALSE);
+
+  G_LOCK (melo_tracer_mutex);
+
+  /* Processing time tracer */
+  if (!g_strcmp0 (name, "proctime")) {
+    /* Create tracer on first use: it cannot be removed */
+    if (!melo_tracer_proc_tracer && enable) {
+      GstTracer *tracer = g_object_new (melo_tracer_proc_get_type (), NULL);
+      melo_tracer_proc_tracer = gst_object_ref_sink (tracer);
+    }
+    if (enable && !g_atomic_int_get (&melo_tracer_proc_enabled))
+      melo_tracer_proc_start = g_get_monotonic_time ();
+    g_atomic_int_set (&melo_tracer_proc_enabled, enable);
+    G_UNLOCK (melo_tracer_mutex);
+    return TRUE;
+  }
+
+  /* Core tracers */
+  for (i = 0; i < MELO_TRACER_CORE_COUNT; i++) {
+    if (g_strcmp0 (name, melo_tracer_cores[i].name))
+      continue;
+
+    /* Enable once */
+    if (melo_tracer_core_tracers[i])
+      ret = enable;
+    else if (enable)
+      ret = melo_tracer_core_enable (i);
+    else
+      ret = TRUE;
+    break;
+  }
+
+  G_UNLOCK (melo_tracer_mutex);
+
+  return ret;
+}
+
+/**
+ * melo_tracer_is_enabled:
+ * @name: the name of the tracer
+ *
+ * Check if a tracer is enabled.
+ *
+ * Returns: %TRUE if the tracer is enabled, %FALSE otherwise.
+ */
+gboolean
+melo_tracer_is_enabled (const gchar *name)
+{
+  gboolean ret = FALSE;
+  guint i;
+
+  /* Processing time tracer */
+  if (!g_strcmp0 (name, "proctime"))
+    return g_atomic_int_get (&melo_tracer_proc_enabled);
+
+  /* Core tracers */
+  G_LOCK (melo_tracer_mutex);
+  for (i = 0; i < MELO_TRACER_CORE_COUNT; i++)
+    if (!g_strcmp0 (name, melo_tracer_cores[i].name))
+      ret = melo_tracer_core_tracers[i] != NULL;
+  G_UNLOCK (melo_tracer_mutex);
+
+  return ret;
+}
+
+/**
+ * melo_tracer_clear:
+ *
+ * Drop the element processing times recorded by the "proctime" tracer.
+ */
+void
+melo_tracer_clear (void)
+{
+  GHashTable *elements;
+
+  /* Detach element statistics */
+  G_LOCK (melo_tracer_stats_mutex);
+  elements = melo_tracer_elements;
+  melo_tracer_elements = NULL;
+  if (elements)
+    g_hash_table_foreach (elements, melo_tracer_element_remove_ref, NULL);
+  G_UNLOCK (melo_tracer_stats_mutex);
+
+  /* Reset start time */
+  G_LOCK (melo_tracer_mutex);
+  melo_tracer_proc_start = g_get_monotonic_time ();
+  G_UNLOCK (melo_tracer_mutex);
+
+  if (elements)
+    g_hash_table_unref (elements);
+}
+
+/**
+ * melo_tracer_get_stats:
+ *
+ * Get the tracers state and the element processing times recorded by the
+ * "proctime" tracer. The returned object contains:
+ *  - "tracers": an array with the names of the enabled tracers,
+ *  - "elapsed": the recording duration (in us),
+ *  - "elements": an array with an object per element, containing its path in
+ *    "element", the "buffers" and "bytes" received, the buffer "rate" (per
+ *    second), and the "total" and "max" processing times (in us).
+ *
+ * Returns: (transfer full): a new #JsonObject. Use json_object_unref() after
+ * usage.
+ */
+JsonObject *
+melo_tracer_get_stats (void)
+{
+  JsonArray *tracers, *elements;
+  GHashTableIter iter;
+  MeloTracerElement *el;
+  JsonObject *obj;
+  gint64 elapsed;
+  guint i;
+
+  /* Add enabled tracers */
+  tracers = json_array_new ();
+  G_LOCK (melo_tracer_mutex);
+  for (i = 0; i < MELO_TRACER_CORE_COUNT; i++)
+    if (melo_tracer_core_tracers[i])
+      json_array_add_string_element (tracers, melo_tracer_cores[i].name);
+  if (g_atomic_int_get (&melo_tracer_proc_enabled))
+    json_array_add_string_element (tracers, "proctime");
+  elapsed = melo_tracer_proc_start ?
+            g_get_monotonic_time () - melo_tracer_proc_start : 0;
+  G_UNLOCK (melo_tracer_mutex);
+
+  /* Add element statistics */
+  elements = json_array_new ();
+  G_LOCK (melo_tracer_stats_mutex);
+  if (melo_tracer_elements) {
+    g_hash_table_iter_init (&iter, melo_tracer_elements);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &el)) {
+      JsonObject *o = json_object_new ();
+
+      json_object_set_string_member (o, "element", el->name);
+      json_object_set_int_member (o, "buffers", el->buffers);
+      json_object_set_int_member (o, "bytes", el->bytes);
+      json_object_set_double_member (o, "rate", elapsed ?
+                                     el->buffers * 1000000.0 / elapsed : 0.0);
+      json_object_set_int_member (o, "total", GST_TIME_AS_USECONDS (el->total));
+      json_object_set_int_member (o, "max", GST_TIME_AS_USECONDS (el->max));
+      json_array_add_object_element (elements, o);
+    }
+  }
+  G_UNLOCK (melo_tracer_stats_mutex);
+
+  /* Create object */
+  obj = json_object_new ();
+  json_object_set_array_member (obj, "tracers", tracers);
+  json_object_set_int_member (obj, "elapsed", elapsed);
+  json_object_set_array_member (obj, "elements", elements);
+
+  return obj;
+}
@@ -0,0 +1,35 @@
+/*
+ * melo_tracer.h: Runtime GStreamer tracers and element processing times
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef __MELO_TRACER_H__
+#define __MELO_TRACER_H__
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+gboolean melo_tracer_set_enabled (const gchar *name, gboolean enable);
+gboolean melo_tracer_is_enabled (const gchar *name);
+
+void melo_tracer_clear (void);
+JsonObject *melo_tracer_get_stats (void);
+
+#endif /* __MELO_TRACER_H__ */
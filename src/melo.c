@@ -32,8 +32,10 @@
 #include "melo_sink.h"
 #include "melo_event.h"
 #include "melo_plugin.h"
+#include "melo_trace.h"
 #include "melo_config_main.h"
 
+#include "melo_jsonrpc.h"
 #include "melo_event_jsonrpc.h"
 #include "melo_config_jsonrpc.h"
 #include "melo_module_jsonrpc.h"
@@ -71,8 +73,197 @@ melo_sigint_handler (gpointer user_data)
 
   return G_SOURCE_REMOVE;
 }
+
+gboolean
+melo_sigusr1_handler (gpointer user_data)
+{
+  GError *err = NULL;
+  gchar *file;
+
+  /* SIGUSR1 capture: dump trace to file */
+  file = g_build_filename (g_get_tmp_dir (), "melo_trace.json", NULL);
+  if (melo_trace_export_to_file (file, &err))
+    g_message ("trace written to %s", file);
+  else {
+    g_warning ("failed to write trace: %s", err->message);
+    g_clear_error (&err);
+  }
+  g_free (file);
+
+  return G_SOURCE_CONTINUE;
+}
 #endif
 
+typedef struct {
+  MeloContext *context;
+  MeloConfig *config;
+  GThread *audio_thread;
+  gint audio_ready;
+  gchar *cert_file;
+  gchar *key_file;
+  gint64 trace;
+} MeloStartup;
+
+static gboolean
+melo_plugin_activate_idle (gpointer user_data)
+{
+  /* Startup is done: activate remaining plugins */
+  melo_plugin_activate_all ();
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+melo_startup_audio_done (gpointer user_data)
+{
+  MeloStartup *startup = user_data;
+  gint64 trace = melo_trace_begin ();
+
+  /* Main audio sink is ready: accept audio config updates */
+  g_atomic_int_set (&startup->audio_ready, TRUE);
+
+  /* Register plugins: plugins with a manifest are activated on first use or
+   * once the main loop is idle.
+   */
+  melo_plugin_load_all_lazy ();
+  g_idle_add_full (G_PRIORITY_LOW, melo_plugin_activate_idle, NULL, NULL);
+  melo_trace_end ("startup", "plugins", trace);
+
+  /* End of startup */
+  melo_trace_end ("startup", "complete", startup->trace);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gpointer
+melo_startup_audio_func (gpointer user_data)
+{
+  MeloStartup *startup = user_data;
+  MeloConfig *config = startup->config;
+  gboolean passthrough;
+  gchar *latency;
+  gchar *multiroom;
+  gint64 trace;
+  gint64 val;
+
+  /* Initialize main audio sink */
+  trace = melo_trace_begin ();
+  melo_sink_main_init (startup->context->audio.rate,
+                       startup->context->audio.channels);
+  if (melo_config_get_string (config, "audio", "latency", &latency)) {
+    melo_sink_set_main_latency (melo_sink_latency_from_string (latency));
+    g_free (latency);
+  }
+  if (melo_config_get_boolean (config, "audio", "passthrough", &passthrough))
+    melo_sink_set_main_passthrough (passthrough);
+  if (melo_config_get_string (config, "audio", "multiroom", &multiroom)) {
+    if (!melo_config_get_integer (config, "audio", "multiroom_latency", &val))
+      val = 300;
+    melo_sink_set_main_multiroom (melo_sink_multiroom_from_string (multiroom),
+                                  val);
+    g_free (multiroom);
+  }
+  melo_trace_end ("startup", "audio", trace);
+
+  /* Register built-in modules: they depend on main audio sink */
+  trace = melo_trace_begin ();
+#if HAVE_MELO_MODULE_FILE
+  melo_module_register (MELO_TYPE_FILE, "file");
+#endif
+#if HAVE_MELO_MODULE_RADIO
+  melo_module_register (MELO_TYPE_RADIO, "radio");
+#endif
+#if HAVE_MELO_MODULE_UPNP
+  melo_module_register (MELO_TYPE_UPNP, "upnp");
+#endif
+  melo_trace_end ("startup", "modules", trace);
+
+  /* Finish audio stage in main loop */
+  g_idle_add (melo_startup_audio_done, startup);
+
+  return NULL;
+}
+
+static void
+melo_startup_https_ready (MeloStartup *startup, gboolean ready)
+{
+  MeloContext *context = startup->context;
+  gboolean reg;
+
+  /* Set certificate and start listening for HTTPS */
+  if (ready &&
+      melo_httpd_set_certificate (context->server, startup->cert_file,
+                                  startup->key_file) &&
+      melo_httpd_start_https (context->server, context->sport))
+    return;
+
+  /* HTTPS is not available: update registered device */
+  context->sport = 0;
+  if (melo_config_get_boolean (startup->config, "general", "register", &reg) &&
+      reg)
+    melo_discover_register_device (context->disco, context->name,
+                                   context->port, context->sport);
+}
+
+static void
+melo_startup_certificate_done (GPid pid, gint status, gpointer user_data)
+{
+  MeloStartup *startup = user_data;
+  GError *err = NULL;
+  gboolean ready;
+
+  /* Close process */
+  g_spawn_close_pid (pid);
+
+  /* Check certificate generation status */
+  ready = g_spawn_check_exit_status (status, &err);
+  if (!ready) {
+    g_warning ("failed to create certificate: %s: disable HTTPS support",
+               err->message);
+    g_clear_error (&err);
+  }
+
+  /* Enable HTTPS */
+  melo_startup_https_ready (startup, ready);
+}
+
+static gboolean
+melo_startup_certificate (MeloStartup *startup, gboolean wait)
+{
+  gchar *cmd_argv[] = {
+    "openssl", "req", "-newkey", "ec", "-pkeyopt",
+    "ec_paramgen_curve:prime256v1", "-nodes", "-sha256", "-x509",
+    "-subj", "/C=US/ST=California/L=San-Francisco/O=Sparod/CN=melo",
+    "-days", "3650", "-out", startup->cert_file, "-keyout", startup->key_file,
+    NULL
+  };
+  GSpawnFlags flags = G_SPAWN_SEARCH_PATH | G_SPAWN_STDOUT_TO_DEV_NULL |
+                      G_SPAWN_STDERR_TO_DEV_NULL;
+  gint status = 0;
+  GPid pid;
+
+  /* Generate default SSL certificate and wait for it */
+  if (wait) {
+    if (!g_spawn_sync (NULL, cmd_argv, NULL, flags, NULL, NULL, NULL, NULL,
+                       &status, NULL) || status) {
+      g_warning ("failed to create certificate (%d): disable HTTPS support",
+                 status);
+      return FALSE;
+    }
+    return TRUE;
+  }
+
+  /* Generate default SSL certificate in background */
+  if (!g_spawn_async (NULL, cmd_argv, NULL, flags | G_SPAWN_DO_NOT_REAP_CHILD,
+                      NULL, NULL, &pid, NULL)) {
+    g_warning ("failed to create certificate: disable HTTPS support");
+    return FALSE;
+  }
+  g_child_watch_add (pid, melo_startup_certificate_done, startup);
+
+  return TRUE;
+}
+
 static gboolean
 melo_event_callback (MeloEventClient *client, MeloEventType type, guint event,
                      const gchar *id, gpointer data, gpointer user_data)
@@ -113,11 +304,14 @@ main (int argc, char *argv[])
   gboolean verbose = FALSE;
   gboolean daemonize = FALSE;
   gboolean event_debug = FALSE;
+  gboolean trace = FALSE;
   GOptionEntry options[] = {
     {"event-debug", 'e', 0, G_OPTION_ARG_NONE, &event_debug,
                                                     "Enable event debug", NULL},
     {"daemon", 'd', 0, G_OPTION_ARG_NONE, &daemonize, "Run as daemon", NULL},
     {"verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose, "Be verbose", NULL},
+    {"trace", 't', 0, G_OPTION_ARG_NONE, &trace,
+                          "Enable tracing (dump to file on SIGUSR1)", NULL},
     {NULL}
   };
   GOptionContext *ctx;
@@ -130,7 +324,11 @@ main (int argc, char *argv[])
   MeloConfig *config;
   /* Melo context */
   MeloContext context;
+  MeloStartup startup;
+  gboolean https_ready;
   gboolean reg;
+  gint64 stage;
+  gint64 val;
   /* Melo event client */
   MeloEventClient *event_client = NULL;
   /* Main loop */
@@ -156,11 +354,17 @@ main (int argc, char *argv[])
   /* Free option context */
   g_option_context_free (ctx);
 
+  /* Enable tracing: startup is traced from here */
+  if (trace || g_getenv ("MELO_TRACE"))
+    melo_trace_set_enabled (TRUE);
+  startup.trace = melo_trace_begin ();
+
   /* Daemonize */
   if (daemonize && daemon (1, 0))
       return -1;
 
   /* Load configuration */
+  stage = melo_trace_begin ();
   config = melo_config_main_new ();
   if (!melo_config_load_from_def_file (config)) {
     melo_config_load_default (config);
@@ -169,12 +373,18 @@ main (int argc, char *argv[])
 
   /* Save automatically configuration to file */
   melo_config_save_to_def_file_at_update (config, TRUE);
+  melo_trace_end ("startup", "config", stage);
 
   /* Get name */
   if (!melo_config_get_string (config, "general", "name", &context.name) ||
       !context.name)
     context.name = g_strdup ("Melo");
 
+  /* Set cover cache size */
+  if (melo_config_get_integer (config, "general", "cover_cache_size", &val) &&
+      val >= 0)
+    melo_tags_set_cover_cache_size (val * 1024);
+
   /* Get audio parameters */
   if (!melo_config_get_integer (config, "audio", "samplerate",
                                 &context.audio.rate))
@@ -189,9 +399,6 @@ main (int argc, char *argv[])
   if (!melo_config_get_integer (config, "http", "sport", &context.sport))
     context.sport = 8443;
 
-  /* Initialize main audio sink */
-  melo_sink_main_init (context.audio.rate, context.audio.channels);
-
   /* Add discoverer */
   context.disco = melo_discover_new ();
   if (melo_config_get_boolean (config, "general", "register",&reg) && reg)
@@ -203,74 +410,86 @@ main (int argc, char *argv[])
     event_client = melo_event_register (melo_event_callback, NULL);
 
   /* Register standard JSON-RPC methods */
+  stage = melo_trace_begin ();
+  melo_jsonrpc_register_system_methods ();
   melo_config_jsonrpc_register_methods ();
   melo_sink_jsonrpc_register_methods ();
   melo_module_jsonrpc_register_methods ();
   melo_browser_jsonrpc_register_methods ();
   melo_player_jsonrpc_register_methods ();
   melo_playlist_jsonrpc_register_methods ();
+  melo_event_jsonrpc_register_methods ();
 
 #if HAVE_LIBNM_GLIB
   /* Add network controler and register its JSON-RPC methods */
   net = melo_network_new ();
   melo_network_jsonrpc_register_methods (net);
 #endif
+  melo_trace_end ("startup", "jsonrpc", stage);
+
+  /* Set threads scheduling before any audio or background thread starts */
+  melo_config_main_load_threads (config);
+  melo_config_set_check_callback (config, "threads",
+                                  melo_config_main_check_threads, NULL);
+  melo_config_set_update_callback (config, "threads",
+                                   melo_config_main_update_threads, NULL);
+
+  /* Add config handler for audio before the HTTP server is started: updates
+   * are refused until the main audio sink is initialized.
+   */
+  startup.audio_ready = FALSE;
+  melo_config_set_check_callback (config, "audio",
+                                  melo_config_main_check_audio,
+                                  &startup.audio_ready);
+  melo_config_set_update_callback (config, "audio",
+                                   melo_config_main_update_audio, NULL);
 
-  /* Register built-in modules */
-#if HAVE_MELO_MODULE_FILE
-  melo_module_register (MELO_TYPE_FILE, "file");
-#endif
-#if HAVE_MELO_MODULE_RADIO
-  melo_module_register (MELO_TYPE_RADIO, "radio");
-#endif
-#if HAVE_MELO_MODULE_UPNP
-  melo_module_register (MELO_TYPE_UPNP, "upnp");
-#endif
-
-  /* Load plugins */
-  melo_plugin_load_all (TRUE);
+  /* Start audio stage: main audio sink and modules are initialized in
+   * background while the HTTP server is started.
+   */
+  startup.context = &context;
+  startup.config = config;
+  startup.audio_thread = g_thread_new ("melo_startup", melo_startup_audio_func,
+                                       &startup);
 
-  /* Create and start HTTP server */
+  /* Create HTTP server */
+  stage = melo_trace_begin ();
   context.server = melo_httpd_new ();
 
-  /* Load and set HTTPs certificate */
+  /* Generate certificate and key path */
+  startup.cert_file = g_strdup_printf ("%s/melo/default.crt",
+                                       g_get_user_config_dir ());
+  startup.key_file = g_strdup_printf ("%s/melo/default.key",
+                                      g_get_user_config_dir ());
+
+  /* Load HTTPs certificate or generate it: HTTPS is enabled in background when
+   * the certificate is ready, unless HTTP is disabled.
+   */
+  https_ready = FALSE;
   if (context.sport) {
-    gchar *cert_file, *key_file;
-
-    /* Generate certificate and key path */
-    cert_file = g_strdup_printf ("%s/melo/default.crt", g_get_user_config_dir ());
-    key_file = g_strdup_printf ("%s/melo/default.key", g_get_user_config_dir ());
-
-    /* Generate files if not present */
-    if (!g_file_test (cert_file, G_FILE_TEST_EXISTS) ||
-        !g_file_test (key_file, G_FILE_TEST_EXISTS)) {
-      gchar *cmd_argv[] = {
-        "openssl", "req", "-newkey", "rsa:4096", "-nodes", "-sha512", "-x509",
-        "-subj", "/C=US/ST=California/L=San-Francisco/O=Sparod/CN=melo",
-        "-days", "3650", "-nodes",  "-out", cert_file, "-keyout", key_file, NULL
-      };
-      gint status = 0;
-
-      /* Generate default SSL certificate */
-      if (!g_spawn_sync (NULL, cmd_argv, NULL, G_SPAWN_SEARCH_PATH |
-                    G_SPAWN_STDOUT_TO_DEV_NULL | G_SPAWN_STDERR_TO_DEV_NULL,
-                    NULL, NULL, NULL, NULL, &status, NULL) || status) {
-        g_warning ("failed to create certificate (%d): disable HTTPS support",
-                   status);
-      }
-    }
+    if (g_file_test (startup.cert_file, G_FILE_TEST_EXISTS) &&
+        g_file_test (startup.key_file, G_FILE_TEST_EXISTS))
+      https_ready = TRUE;
+    else if (!context.port)
+      https_ready = melo_startup_certificate (&startup, TRUE);
+    else if (!melo_startup_certificate (&startup, FALSE))
+      context.sport = 0;
 
     /* Set certificate */
-    if (!melo_httpd_set_certificate (context.server, cert_file, key_file))
+    if (https_ready &&
+        !melo_httpd_set_certificate (context.server, startup.cert_file,
+                                     startup.key_file))
+      https_ready = FALSE;
+    if (!https_ready && !context.port)
       context.sport = 0;
-    g_free (cert_file);
-    g_free (key_file);
   }
 
   /* Start HTTP server */
-  if (!melo_httpd_start (context.server, context.port, context.sport,
-                         context.name))
+  if (!melo_httpd_start (context.server, context.port,
+                         https_ready ? context.sport : 0, context.name))
     goto end;
+  melo_trace_end ("startup", "http", stage);
+  melo_trace_end ("startup", "ready", startup.trace);
 
   /* Load HTTP server configuration */
   melo_config_main_load_http (config, context.server);
@@ -281,12 +500,6 @@ main (int argc, char *argv[])
   melo_config_set_update_callback (config, "general",
                                   melo_config_main_update_general, &context);
 
-  /* Add config handler for audio */
-  melo_config_set_check_callback (config, "audio", melo_config_main_check_audio,
-                                  NULL);
-  melo_config_set_update_callback (config, "audio",
-                                   melo_config_main_update_audio, NULL);
-
   /* Add config handler for HTTP server */
   melo_config_set_check_callback (config, "http", melo_config_main_check_http,
                                   context.server);
@@ -299,6 +512,9 @@ main (int argc, char *argv[])
 #ifdef G_OS_UNIX
   /* Install a signal handler on SIGINT */
   g_unix_signal_add (SIGINT, melo_sigint_handler, loop);
+
+  /* Install a signal handler on SIGUSR1 to dump trace */
+  g_unix_signal_add (SIGUSR1, melo_sigusr1_handler, NULL);
 #endif
 
   /* Run main loop */
@@ -312,6 +528,11 @@ end:
   melo_httpd_stop (context.server);
   g_object_unref (context.server);
 
+  /* Wait end of audio stage */
+  g_thread_join (startup.audio_thread);
+  g_free (startup.cert_file);
+  g_free (startup.key_file);
+
   /* Unload plugins */
   melo_plugin_unload_all ();
 
@@ -333,12 +554,14 @@ end:
 #endif
 
   /* Unregister standard JSON-RPC methods */
+  melo_event_jsonrpc_unregister_methods ();
   melo_playlist_jsonrpc_unregister_methods ();
   melo_player_jsonrpc_unregister_methods ();
   melo_browser_jsonrpc_unregister_methods ();
   melo_module_jsonrpc_unregister_methods ();
   melo_sink_jsonrpc_unregister_methods ();
   melo_config_jsonrpc_unregister_methods ();
+  melo_jsonrpc_unregister_system_methods ();
 
   /* Unregister event client */
   if (event_client)
@@ -350,6 +573,9 @@ end:
   /* Free main audio sink */
   melo_sink_main_release ();
 
+  /* Write pending configuration files */
+  melo_config_flush_deferred ();
+
   /* Save configuration */
   melo_config_save_to_def_file (config);
 
@@ -21,6 +21,8 @@
 
 #include "melo.h"
 #include "melo_sink.h"
+#include "melo_tags.h"
+#include "melo_sched.h"
 #include "melo_config_main.h"
 
 static MeloConfigItem melo_config_general[] = {
@@ -38,6 +40,13 @@ static MeloConfigItem melo_config_general[] = {
     .element = MELO_CONFIG_ELEMENT_CHECKBOX,
     .def._boolean = TRUE,
   },
+  {
+    .id = "cover_cache_size",
+    .name = "Cover cache size in memory (KiB)",
+    .type = MELO_CONFIG_TYPE_INTEGER,
+    .element = MELO_CONFIG_ELEMENT_NUMBER,
+    .def._integer = 8192,
+  },
 };
 
 static MeloConfigItem melo_config_audio[] = {
@@ -55,6 +64,87 @@ static MeloConfigItem melo_config_audio[] = {
     .element = MELO_CONFIG_ELEMENT_NUMBER,
     .def._integer = 44100,
   },
+  {
+    .id = "latency",
+    .name = "Latency (default, low or power_save)",
+    .type = MELO_CONFIG_TYPE_STRING,
+    .element = MELO_CONFIG_ELEMENT_TEXT,
+    .def._string = "default",
+  },
+  {
+    .id = "passthrough",
+    .name = "Use stream format when supported (bit-perfect)",
+    .type = MELO_CONFIG_TYPE_BOOLEAN,
+    .element = MELO_CONFIG_ELEMENT_CHECKBOX,
+    .def._boolean = FALSE,
+  },
+  {
+    .id = "multiroom",
+    .name = "Multi-room (none, master or receiver)",
+    .type = MELO_CONFIG_TYPE_STRING,
+    .element = MELO_CONFIG_ELEMENT_TEXT,
+    .def._string = "none",
+  },
+  {
+    .id = "multiroom_latency",
+    .name = "Multi-room latency (ms)",
+    .type = MELO_CONFIG_TYPE_INTEGER,
+    .element = MELO_CONFIG_ELEMENT_NUMBER,
+    .def._integer = 300,
+  },
+};
+
+static MeloConfigItem melo_config_threads[] = {
+  {
+    .id = NULL,
+    .name = "Audio threads",
+  },
+  {
+    .id = "audio_policy",
+    .name = "Scheduling (normal, nice, fifo or rr)",
+    .type = MELO_CONFIG_TYPE_STRING,
+    .element = MELO_CONFIG_ELEMENT_TEXT,
+    .def._string = "normal",
+  },
+  {
+    .id = "audio_priority",
+    .name = "Real-time priority for fifo and rr (1 to 99)",
+    .type = MELO_CONFIG_TYPE_INTEGER,
+    .element = MELO_CONFIG_ELEMENT_NUMBER,
+    .def._integer = 20,
+  },
+  {
+    .id = "audio_nice",
+    .name = "Nice level for nice (-20 to 19)",
+    .type = MELO_CONFIG_TYPE_INTEGER,
+    .element = MELO_CONFIG_ELEMENT_NUMBER,
+    .def._integer = -10,
+  },
+  {
+    .id = "audio_cpus",
+    .name = "CPUs (as 1 or 2-3, empty for all)",
+    .type = MELO_CONFIG_TYPE_STRING,
+    .element = MELO_CONFIG_ELEMENT_TEXT,
+    .def._string = "",
+  },
+  {
+    .id = NULL,
+    .name = "Background threads",
+  },
+  {
+    .id = "background_idle",
+    .name = "Run library scan at idle priority",
+    .type = MELO_CONFIG_TYPE_BOOLEAN,
+    .element = MELO_CONFIG_ELEMENT_CHECKBOX,
+    .def._boolean = TRUE,
+  },
+  {
+    .id = "background_cpus",
+    .name = "CPUs (as 0 or 0-1, empty for all)",
+    .type = MELO_CONFIG_TYPE_STRING,
+    .element = MELO_CONFIG_ELEMENT_TEXT,
+    .def._string = "",
+  },
 };
 
 static MeloConfigItem melo_config_http[] = {
@@ -77,6 +167,84 @@ static MeloConfigItem melo_config_http[] = {
     .element = MELO_CONFIG_ELEMENT_NUMBER,
     .def._integer = 0,
   },
+  {
+    .id = NULL,
+    .name = "Connections",
+  },
+  {
+    .id = "idle_timeout",
+    .name = "Idle timeout (s)",
+    .type = MELO_CONFIG_TYPE_INTEGER,
+    .element = MELO_CONFIG_ELEMENT_NUMBER,
+    .def._integer = 60,
+  },
+  {
+    .id = "keep_alive_timeout",
+    .name = "Keep-alive timeout (s)",
+    .type = MELO_CONFIG_TYPE_INTEGER,
+    .element = MELO_CONFIG_ELEMENT_NUMBER,
+    .def._integer = 30,
+  },
+  {
+    .id = "compression",
+    .name = "Compress responses",
+    .type = MELO_CONFIG_TYPE_BOOLEAN,
+    .element = MELO_CONFIG_ELEMENT_CHECKBOX,
+    .def._boolean = TRUE,
+  },
+  {
+    .id = "compression_min_size",
+    .name = "Minimum size to compress (bytes)",
+    .type = MELO_CONFIG_TYPE_INTEGER,
+    .element = MELO_CONFIG_ELEMENT_NUMBER,
+    .def._integer = 1024,
+  },
+  {
+    .id = NULL,
+    .name = "Thread pools",
+  },
+  {
+    .id = "threads",
+    .name = "Threads for requests",
+    .type = MELO_CONFIG_TYPE_INTEGER,
+    .element = MELO_CONFIG_ELEMENT_NUMBER,
+    .def._integer = 10,
+  },
+  {
+    .id = "control_threads",
+    .name = "Threads for control requests",
+    .type = MELO_CONFIG_TYPE_INTEGER,
+    .element = MELO_CONFIG_ELEMENT_NUMBER,
+    .def._integer = 4,
+  },
+  {
+    .id = "bulk_threads",
+    .name = "Threads for browse requests",
+    .type = MELO_CONFIG_TYPE_INTEGER,
+    .element = MELO_CONFIG_ELEMENT_NUMBER,
+    .def._integer = 4,
+  },
+  {
+    .id = "cover_threads",
+    .name = "Threads for covers",
+    .type = MELO_CONFIG_TYPE_INTEGER,
+    .element = MELO_CONFIG_ELEMENT_NUMBER,
+    .def._integer = 10,
+  },
+  {
+    .id = "adaptive_threads",
+    .name = "Adapt thread count to load",
+    .type = MELO_CONFIG_TYPE_BOOLEAN,
+    .element = MELO_CONFIG_ELEMENT_CHECKBOX,
+    .def._boolean = FALSE,
+  },
+  {
+    .id = "queue_limit",
+    .name = "Maximum waiting requests (0 = no limit)",
+    .type = MELO_CONFIG_TYPE_INTEGER,
+    .element = MELO_CONFIG_ELEMENT_NUMBER,
+    .def._integer = 64,
+  },
   {
     .id = NULL,
     .name = "Authentication",
@@ -129,6 +297,12 @@ static MeloConfigGroup melo_config_main[] = {
     .items = melo_config_audio,
     .items_count = G_N_ELEMENTS (melo_config_audio),
   },
+  {
+    .id = "threads",
+    .name = "Threads",
+    .items = melo_config_threads,
+    .items_count = G_N_ELEMENTS (melo_config_threads),
+  },
   {
     .id = "http",
     .name = "HTTP Server",
@@ -158,6 +332,7 @@ melo_config_main_update_general (MeloConfigContext *context, gpointer user_data)
   MeloContext *ctx = (MeloContext *) user_data;
   const gchar *old, *new;
   gboolean bold, bnew;
+  gint64 val;
 
   /* Update name */
   if (melo_config_get_updated_string (context, "name", &new, &old) &&
@@ -175,6 +350,11 @@ melo_config_main_update_general (MeloConfigContext *context, gpointer user_data)
     else if (bold)
       melo_discover_unregister_device (ctx->disco);
   }
+
+  /* Update cover cache size */
+  if (melo_config_get_updated_integer (context, "cover_cache_size", &val,
+                                       NULL) && val >= 0)
+    melo_tags_set_cover_cache_size (val * 1024);
 }
 
 /* Audio section */
@@ -182,8 +362,15 @@ gboolean
 melo_config_main_check_audio (MeloConfigContext *context, gpointer user_data,
                               gchar **error)
 {
+  const gchar *latency;
   gint64 value;
 
+  /* Main audio sink is not initialized yet */
+  if (user_data && !g_atomic_int_get ((gint *) user_data)) {
+    *error = g_strdup ("Audio is not ready yet, please retry later!");
+    return FALSE;
+  }
+
   /* Check channels */
   if (melo_config_get_updated_integer (context, "channels", &value, NULL) &&
       (value < 1 || value > 8)) {
@@ -198,18 +385,173 @@ melo_config_main_check_audio (MeloConfigContext *context, gpointer user_data,
     return FALSE;
   }
 
+  /* Check latency profile */
+  if (melo_config_get_updated_string (context, "latency", &latency, NULL) &&
+      g_strcmp0 (latency, "default") &&
+      melo_sink_latency_from_string (latency) == MELO_SINK_LATENCY_DEFAULT) {
+    *error = g_strdup ("Only default, low and power_save latencies are "
+                       "supported!");
+    return FALSE;
+  }
+
+  /* Check multi-room mode */
+  if (melo_config_get_updated_string (context, "multiroom", &latency, NULL) &&
+      g_strcmp0 (latency, "none") &&
+      melo_sink_multiroom_from_string (latency) == MELO_SINK_MULTIROOM_NONE) {
+    *error = g_strdup ("Only none, master and receiver multi-room modes are "
+                       "supported!");
+    return FALSE;
+  }
+
+  /* Check multi-room latency */
+  if (melo_config_get_updated_integer (context, "multiroom_latency", &value,
+                                       NULL) && (value < 20 || value > 5000)) {
+    *error = g_strdup ("Only multi-room latency from 20ms to 5s is "
+                       "supported!");
+    return FALSE;
+  }
+
   return TRUE;
 }
 
 void
 melo_config_main_update_audio (MeloConfigContext *context, gpointer user_data)
 {
-  gint64 rate, channels;
+  const gchar *latency, *old, *mode;
+  gint64 rate, channels, latency_ms;
+  gboolean en;
 
-  /* Get values */
-  if (melo_config_get_updated_integer (context, "samplerate", &rate, NULL) &&
-      melo_config_get_updated_integer (context, "channels", &channels, NULL))
+  /* Reconfigure audio once when sample rate and / or channels are updated */
+  en = melo_config_get_updated_integer (context, "samplerate", &rate, NULL);
+  en |= melo_config_get_updated_integer (context, "channels", &channels, NULL);
+  if (en && melo_config_get_new_integer (context, "samplerate", &rate) &&
+      melo_config_get_new_integer (context, "channels", &channels))
     melo_sink_set_main_config (rate, channels);
+
+  /* Set latency profile */
+  if (melo_config_get_updated_string (context, "latency", &latency, &old) &&
+      g_strcmp0 (latency, old))
+    melo_sink_set_main_latency (melo_sink_latency_from_string (latency));
+
+  /* Set passthrough mode */
+  if (melo_config_get_updated_boolean (context, "passthrough", &en, NULL))
+    melo_sink_set_main_passthrough (en);
+
+  /* Set multi-room mode */
+  mode = melo_sink_multiroom_to_string (melo_sink_get_main_multiroom ());
+  latency_ms = melo_sink_get_main_multiroom_latency ();
+  en = melo_config_get_updated_string (context, "multiroom", &mode, NULL);
+  en |= melo_config_get_updated_integer (context, "multiroom_latency",
+                                         &latency_ms, NULL);
+  if (en)
+    melo_sink_set_main_multiroom (melo_sink_multiroom_from_string (mode),
+                                  latency_ms);
+}
+
+/* Threads section */
+void
+melo_config_main_load_threads (MeloConfig *config)
+{
+  gint64 priority = 20, nice = -10;
+  gchar *policy = NULL;
+  gchar *cpus = NULL;
+  guint64 mask;
+  gboolean en;
+
+  /* Set audio threads scheduling */
+  melo_config_get_integer (config, "threads", "audio_priority", &priority);
+  melo_config_get_integer (config, "threads", "audio_nice", &nice);
+  if (melo_config_get_string (config, "threads", "audio_policy", &policy))
+    melo_sched_set_audio_policy (melo_sched_policy_from_string (policy),
+                                 priority, nice);
+  if (melo_config_get_string (config, "threads", "audio_cpus", &cpus) &&
+      melo_sched_cpus_from_string (cpus, &mask))
+    melo_sched_set_audio_cpus (mask);
+  g_free (policy);
+  g_free (cpus);
+  cpus = NULL;
+
+  /* Set background threads scheduling */
+  if (melo_config_get_boolean (config, "threads", "background_idle", &en))
+    melo_sched_set_background_idle (en);
+  if (melo_config_get_string (config, "threads", "background_cpus", &cpus) &&
+      melo_sched_cpus_from_string (cpus, &mask))
+    melo_sched_set_background_cpus (mask);
+  g_free (cpus);
+}
+
+gboolean
+melo_config_main_check_threads (MeloConfigContext *context,
+                                gpointer user_data, gchar **error)
+{
+  const gchar *str;
+  guint64 mask;
+  gint64 value;
+
+  /* Check scheduling policy */
+  if (melo_config_get_updated_string (context, "audio_policy", &str, NULL) &&
+      g_strcmp0 (str, "normal") &&
+      melo_sched_policy_from_string (str) == MELO_SCHED_POLICY_NORMAL) {
+    *error = g_strdup ("Only normal, nice, fifo and rr scheduling are "
+                       "supported!");
+    return FALSE;
+  }
+
+  /* Check priority and nice level */
+  if (melo_config_get_updated_integer (context, "audio_priority", &value,
+                                       NULL) && (value < 1 || value > 99)) {
+    *error = g_strdup ("Only real-time priority from 1 to 99 is supported!");
+    return FALSE;
+  }
+  if (melo_config_get_updated_integer (context, "audio_nice", &value, NULL) &&
+      (value < -20 || value > 19)) {
+    *error = g_strdup ("Only nice level from -20 to 19 is supported!");
+    return FALSE;
+  }
+
+  /* Check CPU lists */
+  if ((melo_config_get_updated_string (context, "audio_cpus", &str, NULL) &&
+       !melo_sched_cpus_from_string (str, &mask)) ||
+      (melo_config_get_updated_string (context, "background_cpus", &str,
+                                       NULL) &&
+       !melo_sched_cpus_from_string (str, &mask))) {
+    *error = g_strdup ("CPUs must be a list of numbers or ranges, as 0,2-3!");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+void
+melo_config_main_update_threads (MeloConfigContext *context,
+                                 gpointer user_data)
+{
+  gint64 priority, nice;
+  const gchar *str;
+  guint64 mask;
+  gboolean en;
+
+  /* Update audio threads scheduling once */
+  en = melo_config_get_updated_string (context, "audio_policy", &str, NULL);
+  en |= melo_config_get_updated_integer (context, "audio_priority", &priority,
+                                         NULL);
+  en |= melo_config_get_updated_integer (context, "audio_nice", &nice, NULL);
+  if (en && melo_config_get_new_string (context, "audio_policy", &str) &&
+      melo_config_get_new_integer (context, "audio_priority", &priority) &&
+      melo_config_get_new_integer (context, "audio_nice", &nice))
+    melo_sched_set_audio_policy (melo_sched_policy_from_string (str),
+                                 priority, nice);
+  if (melo_config_get_updated_string (context, "audio_cpus", &str, NULL) &&
+      melo_sched_cpus_from_string (str, &mask))
+    melo_sched_set_audio_cpus (mask);
+
+  /* Update background threads scheduling */
+  if (melo_config_get_updated_boolean (context, "background_idle", &en, NULL))
+    melo_sched_set_background_idle (en);
+  if (melo_config_get_updated_string (context, "background_cpus", &str,
+                                      NULL) &&
+      melo_sched_cpus_from_string (str, &mask))
+    melo_sched_set_background_cpus (mask);
 }
 
 /* HTTP server section */
@@ -219,6 +561,42 @@ melo_config_main_load_http (MeloConfig *config, MeloHTTPD *server)
   gchar *user = NULL;
   gchar *pass = NULL;
   gboolean en;
+  gint64 val;
+
+  /* Set connection timeouts */
+  if (melo_config_get_integer (config, "http", "idle_timeout", &val) &&
+      val >= 0)
+    melo_httpd_set_idle_timeout (server, val);
+  if (melo_config_get_integer (config, "http", "keep_alive_timeout", &val) &&
+      val >= 0)
+    melo_httpd_set_keep_alive_timeout (server, val);
+
+  /* Set compression */
+  if (melo_config_get_boolean (config, "http", "compression", &en))
+    melo_httpd_set_compression (server, en);
+  if (melo_config_get_integer (config, "http", "compression_min_size", &val) &&
+      val >= 0)
+    melo_httpd_set_compression_min_size (server, val);
+
+  /* Set thread pool sizes */
+  if (melo_config_get_integer (config, "http", "threads", &val) && val > 0)
+    melo_httpd_set_threads (server, val);
+  if (melo_config_get_integer (config, "http", "control_threads", &val) &&
+      val > 0)
+    melo_httpd_set_control_threads (server, val);
+  if (melo_config_get_integer (config, "http", "bulk_threads", &val) &&
+      val > 0)
+    melo_httpd_set_bulk_threads (server, val);
+  if (melo_config_get_integer (config, "http", "cover_threads", &val) &&
+      val > 0)
+    melo_httpd_set_cover_threads (server, val);
+
+  /* Set thread pool load handling */
+  if (melo_config_get_boolean (config, "http", "adaptive_threads", &en))
+    melo_httpd_set_adaptive_threads (server, en);
+  if (melo_config_get_integer (config, "http", "queue_limit", &val) &&
+      val >= 0)
+    melo_httpd_set_queue_limit (server, val);
 
   /* Enable authentication */
   if (melo_config_get_boolean (config, "http", "auth_enable", &en)) {
@@ -291,6 +669,43 @@ melo_config_main_update_http (MeloConfigContext *context, gpointer user_data)
   MeloHTTPD *server = user_data;
   const gchar *new, *old;
   gboolean en;
+  gint64 val;
+
+  /* Update connection timeouts */
+  if (melo_config_get_updated_integer (context, "idle_timeout", &val, NULL) &&
+      val >= 0)
+    melo_httpd_set_idle_timeout (server, val);
+  if (melo_config_get_updated_integer (context, "keep_alive_timeout", &val,
+                                       NULL) && val >= 0)
+    melo_httpd_set_keep_alive_timeout (server, val);
+
+  /* Update compression */
+  if (melo_config_get_updated_boolean (context, "compression", &en, NULL))
+    melo_httpd_set_compression (server, en);
+  if (melo_config_get_updated_integer (context, "compression_min_size", &val,
+                                       NULL) && val >= 0)
+    melo_httpd_set_compression_min_size (server, val);
+
+  /* Update thread pool sizes */
+  if (melo_config_get_updated_integer (context, "threads", &val, NULL) &&
+      val > 0)
+    melo_httpd_set_threads (server, val);
+  if (melo_config_get_updated_integer (context, "control_threads", &val,
+                                       NULL) && val > 0)
+    melo_httpd_set_control_threads (server, val);
+  if (melo_config_get_updated_integer (context, "bulk_threads", &val, NULL) &&
+      val > 0)
+    melo_httpd_set_bulk_threads (server, val);
+  if (melo_config_get_updated_integer (context, "cover_threads", &val, NULL) &&
+      val > 0)
+    melo_httpd_set_cover_threads (server, val);
+
+  /* Update thread pool load handling */
+  if (melo_config_get_updated_boolean (context, "adaptive_threads", &en, NULL))
+    melo_httpd_set_adaptive_threads (server, en);
+  if (melo_config_get_updated_integer (context, "queue_limit", &val, NULL) &&
+      val >= 0)
+    melo_httpd_set_queue_limit (server, val);
 
   /* Enable / Disable authentication */
   if (melo_config_get_updated_boolean (context, "auth_enable", &en, NULL)) {
@@ -39,6 +39,13 @@ gboolean melo_config_main_check_audio (MeloConfigContext *context,
 void melo_config_main_update_audio (MeloConfigContext *context,
                                     gpointer user_data);
 
+/* Threads section */
+void melo_config_main_load_threads (MeloConfig *config);
+gboolean melo_config_main_check_threads (MeloConfigContext *context,
+                                         gpointer user_data, gchar **error);
+void melo_config_main_update_threads (MeloConfigContext *context,
+                                      gpointer user_data);
+
 /* HTTP server section */
 void melo_config_main_load_http (MeloConfig *config, MeloHTTPD *server);
 gboolean melo_config_main_check_http (MeloConfigContext *context,
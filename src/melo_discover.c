@@ -35,6 +35,9 @@
 #define MELO_DISCOVER_BUFFER_SIZE 4096
 #define MELO_DISCOVER_URL "http://www.sparod.com/melo/discover.php"
 
+/* Delay to coalesce interface changes (in ms) */
+#define MELO_DISCOVER_DELAY 1500
+
 struct _MeloDiscoverPrivate {
   GMutex mutex;
   gboolean register_device;
@@ -42,6 +45,7 @@ struct _MeloDiscoverPrivate {
   SoupSession *session;
   guint netlink_id;
   int netlink_fd;
+  guint update_id;
   gchar *serial;
   gchar *name;
   guint port;
@@ -53,6 +57,9 @@ typedef struct {
   gchar *name;
   gchar *hw_address;
   gchar *address;
+  /* Last address sent */
+  gchar *reg_address;
+  gint synced;
 } MeloDiscoverInterface;
 
 static void melo_discover_interface_free (MeloDiscoverInterface *iface);
@@ -73,6 +80,10 @@ melo_discover_finalize (GObject *gobject)
   if (priv->netlink_id)
     g_source_remove (priv->netlink_id);
 
+  /* Remove pending update */
+  if (priv->update_id)
+    g_source_remove (priv->update_id);
+
   /* Close netlink socket */
   if (priv->netlink_fd > 0)
     close (priv->netlink_fd);
@@ -213,9 +224,21 @@ melo_discover_interface_free (MeloDiscoverInterface *iface)
   g_free (iface->name);
   g_free (iface->hw_address);
   g_free (iface->address);
+  g_free (iface->reg_address);
   g_slice_free (MeloDiscoverInterface, iface);
 }
 
+static void
+melo_discover_address_callback (SoupSession *session, SoupMessage *msg,
+                                gpointer user_data)
+{
+  MeloDiscoverInterface *iface = user_data;
+
+  /* Failed to send message: send address again on next update */
+  if (msg->status_code != SOUP_STATUS_OK)
+    g_atomic_int_set (&iface->synced, FALSE);
+}
+
 static gboolean
 melo_discover_add_address (MeloDiscover *disco, MeloDiscoverInterface *iface)
 {
@@ -232,9 +255,15 @@ melo_discover_add_address (MeloDiscover *disco, MeloDiscoverInterface *iface)
                          "serial=%s&hw_address=%s&address=%s",
                          priv->serial, iface->hw_address, iface->address);
 
+  /* Save address sent */
+  g_free (iface->reg_address);
+  iface->reg_address = g_strdup (iface->address);
+  g_atomic_int_set (&iface->synced, TRUE);
+
   /* Send request */
   msg = soup_message_new ("GET", req);
-  soup_session_queue_message (priv->session, msg, NULL, NULL);
+  soup_session_queue_message (priv->session, msg,
+                              melo_discover_address_callback, iface);
   g_free (req);
 
   return TRUE;
@@ -256,14 +285,69 @@ melo_discover_remove_address (MeloDiscover *disco, MeloDiscoverInterface *iface)
                          "serial=%s&hw_address=%s",
                          priv->serial, iface->hw_address);
 
+  /* Save address removal */
+  g_free (iface->reg_address);
+  iface->reg_address = NULL;
+  g_atomic_int_set (&iface->synced, TRUE);
+
   /* Send request */
   msg = soup_message_new ("GET", req);
-  soup_session_queue_message (priv->session, msg, NULL, NULL);
+  soup_session_queue_message (priv->session, msg,
+                              melo_discover_address_callback, iface);
   g_free (req);
 
   return TRUE;
 }
 
+static void
+melo_discover_update_addresses (MeloDiscover *disco)
+{
+  MeloDiscoverPrivate *priv = disco->priv;
+  MeloDiscoverInterface *iface;
+  GList *l;
+
+  for (l = priv->ifaces; l != NULL; l = l->next) {
+    iface = l->data;
+
+    /* Skip interfaces without hardware address or not changed */
+    if (!iface->hw_address ||
+        (g_atomic_int_get (&iface->synced) &&
+         !g_strcmp0 (iface->address, iface->reg_address)))
+      continue;
+
+    /* Add or remove device address on Melo website */
+    if (iface->address)
+      melo_discover_add_address (disco, iface);
+    else
+      melo_discover_remove_address (disco, iface);
+  }
+}
+
+static gboolean
+melo_discover_update (gpointer user_data)
+{
+  MeloDiscover *disco = user_data;
+  MeloDiscoverPrivate *priv = disco->priv;
+
+  /* Lock interface list access */
+  g_mutex_lock (&priv->mutex);
+
+  priv->update_id = 0;
+
+  /* Register device or send changes of interfaces since last update */
+  if (priv->register_device) {
+    if (!priv->registered)
+      melo_discover_add_device (disco);
+    else
+      melo_discover_update_addresses (disco);
+  }
+
+  /* Unlock interface list access */
+  g_mutex_unlock (&priv->mutex);
+
+  return G_SOURCE_REMOVE;
+}
+
 static gboolean
 melo_netlink_event (gint fd, GIOCondition condition, gpointer user_data)
 {
@@ -285,11 +369,9 @@ melo_netlink_event (gint fd, GIOCondition condition, gpointer user_data)
   if (!priv->register_device)
     goto end;
 
-  /* Device is not yet registered */
-  if (!priv->registered) {
-    melo_discover_add_device (disco);
-    goto end;
-  }
+  /* Device is not yet registered: interfaces are listed at registration */
+  if (!priv->registered)
+    goto update;
 
   /* Parse messages */
   for (nh = (struct nlmsghdr *) buffer; NLMSG_OK (nh, len);
@@ -350,8 +432,6 @@ melo_netlink_event (gint fd, GIOCondition condition, gpointer user_data)
             /* Set address */
             g_free (iface->address);
             iface->address = melo_discover_get_address (&addr);
-            if (iface->hw_address)
-              melo_discover_add_address (disco, iface);
           }
         }
         break;
@@ -367,19 +447,24 @@ melo_netlink_event (gint fd, GIOCondition condition, gpointer user_data)
         if (iface) {
           g_free (iface->address);
           iface->address = NULL;
-          if (iface->hw_address)
-            melo_discover_remove_address (disco, iface);
         }
         break;
       }
       case NLMSG_DONE:
       case NLMSG_ERROR:
-        goto end;
+        goto update;
       default:
         break;
     }
   }
 
+update:
+  /* Coalesce burst of changes: send only final state after a short delay */
+  if (priv->update_id)
+    g_source_remove (priv->update_id);
+  priv->update_id = g_timeout_add (MELO_DISCOVER_DELAY, melo_discover_update,
+                                   disco);
+
 end:
   /* Unock interface list access */
   g_mutex_unlock (&priv->mutex);
@@ -416,7 +501,6 @@ melo_discover_add_device (MeloDiscover *disco)
   const gchar *host;
   SoupMessage *msg;
   gchar *req;
-  GList *l;
 
   /* Get network interfaces */
   if (getifaddrs (&ifap))
@@ -473,19 +557,8 @@ melo_discover_add_device (MeloDiscover *disco)
     }
   }
 
-  /* Add device addresses on Sparod */
-  for (l = priv->ifaces; l != NULL; l = l->next) {
-    /* Get interface */
-    iface = l->data;
-
-    /* Add or remove device address on Melo website */
-    if (iface->hw_address) {
-      if (iface->address)
-        melo_discover_add_address (disco, iface);
-      else
-        melo_discover_remove_address (disco, iface);
-    }
-  }
+  /* Add changed device addresses on Sparod */
+  melo_discover_update_addresses (disco);
 
   /* Free intarfaces list */
   freeifaddrs (ifap);
@@ -525,6 +598,7 @@ melo_discover_unregister_device (MeloDiscover *disco)
   MeloDiscoverPrivate *priv = disco->priv;
   SoupMessage *msg;
   gchar *req;
+  GList *l;
 
   /* Lock interface list access */
   g_mutex_lock (&priv->mutex);
@@ -539,6 +613,10 @@ melo_discover_unregister_device (MeloDiscover *disco)
   priv->register_device = FALSE;
   priv->registered = FALSE;
 
+  /* Addresses are removed with device */
+  for (l = priv->ifaces; l != NULL; l = l->next)
+    g_atomic_int_set (&((MeloDiscoverInterface *) l->data)->synced, FALSE);
+
   /* Prepare request for device removal */
   req = g_strdup_printf (MELO_DISCOVER_URL "?action=remove_device&serial=%s",
                          priv->serial);
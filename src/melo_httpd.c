@@ -27,10 +27,16 @@
 
 #include "melo_tags.h"
 #include "melo_avahi.h"
+#include "melo_jsonrpc.h"
+#include "melo_metrics.h"
 #include "melo_httpd.h"
 #include "melo_httpd_file.h"
+#include "melo_httpd_pool.h"
 #include "melo_httpd_cover.h"
+#include "melo_httpd_event.h"
+#include "melo_httpd_stream.h"
 #include "melo_httpd_jsonrpc.h"
+#include "melo_httpd_encoding.h"
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -38,6 +44,22 @@
 
 #define MELO_HTTPD_REALM "Melo"
 
+/* Default connection timeouts (in s) */
+#define MELO_HTTPD_IDLE_TIMEOUT 60
+#define MELO_HTTPD_KEEP_ALIVE_TIMEOUT 30
+
+/* Default minimum size of a response to compress (in bytes) */
+#define MELO_HTTPD_COMPRESSION_MIN_SIZE 1024
+
+/* Default number of threads for each JSON-RPC priority */
+#define MELO_HTTPD_JSONRPC_THREADS 10
+#define MELO_HTTPD_CONTROL_THREADS 4
+#define MELO_HTTPD_BULK_THREADS 4
+#define MELO_HTTPD_WAIT_THREADS 32
+
+/* Default number of threads for covers */
+#define MELO_HTTPD_COVER_THREADS 10
+
 static gboolean melo_httpd_basic_auth_callback (SoupAuthDomain *auth_domain,
                                                 SoupMessage *msg,
                                                 const char *username,
@@ -48,6 +70,9 @@ struct _MeloHTTPDPrivate {
   GMutex mutex;
   SoupServer *server;
 
+  /* Service name */
+  gchar *name;
+
   /* Avahi client */
   MeloAvahi *avahi;
   const MeloAvahiService *http_service;
@@ -59,9 +84,21 @@ struct _MeloHTTPDPrivate {
   gchar *username;
   gchar *password;
 
-  /* Thread pools */
-  GThreadPool *jsonrpc_pool;
-  GThreadPool *cover_pool;
+  /* Connections */
+  guint idle_timeout;
+  guint keep_alive_timeout;
+
+  /* Compression */
+  gboolean compression;
+  gsize compression_min_size;
+
+  /* Thread pools: one per JSON-RPC priority */
+  MeloHTTPDPool *jsonrpc_pools[MELO_JSONRPC_PRIORITY_COUNT];
+  MeloHTTPDPool *cover_pool;
+  guint adapt_id;
+
+  /* Web root files cache */
+  MeloHTTPDFileCache *file_cache;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (MeloHTTPD, melo_httpd, G_TYPE_OBJECT)
@@ -71,17 +108,24 @@ melo_httpd_finalize (GObject *gobject)
 {
   MeloHTTPDPrivate *priv =
                          melo_httpd_get_instance_private (MELO_HTTPD (gobject));
+  guint i;
 
   /* Free avahi client */
   if (priv->avahi)
     g_object_unref (priv->avahi);
+  g_free (priv->name);
 
   /* Free HTTP server */
   g_object_unref (priv->server);
 
   /* Free thread pools */
-  g_thread_pool_free (priv->jsonrpc_pool, TRUE, FALSE);
-  g_thread_pool_free (priv->cover_pool, TRUE, FALSE);
+  g_source_remove (priv->adapt_id);
+  for (i = 0; i < MELO_JSONRPC_PRIORITY_COUNT; i++)
+    melo_httpd_pool_free (priv->jsonrpc_pools[i]);
+  melo_httpd_pool_free (priv->cover_pool);
+
+  /* Free files cache */
+  melo_httpd_file_cache_free (priv->file_cache);
 
   /* free authentication */
   g_object_unref (priv->auth_domain);
@@ -104,6 +148,20 @@ melo_httpd_class_init (MeloHTTPDClass *klass)
   object_class->finalize = melo_httpd_finalize;
 }
 
+static gboolean
+melo_httpd_adapt_pools (gpointer user_data)
+{
+  MeloHTTPDPrivate *priv = user_data;
+  guint i;
+
+  /* Adapt thread count of all pools */
+  for (i = 0; i < MELO_JSONRPC_PRIORITY_COUNT; i++)
+    melo_httpd_pool_adapt (priv->jsonrpc_pools[i]);
+  melo_httpd_pool_adapt (priv->cover_pool);
+
+  return G_SOURCE_CONTINUE;
+}
+
 static void
 melo_httpd_init (MeloHTTPD *self)
 {
@@ -132,11 +190,41 @@ melo_httpd_init (MeloHTTPD *self)
                           NULL);
   priv->auth_enabled = FALSE;
 
-  /* Init thread pools */
-  priv->jsonrpc_pool = g_thread_pool_new (melo_httpd_jsonrpc_thread_handler,
-                                          priv->server, 10, FALSE, NULL);
-  priv->cover_pool = g_thread_pool_new (melo_httpd_cover_thread_handler,
-                                        priv->server, 10, FALSE, NULL);
+  /* Set default connection and compression settings */
+  priv->idle_timeout = MELO_HTTPD_IDLE_TIMEOUT;
+  priv->keep_alive_timeout = MELO_HTTPD_KEEP_ALIVE_TIMEOUT;
+  priv->compression = TRUE;
+  priv->compression_min_size = MELO_HTTPD_COMPRESSION_MIN_SIZE;
+
+  /* Init thread pools: control, bulk and wait requests have their own lanes,
+   * so a long-poll never holds a thread of the other requests.
+   */
+  priv->jsonrpc_pools[MELO_JSONRPC_PRIORITY_NORMAL] =
+                      melo_httpd_pool_new (melo_httpd_jsonrpc_thread_handler,
+                                           priv->server,
+                                           MELO_HTTPD_JSONRPC_THREADS);
+  priv->jsonrpc_pools[MELO_JSONRPC_PRIORITY_CONTROL] =
+                      melo_httpd_pool_new (melo_httpd_jsonrpc_thread_handler,
+                                           priv->server,
+                                           MELO_HTTPD_CONTROL_THREADS);
+  priv->jsonrpc_pools[MELO_JSONRPC_PRIORITY_BULK] =
+                      melo_httpd_pool_new (melo_httpd_jsonrpc_thread_handler,
+                                           priv->server,
+                                           MELO_HTTPD_BULK_THREADS);
+  priv->jsonrpc_pools[MELO_JSONRPC_PRIORITY_WAIT] =
+                      melo_httpd_pool_new (melo_httpd_jsonrpc_thread_handler,
+                                           priv->server,
+                                           MELO_HTTPD_WAIT_THREADS);
+  priv->cover_pool = melo_httpd_pool_new (melo_httpd_cover_thread_handler,
+                                          priv->server,
+                                          MELO_HTTPD_COVER_THREADS);
+
+  /* Adapt thread pools periodically */
+  priv->adapt_id = g_timeout_add_seconds (MELO_HTTPD_POOL_ADAPT_PERIOD,
+                                          melo_httpd_adapt_pools, priv);
+
+  /* Create files cache */
+  priv->file_cache = melo_httpd_file_cache_new (MELO_DATA_DIR "/www");
 
   /* Create an avahi client */
   priv->avahi = melo_avahi_new ();
@@ -174,6 +262,74 @@ melo_httpd_version_handler (SoupServer *server, SoupMessage *msg,
                              version, strlen (version));
 }
 
+static void
+melo_httpd_metrics_add_pool (GString *out, MeloHTTPDPool *pool,
+                             const gchar *name)
+{
+  melo_metrics_add_value (out, "melo_httpd_pool_queued",
+                          melo_httpd_pool_get_queued (pool), "pool", name,
+                          NULL);
+  melo_metrics_add_value (out, "melo_httpd_pool_threads",
+                          melo_httpd_pool_get_threads (pool), "pool", name,
+                          NULL);
+  melo_metrics_add_value (out, "melo_httpd_pool_max_threads",
+                          melo_httpd_pool_get_max_threads (pool), "pool", name,
+                          NULL);
+  melo_metrics_add_value (out, "melo_httpd_pool_rejected_total",
+                          melo_httpd_pool_get_rejected (pool), "pool", name,
+                          NULL);
+}
+
+static void
+melo_httpd_metrics_handler (SoupServer *server, SoupMessage *msg,
+                            const char *path, GHashTable *query,
+                            SoupClientContext *client, gpointer user_data)
+{
+  MeloHTTPDPrivate *priv = user_data;
+  GString *out;
+  gsize len;
+
+  /* Only GET requests are supported */
+  if (msg->method != SOUP_METHOD_GET) {
+    soup_message_set_status (msg, SOUP_STATUS_NOT_IMPLEMENTED);
+    return;
+  }
+
+  /* Add thread pool metrics */
+  out = g_string_new (NULL);
+  melo_metrics_add_header (out, "melo_httpd_pool_queued", "gauge",
+                           "Number of requests waiting for a thread");
+  melo_metrics_add_header (out, "melo_httpd_pool_threads", "gauge",
+                           "Number of threads of a pool");
+  melo_metrics_add_header (out, "melo_httpd_pool_max_threads", "gauge",
+                           "Current maximum number of threads of a pool");
+  melo_metrics_add_header (out, "melo_httpd_pool_rejected_total", "counter",
+                           "Number of requests rejected as queue was full");
+  melo_httpd_metrics_add_pool (out,
+                        priv->jsonrpc_pools[MELO_JSONRPC_PRIORITY_NORMAL],
+                        "jsonrpc_normal");
+  melo_httpd_metrics_add_pool (out,
+                        priv->jsonrpc_pools[MELO_JSONRPC_PRIORITY_CONTROL],
+                        "jsonrpc_control");
+  melo_httpd_metrics_add_pool (out,
+                        priv->jsonrpc_pools[MELO_JSONRPC_PRIORITY_BULK],
+                        "jsonrpc_bulk");
+  melo_httpd_metrics_add_pool (out,
+                        priv->jsonrpc_pools[MELO_JSONRPC_PRIORITY_WAIT],
+                        "jsonrpc_wait");
+  melo_httpd_metrics_add_pool (out, priv->cover_pool, "cover");
+
+  /* Add metrics of all subsystems */
+  melo_metrics_render (out);
+
+  /* Set response in Prometheus text format */
+  len = out->len;
+  soup_message_set_status (msg, SOUP_STATUS_OK);
+  soup_message_set_response (msg, "text/plain; version=0.0.4",
+                             SOUP_MEMORY_TAKE, g_string_free (out, FALSE),
+                             len);
+}
+
 gboolean
 melo_httpd_set_certificate (MeloHTTPD *httpd, const gchar *cert_file,
                             const gchar *key_file)
@@ -192,6 +348,60 @@ melo_httpd_set_certificate (MeloHTTPD *httpd, const gchar *cert_file,
   return TRUE;
 }
 
+static void
+melo_httpd_request_started (SoupServer *server, SoupMessage *msg,
+                            SoupClientContext *client, gpointer user_data)
+{
+  MeloHTTPDPrivate *priv = user_data;
+  GSocket *socket;
+
+  /* Set timeout while the request is handled */
+  socket = soup_client_context_get_gsocket (client);
+  if (socket)
+    g_socket_set_timeout (socket, priv->idle_timeout);
+}
+
+static void
+melo_httpd_request_read (SoupServer *server, SoupMessage *msg,
+                         SoupClientContext *client, gpointer user_data)
+{
+  MeloHTTPDPrivate *priv = user_data;
+
+  /* WebSocket connections can be idle for a long time */
+  if (soup_message_headers_header_contains (msg->request_headers, "Upgrade",
+                                            "websocket")) {
+    GSocket *socket = soup_client_context_get_gsocket (client);
+    if (socket)
+      g_socket_set_timeout (socket, 0);
+    return;
+  }
+
+  /* Close connection after response when keep-alive is disabled */
+  if (!priv->keep_alive_timeout)
+    soup_message_headers_append (msg->response_headers, "Connection", "close");
+
+  /* Negotiate content encoding of response */
+  if (priv->compression)
+    melo_httpd_encoding_negotiate (msg, priv->compression_min_size);
+}
+
+static void
+melo_httpd_request_finished (SoupServer *server, SoupMessage *msg,
+                             SoupClientContext *client, gpointer user_data)
+{
+  MeloHTTPDPrivate *priv = user_data;
+  GSocket *socket;
+
+  /* Connection has been upgraded */
+  if (msg->status_code == SOUP_STATUS_SWITCHING_PROTOCOLS)
+    return;
+
+  /* Set timeout while the connection is waiting for next request */
+  socket = soup_client_context_get_gsocket (client);
+  if (socket)
+    g_socket_set_timeout (socket, priv->keep_alive_timeout);
+}
+
 gboolean
 melo_httpd_start (MeloHTTPD *httpd, guint port, guint sport, const gchar *name)
 {
@@ -215,44 +425,83 @@ melo_httpd_start (MeloHTTPD *httpd, guint port, guint sport, const gchar *name)
     }
   }
 
-  /* Start listening for HTTPS */
-  if (sport) {
-    res = soup_server_listen_all (server, sport, SOUP_SERVER_LISTEN_HTTPS,
-                                  &err);
-    if (res == FALSE) {
-      g_warning ("failed to start HTTPS server on port %u: %s", sport,
-               err->message);
-      g_clear_error (&err);
-      sport = 0;
-    }
-  }
+  /* Handle connection timeouts and content encoding */
+  g_signal_connect (server, "request-started",
+                    G_CALLBACK (melo_httpd_request_started), priv);
+  g_signal_connect (server, "request-read",
+                    G_CALLBACK (melo_httpd_request_read), priv);
+  g_signal_connect (server, "request-finished",
+                    G_CALLBACK (melo_httpd_request_finished), priv);
 
-  /* Add a default handler */
-  soup_server_add_handler (server, NULL, melo_httpd_file_handler, NULL,
-                           NULL);
+  /* Add a default handler: the web root files are preloaded in cache */
+  soup_server_add_handler (server, NULL, melo_httpd_file_handler,
+                           priv->file_cache, NULL);
+  melo_httpd_file_cache_preload (priv->file_cache);
 
   /* Add an handler for version */
   soup_server_add_handler (server, "/version", melo_httpd_version_handler, NULL,
                            NULL);
 
+  /* Add an handler for metrics */
+  soup_server_add_handler (server, "/metrics", melo_httpd_metrics_handler,
+                           priv, NULL);
+
   /* Add an handler for JSON-RPC */
   soup_server_add_handler (server, "/rpc", melo_httpd_jsonrpc_handler,
-                           priv->jsonrpc_pool, NULL);
+                           priv->jsonrpc_pools, NULL);
 
   /* Add an handler for covers */
   soup_server_add_handler (server, "/cover", melo_httpd_cover_handler,
                            priv->cover_pool, NULL);
 
-  /* Add avahi service(s) */
-  if (priv->avahi) {
-    if (port)
-      priv->http_service = melo_avahi_add_service (priv->avahi, name,
-                                                   "_http._tcp", port, NULL);
-    if (sport)
-      priv->https_service = melo_avahi_add_service (priv->avahi, name,
-                                                   "_https._tcp", sport, NULL);
+  /* Add an handler for encoded audio streams */
+  soup_server_add_handler (server, "/stream", melo_httpd_stream_handler, NULL,
+                           NULL);
+
+  /* Add a WebSocket handler for events */
+  soup_server_add_websocket_handler (server, "/events", NULL, NULL,
+                                     melo_httpd_event_handler, NULL, NULL);
+
+  /* Save service name */
+  g_mutex_lock (&priv->mutex);
+  g_free (priv->name);
+  priv->name = g_strdup (name);
+  g_mutex_unlock (&priv->mutex);
+
+  /* Add avahi service */
+  if (priv->avahi && port)
+    priv->http_service = melo_avahi_add_service (priv->avahi, name,
+                                                 "_http._tcp", port, NULL);
+
+  /* Start listening for HTTPS */
+  if (sport)
+    melo_httpd_start_https (httpd, sport);
+
+  return TRUE;
+}
+
+gboolean
+melo_httpd_start_https (MeloHTTPD *httpd, guint sport)
+{
+  MeloHTTPDPrivate *priv = httpd->priv;
+  GError *err = NULL;
+
+  /* Start listening for HTTPS */
+  if (!soup_server_listen_all (priv->server, sport, SOUP_SERVER_LISTEN_HTTPS,
+                               &err)) {
+    g_warning ("failed to start HTTPS server on port %u: %s", sport,
+               err->message);
+    g_clear_error (&err);
+    return FALSE;
   }
 
+  /* Add avahi service */
+  g_mutex_lock (&priv->mutex);
+  if (priv->avahi && !priv->https_service)
+    priv->https_service = melo_avahi_add_service (priv->avahi, priv->name,
+                                                  "_https._tcp", sport, NULL);
+  g_mutex_unlock (&priv->mutex);
+
   return TRUE;
 }
 
@@ -278,6 +527,11 @@ melo_httpd_set_name (MeloHTTPD *httpd, const gchar *name)
 {
   MeloHTTPDPrivate *priv = httpd->priv;
 
+  /* Save service name */
+  g_mutex_lock (&priv->mutex);
+  g_free (priv->name);
+  priv->name = g_strdup (name);
+
   /* Update avahi name service */
   if (priv->avahi) {
     if (priv->http_service)
@@ -287,6 +541,95 @@ melo_httpd_set_name (MeloHTTPD *httpd, const gchar *name)
       melo_avahi_update_service (priv->avahi, priv->https_service, name, NULL,
                                  0, FALSE);
   }
+  g_mutex_unlock (&priv->mutex);
+}
+
+void
+melo_httpd_set_idle_timeout (MeloHTTPD *httpd, guint timeout)
+{
+  httpd->priv->idle_timeout = timeout;
+}
+
+void
+melo_httpd_set_keep_alive_timeout (MeloHTTPD *httpd, guint timeout)
+{
+  httpd->priv->keep_alive_timeout = timeout;
+}
+
+void
+melo_httpd_set_compression (MeloHTTPD *httpd, gboolean enable)
+{
+  httpd->priv->compression = enable;
+}
+
+void
+melo_httpd_set_compression_min_size (MeloHTTPD *httpd, gsize min_size)
+{
+  httpd->priv->compression_min_size = min_size;
+}
+
+static void
+melo_httpd_set_pool_threads (MeloHTTPDPool *pool, guint count)
+{
+  /* At least one thread is necessary to handle requests */
+  if (!count)
+    count = 1;
+
+  melo_httpd_pool_set_max_threads (pool, count);
+}
+
+void
+melo_httpd_set_threads (MeloHTTPD *httpd, guint count)
+{
+  melo_httpd_set_pool_threads (
+                   httpd->priv->jsonrpc_pools[MELO_JSONRPC_PRIORITY_NORMAL],
+                   count);
+}
+
+void
+melo_httpd_set_control_threads (MeloHTTPD *httpd, guint count)
+{
+  melo_httpd_set_pool_threads (
+                  httpd->priv->jsonrpc_pools[MELO_JSONRPC_PRIORITY_CONTROL],
+                  count);
+}
+
+void
+melo_httpd_set_bulk_threads (MeloHTTPD *httpd, guint count)
+{
+  melo_httpd_set_pool_threads (
+                     httpd->priv->jsonrpc_pools[MELO_JSONRPC_PRIORITY_BULK],
+                     count);
+}
+
+void
+melo_httpd_set_cover_threads (MeloHTTPD *httpd, guint count)
+{
+  melo_httpd_set_pool_threads (httpd->priv->cover_pool, count);
+}
+
+void
+melo_httpd_set_adaptive_threads (MeloHTTPD *httpd, gboolean enable)
+{
+  MeloHTTPDPrivate *priv = httpd->priv;
+  guint i;
+
+  /* Enable adaptive thread count on all pools */
+  for (i = 0; i < MELO_JSONRPC_PRIORITY_COUNT; i++)
+    melo_httpd_pool_set_adaptive (priv->jsonrpc_pools[i], enable);
+  melo_httpd_pool_set_adaptive (priv->cover_pool, enable);
+}
+
+void
+melo_httpd_set_queue_limit (MeloHTTPD *httpd, guint limit)
+{
+  MeloHTTPDPrivate *priv = httpd->priv;
+  guint i;
+
+  /* Set maximum number of waiting requests on all pools */
+  for (i = 0; i < MELO_JSONRPC_PRIORITY_COUNT; i++)
+    melo_httpd_pool_set_queue_limit (priv->jsonrpc_pools[i], limit);
+  melo_httpd_pool_set_queue_limit (priv->cover_pool, limit);
 }
 
 void
@@ -57,10 +57,22 @@ gboolean melo_httpd_set_certificate (MeloHTTPD *httpd, const gchar *cert_file,
 
 gboolean melo_httpd_start (MeloHTTPD *httpd, guint port, guint sport,
                            const gchar *name);
+gboolean melo_httpd_start_https (MeloHTTPD *httpd, guint sport);
 void melo_httpd_stop (MeloHTTPD *httpd);
 
 void melo_httpd_set_name (MeloHTTPD *httpd, const gchar *name);
 
+void melo_httpd_set_idle_timeout (MeloHTTPD *httpd, guint timeout);
+void melo_httpd_set_keep_alive_timeout (MeloHTTPD *httpd, guint timeout);
+void melo_httpd_set_compression (MeloHTTPD *httpd, gboolean enable);
+void melo_httpd_set_compression_min_size (MeloHTTPD *httpd, gsize min_size);
+void melo_httpd_set_threads (MeloHTTPD *httpd, guint count);
+void melo_httpd_set_control_threads (MeloHTTPD *httpd, guint count);
+void melo_httpd_set_bulk_threads (MeloHTTPD *httpd, guint count);
+void melo_httpd_set_cover_threads (MeloHTTPD *httpd, guint count);
+void melo_httpd_set_adaptive_threads (MeloHTTPD *httpd, gboolean enable);
+void melo_httpd_set_queue_limit (MeloHTTPD *httpd, guint limit);
+
 void melo_httpd_auth_enable (MeloHTTPD *httpd);
 void melo_httpd_auth_disable (MeloHTTPD *httpd);
 void melo_httpd_auth_set_username (MeloHTTPD *httpd, const gchar *username);
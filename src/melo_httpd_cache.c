@@ -0,0 +1,144 @@
+/*
+ * melo_httpd_cache.c: HTTP caching helpers for Melo HTTP server
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#include <string.h>
+
+#include "melo_httpd_cache.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/*
+ * The validators of a response (ETag and Last-Modified) are set with
+ * melo_httpd_cache_check(), which also handles the conditional headers of the
+ * request: when the client copy is still valid, the status of the message is
+ * set to 304 (Not Modified) and no body should be sent.
+ *
+ * As in RFC 7232, If-None-Match takes precedence over If-Modified-Since and
+ * the entity tags are compared with the weak comparison, since a same resource
+ * can be sent with different content encodings. The If-Range header is
+ * handled by melo_httpd_cache_check_range() with the strong comparison.
+ */
+
+static gboolean
+melo_httpd_cache_etag_equal (const gchar *a, const gchar *b)
+{
+  /* Weak comparison */
+  if (!strncmp (a, "W/", 2))
+    a += 2;
+  if (!strncmp (b, "W/", 2))
+    b += 2;
+
+  return !strcmp (a, b);
+}
+
+static gboolean
+melo_httpd_cache_match_etag (const gchar *header, const gchar *etag)
+{
+  gboolean ret = FALSE;
+  GSList *list, *l;
+
+  /* Find entity tag in list */
+  list = soup_header_parse_list (header);
+  for (l = list; l != NULL && !ret; l = l->next)
+    ret = !strcmp (l->data, "*") || melo_httpd_cache_etag_equal (l->data, etag);
+  soup_header_free_list (list);
+
+  return ret;
+}
+
+gboolean
+melo_httpd_cache_check (SoupMessage *msg, const gchar *etag, time_t mtime)
+{
+  const gchar *header;
+  gboolean ret = FALSE;
+  SoupDate *date;
+  gchar *str;
+
+  /* Set validators */
+  if (etag)
+    soup_message_headers_replace (msg->response_headers, "ETag", etag);
+  if (mtime) {
+    date = soup_date_new_from_time_t (mtime);
+    str = soup_date_to_string (date, SOUP_DATE_HTTP);
+    soup_message_headers_replace (msg->response_headers, "Last-Modified", str);
+    soup_date_free (date);
+    g_free (str);
+  }
+
+  /* Check entity tag */
+  header = soup_message_headers_get_list (msg->request_headers,
+                                          "If-None-Match");
+  if (header)
+    ret = etag && melo_httpd_cache_match_etag (header, etag);
+  else if (mtime) {
+    /* Check modification date */
+    header = soup_message_headers_get_one (msg->request_headers,
+                                           "If-Modified-Since");
+    date = header ? soup_date_new_from_string (header) : NULL;
+    if (date) {
+      ret = mtime <= soup_date_to_time_t (date);
+      soup_date_free (date);
+    }
+  }
+
+  /* Client copy is still valid */
+  if (ret)
+    soup_message_set_status (msg, SOUP_STATUS_NOT_MODIFIED);
+
+  return ret;
+}
+
+gboolean
+melo_httpd_cache_check_range (SoupMessage *msg, const gchar *etag,
+                              time_t mtime)
+{
+  const gchar *header;
+  SoupDate *date;
+  gboolean ret;
+
+  /* No condition on ranges */
+  header = soup_message_headers_get_one (msg->request_headers, "If-Range");
+  if (!header)
+    return TRUE;
+
+  /* Entity tag: a weak tag cannot be used for ranges */
+  if (*header == '"' || !strncmp (header, "W/", 2))
+    return etag && strncmp (etag, "W/", 2) && !strcmp (header, etag);
+
+  /* Date must match exactly the modification date */
+  date = soup_date_new_from_string (header);
+  if (!date)
+    return FALSE;
+  ret = mtime && mtime == soup_date_to_time_t (date);
+  soup_date_free (date);
+
+  return ret;
+}
+
+void
+melo_httpd_cache_set_control (SoupMessage *msg, const gchar *control)
+{
+  soup_message_headers_replace (msg->response_headers, "Cache-Control",
+                                control);
+}
@@ -0,0 +1,39 @@
+/*
+ * melo_httpd_cache.h: HTTP caching helpers for Melo HTTP server
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __MELO_HTTPD_CACHE_H__
+#define __MELO_HTTPD_CACHE_H__
+
+#include <time.h>
+
+#include <glib.h>
+#include <libsoup/soup.h>
+
+/* Max age of immutable resources (in s) */
+#define MELO_HTTPD_CACHE_IMMUTABLE_MAX_AGE 31536000
+
+gboolean melo_httpd_cache_check (SoupMessage *msg, const gchar *etag,
+                                 time_t mtime);
+gboolean melo_httpd_cache_check_range (SoupMessage *msg, const gchar *etag,
+                                       time_t mtime);
+void melo_httpd_cache_set_control (SoupMessage *msg, const gchar *control);
+
+#endif /* __MELO_HTTPD_CACHE_H__ */
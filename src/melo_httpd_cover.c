@@ -23,42 +23,247 @@
 #include <string.h>
 #include <errno.h>
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_GDK_PIXBUF
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#endif
+
 #include "melo_tags.h"
 
+#include "melo_httpd_pool.h"
 #include "melo_httpd_cover.h"
+#include "melo_httpd_cache.h"
 
-void
-melo_httpd_cover_thread_handler (gpointer data, gpointer user_data)
+/*
+ * The cover IDs are generated from a hash of the cover data, so a cover never
+ * changes for a given ID: the ID is used as entity tag and the cover can be
+ * cached forever by the clients.
+ *
+ * A thumbnail of the cover can be requested with the "size" parameter in the
+ * query string (as "/cover/<id>?size=64"): the size is rounded up to one of
+ * the sizes in melo_httpd_cover_sizes and the cover is decoded and scaled in
+ * the thread pool. The thumbnails are saved next to the covers saved on disk
+ * and kept in memory, up to MELO_HTTPD_COVER_THUMBNAILS_MAX thumbnails.
+ *
+ * A cover set by URL is downloaded asynchronously from the main context before
+ * using the thread pool, so the pool threads are never blocked by a download
+ * and concurrent requests share the same download.
+ */
+
+#define MELO_HTTPD_COVER_THUMBNAILS_MAX 256
+#define MELO_HTTPD_COVER_JPEG_QUALITY "85"
+
+typedef struct {
+  SoupServer *server;
+  SoupMessage *msg;
+  MeloHTTPDPool *pool;
+  guint size;
+} MeloHTTPDCoverFetch;
+
+#ifdef HAVE_GDK_PIXBUF
+/* Allowed thumbnail sizes (in pixels) */
+static const guint melo_httpd_cover_sizes[] = { 64, 128, 256, 512 };
+
+typedef struct {
+  guint size;
+  gboolean scaled;
+} MeloHTTPDCoverScale;
+
+/* Thumbnails cache */
+G_LOCK_DEFINE_STATIC (melo_httpd_cover_mutex);
+static GHashTable *melo_httpd_cover_thumbnails;
+#endif
+
+static guint
+melo_httpd_cover_get_size (SoupMessage *msg)
+{
+  guint size = 0;
+#ifdef HAVE_GDK_PIXBUF
+  GHashTable *query;
+  const gchar *value;
+  guint64 req = 0;
+  guint i;
+
+  /* Get requested size from query */
+  if (!soup_message_get_uri (msg)->query)
+    return 0;
+  query = soup_form_decode (soup_message_get_uri (msg)->query);
+  value = g_hash_table_lookup (query, "size");
+  if (value && *value)
+    req = g_ascii_strtoull (value, NULL, 10);
+  g_hash_table_unref (query);
+
+  /* Round up to an allowed size: bigger sizes use original cover */
+  for (i = 0; req && i < G_N_ELEMENTS (melo_httpd_cover_sizes); i++) {
+    if (req <= melo_httpd_cover_sizes[i]) {
+      size = melo_httpd_cover_sizes[i];
+      break;
+    }
+  }
+#endif
+
+  return size;
+}
+
+#ifdef HAVE_GDK_PIXBUF
+static void
+melo_httpd_cover_size_prepared (GdkPixbufLoader *loader, gint width,
+                                gint height, gpointer user_data)
+{
+  MeloHTTPDCoverScale *scale = user_data;
+  gint size = scale->size;
+
+  /* Cover is already small enough */
+  if (width <= size && height <= size)
+    return;
+
+  /* Decode cover directly at thumbnail size, keeping aspect ratio */
+  if (width > height)
+    gdk_pixbuf_loader_set_size (loader, size, MAX (height * size / width, 1));
+  else
+    gdk_pixbuf_loader_set_size (loader, MAX (width * size / height, 1), size);
+  scale->scaled = TRUE;
+}
+
+static GBytes *
+melo_httpd_cover_scale (GBytes *cover, guint size)
+{
+  MeloHTTPDCoverScale scale = { size, FALSE };
+  GdkPixbufLoader *loader;
+  GdkPixbuf *pixbuf;
+  GBytes *bytes = NULL;
+  gchar *buffer;
+  gboolean ret;
+  gsize len;
+
+  /* Decode and scale cover */
+  loader = gdk_pixbuf_loader_new ();
+  g_signal_connect (loader, "size-prepared",
+                    G_CALLBACK (melo_httpd_cover_size_prepared), &scale);
+  ret = gdk_pixbuf_loader_write (loader, g_bytes_get_data (cover, NULL),
+                                 g_bytes_get_size (cover), NULL);
+  ret = gdk_pixbuf_loader_close (loader, NULL) && ret;
+  pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+  if (!ret || !pixbuf || !scale.scaled)
+    goto end;
+
+  /* Encode thumbnail: keep transparency when necessary */
+  if (gdk_pixbuf_get_has_alpha (pixbuf))
+    ret = gdk_pixbuf_save_to_buffer (pixbuf, &buffer, &len, "png", NULL,
+                                     NULL);
+  else
+    ret = gdk_pixbuf_save_to_buffer (pixbuf, &buffer, &len, "jpeg", NULL,
+                                     "quality", MELO_HTTPD_COVER_JPEG_QUALITY,
+                                     NULL);
+  if (ret)
+    bytes = g_bytes_new_take (buffer, len);
+
+end:
+  g_object_unref (loader);
+  return bytes;
+}
+
+static GBytes *
+melo_httpd_cover_get_thumbnail (const gchar *id, guint size)
+{
+  GBytes *cover, *bytes;
+  gchar *key, *path;
+  gchar *data;
+  gsize len;
+
+  /* Find thumbnail in memory */
+  key = g_strdup_printf ("%s/%u", id, size);
+  G_LOCK (melo_httpd_cover_mutex);
+  if (!melo_httpd_cover_thumbnails)
+    melo_httpd_cover_thumbnails = g_hash_table_new_full (g_str_hash,
+                                                         g_str_equal, g_free,
+                                               (GDestroyNotify) g_bytes_unref);
+  bytes = g_hash_table_lookup (melo_httpd_cover_thumbnails, key);
+  if (bytes)
+    g_bytes_ref (bytes);
+  G_UNLOCK (melo_httpd_cover_mutex);
+  if (bytes) {
+    g_free (key);
+    return bytes;
+  }
+
+  /* Find thumbnail on disk */
+  path = melo_tags_get_cover_thumbnail_path (id, size);
+  if (path && g_file_get_contents (path, &data, &len, NULL))
+    bytes = g_bytes_new_take (data, len);
+
+  /* Generate thumbnail from cover */
+  if (!bytes) {
+    cover = melo_tags_get_cover_by_id (id);
+    if (cover) {
+      bytes = melo_httpd_cover_scale (cover, size);
+      g_bytes_unref (cover);
+    }
+    if (bytes && path)
+      g_file_set_contents (path, g_bytes_get_data (bytes, NULL),
+                           g_bytes_get_size (bytes), NULL);
+  }
+  g_free (path);
+
+  /* Cover cannot be scaled */
+  if (!bytes) {
+    g_free (key);
+    return NULL;
+  }
+
+  /* Keep thumbnail in memory: flush all thumbnails when full */
+  G_LOCK (melo_httpd_cover_mutex);
+  if (g_hash_table_size (melo_httpd_cover_thumbnails) >=
+      MELO_HTTPD_COVER_THUMBNAILS_MAX)
+    g_hash_table_remove_all (melo_httpd_cover_thumbnails);
+  g_hash_table_replace (melo_httpd_cover_thumbnails, key, g_bytes_ref (bytes));
+  G_UNLOCK (melo_httpd_cover_mutex);
+
+  return bytes;
+}
+#endif
+
+static const gchar *
+melo_httpd_cover_get_id (SoupMessage *msg)
 {
-  SoupServer *server = SOUP_SERVER (user_data);
-  SoupMessage *msg = SOUP_MESSAGE (data);
-  SoupBuffer *buffer;
-  SoupURI *uri;
-  GBytes *cover = NULL;
-  const char *cover_data;
   const gchar *url;
-  gsize size;
 
   /* Get URL from request */
-  uri = soup_message_get_uri (msg);
-  url = soup_uri_get_path (uri);
+  url = soup_uri_get_path (soup_message_get_uri (msg));
 
   /* Check URL and move to ID */
-  if (!url || strncmp (url, "/cover/", 7))
-    goto error;
-  url += 7;
+  if (!url || strncmp (url, "/cover/", 7) || url[7] == '\0')
+    return NULL;
+  return url + 7;
+}
 
-  /* Get cover data from its URL */
-  cover = melo_tags_get_cover_by_id (url);
-  if (!cover)
-    goto error;
+static void
+melo_httpd_cover_not_found (SoupServer *server, SoupMessage *msg)
+{
+  /* Missing cover cannot be cached */
+  soup_message_headers_remove (msg->response_headers, "ETag");
+  soup_message_headers_remove (msg->response_headers, "Cache-Control");
+  soup_message_set_status (msg, SOUP_STATUS_NOT_FOUND);
+  soup_server_unpause_message (server, msg);
+}
+
+static void
+melo_httpd_cover_set_response (SoupServer *server, SoupMessage *msg,
+                               GBytes *cover)
+{
+  SoupBuffer *buffer;
+  const char *cover_data;
+  gsize size;
 
   /* Set response status */
   soup_message_set_status (msg, SOUP_STATUS_OK);
 
   /* Create a soup buffer */
   cover_data = g_bytes_get_data (cover, &size);
-  buffer = soup_buffer_new_with_owner (cover_data, size, cover,
+  buffer = soup_buffer_new_with_owner (cover_data, size, g_bytes_ref (cover),
                                        (GDestroyNotify) g_bytes_unref);
 
   /* Append buffer to message */
@@ -67,11 +272,63 @@ melo_httpd_cover_thread_handler (gpointer data, gpointer user_data)
 
   /* Set response */
   soup_server_unpause_message (server, msg);
+}
+
+void
+melo_httpd_cover_thread_handler (gpointer data, gpointer user_data)
+{
+  SoupServer *server = SOUP_SERVER (user_data);
+  SoupMessage *msg = SOUP_MESSAGE (data);
+  GBytes *cover = NULL;
+  const gchar *id;
+#ifdef HAVE_GDK_PIXBUF
+  guint size;
+#endif
+
+  /* Get cover ID */
+  id = melo_httpd_cover_get_id (msg);
+  if (!id)
+    goto error;
+
+#ifdef HAVE_GDK_PIXBUF
+  /* Get cover thumbnail */
+  size = melo_httpd_cover_get_size (msg);
+  if (size)
+    cover = melo_httpd_cover_get_thumbnail (id, size);
+#endif
+
+  /* Get cover data from its ID */
+  if (!cover)
+    cover = melo_tags_get_cover_by_id (id);
+  if (!cover)
+    goto error;
+
+  /* Set response */
+  melo_httpd_cover_set_response (server, msg, cover);
+  g_bytes_unref (cover);
   return;
 
 error:
-  soup_message_set_status (msg, SOUP_STATUS_NOT_FOUND);
-  soup_server_unpause_message (server, msg);
+  melo_httpd_cover_not_found (server, msg);
+}
+
+static void
+melo_httpd_cover_fetched (const gchar *id, GBytes *cover, gpointer user_data)
+{
+  MeloHTTPDCoverFetch *fetch = user_data;
+
+  /* Cover is not available */
+  if (!cover)
+    melo_httpd_cover_not_found (fetch->server, fetch->msg);
+  else if (fetch->size)
+    /* Generate thumbnail in thread pool */
+    melo_httpd_pool_push (fetch->pool, fetch->msg);
+  else
+    /* Send cover directly */
+    melo_httpd_cover_set_response (fetch->server, fetch->msg, cover);
+
+  g_object_unref (fetch->msg);
+  g_slice_free (MeloHTTPDCoverFetch, fetch);
 }
 
 void
@@ -79,7 +336,10 @@ melo_httpd_cover_handler (SoupServer *server, SoupMessage *msg,
                           const char *path, GHashTable *query,
                           SoupClientContext *client, gpointer user_data)
 {
-  GThreadPool *pool = (GThreadPool *) user_data;
+  MeloHTTPDPool *pool = (MeloHTTPDPool *) user_data;
+  const gchar *id;
+  gchar *etag;
+  guint size;
 
   /* We only support GET method */
   if (msg->method != SOUP_METHOD_GET) {
@@ -87,7 +347,48 @@ melo_httpd_cover_handler (SoupServer *server, SoupMessage *msg,
     return;
   }
 
-  /* Push request to thread pool */
+  /* Get cover ID */
+  id = melo_httpd_cover_get_id (msg);
+  if (!id) {
+    soup_message_set_status (msg, SOUP_STATUS_NOT_FOUND);
+    return;
+  }
+
+  /* Covers are immutable: no need to get cover if client has a copy */
+  size = melo_httpd_cover_get_size (msg);
+  if (size)
+    etag = g_strdup_printf ("\"%s-%u\"", id, size);
+  else
+    etag = g_strdup_printf ("\"%s\"", id);
+  melo_httpd_cache_set_control (msg, "public, max-age="
+                                G_STRINGIFY (MELO_HTTPD_CACHE_IMMUTABLE_MAX_AGE)
+                                ", immutable");
+  if (melo_httpd_cache_check (msg, etag, 0)) {
+    g_free (etag);
+    return;
+  }
+  g_free (etag);
+
+  /* Too many covers are waiting in thread pool */
+  if (melo_httpd_pool_reject (pool, msg))
+    return;
+
+  /* Pause request until cover is available */
   soup_server_pause_message (server, msg);
-  g_thread_pool_push (pool, msg, NULL);
+
+  /* Cover set by URL: download it without blocking thread pool */
+  if (*id == '@') {
+    MeloHTTPDCoverFetch *fetch;
+
+    fetch = g_slice_new (MeloHTTPDCoverFetch);
+    fetch->server = server;
+    fetch->msg = g_object_ref (msg);
+    fetch->pool = pool;
+    fetch->size = size;
+    melo_tags_get_cover_by_id_async (id, melo_httpd_cover_fetched, fetch);
+    return;
+  }
+
+  /* Push request to thread pool */
+  melo_httpd_pool_push (pool, msg);
 }
@@ -0,0 +1,352 @@
+/*
+ * melo_httpd_encoding.c: Content encoding for Melo HTTP server
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+#include "melo_httpd_encoding.h"
+
+/*
+ * The content encoding of a response is negotiated from the Accept-Encoding
+ * header of the request, when it has been read by the server: the result is
+ * attached to the #SoupMessage. Then, a handler can compress a complete
+ * response body with melo_httpd_encoding_compress() or use a streaming
+ * #MeloHTTPDEncoder for chunked responses.
+ *
+ * Brotli is preferred when available, then gzip. Bodies smaller than the
+ * minimum size are never compressed.
+ */
+
+#define MELO_HTTPD_ENCODING_KEY "melo-httpd-encoding"
+#define MELO_HTTPD_ENCODER_BUFFER_SIZE 16384
+
+/* Compression levels: favor speed on small devices */
+#define MELO_HTTPD_ENCODING_GZIP_LEVEL 6
+#define MELO_HTTPD_ENCODING_BROTLI_QUALITY 5
+
+typedef struct {
+  MeloHTTPDEncoding encoding;
+  gsize min_size;
+} MeloHTTPDEncodingRequest;
+
+struct _MeloHTTPDEncoder {
+  MeloHTTPDEncoding encoding;
+  GConverter *zlib;
+#ifdef HAVE_BROTLI
+  BrotliEncoderState *brotli;
+#endif
+};
+
+static const gchar *melo_httpd_encoding_str[MELO_HTTPD_ENCODING_COUNT] = {
+  [MELO_HTTPD_ENCODING_IDENTITY] = "identity",
+  [MELO_HTTPD_ENCODING_GZIP] = "gzip",
+  [MELO_HTTPD_ENCODING_BROTLI] = "br",
+};
+
+const gchar *
+melo_httpd_encoding_to_string (MeloHTTPDEncoding encoding)
+{
+  if (encoding >= MELO_HTTPD_ENCODING_COUNT)
+    return NULL;
+  return melo_httpd_encoding_str[encoding];
+}
+
+static gboolean
+melo_httpd_encoding_is_supported (MeloHTTPDEncoding encoding)
+{
+#ifndef HAVE_BROTLI
+  if (encoding == MELO_HTTPD_ENCODING_BROTLI)
+    return FALSE;
+#endif
+  return encoding != MELO_HTTPD_ENCODING_IDENTITY;
+}
+
+static void
+melo_httpd_encoding_request_free (gpointer data)
+{
+  g_slice_free (MeloHTTPDEncodingRequest, data);
+}
+
+void
+melo_httpd_encoding_negotiate (SoupMessage *msg, gsize min_size)
+{
+  MeloHTTPDEncoding encoding = MELO_HTTPD_ENCODING_IDENTITY;
+  MeloHTTPDEncodingRequest *req;
+  const gchar *header;
+  GSList *list, *l;
+  guint i;
+
+  /* Get accepted encodings, sorted by preference */
+  header = soup_message_headers_get_list (msg->request_headers,
+                                          "Accept-Encoding");
+  list = header ? soup_header_parse_quality_list (header, NULL) : NULL;
+
+  /* Find the preferred supported encoding */
+  for (l = list; l != NULL && !encoding; l = l->next) {
+    const gchar *name = l->data;
+
+    /* Any encoding is accepted: use gzip */
+    if (!strcmp (name, "*")) {
+      encoding = MELO_HTTPD_ENCODING_GZIP;
+      break;
+    }
+
+    for (i = 0; i < MELO_HTTPD_ENCODING_COUNT; i++) {
+      if (!g_ascii_strcasecmp (name, melo_httpd_encoding_str[i]) &&
+          melo_httpd_encoding_is_supported (i)) {
+        encoding = i;
+        break;
+      }
+    }
+  }
+  soup_header_free_list (list);
+
+  /* Attach negotiated encoding to message */
+  req = g_slice_new (MeloHTTPDEncodingRequest);
+  req->encoding = encoding;
+  req->min_size = min_size;
+  g_object_set_data_full (G_OBJECT (msg), MELO_HTTPD_ENCODING_KEY, req,
+                          melo_httpd_encoding_request_free);
+}
+
+MeloHTTPDEncoding
+melo_httpd_encoding_get (SoupMessage *msg, gsize *min_size)
+{
+  MeloHTTPDEncodingRequest *req;
+
+  /* Compression is disabled or not accepted */
+  req = g_object_get_data (G_OBJECT (msg), MELO_HTTPD_ENCODING_KEY);
+  if (!req)
+    return MELO_HTTPD_ENCODING_IDENTITY;
+
+  if (min_size)
+    *min_size = req->min_size;
+  return req->encoding;
+}
+
+void
+melo_httpd_encoding_set_headers (SoupMessage *msg, MeloHTTPDEncoding encoding)
+{
+  /* Compression is disabled */
+  if (!g_object_get_data (G_OBJECT (msg), MELO_HTTPD_ENCODING_KEY))
+    return;
+
+  /* Response depends on Accept-Encoding */
+  soup_message_headers_append (msg->response_headers, "Vary",
+                               "Accept-Encoding");
+
+  /* Set content encoding */
+  if (encoding != MELO_HTTPD_ENCODING_IDENTITY)
+    soup_message_headers_replace (msg->response_headers, "Content-Encoding",
+                                  melo_httpd_encoding_to_string (encoding));
+}
+
+void
+melo_httpd_encoding_compress (SoupMessage *msg)
+{
+  MeloHTTPDEncodingRequest *req;
+  MeloHTTPDEncoder *enc;
+  SoupBuffer *buffer;
+  GBytes *bytes;
+
+  /* Compression is disabled */
+  req = g_object_get_data (G_OBJECT (msg), MELO_HTTPD_ENCODING_KEY);
+  if (!req)
+    return;
+
+  /* Body is too small or encoding is not accepted */
+  if (req->encoding == MELO_HTTPD_ENCODING_IDENTITY ||
+      msg->response_body->length < (goffset) req->min_size) {
+    melo_httpd_encoding_set_headers (msg, MELO_HTTPD_ENCODING_IDENTITY);
+    return;
+  }
+
+  /* Compress complete body */
+  enc = melo_httpd_encoder_new (req->encoding);
+  if (!enc)
+    return;
+  buffer = soup_message_body_flatten (msg->response_body);
+  bytes = melo_httpd_encoder_encode (enc, buffer->data, buffer->length,
+                                     G_CONVERTER_INPUT_AT_END);
+  soup_buffer_free (buffer);
+  melo_httpd_encoder_free (enc);
+  if (!bytes)
+    return;
+
+  /* Replace body */
+  soup_message_body_truncate (msg->response_body);
+  soup_message_body_append_bytes (msg->response_body, bytes);
+  g_bytes_unref (bytes);
+  melo_httpd_encoding_set_headers (msg, req->encoding);
+}
+
+MeloHTTPDEncoder *
+melo_httpd_encoder_new (MeloHTTPDEncoding encoding)
+{
+  MeloHTTPDEncoder *enc;
+  gboolean ret = FALSE;
+
+  if (!melo_httpd_encoding_is_supported (encoding))
+    return NULL;
+
+  /* Create encoder */
+  enc = g_slice_new0 (MeloHTTPDEncoder);
+  enc->encoding = encoding;
+
+  /* Create compressor */
+  if (encoding == MELO_HTTPD_ENCODING_GZIP) {
+    enc->zlib = G_CONVERTER (g_zlib_compressor_new (
+                                              G_ZLIB_COMPRESSOR_FORMAT_GZIP,
+                                              MELO_HTTPD_ENCODING_GZIP_LEVEL));
+    ret = enc->zlib != NULL;
+  }
+#ifdef HAVE_BROTLI
+  if (encoding == MELO_HTTPD_ENCODING_BROTLI) {
+    enc->brotli = BrotliEncoderCreateInstance (NULL, NULL, NULL);
+    if (enc->brotli)
+      ret = BrotliEncoderSetParameter (enc->brotli, BROTLI_PARAM_QUALITY,
+                                       MELO_HTTPD_ENCODING_BROTLI_QUALITY);
+  }
+#endif
+
+  /* Failed to create compressor */
+  if (!ret) {
+    melo_httpd_encoder_free (enc);
+    return NULL;
+  }
+
+  return enc;
+}
+
+static gboolean
+melo_httpd_encoder_zlib (MeloHTTPDEncoder *enc, const guint8 *data,
+                         gsize size, GConverterFlags flags, GByteArray *out)
+{
+  guint8 buf[MELO_HTTPD_ENCODER_BUFFER_SIZE];
+  GConverterResult res;
+  gsize read, written;
+  GError *err = NULL;
+
+  /* Nothing to do */
+  if (!size && !flags)
+    return TRUE;
+
+  do {
+    res = g_converter_convert (enc->zlib, data, size, buf, sizeof (buf), flags,
+                               &read, &written, &err);
+    if (res == G_CONVERTER_ERROR) {
+      g_warning ("failed to compress response: %s", err->message);
+      g_clear_error (&err);
+      return FALSE;
+    }
+
+    /* Save output */
+    g_byte_array_append (out, buf, written);
+    data += read;
+    size -= read;
+  } while (size || (flags && res == G_CONVERTER_CONVERTED));
+
+  return TRUE;
+}
+
+#ifdef HAVE_BROTLI
+static gboolean
+melo_httpd_encoder_brotli (MeloHTTPDEncoder *enc, const guint8 *data,
+                           gsize size, GConverterFlags flags, GByteArray *out)
+{
+  guint8 buf[MELO_HTTPD_ENCODER_BUFFER_SIZE];
+  BrotliEncoderOperation op;
+
+  /* Convert flags */
+  if (flags & G_CONVERTER_INPUT_AT_END)
+    op = BROTLI_OPERATION_FINISH;
+  else if (flags & G_CONVERTER_FLUSH)
+    op = BROTLI_OPERATION_FLUSH;
+  else
+    op = BROTLI_OPERATION_PROCESS;
+
+  do {
+    size_t avail_out = sizeof (buf);
+    uint8_t *next_out = buf;
+
+    if (!BrotliEncoderCompressStream (enc->brotli, op, &size, &data,
+                                      &avail_out, &next_out, NULL)) {
+      g_warning ("failed to compress response");
+      return FALSE;
+    }
+
+    /* Save output */
+    g_byte_array_append (out, buf, sizeof (buf) - avail_out);
+  } while (size || BrotliEncoderHasMoreOutput (enc->brotli));
+
+  return TRUE;
+}
+#endif
+
+/*
+ * Compress @data and return the available compressed data. With
+ * %G_CONVERTER_FLUSH, all data are flushed to the output, and with
+ * %G_CONVERTER_INPUT_AT_END the compressed stream is terminated.
+ */
+GBytes *
+melo_httpd_encoder_encode (MeloHTTPDEncoder *enc, gconstpointer data,
+                           gsize size, GConverterFlags flags)
+{
+  GByteArray *out;
+  gboolean ret;
+
+  out = g_byte_array_sized_new (size / 4 + 64);
+  if (enc->zlib)
+    ret = melo_httpd_encoder_zlib (enc, data, size, flags, out);
+#ifdef HAVE_BROTLI
+  else
+    ret = melo_httpd_encoder_brotli (enc, data, size, flags, out);
+#else
+  else
+    ret = FALSE;
+#endif
+
+  if (!ret) {
+    g_byte_array_free (out, TRUE);
+    return NULL;
+  }
+
+  return g_byte_array_free_to_bytes (out);
+}
+
+void
+melo_httpd_encoder_free (MeloHTTPDEncoder *enc)
+{
+  if (enc->zlib)
+    g_object_unref (enc->zlib);
+#ifdef HAVE_BROTLI
+  if (enc->brotli)
+    BrotliEncoderDestroyInstance (enc->brotli);
+#endif
+  g_slice_free (MeloHTTPDEncoder, enc);
+}
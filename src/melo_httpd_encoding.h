@@ -0,0 +1,54 @@
+/*
+ * melo_httpd_encoding.h: Content encoding for Melo HTTP server
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __MELO_HTTPD_ENCODING_H__
+#define __MELO_HTTPD_ENCODING_H__
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <libsoup/soup.h>
+
+typedef enum {
+  MELO_HTTPD_ENCODING_IDENTITY = 0,
+  MELO_HTTPD_ENCODING_GZIP,
+  MELO_HTTPD_ENCODING_BROTLI,
+
+  MELO_HTTPD_ENCODING_COUNT
+} MeloHTTPDEncoding;
+
+typedef struct _MeloHTTPDEncoder MeloHTTPDEncoder;
+
+const gchar *melo_httpd_encoding_to_string (MeloHTTPDEncoding encoding);
+
+/* Per-message encoding */
+void melo_httpd_encoding_negotiate (SoupMessage *msg, gsize min_size);
+MeloHTTPDEncoding melo_httpd_encoding_get (SoupMessage *msg, gsize *min_size);
+void melo_httpd_encoding_set_headers (SoupMessage *msg,
+                                      MeloHTTPDEncoding encoding);
+void melo_httpd_encoding_compress (SoupMessage *msg);
+
+/* Streaming encoder */
+MeloHTTPDEncoder *melo_httpd_encoder_new (MeloHTTPDEncoding encoding);
+GBytes *melo_httpd_encoder_encode (MeloHTTPDEncoder *enc, gconstpointer data,
+                                   gsize size, GConverterFlags flags);
+void melo_httpd_encoder_free (MeloHTTPDEncoder *enc);
+
+#endif /* __MELO_HTTPD_ENCODING_H__ */
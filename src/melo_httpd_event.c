@@ -0,0 +1,270 @@
+/*
+ * melo_httpd_event.c: WebSocket event handler for Melo HTTP server
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "melo_event.h"
+#include "melo_event_jsonrpc.h"
+
+#include "melo_httpd_event.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/*
+ * Each WebSocket connection on "/events" registers its own #MeloEventClient
+ * and receives all events as JSON objects generated by
+ * melo_event_jsonrpc_event_to_object().
+ *
+ * The events can be filtered by type and object ID, during connection with the
+ * query string (as "/events?types=player,playlist&ids=file_player") or later by
+ * sending a text message with a JSON object as:
+ *   { "types": [ "player" ], "ids": [ "file_player", "radio_player" ] }
+ * A missing or empty list disables the associated filter, while a list with
+ * only unknown types filters out all events.
+ *
+ * High-frequency events (as seek or buffering) are coalesced: a client is
+ * notified at most once every MELO_HTTPD_EVENT_INTERVAL ms with the latest
+ * values. The interval can be changed with the "interval" parameter in the
+ * query string or the JSON object (0 to disable).
+ *
+ * The events are queued and delivered from the main context of the server, so
+ * the event producers are never blocked: when the event queue of a client is
+ * full, new events are dropped. Once delivered, an event is handed to the
+ * WebSocket connection, which buffers the outgoing data without any limit
+ * (libsoup 2.4 does not expose its amount): the event queue only bounds the
+ * events waiting for the main context, not the data waiting for a stalled
+ * client.
+ */
+
+#define MELO_HTTPD_EVENT_INTERVAL 200
+#define MELO_HTTPD_EVENT_QUEUE_SIZE 256
+
+typedef struct {
+  SoupWebsocketConnection *conn;
+  MeloEventClient *client;
+
+  /* Filters */
+  gboolean has_types;
+  guint types;
+  GHashTable *ids;
+} MeloHTTPDEventClient;
+
+static void
+melo_httpd_event_set_filters (MeloHTTPDEventClient *ec, gchar **types,
+                              gchar **ids)
+{
+  GHashTable *hash = NULL;
+  guint mask = 0;
+  guint i, t;
+
+  /* Generate type mask */
+  for (i = 0; types && types[i]; i++) {
+    for (t = 0; t < MELO_EVENT_TYPE_COUNT; t++) {
+      if (!g_strcmp0 (types[i], melo_event_type_to_string (t))) {
+        mask |= 1 << t;
+        break;
+      }
+    }
+  }
+
+  /* Generate ID list */
+  if (ids && *ids) {
+    hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    for (i = 0; ids[i]; i++)
+      g_hash_table_add (hash, g_strdup (ids[i]));
+  }
+
+  /* Replace filters */
+  if (ec->ids)
+    g_hash_table_unref (ec->ids);
+  ec->has_types = types && *types;
+  ec->types = mask;
+  ec->ids = hash;
+}
+
+static gchar **
+melo_httpd_event_array_to_strv (JsonObject *obj, const gchar *name)
+{
+  JsonArray *array;
+  gchar **strv;
+  guint count, i, j;
+
+  /* Get array */
+  if (!json_object_has_member (obj, name))
+    return NULL;
+  array = json_object_get_array_member (obj, name);
+  if (!array)
+    return NULL;
+
+  /* Copy strings */
+  count = json_array_get_length (array);
+  strv = g_new0 (gchar *, count + 1);
+  for (i = 0, j = 0; i < count; i++) {
+    const gchar *str = json_array_get_string_element (array, i);
+    if (str)
+      strv[j++] = g_strdup (str);
+  }
+
+  return strv;
+}
+
+static gboolean
+melo_httpd_event_callback (MeloEventClient *client, MeloEventType type,
+                           guint event, const gchar *id, gpointer data,
+                           gpointer user_data)
+{
+  MeloHTTPDEventClient *ec = user_data;
+  GBytes *bytes;
+
+  /* Check filters */
+  if ((ec->has_types && !(ec->types & (1 << type))) ||
+      (ec->ids && (!id || !g_hash_table_contains (ec->ids, id))))
+    return TRUE;
+
+  /* Connection is closing */
+  if (soup_websocket_connection_get_state (ec->conn) !=
+      SOUP_WEBSOCKET_STATE_OPEN)
+    return TRUE;
+
+  /* Get serialized event: it is shared with all other clients */
+  bytes = melo_event_jsonrpc_render ();
+  if (!bytes)
+    return FALSE;
+
+  /* Send event */
+  soup_websocket_connection_send_text (ec->conn,
+                                       g_bytes_get_data (bytes, NULL));
+  g_bytes_unref (bytes);
+
+  return TRUE;
+}
+
+static void
+melo_httpd_event_message (SoupWebsocketConnection *conn, gint type,
+                          GBytes *message, gpointer user_data)
+{
+  MeloHTTPDEventClient *ec = user_data;
+  gchar **types, **ids;
+  JsonParser *parser;
+  JsonNode *node;
+  JsonObject *obj;
+  const gchar *data;
+  gsize size;
+
+  /* Only text message are supported */
+  if (type != SOUP_WEBSOCKET_DATA_TEXT)
+    return;
+
+  /* Parse filters */
+  data = g_bytes_get_data (message, &size);
+  parser = json_parser_new ();
+  if (!json_parser_load_from_data (parser, data, size, NULL) ||
+      (node = json_parser_get_root (parser)) == NULL ||
+      json_node_get_node_type (node) != JSON_NODE_OBJECT) {
+    g_object_unref (parser);
+    return;
+  }
+  obj = json_node_get_object (node);
+
+  /* Update coalescing interval */
+  if (json_object_has_member (obj, "interval")) {
+    gint64 interval = json_object_get_int_member (obj, "interval");
+    if (interval >= 0)
+      melo_event_client_set_coalescing (ec->client, interval);
+  }
+
+  /* Update filters */
+  types = melo_httpd_event_array_to_strv (obj, "types");
+  ids = melo_httpd_event_array_to_strv (obj, "ids");
+  melo_httpd_event_set_filters (ec, types, ids);
+  g_strfreev (types);
+  g_strfreev (ids);
+  g_object_unref (parser);
+}
+
+static void
+melo_httpd_event_closed (SoupWebsocketConnection *conn, gpointer user_data)
+{
+  MeloHTTPDEventClient *ec = user_data;
+
+  /* Unregister event client: no more callback can be called after */
+  melo_event_unregister (ec->client);
+
+  /* Free client */
+  if (ec->ids)
+    g_hash_table_unref (ec->ids);
+  g_object_unref (ec->conn);
+  g_slice_free (MeloHTTPDEventClient, ec);
+}
+
+void
+melo_httpd_event_handler (SoupServer *server,
+                          SoupWebsocketConnection *connection,
+                          const char *path, SoupClientContext *client,
+                          gpointer user_data)
+{
+  guint interval = MELO_HTTPD_EVENT_INTERVAL;
+  MeloHTTPDEventClient *ec;
+  GHashTable *query = NULL;
+  gchar **types = NULL;
+  gchar **ids = NULL;
+  SoupURI *uri;
+
+  /* Create new client */
+  ec = g_slice_new0 (MeloHTTPDEventClient);
+  ec->conn = g_object_ref (connection);
+
+  /* Get initial filters from query */
+  uri = soup_websocket_connection_get_uri (connection);
+  if (uri && uri->query)
+    query = soup_form_decode (uri->query);
+  if (query) {
+    const gchar *value;
+
+    value = g_hash_table_lookup (query, "types");
+    if (value && *value)
+      types = g_strsplit (value, ",", -1);
+    value = g_hash_table_lookup (query, "ids");
+    if (value && *value)
+      ids = g_strsplit (value, ",", -1);
+    value = g_hash_table_lookup (query, "interval");
+    if (value && *value)
+      interval = g_ascii_strtoull (value, NULL, 10);
+    g_hash_table_unref (query);
+  }
+  melo_httpd_event_set_filters (ec, types, ids);
+  g_strfreev (types);
+  g_strfreev (ids);
+
+  /* Capture filter updates and connection end */
+  g_signal_connect (connection, "message",
+                    G_CALLBACK (melo_httpd_event_message), ec);
+  g_signal_connect (connection, "closed",
+                    G_CALLBACK (melo_httpd_event_closed), ec);
+
+  /* Register event client: events are delivered from the server context */
+  ec->client = melo_event_register_async (melo_httpd_event_callback, ec, NULL,
+                                          MELO_HTTPD_EVENT_QUEUE_SIZE);
+  melo_event_client_set_coalescing (ec->client, interval);
+}
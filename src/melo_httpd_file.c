@@ -26,11 +26,133 @@
 #include <glib/gstdio.h>
 
 #include "melo_httpd_file.h"
+#include "melo_httpd_encoding.h"
+#include "melo_httpd_cache.h"
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
+/*
+ * The files of the web root are kept in memory by a #MeloHTTPDFileCache, with
+ * their compressed variants computed once: the small files are preloaded
+ * from a thread when the server starts, or loaded on first hit. The cache is
+ * flushed when a file monitor reports a change in one of the directories
+ * holding a cached file, and files bigger than MELO_HTTPD_FILE_CACHE_FILE_MAX
+ * are always mapped from disk.
+ */
+
+/* Cache limits (in bytes) */
+#define MELO_HTTPD_FILE_CACHE_FILE_MAX (1024 * 1024)
+#define MELO_HTTPD_FILE_CACHE_SIZE_MAX (16 * 1024 * 1024)
+
+typedef struct {
+  gint ref_count;
+  gchar *path;
+
+  /* Validators */
+  time_t mtime;
+  gsize size;
+  gchar *etag;
+
+  /* Content and compressed variants */
+  GBytes *data;
+  GBytes *encoded[MELO_HTTPD_ENCODING_COUNT];
+  gboolean compressible;
+  gboolean precompressed;
+} MeloHTTPDFile;
+
+struct _MeloHTTPDFileCache {
+  gchar *root;
+
+  /* Cached files */
+  GMutex mutex;
+  GHashTable *files;
+  GHashTable *monitors;
+  gsize size;
+
+  /* Preload thread */
+  GThread *thread;
+  volatile gint stop;
+};
+
+/* Extensions of files which can be compressed */
+static const gchar *melo_httpd_file_compressible[] = {
+  ".html", ".htm", ".css", ".js", ".json", ".svg", ".txt", ".xml", ".map",
+};
+
+static gboolean
+melo_httpd_file_is_compressible (const gchar *path)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (melo_httpd_file_compressible); i++)
+    if (g_str_has_suffix (path, melo_httpd_file_compressible[i]))
+      return TRUE;
+  return FALSE;
+}
+
+static gboolean
+melo_httpd_file_append_ranges (SoupMessage *msg, SoupBuffer *buffer)
+{
+  SoupRange *ranges;
+  SoupBuffer *sub;
+  int count;
+
+  /* Get requested ranges */
+  if (!soup_message_headers_get_one (msg->request_headers, "Range"))
+    return FALSE;
+  if (!soup_message_headers_get_ranges (msg->request_headers, buffer->length,
+                                        &ranges, &count)) {
+    gchar *range;
+
+    /* Ranges are not satisfiable */
+    range = g_strdup_printf ("bytes */%lu", (gulong) buffer->length);
+    soup_message_headers_replace (msg->response_headers, "Content-Range",
+                                  range);
+    soup_message_set_status (msg, SOUP_STATUS_REQUESTED_RANGE_NOT_SATISFIABLE);
+    g_free (range);
+    return TRUE;
+  }
+
+  if (count == 1) {
+    /* Single range: send slice of file */
+    sub = soup_buffer_new_subbuffer (buffer, ranges[0].start,
+                                     ranges[0].end - ranges[0].start + 1);
+    soup_message_body_append_buffer (msg->response_body, sub);
+    soup_message_headers_set_content_range (msg->response_headers,
+                                            ranges[0].start, ranges[0].end,
+                                            buffer->length);
+    soup_buffer_free (sub);
+  } else {
+    SoupMultipart *multipart;
+    SoupMessageHeaders *headers;
+    int i;
+
+    /* Multiple ranges: send slices in a multipart body */
+    multipart = soup_multipart_new ("multipart/byteranges");
+    for (i = 0; i < count; i++) {
+      headers = soup_message_headers_new (SOUP_MESSAGE_HEADERS_MULTIPART);
+      soup_message_headers_set_content_range (headers, ranges[i].start,
+                                              ranges[i].end, buffer->length);
+      sub = soup_buffer_new_subbuffer (buffer, ranges[i].start,
+                                       ranges[i].end - ranges[i].start + 1);
+      soup_multipart_append_part (multipart, headers, sub);
+      soup_message_headers_free (headers);
+      soup_buffer_free (sub);
+    }
+    soup_multipart_to_message (multipart, msg->response_headers,
+                               msg->response_body);
+    soup_multipart_free (multipart);
+  }
+  soup_message_headers_free_ranges (msg->request_headers, ranges);
+
+  /* Set status to Partial Content */
+  soup_message_set_status (msg, SOUP_STATUS_PARTIAL_CONTENT);
+
+  return TRUE;
+}
+
 static int
 melo_httpd_strcmp (gconstpointer a, gconstpointer b)
 {
@@ -105,11 +227,372 @@ melo_httpd_list_directory (const char *f_path, const char *path)
   return list;
 }
 
+static MeloHTTPDFile *
+melo_httpd_file_new (const gchar *path, const GStatBuf *st, gboolean load,
+                     gboolean precompress)
+{
+  MeloHTTPDFile *f;
+  GMappedFile *mapping;
+  guint i;
+
+  /* Create file */
+  f = g_slice_new0 (MeloHTTPDFile);
+  f->ref_count = 1;
+  f->path = g_strdup (path);
+  f->mtime = st->st_mtime;
+  f->size = st->st_size;
+  f->compressible = melo_httpd_file_is_compressible (path);
+
+  /* The entity tag is weak when the file can be sent compressed */
+  f->etag = g_strdup_printf ("%s\"%lx-%lx\"", f->compressible ? "W/" : "",
+                             (gulong) f->mtime, (gulong) f->size);
+  if (!load)
+    return f;
+
+  /* Map file into memory */
+  mapping = g_mapped_file_new (path, FALSE, NULL);
+  if (!mapping) {
+    g_free (f->etag);
+    g_free (f->path);
+    g_slice_free (MeloHTTPDFile, f);
+    return NULL;
+  }
+  f->data = g_mapped_file_get_bytes (mapping);
+  g_mapped_file_unref (mapping);
+
+  /* Compress file once with all supported encodings */
+  if (!precompress || !f->compressible)
+    return f;
+  for (i = MELO_HTTPD_ENCODING_IDENTITY + 1; i < MELO_HTTPD_ENCODING_COUNT;
+       i++) {
+    MeloHTTPDEncoder *enc;
+    gconstpointer data;
+    GBytes *bytes;
+    gsize size;
+
+    enc = melo_httpd_encoder_new (i);
+    if (!enc)
+      continue;
+    data = g_bytes_get_data (f->data, &size);
+    bytes = melo_httpd_encoder_encode (enc, data, size,
+                                       G_CONVERTER_INPUT_AT_END);
+    melo_httpd_encoder_free (enc);
+
+    /* Keep variant only if smaller */
+    if (bytes && g_bytes_get_size (bytes) < size)
+      f->encoded[i] = bytes;
+    else if (bytes)
+      g_bytes_unref (bytes);
+  }
+  f->precompressed = TRUE;
+
+  return f;
+}
+
+static MeloHTTPDFile *
+melo_httpd_file_ref (MeloHTTPDFile *f)
+{
+  g_atomic_int_inc (&f->ref_count);
+  return f;
+}
+
+static void
+melo_httpd_file_unref (MeloHTTPDFile *f)
+{
+  guint i;
+
+  if (!g_atomic_int_dec_and_test (&f->ref_count))
+    return;
+
+  for (i = 0; i < MELO_HTTPD_ENCODING_COUNT; i++)
+    if (f->encoded[i])
+      g_bytes_unref (f->encoded[i]);
+  if (f->data)
+    g_bytes_unref (f->data);
+  g_free (f->etag);
+  g_free (f->path);
+  g_slice_free (MeloHTTPDFile, f);
+}
+
+static gsize
+melo_httpd_file_get_memory_size (MeloHTTPDFile *f)
+{
+  gsize size = f->size;
+  guint i;
+
+  for (i = 0; i < MELO_HTTPD_ENCODING_COUNT; i++)
+    if (f->encoded[i])
+      size += g_bytes_get_size (f->encoded[i]);
+  return size;
+}
+
+static void
+melo_httpd_file_send (SoupMessage *msg, MeloHTTPDFile *f)
+{
+  MeloHTTPDEncoding encoding;
+  SoupBuffer *buffer;
+  gsize min_size = 0;
+
+  /* Files can change: the client must always revalidate its copy */
+  melo_httpd_cache_set_control (msg, "no-cache");
+  if (melo_httpd_cache_check (msg, f->etag, f->mtime))
+    return;
+
+  /* Byte ranges are supported */
+  soup_message_headers_replace (msg->response_headers, "Accept-Ranges",
+                                "bytes");
+
+  /* Only headers are requested */
+  if (msg->method == SOUP_METHOD_HEAD || !f->data) {
+    char *length;
+
+    /* Get file length and fill the Content-length header */
+    length = g_strdup_printf ("%lu", (gulong) f->size);
+    soup_message_headers_append (msg->response_headers,
+                                 "Content-Length", length);
+    soup_message_set_status (msg, SOUP_STATUS_OK);
+    g_free (length);
+    return;
+  }
+
+  /* Create a buffer to handle the file */
+  buffer = soup_buffer_new_with_owner (g_bytes_get_data (f->data, NULL),
+                                       g_bytes_get_size (f->data),
+                                       g_bytes_ref (f->data),
+                                       (GDestroyNotify) g_bytes_unref);
+
+  /* Append only requested ranges when the client copy is still valid */
+  if (melo_httpd_cache_check_range (msg, f->etag, f->mtime) &&
+      melo_httpd_file_append_ranges (msg, buffer)) {
+    soup_buffer_free (buffer);
+    return;
+  }
+
+  /* Set status to OK */
+  soup_message_set_status (msg, SOUP_STATUS_OK);
+
+  /* Send compressed variant */
+  encoding = melo_httpd_encoding_get (msg, &min_size);
+  if (f->precompressed) {
+    if (!f->encoded[encoding] || f->size < min_size)
+      encoding = MELO_HTTPD_ENCODING_IDENTITY;
+    if (encoding == MELO_HTTPD_ENCODING_IDENTITY)
+      soup_message_body_append_buffer (msg->response_body, buffer);
+    else
+      soup_message_body_append_bytes (msg->response_body,
+                                      f->encoded[encoding]);
+    melo_httpd_encoding_set_headers (msg, encoding);
+    soup_buffer_free (buffer);
+    return;
+  }
+
+  /* Append buffer to message */
+  soup_message_body_append_buffer (msg->response_body, buffer);
+  soup_buffer_free (buffer);
+
+  /* Compress text files */
+  if (f->compressible)
+    melo_httpd_encoding_compress (msg);
+}
+
+static MeloHTTPDFile *
+melo_httpd_file_cache_lookup (MeloHTTPDFileCache *cache, const gchar *path)
+{
+  MeloHTTPDFile *f;
+
+  g_mutex_lock (&cache->mutex);
+  f = g_hash_table_lookup (cache->files, path);
+  if (f)
+    melo_httpd_file_ref (f);
+  g_mutex_unlock (&cache->mutex);
+
+  return f;
+}
+
+static void
+melo_httpd_file_cache_changed (GFileMonitor *monitor, GFile *file,
+                               GFile *other_file, GFileMonitorEvent event,
+                               gpointer user_data)
+{
+  MeloHTTPDFileCache *cache = user_data;
+
+  /* Flush cache: files are reloaded on next hit */
+  g_mutex_lock (&cache->mutex);
+  g_hash_table_remove_all (cache->files);
+  cache->size = 0;
+  g_mutex_unlock (&cache->mutex);
+}
+
+static gboolean
+melo_httpd_file_cache_monitor (MeloHTTPDFileCache *cache, const gchar *path)
+{
+  GFileMonitor *monitor;
+  gchar *dir;
+  GFile *file;
+
+  /* Directory is already monitored */
+  dir = g_path_get_dirname (path);
+  if (g_hash_table_contains (cache->monitors, dir)) {
+    g_free (dir);
+    return TRUE;
+  }
+
+  /* Monitor directory */
+  file = g_file_new_for_path (dir);
+  monitor = g_file_monitor_directory (file, G_FILE_MONITOR_NONE, NULL, NULL);
+  g_object_unref (file);
+  if (!monitor) {
+    g_free (dir);
+    return FALSE;
+  }
+  g_signal_connect (monitor, "changed",
+                    G_CALLBACK (melo_httpd_file_cache_changed), cache);
+  g_hash_table_insert (cache->monitors, dir, monitor);
+
+  return TRUE;
+}
+
+static gboolean
+melo_httpd_file_cache_add (MeloHTTPDFileCache *cache, const gchar *path,
+                           MeloHTTPDFile *f)
+{
+  gsize size = melo_httpd_file_get_memory_size (f);
+  gboolean ret = FALSE;
+
+  g_mutex_lock (&cache->mutex);
+
+  /* Add file if cache is not full and changes can be detected */
+  if (!g_hash_table_contains (cache->files, path) &&
+      cache->size + size <= MELO_HTTPD_FILE_CACHE_SIZE_MAX &&
+      melo_httpd_file_cache_monitor (cache, f->path)) {
+    g_hash_table_insert (cache->files, g_strdup (path),
+                         melo_httpd_file_ref (f));
+    cache->size += size;
+    ret = TRUE;
+  }
+
+  g_mutex_unlock (&cache->mutex);
+
+  return ret;
+}
+
+static void
+melo_httpd_file_cache_load_dir (MeloHTTPDFileCache *cache, const gchar *dir,
+                                const gchar *path)
+{
+  const gchar *name;
+  GDir *d;
+
+  /* Open directory */
+  d = g_dir_open (dir, 0, NULL);
+  if (!d)
+    return;
+
+  /* Load all small files */
+  while (!g_atomic_int_get (&cache->stop) && (name = g_dir_read_name (d))) {
+    gchar *f_path, *r_path;
+    MeloHTTPDFile *f;
+    GStatBuf st;
+
+    f_path = g_build_filename (dir, name, NULL);
+    if (g_stat (f_path, &st) == -1) {
+      g_free (f_path);
+      continue;
+    }
+
+    if (S_ISDIR (st.st_mode)) {
+      /* Load sub-directory */
+      r_path = g_strdup_printf ("%s%s/", path, name);
+      melo_httpd_file_cache_load_dir (cache, f_path, r_path);
+    } else if (S_ISREG (st.st_mode) &&
+               st.st_size <= MELO_HTTPD_FILE_CACHE_FILE_MAX) {
+      /* Load file */
+      r_path = g_strdup_printf ("%s%s", path, name);
+      f = melo_httpd_file_new (f_path, &st, TRUE, TRUE);
+      if (f) {
+        if (melo_httpd_file_cache_add (cache, r_path, f) &&
+            !strcmp (name, "index.html"))
+          melo_httpd_file_cache_add (cache, path, f);
+        melo_httpd_file_unref (f);
+      }
+    } else
+      r_path = NULL;
+
+    g_free (r_path);
+    g_free (f_path);
+  }
+
+  g_dir_close (d);
+}
+
+static gpointer
+melo_httpd_file_cache_thread (gpointer user_data)
+{
+  MeloHTTPDFileCache *cache = user_data;
+
+  melo_httpd_file_cache_load_dir (cache, cache->root, "/");
+
+  return NULL;
+}
+
+MeloHTTPDFileCache *
+melo_httpd_file_cache_new (const gchar *root)
+{
+  MeloHTTPDFileCache *cache;
+
+  cache = g_slice_new0 (MeloHTTPDFileCache);
+  cache->root = g_strdup (root);
+  g_mutex_init (&cache->mutex);
+  cache->files = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                       (GDestroyNotify) melo_httpd_file_unref);
+  cache->monitors = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                          g_object_unref);
+
+  return cache;
+}
+
+void
+melo_httpd_file_cache_preload (MeloHTTPDFileCache *cache)
+{
+  /* Preload is already started */
+  if (cache->thread)
+    return;
+
+  cache->thread = g_thread_new ("httpd_preload", melo_httpd_file_cache_thread,
+                                cache);
+}
+
+void
+melo_httpd_file_cache_free (MeloHTTPDFileCache *cache)
+{
+  GHashTableIter iter;
+  gpointer monitor;
+
+  /* Stop preload */
+  g_atomic_int_set (&cache->stop, TRUE);
+  if (cache->thread)
+    g_thread_join (cache->thread);
+
+  /* Stop monitors */
+  g_hash_table_iter_init (&iter, cache->monitors);
+  while (g_hash_table_iter_next (&iter, NULL, &monitor))
+    g_file_monitor_cancel (monitor);
+
+  g_hash_table_unref (cache->monitors);
+  g_hash_table_unref (cache->files);
+  g_mutex_clear (&cache->mutex);
+  g_free (cache->root);
+  g_slice_free (MeloHTTPDFileCache, cache);
+}
+
 void
 melo_httpd_file_handler (SoupServer *server, SoupMessage *msg,
                          const char *path, GHashTable *query,
                          SoupClientContext *client, gpointer user_data)
 {
+  MeloHTTPDFileCache *cache = user_data;
+  gboolean cacheable;
+  MeloHTTPDFile *f;
   GStatBuf st;
   char *f_path;
 
@@ -119,6 +602,14 @@ melo_httpd_file_handler (SoupServer *server, SoupMessage *msg,
     return;
   }
 
+  /* File is in cache: no need to access disk */
+  f = cache ? melo_httpd_file_cache_lookup (cache, path) : NULL;
+  if (f) {
+    melo_httpd_file_send (msg, f);
+    melo_httpd_file_unref (f);
+    return;
+  }
+
   /* Generate absolute path in file system */
   f_path = g_strdup_printf (MELO_DATA_DIR "/www/%s", path);
 
@@ -168,6 +659,7 @@ melo_httpd_file_handler (SoupServer *server, SoupMessage *msg,
       soup_message_set_response (msg, "text/html", SOUP_MEMORY_TAKE,
                                  list->str, list->len);
       soup_message_set_status (msg, SOUP_STATUS_OK);
+      melo_httpd_encoding_compress (msg);
       g_string_free (list, FALSE);
       g_free (f_path);
       return;
@@ -178,41 +670,20 @@ melo_httpd_file_handler (SoupServer *server, SoupMessage *msg,
     f_path = index_path;
   }
 
-  /* Check request method */
-  if (msg->method == SOUP_METHOD_GET) {
-    GMappedFile *mapping;
-    SoupBuffer *buffer;
-
-    /* Map file into memory */
-    mapping = g_mapped_file_new (f_path, FALSE, NULL);
-    if (!mapping) {
-      soup_message_set_status (msg, SOUP_STATUS_INTERNAL_SERVER_ERROR);
-      g_free (f_path);
-      return;
-    }
-
-    /* Create a buffer to handle the file */
-    buffer = soup_buffer_new_with_owner (g_mapped_file_get_contents (mapping),
-                                         g_mapped_file_get_length (mapping),
-                                         mapping,
-                                         (GDestroyNotify) g_mapped_file_unref);
-
-    /* Append buffer to message */
-    soup_message_body_append_buffer (msg->response_body, buffer);
-    soup_buffer_free (buffer);
-  } else {
-    char *length;
-
-    /* Get file length and fill the Content-length header */
-    length = g_strdup_printf ("%lu", (gulong) st.st_size);
-    soup_message_headers_append (msg->response_headers,
-                                 "Content-Length", length);
-    g_free (length);
+  /* Load file: small files are kept in cache */
+  cacheable = cache && st.st_size <= MELO_HTTPD_FILE_CACHE_FILE_MAX;
+  f = melo_httpd_file_new (f_path, &st,
+                           msg->method == SOUP_METHOD_GET || cacheable,
+                           cacheable);
+  g_free (f_path);
+  if (!f) {
+    soup_message_set_status (msg, SOUP_STATUS_INTERNAL_SERVER_ERROR);
+    return;
   }
+  if (cacheable)
+    melo_httpd_file_cache_add (cache, path, f);
 
-  /* Set status to OK */
-  soup_message_set_status (msg, SOUP_STATUS_OK);
-
-  /* Free absolute path */
-  g_free (f_path);
+  /* Send file */
+  melo_httpd_file_send (msg, f);
+  melo_httpd_file_unref (f);
 }
@@ -25,6 +25,12 @@
 #include <glib.h>
 #include <libsoup/soup.h>
 
+typedef struct _MeloHTTPDFileCache MeloHTTPDFileCache;
+
+MeloHTTPDFileCache *melo_httpd_file_cache_new (const gchar *root);
+void melo_httpd_file_cache_preload (MeloHTTPDFileCache *cache);
+void melo_httpd_file_cache_free (MeloHTTPDFileCache *cache);
+
 void melo_httpd_file_handler (SoupServer *server, SoupMessage *msg,
                               const char *path, GHashTable *query,
                               SoupClientContext *client, gpointer user_data);
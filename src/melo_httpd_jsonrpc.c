@@ -25,34 +25,251 @@
 
 #include "melo_jsonrpc.h"
 
+#include "melo_httpd_pool.h"
 #include "melo_httpd_jsonrpc.h"
+#include "melo_httpd_encoding.h"
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
 
+/*
+ * The JSON-RPC responses are streamed with a chunked encoding: the request is
+ * parsed in a thread of the pool and each chunk of the serialized response is
+ * queued and then appended to the message body from the main context of the
+ * server, since libsoup is not thread-safe.
+ *
+ * The response is held until its size reaches the minimum size for
+ * compression, in order to select the content encoding before sending the
+ * headers: small responses are always sent uncompressed.
+ *
+ * The requests are dispatched to a thread pool depending on the priority of
+ * their methods, found with melo_jsonrpc_get_priority(): the control calls are
+ * never queued behind slow bulk calls.
+ *
+ * When the request is sent with the "application/cbor" content type, it is
+ * decoded from CBOR and the response is encoded in CBOR: it is then sent in a
+ * single chunk.
+ *
+ * A #GCancellable is set as current (see g_cancellable_get_current()) while
+ * the request is parsed: it is cancelled when the message is finished before
+ * the end of the response, which happens when the client closes the
+ * connection, so long methods can stop as soon as possible.
+ */
+
+#define MELO_HTTPD_JSONRPC_CBOR_TYPE "application/cbor"
+
+typedef struct {
+  SoupServer *server;
+  SoupMessage *msg;
+
+  /* Time of reception */
+  gint64 queued;
+
+  /* Request and response are encoded in CBOR */
+  gboolean cbor;
+
+  /* Cancelled when client goes away */
+  GCancellable *cancellable;
+
+  /* Content encoding */
+  MeloHTTPDEncoding encoding;
+  MeloHTTPDEncoder *encoder;
+  gsize min_size;
+
+  /* Pending chunks */
+  GMutex mutex;
+  GQueue chunks;
+  gsize size;
+  gboolean started;
+  gboolean scheduled;
+  gboolean done;
+} MeloHTTPDJSONRPCStream;
+
+static void
+melo_httpd_jsonrpc_stream_free (MeloHTTPDJSONRPCStream *s)
+{
+  GBytes *bytes;
+
+  while ((bytes = g_queue_pop_head (&s->chunks)))
+    g_bytes_unref (bytes);
+  if (s->encoder)
+    melo_httpd_encoder_free (s->encoder);
+  g_object_unref (s->cancellable);
+  g_mutex_clear (&s->mutex);
+  g_object_unref (s->msg);
+  g_object_unref (s->server);
+  g_slice_free (MeloHTTPDJSONRPCStream, s);
+}
+
+static void
+melo_httpd_jsonrpc_stream_start (MeloHTTPDJSONRPCStream *s, gsize size)
+{
+  MeloHTTPDEncoding encoding = s->encoding;
+
+  /* Response is too small to be compressed */
+  if (size < s->min_size)
+    encoding = MELO_HTTPD_ENCODING_IDENTITY;
+
+  /* Create encoder */
+  if (encoding != MELO_HTTPD_ENCODING_IDENTITY) {
+    s->encoder = melo_httpd_encoder_new (encoding);
+    if (!s->encoder)
+      encoding = MELO_HTTPD_ENCODING_IDENTITY;
+  }
+
+  /* Set headers before first chunk */
+  melo_httpd_encoding_set_headers (s->msg, encoding);
+}
+
+static gboolean
+melo_httpd_jsonrpc_stream_idle (gpointer user_data)
+{
+  MeloHTTPDJSONRPCStream *s = user_data;
+  gboolean start = FALSE;
+  gboolean finished = FALSE;
+  GConverterFlags flags;
+  GQueue chunks;
+  GBytes *bytes;
+  gboolean done;
+  gsize size;
+
+  g_mutex_lock (&s->mutex);
+
+  /* Wait for enough data to select content encoding */
+  if (!s->started) {
+    if (!s->done && s->size < s->min_size) {
+      s->scheduled = FALSE;
+      g_mutex_unlock (&s->mutex);
+      return G_SOURCE_REMOVE;
+    }
+    s->started = start = TRUE;
+  }
+
+  /* Get pending chunks */
+  chunks = s->chunks;
+  g_queue_init (&s->chunks);
+  s->scheduled = FALSE;
+  done = s->done;
+  size = s->size;
+
+  g_mutex_unlock (&s->mutex);
+
+  /* First chunk: select content encoding */
+  if (start)
+    melo_httpd_jsonrpc_stream_start (s, size);
+
+  /* Append pending chunks to response */
+  while ((bytes = g_queue_pop_head (&chunks))) {
+    /* Compress chunk: flush output with the last one */
+    if (s->encoder) {
+      gconstpointer data;
+      GBytes *out;
+      gsize len;
+
+      flags = G_CONVERTER_NO_FLAGS;
+      if (g_queue_is_empty (&chunks)) {
+        flags = done ? G_CONVERTER_INPUT_AT_END : G_CONVERTER_FLUSH;
+        finished = done;
+      }
+      data = g_bytes_get_data (bytes, &len);
+      out = melo_httpd_encoder_encode (s->encoder, data, len, flags);
+      g_bytes_unref (bytes);
+      bytes = out;
+      if (!bytes)
+        continue;
+    }
+
+    /* An empty chunk would end the response */
+    if (g_bytes_get_size (bytes))
+      soup_message_body_append_bytes (s->msg->response_body, bytes);
+    g_bytes_unref (bytes);
+  }
+
+  /* Terminate compressed stream */
+  if (done && s->encoder && !finished) {
+    bytes = melo_httpd_encoder_encode (s->encoder, NULL, 0,
+                                       G_CONVERTER_INPUT_AT_END);
+    if (bytes && g_bytes_get_size (bytes))
+      soup_message_body_append_bytes (s->msg->response_body, bytes);
+    if (bytes)
+      g_bytes_unref (bytes);
+  }
+
+  /* Last chunk */
+  if (done)
+    soup_message_body_complete (s->msg->response_body);
+
+  /* Resume message to send chunks */
+  soup_server_unpause_message (s->server, s->msg);
+
+  /* Response is complete */
+  if (done)
+    melo_httpd_jsonrpc_stream_free (s);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+melo_httpd_jsonrpc_stream_push (MeloHTTPDJSONRPCStream *s, GBytes *bytes,
+                                gboolean done)
+{
+  gboolean schedule;
+
+  /* Queue chunk and schedule flush in main context */
+  g_mutex_lock (&s->mutex);
+  if (bytes) {
+    g_queue_push_tail (&s->chunks, bytes);
+    s->size += g_bytes_get_size (bytes);
+  }
+  if (done)
+    s->done = TRUE;
+  schedule = !s->scheduled;
+  s->scheduled = TRUE;
+  g_mutex_unlock (&s->mutex);
+
+  if (schedule)
+    g_idle_add (melo_httpd_jsonrpc_stream_idle, s);
+}
+
+static void
+melo_httpd_jsonrpc_write (gchar *data, gsize size, gpointer user_data)
+{
+  melo_httpd_jsonrpc_stream_push (user_data, g_bytes_new_take (data, size),
+                                  FALSE);
+}
+
 void
 melo_httpd_jsonrpc_thread_handler (gpointer data, gpointer user_data)
 {
-  SoupServer *server = SOUP_SERVER (user_data);
-  SoupMessage *msg = SOUP_MESSAGE (data);
+  MeloHTTPDJSONRPCStream *s = data;
+  SoupMessage *msg = s->msg;
   GError *err = NULL;
-  char *res;
 
-  /* Parse request */
-  res = melo_jsonrpc_parse_request (msg->request_body->data,
-                                    msg->request_body->length,
-                                    &err);
+  /* Record time spent in thread pool queue */
+  melo_jsonrpc_add_queue_time (g_get_monotonic_time () - s->queued);
 
-  /* Set response status */
-  soup_message_set_status (msg, SOUP_STATUS_OK);
+  /* Set cancellable for methods */
+  g_cancellable_push_current (s->cancellable);
+
+  /* Parse request and stream response */
+  if (s->cbor) {
+    GBytes *bytes;
+
+    bytes = melo_jsonrpc_parse_request_cbor (msg->request_body->data,
+                                             msg->request_body->length, &err);
+    if (bytes)
+      melo_httpd_jsonrpc_stream_push (s, bytes, FALSE);
+  } else
+    melo_jsonrpc_parse_request_stream (msg->request_body->data,
+                                       msg->request_body->length,
+                                       melo_httpd_jsonrpc_write, s, &err);
+  g_clear_error (&err);
+  g_cancellable_pop_current (s->cancellable);
 
-  /* Set response */
-  if (res)
-    soup_message_set_response (msg, "application/json", SOUP_MEMORY_TAKE,
-                               res, strlen (res));
-  soup_server_unpause_message (server, msg);
+  /* End of response */
+  melo_httpd_jsonrpc_stream_push (s, NULL, TRUE);
 }
 
 void
@@ -60,7 +277,11 @@ melo_httpd_jsonrpc_handler (SoupServer *server, SoupMessage *msg,
                             const char *path, GHashTable *query,
                             SoupClientContext *client, gpointer user_data)
 {
-  GThreadPool *pool = (GThreadPool *) user_data;
+  MeloHTTPDPool **pools = (MeloHTTPDPool **) user_data;
+  MeloJSONRPCPriority priority;
+  MeloHTTPDJSONRPCStream *s;
+  const gchar *type;
+  gboolean cbor;
 
   /* We only support POST method */
   if (msg->method != SOUP_METHOD_POST) {
@@ -74,7 +295,47 @@ melo_httpd_jsonrpc_handler (SoupServer *server, SoupMessage *msg,
     return;
   }
 
-  /* Push request to thread pool */
+  /* Get request encoding */
+  type = soup_message_headers_get_content_type (msg->request_headers, NULL);
+  cbor = type && !g_ascii_strcasecmp (type, MELO_HTTPD_JSONRPC_CBOR_TYPE);
+
+  /* Get request priority */
+  if (cbor)
+    priority = melo_jsonrpc_get_priority_cbor (msg->request_body->data,
+                                               msg->request_body->length);
+  else
+    priority = melo_jsonrpc_get_priority (msg->request_body->data,
+                                          msg->request_body->length);
+
+  /* Too many requests are waiting in thread pool of this priority */
+  if (melo_httpd_pool_reject (pools[priority], msg))
+    return;
+
+  /* Prepare a chunked response: the body is not kept after sending */
+  soup_message_set_status (msg, SOUP_STATUS_OK);
+  soup_message_headers_set_encoding (msg->response_headers,
+                                     SOUP_ENCODING_CHUNKED);
+  soup_message_headers_set_content_type (msg->response_headers,
+                                         cbor ? MELO_HTTPD_JSONRPC_CBOR_TYPE :
+                                                "application/json", NULL);
+  soup_message_body_set_accumulate (msg->response_body, FALSE);
+
+  /* Create stream: message reference is released with it */
+  s = g_slice_new0 (MeloHTTPDJSONRPCStream);
+  s->server = g_object_ref (server);
+  s->msg = g_object_ref (msg);
+  s->queued = g_get_monotonic_time ();
+  s->cbor = cbor;
+  s->encoding = melo_httpd_encoding_get (msg, &s->min_size);
+  g_mutex_init (&s->mutex);
+  g_queue_init (&s->chunks);
+
+  /* Cancel request when message is aborted */
+  s->cancellable = g_cancellable_new ();
+  g_signal_connect_object (msg, "finished", G_CALLBACK (g_cancellable_cancel),
+                           s->cancellable, G_CONNECT_SWAPPED);
+
+  /* Push request to thread pool of its priority */
   soup_server_pause_message (server, msg);
-  g_thread_pool_push (pool, msg, NULL);
+  melo_httpd_pool_push (pools[priority], s);
 }
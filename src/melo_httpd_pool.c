@@ -0,0 +1,308 @@
+/*
+ * melo_httpd_pool.c: Thread pools of Melo HTTP server
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#include "melo_httpd_pool.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/*
+ * A pool wraps a #GThreadPool and records the time spent by each request in
+ * its queue, in order to provide two features:
+ *  - in adaptive mode, the number of threads is adjusted periodically with
+ *    melo_httpd_pool_adapt(): it grows when requests are waiting in queue or
+ *    when the average waiting time exceeds a target, and it shrinks by one
+ *    after some idle periods, down to the number of CPUs,
+ *  - with a queue limit, new requests are rejected by
+ *    melo_httpd_pool_reject() with a 503 (Service Unavailable) and a
+ *    Retry-After header estimated from the average waiting time, instead of
+ *    letting the latency grow without bound.
+ */
+
+/* Target of average waiting time in queue (in us) */
+#define MELO_HTTPD_POOL_TARGET_WAIT (50 * G_TIME_SPAN_MILLISECOND)
+
+/* Number of idle periods before releasing a thread */
+#define MELO_HTTPD_POOL_SHRINK_PERIODS 5
+
+/* Maximum value of Retry-After (in s) */
+#define MELO_HTTPD_POOL_RETRY_MAX 30
+
+struct _MeloHTTPDPool {
+  GMutex mutex;
+  GThreadPool *pool;
+  GFunc func;
+  gpointer user_data;
+
+  /* Thread count */
+  guint max_threads;
+  guint min_threads;
+  guint threads;
+  gboolean adaptive;
+  guint idle_periods;
+
+  /* Back-pressure */
+  guint queue_limit;
+  guint64 rejected;
+
+  /* Waiting time in queue */
+  gint64 wait_sum;
+  guint wait_count;
+  gint64 wait_avg;
+};
+
+typedef struct {
+  gpointer data;
+  gint64 queued;
+} MeloHTTPDPoolJob;
+
+static void
+melo_httpd_pool_func (gpointer data, gpointer user_data)
+{
+  MeloHTTPDPoolJob *job = data;
+  MeloHTTPDPool *pool = user_data;
+  gint64 wait = g_get_monotonic_time () - job->queued;
+
+  /* Record waiting time */
+  g_mutex_lock (&pool->mutex);
+  pool->wait_sum += wait;
+  pool->wait_count++;
+  g_mutex_unlock (&pool->mutex);
+
+  /* Handle request */
+  pool->func (job->data, pool->user_data);
+  g_slice_free (MeloHTTPDPoolJob, job);
+}
+
+MeloHTTPDPool *
+melo_httpd_pool_new (GFunc func, gpointer user_data, guint max_threads)
+{
+  MeloHTTPDPool *pool;
+
+  /* Allocate pool */
+  pool = g_slice_new0 (MeloHTTPDPool);
+  g_mutex_init (&pool->mutex);
+  pool->func = func;
+  pool->user_data = user_data;
+  pool->max_threads = max_threads ? max_threads : 1;
+  pool->min_threads = MIN (g_get_num_processors (), pool->max_threads);
+  pool->threads = pool->max_threads;
+  pool->queue_limit = MELO_HTTPD_POOL_QUEUE_LIMIT;
+
+  /* Create thread pool */
+  pool->pool = g_thread_pool_new (melo_httpd_pool_func, pool,
+                                  pool->threads, FALSE, NULL);
+
+  return pool;
+}
+
+void
+melo_httpd_pool_free (MeloHTTPDPool *pool)
+{
+  if (!pool)
+    return;
+
+  /* Free thread pool: waiting requests are dropped */
+  g_thread_pool_free (pool->pool, TRUE, FALSE);
+
+  /* Free pool */
+  g_mutex_clear (&pool->mutex);
+  g_slice_free (MeloHTTPDPool, pool);
+}
+
+void
+melo_httpd_pool_push (MeloHTTPDPool *pool, gpointer data)
+{
+  MeloHTTPDPoolJob *job;
+
+  /* Create job */
+  job = g_slice_new (MeloHTTPDPoolJob);
+  job->data = data;
+  job->queued = g_get_monotonic_time ();
+
+  /* Push to queue: the queue limit is not checked here */
+  g_thread_pool_push (pool->pool, job, NULL);
+}
+
+gboolean
+melo_httpd_pool_reject (MeloHTTPDPool *pool, SoupMessage *msg)
+{
+  gint64 retry;
+  gchar *value;
+
+  /* Check queue limit */
+  g_mutex_lock (&pool->mutex);
+  if (!pool->queue_limit ||
+      g_thread_pool_unprocessed (pool->pool) < pool->queue_limit) {
+    g_mutex_unlock (&pool->mutex);
+    return FALSE;
+  }
+  pool->rejected++;
+
+  /* Estimate when the queue will be processed */
+  retry = pool->wait_avg / G_TIME_SPAN_SECOND + 1;
+  g_mutex_unlock (&pool->mutex);
+  retry = MIN (retry, MELO_HTTPD_POOL_RETRY_MAX);
+
+  /* Reply with service unavailable: the response must not be cached */
+  soup_message_set_status (msg, SOUP_STATUS_SERVICE_UNAVAILABLE);
+  soup_message_headers_replace (msg->response_headers, "Cache-Control",
+                                "no-store");
+  value = g_strdup_printf ("%" G_GINT64_FORMAT, retry);
+  soup_message_headers_replace (msg->response_headers, "Retry-After", value);
+  g_free (value);
+
+  return TRUE;
+}
+
+static void
+melo_httpd_pool_update_threads (MeloHTTPDPool *pool, guint threads)
+{
+  /* Set new thread count */
+  if (threads == pool->threads)
+    return;
+  pool->threads = threads;
+
+  if (!g_thread_pool_set_max_threads (pool->pool, threads, NULL))
+    g_warning ("failed to set thread pool size to %u", threads);
+}
+
+void
+melo_httpd_pool_set_max_threads (MeloHTTPDPool *pool, guint count)
+{
+  if (!count)
+    return;
+
+  g_mutex_lock (&pool->mutex);
+  pool->max_threads = count;
+  pool->min_threads = MIN (g_get_num_processors (), count);
+
+  /* Keep current count in adaptive mode if still in range */
+  if (pool->adaptive)
+    melo_httpd_pool_update_threads (pool,
+                                    CLAMP (pool->threads, pool->min_threads,
+                                           pool->max_threads));
+  else
+    melo_httpd_pool_update_threads (pool, count);
+  g_mutex_unlock (&pool->mutex);
+}
+
+void
+melo_httpd_pool_set_adaptive (MeloHTTPDPool *pool, gboolean enable)
+{
+  g_mutex_lock (&pool->mutex);
+  if (pool->adaptive == enable) {
+    g_mutex_unlock (&pool->mutex);
+    return;
+  }
+  pool->adaptive = enable;
+  pool->idle_periods = 0;
+
+  /* Start from minimal count in adaptive mode */
+  melo_httpd_pool_update_threads (pool, enable ? pool->min_threads :
+                                                 pool->max_threads);
+  g_mutex_unlock (&pool->mutex);
+}
+
+void
+melo_httpd_pool_set_queue_limit (MeloHTTPDPool *pool, guint limit)
+{
+  g_mutex_lock (&pool->mutex);
+  pool->queue_limit = limit;
+  g_mutex_unlock (&pool->mutex);
+}
+
+void
+melo_httpd_pool_adapt (MeloHTTPDPool *pool)
+{
+  guint queued, threads;
+
+  g_mutex_lock (&pool->mutex);
+
+  /* Update average waiting time of last period */
+  if (pool->wait_count)
+    pool->wait_avg = pool->wait_sum / pool->wait_count;
+  else
+    pool->wait_avg = 0;
+  pool->wait_sum = 0;
+  pool->wait_count = 0;
+
+  /* Thread count is fixed */
+  if (!pool->adaptive) {
+    g_mutex_unlock (&pool->mutex);
+    return;
+  }
+
+  /* Adjust thread count */
+  queued = g_thread_pool_unprocessed (pool->pool);
+  threads = pool->threads;
+  if (queued || pool->wait_avg > MELO_HTTPD_POOL_TARGET_WAIT) {
+    /* Requests are waiting: add a thread per waiting request */
+    threads = MIN (threads + MAX (queued, 1), pool->max_threads);
+    pool->idle_periods = 0;
+  } else if (++pool->idle_periods >= MELO_HTTPD_POOL_SHRINK_PERIODS) {
+    /* Pool is idle: release a thread */
+    if (threads > pool->min_threads)
+      threads--;
+    pool->idle_periods = 0;
+  }
+  melo_httpd_pool_update_threads (pool, threads);
+
+  g_mutex_unlock (&pool->mutex);
+}
+
+guint
+melo_httpd_pool_get_queued (MeloHTTPDPool *pool)
+{
+  return g_thread_pool_unprocessed (pool->pool);
+}
+
+guint
+melo_httpd_pool_get_threads (MeloHTTPDPool *pool)
+{
+  return g_thread_pool_get_num_threads (pool->pool);
+}
+
+guint
+melo_httpd_pool_get_max_threads (MeloHTTPDPool *pool)
+{
+  guint threads;
+
+  g_mutex_lock (&pool->mutex);
+  threads = pool->threads;
+  g_mutex_unlock (&pool->mutex);
+
+  return threads;
+}
+
+guint64
+melo_httpd_pool_get_rejected (MeloHTTPDPool *pool)
+{
+  guint64 rejected;
+
+  g_mutex_lock (&pool->mutex);
+  rejected = pool->rejected;
+  g_mutex_unlock (&pool->mutex);
+
+  return rejected;
+}
@@ -0,0 +1,53 @@
+/*
+ * melo_httpd_pool.h: Thread pools of Melo HTTP server
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __MELO_HTTPD_POOL_H__
+#define __MELO_HTTPD_POOL_H__
+
+#include <glib.h>
+#include <libsoup/soup.h>
+
+/* Default maximum number of requests waiting in a pool */
+#define MELO_HTTPD_POOL_QUEUE_LIMIT 64
+
+/* Period of thread count adaptation (in s) */
+#define MELO_HTTPD_POOL_ADAPT_PERIOD 1
+
+typedef struct _MeloHTTPDPool MeloHTTPDPool;
+
+MeloHTTPDPool *melo_httpd_pool_new (GFunc func, gpointer user_data,
+                                    guint max_threads);
+void melo_httpd_pool_free (MeloHTTPDPool *pool);
+
+void melo_httpd_pool_push (MeloHTTPDPool *pool, gpointer data);
+gboolean melo_httpd_pool_reject (MeloHTTPDPool *pool, SoupMessage *msg);
+
+void melo_httpd_pool_set_max_threads (MeloHTTPDPool *pool, guint count);
+void melo_httpd_pool_set_adaptive (MeloHTTPDPool *pool, gboolean enable);
+void melo_httpd_pool_set_queue_limit (MeloHTTPDPool *pool, guint limit);
+void melo_httpd_pool_adapt (MeloHTTPDPool *pool);
+
+guint melo_httpd_pool_get_queued (MeloHTTPDPool *pool);
+guint melo_httpd_pool_get_threads (MeloHTTPDPool *pool);
+guint melo_httpd_pool_get_max_threads (MeloHTTPDPool *pool);
+guint64 melo_httpd_pool_get_rejected (MeloHTTPDPool *pool);
+
+#endif /* __MELO_HTTPD_POOL_H__ */
@@ -0,0 +1,167 @@
+/*
+ * melo_httpd_stream.c: Encoded audio streams of sinks over HTTP
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "melo_sink.h"
+
+#include "melo_httpd_stream.h"
+
+/*
+ * The encoded stream of a sink is served on "/stream/<sink_id>" when it has
+ * been enabled with melo_sink_set_stream_format(). Each HTTP client is a
+ * listener of the #MeloSinkStream: the encoded chunks are shared by all the
+ * clients and appended to the chunked response without copy.
+ *
+ * The chunks sent to the socket are not accumulated in the response body. A
+ * client which is too slow is not fed while more than
+ * MELO_HTTPD_STREAM_MAX_PENDING bytes are waiting to be written: it then
+ * skips the chunks which are dropped from the stream meanwhile.
+ */
+
+#define MELO_HTTPD_STREAM_PATH "/stream/"
+#define MELO_HTTPD_STREAM_MAX_PENDING 262144
+
+typedef struct {
+  SoupServer *server;
+  SoupMessage *msg;
+  MeloSinkListener *listener;
+  gsize pending;
+  gboolean done;
+} MeloHTTPDStreamClient;
+
+static void
+melo_httpd_stream_listener_cb (MeloSinkListener *listener, gpointer user_data)
+{
+  MeloHTTPDStreamClient *client = user_data;
+  gboolean closed = FALSE, unpause = FALSE;
+  GBytes *chunk;
+
+  if (client->done)
+    return;
+
+  /* Append shared chunks to response */
+  while (client->pending < MELO_HTTPD_STREAM_MAX_PENDING &&
+         (chunk = melo_sink_listener_pop (listener, &closed))) {
+    SoupBuffer *buffer;
+    gconstpointer data;
+    gsize size;
+
+    data = g_bytes_get_data (chunk, &size);
+    buffer = soup_buffer_new_with_owner (data, size, chunk,
+                                         (GDestroyNotify) g_bytes_unref);
+    soup_message_body_append_buffer (client->msg->response_body, buffer);
+    soup_buffer_free (buffer);
+    client->pending += size;
+    unpause = TRUE;
+  }
+
+  /* End of stream */
+  if (closed && client->pending < MELO_HTTPD_STREAM_MAX_PENDING) {
+    soup_message_body_complete (client->msg->response_body);
+    client->done = TRUE;
+    unpause = TRUE;
+  }
+
+  /* Send new chunks */
+  if (unpause)
+    soup_server_unpause_message (client->server, client->msg);
+}
+
+static void
+melo_httpd_stream_wrote_body_data (SoupMessage *msg, SoupBuffer *chunk,
+                                   gpointer user_data)
+{
+  MeloHTTPDStreamClient *client = user_data;
+
+  /* Chunk has been written to socket */
+  client->pending -= MIN (chunk->length, client->pending);
+}
+
+static void
+melo_httpd_stream_finished (SoupMessage *msg, gpointer user_data)
+{
+  MeloHTTPDStreamClient *client = user_data;
+
+  /* Client has left */
+  melo_sink_stream_remove_listener (client->listener);
+  g_slice_free (MeloHTTPDStreamClient, client);
+}
+
+void
+melo_httpd_stream_handler (SoupServer *server, SoupMessage *msg,
+                           const char *path, GHashTable *query,
+                           SoupClientContext *client, gpointer user_data)
+{
+  MeloHTTPDStreamClient *c;
+  MeloSinkStream *stream;
+  MeloSink *sink;
+
+  /* Only GET is supported */
+  if (msg->method != SOUP_METHOD_GET) {
+    soup_message_set_status (msg, SOUP_STATUS_NOT_IMPLEMENTED);
+    return;
+  }
+
+  /* Find sink stream */
+  if (!g_str_has_prefix (path, MELO_HTTPD_STREAM_PATH) ||
+      !(sink = melo_sink_get_sink_by_id (path +
+                                         strlen (MELO_HTTPD_STREAM_PATH)))) {
+    soup_message_set_status (msg, SOUP_STATUS_NOT_FOUND);
+    return;
+  }
+  stream = melo_sink_get_stream (sink);
+  if (!stream) {
+    soup_message_set_status (msg, SOUP_STATUS_NOT_FOUND);
+    g_object_unref (sink);
+    return;
+  }
+
+  /* Prepare an endless chunked response */
+  soup_message_set_status (msg, SOUP_STATUS_OK);
+  soup_message_headers_set_content_type (msg->response_headers,
+                                      melo_sink_stream_get_mime_type (stream),
+                                      NULL);
+  soup_message_headers_set_encoding (msg->response_headers,
+                                     SOUP_ENCODING_CHUNKED);
+  soup_message_headers_append (msg->response_headers, "Cache-Control",
+                               "no-cache, no-store");
+  soup_message_headers_append (msg->response_headers, "icy-name",
+                               melo_sink_get_name (sink));
+  soup_message_body_set_accumulate (msg->response_body, FALSE);
+  g_object_unref (sink);
+
+  /* Add client as a stream listener */
+  c = g_slice_new0 (MeloHTTPDStreamClient);
+  c->server = server;
+  c->msg = msg;
+  c->listener = melo_sink_stream_add_listener (stream,
+                                               melo_httpd_stream_listener_cb,
+                                               c);
+  melo_sink_stream_unref (stream);
+  g_signal_connect (msg, "wrote-body-data",
+                    G_CALLBACK (melo_httpd_stream_wrote_body_data), c);
+  g_signal_connect (msg, "finished", G_CALLBACK (melo_httpd_stream_finished),
+                    c);
+
+  /* Wait for data */
+  soup_server_pause_message (server, msg);
+}
@@ -25,20 +25,58 @@
 #include <nm-device-wifi.h>
 #include <nm-setting-ip4-config.h>
 
+#include "melo_event.h"
+
 #include "melo_network.h"
 
+/* Default maximum age of a Wifi scan result (in s) */
+#define MELO_NETWORK_WIFI_SCAN_MAX_AGE 30
+
+/* Wifi scan cache entry: the access point list and timestamp are protected by
+ * the network mutex, while the device and the update source are only used
+ * from the main context, which owns the Network Manager client.
+ */
+typedef struct {
+  MeloNetwork *net;
+  gchar *iface;
+
+  /* Cached result */
+  GList *aps;
+  gint64 timestamp;
+  gboolean scanning;
+
+  /* Main context only */
+  NMDeviceWifi *wifi;
+  guint update_id;
+} MeloNetworkWifiScan;
+
 struct _MeloNetworkPrivate {
   NMClient *client;
+
+  /* Wifi scan cache */
+  GMutex mutex;
+  GHashTable *scans;
+  gint max_age;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (MeloNetwork, melo_network, G_TYPE_OBJECT)
 
+static void melo_network_wifi_scan_free (MeloNetworkWifiScan *scan);
+static void melo_network_wifi_scan_add (NMClient *client, NMDevice *dev,
+                                        gpointer user_data);
+
 static void
 melo_network_finalize (GObject *gobject)
 {
   MeloNetwork *net = MELO_NETWORK (gobject);
   MeloNetworkPrivate *priv = melo_network_get_instance_private (net);
 
+  /* Free Wifi scan cache */
+  if (priv->client)
+    g_signal_handlers_disconnect_by_data (priv->client, net);
+  g_hash_table_unref (priv->scans);
+  g_mutex_clear (&priv->mutex);
+
   /* Free Network Manager client */
   if (priv->client)
     g_object_unref (priv->client);
@@ -64,8 +102,26 @@ melo_network_init (MeloNetwork *self)
 
   self->priv = priv;
 
+  /* Init Wifi scan cache */
+  g_mutex_init (&priv->mutex);
+  priv->scans = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                 (GDestroyNotify) melo_network_wifi_scan_free);
+  priv->max_age = MELO_NETWORK_WIFI_SCAN_MAX_AGE;
+
   /* Create a new Network Manager client */
   priv->client = nm_client_new ();
+  if (priv->client) {
+    const GPtrArray *devs;
+    guint i;
+
+    /* Seed Wifi scan cache with known access points */
+    devs = nm_client_get_devices (priv->client);
+    for (i = 0; devs && i < devs->len; i++)
+      melo_network_wifi_scan_add (priv->client, g_ptr_array_index (devs, i),
+                                  self);
+    g_signal_connect (priv->client, "device-added",
+                      G_CALLBACK (melo_network_wifi_scan_add), self);
+  }
 }
 
 MeloNetwork *
@@ -270,25 +326,14 @@ melo_network_nm_ap_to_ap_item (NMAccessPoint *ap)
   return item;
 }
 
-GList *
-melo_network_wifi_scan (MeloNetwork *net, const gchar *name)
+static GList *
+melo_network_wifi_get_ap_list (NMDeviceWifi *wifi)
 {
-  MeloNetworkPrivate *priv = net->priv;
   NMAccessPoint *cur_ap;
-  NMDeviceWifi *wifi;
-  NMDevice *dev;
   const GPtrArray *aps;
   GList *list = NULL;
   guint i;
 
-  g_return_val_if_fail (priv->client, NULL);
-
-  /* Get device */
-  dev = nm_client_get_device_by_iface (priv->client, name);
-  if (!dev)
-    return NULL;
-  wifi = NM_DEVICE_WIFI (dev);
-
   /* Get active access point */
   cur_ap = nm_device_wifi_get_active_access_point (wifi);
 
@@ -318,6 +363,244 @@ melo_network_wifi_scan (MeloNetwork *net, const gchar *name)
   return list;
 }
 
+static MeloNetworkAP *
+melo_network_ap_copy (const MeloNetworkAP *ap)
+{
+  MeloNetworkAP *copy;
+
+  /* Copy access point */
+  copy = g_slice_dup (MeloNetworkAP, ap);
+  copy->bssid = g_strdup (ap->bssid);
+  copy->ssid = g_strdup (ap->ssid);
+
+  return copy;
+}
+
+static void
+melo_network_wifi_scan_free (MeloNetworkWifiScan *scan)
+{
+  /* Stop pending update */
+  if (scan->update_id)
+    g_source_remove (scan->update_id);
+
+  /* Release device */
+  if (scan->wifi) {
+    g_signal_handlers_disconnect_by_data (scan->wifi, scan);
+    g_object_unref (scan->wifi);
+  }
+
+  /* Free cached result */
+  g_list_free_full (scan->aps, (GDestroyNotify) melo_network_ap_free);
+  g_free (scan->iface);
+  g_slice_free (MeloNetworkWifiScan, scan);
+}
+
+static void
+melo_network_wifi_scan_update (MeloNetworkWifiScan *scan, gboolean done)
+{
+  MeloNetworkPrivate *priv = scan->net->priv;
+  gint64 timestamp;
+  GList *list;
+  guint count;
+
+  /* Get current access point list */
+  list = melo_network_wifi_get_ap_list (scan->wifi);
+  count = g_list_length (list);
+  timestamp = g_get_monotonic_time ();
+
+  /* Replace cached result */
+  g_mutex_lock (&priv->mutex);
+  g_list_free_full (scan->aps, (GDestroyNotify) melo_network_ap_free);
+  scan->aps = list;
+  scan->timestamp = timestamp;
+  if (done)
+    scan->scanning = FALSE;
+  g_mutex_unlock (&priv->mutex);
+
+  /* Notify clients */
+  melo_event_network_wifi_scan (scan->iface, count, timestamp);
+}
+
+static gboolean
+melo_network_wifi_scan_update_func (gpointer user_data)
+{
+  MeloNetworkWifiScan *scan = user_data;
+
+  /* Update cached result */
+  scan->update_id = 0;
+  melo_network_wifi_scan_update (scan, FALSE);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+melo_network_wifi_scan_changed (NMDeviceWifi *wifi, NMAccessPoint *ap,
+                                gpointer user_data)
+{
+  MeloNetworkWifiScan *scan = user_data;
+
+  /* Coalesce all changes of a scan in one update */
+  if (!scan->update_id)
+    scan->update_id = g_idle_add (melo_network_wifi_scan_update_func, scan);
+}
+
+static void
+melo_network_wifi_scan_cb (NMDeviceWifi *wifi, GError *error,
+                           gpointer user_data)
+{
+  MeloNetworkWifiScan *scan = user_data;
+  MeloNetwork *net = scan->net;
+
+  /* Scan request has failed: the last known list is still updated */
+  if (error)
+    g_debug ("network: failed to scan %s: %s", scan->iface, error->message);
+
+  /* Update cached result and allow a new scan */
+  melo_network_wifi_scan_update (scan, TRUE);
+  g_object_unref (net);
+}
+
+/* Called from main context for each new device */
+static void
+melo_network_wifi_scan_add (NMClient *client, NMDevice *dev,
+                            gpointer user_data)
+{
+  MeloNetwork *net = MELO_NETWORK (user_data);
+  MeloNetworkPrivate *priv = net->priv;
+  MeloNetworkWifiScan *scan;
+  const gchar *iface;
+  GList *list;
+
+  /* Only Wifi devices can be scanned */
+  if (!NM_IS_DEVICE_WIFI (dev))
+    return;
+  iface = nm_device_get_iface (dev);
+
+  /* Get or create cache entry */
+  g_mutex_lock (&priv->mutex);
+  scan = g_hash_table_lookup (priv->scans, iface);
+  if (!scan) {
+    scan = g_slice_new0 (MeloNetworkWifiScan);
+    scan->net = net;
+    scan->iface = g_strdup (iface);
+    g_hash_table_insert (priv->scans, scan->iface, scan);
+  }
+  g_mutex_unlock (&priv->mutex);
+
+  /* Device already tracked */
+  if (scan->wifi == NM_DEVICE_WIFI (dev))
+    return;
+
+  /* Device has been plugged again: track the new one */
+  if (scan->wifi) {
+    g_signal_handlers_disconnect_by_data (scan->wifi, scan);
+    g_object_unref (scan->wifi);
+  }
+  scan->wifi = NM_DEVICE_WIFI (g_object_ref (dev));
+
+  /* Results of a scan are reported after the request completes */
+  g_signal_connect (scan->wifi, "access-point-added",
+                    G_CALLBACK (melo_network_wifi_scan_changed), scan);
+  g_signal_connect (scan->wifi, "access-point-removed",
+                    G_CALLBACK (melo_network_wifi_scan_changed), scan);
+
+  /* Seed with access points already known by Network Manager: the timestamp
+   * is left to 0 until a first scan has completed
+   */
+  list = melo_network_wifi_get_ap_list (scan->wifi);
+  g_mutex_lock (&priv->mutex);
+  g_list_free_full (scan->aps, (GDestroyNotify) melo_network_ap_free);
+  scan->aps = list;
+  g_mutex_unlock (&priv->mutex);
+}
+
+static gboolean
+melo_network_wifi_scan_start (gpointer user_data)
+{
+  MeloNetworkWifiScan *scan = user_data;
+
+  /* Request a new scan */
+  nm_device_wifi_request_scan_simple (scan->wifi, melo_network_wifi_scan_cb,
+                                      scan);
+
+  return G_SOURCE_REMOVE;
+}
+
+void
+melo_network_set_wifi_scan_max_age (MeloNetwork *net, guint max_age)
+{
+  g_atomic_int_set (&net->priv->max_age, max_age);
+}
+
+/* Get the access point list of a Wifi interface from the scan cache: the call
+ * never blocks. When the cached list is older than max_age (or the default
+ * when negative), a single scan shared by all callers is started from the main
+ * context and a MELO_EVENT_NETWORK_WIFI_SCAN event is sent once the list has
+ * been updated. Until a first scan has completed, the list holds the access
+ * points already known by Network Manager and the timestamp is 0. The
+ * scanning flag is set while a scan is running.
+ */
+GList *
+melo_network_wifi_scan (MeloNetwork *net, const gchar *name, gint max_age,
+                        gint64 *timestamp, gboolean *scanning)
+{
+  MeloNetworkPrivate *priv = net->priv;
+  MeloNetworkWifiScan *scan;
+  gboolean start = FALSE;
+  GList *list = NULL, *l;
+  gint64 now;
+
+  g_return_val_if_fail (priv->client, NULL);
+
+  if (timestamp)
+    *timestamp = 0;
+  if (scanning)
+    *scanning = FALSE;
+  if (!name)
+    return NULL;
+
+  /* Get maximum age */
+  if (max_age < 0)
+    max_age = g_atomic_int_get (&priv->max_age);
+  now = g_get_monotonic_time ();
+
+  g_mutex_lock (&priv->mutex);
+
+  /* Get cache entry: not a Wifi device */
+  scan = g_hash_table_lookup (priv->scans, name);
+  if (!scan) {
+    g_mutex_unlock (&priv->mutex);
+    return NULL;
+  }
+
+  /* Copy cached result */
+  for (l = scan->aps; l != NULL; l = l->next)
+    list = g_list_prepend (list, melo_network_ap_copy (l->data));
+  list = g_list_reverse (list);
+  if (timestamp)
+    *timestamp = scan->timestamp;
+
+  /* Result is too old: start a new scan if none is running */
+  if ((!scan->timestamp ||
+       now - scan->timestamp >= (gint64) max_age * G_USEC_PER_SEC) &&
+      !scan->scanning) {
+    scan->scanning = TRUE;
+    start = TRUE;
+  }
+  if (scanning)
+    *scanning = scan->scanning;
+
+  g_mutex_unlock (&priv->mutex);
+
+  /* Start scan from the main context */
+  if (start) {
+    g_object_ref (net);
+    g_main_context_invoke (NULL, melo_network_wifi_scan_start, scan);
+  }
+
+  return list;
+}
+
 MeloNetworkDevice *
 melo_network_device_new (const gchar *iface)
 {
@@ -117,7 +117,10 @@ GType melo_network_get_type (void);
 MeloNetwork *melo_network_new (void);
 
 GList *melo_network_get_device_list (MeloNetwork *net);
-GList *melo_network_wifi_scan (MeloNetwork *net, const gchar *name);
+void melo_network_set_wifi_scan_max_age (MeloNetwork *net, guint max_age);
+GList *melo_network_wifi_scan (MeloNetwork *net, const gchar *name,
+                               gint max_age, gint64 *timestamp,
+                               gboolean *scanning);
 
 MeloNetworkDevice *melo_network_device_new (const gchar *iface);
 void melo_network_device_free (MeloNetworkDevice *dev);
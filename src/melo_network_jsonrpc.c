@@ -336,6 +336,9 @@ melo_network_jsonrpc_scan_wifi (const gchar *method,
   JsonArray *array;
   JsonObject *obj;
   const gchar *iface;
+  gint max_age = -1;
+  gint64 timestamp;
+  gboolean scanning;
   GList *list;
 
   /* Get parameters */
@@ -346,11 +349,15 @@ melo_network_jsonrpc_scan_wifi (const gchar *method,
   /* Get network interface */
   iface = json_object_get_string_member (obj, "iface");
 
+  /* Get maximum age of the result */
+  if (json_object_has_member (obj, "max_age"))
+    max_age = json_object_get_int_member (obj, "max_age");
+
   /* Get fields */
   fields = melo_network_jsonrpc_get_ap_list_fields (obj);
 
-  /* Get Wifi AP list */
-  list = melo_network_wifi_scan (net, iface);
+  /* Get cached Wifi AP list: a new scan is started when it is too old */
+  list = melo_network_wifi_scan (net, iface, max_age, &timestamp, &scanning);
   json_object_unref (obj);
 
   /* Create response with Wifi AP list */
@@ -359,9 +366,15 @@ melo_network_jsonrpc_scan_wifi (const gchar *method,
   /* Free device list */
   g_list_free_full (list, (GDestroyNotify) melo_network_ap_free);
 
+  /* Add scan state: timestamp is 0 until a first scan has completed */
+  obj = json_object_new ();
+  json_object_set_array_member (obj, "aps", array);
+  json_object_set_int_member (obj, "timestamp", timestamp);
+  json_object_set_boolean_member (obj, "scanning", scanning);
+
   /* Return object */
-  *result = json_node_new (JSON_NODE_ARRAY);
-  json_node_take_array (*result, array);
+  *result = json_node_new (JSON_NODE_OBJECT);
+  json_node_take_object (*result, obj);
 }
 
 /* List of methods */
@@ -377,6 +390,7 @@ static MeloJSONRPCMethod melo_network_jsonrpc_methods[] = {
     .result = "{\"type\":\"array\"}",
     .callback = melo_network_jsonrpc_get_device_list,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONCURRENT,
   },
   {
     .method = "scan_wifi",
@@ -385,11 +399,16 @@ static MeloJSONRPCMethod melo_network_jsonrpc_methods[] = {
               "  {"
               "    \"name\": \"fields\", \"type\": \"array\","
               "    \"required\": false"
+              "  },"
+              "  {"
+              "    \"name\": \"max_age\", \"type\": \"integer\","
+              "    \"required\": false"
               "  }"
               "]",
-    .result = "{\"type\":\"array\"}",
+    .result = "{\"type\":\"object\"}",
     .callback = melo_network_jsonrpc_scan_wifi,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONCURRENT,
   },
 };
 
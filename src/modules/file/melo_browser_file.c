@@ -24,12 +24,26 @@
 #include <gst/pbutils/pbutils.h>
 
 #include "melo_file_utils.h"
+#include "melo_file_discoverer.h"
 
 #include "melo_browser_file.h"
 
 #define MELO_BROWSER_FILE_ID "melo_browser_file_id"
 #define MELO_BROWSER_FILE_ID_LENGTH 8
 
+/* Directory lists cache: lifetime (in us) and maximal count */
+#define MELO_BROWSER_FILE_CACHE_TTL (30 * G_USEC_PER_SEC)
+#define MELO_BROWSER_FILE_CACHE_TTL_MONITORED (600 * G_USEC_PER_SEC)
+#define MELO_BROWSER_FILE_CACHE_MAX 16
+
+/* Network neighborhood (workgroups, hosts and shares) lists lifetime (in us),
+ * delay before checking again a mounted share (in us) and count of threads
+ * used to resolve hosts in parallel
+ */
+#define MELO_BROWSER_FILE_CACHE_TTL_NETWORK (300 * G_USEC_PER_SEC)
+#define MELO_BROWSER_FILE_MOUNT_TTL (120 * G_USEC_PER_SEC)
+#define MELO_BROWSER_FILE_RESOLVE_THREADS 4
+
 /* File browser info */
 static MeloBrowserInfo melo_browser_file_info = {
   .name = "Browse files",
@@ -43,10 +57,12 @@ static void vms_added(GVolumeMonitor *monitor, GObject *obj,
                       MeloBrowserFilePrivate *priv);
 static void vms_removed(GVolumeMonitor *monitor, GObject *obj,
                         MeloBrowserFilePrivate *priv);
-static void on_discovered (GstDiscoverer *discoverer, GstDiscovererInfo *info,
-                           GError *error, gpointer user_data);
+static void on_discovered (const gchar *uri, MeloTags *tags,
+                           gpointer user_data);
 static void melo_browser_file_set_id (GObject *obj,
                                       MeloBrowserFilePrivate *priv);
+static void melo_browser_file_resolve_func (gpointer data, gpointer user_data);
+static void melo_browser_file_cache_free (gpointer data);
 static const MeloBrowserInfo *melo_browser_file_get_info (MeloBrowser *browser);
 static MeloBrowserList *melo_browser_file_get_list (MeloBrowser *browser,
                                         const gchar *path,
@@ -59,6 +75,19 @@ static gboolean melo_browser_file_action (MeloBrowser *browser,
                                          MeloBrowserItemAction action,
                                          const MeloBrowserActionParams *params);
 
+typedef struct {
+  gchar *key;
+  MeloBrowserItem *item;
+} MeloBrowserFileEntry;
+
+typedef struct {
+  GArray *items;
+  gint64 time;
+  gint64 ttl;
+  gint valid;
+  GFileMonitor *monitor;
+} MeloBrowserFileCache;
+
 struct _MeloBrowserFilePrivate {
   gchar *local_path;
   GVolumeMonitor *monitor;
@@ -67,7 +96,11 @@ struct _MeloBrowserFilePrivate {
   GHashTable *ids;
   GHashTable *shortcuts;
   MeloFileDB *fdb;
-  GstDiscoverer *discoverer;
+  MeloFileDiscoverer *disco;
+  GMutex cache_mutex;
+  GHashTable *cache;
+  GHashTable *mounts;
+  GThreadPool *resolver;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (MeloBrowserFile, melo_browser_file, MELO_TYPE_BROWSER)
@@ -79,14 +112,23 @@ melo_browser_file_finalize (GObject *gobject)
   MeloBrowserFilePrivate *priv =
                           melo_browser_file_get_instance_private (browser_file);
 
-  /* Stop discoverer and release it */
-  gst_discoverer_stop (priv->discoverer);
-  gst_object_unref (priv->discoverer);
+  /* Stop discoverer workers */
+  if (priv->disco)
+    melo_file_discoverer_free (priv->disco);
+
+  /* Stop host resolver */
+  if (priv->resolver)
+    g_thread_pool_free (priv->resolver, TRUE, TRUE);
 
   /* Release volume monitor */
   g_object_unref (priv->monitor);
 
+  /* Free directory lists and mounted shares */
+  g_hash_table_unref (priv->cache);
+  g_hash_table_unref (priv->mounts);
+
   /* Clear mutex */
+  g_mutex_clear (&priv->cache_mutex);
   g_mutex_clear (&priv->mutex);
 
   /* Free hash table */
@@ -135,6 +177,20 @@ melo_browser_file_init (MeloBrowserFile *self)
 
   /* Init mutex */
   g_mutex_init (&priv->mutex);
+  g_mutex_init (&priv->cache_mutex);
+
+  /* Init cache of directory lists */
+  priv->cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                       melo_browser_file_cache_free);
+
+  /* Init list of mounted shares (URI -> time of last check) */
+  priv->mounts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                        g_free);
+
+  /* Create host resolver */
+  priv->resolver = g_thread_pool_new (melo_browser_file_resolve_func, self,
+                                      MELO_BROWSER_FILE_RESOLVE_THREADS, FALSE,
+                                      NULL);
 
   /* Get list of volumes and mounts and sort by name */
   priv->vms = g_list_concat (g_volume_monitor_get_volumes (priv->monitor),
@@ -161,13 +217,8 @@ melo_browser_file_init (MeloBrowserFile *self)
   priv->shortcuts = g_hash_table_new_full (g_str_hash, g_str_equal,
                                            g_free, g_free);
 
-  /* Create a new Gstreamer discoverer for async tags discovering */
-  priv->discoverer = gst_discoverer_new (GST_SECOND, NULL);
-  gst_discoverer_start (priv->discoverer);
-
-  /* Subscribe to discovered event of discoverer */
-  g_signal_connect (priv->discoverer, "discovered",
-                    (GCallback) on_discovered, self);
+  /* Create pool of discoverers (one per CPU) shared by all requests */
+  priv->disco = melo_file_discoverer_new (0, GST_SECOND, on_discovered, self);
 }
 
 void
@@ -285,75 +336,121 @@ melo_brower_file_fix_path (const gchar *path)
   return path;
 }
 
-static MeloTags *
-melo_browser_file_discover_tags (MeloBrowserFile *bfile,
-                                 GstDiscovererInfo *info, const gchar *path,
-                                 gint path_id, const gchar *file)
-{
-  MeloBrowserFilePrivate *priv = bfile->priv;
-  const GstTagList *gtags;
-  MeloTags *tags = NULL;
-
-  /* Get GstTagLsit */
-  gtags = gst_discoverer_info_get_tags (info);
-
-  /* Convert to MeloTags */
-  if (gtags)
-    tags = melo_tags_new_from_gst_tag_list (gtags, MELO_TAGS_FIELDS_FULL,
-                                            MELO_TAGS_COVER_PERSIST_DISK);
-
-  /* Add file to database if tags are available */
-  if (priv->fdb && tags) {
-    if (path)
-      melo_file_db_add_tags (priv->fdb, path, file, 0, tags);
-    else
-      melo_file_db_add_tags2 (priv->fdb, path_id, file, 0, tags);
-  }
-
-  return tags;
-}
-
 static void
-on_discovered (GstDiscoverer *discoverer, GstDiscovererInfo *info,
-               GError *error, gpointer user_data)
+on_discovered (const gchar *uri, MeloTags *tags, const MeloFileDBInfo *info,
+               gpointer user_data)
 {
   MeloBrowserFile *bfile = user_data;
   gchar *path, *file;
-  const gchar *uri;
-  MeloTags *tags;
 
-  if (error || !info)
+  if (!bfile->priv->fdb)
     return;
 
   /* Get dirname and basename */
-  uri = gst_discoverer_info_get_uri (info);
   path = g_path_get_dirname (uri);
   file = g_path_get_basename (uri);
 
   /* Add media to database */
-  tags = melo_browser_file_discover_tags (bfile, info, path, 0, file);
-  if (tags)
-    melo_tags_unref (tags);
+  melo_file_db_add_tags (bfile->priv->fdb, path, file, 0, tags, info);
   g_free (path);
   g_free (file);
 }
 
-static GList *
-melo_browser_file_list (MeloBrowserFile * bfile, GFile *dir,
-                        MeloBrowserTagsMode tags_mode,
-                        MeloTagsFields tags_fields)
+static void
+melo_browser_file_discover (MeloBrowserFile *bfile, GList *list,
+                            GHashTable *pending,
+                            const MeloBrowserGetListParams *params)
 {
   MeloBrowserFilePrivate *priv = bfile->priv;
-  GstDiscoverer *disco = NULL;
+  MeloFileDiscovererPriority priority;
+  MeloFileDiscovererJob *job;
+  gboolean batch = FALSE;
+  GHashTableIter iter;
+  gpointer key, value;
+  GHashTable *jobs;
+  const gchar *uri;
+  guint i;
+
+  /* Jobs to wait for */
+  jobs = g_hash_table_new_full (NULL, NULL, NULL,
+                                (GDestroyNotify) melo_file_discoverer_job_unref);
+
+  /* Visible items are discovered first, others are only prefetched */
+  for (i = 0; list != NULL; list = list->next, i++) {
+    MeloBrowserItem *item = list->data;
+
+    uri = g_hash_table_lookup (pending, item);
+    if (!uri)
+      continue;
+
+    /* Item is in requested part of list */
+    if (i >= params->offset && i - params->offset < params->count)
+      priority = MELO_FILE_DISCOVERER_PRIORITY_VISIBLE;
+    else
+      priority = MELO_FILE_DISCOVERER_PRIORITY_PREFETCH;
+
+    /* Tags of visible items are waited in full mode */
+    if (params->tags_mode == MELO_BROWSER_TAGS_MODE_FULL &&
+        priority == MELO_FILE_DISCOVERER_PRIORITY_VISIBLE) {
+      job = melo_file_discoverer_add (priv->disco, uri, priority);
+      if (job)
+        g_hash_table_insert (jobs, item, job);
+    } else
+      melo_file_discoverer_push (priv->disco, uri, priority);
+  }
+
+  /* Group new tags in one transaction */
+  if (g_hash_table_size (jobs))
+    batch = melo_file_db_begin_batch (priv->fdb);
+
+  /* Wait for tags of visible items */
+  g_hash_table_iter_init (&iter, jobs);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    MeloBrowserItem *item = key;
+
+    item->tags = melo_file_discoverer_job_wait (value);
+  }
+  g_hash_table_unref (jobs);
+
+  /* Commit new tags */
+  if (batch)
+    melo_file_db_commit_batch (priv->fdb);
+}
+
+static void
+melo_browser_file_entry_clear (gpointer data)
+{
+  MeloBrowserFileEntry *entry = data;
+
+  g_free (entry->key);
+  melo_browser_item_free (entry->item);
+}
+
+static gint
+melo_browser_file_entry_cmp (gconstpointer a, gconstpointer b)
+{
+  const MeloBrowserFileEntry *ea = a, *eb = b;
+  gboolean fa = ea->item->type == MELO_BROWSER_ITEM_TYPE_FILE;
+  gboolean fb = eb->item->type == MELO_BROWSER_ITEM_TYPE_FILE;
+
+  /* Folders first, then files, sorted by collation key */
+  if (fa != fb)
+    return fa ? 1 : -1;
+  return strcmp (ea->key, eb->key);
+}
+
+static GArray *
+melo_browser_file_read_dir (MeloBrowserFile *bfile, GFile *dir)
+{
+  MeloBrowserFilePrivate *priv = bfile->priv;
+  GCancellable *cancellable = g_cancellable_get_current ();
+  MeloBrowserFileEntry entry;
   GFileEnumerator *dir_enum;
   GFileInfo *info;
-  GList *dir_list = NULL;
-  GList *list = NULL;
-  gchar *path, *path_uri;
-  gint path_id;
+  GArray *array;
 
   /* Get details */
-  if (g_file_query_file_type (dir, 0, NULL) != G_FILE_TYPE_DIRECTORY)
+  if (g_file_query_file_type (dir, 0, cancellable) != G_FILE_TYPE_DIRECTORY)
     return NULL;
 
   /* Get list of directory */
@@ -362,20 +459,16 @@ melo_browser_file_list (MeloBrowserFile * bfile, GFile *dir,
                                     G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME ","
                                     G_FILE_ATTRIBUTE_STANDARD_TARGET_URI ","
                                     G_FILE_ATTRIBUTE_STANDARD_NAME,
-                                    0, NULL, NULL);
+                                    0, cancellable, NULL);
   if (!dir_enum)
     return NULL;
 
-  /* Get path from directory */
-  path_uri = g_file_get_uri (dir);
-  path = g_uri_unescape_string (path_uri, NULL);
-  g_free (path_uri);
+  /* Create array of entries */
+  array = g_array_new (FALSE, FALSE, sizeof (MeloBrowserFileEntry));
+  g_array_set_clear_func (array, melo_browser_file_entry_clear);
 
-  /* Get path ID for faster database find / insertion */
-  melo_file_db_get_path_id (priv->fdb, path, TRUE, &path_id);
-
-  /* Create list */
-  while ((info = g_file_enumerator_next_file (dir_enum, NULL, NULL))) {
+  /* Fill array */
+  while ((info = g_file_enumerator_next_file (dir_enum, cancellable, NULL))) {
     MeloBrowserItemActionFields actions;
     MeloBrowserItemType itype;
     MeloBrowserItem *item;
@@ -409,8 +502,10 @@ melo_browser_file_list (MeloBrowserFile * bfile, GFile *dir,
       g_free (sha1);
 
       /* Add shortcut to hash table */
+      g_mutex_lock (&priv->mutex);
       if (!g_hash_table_lookup (priv->shortcuts, id))
         g_hash_table_insert (priv->shortcuts, g_strdup (id), g_strdup (uri));
+      g_mutex_unlock (&priv->mutex);
 
       if (type == G_FILE_TYPE_MOUNTABLE) {
         itype = MELO_BROWSER_ITEM_TYPE_DEVICE;
@@ -430,82 +525,297 @@ melo_browser_file_list (MeloBrowserFile * bfile, GFile *dir,
     item->name = g_strdup (g_file_info_get_display_name (info));
     item->actions = actions;
 
-    /* Insert into list */
-    if (type == G_FILE_TYPE_REGULAR) {
-      if (tags_mode != MELO_BROWSER_TAGS_MODE_NONE) {
-        MeloTags *tags = NULL;
+    /* Compute collation key once and add to array */
+    entry.key = g_utf8_collate_key_for_filename (item->name ? item->name :
+                                                 item->id, -1);
+    entry.item = item;
+    g_array_append_val (array, entry);
+    g_object_unref (info);
+  }
+  g_object_unref (dir_enum);
+
+  /* Sort entries */
+  g_array_sort (array, melo_browser_file_entry_cmp);
+
+  return array;
+}
+
+static void
+melo_browser_file_cache_free (gpointer data)
+{
+  MeloBrowserFileCache *cache = data;
+
+  if (cache->monitor) {
+    g_signal_handlers_disconnect_by_data (cache->monitor, cache);
+    g_file_monitor_cancel (cache->monitor);
+    g_object_unref (cache->monitor);
+  }
+  g_array_unref (cache->items);
+  g_slice_free (MeloBrowserFileCache, cache);
+}
+
+static void
+on_dir_changed (GFileMonitor *monitor, GFile *file, GFile *other_file,
+                GFileMonitorEvent event_type, gpointer user_data)
+{
+  MeloBrowserFileCache *cache = user_data;
+
+  /* Drop list at next access when an item is added or removed */
+  if (event_type == G_FILE_MONITOR_EVENT_CREATED ||
+      event_type == G_FILE_MONITOR_EVENT_DELETED ||
+      event_type == G_FILE_MONITOR_EVENT_MOVED)
+    g_atomic_int_set (&cache->valid, FALSE);
+}
 
-        /* Get file from database */
-        tags = melo_file_db_get_tags (priv->fdb, G_OBJECT (bfile),
+static GList *
+melo_browser_file_copy_items (GArray *items)
+{
+  GList *list = NULL;
+  guint i;
+
+  /* Copy items without tags (from end to keep order) */
+  for (i = items->len; i > 0; i--) {
+    MeloBrowserItem *src, *item;
+
+    src = g_array_index (items, MeloBrowserFileEntry, i - 1).item;
+    item = melo_browser_item_new (src->id, src->type);
+    item->name = g_strdup (src->name);
+    item->actions = src->actions;
+    list = g_list_prepend (list, item);
+  }
+
+  return list;
+}
+
+static gboolean
+melo_browser_file_is_neighborhood (const gchar *uri)
+{
+  const gchar *p;
+
+  /* Network root */
+  if (g_str_has_prefix (uri, "network://"))
+    return TRUE;
+
+  /* Workgroup or host: "smb://name/" */
+  if (!g_str_has_prefix (uri, "smb://"))
+    return FALSE;
+  p = strchr (uri + 6, '/');
+  return !p || p[1] == '\0';
+}
+
+static void
+melo_browser_file_resolve (MeloBrowserFile *bfile, GArray *items)
+{
+  MeloBrowserFilePrivate *priv = bfile->priv;
+  guint i;
+
+  if (!priv->resolver)
+    return;
+
+  /* Push all workgroups and hosts to resolver */
+  for (i = 0; i < items->len; i++) {
+    MeloBrowserItem *item = g_array_index (items, MeloBrowserFileEntry, i).item;
+    const gchar *uri;
+
+    if (item->type != MELO_BROWSER_ITEM_TYPE_REMOTE &&
+        item->type != MELO_BROWSER_ITEM_TYPE_DEVICE)
+      continue;
+
+    /* Get target URI */
+    g_mutex_lock (&priv->mutex);
+    uri = g_hash_table_lookup (priv->shortcuts, item->id);
+    if (uri && melo_browser_file_is_neighborhood (uri))
+      g_thread_pool_push (priv->resolver, g_strdup (uri), NULL);
+    g_mutex_unlock (&priv->mutex);
+  }
+}
+
+static GList *
+melo_browser_file_cache_get (MeloBrowserFile *bfile, GFile *dir,
+                             gboolean *cached)
+{
+  MeloBrowserFilePrivate *priv = bfile->priv;
+  MeloBrowserFileCache *cache, *old = NULL;
+  gint64 now = g_get_monotonic_time ();
+  GHashTableIter iter;
+  gpointer key, value;
+  GArray *items;
+  GList *list;
+  gchar *uri;
+
+  /* Find list of directory */
+  uri = g_file_get_uri (dir);
+  g_mutex_lock (&priv->cache_mutex);
+  cache = g_hash_table_lookup (priv->cache, uri);
+  if (cache) {
+    /* List is still valid */
+    if (g_atomic_int_get (&cache->valid) && now - cache->time < cache->ttl) {
+      list = melo_browser_file_copy_items (cache->items);
+      g_mutex_unlock (&priv->cache_mutex);
+      g_free (uri);
+      *cached = TRUE;
+      return list;
+    }
+    g_hash_table_remove (priv->cache, uri);
+  }
+  g_mutex_unlock (&priv->cache_mutex);
+  *cached = FALSE;
+
+  /* Read directory */
+  items = melo_browser_file_read_dir (bfile, dir);
+  if (!items) {
+    g_free (uri);
+    return NULL;
+  }
+  list = melo_browser_file_copy_items (items);
+
+  /* Create new entry */
+  cache = g_slice_new0 (MeloBrowserFileCache);
+  cache->items = items;
+  cache->time = now;
+  cache->valid = TRUE;
+
+  /* Watch directory when supported by backend */
+  cache->monitor = g_file_monitor_directory (dir, G_FILE_MONITOR_NONE, NULL,
+                                             NULL);
+  if (cache->monitor)
+    g_signal_connect (cache->monitor, "changed", (GCallback) on_dir_changed,
+                      cache);
+
+  /* Select lifetime of list */
+  if (cache->monitor)
+    cache->ttl = MELO_BROWSER_FILE_CACHE_TTL_MONITORED;
+  else if (melo_browser_file_is_neighborhood (uri)) {
+    cache->ttl = MELO_BROWSER_FILE_CACHE_TTL_NETWORK;
+
+    /* Resolve hosts found in neighborhood in parallel */
+    melo_browser_file_resolve (bfile, items);
+  } else
+    cache->ttl = MELO_BROWSER_FILE_CACHE_TTL;
+
+  g_mutex_lock (&priv->cache_mutex);
+
+  /* Remove oldest entry when cache is full */
+  if (g_hash_table_size (priv->cache) >= MELO_BROWSER_FILE_CACHE_MAX) {
+    g_hash_table_iter_init (&iter, priv->cache);
+    while (g_hash_table_iter_next (&iter, &key, &value))
+      if (!old || ((MeloBrowserFileCache *) value)->time < old->time)
+        old = value;
+    g_hash_table_iter_init (&iter, priv->cache);
+    while (g_hash_table_iter_next (&iter, &key, &value))
+      if (value == old)
+        g_hash_table_iter_remove (&iter);
+  }
+
+  /* Add new entry */
+  g_hash_table_insert (priv->cache, uri, cache);
+  g_mutex_unlock (&priv->cache_mutex);
+
+  return list;
+}
+
+static void
+melo_browser_file_resolve_func (gpointer data, gpointer user_data)
+{
+  MeloBrowserFile *bfile = user_data;
+  gchar *uri = data;
+  gboolean cached;
+  GList *list;
+  GFile *dir;
+
+  /* Fill cache with content of workgroup / host */
+  dir = g_file_new_for_uri (uri);
+  list = melo_browser_file_cache_get (bfile, dir, &cached);
+  g_list_free_full (list, (GDestroyNotify) melo_browser_item_free);
+  g_object_unref (dir);
+  g_free (uri);
+}
+
+static GList *
+melo_browser_file_list (MeloBrowserFile *bfile, GFile *dir,
+                        const MeloBrowserGetListParams *params)
+{
+  MeloBrowserTagsMode tags_mode = params->tags_mode;
+  MeloBrowserFilePrivate *priv = bfile->priv;
+  GHashTable *pending;
+  gboolean cached, visible;
+  gchar *path, *path_uri;
+  GList *list, *l;
+  gint path_id;
+  guint i;
+
+  /* Get sorted list of directory */
+  list = melo_browser_file_cache_get (bfile, dir, &cached);
+  if (!list || tags_mode == MELO_BROWSER_TAGS_MODE_NONE)
+    return list;
+
+  /* Get path from directory */
+  path_uri = g_file_get_uri (dir);
+  path = g_uri_unescape_string (path_uri, NULL);
+  g_free (path_uri);
+
+  /* Get path ID for faster database find / insertion */
+  melo_file_db_get_path_id (priv->fdb, path, TRUE, &path_id);
+
+  /* Items with tags to discover */
+  pending = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+
+  /* Get tags of files */
+  for (l = list, i = 0; l != NULL; l = l->next, i++) {
+    MeloBrowserItem *item = l->data;
+    MeloTags *tags;
+
+    if (item->type != MELO_BROWSER_ITEM_TYPE_FILE)
+      continue;
+
+    /* Stop after requested part of list and next page */
+    if (i >= params->offset && i - params->offset >= 2 * params->count)
+      break;
+
+    /* Only visible items are needed, next page is checked to be prefetched
+     * when directory has been read
+     */
+    visible = i >= params->offset && i - params->offset < params->count;
+    if (!visible &&
+        (cached || i < params->offset ||
+         tags_mode == MELO_BROWSER_TAGS_MODE_ONLY_CACHED))
+      continue;
+
+    /* Get file from database */
+    tags = melo_file_db_get_tags (priv->fdb, G_OBJECT (bfile),
                          MELO_FILE_DB_TYPE_SONG,
                          tags_mode == MELO_BROWSER_TAGS_MODE_NONE_WITH_CACHING ?
-                                            MELO_TAGS_FIELDS_NONE : tags_fields,
+                                     MELO_TAGS_FIELDS_NONE : params->tags_fields,
                          MELO_FILE_DB_FIELDS_PATH_ID, path_id,
-                         MELO_FILE_DB_FIELDS_FILE, id,
+                         MELO_FILE_DB_FIELDS_FILE, item->id,
                          MELO_FILE_DB_FIELDS_END);
 
-        /* No tags available in database */
-        if (!tags) {
-          gchar *file_uri;
-
-          /* Generate complete file URI */
-          file_uri = g_strdup_printf ("%s/%s", path, id);
-
-          if (tags_mode == MELO_BROWSER_TAGS_MODE_FULL) {
-            GstDiscovererInfo *info;
-
-            /* Create a new discoverer if not yet done */
-            if (!disco)
-              disco = gst_discoverer_new (GST_SECOND, NULL);
-
-            /* Get tags from URI */
-            info = gst_discoverer_discover_uri (disco, file_uri, NULL);
-            if (info) {
-              tags = melo_browser_file_discover_tags (bfile, info, NULL,
-                                                      path_id, id);
-              g_object_unref (info);
-            }
-          } else if (tags_mode == MELO_BROWSER_TAGS_MODE_NONE_WITH_CACHING ||
-                     tags_mode == MELO_BROWSER_TAGS_MODE_FULL_WITH_CACHING) {
-            /* Add URI to discoverer pending list */
-            gst_discoverer_discover_uri_async (priv->discoverer, file_uri);
-          }
-          g_free (file_uri);
-        }
-
-        /* Add tags to item */
-        if (tags) {
-          if (tags_mode == MELO_BROWSER_TAGS_MODE_NONE_WITH_CACHING)
-            melo_tags_unref (tags);
-          else
-            item->tags = tags;
-        }
-      }
-      list = g_list_prepend (list, item);
-    } else {
-      dir_list = g_list_prepend (dir_list, item);
+    /* No tags available in database: discover them */
+    if (!tags && tags_mode != MELO_BROWSER_TAGS_MODE_ONLY_CACHED)
+      g_hash_table_insert (pending, item,
+                           g_strdup_printf ("%s/%s", path, item->id));
+
+    /* Add tags to item */
+    if (tags) {
+      if (!visible || tags_mode == MELO_BROWSER_TAGS_MODE_NONE_WITH_CACHING)
+        melo_tags_unref (tags);
+      else
+        item->tags = tags;
     }
-    g_object_unref (info);
   }
-  g_object_unref (dir_enum);
   g_free (path);
 
-  /* Free discoverer */
-  if (disco)
-    gst_object_unref (disco);
-
-  /* Sort both lists */
-  list = g_list_sort (list, (GCompareFunc) melo_browser_item_cmp);
-  dir_list = g_list_sort (dir_list, (GCompareFunc) melo_browser_item_cmp);
+  /* Discover missing tags */
+  if (priv->disco && g_hash_table_size (pending))
+    melo_browser_file_discover (bfile, list, pending, params);
+  g_hash_table_unref (pending);
 
-  /* Merge both list */
-  return g_list_concat (dir_list, list);
+  return list;
 }
 
 static GList *
 melo_browser_file_get_local_list (MeloBrowserFile *bfile, const gchar *uri,
-                                  MeloBrowserTagsMode tags_mode,
-                                  MeloTagsFields tags_fields)
+                                  const MeloBrowserGetListParams *params)
 {
   GFile *dir;
   GList *list;
@@ -516,7 +826,7 @@ melo_browser_file_get_local_list (MeloBrowserFile *bfile, const gchar *uri,
     return NULL;
 
   /* Get list from GFile */
-  list = melo_browser_file_list (bfile, dir, tags_mode, tags_fields);
+  list = melo_browser_file_list (bfile, dir, params);
   g_object_unref (dir);
 
   return list;
@@ -580,8 +890,7 @@ melo_browser_file_get_mount (MeloBrowserFile *bfile, const gchar *path)
 
 static GList *
 melo_browser_file_get_volume_list (MeloBrowserFile *bfile, const gchar *path,
-                                   MeloBrowserTagsMode tags_mode,
-                                   MeloTagsFields tags_fields)
+                                   const MeloBrowserGetListParams *params)
 {
   GMount *mount;
   GFile *root, *dir;
@@ -612,7 +921,7 @@ melo_browser_file_get_volume_list (MeloBrowserFile *bfile, const gchar *path,
   g_object_unref (root);
 
   /* List files from our GFile  */
-  list = melo_browser_file_list (bfile, dir, tags_mode, tags_fields);
+  list = melo_browser_file_list (bfile, dir, params);
   g_object_unref (dir);
 
   return list;
@@ -686,15 +995,63 @@ melo_browser_file_list_volumes (MeloBrowserFile *bfile, GList *list)
 }
 
 
+static gboolean
+melo_browser_file_check_mount (MeloBrowserFile *bfile, GFile *dir,
+                               const gchar *uri)
+{
+  MeloBrowserFilePrivate *priv = bfile->priv;
+  gint64 now = g_get_monotonic_time ();
+  gint64 *last;
+
+  /* Share has been checked recently: keep it */
+  g_mutex_lock (&priv->cache_mutex);
+  last = g_hash_table_lookup (priv->mounts, uri);
+  if (last && now - *last < MELO_BROWSER_FILE_MOUNT_TTL) {
+    g_mutex_unlock (&priv->cache_mutex);
+    return TRUE;
+  }
+  g_mutex_unlock (&priv->cache_mutex);
+
+  /* Check and mount volume for remote files */
+  if (!melo_file_utils_check_and_mount_file (dir, g_cancellable_get_current (),
+                                             NULL)) {
+    g_mutex_lock (&priv->cache_mutex);
+    g_hash_table_remove (priv->mounts, uri);
+    g_mutex_unlock (&priv->cache_mutex);
+    return FALSE;
+  }
+
+  /* Save time of check */
+  last = g_new (gint64, 1);
+  *last = now;
+  g_mutex_lock (&priv->cache_mutex);
+  g_hash_table_insert (priv->mounts, g_strdup (uri), last);
+  g_mutex_unlock (&priv->cache_mutex);
+
+  return TRUE;
+}
+
+static void
+melo_browser_file_forget_mount (MeloBrowserFile *bfile, const gchar *uri)
+{
+  MeloBrowserFilePrivate *priv = bfile->priv;
+
+  g_mutex_lock (&priv->cache_mutex);
+  g_hash_table_remove (priv->mounts, uri);
+  g_mutex_unlock (&priv->cache_mutex);
+}
+
 static gchar *
-melo_browser_file_get_network_uri (MeloBrowserFile *bfile, const gchar *path)
+melo_browser_file_get_network_uri (MeloBrowserFile *bfile, const gchar *path,
+                                   gchar **shortcut_uri)
 {
   MeloBrowserFilePrivate *priv = bfile->priv;
-  const gchar *shortcut = NULL;
+  gchar *shortcut = NULL;
   gint len;
 
   /* Convert all shortcuts to final URI */
   len = strlen (path);
+  g_mutex_lock (&priv->mutex);
   while (len >= MELO_BROWSER_FILE_ID_LENGTH &&
          path[MELO_BROWSER_FILE_ID_LENGTH] == '/') {
     const gchar *s;
@@ -710,10 +1067,12 @@ melo_browser_file_get_network_uri (MeloBrowserFile *bfile, const gchar *path)
       break;
 
     /* Save shortcut and look for next */
-    shortcut = s;
+    g_free (shortcut);
+    shortcut = g_strdup (s);
     path += MELO_BROWSER_FILE_ID_LENGTH + 1;
     len -= MELO_BROWSER_FILE_ID_LENGTH + 1;
   }
+  g_mutex_unlock (&priv->mutex);
 
   /* Path contains a shortcut */
   if (shortcut) {
@@ -722,14 +1081,20 @@ melo_browser_file_get_network_uri (MeloBrowserFile *bfile, const gchar *path)
 
     /* Get file from shortcut */
     dir = g_file_new_for_uri (shortcut);
-    if (!dir)
+    if (!dir) {
+      g_free (shortcut);
       return NULL;
+    }
 
-    /* Check and mount volume for remote files */
-    if (!melo_file_utils_check_and_mount_file (dir, NULL, NULL)) {
+    /* Check and mount volume for remote files (if not done recently) */
+    if (!melo_browser_file_check_mount (bfile, dir, shortcut)) {
       g_object_unref (dir);
+      g_free (shortcut);
       return NULL;
     }
+    if (shortcut_uri)
+      *shortcut_uri = g_strdup (shortcut);
+    g_free (shortcut);
 
     /* Generate final URI */
     furi = g_file_get_uri (dir);
@@ -746,27 +1111,32 @@ melo_browser_file_get_network_uri (MeloBrowserFile *bfile, const gchar *path)
 
 static GList *
 melo_browser_file_get_network_list (MeloBrowserFile *bfile, const gchar *path,
-                                    MeloBrowserTagsMode tags_mode,
-                                    MeloTagsFields tags_fields)
+                                    const MeloBrowserGetListParams *params)
 {
+  gchar *shortcut = NULL;
   GList *list = NULL;
   GFile *dir;
   gchar *uri;
 
   /* Generate URI from path */
-  uri = melo_browser_file_get_network_uri (bfile, path);
+  uri = melo_browser_file_get_network_uri (bfile, path, &shortcut);
   if (!uri)
     return NULL;
 
   /* Get list from URI */
   dir = g_file_new_for_uri (uri);
   g_free (uri);
-  if (!dir)
+  if (!dir) {
+    g_free (shortcut);
     return NULL;
+  }
 
-  /* Get list from GFile */
-  list = melo_browser_file_list (bfile, dir, tags_mode, tags_fields);
+  /* Get list from GFile: check mount again at next access on failure */
+  list = melo_browser_file_list (bfile, dir, params);
+  if (!list && shortcut)
+    melo_browser_file_forget_mount (bfile, shortcut);
   g_object_unref (dir);
+  g_free (shortcut);
 
   return list;
 }
@@ -813,21 +1183,15 @@ melo_browser_file_get_list (MeloBrowser *browser, const gchar *path,
     /* Get file path: "/local/" */
     path = melo_brower_file_fix_path (path + 5);
     uri = g_strdup_printf ("file:%s/%s", bfile->priv->local_path, path);
-    list->items = melo_browser_file_get_local_list (bfile, uri,
-                                                    params->tags_mode,
-                                                    params->tags_fields);
+    list->items = melo_browser_file_get_local_list (bfile, uri, params);
     g_free (uri);
   } else if (g_str_has_prefix (path, "network")) {
     /* Get file path: "/network/" */
-    list->items = melo_browser_file_get_network_list (bfile, path + 8,
-                                                      params->tags_mode,
-                                                      params->tags_fields);
+    list->items = melo_browser_file_get_network_list (bfile, path + 8, params);
   } else if (strlen (path) >= MELO_BROWSER_FILE_ID_LENGTH &&
              path[MELO_BROWSER_FILE_ID_LENGTH] == '/') {
     /* Volume path: "/VOLUME_ID/" */
-    list->items = melo_browser_file_get_volume_list (bfile, path,
-                                                     params->tags_mode,
-                                                     params->tags_fields);
+    list->items = melo_browser_file_get_volume_list (bfile, path, params);
   }
 
   /* Keep only requested part of list */
@@ -874,7 +1238,7 @@ melo_browser_file_get_uri (MeloBrowser *browser, const gchar *path)
     uri = g_file_get_uri (root);
     g_object_unref (root);
   } else if (g_str_has_prefix (path, "network/")) {
-    uri = melo_browser_file_get_network_uri (bfile, path + 8);
+    uri = melo_browser_file_get_network_uri (bfile, path + 8, NULL);
   } else if (strlen (path) >= MELO_BROWSER_FILE_ID_LENGTH &&
              path[MELO_BROWSER_FILE_ID_LENGTH] == '/') {
     GMount *mount;
@@ -911,8 +1275,7 @@ melo_browser_file_get_tags_from_uri (MeloBrowserFile *bfile, const gchar *uri,
                                      MeloTagsFields fields)
 {
   MeloBrowserFilePrivate *priv = bfile->priv;
-  GstDiscovererInfo *info;
-  GstDiscoverer *disco;
+  MeloFileDiscovererJob *job;
   MeloTags *tags = NULL;
   gchar *dir, *file;
 
@@ -931,21 +1294,16 @@ melo_browser_file_get_tags_from_uri (MeloBrowserFile *bfile, const gchar *uri,
       goto end;
   }
 
-  /* Create a new discoverer */
-  disco = gst_discoverer_new (GST_SECOND, NULL);
-  if (!disco)
+  /* Discover tags in workers pool */
+  if (!priv->disco)
     goto end;
-
-  /* Get tags from URI */
-  info = gst_discoverer_discover_uri (disco, uri, NULL);
-  if (info) {
-    tags = melo_browser_file_discover_tags (bfile, info, dir, 0, file);
-    g_object_unref (info);
+  job = melo_file_discoverer_add (priv->disco, uri,
+                                  MELO_FILE_DISCOVERER_PRIORITY_VISIBLE);
+  if (job) {
+    tags = melo_file_discoverer_job_wait (job);
+    melo_file_discoverer_job_unref (job);
   }
 
-  /* Free discoverer */
-  gst_object_unref (disco);
-
 end:
   /* Free URI parts */
   g_free (file);
@@ -32,13 +32,117 @@ static MeloConfigItem melo_config_global[] = {
   },
 };
 
+static MeloConfigItem melo_config_database[] = {
+  {
+    .id = "wal",
+    .name = "Use Write-Ahead Logging",
+    .type = MELO_CONFIG_TYPE_BOOLEAN,
+    .element = MELO_CONFIG_ELEMENT_CHECKBOX,
+    .def._boolean = TRUE,
+  },
+  {
+    .id = "synchronous",
+    .name = "Synchronous mode (0 = off, 1 = normal, 2 = full)",
+    .type = MELO_CONFIG_TYPE_INTEGER,
+    .element = MELO_CONFIG_ELEMENT_NUMBER,
+    .def._integer = 1,
+  },
+  {
+    .id = "cache_size",
+    .name = "Cache size (KiB)",
+    .type = MELO_CONFIG_TYPE_INTEGER,
+    .element = MELO_CONFIG_ELEMENT_NUMBER,
+    .def._integer = 2048,
+  },
+};
+
+static MeloConfigItem melo_config_indexer[] = {
+  {
+    .id = "enable",
+    .name = "Index library in background",
+    .type = MELO_CONFIG_TYPE_BOOLEAN,
+    .element = MELO_CONFIG_ELEMENT_CHECKBOX,
+    .def._boolean = TRUE,
+  },
+  {
+    .id = "roots",
+    .name = "Library folders (comma separated URIs, local path if empty)",
+    .type = MELO_CONFIG_TYPE_STRING,
+    .element = MELO_CONFIG_ELEMENT_TEXT,
+    .def._string = "",
+  },
+  {
+    .id = "throttle",
+    .name = "Delay between two indexed files (ms)",
+    .type = MELO_CONFIG_TYPE_INTEGER,
+    .element = MELO_CONFIG_ELEMENT_NUMBER,
+    .def._integer = 50,
+  },
+  {
+    .id = "monitor",
+    .name = "Watch library folders for changes",
+    .type = MELO_CONFIG_TYPE_BOOLEAN,
+    .element = MELO_CONFIG_ELEMENT_CHECKBOX,
+    .def._boolean = TRUE,
+  },
+  {
+    .id = "loudness",
+    .name = "Analyze loudness of songs after scan",
+    .type = MELO_CONFIG_TYPE_BOOLEAN,
+    .element = MELO_CONFIG_ELEMENT_CHECKBOX,
+    .def._boolean = TRUE,
+  },
+};
+
+static MeloConfigItem melo_config_player[] = {
+  {
+    .id = "crossfade",
+    .name = "Crossfade between medias (ms, 0 = gapless)",
+    .type = MELO_CONFIG_TYPE_INTEGER,
+    .element = MELO_CONFIG_ELEMENT_NUMBER,
+    .def._integer = 0,
+  },
+  {
+    .id = "loudness",
+    .name = "Match loudness of analyzed songs",
+    .type = MELO_CONFIG_TYPE_BOOLEAN,
+    .element = MELO_CONFIG_ELEMENT_CHECKBOX,
+    .def._boolean = FALSE,
+  },
+  {
+    .id = "loudness_target",
+    .name = "Target loudness (LUFS)",
+    .type = MELO_CONFIG_TYPE_INTEGER,
+    .element = MELO_CONFIG_ELEMENT_NUMBER,
+    .def._integer = -18,
+  },
+};
+
 static MeloConfigGroup melo_config_file[] = {
   {
     .id = "global",
     .name = "Global",
     .items = melo_config_global,
     .items_count = G_N_ELEMENTS (melo_config_global),
-  }
+  },
+  {
+    .id = "database",
+    .name = "Media database",
+    .items = melo_config_database,
+    .items_count = G_N_ELEMENTS (melo_config_database),
+  },
+  {
+    .id = "indexer",
+    .name = "Library indexer",
+    .items = melo_config_indexer,
+    .items_count = G_N_ELEMENTS (melo_config_indexer),
+  },
+  {
+    .id = "player",
+    .name = "Player",
+    .items = melo_config_player,
+    .items_count = G_N_ELEMENTS (melo_config_player),
+  },
 };
 
 MeloConfig *
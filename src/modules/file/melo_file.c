@@ -19,8 +19,12 @@
  * Boston, MA  02110-1301, USA.
  */
 
+#include "melo_memory.h"
+#include "melo_metrics.h"
+
 #include "melo_file.h"
 #include "melo_file_db.h"
+#include "melo_file_indexer.h"
 #include "melo_browser_file.h"
 #include "melo_library_file.h"
 #include "melo_player_file.h"
@@ -39,6 +43,7 @@ static const MeloModuleInfo *melo_file_get_info (MeloModule *module);
 
 struct _MeloFilePrivate {
   MeloFileDB *fdb;
+  MeloFileIndexer *indexer;
   MeloBrowser *files;
   MeloBrowser *library;
   MeloPlayer *player;
@@ -71,8 +76,14 @@ melo_file_finalize (GObject *gobject)
     g_object_unref (priv->files);
   }
 
-  if (priv->fdb)
+  if (priv->indexer)
+    melo_file_indexer_free (priv->indexer);
+
+  if (priv->fdb) {
+    melo_metrics_unregister ("file");
+    melo_memory_unregister ("file_db");
     g_object_unref (priv->fdb);
+  }
 
   /* Chain up to the parent class */
   G_OBJECT_CLASS (melo_file_parent_class)->finalize (gobject);
@@ -93,10 +104,38 @@ melo_file_class_init (MeloFileClass *klass)
   oclass->finalize = melo_file_finalize;
 }
 
+static void
+melo_file_update_player (MeloConfigContext *context, gpointer user_data)
+{
+  gboolean enable, enable_updated, target_updated;
+  gint64 val, target;
+
+  /* Update crossfade duration */
+  if (melo_config_get_updated_integer (context, "crossfade", &val, NULL))
+    melo_player_file_set_crossfade (MELO_PLAYER_FILE (user_data), val);
+
+  /* Update loudness matching */
+  enable_updated = melo_config_get_updated_boolean (context, "loudness",
+                                                    &enable, NULL);
+  target_updated = melo_config_get_updated_integer (context,
+                                                    "loudness_target",
+                                                    &target, NULL);
+  if (enable_updated || target_updated) {
+    if (!enable_updated)
+      melo_config_get_new_boolean (context, "loudness", &enable);
+    if (!target_updated)
+      melo_config_get_new_integer (context, "loudness_target", &target);
+    melo_player_file_set_loudness (MELO_PLAYER_FILE (user_data), enable,
+                                   target);
+  }
+}
+
 static void
 melo_file_init (MeloFile *self)
 {
   MeloFilePrivate *priv = melo_file_get_instance_private (self);
+  gboolean enable;
+  gint64 val;
   gchar *path;
 
   self->priv = priv;
@@ -125,6 +164,10 @@ melo_file_init (MeloFile *self)
   melo_browser_set_player (priv->files, priv->player);
   melo_browser_set_player (priv->library, priv->player);
 
+  /* Prefetch next pages of browsers */
+  melo_browser_set_prefetch (priv->files, TRUE);
+  melo_browser_set_prefetch (priv->library, TRUE);
+
   /* Initialize and load configuration */
   priv->config = melo_config_file_new ();
   if (!melo_config_load_from_def_file (priv->config)) {
@@ -137,23 +180,160 @@ melo_file_init (MeloFile *self)
     melo_browser_file_set_local_path (MELO_BROWSER_FILE (priv->files), path);
     g_free (path);
   }
+
+  /* Load crossfade duration and loudness matching, and follow their
+   * updates
+   */
+  if (melo_config_get_integer (priv->config, "player", "crossfade", &val))
+    melo_player_file_set_crossfade (MELO_PLAYER_FILE (priv->player), val);
+  if (melo_config_get_boolean (priv->config, "player", "loudness", &enable) &&
+      melo_config_get_integer (priv->config, "player", "loudness_target",
+                               &val))
+    melo_player_file_set_loudness (MELO_PLAYER_FILE (priv->player), enable,
+                                   val);
+  melo_config_set_update_callback (priv->config, "player",
+                                   melo_file_update_player, priv->player);
+}
+
+static void
+melo_file_metrics (GString *out, gpointer user_data)
+{
+  MeloFileDBQueryStats stats;
+
+  /* Get media database statistics */
+  if (!melo_file_db_get_query_stats (user_data, &stats))
+    return;
+
+  /* Add database size and find queries */
+  melo_metrics_add_header (out, "melo_file_db_bytes", "gauge",
+                           "Size of the media database file");
+  melo_metrics_add_value (out, "melo_file_db_bytes", stats.size, NULL);
+  melo_metrics_add_header (out, "melo_file_db_queries_total", "counter",
+                           "Number of queries on the media database");
+  melo_metrics_add_value (out, "melo_file_db_queries_total", stats.queries,
+                          NULL);
+  melo_metrics_add_header (out, "melo_file_db_query_seconds_total", "counter",
+                           "Time spent in queries on the media database");
+  melo_metrics_add_value (out, "melo_file_db_query_seconds_total",
+                          stats.query_time / 1000000.0, NULL);
+  melo_metrics_add_header (out, "melo_file_db_query_max_seconds", "gauge",
+                           "Duration of the slowest query on the media database");
+  melo_metrics_add_value (out, "melo_file_db_query_max_seconds",
+                          stats.query_max / 1000000.0, NULL);
+}
+
+static void
+melo_file_memory_usage (MeloMemoryUsage *usage, gpointer user_data)
+{
+  melo_file_db_get_memory_usage (user_data, usage);
+}
+
+static void
+melo_file_memory_trim (gsize budget, gpointer user_data)
+{
+  melo_file_db_release_memory (user_data);
+}
+
+static void
+melo_file_start_indexer (MeloFile *file)
+{
+  MeloFilePrivate *priv = file->priv;
+  gboolean enable = TRUE, monitor = TRUE, loudness = TRUE;
+  gint64 throttle = 50;
+  gchar *roots = NULL, *path;
+  gchar **uris;
+  guint i;
+
+  /* Load indexer settings */
+  melo_config_get_boolean (priv->config, "indexer", "enable", &enable);
+  if (!enable)
+    return;
+  melo_config_get_integer (priv->config, "indexer", "throttle", &throttle);
+  melo_config_get_boolean (priv->config, "indexer", "monitor", &monitor);
+  melo_config_get_boolean (priv->config, "indexer", "loudness", &loudness);
+  melo_config_get_string (priv->config, "indexer", "roots", &roots);
+
+  /* Use local path when no folder is set */
+  if (!roots || *roots == '\0') {
+    g_free (roots);
+    roots = NULL;
+    if (melo_config_get_string (priv->config, "global", "local_path", &path)) {
+      if (*path != '\0')
+        roots = g_filename_to_uri (path, NULL, NULL);
+      g_free (path);
+    }
+  }
+  if (!roots)
+    return;
+
+  /* Create indexer */
+  priv->indexer = melo_file_indexer_new (priv->fdb, "file_library",
+                                         throttle < 0 ? 0 : throttle, monitor);
+  if (!priv->indexer) {
+    g_free (roots);
+    return;
+  }
+
+  /* Analyze loudness after scan */
+  melo_file_indexer_set_loudness (priv->indexer, loudness);
+
+  /* Add library folders */
+  uris = g_strsplit (roots, ",", -1);
+  for (i = 0; uris[i]; i++) {
+    g_strstrip (uris[i]);
+    if (*uris[i] != '\0')
+      melo_file_indexer_add_root (priv->indexer, uris[i]);
+  }
+  g_strfreev (uris);
+  g_free (roots);
 }
 
 static void
 melo_file_constructed (GObject *gobject)
 {
   MeloFilePrivate *priv = melo_file_get_instance_private (MELO_FILE (gobject));
+  MeloFileDBSettings settings = {
+    .wal = TRUE,
+    .synchronous = 1,
+    .cache_size = 2048,
+  };
+  gint64 val;
   gchar *db;
 
+  /* Load database settings */
+  if (priv->config) {
+    melo_config_get_boolean (priv->config, "database", "wal", &settings.wal);
+    if (melo_config_get_integer (priv->config, "database", "synchronous", &val))
+      settings.synchronous = val;
+    if (melo_config_get_integer (priv->config, "database", "cache_size", &val))
+      settings.cache_size = val;
+  }
+
+  /* Restore playlist and save its next modifications */
+  db = melo_module_build_path (MELO_MODULE (gobject), "playlist.bin");
+  if (priv->playlist)
+    melo_playlist_simple_set_persist (MELO_PLAYLIST_SIMPLE (priv->playlist),
+                                      db);
+  g_free (db);
+
   /* Open media database */
   db = melo_module_build_path (MELO_MODULE (gobject), "media.db");
-  priv->fdb = melo_file_db_new (db);
+  priv->fdb = melo_file_db_new (db, &settings);
   g_free (db);
 
   /* Set database file for browser */
   if (priv->fdb) {
+    melo_metrics_register ("file", melo_file_metrics, priv->fdb);
+    melo_memory_register ("file_db", melo_file_memory_usage,
+                          melo_file_memory_trim, priv->fdb);
     melo_browser_file_set_db (MELO_BROWSER_FILE (priv->files), priv->fdb);
     melo_library_file_set_db (MELO_LIBRARY_FILE (priv->library), priv->fdb);
+    if (priv->player)
+      melo_player_file_set_db (MELO_PLAYER_FILE (priv->player), priv->fdb);
+
+    /* Index library in background */
+    if (priv->config)
+      melo_file_start_indexer (MELO_FILE (gobject));
   }
 
   /* Chain up to the parent class */
@@ -19,12 +19,76 @@
  * Boston, MA  02110-1301, USA.
  */
 
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <glib/gstdio.h>
+
 #include <sqlite3.h>
 
+#include "melo_trace.h"
 #include "melo_file_db.h"
 
-#define MELO_FILE_DB_VERSION 6
-#define MELO_FILE_DB_VERSION_STR "6"
+#define MELO_FILE_DB_VERSION 11
+#define MELO_FILE_DB_VERSION_STR "11"
+
+/* Aggregates of artist, album and genre tables (song count, album count,
+ * total duration and representative cover) are maintained by triggers, in
+ * same transaction than changes of song table.
+ */
+#define MELO_FILE_DB_AGGREGATE_ADD(table, albums) \
+  "UPDATE " table " SET songs = songs + 1, " \
+  "duration = duration + IFNULL(NEW.duration, 0), " \
+  "cover = IFNULL(cover, NEW.cover)" albums " WHERE rowid = NEW." table "_id;"
+#define MELO_FILE_DB_AGGREGATE_ADD_ALBUMS(table) \
+  ", albums = albums + NOT EXISTS (SELECT 1 FROM song " \
+  "WHERE " table "_id = NEW." table "_id AND album_id = NEW.album_id AND " \
+  "rowid != NEW.rowid)"
+#define MELO_FILE_DB_AGGREGATE_REMOVE(table, albums) \
+  "UPDATE " table " SET songs = songs - 1, " \
+  "duration = duration - IFNULL(OLD.duration, 0), " \
+  "cover = CASE WHEN cover IS OLD.cover THEN (SELECT cover FROM song " \
+  "WHERE " table "_id = OLD." table "_id AND cover IS NOT NULL LIMIT 1) " \
+  "ELSE cover END" albums " WHERE rowid = OLD." table "_id;"
+#define MELO_FILE_DB_AGGREGATE_REMOVE_ALBUMS(table) \
+  ", albums = albums - NOT EXISTS (SELECT 1 FROM song " \
+  "WHERE " table "_id = OLD." table "_id AND album_id = OLD.album_id)"
+#define MELO_FILE_DB_AGGREGATE_ALBUMS(table) \
+  "UPDATE " table " SET albums = (SELECT COUNT(DISTINCT album_id) FROM song " \
+  "WHERE " table "_id = " table ".rowid) " \
+  "WHERE rowid IN (OLD." table "_id, NEW." table "_id);"
+#define MELO_FILE_DB_AGGREGATES \
+  "CREATE INDEX song_artist_album_idx ON song (artist_id, album_id);" \
+  "CREATE INDEX song_genre_album_idx ON song (genre_id, album_id);" \
+  "CREATE TRIGGER song_add_trg AFTER INSERT ON song BEGIN " \
+  MELO_FILE_DB_AGGREGATE_ADD ("artist", \
+                   MELO_FILE_DB_AGGREGATE_ADD_ALBUMS ("artist")) \
+  MELO_FILE_DB_AGGREGATE_ADD ("album", "") \
+  MELO_FILE_DB_AGGREGATE_ADD ("genre", \
+                   MELO_FILE_DB_AGGREGATE_ADD_ALBUMS ("genre")) \
+  "END;" \
+  "CREATE TRIGGER song_remove_trg AFTER DELETE ON song BEGIN " \
+  MELO_FILE_DB_AGGREGATE_REMOVE ("artist", \
+                   MELO_FILE_DB_AGGREGATE_REMOVE_ALBUMS ("artist")) \
+  MELO_FILE_DB_AGGREGATE_REMOVE ("album", "") \
+  MELO_FILE_DB_AGGREGATE_REMOVE ("genre", \
+                   MELO_FILE_DB_AGGREGATE_REMOVE_ALBUMS ("genre")) \
+  "END;" \
+  "CREATE TRIGGER song_update_trg AFTER UPDATE OF " \
+  "artist_id,album_id,genre_id,duration,cover ON song WHEN " \
+  "OLD.artist_id IS NOT NEW.artist_id OR OLD.album_id IS NOT NEW.album_id OR " \
+  "OLD.genre_id IS NOT NEW.genre_id OR OLD.duration IS NOT NEW.duration OR " \
+  "OLD.cover IS NOT NEW.cover BEGIN " \
+  MELO_FILE_DB_AGGREGATE_REMOVE ("artist", "") \
+  MELO_FILE_DB_AGGREGATE_REMOVE ("album", "") \
+  MELO_FILE_DB_AGGREGATE_REMOVE ("genre", "") \
+  MELO_FILE_DB_AGGREGATE_ADD ("artist", "") \
+  MELO_FILE_DB_AGGREGATE_ADD ("album", "") \
+  MELO_FILE_DB_AGGREGATE_ADD ("genre", "") \
+  MELO_FILE_DB_AGGREGATE_ALBUMS ("artist") \
+  MELO_FILE_DB_AGGREGATE_ALBUMS ("genre") \
+  "END;"
 
 /* Table creation */
 #define MELO_FILE_DB_CREATE \
@@ -39,27 +103,55 @@
   "        'cover'         TEXT," \
   "        'file'          TEXT," \
   "        'path_id'       INTEGER," \
-  "        'timestamp'     INTEGER" \
+  "        'timestamp'     INTEGER," \
+  "        'duration'      INTEGER," \
+  "        'codec'         TEXT," \
+  "        'rate'          INTEGER," \
+  "        'channels'      INTEGER," \
+  "        'bitrate'       INTEGER," \
+  "        'loudness'      REAL," \
+  "        'peak'          REAL" \
   ");" \
   "CREATE TABLE artist (" \
   "        'artist'        TEXT NOT NULL UNIQUE," \
-  "        'cover'         TEXT" \
+  "        'cover'         TEXT," \
+  "        'songs'         INTEGER DEFAULT 0," \
+  "        'albums'        INTEGER DEFAULT 0," \
+  "        'duration'      INTEGER DEFAULT 0" \
   ");" \
   "CREATE TABLE album (" \
   "        'album'         TEXT NOT NULL UNIQUE," \
-  "        'cover'         TEXT" \
+  "        'cover'         TEXT," \
+  "        'songs'         INTEGER DEFAULT 0," \
+  "        'duration'      INTEGER DEFAULT 0" \
   ");" \
   "CREATE TABLE genre (" \
   "        'genre'         TEXT NOT NULL UNIQUE," \
-  "        'cover'         TEXT" \
+  "        'cover'         TEXT," \
+  "        'songs'         INTEGER DEFAULT 0," \
+  "        'albums'        INTEGER DEFAULT 0," \
+  "        'duration'      INTEGER DEFAULT 0" \
   ");" \
   "CREATE TABLE path (" \
   "        'path'          TEXT NOT NULL UNIQUE" \
   ");" \
-  "CREATE VIRTUAL TABLE song_fts USING FTS4(file,title);" \
-  "CREATE VIRTUAL TABLE artist_fts USING FTS4(artist);" \
-  "CREATE VIRTUAL TABLE album_fts USING FTS4(album);" \
-  "CREATE VIRTUAL TABLE genre_fts USING FTS4(genre);" \
+  "CREATE VIRTUAL TABLE song_fts USING FTS4(file,title,prefix='2,3');" \
+  "CREATE VIRTUAL TABLE artist_fts USING FTS4(artist,prefix='2,3');" \
+  "CREATE VIRTUAL TABLE album_fts USING FTS4(album,prefix='2,3');" \
+  "CREATE VIRTUAL TABLE genre_fts USING FTS4(genre,prefix='2,3');" \
+  "CREATE INDEX song_path_idx ON song (path_id, file);" \
+  "CREATE INDEX song_artist_idx ON song (artist_id);" \
+  "CREATE INDEX song_album_idx ON song (album_id);" \
+  "CREATE INDEX song_genre_idx ON song (genre_id);" \
+  "CREATE INDEX song_file_idx ON song (file COLLATE NOCASE);" \
+  "CREATE INDEX song_title_idx ON song (title COLLATE NOCASE);" \
+  "CREATE INDEX song_date_idx ON song (date COLLATE NOCASE);" \
+  "CREATE INDEX song_track_idx ON song (track COLLATE NOCASE);" \
+  "CREATE INDEX song_tracks_idx ON song (tracks COLLATE NOCASE);" \
+  "CREATE INDEX artist_sort_idx ON artist (artist COLLATE NOCASE);" \
+  "CREATE INDEX album_sort_idx ON album (album COLLATE NOCASE);" \
+  "CREATE INDEX genre_sort_idx ON genre (genre COLLATE NOCASE);" \
+  MELO_FILE_DB_AGGREGATES \
   "PRAGMA user_version = " MELO_FILE_DB_VERSION_STR ";"
 
 /* Get database version */
@@ -71,7 +163,258 @@
   "DROP TABLE IF EXISTS artist;" \
   "DROP TABLE IF EXISTS album;" \
   "DROP TABLE IF EXISTS genre;" \
-  "DROP TABLE IF EXISTS path;"
+  "DROP TABLE IF EXISTS path;" \
+  "DROP TABLE IF EXISTS song_fts;" \
+  "DROP TABLE IF EXISTS artist_fts;" \
+  "DROP TABLE IF EXISTS album_fts;" \
+  "DROP TABLE IF EXISTS genre_fts;"
+
+/* Oldest version which can be migrated */
+#define MELO_FILE_DB_VERSION_MIN 6
+
+/* Migration steps: each step upgrades database from previous version and is
+ * run in its own transaction. Columns must be added with ALTER TABLE, so
+ * existing rows are kept and new values are filled lazily.
+ */
+typedef struct {
+  gint version;
+  const gchar *sql;
+} MeloFileDBMigration;
+
+static const MeloFileDBMigration melo_file_db_migrations[] = {
+  /* Indexes for sort and keyset pagination */
+  { 7,
+    "CREATE INDEX IF NOT EXISTS song_path_idx ON song (path_id, file);"
+    "CREATE INDEX IF NOT EXISTS song_artist_idx ON song (artist_id);"
+    "CREATE INDEX IF NOT EXISTS song_album_idx ON song (album_id);"
+    "CREATE INDEX IF NOT EXISTS song_genre_idx ON song (genre_id);"
+    "CREATE INDEX IF NOT EXISTS song_file_idx ON song (file COLLATE NOCASE);"
+    "CREATE INDEX IF NOT EXISTS song_title_idx ON song (title COLLATE NOCASE);"
+    "CREATE INDEX IF NOT EXISTS song_date_idx ON song (date COLLATE NOCASE);"
+    "CREATE INDEX IF NOT EXISTS song_track_idx ON song (track COLLATE NOCASE);"
+    "CREATE INDEX IF NOT EXISTS song_tracks_idx ON song "
+                                                      "(tracks COLLATE NOCASE);"
+    "CREATE INDEX IF NOT EXISTS artist_sort_idx ON artist "
+                                                      "(artist COLLATE NOCASE);"
+    "CREATE INDEX IF NOT EXISTS album_sort_idx ON album (album COLLATE NOCASE);"
+    "CREATE INDEX IF NOT EXISTS genre_sort_idx ON genre (genre COLLATE NOCASE);"
+  },
+  /* Prefix indexes for search: FTS tables are copied with same document IDs */
+  { 8,
+    "CREATE VIRTUAL TABLE song_fts_new USING FTS4(file,title,prefix='2,3');"
+    "INSERT INTO song_fts_new (docid,file,title) "
+                                         "SELECT docid,file,title FROM song_fts;"
+    "DROP TABLE song_fts;"
+    "ALTER TABLE song_fts_new RENAME TO song_fts;"
+    "CREATE VIRTUAL TABLE artist_fts_new USING FTS4(artist,prefix='2,3');"
+    "INSERT INTO artist_fts_new (docid,artist) "
+                                          "SELECT docid,artist FROM artist_fts;"
+    "DROP TABLE artist_fts;"
+    "ALTER TABLE artist_fts_new RENAME TO artist_fts;"
+    "CREATE VIRTUAL TABLE album_fts_new USING FTS4(album,prefix='2,3');"
+    "INSERT INTO album_fts_new (docid,album) SELECT docid,album FROM album_fts;"
+    "DROP TABLE album_fts;"
+    "ALTER TABLE album_fts_new RENAME TO album_fts;"
+    "CREATE VIRTUAL TABLE genre_fts_new USING FTS4(genre,prefix='2,3');"
+    "INSERT INTO genre_fts_new (docid,genre) SELECT docid,genre FROM genre_fts;"
+    "DROP TABLE genre_fts;"
+    "ALTER TABLE genre_fts_new RENAME TO genre_fts;"
+  },
+  /* Stream details: songs are marked as outdated, so indexer fills details
+   * in background while keeping existing tags
+   */
+  { 9,
+    "ALTER TABLE song ADD COLUMN duration INTEGER;"
+    "ALTER TABLE song ADD COLUMN codec TEXT;"
+    "ALTER TABLE song ADD COLUMN rate INTEGER;"
+    "ALTER TABLE song ADD COLUMN channels INTEGER;"
+    "ALTER TABLE song ADD COLUMN bitrate INTEGER;"
+    "UPDATE song SET timestamp = 0;"
+  },
+  /* Aggregates of artists, albums and genres: computed once from songs */
+  { 10,
+    "ALTER TABLE artist ADD COLUMN songs INTEGER DEFAULT 0;"
+    "ALTER TABLE artist ADD COLUMN albums INTEGER DEFAULT 0;"
+    "ALTER TABLE artist ADD COLUMN duration INTEGER DEFAULT 0;"
+    "ALTER TABLE album ADD COLUMN songs INTEGER DEFAULT 0;"
+    "ALTER TABLE album ADD COLUMN duration INTEGER DEFAULT 0;"
+    "ALTER TABLE genre ADD COLUMN songs INTEGER DEFAULT 0;"
+    "ALTER TABLE genre ADD COLUMN albums INTEGER DEFAULT 0;"
+    "ALTER TABLE genre ADD COLUMN duration INTEGER DEFAULT 0;"
+    "UPDATE artist SET "
+      "songs = (SELECT COUNT(*) FROM song WHERE artist_id = artist.rowid),"
+      "albums = (SELECT COUNT(DISTINCT album_id) FROM song "
+                "WHERE artist_id = artist.rowid),"
+      "duration = (SELECT TOTAL(duration) FROM song "
+                  "WHERE artist_id = artist.rowid),"
+      "cover = IFNULL(cover, (SELECT cover FROM song "
+               "WHERE artist_id = artist.rowid AND cover IS NOT NULL LIMIT 1));"
+    "UPDATE album SET "
+      "songs = (SELECT COUNT(*) FROM song WHERE album_id = album.rowid),"
+      "duration = (SELECT TOTAL(duration) FROM song "
+                  "WHERE album_id = album.rowid),"
+      "cover = IFNULL(cover, (SELECT cover FROM song "
+               "WHERE album_id = album.rowid AND cover IS NOT NULL LIMIT 1));"
+    "UPDATE genre SET "
+      "songs = (SELECT COUNT(*) FROM song WHERE genre_id = genre.rowid),"
+      "albums = (SELECT COUNT(DISTINCT album_id) FROM song "
+                "WHERE genre_id = genre.rowid),"
+      "duration = (SELECT TOTAL(duration) FROM song "
+                  "WHERE genre_id = genre.rowid),"
+      "cover = IFNULL(cover, (SELECT cover FROM song "
+               "WHERE genre_id = genre.rowid AND cover IS NOT NULL LIMIT 1));"
+    MELO_FILE_DB_AGGREGATES
+  },
+  /* Loudness and peak: filled in background by indexer */
+  { 11,
+    "ALTER TABLE song ADD COLUMN loudness REAL;"
+    "ALTER TABLE song ADD COLUMN peak REAL;"
+  },
+};
+
+/* Default settings */
+#define MELO_FILE_DB_DEFAULT_SYNCHRONOUS 1
+#define MELO_FILE_DB_DEFAULT_CACHE_SIZE 2048
+
+/* Maximum number of songs added in one transaction */
+#define MELO_FILE_DB_BATCH_SIZE 256
+
+/* Prepared statements for fixed requests */
+typedef enum {
+  MELO_FILE_DB_STMT_PATH_GET = 0,
+  MELO_FILE_DB_STMT_PATH_ADD,
+  MELO_FILE_DB_STMT_SONG_GET,
+  MELO_FILE_DB_STMT_SONG_ADD,
+  MELO_FILE_DB_STMT_SONG_UPDATE,
+  MELO_FILE_DB_STMT_SONG_FTS_ADD,
+  MELO_FILE_DB_STMT_SONG_FTS_UPDATE,
+  /* Get, add and add to FTS table must be consecutive */
+  MELO_FILE_DB_STMT_ARTIST_GET,
+  MELO_FILE_DB_STMT_ARTIST_ADD,
+  MELO_FILE_DB_STMT_ARTIST_FTS_ADD,
+  MELO_FILE_DB_STMT_ALBUM_GET,
+  MELO_FILE_DB_STMT_ALBUM_ADD,
+  MELO_FILE_DB_STMT_ALBUM_FTS_ADD,
+  MELO_FILE_DB_STMT_GENRE_GET,
+  MELO_FILE_DB_STMT_GENRE_ADD,
+  MELO_FILE_DB_STMT_GENRE_FTS_ADD,
+  MELO_FILE_DB_STMT_SONG_REMOVE,
+  MELO_FILE_DB_STMT_SONG_FTS_REMOVE,
+  MELO_FILE_DB_STMT_PATH_FTS_REMOVE,
+  MELO_FILE_DB_STMT_PATH_REMOVE,
+  MELO_FILE_DB_STMT_SONG_INFO_GET,
+  MELO_FILE_DB_STMT_SONG_STATS,
+  MELO_FILE_DB_STMT_ARTIST_STATS,
+  MELO_FILE_DB_STMT_ALBUM_STATS,
+  MELO_FILE_DB_STMT_GENRE_STATS,
+  MELO_FILE_DB_STMT_LOUDNESS_GET,
+  MELO_FILE_DB_STMT_LOUDNESS_SET,
+  MELO_FILE_DB_STMT_LOUDNESS_NEXT,
+
+  MELO_FILE_DB_STMT_COUNT
+} MeloFileDBStmt;
+
+static const gchar *melo_file_db_stmt_sql[MELO_FILE_DB_STMT_COUNT] = {
+  [MELO_FILE_DB_STMT_PATH_GET] = "SELECT rowid FROM path WHERE path = ?",
+  [MELO_FILE_DB_STMT_PATH_ADD] = "INSERT INTO path (path) VALUES (?)",
+  [MELO_FILE_DB_STMT_SONG_GET] =
+    "SELECT rowid,timestamp FROM song WHERE path_id = ? AND file = ?",
+  [MELO_FILE_DB_STMT_SONG_ADD] =
+    "INSERT INTO song (title,artist_id,album_id,genre_id,date,track,tracks,"
+    "cover,duration,codec,rate,channels,bitrate,file,path_id,timestamp) "
+    "VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?)",
+  [MELO_FILE_DB_STMT_SONG_UPDATE] =
+    "UPDATE song SET title = ?, artist_id = ?, album_id = ?, genre_id = ?, "
+    "date = ?, track = ?, tracks = ?, cover = ?, duration = ?, codec = ?, "
+    "rate = ?, channels = ?, bitrate = ?, loudness = NULL, peak = NULL, "
+    "timestamp = ? WHERE rowid = ?",
+  [MELO_FILE_DB_STMT_SONG_FTS_ADD] =
+    "INSERT INTO song_fts (file,title) VALUES (?,?)",
+  [MELO_FILE_DB_STMT_SONG_FTS_UPDATE] =
+    "UPDATE song_fts SET title = ? WHERE rowid = ?",
+  [MELO_FILE_DB_STMT_ARTIST_GET] = "SELECT rowid FROM artist WHERE artist = ?",
+  [MELO_FILE_DB_STMT_ARTIST_ADD] = "INSERT INTO artist (artist) VALUES (?)",
+  [MELO_FILE_DB_STMT_ARTIST_FTS_ADD] =
+    "INSERT INTO artist_fts (artist) VALUES (?)",
+  [MELO_FILE_DB_STMT_ALBUM_GET] = "SELECT rowid FROM album WHERE album = ?",
+  [MELO_FILE_DB_STMT_ALBUM_ADD] = "INSERT INTO album (album) VALUES (?)",
+  [MELO_FILE_DB_STMT_ALBUM_FTS_ADD] =
+    "INSERT INTO album_fts (album) VALUES (?)",
+  [MELO_FILE_DB_STMT_GENRE_GET] = "SELECT rowid FROM genre WHERE genre = ?",
+  [MELO_FILE_DB_STMT_GENRE_ADD] = "INSERT INTO genre (genre) VALUES (?)",
+  [MELO_FILE_DB_STMT_GENRE_FTS_ADD] =
+    "INSERT INTO genre_fts (genre) VALUES (?)",
+  [MELO_FILE_DB_STMT_SONG_REMOVE] = "DELETE FROM song WHERE rowid = ?",
+  [MELO_FILE_DB_STMT_SONG_FTS_REMOVE] = "DELETE FROM song_fts WHERE docid = ?",
+  /* Remove songs of a path and all its sub-paths */
+  [MELO_FILE_DB_STMT_PATH_FTS_REMOVE] =
+    "DELETE FROM song_fts WHERE docid IN (SELECT song.rowid FROM song "
+    "JOIN path ON song.path_id = path.rowid WHERE path.path = ?1 OR "
+    "substr(path.path, 1, length(?1) + 1) = ?1 || '/')",
+  [MELO_FILE_DB_STMT_PATH_REMOVE] =
+    "DELETE FROM song WHERE path_id IN (SELECT rowid FROM path "
+    "WHERE path = ?1 OR substr(path, 1, length(?1) + 1) = ?1 || '/')",
+  [MELO_FILE_DB_STMT_SONG_INFO_GET] =
+    "SELECT duration,codec,rate,channels,bitrate FROM song "
+    "WHERE path_id = ? AND file = ?",
+  /* Songs without duration are counted but not in total duration */
+  [MELO_FILE_DB_STMT_SONG_STATS] =
+    "SELECT COUNT(*),(SELECT COUNT(*) FROM album WHERE songs > 0),"
+    "TOTAL(duration) FROM song",
+  [MELO_FILE_DB_STMT_ARTIST_STATS] =
+    "SELECT songs,albums,duration FROM artist WHERE rowid = ?",
+  [MELO_FILE_DB_STMT_ALBUM_STATS] =
+    "SELECT songs,1,duration FROM album WHERE rowid = ?",
+  [MELO_FILE_DB_STMT_GENRE_STATS] =
+    "SELECT songs,albums,duration FROM genre WHERE rowid = ?",
+  [MELO_FILE_DB_STMT_LOUDNESS_GET] =
+    "SELECT loudness,peak FROM song WHERE path_id = ? AND file = ? AND "
+    "loudness IS NOT NULL",
+  [MELO_FILE_DB_STMT_LOUDNESS_SET] =
+    "UPDATE song SET loudness = ?, peak = ? WHERE rowid = ?",
+  /* Songs are analyzed in row order, so failed songs are skipped */
+  [MELO_FILE_DB_STMT_LOUDNESS_NEXT] =
+    "SELECT song.rowid,path.path,song.file FROM song "
+    "JOIN path ON song.path_id = path.rowid "
+    "WHERE song.rowid > ? AND song.loudness IS NULL ORDER BY song.rowid "
+    "LIMIT 1",
+};
+
+/* Caches of IDs for dimension tables */
+typedef enum {
+  MELO_FILE_DB_ID_CACHE_PATH = 0,
+  MELO_FILE_DB_ID_CACHE_ARTIST,
+  MELO_FILE_DB_ID_CACHE_ALBUM,
+  MELO_FILE_DB_ID_CACHE_GENRE,
+
+  MELO_FILE_DB_ID_CACHE_COUNT
+} MeloFileDBIDCache;
+
+static const gchar *melo_file_db_id_cache_table[MELO_FILE_DB_ID_CACHE_COUNT] = {
+  [MELO_FILE_DB_ID_CACHE_PATH] = "path",
+  [MELO_FILE_DB_ID_CACHE_ARTIST] = "artist",
+  [MELO_FILE_DB_ID_CACHE_ALBUM] = "album",
+  [MELO_FILE_DB_ID_CACHE_GENRE] = "genre",
+};
+
+static const MeloFileDBStmt
+melo_file_db_id_cache_stmt[MELO_FILE_DB_ID_CACHE_COUNT] = {
+  [MELO_FILE_DB_ID_CACHE_PATH] = MELO_FILE_DB_STMT_PATH_GET,
+  [MELO_FILE_DB_ID_CACHE_ARTIST] = MELO_FILE_DB_STMT_ARTIST_GET,
+  [MELO_FILE_DB_ID_CACHE_ALBUM] = MELO_FILE_DB_STMT_ALBUM_GET,
+  [MELO_FILE_DB_ID_CACHE_GENRE] = MELO_FILE_DB_STMT_GENRE_GET,
+};
+
+/* Maximum number of IDs kept in each cache */
+#define MELO_FILE_DB_ID_CACHE_MAX 4096
+
+/* Maximum number of prepared statements kept for find requests */
+#define MELO_FILE_DB_FIND_CACHE_MAX 32
+
+/* Maximum number of idle reader connections kept open */
+#define MELO_FILE_DB_READERS_MAX 8
+/* Time to wait for a locked database (in ms) */
+#define MELO_FILE_DB_BUSY_TIMEOUT 5000
 
 static const gchar *melo_sort_to_file_db_string[MELO_SORT_COUNT] = {
   [MELO_SORT_FILE] = "file",
@@ -84,15 +427,57 @@ static const gchar *melo_sort_to_file_db_string[MELO_SORT_COUNT] = {
   [MELO_SORT_TRACKS] = "tracks",
 };
 
+/* Node of prefix tree of words used for search hints */
+typedef struct _MeloFileDBHint MeloFileDBHint;
+struct _MeloFileDBHint {
+  MeloFileDBHint *child;
+  MeloFileDBHint *next;
+  MeloFileDBHint *best;
+  gchar *word;
+  guint count;
+  guchar c;
+};
+
+/* Length limits of words saved in prefix tree */
+#define MELO_FILE_DB_HINT_MIN 2
+#define MELO_FILE_DB_HINT_MAX 64
+
+/* Read-only connection used by one thread at a time */
+typedef struct {
+  sqlite3 *db;
+  GHashTable *find_stmts;
+} MeloFileDBReader;
+
 struct _MeloFileDBPrivate {
   GMutex mutex;
+  gchar *file;
   sqlite3 *db;
+  sqlite3_stmt *stmts[MELO_FILE_DB_STMT_COUNT];
+  GHashTable *ids[MELO_FILE_DB_ID_CACHE_COUNT];
+  MeloFileDBHint *hints;
+  MeloFileDBSettings settings;
+
+  /* Idle reader connections */
+  GMutex readers_mutex;
+  GQueue readers;
+
+  /* Current batch */
+  guint batch_depth;
+  guint batch_count;
+
+  /* Query statistics */
+  GMutex stats_mutex;
+  guint64 queries;
+  gint64 query_time;
+  gint64 query_max;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (MeloFileDB, melo_file_db, G_TYPE_OBJECT)
 
 static gboolean melo_file_db_open (MeloFileDB *db, const gchar *file);
 static void melo_file_db_close (MeloFileDB *db);
+static void melo_file_db_rank (sqlite3_context *ctx, int argc,
+                               sqlite3_value **argv);
 
 static void
 melo_file_db_finalize (GObject *gobject)
@@ -103,7 +488,9 @@ melo_file_db_finalize (GObject *gobject)
   /* Close database file */
   melo_file_db_close (fdb);
 
-  /* Clear mutex */
+  /* Clear mutexes */
+  g_mutex_clear (&priv->stats_mutex);
+  g_mutex_clear (&priv->readers_mutex);
   g_mutex_clear (&priv->mutex);
 
   /* Chain up to the parent class */
@@ -126,12 +513,20 @@ melo_file_db_init (MeloFileDB *self)
 
   self->priv = priv;
 
-  /* Init mutex */
+  /* Init mutexes and reader pool */
   g_mutex_init (&priv->mutex);
+  g_mutex_init (&priv->readers_mutex);
+  g_mutex_init (&priv->stats_mutex);
+  g_queue_init (&priv->readers);
+
+  /* Set default settings */
+  priv->settings.wal = TRUE;
+  priv->settings.synchronous = MELO_FILE_DB_DEFAULT_SYNCHRONOUS;
+  priv->settings.cache_size = MELO_FILE_DB_DEFAULT_CACHE_SIZE;
 }
 
 MeloFileDB *
-melo_file_db_new (const gchar *file)
+melo_file_db_new (const gchar *file, const MeloFileDBSettings *settings)
 {
   MeloFileDB *fdb;
 
@@ -140,6 +535,10 @@ melo_file_db_new (const gchar *file)
   if (!fdb)
     return NULL;
 
+  /* Set settings */
+  if (settings)
+    fdb->priv->settings = *settings;
+
   /* Open database file */
   if (!melo_file_db_open (fdb, file)) {
     g_object_unref (fdb);
@@ -161,262 +560,1213 @@ melo_file_db_get_int (MeloFileDBPrivate *priv, const gchar *sql, gint *value)
   if (ret != SQLITE_OK)
     return FALSE;
 
-  /* Get value from results */
-  while ((ret = sqlite3_step (req)) == SQLITE_ROW) {
-    *value = sqlite3_column_int (req, 0);
-    count++;
+  /* Get value from results */
+  while ((ret = sqlite3_step (req)) == SQLITE_ROW) {
+    *value = sqlite3_column_int (req, 0);
+    count++;
+  }
+
+  /* Finalize request */
+  sqlite3_finalize (req);
+
+  return ret != SQLITE_DONE || !count ? FALSE : TRUE;
+}
+
+/* Must be called with database locked */
+static sqlite3_stmt *
+melo_file_db_get_stmt (MeloFileDBPrivate *priv, MeloFileDBStmt id)
+{
+  /* Prepare statement on first use */
+  if (!priv->stmts[id] &&
+      sqlite3_prepare_v2 (priv->db, melo_file_db_stmt_sql[id], -1,
+                          &priv->stmts[id], NULL) != SQLITE_OK) {
+    sqlite3_finalize (priv->stmts[id]);
+    priv->stmts[id] = NULL;
+  }
+
+  return priv->stmts[id];
+}
+
+static void
+melo_file_db_reset_stmt (sqlite3_stmt *req)
+{
+  sqlite3_reset (req);
+  sqlite3_clear_bindings (req);
+}
+
+static gboolean
+melo_file_db_stmt_get_int (sqlite3_stmt *req, gint *value)
+{
+  gint count = 0;
+  int ret;
+
+  /* Get value from results */
+  while ((ret = sqlite3_step (req)) == SQLITE_ROW) {
+    *value = sqlite3_column_int (req, 0);
+    count++;
+  }
+  melo_file_db_reset_stmt (req);
+
+  return ret != SQLITE_DONE || !count ? FALSE : TRUE;
+}
+
+static gboolean
+melo_file_db_stmt_exec (sqlite3_stmt *req)
+{
+  int ret;
+
+  ret = sqlite3_step (req);
+  melo_file_db_reset_stmt (req);
+
+  return ret == SQLITE_DONE;
+}
+
+/* Must be called with database locked */
+static void
+melo_file_db_id_cache_add (MeloFileDBPrivate *priv, MeloFileDBIDCache cache,
+                           const gchar *name, gint id)
+{
+  GHashTable *ids = priv->ids[cache];
+
+  if (!ids || !id)
+    return;
+
+  /* Cache is full: flush it */
+  if (g_hash_table_size (ids) >= MELO_FILE_DB_ID_CACHE_MAX)
+    g_hash_table_remove_all (ids);
+
+  g_hash_table_insert (ids, g_strdup (name), GINT_TO_POINTER (id));
+}
+
+/* Must be called with database locked */
+static void
+melo_file_db_id_cache_load (MeloFileDBPrivate *priv)
+{
+  sqlite3_stmt *req;
+  guint i;
+
+  for (i = 0; i < MELO_FILE_DB_ID_CACHE_COUNT; i++) {
+    gchar *sql;
+
+    /* Create cache */
+    priv->ids[i] = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                          NULL);
+
+    /* Fill cache from table */
+    sql = sqlite3_mprintf ("SELECT rowid,%s FROM %s LIMIT %d",
+                           melo_file_db_id_cache_table[i],
+                           melo_file_db_id_cache_table[i],
+                           MELO_FILE_DB_ID_CACHE_MAX);
+    if (sqlite3_prepare_v2 (priv->db, sql, -1, &req, NULL) == SQLITE_OK) {
+      while (sqlite3_step (req) == SQLITE_ROW) {
+        const gchar *name = (const gchar *) sqlite3_column_text (req, 1);
+
+        if (name)
+          g_hash_table_insert (priv->ids[i], g_strdup (name),
+                               GINT_TO_POINTER (sqlite3_column_int (req, 0)));
+      }
+    }
+    sqlite3_finalize (req);
+    sqlite3_free (sql);
+  }
+}
+
+/* Must be called with database locked */
+static void
+melo_file_db_id_cache_clear (MeloFileDBPrivate *priv)
+{
+  guint i;
+
+  for (i = 0; i < MELO_FILE_DB_ID_CACHE_COUNT; i++)
+    if (priv->ids[i])
+      g_hash_table_remove_all (priv->ids[i]);
+}
+
+/* Must be called with database locked */
+static gint
+melo_file_db_id_cache_get (MeloFileDBPrivate *priv, MeloFileDBIDCache cache,
+                           const gchar *name)
+{
+  sqlite3_stmt *req;
+  gint id = 0;
+
+  /* Find ID in cache */
+  if (priv->ids[cache]) {
+    id = GPOINTER_TO_INT (g_hash_table_lookup (priv->ids[cache], name));
+    if (id)
+      return id;
+  }
+
+  /* Find ID in database */
+  req = melo_file_db_get_stmt (priv, melo_file_db_id_cache_stmt[cache]);
+  if (req) {
+    sqlite3_bind_text (req, 1, name, -1, SQLITE_STATIC);
+    if (!melo_file_db_stmt_get_int (req, &id))
+      id = 0;
+  }
+  melo_file_db_id_cache_add (priv, cache, name, id);
+
+  return id;
+}
+
+static void
+melo_file_db_hint_free (MeloFileDBHint *node)
+{
+  while (node) {
+    MeloFileDBHint *next = node->next;
+
+    melo_file_db_hint_free (node->child);
+    g_free (node->word);
+    g_slice_free (MeloFileDBHint, node);
+    node = next;
+  }
+}
+
+static void
+melo_file_db_hint_add_word (MeloFileDBHint *root, const gchar *word, gsize len)
+{
+  MeloFileDBHint *node = root;
+  gsize i;
+
+  /* Find or create node for each byte */
+  for (i = 0; i < len; i++) {
+    MeloFileDBHint **child = &node->child;
+    guchar c = word[i];
+
+    while (*child && (*child)->c != c)
+      child = &(*child)->next;
+    if (!*child) {
+      *child = g_slice_new0 (MeloFileDBHint);
+      (*child)->c = c;
+    }
+    node = *child;
+  }
+
+  /* Word end */
+  if (!node->word)
+    node->word = g_strndup (word, len);
+  node->count++;
+
+  /* Update most frequent word of each prefix */
+  for (i = 0, root = root->child; root; root = root->child) {
+    while (root->c != (guchar) word[i])
+      root = root->next;
+    if (!root->best || root->best->count < node->count)
+      root->best = node;
+    if (++i == len)
+      break;
+  }
+}
+
+static void
+melo_file_db_hint_add (MeloFileDBHint *root, const gchar *text)
+{
+  const gchar *word = NULL;
+  gchar *str, *s;
+
+  if (!root || !text)
+    return;
+
+  /* Split lower case text in words */
+  str = g_utf8_strdown (text, -1);
+  for (s = str; ; s = g_utf8_next_char (s)) {
+    gboolean alnum = *s && g_unichar_isalnum (g_utf8_get_char (s));
+
+    if (alnum && !word)
+      word = s;
+    else if (!alnum && word) {
+      gsize len = s - word;
+
+      if (len >= MELO_FILE_DB_HINT_MIN && len <= MELO_FILE_DB_HINT_MAX)
+        melo_file_db_hint_add_word (root, word, len);
+      word = NULL;
+    }
+    if (!*s)
+      break;
+  }
+  g_free (str);
+}
+
+/* Must be called with database locked */
+static void
+melo_file_db_hint_load (MeloFileDBPrivate *priv)
+{
+  static const gchar *sql[] = {
+    "SELECT title FROM song",
+    "SELECT artist FROM artist",
+    "SELECT album FROM album",
+  };
+  sqlite3_stmt *req;
+  guint i;
+
+  /* Create prefix tree */
+  priv->hints = g_slice_new0 (MeloFileDBHint);
+
+  /* Add words from titles, artists and albums */
+  for (i = 0; i < G_N_ELEMENTS (sql); i++) {
+    if (sqlite3_prepare_v2 (priv->db, sql[i], -1, &req, NULL) == SQLITE_OK) {
+      while (sqlite3_step (req) == SQLITE_ROW)
+        melo_file_db_hint_add (priv->hints,
+                               (const gchar *) sqlite3_column_text (req, 0));
+    }
+    sqlite3_finalize (req);
+  }
+}
+
+/* Must be called with database locked */
+static gint
+melo_file_db_get_name_id (MeloFileDBPrivate *priv, MeloFileDBIDCache cache,
+                          const gchar *name)
+{
+  MeloFileDBStmt get = melo_file_db_id_cache_stmt[cache];
+  sqlite3_stmt *req;
+  gint id;
+
+  /* Find ID */
+  id = melo_file_db_id_cache_get (priv, cache, name);
+  if (id)
+    return id;
+
+  /* Add new name */
+  req = melo_file_db_get_stmt (priv, get + 1);
+  if (req) {
+    sqlite3_bind_text (req, 1, name, -1, SQLITE_STATIC);
+    if (melo_file_db_stmt_exec (req))
+      id = sqlite3_last_insert_rowid (priv->db);
+  }
+  melo_file_db_id_cache_add (priv, cache, name, id);
+
+  /* Add name to search hints */
+  if (cache != MELO_FILE_DB_ID_CACHE_GENRE)
+    melo_file_db_hint_add (priv->hints, name);
+
+  /* Add name in Full Text Search table */
+  req = melo_file_db_get_stmt (priv, get + 2);
+  if (req) {
+    sqlite3_bind_text (req, 1, name, -1, SQLITE_STATIC);
+    melo_file_db_stmt_exec (req);
+  }
+
+  return id;
+}
+
+static void
+melo_file_db_reader_free (MeloFileDBReader *reader)
+{
+  /* Finalize prepared statements and close connection */
+  g_hash_table_destroy (reader->find_stmts);
+  sqlite3_close (reader->db);
+  g_slice_free (MeloFileDBReader, reader);
+}
+
+static MeloFileDBReader *
+melo_file_db_reader_get (MeloFileDBPrivate *priv)
+{
+  MeloFileDBReader *reader;
+  gchar *file;
+
+  /* Take an idle reader */
+  g_mutex_lock (&priv->readers_mutex);
+  reader = g_queue_pop_head (&priv->readers);
+  g_mutex_unlock (&priv->readers_mutex);
+  if (reader)
+    return reader;
+
+  /* Get database file path */
+  g_mutex_lock (&priv->mutex);
+  file = g_strdup (priv->file);
+  g_mutex_unlock (&priv->mutex);
+  if (!file)
+    return NULL;
+
+  /* Open a new read-only connection */
+  reader = g_slice_new (MeloFileDBReader);
+  if (sqlite3_open_v2 (file, &reader->db,
+                       SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL)) {
+    sqlite3_close (reader->db);
+    g_slice_free (MeloFileDBReader, reader);
+    g_free (file);
+    return NULL;
+  }
+  sqlite3_busy_timeout (reader->db, MELO_FILE_DB_BUSY_TIMEOUT);
+  sqlite3_create_function (reader->db, "melo_file_db_rank", 1, SQLITE_UTF8,
+                           NULL, melo_file_db_rank, NULL, NULL);
+  g_free (file);
+
+  /* Create cache for find requests */
+  reader->find_stmts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                           (GDestroyNotify) sqlite3_finalize);
+
+  return reader;
+}
+
+static void
+melo_file_db_reader_release (MeloFileDBPrivate *priv,
+                             MeloFileDBReader *reader)
+{
+  /* Put reader back in pool */
+  g_mutex_lock (&priv->readers_mutex);
+  if (priv->readers.length < MELO_FILE_DB_READERS_MAX) {
+    g_queue_push_head (&priv->readers, reader);
+    reader = NULL;
+  }
+  g_mutex_unlock (&priv->readers_mutex);
+
+  /* Too many idle readers */
+  if (reader)
+    melo_file_db_reader_free (reader);
+}
+
+/* Must be called with database locked */
+static gboolean
+melo_file_db_migrate (MeloFileDBPrivate *priv, gint version)
+{
+  gchar *sql;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (melo_file_db_migrations); i++) {
+    const MeloFileDBMigration *step = &melo_file_db_migrations[i];
+
+    /* Already applied */
+    if (step->version <= version)
+      continue;
+
+    /* Apply step and update version in one transaction */
+    sql = sqlite3_mprintf ("BEGIN;%sPRAGMA user_version = %d;COMMIT;",
+                           step->sql, step->version);
+    if (sqlite3_exec (priv->db, sql, NULL, NULL, NULL) != SQLITE_OK) {
+      g_warning ("file_db: migration to version %d failed: %s", step->version,
+                 sqlite3_errmsg (priv->db));
+      sqlite3_exec (priv->db, "ROLLBACK", NULL, NULL, NULL);
+      sqlite3_free (sql);
+      return FALSE;
+    }
+    sqlite3_free (sql);
+    version = step->version;
+  }
+
+  return version == MELO_FILE_DB_VERSION;
+}
+
+/* Must be called with database locked */
+static void
+melo_file_db_setup (MeloFileDBPrivate *priv)
+{
+  gchar *sql;
+
+  /* Use Write-Ahead Logging: readers are not blocked by writer */
+  if (priv->settings.wal)
+    sqlite3_exec (priv->db, "PRAGMA journal_mode = WAL", NULL, NULL, NULL);
+
+  /* Set synchronous mode: 0 = OFF, 1 = NORMAL, 2 = FULL */
+  sql = sqlite3_mprintf ("PRAGMA synchronous = %d",
+                         CLAMP (priv->settings.synchronous, 0, 2));
+  sqlite3_exec (priv->db, sql, NULL, NULL, NULL);
+  sqlite3_free (sql);
+
+  /* Set page cache size (a negative value is a size in KiB) */
+  if (priv->settings.cache_size > 0) {
+    sql = sqlite3_mprintf ("PRAGMA cache_size = -%d",
+                           priv->settings.cache_size);
+    sqlite3_exec (priv->db, sql, NULL, NULL, NULL);
+    sqlite3_free (sql);
+  }
+}
+
+static gboolean
+melo_file_db_open (MeloFileDB *db, const gchar *file)
+{
+  MeloFileDBPrivate *priv = db->priv;
+  gint version;
+  gchar *path;
+
+  /* Create directory if necessary */
+  path = g_path_get_dirname (file);
+  if (g_mkdir_with_parents (path, 0700)) {
+    g_free (path);
+    return FALSE;
+  }
+  g_free (path);
+
+  /* Lock database access */
+  g_mutex_lock (&priv->mutex);
+
+  /* Open database file */
+  if (!priv->db) {
+    /* Open sqlite database */
+    if (sqlite3_open (file, &priv->db)) {
+      g_mutex_unlock (&priv->mutex);
+      return FALSE;
+    }
+
+    /* Get database version */
+    if (!melo_file_db_get_int (priv, MELO_FILE_DB_GET_VERSION, &version))
+      version = 0;
+
+    /* Not initialized, too old version or failed migration */
+    if (version < MELO_FILE_DB_VERSION_MIN ||
+        (version < MELO_FILE_DB_VERSION &&
+         !melo_file_db_migrate (priv, version))) {
+      /* Remove old database */
+      sqlite3_exec (priv->db, MELO_FILE_DB_CLEAN, NULL, NULL, NULL);
+
+      /* Initialize database */
+      sqlite3_exec (priv->db, MELO_FILE_DB_CREATE, NULL, NULL, NULL);
+    }
+
+    /* Setup journaling and cache */
+    melo_file_db_setup (priv);
+    sqlite3_busy_timeout (priv->db, MELO_FILE_DB_BUSY_TIMEOUT);
+
+    /* Load IDs of dimension tables */
+    melo_file_db_id_cache_load (priv);
+
+    /* Save file path for reader connections */
+    priv->file = g_strdup (file);
+  }
+
+  /* Unlock database access */
+  g_mutex_unlock (&priv->mutex);
+
+  return TRUE;
+}
+
+static void
+melo_file_db_close (MeloFileDB *db)
+{
+  MeloFileDBPrivate *priv = db->priv;
+
+  /* Lock database access */
+  g_mutex_lock (&priv->mutex);
+
+  /* Close databse */
+  if (priv->db) {
+    guint i;
+
+    /* Commit pending batch */
+    if (priv->batch_depth)
+      sqlite3_exec (priv->db, "COMMIT", NULL, NULL, NULL);
+    priv->batch_depth = 0;
+
+    /* Finalize prepared statements */
+    for (i = 0; i < MELO_FILE_DB_STMT_COUNT; i++) {
+      sqlite3_finalize (priv->stmts[i]);
+      priv->stmts[i] = NULL;
+    }
+
+    /* Free search hints */
+    melo_file_db_hint_free (priv->hints);
+    priv->hints = NULL;
+
+    /* Free ID caches */
+    for (i = 0; i < MELO_FILE_DB_ID_CACHE_COUNT; i++) {
+      if (priv->ids[i])
+        g_hash_table_destroy (priv->ids[i]);
+      priv->ids[i] = NULL;
+    }
+
+    sqlite3_close (priv->db);
+    priv->db = NULL;
+  }
+  g_free (priv->file);
+  priv->file = NULL;
+
+  /* Unlock database access */
+  g_mutex_unlock (&priv->mutex);
+
+  /* Close idle reader connections */
+  g_mutex_lock (&priv->readers_mutex);
+  while (!g_queue_is_empty (&priv->readers))
+    melo_file_db_reader_free (g_queue_pop_head (&priv->readers));
+  g_mutex_unlock (&priv->readers_mutex);
+}
+
+gboolean
+melo_file_db_get_path_id (MeloFileDB *db, const gchar *path, gboolean add,
+                          gint *path_id)
+{
+  MeloFileDBPrivate *priv = db->priv;
+  sqlite3_stmt *req;
+
+  /* Lock database access */
+  g_mutex_lock (&priv->mutex);
+
+  /* Get ID for path */
+  *path_id = melo_file_db_id_cache_get (priv, MELO_FILE_DB_ID_CACHE_PATH,
+                                        path);
+
+  /* Path not found */
+  if (!*path_id) {
+    if (!add) {
+      g_mutex_unlock (&priv->mutex);
+      return FALSE;
+    }
+
+    /* Add new path */
+    *path_id = 0;
+    req = melo_file_db_get_stmt (priv, MELO_FILE_DB_STMT_PATH_ADD);
+    if (req) {
+      sqlite3_bind_text (req, 1, path, -1, SQLITE_STATIC);
+      if (melo_file_db_stmt_exec (req))
+        *path_id = sqlite3_last_insert_rowid (priv->db);
+    }
+    melo_file_db_id_cache_add (priv, MELO_FILE_DB_ID_CACHE_PATH, path,
+                               *path_id);
+  }
+
+  /* Unlock database access */
+  g_mutex_unlock (&priv->mutex);
+
+  return TRUE;
+}
+
+gboolean
+melo_file_db_add_tags2 (MeloFileDB *db, gint path_id, const gchar *filename,
+                        gint timestamp, MeloTags *tags,
+                        const MeloFileDBInfo *info)
+{
+  const gchar *title, *artist, *album, *genre, *cover;
+  MeloFileDBPrivate *priv = db->priv;
+  sqlite3_stmt *req, *req_fts;
+  guint track = 0, tracks = 0;
+  gint row_id = 0, ts = 0;
+  gint artist_id;
+  gint album_id;
+  gint genre_id;
+  gint date = 0;
+
+  /* Lock database access */
+  g_mutex_lock (&priv->mutex);
+
+  /* Find if file is already registered */
+  req = melo_file_db_get_stmt (priv, MELO_FILE_DB_STMT_SONG_GET);
+  if (req) {
+    sqlite3_bind_int (req, 1, path_id);
+    sqlite3_bind_text (req, 2, filename, -1, SQLITE_STATIC);
+    while (sqlite3_step (req) == SQLITE_ROW) {
+      row_id = sqlite3_column_int (req, 0);
+      ts = sqlite3_column_int (req, 1);
+    }
+    melo_file_db_reset_stmt (req);
+  }
+
+  /* File already registered and up to date */
+  if (row_id && timestamp == ts) {
+    g_mutex_unlock (&priv->mutex);
+    return TRUE;
+  }
+
+  /* Get strings from tags */
+  title = tags && tags->title ? tags->title : NULL;
+  artist = tags && tags->artist ? tags->artist : "Unknown";
+  album = tags && tags->album ? tags->album : "Unknown";
+  genre = tags && tags->genre ? tags->genre : "Unknown";
+  cover = tags && tags->cover ? tags->cover : NULL;
+
+  /* Get values from tags */
+  if (tags) {
+    date = tags->date;
+    track = tags->track;
+    tracks = tags->tracks;
+  }
+
+  /* Find artist, album and genre IDs (and add if not available) */
+  artist_id = melo_file_db_get_name_id (priv, MELO_FILE_DB_ID_CACHE_ARTIST,
+                                        artist);
+  album_id = melo_file_db_get_name_id (priv, MELO_FILE_DB_ID_CACHE_ALBUM,
+                                       album);
+  genre_id = melo_file_db_get_name_id (priv, MELO_FILE_DB_ID_CACHE_GENRE,
+                                       genre);
+
+  /* Add song */
+  if (!row_id) {
+    melo_file_db_hint_add (priv->hints, title);
+    req = melo_file_db_get_stmt (priv, MELO_FILE_DB_STMT_SONG_ADD);
+    if (req) {
+      sqlite3_bind_text (req, 14, filename, -1, SQLITE_STATIC);
+      sqlite3_bind_int (req, 15, path_id);
+      sqlite3_bind_int (req, 16, timestamp);
+    }
+    req_fts = melo_file_db_get_stmt (priv, MELO_FILE_DB_STMT_SONG_FTS_ADD);
+    if (req_fts) {
+      sqlite3_bind_text (req_fts, 1, filename, -1, SQLITE_STATIC);
+      sqlite3_bind_text (req_fts, 2, title, -1, SQLITE_STATIC);
+    }
+  } else {
+    req = melo_file_db_get_stmt (priv, MELO_FILE_DB_STMT_SONG_UPDATE);
+    if (req) {
+      sqlite3_bind_int (req, 14, timestamp);
+      sqlite3_bind_int (req, 15, row_id);
+    }
+    req_fts = melo_file_db_get_stmt (priv, MELO_FILE_DB_STMT_SONG_FTS_UPDATE);
+    if (req_fts) {
+      sqlite3_bind_text (req_fts, 1, title, -1, SQLITE_STATIC);
+      sqlite3_bind_int (req_fts, 2, row_id);
+    }
+  }
+  if (req) {
+    sqlite3_bind_text (req, 1, title, -1, SQLITE_STATIC);
+    sqlite3_bind_int (req, 2, artist_id);
+    sqlite3_bind_int (req, 3, album_id);
+    sqlite3_bind_int (req, 4, genre_id);
+    sqlite3_bind_int (req, 5, date);
+    sqlite3_bind_int (req, 6, track);
+    sqlite3_bind_int (req, 7, tracks);
+    sqlite3_bind_text (req, 8, cover, -1, SQLITE_STATIC);
+
+    /* Unknown details are left NULL */
+    if (info) {
+      if (info->duration > 0)
+        sqlite3_bind_int (req, 9, info->duration);
+      sqlite3_bind_text (req, 10, info->codec, -1, SQLITE_STATIC);
+      if (info->rate > 0)
+        sqlite3_bind_int (req, 11, info->rate);
+      if (info->channels > 0)
+        sqlite3_bind_int (req, 12, info->channels);
+      if (info->bitrate > 0)
+        sqlite3_bind_int (req, 13, info->bitrate);
+    }
+    melo_file_db_stmt_exec (req);
+  }
+
+  /* Add song in Full Text Search table */
+  if (req_fts)
+    melo_file_db_stmt_exec (req_fts);
+
+  /* Unlock database access */
+  g_mutex_unlock (&priv->mutex);
+
+  return TRUE;
+}
+
+gboolean
+melo_file_db_begin_batch (MeloFileDB *db)
+{
+  MeloFileDBPrivate *priv = db->priv;
+  gboolean ret = TRUE;
+
+  /* Lock database access */
+  g_mutex_lock (&priv->mutex);
+
+  /* Start a new transaction (batches can be nested) */
+  if (!priv->batch_depth++) {
+    priv->batch_count = 0;
+    ret = sqlite3_exec (priv->db, "BEGIN", NULL, NULL, NULL) == SQLITE_OK;
+    if (!ret)
+      priv->batch_depth = 0;
+  }
+
+  /* Unlock database access */
+  g_mutex_unlock (&priv->mutex);
+
+  return ret;
+}
+
+gboolean
+melo_file_db_add_tags_batch (MeloFileDB *db, gint path_id,
+                             const gchar *filename, gint timestamp,
+                             MeloTags *tags, const MeloFileDBInfo *info)
+{
+  MeloFileDBPrivate *priv = db->priv;
+  gboolean ret;
+
+  /* Add tags to database */
+  ret = melo_file_db_add_tags2 (db, path_id, filename, timestamp, tags, info);
+
+  /* Lock database access */
+  g_mutex_lock (&priv->mutex);
+
+  /* Commit transaction when batch is full */
+  if (priv->batch_depth && ++priv->batch_count >= MELO_FILE_DB_BATCH_SIZE) {
+    priv->batch_count = 0;
+    if (sqlite3_exec (priv->db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK) {
+      /* Abort batch: IDs added in transaction are lost */
+      sqlite3_exec (priv->db, "ROLLBACK", NULL, NULL, NULL);
+      melo_file_db_id_cache_clear (priv);
+      priv->batch_depth = 0;
+      ret = FALSE;
+    } else if (sqlite3_exec (priv->db, "BEGIN", NULL, NULL, NULL) != SQLITE_OK)
+      priv->batch_depth = 0;
+  }
+
+  /* Unlock database access */
+  g_mutex_unlock (&priv->mutex);
+
+  return ret;
+}
+
+gboolean
+melo_file_db_commit_batch (MeloFileDB *db)
+{
+  MeloFileDBPrivate *priv = db->priv;
+  gboolean ret = TRUE;
+
+  /* Lock database access */
+  g_mutex_lock (&priv->mutex);
+
+  /* Commit transaction when outer batch is done */
+  if (priv->batch_depth && !--priv->batch_depth)
+    ret = sqlite3_exec (priv->db, "COMMIT", NULL, NULL, NULL) == SQLITE_OK;
+
+  /* Abort batch: IDs added in transaction are lost */
+  if (!ret) {
+    sqlite3_exec (priv->db, "ROLLBACK", NULL, NULL, NULL);
+    melo_file_db_id_cache_clear (priv);
+  }
+
+  /* Unlock database access */
+  g_mutex_unlock (&priv->mutex);
+
+  return ret;
+}
+
+gboolean
+melo_file_db_get_timestamp (MeloFileDB *db, gint path_id,
+                            const gchar *filename, gint *timestamp)
+{
+  MeloFileDBPrivate *priv = db->priv;
+  gboolean ret = FALSE;
+  sqlite3_stmt *req;
+
+  /* Lock database access */
+  g_mutex_lock (&priv->mutex);
+
+  /* Find file */
+  req = melo_file_db_get_stmt (priv, MELO_FILE_DB_STMT_SONG_GET);
+  if (req) {
+    sqlite3_bind_int (req, 1, path_id);
+    sqlite3_bind_text (req, 2, filename, -1, SQLITE_STATIC);
+    while (sqlite3_step (req) == SQLITE_ROW) {
+      *timestamp = sqlite3_column_int (req, 1);
+      ret = TRUE;
+    }
+    melo_file_db_reset_stmt (req);
+  }
+
+  /* Unlock database access */
+  g_mutex_unlock (&priv->mutex);
+
+  return ret;
+}
+
+gboolean
+melo_file_db_get_info (MeloFileDB *db, gint path_id, const gchar *filename,
+                       MeloFileDBInfo *info)
+{
+  MeloFileDBPrivate *priv = db->priv;
+  gboolean ret = FALSE;
+  sqlite3_stmt *req;
+
+  /* Lock database access */
+  g_mutex_lock (&priv->mutex);
+
+  /* Find file */
+  req = melo_file_db_get_stmt (priv, MELO_FILE_DB_STMT_SONG_INFO_GET);
+  if (req) {
+    sqlite3_bind_int (req, 1, path_id);
+    sqlite3_bind_text (req, 2, filename, -1, SQLITE_STATIC);
+    while (sqlite3_step (req) == SQLITE_ROW) {
+      info->duration = sqlite3_column_int (req, 0);
+      info->codec = g_intern_string (
+                                (const gchar *) sqlite3_column_text (req, 1));
+      info->rate = sqlite3_column_int (req, 2);
+      info->channels = sqlite3_column_int (req, 3);
+      info->bitrate = sqlite3_column_int (req, 4);
+      ret = TRUE;
+    }
+    melo_file_db_reset_stmt (req);
+  }
+
+  /* Unlock database access */
+  g_mutex_unlock (&priv->mutex);
+
+  return ret;
+}
+
+gboolean
+melo_file_db_get_loudness (MeloFileDB *db, gint path_id,
+                           const gchar *filename, gdouble *loudness,
+                           gdouble *peak)
+{
+  MeloFileDBPrivate *priv = db->priv;
+  gboolean ret = FALSE;
+  sqlite3_stmt *req;
+
+  /* Lock database access */
+  g_mutex_lock (&priv->mutex);
+
+  /* Find analyzed file */
+  req = melo_file_db_get_stmt (priv, MELO_FILE_DB_STMT_LOUDNESS_GET);
+  if (req) {
+    sqlite3_bind_int (req, 1, path_id);
+    sqlite3_bind_text (req, 2, filename, -1, SQLITE_STATIC);
+    while (sqlite3_step (req) == SQLITE_ROW) {
+      *loudness = sqlite3_column_double (req, 0);
+      *peak = sqlite3_column_double (req, 1);
+      ret = TRUE;
+    }
+    melo_file_db_reset_stmt (req);
+  }
+
+  /* Unlock database access */
+  g_mutex_unlock (&priv->mutex);
+
+  return ret;
+}
+
+gboolean
+melo_file_db_set_loudness (MeloFileDB *db, gint file_id, gdouble loudness,
+                           gdouble peak)
+{
+  MeloFileDBPrivate *priv = db->priv;
+  gboolean ret = FALSE;
+  sqlite3_stmt *req;
+
+  /* Lock database access */
+  g_mutex_lock (&priv->mutex);
+
+  /* Save loudness of file */
+  req = melo_file_db_get_stmt (priv, MELO_FILE_DB_STMT_LOUDNESS_SET);
+  if (req) {
+    sqlite3_bind_double (req, 1, loudness);
+    sqlite3_bind_double (req, 2, peak);
+    sqlite3_bind_int (req, 3, file_id);
+    ret = melo_file_db_stmt_exec (req);
+  }
+
+  /* Unlock database access */
+  g_mutex_unlock (&priv->mutex);
+
+  return ret;
+}
+
+gboolean
+melo_file_db_get_next_loudness (MeloFileDB *db, gint after_id, gint *file_id,
+                                gchar **path, gchar **filename)
+{
+  MeloFileDBPrivate *priv = db->priv;
+  gboolean ret = FALSE;
+  sqlite3_stmt *req;
+
+  /* Lock database access */
+  g_mutex_lock (&priv->mutex);
+
+  /* Find next file to analyze */
+  req = melo_file_db_get_stmt (priv, MELO_FILE_DB_STMT_LOUDNESS_NEXT);
+  if (req) {
+    sqlite3_bind_int (req, 1, after_id);
+    while (sqlite3_step (req) == SQLITE_ROW) {
+      *file_id = sqlite3_column_int (req, 0);
+      *path = g_strdup ((const gchar *) sqlite3_column_text (req, 1));
+      *filename = g_strdup ((const gchar *) sqlite3_column_text (req, 2));
+      ret = TRUE;
+    }
+    melo_file_db_reset_stmt (req);
+  }
+
+  /* Unlock database access */
+  g_mutex_unlock (&priv->mutex);
+
+  return ret;
+}
+
+gboolean
+melo_file_db_get_stats (MeloFileDB *db, MeloFileDBType type, gint id,
+                        gint *songs, gint *albums, gint64 *duration)
+{
+  MeloFileDBPrivate *priv = db->priv;
+  gboolean ret = FALSE;
+  sqlite3_stmt *req;
+  MeloFileDBStmt stmt;
+
+  /* Select request */
+  switch (type) {
+    case MELO_FILE_DB_TYPE_SONG:
+      stmt = MELO_FILE_DB_STMT_SONG_STATS;
+      break;
+    case MELO_FILE_DB_TYPE_ARTIST:
+      stmt = MELO_FILE_DB_STMT_ARTIST_STATS;
+      break;
+    case MELO_FILE_DB_TYPE_ALBUM:
+      stmt = MELO_FILE_DB_STMT_ALBUM_STATS;
+      break;
+    case MELO_FILE_DB_TYPE_GENRE:
+      stmt = MELO_FILE_DB_STMT_GENRE_STATS;
+      break;
+    default:
+      return FALSE;
+  }
+
+  /* Lock database access */
+  g_mutex_lock (&priv->mutex);
+
+  /* Get song count, album count and total duration */
+  req = melo_file_db_get_stmt (priv, stmt);
+  if (req) {
+    if (type != MELO_FILE_DB_TYPE_SONG)
+      sqlite3_bind_int (req, 1, id);
+    if (sqlite3_step (req) == SQLITE_ROW) {
+      if (songs)
+        *songs = sqlite3_column_int (req, 0);
+      if (albums)
+        *albums = sqlite3_column_int (req, 1);
+      if (duration)
+        *duration = sqlite3_column_int64 (req, 2);
+      ret = TRUE;
+    }
+    melo_file_db_reset_stmt (req);
   }
 
-  /* Finalize request */
-  sqlite3_finalize (req);
+  /* Unlock database access */
+  g_mutex_unlock (&priv->mutex);
 
-  return ret != SQLITE_DONE || !count ? FALSE : TRUE;
+  return ret;
 }
 
-static gboolean
-melo_file_db_open (MeloFileDB *db, const gchar *file)
+gboolean
+melo_file_db_get_query_stats (MeloFileDB *db, MeloFileDBQueryStats *stats)
 {
   MeloFileDBPrivate *priv = db->priv;
-  gint version;
-  gchar *path;
+  GStatBuf st;
 
-  /* Create directory if necessary */
-  path = g_path_get_dirname (file);
-  if (g_mkdir_with_parents (path, 0700)) {
-    g_free (path);
+  if (!stats)
     return FALSE;
-  }
-  g_free (path);
 
-  /* Lock database access */
-  g_mutex_lock (&priv->mutex);
+  /* Get database file size */
+  stats->size = priv->file && !g_stat (priv->file, &st) ? st.st_size : -1;
 
-  /* Open database file */
-  if (!priv->db) {
-    /* Open sqlite database */
-    if (sqlite3_open (file, &priv->db)) {
-      g_mutex_unlock (&priv->mutex);
-      return FALSE;
-    }
+  /* Get query statistics */
+  g_mutex_lock (&priv->stats_mutex);
+  stats->queries = priv->queries;
+  stats->query_time = priv->query_time;
+  stats->query_max = priv->query_max;
+  g_mutex_unlock (&priv->stats_mutex);
 
-    /* Get database version */
-    if (!melo_file_db_get_int (priv, MELO_FILE_DB_GET_VERSION, &version))
-      version = 0;
+  return TRUE;
+}
 
-    /* Not initialized or old version */
-    if (version < MELO_FILE_DB_VERSION) {
-      /* Remove old database */
-      sqlite3_exec (priv->db, MELO_FILE_DB_CLEAN, NULL, NULL, NULL);
+gboolean
+melo_file_db_get_memory_usage (MeloFileDB *db, MeloMemoryUsage *usage)
+{
+  MeloFileDBPrivate *priv = db->priv;
+  gint cache = 0, stmt = 0, cur, high;
+  guint connections = 0, stmts = 0;
+  GList *l;
 
-      /* Initialize database */
-      sqlite3_exec (priv->db, MELO_FILE_DB_CREATE, NULL, NULL, NULL);
-    }
-  }
+  if (!usage)
+    return FALSE;
 
-  /* Unlock database access */
+  /* Get memory of main connection */
+  g_mutex_lock (&priv->mutex);
+  if (priv->db) {
+    sqlite3_db_status (priv->db, SQLITE_DBSTATUS_CACHE_USED, &cur, &high, 0);
+    cache += cur;
+    sqlite3_db_status (priv->db, SQLITE_DBSTATUS_STMT_USED, &cur, &high, 0);
+    stmt += cur;
+    connections++;
+  }
   g_mutex_unlock (&priv->mutex);
 
+  /* Get memory of idle readers */
+  g_mutex_lock (&priv->readers_mutex);
+  for (l = priv->readers.head; l != NULL; l = l->next) {
+    MeloFileDBReader *reader = l->data;
+
+    sqlite3_db_status (reader->db, SQLITE_DBSTATUS_CACHE_USED, &cur, &high, 0);
+    cache += cur;
+    sqlite3_db_status (reader->db, SQLITE_DBSTATUS_STMT_USED, &cur, &high, 0);
+    stmt += cur;
+    stmts += g_hash_table_size (reader->find_stmts);
+    connections++;
+  }
+  g_mutex_unlock (&priv->readers_mutex);
+
+  /* Whole SQLite heap includes busy readers */
+  usage->bytes = sqlite3_memory_used ();
+  usage->count = connections;
+  usage->details = json_object_new ();
+  json_object_set_int_member (usage->details, "page_cache_bytes", cache);
+  json_object_set_int_member (usage->details, "statements_bytes", stmt);
+  json_object_set_int_member (usage->details, "find_statements", stmts);
+
   return TRUE;
 }
 
-static void
-melo_file_db_close (MeloFileDB *db)
+void
+melo_file_db_release_memory (MeloFileDB *db)
 {
   MeloFileDBPrivate *priv = db->priv;
+  GList *l;
 
-  /* Lock database access */
+  /* Release page cache of main connection */
   g_mutex_lock (&priv->mutex);
+  if (priv->db)
+    sqlite3_db_release_memory (priv->db);
+  g_mutex_unlock (&priv->mutex);
 
-  /* Close databse */
-  if (priv->db) {
-    sqlite3_close (priv->db);
-    priv->db = NULL;
-  }
+  /* Release cached find statements and page cache of idle readers */
+  g_mutex_lock (&priv->readers_mutex);
+  for (l = priv->readers.head; l != NULL; l = l->next) {
+    MeloFileDBReader *reader = l->data;
 
-  /* Unlock database access */
-  g_mutex_unlock (&priv->mutex);
+    g_hash_table_remove_all (reader->find_stmts);
+    sqlite3_db_release_memory (reader->db);
+  }
+  g_mutex_unlock (&priv->readers_mutex);
 }
 
 gboolean
-melo_file_db_get_path_id (MeloFileDB *db, const gchar *path, gboolean add,
-                          gint *path_id)
+melo_file_db_remove (MeloFileDB *db, const gchar *path, const gchar *filename)
 {
   MeloFileDBPrivate *priv = db->priv;
-  gboolean ret;
-  char *sql;
+  sqlite3_stmt *req;
+  gint path_id, row_id = 0;
+  gboolean ret = FALSE;
+
+  /* Remove all songs of path */
+  if (!filename) {
+    g_mutex_lock (&priv->mutex);
+    req = melo_file_db_get_stmt (priv, MELO_FILE_DB_STMT_PATH_FTS_REMOVE);
+    if (req) {
+      sqlite3_bind_text (req, 1, path, -1, SQLITE_STATIC);
+      melo_file_db_stmt_exec (req);
+    }
+    req = melo_file_db_get_stmt (priv, MELO_FILE_DB_STMT_PATH_REMOVE);
+    if (req) {
+      sqlite3_bind_text (req, 1, path, -1, SQLITE_STATIC);
+      ret = melo_file_db_stmt_exec (req);
+    }
+    g_mutex_unlock (&priv->mutex);
+    return ret;
+  }
+
+  /* Get path ID */
+  if (!melo_file_db_get_path_id (db, path, FALSE, &path_id))
+    return FALSE;
 
   /* Lock database access */
   g_mutex_lock (&priv->mutex);
 
-  /* Get ID for path */
-  sql = sqlite3_mprintf ("SELECT rowid FROM path WHERE path = '%q'", path);
-  ret = melo_file_db_get_int (priv, sql, path_id);
-  sqlite3_free (sql);
+  /* Find song */
+  req = melo_file_db_get_stmt (priv, MELO_FILE_DB_STMT_SONG_GET);
+  if (req) {
+    sqlite3_bind_int (req, 1, path_id);
+    sqlite3_bind_text (req, 2, filename, -1, SQLITE_STATIC);
+    melo_file_db_stmt_get_int (req, &row_id);
+  }
 
-  /* Path not found */
-  if (!ret || !*path_id) {
-    if (!add) {
-      g_mutex_unlock (&priv->mutex);
-      return FALSE;
+  /* Remove song */
+  if (row_id) {
+    req = melo_file_db_get_stmt (priv, MELO_FILE_DB_STMT_SONG_FTS_REMOVE);
+    if (req) {
+      sqlite3_bind_int (req, 1, row_id);
+      melo_file_db_stmt_exec (req);
+    }
+    req = melo_file_db_get_stmt (priv, MELO_FILE_DB_STMT_SONG_REMOVE);
+    if (req) {
+      sqlite3_bind_int (req, 1, row_id);
+      ret = melo_file_db_stmt_exec (req);
     }
-
-    /* Add new path */
-    sql = sqlite3_mprintf ("INSERT INTO path (path) VALUES ('%q')", path);
-    sqlite3_exec (priv->db, sql, NULL, NULL, NULL);
-    *path_id = sqlite3_last_insert_rowid (priv->db);
-    sqlite3_free (sql);
   }
 
   /* Unlock database access */
   g_mutex_unlock (&priv->mutex);
 
-  return TRUE;
+  return ret;
 }
 
-gboolean
-melo_file_db_add_tags2 (MeloFileDB *db, gint path_id, const gchar *filename,
-                        gint timestamp, MeloTags *tags)
+gchar *
+melo_file_db_get_hint (MeloFileDB *db, const gchar *input)
 {
-  const gchar *title, *artist, *album, *genre, *cover;
   MeloFileDBPrivate *priv = db->priv;
-  sqlite3_stmt *req;
-  guint track = 0, tracks = 0;
-  gint row_id = 0, ts = 0;
-  gint artist_id;
-  gint album_id;
-  gint genre_id;
-  gint date = 0;
-  gboolean ret;
-  char *sql, *sql_fts;
+  MeloFileDBHint *node;
+  const gchar *word, *s;
+  gchar *prefix, *p;
+  gchar *hint = NULL;
 
-  /* Lock database access */
-  g_mutex_lock (&priv->mutex);
+  if (!input)
+    return NULL;
 
-  /* Find if file is already registered */
-  sql = sqlite3_mprintf ("SELECT rowid,timestamp FROM song "
-                         "WHERE path_id = %d AND file = '%q'",
-                         path_id, filename);
-  sqlite3_prepare_v2 (priv->db, sql, -1, &req, NULL);
-  sqlite3_free (sql);
-  while (sqlite3_step (req) == SQLITE_ROW) {
-    row_id = sqlite3_column_int (req, 0);
-    ts = sqlite3_column_int (req, 1);
+  /* Find last word of input */
+  word = NULL;
+  for (s = input; *s; s = g_utf8_next_char (s)) {
+    if (!g_unichar_isalnum (g_utf8_get_char (s)))
+      word = NULL;
+    else if (!word)
+      word = s;
   }
-  sqlite3_finalize (req);
+  if (!word)
+    return NULL;
+  prefix = g_utf8_strdown (word, -1);
 
-  /* File already registered and up to date */
-  if (row_id && timestamp == ts) {
-    g_mutex_unlock (&priv->mutex);
-    return TRUE;
-  }
+  /* Lock database access */
+  g_mutex_lock (&priv->mutex);
 
-  /* Get strings from tags */
-  title = tags && tags->title ? tags->title : NULL;
-  artist = tags && tags->artist ? tags->artist : "Unknown";
-  album = tags && tags->album ? tags->album : "Unknown";
-  genre = tags && tags->genre ? tags->genre : "Unknown";
-  cover = tags && tags->cover ? tags->cover : NULL;
+  /* Load prefix tree on first call */
+  if (!priv->hints && priv->db)
+    melo_file_db_hint_load (priv);
 
-  /* Get values from tags */
-  if (tags) {
-    date = tags->date;
-    track = tags->track;
-    tracks = tags->tracks;
+  /* Find node of prefix */
+  node = priv->hints;
+  for (p = prefix; node && *p; p++) {
+    node = node->child;
+    while (node && node->c != (guchar) *p)
+      node = node->next;
   }
 
-  /* Find artist ID */
-  sql = sqlite3_mprintf ("SELECT rowid FROM artist WHERE artist = '%q'",
-                         artist);
-  ret = melo_file_db_get_int (priv, sql, &artist_id);
-  sqlite3_free (sql);
-  if (!ret || !artist_id) {
-    /* Add new artist */
-    sql = sqlite3_mprintf ("INSERT INTO artist (artist) VALUES ('%q')",
-                           artist);
-    sqlite3_exec (priv->db, sql, NULL, NULL, NULL);
-    artist_id = sqlite3_last_insert_rowid (priv->db);
-    sqlite3_free (sql);
+  /* Complete last word with most frequent word */
+  if (node && node != priv->hints && node->best &&
+      strcmp (node->best->word, prefix))
+    hint = g_strdup_printf ("%.*s%s", (int) (word - input), input,
+                            node->best->word);
 
-    /* Add artist in Full Text Search table */
-    sql_fts = sqlite3_mprintf ("INSERT INTO artist_fts (artist) VALUES ('%q')",
-                               artist);
-    sqlite3_exec (priv->db, sql_fts, NULL, NULL, NULL);
-    sqlite3_free (sql_fts);
-  }
+  /* Unlock database access */
+  g_mutex_unlock (&priv->mutex);
+  g_free (prefix);
 
-  /* Find album ID */
-  sql = sqlite3_mprintf ("SELECT rowid FROM album WHERE album = '%q'", album);
-  ret = melo_file_db_get_int (priv, sql, &album_id);
-  sqlite3_free (sql);
-  if (!ret || !album_id) {
-    /* Add new album */
-    sql = sqlite3_mprintf ("INSERT INTO album (album) VALUES ('%q')", album);
-    sqlite3_exec (priv->db, sql, NULL, NULL, NULL);
-    album_id = sqlite3_last_insert_rowid (priv->db);
-    sqlite3_free (sql);
+  return hint;
+}
 
-    /* Add album in Full Text Search table */
-    sql_fts = sqlite3_mprintf ("INSERT INTO album_fts (album) VALUES ('%q')",
-                               album);
-    sqlite3_exec (priv->db, sql_fts, NULL, NULL, NULL);
-    sqlite3_free (sql_fts);
-  }
+gchar *
+melo_file_db_build_prefix_query (const gchar *input)
+{
+  const gchar *word = NULL, *s;
+  GString *query;
 
-  /* Find genre ID */
-  sql = sqlite3_mprintf ("SELECT rowid FROM genre WHERE genre = '%q'", genre);
-  ret = melo_file_db_get_int (priv, sql, &genre_id);
-  sqlite3_free (sql);
-  if (!ret || !genre_id) {
-    /* Add new genre */
-    sql = sqlite3_mprintf ("INSERT INTO genre (genre) VALUES ('%q')", genre);
-    sqlite3_exec (priv->db, sql, NULL, NULL, NULL);
-    genre_id = sqlite3_last_insert_rowid (priv->db);
-    sqlite3_free (sql);
+  if (!input)
+    return NULL;
 
-    /* Add genre in Full Text Search table */
-    sql_fts = sqlite3_mprintf ("INSERT INTO genre_fts (genre) VALUES ('%q')",
-                               genre);
-    sqlite3_exec (priv->db, sql_fts, NULL, NULL, NULL);
-    sqlite3_free (sql_fts);
+  /* Match all words of input as prefixes: "word1* word2*" */
+  query = g_string_new (NULL);
+  for (s = input; ; s = g_utf8_next_char (s)) {
+    gboolean alnum = *s && g_unichar_isalnum (g_utf8_get_char (s));
+
+    if (alnum && !word)
+      word = s;
+    else if (!alnum && word) {
+      if (query->len)
+        g_string_append_c (query, ' ');
+      g_string_append_len (query, word, s - word);
+      g_string_append_c (query, '*');
+      word = NULL;
+    }
+    if (!*s)
+      break;
   }
 
-  /* Add song */
-  if (!row_id) {
-    sql = sqlite3_mprintf ("INSERT INTO song (title,artist_id,album_id,"
-                           "genre_id,date,track,tracks,cover,file,path_id,"
-                           "timestamp) "
-                           "VALUES (%Q,%d,%d,%d,%d,%d,%d,%Q,'%q',%d,%d)",
-                           title, artist_id, album_id, genre_id, date, track,
-                           tracks, cover, filename, path_id, timestamp);
-    sql_fts = sqlite3_mprintf ("INSERT INTO song_fts (file,title) "
-                               "VALUES ('%q',%Q)", filename, title);
-  } else {
-    sql = sqlite3_mprintf ("UPDATE song SET title = %Q, artist_id = %d, "
-                           "album_id = %d, genre_id = %d, date = %d, "
-                           "track = %d, tracks = %d, cover = %Q, "
-                           "timestamp = '%d' "
-                           "WHERE rowid = %d",
-                           title, artist_id, album_id, genre_id, date, track,
-                           tracks, cover, timestamp, row_id);
-    sql_fts = sqlite3_mprintf ("UPDATE song_fts SET title=%Q WHERE rowid = %d",
-                               title, row_id);
+  /* No word found */
+  if (!query->len) {
+    g_string_free (query, TRUE);
+    return NULL;
   }
-  sqlite3_exec (priv->db, sql, NULL, NULL, NULL);
-  sqlite3_free (sql);
-
-  /* Add song in Full Text Search table */
-  sqlite3_exec (priv->db, sql_fts, NULL, NULL, NULL);
-  sqlite3_free (sql_fts);
 
-  /* Unlock database access */
-  g_mutex_unlock (&priv->mutex);
-
-  return TRUE;
+  return g_string_free (query, FALSE);
 }
 
 gboolean
 melo_file_db_add_tags (MeloFileDB *db, const gchar *path, const gchar *filename,
-                       gint timestamp, MeloTags *tags)
+                       gint timestamp, MeloTags *tags,
+                       const MeloFileDBInfo *info)
 {
   gint path_id;
 
@@ -425,39 +1775,231 @@ melo_file_db_add_tags (MeloFileDB *db, const gchar *path, const gchar *filename,
     return FALSE;
 
   /* Add tags to database */
-  return melo_file_db_add_tags2 (db, path_id, filename, timestamp, tags);
+  return melo_file_db_add_tags2 (db, path_id, filename, timestamp, tags, info);
 }
 
 #define MELO_FILE_DB_COND_SIZE 256
 #define MELO_FILE_DB_COLUMN_SIZE 256
 
+typedef struct {
+  const gchar *text;
+  gint value;
+} MeloFileDBParam;
+
+/* Position in a list, used for keyset pagination */
+typedef struct {
+  guint type;
+  guint sort;
+  gint id;
+  gchar *key;
+} MeloFileDBCursor;
+
+static gchar *
+melo_file_db_cursor_to_token (MeloFileDBType type, MeloSort sort, gint id,
+                              const gchar *key)
+{
+  gchar *str, *token;
+
+  /* Save type, sort, last ID and last sort key (N for a NULL key) */
+  str = g_strdup_printf ("%u:%u:%d:%c%s", type, sort, id, key ? 'V' : 'N',
+                         key ? key : "");
+  token = g_base64_encode ((const guchar *) str, strlen (str));
+  g_free (str);
+
+  return token;
+}
+
+static gboolean
+melo_file_db_cursor_from_token (MeloFileDBCursor *cursor, const gchar *token,
+                                MeloFileDBType type, MeloSort sort)
+{
+  gchar *str, *end, *key;
+  gsize len;
+
+  /* Decode token */
+  str = (gchar *) g_base64_decode (token, &len);
+  if (!str)
+    return FALSE;
+  str = g_realloc (str, len + 1);
+  str[len] = '\0';
+
+  /* Parse fields */
+  cursor->type = strtoul (str, &end, 10);
+  if (*end++ != ':')
+    goto failed;
+  cursor->sort = strtoul (end, &end, 10);
+  if (*end++ != ':')
+    goto failed;
+  cursor->id = strtol (end, &end, 10);
+  if (*end++ != ':' || (*end != 'V' && *end != 'N'))
+    goto failed;
+  key = *end == 'V' ? end + 1 : NULL;
+
+  /* Token has been generated for another list */
+  if (cursor->type != type || cursor->sort != sort)
+    goto failed;
+
+  cursor->key = key ? g_strdup (key) : NULL;
+  g_free (str);
+
+  return TRUE;
+
+failed:
+  g_free (str);
+  return FALSE;
+}
+
+static sqlite3_stmt *
+melo_file_db_find_stmt_get (MeloFileDBReader *reader, const gchar *sql)
+{
+  sqlite3_stmt *req = NULL;
+  gpointer key;
+
+  /* Take prepared statement from cache */
+  if (g_hash_table_lookup_extended (reader->find_stmts, sql, &key,
+                                    (gpointer *) &req)) {
+    g_hash_table_steal (reader->find_stmts, sql);
+    g_free (key);
+  } else if (sqlite3_prepare_v2 (reader->db, sql, -1, &req, NULL) !=
+             SQLITE_OK) {
+    sqlite3_finalize (req);
+    req = NULL;
+  }
+
+  return req;
+}
+
+static void
+melo_file_db_find_stmt_release (MeloFileDBReader *reader, gchar *sql,
+                                sqlite3_stmt *req)
+{
+  /* Reset statement for next use */
+  melo_file_db_reset_stmt (req);
+
+  /* Cache is full: flush it */
+  if (g_hash_table_size (reader->find_stmts) >= MELO_FILE_DB_FIND_CACHE_MAX)
+    g_hash_table_remove_all (reader->find_stmts);
+
+  /* Save statement in cache */
+  g_hash_table_insert (reader->find_stmts, sql, req);
+}
+
+/*
+ * Lookups in full text tables are joined with their rank, computed with
+ * Okapi BM25 from the matchinfo() of the row, in order to sort by relevance.
+ */
+#define MELO_FILE_DB_RANK_K1 1.2
+#define MELO_FILE_DB_RANK_B 0.75
+
+static void
+melo_file_db_rank (sqlite3_context *ctx, int argc, sqlite3_value **argv)
+{
+  const guint32 *info, *avg, *len, *hits;
+  gdouble score = 0.0;
+  guint32 p, c, n, i, j;
+
+  /* Get matchinfo() with 'pcnalx' format */
+  info = sqlite3_value_blob (argv[0]);
+  if (!info || sqlite3_value_bytes (argv[0]) < 3 * (int) sizeof (*info))
+    goto end;
+  p = info[0];
+  c = info[1];
+  n = info[2];
+  if ((guint) sqlite3_value_bytes (argv[0]) <
+      (3 + 2 * c + 3 * p * c) * sizeof (*info))
+    goto end;
+  avg = info + 3;
+  len = avg + c;
+  hits = len + c;
+
+  /* Calculate score of each phrase in each column */
+  for (i = 0; i < p; i++) {
+    for (j = 0; j < c; j++) {
+      const guint32 *x = hits + 3 * (j + i * c);
+      gdouble idf, norm;
+
+      if (!x[0])
+        continue;
+
+      idf = log (1.0 + (n - x[2] + 0.5) / (x[2] + 0.5));
+      norm = MELO_FILE_DB_RANK_K1 * (1.0 - MELO_FILE_DB_RANK_B +
+             MELO_FILE_DB_RANK_B * len[j] / (avg[j] ? avg[j] : 1));
+      score += idf * x[0] * (MELO_FILE_DB_RANK_K1 + 1.0) / (x[0] + norm);
+    }
+  }
+
+end:
+  sqlite3_result_double (ctx, score);
+}
+
+static void
+melo_file_db_rank_join (GString *joins, GString *ranks, const gchar *table,
+                        const gchar *match, const gchar *alias,
+                        const gchar *id)
+{
+  /* Join matching docid with rank */
+  g_string_append_printf (joins, " LEFT JOIN (SELECT docid,"
+                          "melo_file_db_rank(matchinfo(%s_fts,'pcnalx')) "
+                          "AS rank FROM %s_fts WHERE %s MATCH ?) %s "
+                          "ON %s.docid = %s", table, table, match, alias,
+                          alias, id);
+
+  /* Add rank to global rank */
+  g_string_append_printf (ranks, "%sIFNULL(%s.rank,0)",
+                          ranks->len ? " + " : "", alias);
+}
+
 static gboolean
 melo_file_db_vfind (MeloFileDB *db, MeloFileDBType type, GObject *obj,
                     MeloFileDBGetList cb, gpointer user_data, MeloTags **utags,
-                    gint offset, gint count, MeloSort sort, gboolean match,
+                    const gchar *token, gchar **next_token, gint offset,
+                    gint count, MeloSort sort, gboolean match,
                     MeloTagsFields tags_fields, MeloFileDBFields field,
                     va_list args)
 {
+  static const gchar *trace_names[MELO_FILE_DB_TYPE_COUNT] = {
+    [MELO_FILE_DB_TYPE_FILE] = "find_file",
+    [MELO_FILE_DB_TYPE_SONG] = "find_song",
+    [MELO_FILE_DB_TYPE_ARTIST] = "find_artist",
+    [MELO_FILE_DB_TYPE_ALBUM] = "find_album",
+    [MELO_FILE_DB_TYPE_GENRE] = "find_genre",
+  };
+  gint64 trace = melo_trace_begin ();
+  gint64 start = g_get_monotonic_time ();
   const gchar *cond_join = match ? " OR " : " AND ";
   const gchar *order = "", *order_col = "", *order_sort = "";
+  const gchar *order_id = "";
+  MeloFileDBCursor cursor = { 0, 0, 0, NULL };
+  gboolean has_cursor = FALSE;
+  gboolean keyset = next_token != NULL;
+  gchar *last_key = NULL;
+  gint last_id = 0, rows = 0;
   MeloFileDBPrivate *priv = db->priv;
+  MeloFileDBReader *reader;
   sqlite3_stmt *req = NULL;
   gboolean join_artist = FALSE;
   gboolean join_album = FALSE;
   gboolean join_genre = FALSE;
   gboolean join_path = FALSE;
   gboolean join = FALSE;
-  GString *conds;
+  gboolean ranked = match && type <= MELO_FILE_DB_TYPE_SONG;
+  GString *conds, *joins, *ranks;
+  GArray *params, *jparams;
   const gchar *file_cond = NULL;
   const gchar *title_cond = NULL;
   gchar columns[MELO_FILE_DB_COLUMN_SIZE];
   gchar *cols, *conditions;
   gchar *sql;
+  guint p;
 
   /* Prepare string for conditions */
   conds = g_string_new_len (NULL, MELO_FILE_DB_COND_SIZE);
   if (!conds)
-    return FALSE;
+    goto failed;
+  params = g_array_new (FALSE, FALSE, sizeof (MeloFileDBParam));
+  jparams = g_array_new (FALSE, FALSE, sizeof (MeloFileDBParam));
+  joins = g_string_new (NULL);
+  ranks = g_string_new (NULL);
 
   /* Generate columns for request */
   cols = g_stpcpy (columns, "m.rowid,");
@@ -493,138 +2035,191 @@ melo_file_db_vfind (MeloFileDB *db, MeloFileDBType type, GObject *obj,
 
   /* Generate SQL request */
   while (field != MELO_FILE_DB_FIELDS_END) {
-    gchar temp[MELO_FILE_DB_COND_SIZE];
-    gboolean skip = FALSE;
+    MeloFileDBParam param = { NULL, 0 };
+    const gchar *cond = NULL;
+    gboolean joined = FALSE;
 
     switch (field) {
       case MELO_FILE_DB_FIELDS_PATH:
-        sqlite3_snprintf (sizeof (temp), temp, "path = '%q'",
-                          va_arg (args, const gchar *));
+        param.text = va_arg (args, const gchar *);
+        cond = "path = ?";
         join_path = TRUE;
         break;
       case MELO_FILE_DB_FIELDS_PATH_ID:
-        sqlite3_snprintf (sizeof (temp), temp, "path_id = '%d'",
-                          va_arg (args, gint));
+        param.value = va_arg (args, gint);
+        cond = "path_id = ?";
         break;
       case MELO_FILE_DB_FIELDS_FILE:
-        if (match) {
+        if (match)
           file_cond = va_arg (args, const gchar *);
-          skip = TRUE;
-        } else {
-          sqlite3_snprintf (sizeof (temp), temp, "file = '%q'",
-                            va_arg (args, const gchar *));
+        else {
+          param.text = va_arg (args, const gchar *);
+          cond = "file = ?";
         }
         break;
       case MELO_FILE_DB_FIELDS_FILE_ID:
-        sqlite3_snprintf (sizeof (temp), temp, "m.rowid = '%d'",
-                          va_arg (args, gint));
+        param.value = va_arg (args, gint);
+        cond = "m.rowid = ?";
         break;
       case MELO_FILE_DB_FIELDS_TITLE:
-        if (match) {
+        if (match)
           title_cond = va_arg (args, const gchar *);
-          skip = TRUE;
-        } else {
-          sqlite3_snprintf (sizeof (temp), temp, "title = '%q'",
-                            va_arg (args, const gchar *));
+        else {
+          param.text = va_arg (args, const gchar *);
+          cond = "title = ?";
         }
         break;
       case MELO_FILE_DB_FIELDS_ARTIST:
-        if (match) {
-          sqlite3_snprintf (sizeof (temp), temp, "m.artist_id IN ("
-                        "SELECT docid FROM artist_fts WHERE artist MATCH '%q')",
-                        va_arg (args, const gchar *));
+        param.text = va_arg (args, const gchar *);
+        if (ranked) {
+          melo_file_db_rank_join (joins, ranks, "artist", "artist", "ra",
+                                  "m.artist_id");
+          cond = "ra.docid IS NOT NULL";
+          joined = TRUE;
+        } else if (match) {
+          cond = "m.artist_id IN ("
+                 "SELECT docid FROM artist_fts WHERE artist MATCH ?)";
         } else {
-          sqlite3_snprintf (sizeof (temp), temp, "artist = '%q'",
-                            va_arg (args, const gchar *));
+          cond = "artist = ?";
           join_artist = TRUE;
         }
         break;
       case MELO_FILE_DB_FIELDS_ARTIST_ID:
-        sqlite3_snprintf (sizeof (temp), temp, "artist_id = '%d'",
-                          va_arg (args, gint));
+        param.value = va_arg (args, gint);
+        cond = "artist_id = ?";
         join = type != MELO_FILE_DB_TYPE_ARTIST;
         break;
       case MELO_FILE_DB_FIELDS_ALBUM:
-        if (match) {
-          sqlite3_snprintf (sizeof (temp), temp, "m.album_id IN ("
-                          "SELECT docid FROM album_fts WHERE album MATCH '%q')",
-                          va_arg (args, const gchar *));
+        param.text = va_arg (args, const gchar *);
+        if (ranked) {
+          melo_file_db_rank_join (joins, ranks, "album", "album", "rl",
+                                  "m.album_id");
+          cond = "rl.docid IS NOT NULL";
+          joined = TRUE;
+        } else if (match) {
+          cond = "m.album_id IN ("
+                 "SELECT docid FROM album_fts WHERE album MATCH ?)";
         } else {
-          sqlite3_snprintf (sizeof (temp), temp, "album = '%q'",
-                            va_arg (args, const gchar *));
+          cond = "album = ?";
           join_album = TRUE;
         }
         break;
       case MELO_FILE_DB_FIELDS_ALBUM_ID:
-        sqlite3_snprintf (sizeof (temp), temp, "album_id = '%d'",
-                          va_arg (args, gint));
+        param.value = va_arg (args, gint);
+        cond = "album_id = ?";
         join = type != MELO_FILE_DB_TYPE_ALBUM;
         break;
       case MELO_FILE_DB_FIELDS_GENRE:
-        if (match) {
-          sqlite3_snprintf (sizeof (temp), temp, "mg.genre_id IN ("
-                          "SELECT docid FROM genre_fts WHERE genre MATCH '%q')",
-                          va_arg (args, const gchar *));
+        param.text = va_arg (args, const gchar *);
+        if (ranked) {
+          melo_file_db_rank_join (joins, ranks, "genre", "genre", "rg",
+                                  "m.genre_id");
+          cond = "rg.docid IS NOT NULL";
+          joined = TRUE;
+        } else if (match) {
+          cond = "m.genre_id IN ("
+                 "SELECT docid FROM genre_fts WHERE genre MATCH ?)";
         } else {
-          sqlite3_snprintf (sizeof (temp), temp, "genre = '%q'",
-                          va_arg (args, const gchar *));
+          cond = "genre = ?";
           join_genre = TRUE;
         }
         break;
       case MELO_FILE_DB_FIELDS_GENRE_ID:
-        sqlite3_snprintf (sizeof (temp), temp, "genre_id = '%d'",
-                          va_arg (args, gint));
+        param.value = va_arg (args, gint);
+        cond = "genre_id = ?";
         join = type != MELO_FILE_DB_TYPE_GENRE;
         break;
       case MELO_FILE_DB_FIELDS_DATE:
-        sqlite3_snprintf (sizeof (temp), temp, "date = '%d'",
-                          va_arg (args, gint));
+        param.value = va_arg (args, gint);
+        cond = "date = ?";
         break;
       case MELO_FILE_DB_FIELDS_TRACK:
-        sqlite3_snprintf (sizeof (temp), temp, "track = '%d'",
-                          va_arg (args, gint));
+        param.value = va_arg (args, gint);
+        cond = "track = ?";
         break;
       case MELO_FILE_DB_FIELDS_TRACKS:
-        sqlite3_snprintf (sizeof (temp), temp, "tracks = '%d'",
-                          va_arg (args, gint));
+        param.value = va_arg (args, gint);
+        cond = "tracks = ?";
+        break;
+      case MELO_FILE_DB_FIELDS_DURATION:
+        param.value = va_arg (args, gint);
+        cond = "m.duration = ?";
+        break;
+      case MELO_FILE_DB_FIELDS_CODEC:
+        param.text = va_arg (args, const gchar *);
+        cond = "codec = ?";
+        break;
+      case MELO_FILE_DB_FIELDS_RATE:
+        param.value = va_arg (args, gint);
+        cond = "rate = ?";
+        break;
+      case MELO_FILE_DB_FIELDS_CHANNELS:
+        param.value = va_arg (args, gint);
+        cond = "channels = ?";
+        break;
+      case MELO_FILE_DB_FIELDS_BITRATE:
+        param.value = va_arg (args, gint);
+        cond = "bitrate = ?";
         break;
       default:
-          g_string_free (conds, TRUE);
-        goto error;
+        g_string_free (conds, TRUE);
+        g_string_free (joins, TRUE);
+        g_string_free (ranks, TRUE);
+        g_array_free (params, TRUE);
+        g_array_free (jparams, TRUE);
+        goto failed;
     }
 
-    /* Append condition */
-    if (!skip)
-      g_string_append (conds, temp);
+    /* Append condition and its parameter */
+    if (cond) {
+      if (conds->len)
+        g_string_append (conds, cond_join);
+      g_string_append (conds, cond);
+      g_array_append_val (joined ? jparams : params, param);
+    }
 
     /* Get next field */
     field = va_arg (args, MeloFileDBFields);
-    if (field == MELO_FILE_DB_FIELDS_END)
-      break;
-
-    /* Append condition join */
-    if (!skip)
-      g_string_append (conds, cond_join);
   }
 
-  /* Generate condition for file / title in FTS table */
-  if (file_cond || title_cond) {
-    gchar temp[MELO_FILE_DB_COND_SIZE];
+  /* Generate ranked condition for file / title in FTS table */
+  if (ranked && (file_cond || title_cond) &&
+      (!file_cond || !title_cond || !g_strcmp0 (file_cond, title_cond))) {
+    MeloFileDBParam param = { title_cond ? title_cond : file_cond, 0 };
+
+    /* Match on both columns with a single full text query */
+    melo_file_db_rank_join (joins, ranks, "song",
+                            !file_cond ? "title" :
+                            !title_cond ? "file" : "song_fts", "rs",
+                            "m.rowid");
+    g_array_append_val (jparams, param);
+    if (conds->len)
+      g_string_append (conds, cond_join);
+    g_string_append (conds, "rs.docid IS NOT NULL");
+  } else if (file_cond || title_cond) {
+    MeloFileDBParam param = { NULL, 0 };
 
     /* Append a mix condition for song FTS table */
-    sqlite3_snprintf (sizeof (temp), temp,
-                 "m.rowid IN (SELECT docid FROM song_fts WHERE %s%q%s%s%q')",
-                 file_cond ? "file MATCH '" : "", file_cond ? file_cond : "",
-                 file_cond && title_cond ? "' OR " : "",
-                 title_cond ? "title MATCH '" : "",
-                 title_cond ? title_cond : "");
-    g_string_append (conds, temp);
+    if (conds->len)
+      g_string_append (conds, cond_join);
+    g_string_append_printf (conds,
+                       "m.rowid IN (SELECT docid FROM song_fts WHERE %s%s%s)",
+                            file_cond ? "file MATCH ?" : "",
+                            file_cond && title_cond ? " OR " : "",
+                            title_cond ? "title MATCH ?" : "");
+    if (file_cond) {
+      param.text = file_cond;
+      g_array_append_val (params, param);
+    }
+    if (title_cond) {
+      param.text = title_cond;
+      g_array_append_val (params, param);
+    }
   }
 
   /* Finalize condition */
   if (!conds->len)
     g_string_append (conds, "1");
-  conditions = g_string_free (conds, FALSE);
 
   /* Generate order directive */
   if (sort != MELO_SORT_NONE && melo_sort_is_valid (sort) &&
@@ -636,54 +2231,179 @@ melo_file_db_vfind (MeloFileDB *db, MeloFileDBType type, GObject *obj,
       order_sort = " COLLATE NOCASE DESC";
     else
       order_sort = " COLLATE NOCASE ASC";
+  } else if (ranks->len && melo_sort_set_asc (sort) == MELO_SORT_RELEVANT) {
+    /* Most relevant items first */
+    order = "ORDER BY ";
+    order_col = ranks->str;
+    order_sort = melo_sort_is_desc (sort) ? " ASC" : " DESC";
+
+    /* Keyset pagination is not supported on rank */
+    keyset = FALSE;
+    token = NULL;
   }
 
-  /* Generate SQL request */
+  /* Get position from token */
+  if (token)
+    has_cursor = melo_file_db_cursor_from_token (&cursor, token, type, sort);
+  keyset |= has_cursor;
+
+  /* Setup keyset pagination: order by sort key and then by ID */
+  if (keyset) {
+    order_id = *order ? ", m.rowid" : "ORDER BY m.rowid";
+
+    /* Add sort key as last column */
+    if (*order_col) {
+      cols = g_stpcpy (columns + strlen (columns), ",");
+      cols = g_stpcpy (cols, order_col);
+      if (type <= MELO_FILE_DB_TYPE_SONG) {
+        MeloSort asc = melo_sort_set_asc (sort);
+
+        join_artist |= asc == MELO_SORT_ARTIST;
+        join_album |= asc == MELO_SORT_ALBUM;
+        join_genre |= asc == MELO_SORT_GENRE;
+      }
+    }
+  }
+
+  /* Add condition to start after position */
+  if (has_cursor) {
+    MeloFileDBParam key = { cursor.key, 0 }, id = { NULL, cursor.id };
+
+    g_string_prepend_c (conds, '(');
+    g_string_append (conds, ") AND ");
+    if (!*order_col) {
+      g_string_append (conds, "m.rowid > ?");
+    } else if (!melo_sort_is_desc (sort)) {
+      /* Ascending order: NULL keys are first */
+      if (cursor.key) {
+        g_string_append_printf (conds, "(%s COLLATE NOCASE > ? OR "
+                                "(%s COLLATE NOCASE = ? AND m.rowid > ?))",
+                                order_col, order_col);
+        g_array_append_val (params, key);
+        g_array_append_val (params, key);
+      } else
+        g_string_append_printf (conds, "(%s IS NOT NULL OR m.rowid > ?)",
+                                order_col);
+    } else {
+      /* Descending order: NULL keys are last */
+      if (cursor.key) {
+        g_string_append_printf (conds, "(%s COLLATE NOCASE < ? OR "
+                                "(%s COLLATE NOCASE = ? AND m.rowid > ?) OR "
+                                "%s IS NULL)", order_col, order_col,
+                                order_col);
+        g_array_append_val (params, key);
+        g_array_append_val (params, key);
+      } else
+        g_string_append_printf (conds, "(%s IS NULL AND m.rowid > ?)",
+                                order_col);
+    }
+    g_array_append_val (params, id);
+
+    /* Offset is replaced by position */
+    offset = 0;
+  }
+  conditions = g_string_free (conds, FALSE);
+
+  /* Generate SQL request: offset and count are bound as last parameters, and
+   * artists, albums and genres without any song are skipped
+   */
   switch (type) {
     case MELO_FILE_DB_TYPE_SONG:
     case MELO_FILE_DB_TYPE_FILE:
-      sql = sqlite3_mprintf ("SELECT %s FROM song m %s %s %s %s "
-            "WHERE %s %s%s%s LIMIT %d,%d", columns,
+      sql = g_strdup_printf ("SELECT %s FROM song m %s %s %s %s%s "
+            "WHERE %s %s%s%s%s LIMIT ?,?", columns,
             join_artist ? "LEFT JOIN artist ON m.artist_id = artist.rowid" : "",
             join_album ? "LEFT JOIN album ON m.album_id = album.rowid" : "",
             join_genre ? "LEFT JOIN genre ON m.genre_id = genre.rowid" : "",
             join_path ? "LEFT JOIN path ON m.path_id = path.rowid" : "",
-            conditions, order, order_col, order_sort, offset, count);
+            joins->str, conditions, order, order_col, order_sort, order_id);
       break;
     case MELO_FILE_DB_TYPE_ARTIST:
-      sql = sqlite3_mprintf ("SELECT DISTINCT %s FROM artist m %s "
-                       "WHERE %s %s%s%s LIMIT %d,%d", columns,
+      sql = g_strdup_printf ("SELECT DISTINCT %s FROM artist m %s "
+                       "WHERE m.songs > 0 AND (%s) %s%s%s%s LIMIT ?,?",
+                       columns,
                        join ? "LEFT JOIN song ON song.artist_id = m.rowid" : "",
-                       conditions, order, order_col, order_sort, offset, count);
+                       conditions, order, order_col, order_sort, order_id);
       break;
     case MELO_FILE_DB_TYPE_ALBUM:
-      sql = sqlite3_mprintf ("SELECT DISTINCT %s FROM album m %s "
-                        "WHERE %s %s%s%s LIMIT %d,%d", columns,
+      sql = g_strdup_printf ("SELECT DISTINCT %s FROM album m %s "
+                        "WHERE m.songs > 0 AND (%s) %s%s%s%s LIMIT ?,?",
+                       columns,
                         join ? "LEFT JOIN song ON song.album_id = m.rowid" : "",
-                        conditions, order, order_col, order_sort, offset,
-                        count);
+                        conditions, order, order_col, order_sort, order_id);
       break;
     case MELO_FILE_DB_TYPE_GENRE:
-      sql = sqlite3_mprintf ("SELECT DISTINCT %s FROM genre m %s "
-                       "WHERE %s %s%s%s LIMIT %d,%d", columns,
+      sql = g_strdup_printf ("SELECT DISTINCT %s FROM genre m %s "
+                       "WHERE m.songs > 0 AND (%s) %s%s%s%s LIMIT ?,?",
+                       columns,
                         join ? "LEFT JOIN song ON song.genre_id = m.rowid" : "",
-                        conditions, order, order_col, order_sort, offset,
-                        count);
+                        conditions, order, order_col, order_sort, order_id);
       break;
     default:
       sql = NULL;
   }
   g_free (conditions);
+  g_string_free (joins, TRUE);
+  g_string_free (ranks, TRUE);
 
-  /* Do SQL request */
-  sqlite3_prepare_v2 (priv->db, sql, -1, &req, NULL);
-  sqlite3_free (sql);
+  /* Parameters of joined full text queries come first */
+  g_array_prepend_vals (params, jparams->data, jparams->len);
+  g_array_free (jparams, TRUE);
+
+  if (!sql) {
+    g_array_free (params, TRUE);
+    g_free (cursor.key);
+    goto failed;
+  }
+
+  /* Get a reader connection */
+  reader = melo_file_db_reader_get (priv);
+  if (!reader) {
+    g_array_free (params, TRUE);
+    g_free (cursor.key);
+    g_free (sql);
+    goto failed;
+  }
+
+  /* Get a prepared statement for SQL request */
+  req = melo_file_db_find_stmt_get (reader, sql);
+  if (!req) {
+    melo_file_db_reader_release (priv, reader);
+    g_array_free (params, TRUE);
+    g_free (cursor.key);
+    g_free (sql);
+    goto failed;
+  }
+
+  /* Bind parameters */
+  for (p = 0; p < params->len; p++) {
+    MeloFileDBParam *param = &g_array_index (params, MeloFileDBParam, p);
+
+    if (param->text)
+      sqlite3_bind_text (req, p + 1, param->text, -1, SQLITE_STATIC);
+    else
+      sqlite3_bind_int (req, p + 1, param->value);
+  }
+  sqlite3_bind_int (req, ++p, offset);
+  sqlite3_bind_int (req, ++p, count);
+  g_array_free (params, TRUE);
 
   while (sqlite3_step (req) == SQLITE_ROW) {
     const gchar *path = NULL, *file = NULL;
     MeloTags *tags;
     gint id, i = 0;
 
+    /* Save position of last item */
+    if (keyset) {
+      last_id = sqlite3_column_int (req, 0);
+      if (*order_col) {
+        g_free (last_key);
+        last_key = g_strdup ((const gchar *) sqlite3_column_text (req,
+                                        sqlite3_column_count (req) - 1));
+      }
+      rows++;
+    }
+
     /* Do not generate tags */
     if (!cb && (!utags || *utags))
       continue;
@@ -691,7 +2411,7 @@ melo_file_db_vfind (MeloFileDB *db, MeloFileDBType type, GObject *obj,
     /* Create a new MeloTags */
     tags = melo_tags_new ();
     if (!tags)
-      goto error;;
+      goto error;
 
     /* Fill MeloTags */
     id = sqlite3_column_int (req, i++);
@@ -700,13 +2420,17 @@ melo_file_db_vfind (MeloFileDB *db, MeloFileDBType type, GObject *obj,
     if (type <= MELO_FILE_DB_TYPE_SONG)
       file = (const gchar *) sqlite3_column_text (req, i++);
     if (tags_fields & MELO_TAGS_FIELDS_TITLE)
-      tags->title = g_strdup ((const gchar *) sqlite3_column_text (req, i++));
+      tags->title = melo_tags_intern_string (
+                             (const gchar *) sqlite3_column_text (req, i++));
     if (tags_fields & MELO_TAGS_FIELDS_ARTIST)
-      tags->artist = g_strdup ((const gchar *) sqlite3_column_text (req, i++));
+      tags->artist = melo_tags_intern_string (
+                             (const gchar *) sqlite3_column_text (req, i++));
     if (tags_fields & MELO_TAGS_FIELDS_ALBUM)
-      tags->album = g_strdup ((const gchar *) sqlite3_column_text (req, i++));
+      tags->album = melo_tags_intern_string (
+                             (const gchar *) sqlite3_column_text (req, i++));
     if (tags_fields & MELO_TAGS_FIELDS_GENRE)
-      tags->genre = g_strdup ((const gchar *) sqlite3_column_text (req, i++));
+      tags->genre = melo_tags_intern_string (
+                             (const gchar *) sqlite3_column_text (req, i++));
     if (tags_fields & MELO_TAGS_FIELDS_DATE)
       tags->date = sqlite3_column_int (req, i++);
     if (tags_fields & MELO_TAGS_FIELDS_TRACK)
@@ -725,14 +2449,39 @@ melo_file_db_vfind (MeloFileDB *db, MeloFileDBType type, GObject *obj,
       goto error;
   }
 
-  /* Finalize SQL request */
-  sqlite3_finalize (req);
+  /* Release SQL request and reader */
+  melo_file_db_find_stmt_release (reader, sql, req);
+  melo_file_db_reader_release (priv, reader);
+  g_free (cursor.key);
+
+  /* More items can be available: generate token for next call */
+  if (next_token)
+    *next_token = rows && rows == count ?
+                melo_file_db_cursor_to_token (type, sort, last_id, last_key) :
+                NULL;
+  g_free (last_key);
+  melo_trace_end ("file_db", trace_names[type], trace);
+
+  /* Update query statistics */
+  start = g_get_monotonic_time () - start;
+  g_mutex_lock (&priv->stats_mutex);
+  priv->queries++;
+  priv->query_time += start;
+  if (start > priv->query_max)
+    priv->query_max = start;
+  g_mutex_unlock (&priv->stats_mutex);
 
   return TRUE;
 
 error:
-  if (req)
-    sqlite3_finalize (req);
+  melo_file_db_find_stmt_release (reader, sql, req);
+  melo_file_db_reader_release (priv, reader);
+  g_free (cursor.key);
+  g_free (last_key);
+failed:
+  melo_trace_end ("file_db",
+                  type < MELO_FILE_DB_TYPE_COUNT ? trace_names[type] : NULL,
+                  trace);
   return FALSE;
 }
 
@@ -774,9 +2523,8 @@ melo_file_db_get_tags (MeloFileDB *db, GObject *obj, MeloFileDBType type,
 
   /* Get tags */
   va_start (args, field_0);
-  melo_file_db_vfind (db, type, obj, NULL, NULL, &tags, 0, 1, MELO_SORT_NONE,
-                      FALSE, tags_fields, field_0,
-                      args);
+  melo_file_db_vfind (db, type, obj, NULL, NULL, &tags, NULL, NULL, 0, 1,
+                      MELO_SORT_NONE, FALSE, tags_fields, field_0, args);
   va_end (args);
 
   return tags;
@@ -797,8 +2545,34 @@ melo_file_db_get_list (MeloFileDB *db, GObject *obj,MeloFileDBGetList cb,
 
   /* Get list */
   va_start (args, field_0);
-  ret = melo_file_db_vfind (db, type, obj, cb, user_data, NULL, offset, count,
-                            sort, find, tags_fields, field_0, args);
+  ret = melo_file_db_vfind (db, type, obj, cb, user_data, NULL, NULL, NULL,
+                            offset, count, sort, find, tags_fields, field_0,
+                            args);
+  va_end (args);
+
+  return ret;
+}
+
+gboolean
+melo_file_db_get_list_with_token (MeloFileDB *db, GObject *obj,
+                                  MeloFileDBGetList cb, gpointer user_data,
+                                  const gchar *token, gchar **next_token,
+                                  gint offset, gint count, MeloSort sort,
+                                  gboolean find, MeloFileDBType type,
+                                  MeloTagsFields tags_fields,
+                                  MeloFileDBFields field_0, ...)
+{
+  gboolean ret;
+  va_list args;
+
+  /* Apply filter on tags */
+  tags_fields &= melo_file_db_type_get_tags_fields_filter (type);
+
+  /* Get list after token position */
+  va_start (args, field_0);
+  ret = melo_file_db_vfind (db, type, obj, cb, user_data, NULL, token,
+                            next_token, offset, count, sort, find, tags_fields,
+                            field_0, args);
   va_end (args);
 
   return ret;
@@ -78,24 +78,105 @@ typedef enum {
   MELO_FILE_DB_FIELDS_DATE,
   MELO_FILE_DB_FIELDS_TRACK,
   MELO_FILE_DB_FIELDS_TRACKS,
+  MELO_FILE_DB_FIELDS_DURATION,
+  MELO_FILE_DB_FIELDS_CODEC,
+  MELO_FILE_DB_FIELDS_RATE,
+  MELO_FILE_DB_FIELDS_CHANNELS,
+  MELO_FILE_DB_FIELDS_BITRATE,
 
   /* Fields count */
   MELO_FILE_DB_FIELDS_COUNT
 } MeloFileDBFields;
 
+/* Technical details of audio stream: codec must be a static or interned
+ * string, duration is in ms and bitrate in bit/s
+ */
+typedef struct {
+  gint duration;
+  const gchar *codec;
+  gint rate;
+  gint channels;
+  gint bitrate;
+} MeloFileDBInfo;
+
+typedef struct {
+  gboolean wal;
+  gint synchronous;
+  gint cache_size;
+} MeloFileDBSettings;
+
+/* Size of database file (or -1), number of find queries, and their total and
+ * maximum durations (in us)
+ */
+typedef struct {
+  gint64 size;
+  guint64 queries;
+  gint64 query_time;
+  gint64 query_max;
+} MeloFileDBQueryStats;
+
 GType melo_file_db_get_type (void);
 
-MeloFileDB *melo_file_db_new (const gchar *file);
+MeloFileDB *melo_file_db_new (const gchar *file,
+                              const MeloFileDBSettings *settings);
 
 gboolean melo_file_db_get_path_id (MeloFileDB *db, const gchar *path,
                                    gboolean add, gint *path_id);
 
 gboolean melo_file_db_add_tags (MeloFileDB *db, const gchar *path,
                                 const gchar *filename, gint timestamp,
-                                MeloTags *tags);
+                                MeloTags *tags, const MeloFileDBInfo *info);
 gboolean melo_file_db_add_tags2 (MeloFileDB *db, gint path_id,
                                  const gchar *filename, gint timestamp,
-                                 MeloTags *tags);
+                                 MeloTags *tags, const MeloFileDBInfo *info);
+
+gboolean melo_file_db_get_timestamp (MeloFileDB *db, gint path_id,
+                                     const gchar *filename, gint *timestamp);
+gboolean melo_file_db_remove (MeloFileDB *db, const gchar *path,
+                              const gchar *filename);
+
+/* Group insertions in transactions */
+gboolean melo_file_db_begin_batch (MeloFileDB *db);
+gboolean melo_file_db_add_tags_batch (MeloFileDB *db, gint path_id,
+                                      const gchar *filename, gint timestamp,
+                                      MeloTags *tags,
+                                      const MeloFileDBInfo *info);
+gboolean melo_file_db_commit_batch (MeloFileDB *db);
+
+/* Get stream details of a song */
+gboolean melo_file_db_get_info (MeloFileDB *db, gint path_id,
+                                const gchar *filename, MeloFileDBInfo *info);
+
+/* Get and set loudness (in LUFS) and peak (in dBFS) of a song, and find next
+ * song not analyzed with an ID greater than after_id
+ */
+gboolean melo_file_db_get_loudness (MeloFileDB *db, gint path_id,
+                                    const gchar *filename, gdouble *loudness,
+                                    gdouble *peak);
+gboolean melo_file_db_set_loudness (MeloFileDB *db, gint file_id,
+                                    gdouble loudness, gdouble peak);
+gboolean melo_file_db_get_next_loudness (MeloFileDB *db, gint after_id,
+                                         gint *file_id, gchar **path,
+                                         gchar **filename);
+
+/* Get song count, album count and total duration (in ms) of an artist, album
+ * or genre, or of whole library with MELO_FILE_DB_TYPE_SONG
+ */
+gboolean melo_file_db_get_stats (MeloFileDB *db, MeloFileDBType type, gint id,
+                                 gint *songs, gint *albums, gint64 *duration);
+
+/* Get database size and query statistics */
+gboolean melo_file_db_get_query_stats (MeloFileDB *db,
+                                       MeloFileDBQueryStats *stats);
+
+/* Get memory used by SQLite and release the caches of idle connections */
+gboolean melo_file_db_get_memory_usage (MeloFileDB *db,
+                                        MeloMemoryUsage *usage);
+void melo_file_db_release_memory (MeloFileDB *db);
+
+/* Search helpers */
+gchar *melo_file_db_get_hint (MeloFileDB *db, const gchar *input);
+gchar *melo_file_db_build_prefix_query (const gchar *input);
 
 /* Get tags for one or more types */
 MeloTags *melo_file_db_get_tags (MeloFileDB *db, GObject *obj,
@@ -115,6 +196,17 @@ gboolean melo_file_db_get_list (MeloFileDB *db, GObject *obj,
                                 MeloTagsFields tags_fields,
                                 MeloFileDBFields field_0, ...);
 
+/* Get item list starting after the position saved in token */
+gboolean melo_file_db_get_list_with_token (MeloFileDB *db, GObject *obj,
+                                           MeloFileDBGetList cb,
+                                           gpointer user_data,
+                                           const gchar *token,
+                                           gchar **next_token, gint offset,
+                                           gint count, MeloSort sort,
+                                           gboolean find, MeloFileDBType type,
+                                           MeloTagsFields tags_fields,
+                                           MeloFileDBFields field_0, ...);
+
 G_END_DECLS
 
 #endif /* __MELO_FILE_DB_H__ */
@@ -0,0 +1,367 @@
+/*
+ * melo_file_discoverer.c: Pool of workers for tags discovery
+ *
+ * Copyright (C) 2016 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "melo_sched.h"
+
+#include "melo_file_tags.h"
+#include "melo_file_discoverer.h"
+
+/*
+ * Each worker thread owns a #GstDiscoverer and discovers one URI at a time,
+ * taking jobs from the highest priority queue first. A job is kept in the URI
+ * table until it is done, so a second request for the same URI shares the
+ * pending job (and promotes it when its priority is higher).
+ */
+
+struct _MeloFileDiscovererJob {
+  MeloFileDiscoverer *disco;
+  gint ref_count;
+
+  gchar *uri;
+  MeloFileDiscovererPriority priority;
+  GList *link;
+
+  gboolean done;
+  MeloTags *tags;
+};
+
+struct _MeloFileDiscoverer {
+  GMutex mutex;
+  GCond cond;
+  GCond done_cond;
+  gboolean stop;
+
+  /* Pending jobs */
+  GQueue queues[MELO_FILE_DISCOVERER_PRIORITY_COUNT];
+  GHashTable *jobs;
+
+  /* Workers */
+  GThread **threads;
+  guint workers;
+  GstClockTime timeout;
+
+  /* Discovered callback */
+  MeloFileDiscovererFunc func;
+  gpointer user_data;
+};
+
+static MeloFileDiscovererJob *
+melo_file_discoverer_job_ref (MeloFileDiscovererJob *job)
+{
+  g_atomic_int_inc (&job->ref_count);
+  return job;
+}
+
+void
+melo_file_discoverer_job_unref (MeloFileDiscovererJob *job)
+{
+  if (!g_atomic_int_dec_and_test (&job->ref_count))
+    return;
+
+  if (job->tags)
+    melo_tags_unref (job->tags);
+  g_free (job->uri);
+  g_slice_free (MeloFileDiscovererJob, job);
+}
+
+/* Must be called with discoverer locked */
+static MeloFileDiscovererJob *
+melo_file_discoverer_pop (MeloFileDiscoverer *disco)
+{
+  MeloFileDiscovererJob *job;
+  GList *link;
+  guint i;
+
+  /* Get first job of highest priority queue */
+  for (i = 0; i < MELO_FILE_DISCOVERER_PRIORITY_COUNT; i++) {
+    link = g_queue_pop_head_link (&disco->queues[i]);
+    if (link) {
+      job = link->data;
+      g_list_free_1 (link);
+      job->link = NULL;
+      return job;
+    }
+  }
+
+  return NULL;
+}
+
+void
+melo_file_discoverer_get_info (GstDiscovererInfo *info, MeloFileDBInfo *dinfo)
+{
+  GstDiscovererStreamInfo *sinfo;
+  GstDiscovererAudioInfo *ainfo;
+  GList *streams;
+  GstClockTime duration;
+  GstCaps *caps;
+  gchar *codec;
+
+  /* Get duration */
+  memset (dinfo, 0, sizeof (*dinfo));
+  duration = gst_discoverer_info_get_duration (info);
+  if (GST_CLOCK_TIME_IS_VALID (duration))
+    dinfo->duration = duration / GST_MSECOND;
+
+  /* Get details of first audio stream */
+  streams = gst_discoverer_info_get_audio_streams (info);
+  if (!streams)
+    return;
+  sinfo = streams->data;
+  ainfo = GST_DISCOVERER_AUDIO_INFO (sinfo);
+  dinfo->rate = gst_discoverer_audio_info_get_sample_rate (ainfo);
+  dinfo->channels = gst_discoverer_audio_info_get_channels (ainfo);
+  dinfo->bitrate = gst_discoverer_audio_info_get_bitrate (ainfo);
+
+  /* Get codec name */
+  caps = gst_discoverer_stream_info_get_caps (sinfo);
+  if (caps) {
+    codec = gst_pb_utils_get_codec_description (caps);
+    dinfo->codec = g_intern_string (codec);
+    g_free (codec);
+    gst_caps_unref (caps);
+  }
+  gst_discoverer_stream_info_list_free (streams);
+}
+
+static MeloTags *
+melo_file_discoverer_discover (GstDiscoverer *gdisco, const gchar *uri,
+                               MeloFileDBInfo *dinfo)
+{
+  GstDiscovererInfo *info;
+  const GstTagList *gtags;
+  MeloTags *tags = NULL;
+
+  /* Read tags directly from file when its format is supported */
+  memset (dinfo, 0, sizeof (*dinfo));
+  tags = melo_file_tags_new_from_uri (uri, MELO_TAGS_FIELDS_FULL,
+                                      MELO_TAGS_COVER_PERSIST_DISK, dinfo);
+  if (tags || !gdisco)
+    return tags;
+
+  /* Get tags from URI */
+  info = gst_discoverer_discover_uri (gdisco, uri, NULL);
+  if (!info)
+    return NULL;
+
+  /* Convert to MeloTags */
+  gtags = gst_discoverer_info_get_tags (info);
+  if (gtags)
+    tags = melo_tags_new_from_gst_tag_list (gtags, MELO_TAGS_FIELDS_FULL,
+                                            MELO_TAGS_COVER_PERSIST_DISK);
+  melo_file_discoverer_get_info (info, dinfo);
+  g_object_unref (info);
+
+  return tags;
+}
+
+static gpointer
+melo_file_discoverer_worker (gpointer user_data)
+{
+  MeloFileDiscoverer *disco = user_data;
+  MeloFileDiscovererJob *job;
+  GstDiscoverer *gdisco;
+  MeloFileDBInfo info;
+  MeloTags *tags;
+
+  /* Discovery runs in background: keep CPU for audio threads */
+  melo_sched_demote_thread ();
+
+  /* Create discoverer for this worker */
+  gdisco = gst_discoverer_new (disco->timeout, NULL);
+
+  g_mutex_lock (&disco->mutex);
+  while (!disco->stop) {
+    /* Wait for a new job */
+    job = melo_file_discoverer_pop (disco);
+    if (!job) {
+      g_cond_wait (&disco->cond, &disco->mutex);
+      continue;
+    }
+    g_mutex_unlock (&disco->mutex);
+
+    /* Discover tags */
+    tags = melo_file_discoverer_discover (gdisco, job->uri, &info);
+    if (tags && disco->func)
+      disco->func (job->uri, tags, &info, disco->user_data);
+
+    g_mutex_lock (&disco->mutex);
+
+    /* Job is done: wake up waiters */
+    job->tags = tags;
+    job->done = TRUE;
+    g_hash_table_remove (disco->jobs, job->uri);
+    g_cond_broadcast (&disco->done_cond);
+    melo_file_discoverer_job_unref (job);
+  }
+  g_mutex_unlock (&disco->mutex);
+
+  if (gdisco)
+    gst_object_unref (gdisco);
+
+  return NULL;
+}
+
+MeloFileDiscoverer *
+melo_file_discoverer_new (guint workers, GstClockTime timeout,
+                          MeloFileDiscovererFunc func, gpointer user_data)
+{
+  MeloFileDiscoverer *disco;
+  guint i;
+
+  /* Use one worker per CPU by default */
+  if (!workers)
+    workers = g_get_num_processors ();
+
+  /* Create discoverer pool */
+  disco = g_slice_new0 (MeloFileDiscoverer);
+  g_mutex_init (&disco->mutex);
+  g_cond_init (&disco->cond);
+  g_cond_init (&disco->done_cond);
+  for (i = 0; i < MELO_FILE_DISCOVERER_PRIORITY_COUNT; i++)
+    g_queue_init (&disco->queues[i]);
+  disco->jobs = g_hash_table_new (g_str_hash, g_str_equal);
+  disco->timeout = timeout;
+  disco->func = func;
+  disco->user_data = user_data;
+
+  /* Start workers */
+  disco->threads = g_new0 (GThread *, workers);
+  for (i = 0; i < workers; i++) {
+    disco->threads[i] = g_thread_try_new ("melo_file_discoverer",
+                                          melo_file_discoverer_worker, disco,
+                                          NULL);
+    if (!disco->threads[i])
+      break;
+  }
+  disco->workers = i;
+
+  /* No worker available */
+  if (!disco->workers) {
+    melo_file_discoverer_free (disco);
+    return NULL;
+  }
+
+  return disco;
+}
+
+void
+melo_file_discoverer_free (MeloFileDiscoverer *disco)
+{
+  MeloFileDiscovererJob *job;
+  guint i;
+
+  /* Stop workers */
+  g_mutex_lock (&disco->mutex);
+  disco->stop = TRUE;
+  g_cond_broadcast (&disco->cond);
+  g_mutex_unlock (&disco->mutex);
+  for (i = 0; i < disco->workers; i++)
+    g_thread_join (disco->threads[i]);
+  g_free (disco->threads);
+
+  /* Cancel pending jobs */
+  g_mutex_lock (&disco->mutex);
+  while ((job = melo_file_discoverer_pop (disco))) {
+    job->done = TRUE;
+    g_hash_table_remove (disco->jobs, job->uri);
+    melo_file_discoverer_job_unref (job);
+  }
+  g_cond_broadcast (&disco->done_cond);
+  g_mutex_unlock (&disco->mutex);
+
+  /* Free discoverer pool */
+  g_hash_table_unref (disco->jobs);
+  g_cond_clear (&disco->done_cond);
+  g_cond_clear (&disco->cond);
+  g_mutex_clear (&disco->mutex);
+  g_slice_free (MeloFileDiscoverer, disco);
+}
+
+MeloFileDiscovererJob *
+melo_file_discoverer_add (MeloFileDiscoverer *disco, const gchar *uri,
+                          MeloFileDiscovererPriority priority)
+{
+  MeloFileDiscovererJob *job;
+
+  g_return_val_if_fail (disco && uri, NULL);
+  g_return_val_if_fail (priority < MELO_FILE_DISCOVERER_PRIORITY_COUNT, NULL);
+
+  g_mutex_lock (&disco->mutex);
+
+  /* Find pending job for URI */
+  job = g_hash_table_lookup (disco->jobs, uri);
+  if (job) {
+    /* Promote job when still pending */
+    if (job->link && priority < job->priority) {
+      g_queue_unlink (&disco->queues[job->priority], job->link);
+      g_queue_push_tail_link (&disco->queues[priority], job->link);
+      job->priority = priority;
+    }
+  } else {
+    /* Create new job: one reference is kept until job is done */
+    job = g_slice_new0 (MeloFileDiscovererJob);
+    job->disco = disco;
+    job->ref_count = 1;
+    job->uri = g_strdup (uri);
+    job->priority = priority;
+
+    /* Queue job and wake up a worker */
+    g_queue_push_tail (&disco->queues[priority], job);
+    job->link = disco->queues[priority].tail;
+    g_hash_table_insert (disco->jobs, job->uri, job);
+    g_cond_signal (&disco->cond);
+  }
+  melo_file_discoverer_job_ref (job);
+
+  g_mutex_unlock (&disco->mutex);
+
+  return job;
+}
+
+void
+melo_file_discoverer_push (MeloFileDiscoverer *disco, const gchar *uri,
+                           MeloFileDiscovererPriority priority)
+{
+  MeloFileDiscovererJob *job;
+
+  job = melo_file_discoverer_add (disco, uri, priority);
+  if (job)
+    melo_file_discoverer_job_unref (job);
+}
+
+MeloTags *
+melo_file_discoverer_job_wait (MeloFileDiscovererJob *job)
+{
+  MeloFileDiscoverer *disco = job->disco;
+  MeloTags *tags = NULL;
+
+  /* Wait end of job */
+  g_mutex_lock (&disco->mutex);
+  while (!job->done)
+    g_cond_wait (&disco->done_cond, &disco->mutex);
+  if (job->tags)
+    tags = melo_tags_ref (job->tags);
+  g_mutex_unlock (&disco->mutex);
+
+  return tags;
+}
@@ -0,0 +1,68 @@
+/*
+ * melo_file_discoverer.h: Pool of workers for tags discovery
+ *
+ * Copyright (C) 2016 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __MELO_FILE_DISCOVERER_H__
+#define __MELO_FILE_DISCOVERER_H__
+
+#include <glib.h>
+#include <gst/gst.h>
+
+#include <gst/pbutils/pbutils.h>
+
+#include "melo_tags.h"
+#include "melo_file_db.h"
+
+typedef enum {
+  MELO_FILE_DISCOVERER_PRIORITY_VISIBLE = 0,
+  MELO_FILE_DISCOVERER_PRIORITY_PREFETCH,
+
+  MELO_FILE_DISCOVERER_PRIORITY_COUNT
+} MeloFileDiscovererPriority;
+
+typedef struct _MeloFileDiscoverer MeloFileDiscoverer;
+typedef struct _MeloFileDiscovererJob MeloFileDiscovererJob;
+
+/* Called from a worker thread when tags of an URI have been discovered */
+typedef void (*MeloFileDiscovererFunc) (const gchar *uri, MeloTags *tags,
+                                        const MeloFileDBInfo *info,
+                                        gpointer user_data);
+
+MeloFileDiscoverer *melo_file_discoverer_new (guint workers,
+                                              GstClockTime timeout,
+                                              MeloFileDiscovererFunc func,
+                                              gpointer user_data);
+void melo_file_discoverer_free (MeloFileDiscoverer *disco);
+
+/* Queue an URI: pending jobs with same URI are shared */
+MeloFileDiscovererJob *melo_file_discoverer_add (MeloFileDiscoverer *disco,
+                                           const gchar *uri,
+                                           MeloFileDiscovererPriority priority);
+void melo_file_discoverer_push (MeloFileDiscoverer *disco, const gchar *uri,
+                                MeloFileDiscovererPriority priority);
+
+MeloTags *melo_file_discoverer_job_wait (MeloFileDiscovererJob *job);
+void melo_file_discoverer_job_unref (MeloFileDiscovererJob *job);
+
+/* Get stream details from a GStreamer discoverer result */
+void melo_file_discoverer_get_info (GstDiscovererInfo *info,
+                                    MeloFileDBInfo *dinfo);
+
+#endif /* __MELO_FILE_DISCOVERER_H__ */
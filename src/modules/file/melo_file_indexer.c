@@ -0,0 +1,691 @@
+/*
+ * melo_file_indexer.c: Background indexer for file library
+ *
+ * Copyright (C) 2016 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include <gio/gio.h>
+#include <gst/pbutils/pbutils.h>
+
+#include "melo_event.h"
+#include "melo_sched.h"
+#include "melo_file_tags.h"
+#include "melo_file_discoverer.h"
+#include "melo_file_loudness.h"
+#include "melo_file_indexer.h"
+
+/*
+ * The indexer walks the library roots in its own thread and main context, one
+ * item per throttle interval, so the media database is filled without the
+ * library being browsed first. A file is only discovered again when its
+ * modification time differs from the one saved in database. When monitoring
+ * is enabled, every indexed directory is watched and changes are pushed back
+ * to the queue, and removed files are dropped from the database.
+ *
+ * When loudness analysis is enabled, the songs without loudness are decoded
+ * once the scan is done, one song per throttle interval, and their loudness
+ * and peak are saved in the database. A new scan takes precedence over the
+ * analysis, which restarts from the first song after the scan.
+ */
+
+/* Timeout for tags discovery */
+#define MELO_FILE_INDEXER_DISCOVER_TIMEOUT (5 * GST_SECOND)
+
+/* Minimal interval between two progress events (in us) */
+#define MELO_FILE_INDEXER_EVENT_INTERVAL G_USEC_PER_SEC
+
+#define MELO_FILE_INDEXER_ATTRIBUTES \
+  G_FILE_ATTRIBUTE_STANDARD_TYPE "," \
+  G_FILE_ATTRIBUTE_STANDARD_NAME "," \
+  G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN "," \
+  G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE "," \
+  G_FILE_ATTRIBUTE_TIME_MODIFIED
+
+typedef struct {
+  GFile *file;
+  GFileType type;
+  gchar *content_type;
+  guint64 mtime;
+} MeloFileIndexerItem;
+
+typedef struct {
+  MeloFileIndexer *indexer;
+  GFile *file;
+  guint throttle;
+  gboolean loudness;
+} MeloFileIndexerRequest;
+
+struct _MeloFileIndexer {
+  MeloFileDB *fdb;
+  gchar *id;
+
+  /* Indexer thread */
+  GMainContext *context;
+  GMainLoop *loop;
+  GThread *thread;
+
+  /* Pending items */
+  GQueue queue;
+  GHashTable *queued;
+  GSource *source;
+  guint throttle;
+
+  /* Directory monitors */
+  gboolean monitor;
+  GHashTable *monitors;
+
+  /* Current scan */
+  GstDiscoverer *disco;
+  gboolean batch;
+  guint scanned;
+  guint added;
+  gint64 last_event;
+
+  /* Loudness analysis */
+  gboolean loudness;
+  gboolean analyze;
+  gint analyze_id;
+};
+
+static gboolean melo_file_indexer_process (gpointer user_data);
+
+static void
+melo_file_indexer_item_free (gpointer data)
+{
+  MeloFileIndexerItem *item = data;
+
+  g_object_unref (item->file);
+  g_free (item->content_type);
+  g_slice_free (MeloFileIndexerItem, item);
+}
+
+static void
+melo_file_indexer_request_free (gpointer data)
+{
+  MeloFileIndexerRequest *req = data;
+
+  if (req->file)
+    g_object_unref (req->file);
+  g_slice_free (MeloFileIndexerRequest, req);
+}
+
+/* Following functions must be called from indexer thread */
+static void
+melo_file_indexer_schedule (MeloFileIndexer *indexer)
+{
+  if (indexer->source ||
+      (g_queue_is_empty (&indexer->queue) && !indexer->analyze))
+    return;
+
+  /* Process one item per interval, or as soon as possible when idle */
+  if (indexer->throttle)
+    indexer->source = g_timeout_source_new (indexer->throttle);
+  else
+    indexer->source = g_idle_source_new ();
+  g_source_set_priority (indexer->source, G_PRIORITY_LOW);
+  g_source_set_callback (indexer->source, melo_file_indexer_process, indexer,
+                         NULL);
+  g_source_attach (indexer->source, indexer->context);
+}
+
+static void
+melo_file_indexer_push (MeloFileIndexer *indexer, GFile *file, GFileInfo *info)
+{
+  MeloFileIndexerItem *item;
+  gchar *uri;
+
+  /* Item is already queued */
+  uri = g_file_get_uri (file);
+  if (g_hash_table_contains (indexer->queued, uri)) {
+    g_free (uri);
+    return;
+  }
+  g_hash_table_add (indexer->queued, uri);
+
+  /* Create new item: type is retrieved later when info is not available */
+  item = g_slice_new0 (MeloFileIndexerItem);
+  item->file = g_object_ref (file);
+  item->type = G_FILE_TYPE_UNKNOWN;
+  if (info) {
+    item->type = g_file_info_get_file_type (info);
+    item->content_type = g_strdup (g_file_info_get_content_type (info));
+    item->mtime = g_file_info_get_attribute_uint64 (info,
+                                              G_FILE_ATTRIBUTE_TIME_MODIFIED);
+  }
+
+  /* Add to queue */
+  g_queue_push_tail (&indexer->queue, item);
+  melo_file_indexer_schedule (indexer);
+}
+
+static void
+melo_file_indexer_notify (MeloFileIndexer *indexer, gboolean done)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  /* Limit events rate */
+  if (!done && now - indexer->last_event < MELO_FILE_INDEXER_EVENT_INTERVAL)
+    return;
+  indexer->last_event = now;
+
+  /* Send progress */
+  melo_event_browser_scan (indexer->id, indexer->scanned, indexer->added,
+                           g_queue_get_length (&indexer->queue), done);
+}
+
+static gboolean
+melo_file_indexer_remove_monitor (gpointer key, gpointer value,
+                                  gpointer user_data)
+{
+  const gchar *uri = user_data;
+  gsize len = strlen (uri);
+
+  return !strncmp (key, uri, len) && ((const gchar *) key)[len] == '/';
+}
+
+static gchar *
+melo_file_indexer_get_path (GFile *file)
+{
+  gchar *uri, *path;
+
+  /* Paths are saved unescaped in database */
+  uri = g_file_get_uri (file);
+  path = g_uri_unescape_string (uri, NULL);
+  g_free (uri);
+
+  return path;
+}
+
+static void
+on_changed (GFileMonitor *monitor, GFile *file, GFile *other_file,
+            GFileMonitorEvent event_type, gpointer user_data)
+{
+  MeloFileIndexer *indexer = user_data;
+  gchar *uri, *path, *name;
+  GFile *parent;
+
+  switch (event_type) {
+    case G_FILE_MONITOR_EVENT_CREATED:
+    case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+      /* Index new or modified file */
+      melo_file_indexer_push (indexer, file, NULL);
+      break;
+    case G_FILE_MONITOR_EVENT_DELETED:
+      uri = g_file_get_uri (file);
+
+      /* Directory removed: drop its monitors and all its songs */
+      if (g_hash_table_remove (indexer->monitors, uri)) {
+        g_hash_table_foreach_remove (indexer->monitors,
+                                     melo_file_indexer_remove_monitor, uri);
+        path = melo_file_indexer_get_path (file);
+        melo_file_db_remove (indexer->fdb, path, NULL);
+        g_free (path);
+        g_free (uri);
+        break;
+      }
+      g_free (uri);
+
+      /* Remove song from database */
+      parent = g_file_get_parent (file);
+      if (parent) {
+        path = melo_file_indexer_get_path (parent);
+        name = g_file_get_basename (file);
+        melo_file_db_remove (indexer->fdb, path, name);
+        g_object_unref (parent);
+        g_free (path);
+        g_free (name);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+static void
+melo_file_indexer_monitor_free (gpointer data)
+{
+  GFileMonitor *monitor = data;
+
+  g_signal_handlers_disconnect_matched (monitor, G_SIGNAL_MATCH_FUNC, 0, 0,
+                                        NULL, on_changed, NULL);
+  g_file_monitor_cancel (monitor);
+  g_object_unref (monitor);
+}
+
+static void
+melo_file_indexer_index_dir (MeloFileIndexer *indexer,
+                             MeloFileIndexerItem *item, const gchar *uri)
+{
+  GFileEnumerator *dir_enum;
+  GFileMonitor *monitor;
+  GFileInfo *info;
+
+  /* Watch directory */
+  if (indexer->monitor && !g_hash_table_contains (indexer->monitors, uri)) {
+    monitor = g_file_monitor_directory (item->file, G_FILE_MONITOR_NONE, NULL,
+                                        NULL);
+    if (monitor) {
+      g_signal_connect (monitor, "changed", (GCallback) on_changed, indexer);
+      g_hash_table_insert (indexer->monitors, g_strdup (uri), monitor);
+    }
+  }
+
+  /* List directory */
+  dir_enum = g_file_enumerate_children (item->file,
+                                        MELO_FILE_INDEXER_ATTRIBUTES, 0, NULL,
+                                        NULL);
+  if (!dir_enum)
+    return;
+
+  /* Queue children */
+  while ((info = g_file_enumerator_next_file (dir_enum, NULL, NULL))) {
+    GFile *child;
+
+    if (!g_file_info_get_is_hidden (info)) {
+      child = g_file_get_child (item->file, g_file_info_get_name (info));
+      melo_file_indexer_push (indexer, child, info);
+      g_object_unref (child);
+    }
+    g_object_unref (info);
+  }
+  g_object_unref (dir_enum);
+}
+
+static gboolean
+melo_file_indexer_discover (MeloFileIndexer *indexer, const gchar *uri,
+                            MeloTags **tags, MeloFileDBInfo *dinfo)
+{
+  GstDiscovererInfo *info;
+  const GstTagList *gtags;
+  gboolean ret = FALSE;
+
+  /* Create discoverer */
+  if (!indexer->disco)
+    indexer->disco = gst_discoverer_new (MELO_FILE_INDEXER_DISCOVER_TIMEOUT,
+                                         NULL);
+  if (!indexer->disco)
+    return FALSE;
+
+  /* Get tags from file */
+  info = gst_discoverer_discover_uri (indexer->disco, uri, NULL);
+  if (!info)
+    return FALSE;
+  if (gst_discoverer_info_get_result (info) == GST_DISCOVERER_OK) {
+    gtags = gst_discoverer_info_get_tags (info);
+    if (gtags)
+      *tags = melo_tags_new_from_gst_tag_list (gtags, MELO_TAGS_FIELDS_FULL,
+                                               MELO_TAGS_COVER_PERSIST_DISK);
+    melo_file_discoverer_get_info (info, dinfo);
+    ret = TRUE;
+  }
+  g_object_unref (info);
+
+  return ret;
+}
+
+static void
+melo_file_indexer_index_file (MeloFileIndexer *indexer,
+                              MeloFileIndexerItem *item, const gchar *uri)
+{
+  MeloFileDBInfo info = { 0 };
+  MeloTags *tags = NULL;
+  GFile *parent;
+  gchar *path, *name;
+  gint path_id, timestamp;
+
+  /* Only audio files are indexed */
+  if (!item->content_type || !g_str_has_prefix (item->content_type, "audio/"))
+    return;
+  indexer->scanned++;
+
+  /* Get path ID */
+  parent = g_file_get_parent (item->file);
+  if (!parent)
+    return;
+  path = melo_file_indexer_get_path (parent);
+  g_object_unref (parent);
+  if (!melo_file_db_get_path_id (indexer->fdb, path, TRUE, &path_id)) {
+    g_free (path);
+    return;
+  }
+  g_free (path);
+
+  /* File is up to date */
+  name = g_file_get_basename (item->file);
+  if (melo_file_db_get_timestamp (indexer->fdb, path_id, name, &timestamp) &&
+      (guint64) timestamp == item->mtime) {
+    g_free (name);
+    return;
+  }
+
+  /* Read tags directly from file, or with discoverer */
+  tags = melo_file_tags_new_from_uri (uri, MELO_TAGS_FIELDS_FULL,
+                                      MELO_TAGS_COVER_PERSIST_DISK, &info);
+  if (tags || melo_file_indexer_discover (indexer, uri, &tags, &info)) {
+    /* Save file with its modification time */
+    melo_file_db_add_tags_batch (indexer->fdb, path_id, name, item->mtime,
+                                 tags, &info);
+    indexer->added++;
+    if (tags)
+      melo_tags_unref (tags);
+  }
+  g_free (name);
+}
+
+static gboolean
+melo_file_indexer_analyze (MeloFileIndexer *indexer)
+{
+  gchar *path, *name, *uri;
+  gdouble loudness, peak;
+  gint id;
+
+  /* Get next song without loudness */
+  if (!melo_file_db_get_next_loudness (indexer->fdb, indexer->analyze_id, &id,
+                                       &path, &name))
+    return FALSE;
+  indexer->analyze_id = id;
+
+  /* Decode song and save its loudness */
+  uri = g_strjoin ("/", path, name, NULL);
+  if (melo_file_loudness_analyze (uri, &loudness, &peak))
+    melo_file_db_set_loudness (indexer->fdb, id, loudness, peak);
+  g_free (path);
+  g_free (name);
+  g_free (uri);
+
+  return TRUE;
+}
+
+static gboolean
+melo_file_indexer_process (gpointer user_data)
+{
+  MeloFileIndexer *indexer = user_data;
+  MeloFileIndexerItem *item;
+  GFileInfo *info;
+  gchar *uri;
+
+  /* Library is up to date: analyze one song per interval */
+  if (indexer->analyze && g_queue_is_empty (&indexer->queue)) {
+    if (indexer->loudness && melo_file_indexer_analyze (indexer))
+      return G_SOURCE_CONTINUE;
+    indexer->analyze = FALSE;
+    g_source_unref (indexer->source);
+    indexer->source = NULL;
+    return G_SOURCE_REMOVE;
+  }
+
+  /* Get next item */
+  item = g_queue_pop_head (&indexer->queue);
+  if (item) {
+    uri = g_file_get_uri (item->file);
+    g_hash_table_remove (indexer->queued, uri);
+
+    /* Get file details */
+    if (item->type == G_FILE_TYPE_UNKNOWN) {
+      info = g_file_query_info (item->file, MELO_FILE_INDEXER_ATTRIBUTES, 0,
+                                NULL, NULL);
+      if (info) {
+        item->type = g_file_info_get_file_type (info);
+        item->content_type = g_strdup (g_file_info_get_content_type (info));
+        item->mtime = g_file_info_get_attribute_uint64 (info,
+                                              G_FILE_ATTRIBUTE_TIME_MODIFIED);
+        g_object_unref (info);
+      }
+    }
+
+    /* Group insertions in transactions */
+    if (!indexer->batch)
+      indexer->batch = melo_file_db_begin_batch (indexer->fdb);
+
+    /* Index item */
+    if (item->type == G_FILE_TYPE_DIRECTORY)
+      melo_file_indexer_index_dir (indexer, item, uri);
+    else if (item->type == G_FILE_TYPE_REGULAR)
+      melo_file_indexer_index_file (indexer, item, uri);
+    melo_file_indexer_item_free (item);
+    g_free (uri);
+
+    /* More items to index */
+    if (!g_queue_is_empty (&indexer->queue)) {
+      melo_file_indexer_notify (indexer, FALSE);
+      return G_SOURCE_CONTINUE;
+    }
+  }
+
+  /* Scan is done: commit last songs */
+  if (indexer->batch)
+    melo_file_db_commit_batch (indexer->fdb);
+  indexer->batch = FALSE;
+  melo_file_indexer_notify (indexer, TRUE);
+  indexer->scanned = indexer->added = 0;
+
+  /* Analyze loudness of new songs */
+  if (indexer->loudness) {
+    indexer->analyze = TRUE;
+    indexer->analyze_id = 0;
+    return G_SOURCE_CONTINUE;
+  }
+
+  /* Wait for next items */
+  g_source_unref (indexer->source);
+  indexer->source = NULL;
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+melo_file_indexer_add_root_func (gpointer user_data)
+{
+  MeloFileIndexerRequest *req = user_data;
+
+  melo_file_indexer_push (req->indexer, req->file, NULL);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+melo_file_indexer_set_throttle_func (gpointer user_data)
+{
+  MeloFileIndexerRequest *req = user_data;
+  MeloFileIndexer *indexer = req->indexer;
+
+  /* Restart processing with new interval */
+  indexer->throttle = req->throttle;
+  if (indexer->source) {
+    g_source_destroy (indexer->source);
+    g_source_unref (indexer->source);
+    indexer->source = NULL;
+  }
+  melo_file_indexer_schedule (indexer);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+melo_file_indexer_set_loudness_func (gpointer user_data)
+{
+  MeloFileIndexerRequest *req = user_data;
+  MeloFileIndexer *indexer = req->indexer;
+
+  /* Start analysis, or after current scan */
+  indexer->loudness = req->loudness;
+  if (indexer->loudness && !indexer->source) {
+    indexer->analyze = TRUE;
+    indexer->analyze_id = 0;
+    melo_file_indexer_schedule (indexer);
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+melo_file_indexer_quit_func (gpointer user_data)
+{
+  MeloFileIndexerRequest *req = user_data;
+
+  g_main_loop_quit (req->indexer->loop);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gpointer
+melo_file_indexer_thread (gpointer user_data)
+{
+  MeloFileIndexer *indexer = user_data;
+
+  /* Scan runs in background: keep CPU for audio threads */
+  melo_sched_demote_thread ();
+
+  /* Monitors and sources are attached to indexer context */
+  g_main_context_push_thread_default (indexer->context);
+  g_main_loop_run (indexer->loop);
+
+  /* Stop current scan */
+  if (indexer->source) {
+    g_source_destroy (indexer->source);
+    g_source_unref (indexer->source);
+  }
+  if (indexer->batch)
+    melo_file_db_commit_batch (indexer->fdb);
+  g_queue_foreach (&indexer->queue, (GFunc) melo_file_indexer_item_free, NULL);
+  g_queue_clear (&indexer->queue);
+
+  /* Release thread resources */
+  g_hash_table_remove_all (indexer->monitors);
+  if (indexer->disco)
+    g_object_unref (indexer->disco);
+  g_main_context_pop_thread_default (indexer->context);
+
+  return NULL;
+}
+
+/* Following functions can be called from any thread */
+static void
+melo_file_indexer_send (MeloFileIndexer *indexer, GSourceFunc func,
+                        GFile *file, guint throttle)
+{
+  MeloFileIndexerRequest *req;
+  GSource *source;
+
+  /* Create request */
+  req = g_slice_new0 (MeloFileIndexerRequest);
+  req->indexer = indexer;
+  req->file = file;
+  req->throttle = throttle;
+
+  /* Run request in indexer thread */
+  source = g_idle_source_new ();
+  g_source_set_callback (source, func, req, melo_file_indexer_request_free);
+  g_source_attach (source, indexer->context);
+  g_source_unref (source);
+}
+
+MeloFileIndexer *
+melo_file_indexer_new (MeloFileDB *fdb, const gchar *id, guint throttle,
+                       gboolean monitor)
+{
+  MeloFileIndexer *indexer;
+
+  g_return_val_if_fail (fdb, NULL);
+
+  /* Create indexer */
+  indexer = g_slice_new0 (MeloFileIndexer);
+  indexer->fdb = g_object_ref (fdb);
+  indexer->id = g_strdup (id);
+  indexer->throttle = throttle;
+  indexer->monitor = monitor;
+  g_queue_init (&indexer->queue);
+  indexer->queued = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                           NULL);
+  indexer->monitors = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                             melo_file_indexer_monitor_free);
+
+  /* Create main loop */
+  indexer->context = g_main_context_new ();
+  indexer->loop = g_main_loop_new (indexer->context, FALSE);
+
+  /* Start indexer thread */
+  indexer->thread = g_thread_try_new ("melo_file_indexer",
+                                      melo_file_indexer_thread, indexer, NULL);
+  if (!indexer->thread) {
+    melo_file_indexer_free (indexer);
+    return NULL;
+  }
+
+  return indexer;
+}
+
+void
+melo_file_indexer_free (MeloFileIndexer *indexer)
+{
+  /* Stop indexer thread */
+  if (indexer->thread) {
+    melo_file_indexer_send (indexer, melo_file_indexer_quit_func, NULL, 0);
+    g_thread_join (indexer->thread);
+  }
+
+  /* Free pending requests */
+  g_main_loop_unref (indexer->loop);
+  g_main_context_unref (indexer->context);
+
+  /* Free indexer */
+  g_hash_table_unref (indexer->monitors);
+  g_hash_table_unref (indexer->queued);
+  g_object_unref (indexer->fdb);
+  g_free (indexer->id);
+  g_slice_free (MeloFileIndexer, indexer);
+}
+
+void
+melo_file_indexer_add_root (MeloFileIndexer *indexer, const gchar *uri)
+{
+  g_return_if_fail (indexer && uri);
+
+  melo_file_indexer_send (indexer, melo_file_indexer_add_root_func,
+                          g_file_new_for_uri (uri), 0);
+}
+
+void
+melo_file_indexer_set_throttle (MeloFileIndexer *indexer, guint throttle)
+{
+  g_return_if_fail (indexer);
+
+  melo_file_indexer_send (indexer, melo_file_indexer_set_throttle_func, NULL,
+                          throttle);
+}
+
+void
+melo_file_indexer_set_loudness (MeloFileIndexer *indexer, gboolean enable)
+{
+  MeloFileIndexerRequest *req;
+  GSource *source;
+
+  g_return_if_fail (indexer);
+
+  /* Run request in indexer thread */
+  req = g_slice_new0 (MeloFileIndexerRequest);
+  req->indexer = indexer;
+  req->loudness = enable;
+  source = g_idle_source_new ();
+  g_source_set_callback (source, melo_file_indexer_set_loudness_func, req,
+                         melo_file_indexer_request_free);
+  g_source_attach (source, indexer->context);
+  g_source_unref (source);
+}
@@ -0,0 +1,39 @@
+/*
+ * melo_file_indexer.h: Background indexer for file library
+ *
+ * Copyright (C) 2016 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __MELO_FILE_INDEXER_H__
+#define __MELO_FILE_INDEXER_H__
+
+#include <glib.h>
+
+#include "melo_file_db.h"
+
+typedef struct _MeloFileIndexer MeloFileIndexer;
+
+MeloFileIndexer *melo_file_indexer_new (MeloFileDB *fdb, const gchar *id,
+                                        guint throttle, gboolean monitor);
+void melo_file_indexer_free (MeloFileIndexer *indexer);
+
+void melo_file_indexer_add_root (MeloFileIndexer *indexer, const gchar *uri);
+void melo_file_indexer_set_throttle (MeloFileIndexer *indexer, guint throttle);
+void melo_file_indexer_set_loudness (MeloFileIndexer *indexer, gboolean enable);
+
+#endif /* __MELO_FILE_INDEXER_H__ */
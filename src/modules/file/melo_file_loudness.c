@@ -0,0 +1,338 @@
+/*
+ * melo_file_loudness.c: Loudness analysis of media files
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <math.h>
+
+#include <gst/gst.h>
+
+#include "melo_sched.h"
+
+#include "melo_file_loudness.h"
+
+/*
+ * The integrated loudness is measured as defined by ITU-R BS.1770 and EBU
+ * R128: the audio is converted to 48 kHz float samples and filtered by the
+ * K-weighting filter, then the mean square of each channel is computed on
+ * blocks of 400 ms overlapping by 75%. The blocks under the absolute gate of
+ * -70 LUFS are dropped, then the blocks 10 LU under the loudness of remaining
+ * blocks. All channels are weighted by 1.0, as the channel positions are not
+ * known after conversion. The sample peak is taken before filtering.
+ */
+
+/* Analysis format: filter coefficients are given for 48 kHz */
+#define MELO_FILE_LOUDNESS_RATE 48000
+#define MELO_FILE_LOUDNESS_CHANNELS 8
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define MELO_FILE_LOUDNESS_FORMAT "F32LE"
+#else
+#define MELO_FILE_LOUDNESS_FORMAT "F32BE"
+#endif
+#define MELO_FILE_LOUDNESS_CAPS \
+  "audio/x-raw,format=" MELO_FILE_LOUDNESS_FORMAT ",layout=interleaved," \
+  "rate=48000,channels=[1,8]"
+
+/* Gating blocks are made of 4 steps of 100 ms */
+#define MELO_FILE_LOUDNESS_STEP (MELO_FILE_LOUDNESS_RATE / 10)
+#define MELO_FILE_LOUDNESS_STEPS 4
+
+/* Relative gate (in LU) */
+#define MELO_FILE_LOUDNESS_GATE -10.0
+
+/* Maximum time to decode a media */
+#define MELO_FILE_LOUDNESS_TIMEOUT (10 * 60 * GST_SECOND)
+
+/* K-weighting filter: high shelf then high pass */
+#define MELO_FILE_LOUDNESS_SHELF_B0 1.53512485958697
+#define MELO_FILE_LOUDNESS_SHELF_B1 -2.69169618940638
+#define MELO_FILE_LOUDNESS_SHELF_B2 1.19839281085285
+#define MELO_FILE_LOUDNESS_SHELF_A1 -1.69065929318241
+#define MELO_FILE_LOUDNESS_SHELF_A2 0.73248077421585
+#define MELO_FILE_LOUDNESS_HPF_A1 -1.99004745483398
+#define MELO_FILE_LOUDNESS_HPF_A2 0.99007225036621
+
+typedef struct {
+  /* Filter states of each channel */
+  guint channels;
+  gdouble states[MELO_FILE_LOUDNESS_CHANNELS][4];
+
+  /* Current step */
+  gdouble energy;
+  guint frames;
+
+  /* Mean squares of last steps and of gating blocks */
+  gdouble steps[MELO_FILE_LOUDNESS_STEPS];
+  guint64 step_count;
+  GArray *blocks;
+
+  /* Sample peak */
+  gdouble peak;
+} MeloFileLoudness;
+
+static inline gdouble
+melo_file_loudness_to_lufs (gdouble power)
+{
+  return -0.691 + 10.0 * log10 (power);
+}
+
+static void
+melo_file_loudness_process (MeloFileLoudness *l, const gfloat *samples,
+                            gsize frames)
+{
+  gsize i;
+  guint c;
+
+  for (i = 0; i < frames; i++) {
+    for (c = 0; c < l->channels; c++) {
+      gdouble *s = l->states[c];
+      gdouble x, y;
+
+      /* Update sample peak */
+      x = *samples++;
+      if (fabs (x) > l->peak)
+        l->peak = fabs (x);
+
+      /* Apply K-weighting filter (transposed direct form II) */
+      y = MELO_FILE_LOUDNESS_SHELF_B0 * x + s[0];
+      s[0] = MELO_FILE_LOUDNESS_SHELF_B1 * x - MELO_FILE_LOUDNESS_SHELF_A1 * y +
+             s[1];
+      s[1] = MELO_FILE_LOUDNESS_SHELF_B2 * x - MELO_FILE_LOUDNESS_SHELF_A2 * y;
+      x = y;
+      y = x + s[2];
+      s[2] = -2.0 * x - MELO_FILE_LOUDNESS_HPF_A1 * y + s[3];
+      s[3] = x - MELO_FILE_LOUDNESS_HPF_A2 * y;
+
+      /* Sum energy of all channels */
+      l->energy += y * y;
+    }
+
+    /* Step is done */
+    if (++l->frames == MELO_FILE_LOUDNESS_STEP) {
+      l->steps[l->step_count++ % MELO_FILE_LOUDNESS_STEPS] =
+                                      l->energy / MELO_FILE_LOUDNESS_STEP;
+      l->energy = 0.0;
+      l->frames = 0;
+
+      /* Add a new gating block */
+      if (l->step_count >= MELO_FILE_LOUDNESS_STEPS) {
+        gdouble power = 0.0;
+        guint j;
+
+        for (j = 0; j < MELO_FILE_LOUDNESS_STEPS; j++)
+          power += l->steps[j];
+        power /= MELO_FILE_LOUDNESS_STEPS;
+        g_array_append_val (l->blocks, power);
+      }
+    }
+  }
+}
+
+static gdouble
+melo_file_loudness_gate (MeloFileLoudness *l, gdouble gate)
+{
+  gdouble sum = 0.0;
+  guint i, count = 0;
+
+  /* Get mean power of blocks above gate */
+  for (i = 0; i < l->blocks->len; i++) {
+    gdouble power = g_array_index (l->blocks, gdouble, i);
+
+    if (power > 0.0 && melo_file_loudness_to_lufs (power) > gate) {
+      sum += power;
+      count++;
+    }
+  }
+
+  return count ? melo_file_loudness_to_lufs (sum / count) :
+                 MELO_FILE_LOUDNESS_MIN;
+}
+
+static void
+melo_file_loudness_handoff (GstElement *sink, GstBuffer *buffer, GstPad *pad,
+                            gpointer user_data)
+{
+  MeloFileLoudness *l = user_data;
+  GstMapInfo map;
+
+  /* Get channels count on first buffer */
+  if (!l->channels) {
+    GstCaps *caps = gst_pad_get_current_caps (pad);
+    gint channels = 0;
+
+    if (caps) {
+      gst_structure_get_int (gst_caps_get_structure (caps, 0), "channels",
+                             &channels);
+      gst_caps_unref (caps);
+    }
+    if (channels <= 0 || channels > MELO_FILE_LOUDNESS_CHANNELS)
+      return;
+    l->channels = channels;
+  }
+
+  /* Analyze samples */
+  if (!gst_buffer_map (buffer, &map, GST_MAP_READ))
+    return;
+  melo_file_loudness_process (l, (const gfloat *) map.data,
+                              map.size / (sizeof (gfloat) * l->channels));
+  gst_buffer_unmap (buffer, &map);
+}
+
+static void
+melo_file_loudness_pad_added (GstElement *src, GstPad *pad, gpointer user_data)
+{
+  GstElement *convert = user_data;
+  GstStructure *str;
+  GstPad *sink_pad;
+  GstCaps *caps;
+
+  /* Get sink pad from converter */
+  sink_pad = gst_element_get_static_pad (convert, "sink");
+  if (GST_PAD_IS_LINKED (sink_pad)) {
+    gst_object_unref (sink_pad);
+    return;
+  }
+
+  /* Only select audio pad */
+  caps = gst_pad_query_caps (pad, NULL);
+  str = gst_caps_get_structure (caps, 0);
+  if (g_strrstr (gst_structure_get_name (str), "audio"))
+    gst_pad_link (pad, sink_pad);
+  gst_caps_unref (caps);
+  gst_object_unref (sink_pad);
+}
+
+static GstBusSyncReply
+melo_file_loudness_sync (GstBus *bus, GstMessage *msg, gpointer user_data)
+{
+  GstStreamStatusType type;
+  GstElement *owner;
+
+  /* Decoding threads are taken from a pool: keep them in background while
+   * they run for the analysis only
+   */
+  if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_STREAM_STATUS) {
+    gst_message_parse_stream_status (msg, &type, &owner);
+    if (type == GST_STREAM_STATUS_TYPE_ENTER)
+      melo_sched_demote_thread ();
+    else if (type == GST_STREAM_STATUS_TYPE_LEAVE)
+      melo_sched_restore_thread ();
+  }
+
+  return GST_BUS_PASS;
+}
+
+gboolean
+melo_file_loudness_analyze (const gchar *uri, gdouble *loudness,
+                            gdouble *peak)
+{
+  GstElement *pipeline, *src, *convert, *resample, *filter, *sink;
+  MeloFileLoudness l = { 0 };
+  gboolean ret = FALSE;
+  GstMessage *msg;
+  GstCaps *caps;
+  GstBus *bus;
+
+  g_return_val_if_fail (uri, FALSE);
+
+  /* Create pipeline without output */
+  pipeline = gst_pipeline_new ("melo_file_loudness");
+  src = gst_element_factory_make ("uridecodebin", NULL);
+  convert = gst_element_factory_make ("audioconvert", NULL);
+  resample = gst_element_factory_make ("audioresample", NULL);
+  filter = gst_element_factory_make ("capsfilter", NULL);
+  sink = gst_element_factory_make ("fakesink", NULL);
+  if (!src || !convert || !resample || !filter || !sink) {
+    if (src)
+      gst_object_unref (src);
+    if (convert)
+      gst_object_unref (convert);
+    if (resample)
+      gst_object_unref (resample);
+    if (filter)
+      gst_object_unref (filter);
+    if (sink)
+      gst_object_unref (sink);
+    gst_object_unref (pipeline);
+    return FALSE;
+  }
+  gst_bin_add_many (GST_BIN (pipeline), src, convert, resample, filter, sink,
+                    NULL);
+  gst_element_link_many (convert, resample, filter, sink, NULL);
+
+  /* Setup elements: samples are consumed as fast as they are decoded */
+  g_object_set (src, "uri", uri, NULL);
+  caps = gst_caps_from_string (MELO_FILE_LOUDNESS_CAPS);
+  g_object_set (filter, "caps", caps, NULL);
+  gst_caps_unref (caps);
+  g_object_set (sink, "sync", FALSE, "signal-handoffs", TRUE, NULL);
+  g_signal_connect (src, "pad-added",
+                    G_CALLBACK (melo_file_loudness_pad_added), convert);
+  g_signal_connect (sink, "handoff", G_CALLBACK (melo_file_loudness_handoff),
+                    &l);
+  l.blocks = g_array_new (FALSE, FALSE, sizeof (gdouble));
+
+  /* Decode whole media */
+  bus = gst_element_get_bus (pipeline);
+  gst_bus_set_sync_handler (bus, melo_file_loudness_sync, NULL, NULL);
+  if (gst_element_set_state (pipeline, GST_STATE_PLAYING) !=
+      GST_STATE_CHANGE_FAILURE) {
+    msg = gst_bus_timed_pop_filtered (bus, MELO_FILE_LOUDNESS_TIMEOUT,
+                                      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+    if (msg) {
+      ret = GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS;
+      gst_message_unref (msg);
+    }
+  }
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_bus_set_sync_handler (bus, NULL, NULL, NULL);
+  gst_object_unref (bus);
+  gst_object_unref (pipeline);
+
+  /* Apply absolute gate, then relative gate */
+  if (ret && l.channels) {
+    *loudness = melo_file_loudness_gate (&l, MELO_FILE_LOUDNESS_MIN);
+    if (*loudness > MELO_FILE_LOUDNESS_MIN)
+      *loudness = melo_file_loudness_gate (&l, MAX (MELO_FILE_LOUDNESS_MIN,
+                                   *loudness + MELO_FILE_LOUDNESS_GATE));
+    *peak = l.peak > 0.0 ? 20.0 * log10 (l.peak) : MELO_FILE_LOUDNESS_MIN;
+    *peak = MAX (*peak, MELO_FILE_LOUDNESS_MIN);
+  } else
+    ret = FALSE;
+  g_array_free (l.blocks, TRUE);
+
+  return ret;
+}
+
+gdouble
+melo_file_loudness_get_gain (gdouble loudness, gdouble peak, gdouble target)
+{
+  gdouble gain;
+
+  /* Silent media: keep it as is */
+  if (loudness <= MELO_FILE_LOUDNESS_MIN)
+    return 1.0;
+
+  /* Reach target loudness without clipping */
+  gain = target - loudness;
+  if (peak + gain > 0.0)
+    gain = -peak;
+
+  return pow (10.0, gain / 20.0);
+}
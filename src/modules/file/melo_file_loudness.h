@@ -0,0 +1,43 @@
+/*
+ * melo_file_loudness.h: Loudness analysis of media files
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __MELO_FILE_LOUDNESS_H__
+#define __MELO_FILE_LOUDNESS_H__
+
+#include <glib.h>
+
+/* Loudness of silent or too short medias (in LUFS) */
+#define MELO_FILE_LOUDNESS_MIN -70.0
+
+/* Decode a media as fast as possible and get its EBU R128 integrated loudness
+ * (in LUFS) and its sample peak (in dBFS). It blocks until the whole media is
+ * decoded: it must be called from a background thread.
+ */
+gboolean melo_file_loudness_analyze (const gchar *uri, gdouble *loudness,
+                                     gdouble *peak);
+
+/* Get linear gain to apply for a target loudness (in LUFS), limited to keep
+ * the peak under 0 dBFS
+ */
+gdouble melo_file_loudness_get_gain (gdouble loudness, gdouble peak,
+                                     gdouble target);
+
+#endif /* __MELO_FILE_LOUDNESS_H__ */
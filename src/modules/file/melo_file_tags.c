@@ -0,0 +1,1161 @@
+/*
+ * melo_file_tags.c: Native tags reader for common audio files
+ *
+ * Copyright (C) 2016 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "melo_file_tags.h"
+
+/*
+ * The file is memory-mapped and only the metadata blocks are parsed: the
+ * ID3v2 / ID3v1 tags of MP3, the Vorbis comments and pictures of FLAC, the
+ * comment header of Ogg Vorbis / Opus and the iTunes items of MP4. When the
+ * format is not known, NULL is returned and the caller should use a
+ * GstDiscoverer instead.
+ *
+ * Stream details are read from the same headers: first frame and Xing header
+ * of MP3, STREAMINFO of FLAC, identification header and last page of Ogg, and
+ * movie header and sample description of MP4.
+ */
+
+/* Maximal size of an Ogg comment packet (embedded cover included) */
+#define MELO_FILE_TAGS_OGG_MAX_PACKET (16 * 1024 * 1024)
+
+/* Picture type of front cover (ID3v2 / FLAC) */
+#define MELO_FILE_TAGS_FRONT_COVER 3
+
+/* Maximal size of data searched for first MPEG frame / last Ogg page */
+#define MELO_FILE_TAGS_MPEG_SYNC_MAX 4096
+#define MELO_FILE_TAGS_OGG_LAST_PAGE_MAX 65536
+
+/* Codec names (same as GStreamer descriptions) */
+#define MELO_FILE_TAGS_CODEC_MP3 "MPEG-1 Layer 3 (MP3)"
+#define MELO_FILE_TAGS_CODEC_FLAC "Free Lossless Audio Codec (FLAC)"
+#define MELO_FILE_TAGS_CODEC_VORBIS "Vorbis"
+#define MELO_FILE_TAGS_CODEC_OPUS "Opus"
+#define MELO_FILE_TAGS_CODEC_AAC "MPEG-4 AAC"
+#define MELO_FILE_TAGS_CODEC_ALAC "Apple Lossless Audio (ALAC)"
+
+typedef struct {
+  MeloTags *tags;
+  MeloTagsFields fields;
+  GBytes *cover;
+  gboolean front;
+  MeloFileDBInfo info;
+} MeloFileTagsContext;
+
+/* ID3v1 genres (also used by ID3v2 and MP4) */
+static const gchar *melo_file_tags_genres[] = {
+  "Blues", "Classic Rock", "Country", "Dance", "Disco", "Funk", "Grunge",
+  "Hip-Hop", "Jazz", "Metal", "New Age", "Oldies", "Other", "Pop", "R&B",
+  "Rap", "Reggae", "Rock", "Techno", "Industrial", "Alternative", "Ska",
+  "Death Metal", "Pranks", "Soundtrack", "Euro-Techno", "Ambient", "Trip-Hop",
+  "Vocal", "Jazz+Funk", "Fusion", "Trance", "Classical", "Instrumental",
+  "Acid", "House", "Game", "Sound Clip", "Gospel", "Noise", "Alternative Rock",
+  "Bass", "Soul", "Punk", "Space", "Meditative", "Instrumental Pop",
+  "Instrumental Rock", "Ethnic", "Gothic", "Darkwave", "Techno-Industrial",
+  "Electronic", "Pop-Folk", "Eurodance", "Dream", "Southern Rock", "Comedy",
+  "Cult", "Gangsta", "Top 40", "Christian Rap", "Pop/Funk", "Jungle",
+  "Native American", "Cabaret", "New Wave", "Psychedelic", "Rave",
+  "Showtunes", "Trailer", "Lo-Fi", "Tribal", "Acid Punk", "Acid Jazz", "Polka",
+  "Retro", "Musical", "Rock & Roll", "Hard Rock",
+};
+
+static inline guint32
+melo_file_tags_be32 (const guint8 *p)
+{
+  return ((guint32) p[0] << 24) | ((guint32) p[1] << 16) |
+         ((guint32) p[2] << 8) | p[3];
+}
+
+static inline guint16
+melo_file_tags_be16 (const guint8 *p)
+{
+  return (p[0] << 8) | p[1];
+}
+
+static inline guint32
+melo_file_tags_le32 (const guint8 *p)
+{
+  return ((guint32) p[3] << 24) | ((guint32) p[2] << 16) |
+         ((guint32) p[1] << 8) | p[0];
+}
+
+static inline guint64
+melo_file_tags_be64 (const guint8 *p)
+{
+  return ((guint64) melo_file_tags_be32 (p) << 32) | melo_file_tags_be32 (p + 4);
+}
+
+static inline guint64
+melo_file_tags_le64 (const guint8 *p)
+{
+  return ((guint64) melo_file_tags_le32 (p + 4) << 32) | melo_file_tags_le32 (p);
+}
+
+static inline guint32
+melo_file_tags_syncsafe (const guint8 *p)
+{
+  return ((guint32) (p[0] & 0x7f) << 21) | ((guint32) (p[1] & 0x7f) << 14) |
+         ((guint32) (p[2] & 0x7f) << 7) | (p[3] & 0x7f);
+}
+
+static const gchar *
+melo_file_tags_get_genre (guint id)
+{
+  if (id >= G_N_ELEMENTS (melo_file_tags_genres))
+    return NULL;
+  return melo_file_tags_genres[id];
+}
+
+static void
+melo_file_tags_set (MeloFileTagsContext *ctx, MeloTagsFields field,
+                    const gchar *value)
+{
+  MeloTags *tags = ctx->tags;
+  guint64 track;
+  gchar *end;
+
+  /* Field not requested or invalid value */
+  if (!(ctx->fields & field) || !value || *value == '\0' ||
+      !g_utf8_validate (value, -1, NULL))
+    return;
+
+  /* First value found is kept */
+  switch (field) {
+    case MELO_TAGS_FIELDS_TITLE:
+      if (!tags->title)
+        tags->title = melo_tags_intern_string (value);
+      break;
+    case MELO_TAGS_FIELDS_ARTIST:
+      if (!tags->artist)
+        tags->artist = melo_tags_intern_string (value);
+      break;
+    case MELO_TAGS_FIELDS_ALBUM:
+      if (!tags->album)
+        tags->album = melo_tags_intern_string (value);
+      break;
+    case MELO_TAGS_FIELDS_GENRE:
+      if (!tags->genre)
+        tags->genre = melo_tags_intern_string (value);
+      break;
+    case MELO_TAGS_FIELDS_DATE:
+      /* Keep only year */
+      if (!tags->date)
+        tags->date = g_ascii_strtoll (value, NULL, 10);
+      break;
+    case MELO_TAGS_FIELDS_TRACK:
+      /* Track can be set as "track/tracks" */
+      track = g_ascii_strtoull (value, &end, 10);
+      if (!tags->track)
+        tags->track = track;
+      if (*end == '/' && ctx->fields & MELO_TAGS_FIELDS_TRACKS &&
+          !tags->tracks)
+        tags->tracks = g_ascii_strtoull (end + 1, NULL, 10);
+      break;
+    case MELO_TAGS_FIELDS_TRACKS:
+      if (!tags->tracks)
+        tags->tracks = g_ascii_strtoull (value, NULL, 10);
+      break;
+    default:
+      break;
+  }
+}
+
+static void
+melo_file_tags_set_cover (MeloFileTagsContext *ctx, GBytes *cover, guint type)
+{
+  /* Keep front cover or first image found */
+  if (ctx->fields & MELO_TAGS_FIELDS_COVER && g_bytes_get_size (cover) &&
+      (!ctx->cover ||
+       (!ctx->front && type == MELO_FILE_TAGS_FRONT_COVER))) {
+    if (ctx->cover)
+      g_bytes_unref (ctx->cover);
+    ctx->cover = g_bytes_ref (cover);
+    ctx->front = type == MELO_FILE_TAGS_FRONT_COVER;
+  }
+  g_bytes_unref (cover);
+}
+
+/* Vorbis comments (FLAC / Ogg) */
+static void
+melo_file_tags_parse_picture (MeloFileTagsContext *ctx, const guint8 *data,
+                              gsize size)
+{
+  guint32 type, len;
+  gsize pos;
+
+  /* Picture type and MIME type */
+  if (size < 8)
+    return;
+  type = melo_file_tags_be32 (data);
+  len = melo_file_tags_be32 (data + 4);
+  if (len > size - 8)
+    return;
+  pos = 8 + len;
+
+  /* Description */
+  if (size - pos < 4)
+    return;
+  len = melo_file_tags_be32 (data + pos);
+  if (len > size - pos - 4)
+    return;
+  pos += 4 + len;
+
+  /* Skip width, height, depth and colors */
+  if (size - pos < 20)
+    return;
+  len = melo_file_tags_be32 (data + pos + 16);
+  pos += 20;
+  if (len > size - pos)
+    return;
+
+  melo_file_tags_set_cover (ctx, g_bytes_new (data + pos, len), type);
+}
+
+static void
+melo_file_tags_parse_comment (MeloFileTagsContext *ctx, const gchar *comment,
+                              gsize size)
+{
+  static const struct {
+    const gchar *key;
+    MeloTagsFields field;
+  } keys[] = {
+    { "TITLE", MELO_TAGS_FIELDS_TITLE },
+    { "ARTIST", MELO_TAGS_FIELDS_ARTIST },
+    { "ALBUM", MELO_TAGS_FIELDS_ALBUM },
+    { "GENRE", MELO_TAGS_FIELDS_GENRE },
+    { "DATE", MELO_TAGS_FIELDS_DATE },
+    { "TRACKNUMBER", MELO_TAGS_FIELDS_TRACK },
+    { "TRACKTOTAL", MELO_TAGS_FIELDS_TRACKS },
+    { "TOTALTRACKS", MELO_TAGS_FIELDS_TRACKS },
+  };
+  const gchar *sep;
+  gsize len, i;
+  guchar *img;
+  gchar *value;
+
+  /* Split key and value */
+  sep = memchr (comment, '=', size);
+  if (!sep)
+    return;
+  len = sep - comment;
+  value = g_strndup (sep + 1, size - len - 1);
+
+  /* Embedded covers are base64 encoded */
+  if (len == 22 &&
+      !g_ascii_strncasecmp (comment, "METADATA_BLOCK_PICTURE", len)) {
+    if (ctx->fields & MELO_TAGS_FIELDS_COVER) {
+      img = g_base64_decode (value, &len);
+      if (img)
+        melo_file_tags_parse_picture (ctx, img, len);
+      g_free (img);
+    }
+  } else if (len == 8 && !g_ascii_strncasecmp (comment, "COVERART", len)) {
+    if (ctx->fields & MELO_TAGS_FIELDS_COVER) {
+      img = g_base64_decode (value, &len);
+      if (img)
+        melo_file_tags_set_cover (ctx, g_bytes_new_take (img, len), 0);
+    }
+  } else {
+    for (i = 0; i < G_N_ELEMENTS (keys); i++) {
+      if (len == strlen (keys[i].key) &&
+          !g_ascii_strncasecmp (comment, keys[i].key, len)) {
+        melo_file_tags_set (ctx, keys[i].field, value);
+        break;
+      }
+    }
+  }
+  g_free (value);
+}
+
+static void
+melo_file_tags_parse_vorbis_comment (MeloFileTagsContext *ctx,
+                                     const guint8 *data, gsize size)
+{
+  guint32 count, len;
+  gsize pos;
+
+  /* Skip vendor string */
+  if (size < 4)
+    return;
+  len = melo_file_tags_le32 (data);
+  if (len > size - 4 || size - 4 - len < 4)
+    return;
+  pos = 4 + len;
+
+  /* Parse comments */
+  count = melo_file_tags_le32 (data + pos);
+  pos += 4;
+  while (count-- && size - pos >= 4) {
+    len = melo_file_tags_le32 (data + pos);
+    pos += 4;
+    if (len > size - pos)
+      break;
+    melo_file_tags_parse_comment (ctx, (const gchar *) data + pos, len);
+    pos += len;
+  }
+}
+
+/* FLAC */
+static void
+melo_file_tags_parse_streaminfo (MeloFileTagsContext *ctx, const guint8 *data)
+{
+  guint rate;
+  guint64 samples;
+
+  /* Sample rate (20 bits), channels (3 bits), bits per sample (5 bits) and
+   * total samples (36 bits)
+   */
+  rate = (data[10] << 12) | (data[11] << 4) | (data[12] >> 4);
+  samples = ((guint64) (data[13] & 0x0f) << 32) |
+            melo_file_tags_be32 (data + 14);
+
+  ctx->info.codec = MELO_FILE_TAGS_CODEC_FLAC;
+  ctx->info.rate = rate;
+  ctx->info.channels = ((data[12] >> 1) & 0x07) + 1;
+  if (rate)
+    ctx->info.duration = samples * 1000 / rate;
+}
+
+static gboolean
+melo_file_tags_parse_flac (MeloFileTagsContext *ctx, const guint8 *data,
+                           gsize size)
+{
+  guint32 len;
+  gsize pos = 4;
+  guint8 hdr;
+
+  if (size < 4 || memcmp (data, "fLaC", 4))
+    return FALSE;
+
+  /* Parse metadata blocks */
+  while (size - pos >= 4) {
+    hdr = data[pos];
+    len = melo_file_tags_be32 (data + pos) & 0xffffff;
+    pos += 4;
+    if (len > size - pos)
+      break;
+
+    /* Stream info, Vorbis comment or picture */
+    if ((hdr & 0x7f) == 0 && len >= 18)
+      melo_file_tags_parse_streaminfo (ctx, data + pos);
+    else if ((hdr & 0x7f) == 4)
+      melo_file_tags_parse_vorbis_comment (ctx, data + pos, len);
+    else if ((hdr & 0x7f) == 6)
+      melo_file_tags_parse_picture (ctx, data + pos, len);
+    pos += len;
+
+    /* Last metadata block */
+    if (hdr & 0x80)
+      break;
+  }
+
+  return TRUE;
+}
+
+/* Ogg Vorbis / Opus */
+static guint64
+melo_file_tags_ogg_last_granule (const guint8 *data, gsize size,
+                                 guint32 serial)
+{
+  gsize pos, min;
+
+  /* Find last page of stream from end of file */
+  min = size > MELO_FILE_TAGS_OGG_LAST_PAGE_MAX ?
+        size - MELO_FILE_TAGS_OGG_LAST_PAGE_MAX : 0;
+  for (pos = size - 27; pos > min; pos--) {
+    if (data[pos] == 'O' && !memcmp (data + pos, "OggS", 4) &&
+        melo_file_tags_le32 (data + pos + 14) == serial)
+      return melo_file_tags_le64 (data + pos + 6);
+  }
+
+  return 0;
+}
+
+static void
+melo_file_tags_ogg_info (MeloFileTagsContext *ctx, const guint8 *data,
+                         gsize size, guint32 serial, const guint8 *id,
+                         gboolean opus)
+{
+  guint64 granule;
+  guint pre_skip = 0;
+  gint32 bitrate;
+
+  /* Get details from identification header */
+  if (opus) {
+    ctx->info.codec = MELO_FILE_TAGS_CODEC_OPUS;
+    ctx->info.channels = id[9];
+    ctx->info.rate = 48000;
+    pre_skip = id[10] | (id[11] << 8);
+  } else {
+    ctx->info.codec = MELO_FILE_TAGS_CODEC_VORBIS;
+    ctx->info.channels = id[11];
+    ctx->info.rate = melo_file_tags_le32 (id + 12);
+    bitrate = melo_file_tags_le32 (id + 20);
+    if (bitrate > 0)
+      ctx->info.bitrate = bitrate;
+  }
+
+  /* Duration is given by granule position of last page */
+  granule = melo_file_tags_ogg_last_granule (data, size, serial);
+  if (granule > pre_skip && granule != G_MAXUINT64 && ctx->info.rate)
+    ctx->info.duration = (granule - pre_skip) * 1000 / ctx->info.rate;
+}
+
+static gboolean
+melo_file_tags_parse_ogg (MeloFileTagsContext *ctx, const guint8 *data,
+                          gsize size)
+{
+  gboolean opus = FALSE, ret = FALSE;
+  guint32 serial = 0, page_serial;
+  guint packets = 0, segs, i;
+  GByteArray *packet;
+  gsize pos = 0, body;
+
+  if (size < 4 || memcmp (data, "OggS", 4))
+    return FALSE;
+
+  /* Rebuild identification and comment packets of first stream */
+  packet = g_byte_array_new ();
+  while (size - pos >= 27 && !memcmp (data + pos, "OggS", 4)) {
+    segs = data[pos + 26];
+    body = pos + 27 + segs;
+    if (body > size)
+      break;
+    page_serial = melo_file_tags_le32 (data + pos + 14);
+    if (!pos)
+      serial = page_serial;
+
+    for (i = 0; i < segs; i++) {
+      guint len = data[pos + 27 + i];
+
+      if (len > size - body)
+        goto end;
+
+      /* Append segment to current packet */
+      if (page_serial == serial) {
+        g_byte_array_append (packet, data + body, len);
+        if (packet->len > MELO_FILE_TAGS_OGG_MAX_PACKET)
+          goto end;
+
+        /* Packet is complete */
+        if (len < 255) {
+          if (!packets) {
+            /* Identification header */
+            if (packet->len >= 30 &&
+                !memcmp (packet->data, "\001vorbis", 7))
+              opus = FALSE;
+            else if (packet->len >= 19 &&
+                     !memcmp (packet->data, "OpusHead", 8))
+              opus = TRUE;
+            else
+              goto end;
+            melo_file_tags_ogg_info (ctx, data, size, serial, packet->data,
+                                     opus);
+          } else {
+            /* Comment header */
+            if (!opus && packet->len >= 7 &&
+                !memcmp (packet->data, "\003vorbis", 7)) {
+              melo_file_tags_parse_vorbis_comment (ctx, packet->data + 7,
+                                                   packet->len - 7);
+              ret = TRUE;
+            } else if (opus && packet->len >= 8 &&
+                       !memcmp (packet->data, "OpusTags", 8)) {
+              melo_file_tags_parse_vorbis_comment (ctx, packet->data + 8,
+                                                   packet->len - 8);
+              ret = TRUE;
+            }
+            goto end;
+          }
+          g_byte_array_set_size (packet, 0);
+          packets++;
+        }
+      }
+      body += len;
+    }
+    pos = body;
+  }
+
+end:
+  g_byte_array_free (packet, TRUE);
+  return ret;
+}
+
+/* ID3v2 / ID3v1 */
+static guint8 *
+melo_file_tags_id3v2_unsync (const guint8 *data, gsize size, gsize *len)
+{
+  guint8 *buf;
+  gsize i, j;
+
+  /* Remove 0x00 inserted after each 0xFF */
+  buf = g_malloc (size);
+  for (i = 0, j = 0; i < size; i++) {
+    buf[j++] = data[i];
+    if (data[i] == 0xff && i + 1 < size && !data[i + 1])
+      i++;
+  }
+  *len = j;
+
+  return buf;
+}
+
+static gchar *
+melo_file_tags_id3v2_text (guint8 encoding, const guint8 *data, gsize size,
+                           gsize *used)
+{
+  const gchar *codeset;
+  gsize len = 0;
+
+  /* Find string end */
+  if (encoding == 1 || encoding == 2) {
+    while (len + 1 < size && (data[len] || data[len + 1]))
+      len += 2;
+    if (used)
+      *used = MIN (len + 2, size);
+  } else {
+    while (len < size && data[len])
+      len++;
+    if (used)
+      *used = MIN (len + 1, size);
+  }
+
+  /* Convert to UTF-8 */
+  switch (encoding) {
+    case 0:
+      codeset = "ISO-8859-1";
+      break;
+    case 1:
+      /* Get byte order from BOM */
+      codeset = "UTF-16LE";
+      if (len >= 2 && data[0] == 0xfe && data[1] == 0xff)
+        codeset = "UTF-16BE";
+      if (len >= 2 && ((data[0] == 0xfe && data[1] == 0xff) ||
+                       (data[0] == 0xff && data[1] == 0xfe))) {
+        data += 2;
+        len -= 2;
+      }
+      break;
+    case 2:
+      codeset = "UTF-16BE";
+      break;
+    case 3:
+      return g_strndup ((const gchar *) data, len);
+    default:
+      return NULL;
+  }
+
+  return g_convert ((const gchar *) data, len, "UTF-8", codeset, NULL, NULL,
+                    NULL);
+}
+
+static void
+melo_file_tags_id3v2_genre (MeloFileTagsContext *ctx, const gchar *value)
+{
+  const gchar *genre = value;
+  gchar *end;
+  guint64 id;
+
+  /* Genre can be "(id)", "(id)name" or "id" */
+  if (*value == '(' && g_ascii_isdigit (value[1])) {
+    id = g_ascii_strtoull (value + 1, &end, 10);
+    if (*end == ')')
+      genre = end[1] != '\0' ? end + 1 : melo_file_tags_get_genre (id);
+  } else if (g_ascii_isdigit (*value)) {
+    id = g_ascii_strtoull (value, &end, 10);
+    if (*end == '\0')
+      genre = melo_file_tags_get_genre (id);
+  }
+
+  melo_file_tags_set (ctx, MELO_TAGS_FIELDS_GENRE, genre);
+}
+
+static void
+melo_file_tags_id3v2_picture (MeloFileTagsContext *ctx, guint version,
+                              const guint8 *data, gsize size)
+{
+  gsize pos, used;
+  guint8 type;
+  gchar *desc;
+
+  if (!(ctx->fields & MELO_TAGS_FIELDS_COVER) || size < 2)
+    return;
+
+  /* Skip image format (ID3v2.2) or MIME type */
+  if (version == 2) {
+    pos = 4;
+  } else {
+    pos = 1;
+    while (pos < size && data[pos])
+      pos++;
+    pos++;
+  }
+  if (pos >= size)
+    return;
+
+  /* Skip description */
+  type = data[pos++];
+  desc = melo_file_tags_id3v2_text (data[0], data + pos, size - pos, &used);
+  g_free (desc);
+  pos += used;
+  if (pos >= size)
+    return;
+
+  melo_file_tags_set_cover (ctx, g_bytes_new (data + pos, size - pos), type);
+}
+
+static void
+melo_file_tags_id3v2_frame (MeloFileTagsContext *ctx, guint version,
+                            const guint8 *id, guint16 flags,
+                            const guint8 *data, gsize size)
+{
+  static const struct {
+    const gchar *id;
+    MeloTagsFields field;
+  } frames[] = {
+    { "TT2", MELO_TAGS_FIELDS_TITLE },
+    { "TP1", MELO_TAGS_FIELDS_ARTIST },
+    { "TAL", MELO_TAGS_FIELDS_ALBUM },
+    { "TCO", MELO_TAGS_FIELDS_GENRE },
+    { "TYE", MELO_TAGS_FIELDS_DATE },
+    { "TRK", MELO_TAGS_FIELDS_TRACK },
+    { "PIC", MELO_TAGS_FIELDS_COVER },
+    { "TIT2", MELO_TAGS_FIELDS_TITLE },
+    { "TPE1", MELO_TAGS_FIELDS_ARTIST },
+    { "TALB", MELO_TAGS_FIELDS_ALBUM },
+    { "TCON", MELO_TAGS_FIELDS_GENRE },
+    { "TYER", MELO_TAGS_FIELDS_DATE },
+    { "TDRC", MELO_TAGS_FIELDS_DATE },
+    { "TRCK", MELO_TAGS_FIELDS_TRACK },
+    { "APIC", MELO_TAGS_FIELDS_COVER },
+  };
+  guint id_len = version == 2 ? 3 : 4;
+  MeloTagsFields field = MELO_TAGS_FIELDS_NONE;
+  guint8 *buf = NULL;
+  gchar *value;
+  guint i;
+
+  /* Find frame */
+  for (i = 0; i < G_N_ELEMENTS (frames); i++) {
+    if (strlen (frames[i].id) == id_len && !memcmp (id, frames[i].id, id_len)) {
+      field = frames[i].field;
+      break;
+    }
+  }
+  if (!(ctx->fields & field))
+    return;
+
+  /* Compressed and encrypted frames are not supported */
+  if ((version == 3 && flags & 0x00c0) || (version == 4 && flags & 0x000c))
+    return;
+
+  /* Skip data length indicator and remove unsynchronisation */
+  if (version == 4) {
+    if (flags & 0x0001) {
+      if (size < 4)
+        return;
+      data += 4;
+      size -= 4;
+    }
+    if (flags & 0x0002)
+      data = buf = melo_file_tags_id3v2_unsync (data, size, &size);
+  }
+
+  /* Parse frame */
+  if (field == MELO_TAGS_FIELDS_COVER) {
+    melo_file_tags_id3v2_picture (ctx, version, data, size);
+  } else if (size > 1) {
+    value = melo_file_tags_id3v2_text (data[0], data + 1, size - 1, NULL);
+    if (value) {
+      if (field == MELO_TAGS_FIELDS_GENRE)
+        melo_file_tags_id3v2_genre (ctx, value);
+      else
+        melo_file_tags_set (ctx, field, value);
+      g_free (value);
+    }
+  }
+  g_free (buf);
+}
+
+static gboolean
+melo_file_tags_parse_id3v2 (MeloFileTagsContext *ctx, const guint8 *data,
+                            gsize size, gsize *tag_size)
+{
+  guint version, hdr_len;
+  guint8 *buf = NULL;
+  gsize len, pos = 0;
+  guint8 flags;
+
+  /* Parse header */
+  if (size < 10 || memcmp (data, "ID3", 3))
+    return FALSE;
+  version = data[3];
+  flags = data[5];
+  len = melo_file_tags_syncsafe (data + 6);
+  if (version < 2 || version > 4 || len > size - 10)
+    return FALSE;
+  *tag_size = 10 + len + (version == 4 && flags & 0x10 ? 10 : 0);
+  data += 10;
+
+  /* Remove unsynchronisation of whole tag */
+  if (version < 4 && flags & 0x80)
+    data = buf = melo_file_tags_id3v2_unsync (data, len, &len);
+
+  /* Skip extended header */
+  if (version > 2 && flags & 0x40) {
+    if (len < 4)
+      goto end;
+    pos = version == 3 ? melo_file_tags_be32 (data) + 4 :
+                         melo_file_tags_syncsafe (data);
+  }
+
+  /* Parse frames */
+  hdr_len = version == 2 ? 6 : 10;
+  while (pos < len && len - pos >= hdr_len && data[pos]) {
+    const guint8 *frame = data + pos;
+    guint16 frame_flags = 0;
+    gsize frame_len;
+
+    /* Get frame size and flags */
+    if (version == 2) {
+      frame_len = melo_file_tags_be32 (frame + 2) & 0xffffff;
+    } else {
+      if (version == 3)
+        frame_len = melo_file_tags_be32 (frame + 4);
+      else
+        frame_len = melo_file_tags_syncsafe (frame + 4);
+      frame_flags = (frame[8] << 8) | frame[9];
+    }
+    pos += hdr_len;
+    if (frame_len > len - pos)
+      break;
+
+    melo_file_tags_id3v2_frame (ctx, version, frame, frame_flags, data + pos,
+                                frame_len);
+    pos += frame_len;
+  }
+
+end:
+  g_free (buf);
+  return TRUE;
+}
+
+static gchar *
+melo_file_tags_id3v1_text (const guint8 *data, gsize size)
+{
+  gsize len = 0;
+
+  /* Strings are padded with zeros or spaces */
+  while (len < size && data[len])
+    len++;
+  while (len && data[len - 1] == ' ')
+    len--;
+
+  return g_convert ((const gchar *) data, len, "UTF-8", "ISO-8859-1", NULL,
+                    NULL, NULL);
+}
+
+static gboolean
+melo_file_tags_parse_id3v1 (MeloFileTagsContext *ctx, const guint8 *data,
+                            gsize size)
+{
+  gchar *value;
+
+  if (size < 128 || memcmp (data + size - 128, "TAG", 3))
+    return FALSE;
+  data += size - 128;
+
+  /* Title, artist and album */
+  value = melo_file_tags_id3v1_text (data + 3, 30);
+  melo_file_tags_set (ctx, MELO_TAGS_FIELDS_TITLE, value);
+  g_free (value);
+  value = melo_file_tags_id3v1_text (data + 33, 30);
+  melo_file_tags_set (ctx, MELO_TAGS_FIELDS_ARTIST, value);
+  g_free (value);
+  value = melo_file_tags_id3v1_text (data + 63, 30);
+  melo_file_tags_set (ctx, MELO_TAGS_FIELDS_ALBUM, value);
+  g_free (value);
+
+  /* Year */
+  value = melo_file_tags_id3v1_text (data + 93, 4);
+  melo_file_tags_set (ctx, MELO_TAGS_FIELDS_DATE, value);
+  g_free (value);
+
+  /* Track (ID3v1.1) and genre */
+  if (!data[125] && data[126] && ctx->fields & MELO_TAGS_FIELDS_TRACK &&
+      !ctx->tags->track)
+    ctx->tags->track = data[126];
+  melo_file_tags_set (ctx, MELO_TAGS_FIELDS_GENRE,
+                      melo_file_tags_get_genre (data[127]));
+
+  return TRUE;
+}
+
+/* MPEG audio */
+static const guint16 melo_file_tags_mpeg_bitrates[2][16] = {
+  { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0 },
+  { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 },
+};
+
+static const guint16 melo_file_tags_mpeg_rates[3] = { 44100, 48000, 32000 };
+
+static void
+melo_file_tags_parse_mpeg (MeloFileTagsContext *ctx, const guint8 *data,
+                           gsize size)
+{
+  guint version, bitrate, rate, mode, side;
+  guint64 frames = 0, samples;
+  const guint8 *xing;
+  gsize pos;
+
+  /* Find first frame of MPEG-1 / 2 / 2.5 Layer III */
+  for (pos = 0; pos + 4 <= size && pos < MELO_FILE_TAGS_MPEG_SYNC_MAX; pos++) {
+    if (data[pos] == 0xff && (data[pos + 1] & 0xe6) == 0xe2 &&
+        (data[pos + 1] & 0x18) != 0x08 && (data[pos + 2] & 0xf0) != 0xf0 &&
+        (data[pos + 2] & 0x0c) != 0x0c)
+      break;
+  }
+  if (pos + 4 > size || pos >= MELO_FILE_TAGS_MPEG_SYNC_MAX)
+    return;
+  data += pos;
+  size -= pos;
+
+  /* Parse frame header: version 3 is MPEG-1, 2 is MPEG-2 and 0 is MPEG-2.5 */
+  version = (data[1] >> 3) & 0x03;
+  bitrate = melo_file_tags_mpeg_bitrates[version != 3][data[2] >> 4];
+  rate = melo_file_tags_mpeg_rates[(data[2] >> 2) & 0x03];
+  rate >>= version == 3 ? 0 : version == 2 ? 1 : 2;
+  mode = data[3] >> 6;
+  samples = version == 3 ? 1152 : 576;
+
+  ctx->info.codec = MELO_FILE_TAGS_CODEC_MP3;
+  ctx->info.rate = rate;
+  ctx->info.channels = mode == 3 ? 1 : 2;
+
+  /* Find Xing / Info header after side information of first frame */
+  if (version == 3)
+    side = mode == 3 ? 17 : 32;
+  else
+    side = mode == 3 ? 9 : 17;
+  xing = data + 4 + side;
+  if (size >= 4 + side + 12 &&
+      (!memcmp (xing, "Xing", 4) || !memcmp (xing, "Info", 4)) &&
+      xing[7] & 0x01)
+    frames = melo_file_tags_be32 (xing + 8);
+
+  /* Get duration from frame count (VBR) or from bitrate (CBR) */
+  if (frames)
+    ctx->info.duration = frames * samples * 1000 / rate;
+  else if (bitrate) {
+    ctx->info.bitrate = bitrate * 1000;
+    ctx->info.duration = (guint64) size * 8 / bitrate;
+  }
+}
+
+/* MP4 */
+static gboolean
+melo_file_tags_mp4_next (const guint8 *data, gsize size, gsize *pos,
+                         const guint8 **type, const guint8 **payload,
+                         gsize *len)
+{
+  guint64 atom_len;
+  gsize hdr = 8;
+
+  if (size - *pos < 8)
+    return FALSE;
+
+  /* Get atom size */
+  atom_len = melo_file_tags_be32 (data + *pos);
+  if (atom_len == 1) {
+    if (size - *pos < 16)
+      return FALSE;
+    atom_len = ((guint64) melo_file_tags_be32 (data + *pos + 8) << 32) |
+               melo_file_tags_be32 (data + *pos + 12);
+    hdr = 16;
+  } else if (!atom_len) {
+    atom_len = size - *pos;
+  }
+  if (atom_len < hdr || atom_len > size - *pos)
+    return FALSE;
+
+  /* Get atom */
+  *type = data + *pos + 4;
+  *payload = data + *pos + hdr;
+  *len = atom_len - hdr;
+  *pos += atom_len;
+
+  return TRUE;
+}
+
+static const guint8 *
+melo_file_tags_mp4_find (const guint8 *data, gsize size, const gchar *name,
+                         gsize *len)
+{
+  const guint8 *type, *payload;
+  gsize pos = 0;
+
+  while (melo_file_tags_mp4_next (data, size, &pos, &type, &payload, len))
+    if (!memcmp (type, name, 4))
+      return payload;
+
+  return NULL;
+}
+
+static void
+melo_file_tags_mp4_item (MeloFileTagsContext *ctx, const guint8 *type,
+                         const guint8 *data, gsize size)
+{
+  MeloTagsFields field = MELO_TAGS_FIELDS_NONE;
+  const guint8 *value;
+  gchar *str;
+  gsize len;
+
+  /* Get item value */
+  value = melo_file_tags_mp4_find (data, size, "data", &len);
+  if (!value || len < 8)
+    return;
+  value += 8;
+  len -= 8;
+
+  /* Binary items */
+  if (!memcmp (type, "trkn", 4)) {
+    if (len >= 6) {
+      if (ctx->fields & MELO_TAGS_FIELDS_TRACK && !ctx->tags->track)
+        ctx->tags->track = (value[2] << 8) | value[3];
+      if (ctx->fields & MELO_TAGS_FIELDS_TRACKS && !ctx->tags->tracks)
+        ctx->tags->tracks = (value[4] << 8) | value[5];
+    }
+    return;
+  } else if (!memcmp (type, "gnre", 4)) {
+    if (len >= 2 && ((value[0] << 8) | value[1]))
+      melo_file_tags_set (ctx, MELO_TAGS_FIELDS_GENRE,
+                          melo_file_tags_get_genre (
+                                              ((value[0] << 8) | value[1]) - 1));
+    return;
+  } else if (!memcmp (type, "covr", 4)) {
+    if (ctx->fields & MELO_TAGS_FIELDS_COVER)
+      melo_file_tags_set_cover (ctx, g_bytes_new (value, len),
+                                MELO_FILE_TAGS_FRONT_COVER);
+    return;
+  }
+
+  /* Text items */
+  if (!memcmp (type, "\251nam", 4))
+    field = MELO_TAGS_FIELDS_TITLE;
+  else if (!memcmp (type, "\251ART", 4))
+    field = MELO_TAGS_FIELDS_ARTIST;
+  else if (!memcmp (type, "\251alb", 4))
+    field = MELO_TAGS_FIELDS_ALBUM;
+  else if (!memcmp (type, "\251gen", 4))
+    field = MELO_TAGS_FIELDS_GENRE;
+  else if (!memcmp (type, "\251day", 4))
+    field = MELO_TAGS_FIELDS_DATE;
+  if (!(ctx->fields & field))
+    return;
+
+  str = g_strndup ((const gchar *) value, len);
+  melo_file_tags_set (ctx, field, str);
+  g_free (str);
+}
+
+static void
+melo_file_tags_mp4_info (MeloFileTagsContext *ctx, const guint8 *moov,
+                         gsize size)
+{
+  const guint8 *atom, *type, *trak;
+  guint64 duration;
+  guint32 scale;
+  gsize len, pos = 0;
+
+  /* Get duration from movie header */
+  atom = melo_file_tags_mp4_find (moov, size, "mvhd", &len);
+  if (atom && len >= 32) {
+    if (atom[0] == 1) {
+      scale = melo_file_tags_be32 (atom + 20);
+      duration = melo_file_tags_be64 (atom + 24);
+    } else {
+      scale = melo_file_tags_be32 (atom + 12);
+      duration = melo_file_tags_be32 (atom + 16);
+    }
+    if (scale)
+      ctx->info.duration = duration * 1000 / scale;
+  }
+
+  /* Get codec from sample description of first track:
+   * moov.trak.mdia.minf.stbl.stsd
+   */
+  while (melo_file_tags_mp4_next (moov, size, &pos, &type, &trak, &len)) {
+    if (memcmp (type, "trak", 4))
+      continue;
+    atom = melo_file_tags_mp4_find (trak, len, "mdia", &len);
+    if (atom)
+      atom = melo_file_tags_mp4_find (atom, len, "minf", &len);
+    if (atom)
+      atom = melo_file_tags_mp4_find (atom, len, "stbl", &len);
+    if (atom)
+      atom = melo_file_tags_mp4_find (atom, len, "stsd", &len);
+
+    /* Audio sample entry: 8 bytes of stsd header, then entry header */
+    if (!atom || len < 44)
+      continue;
+    atom += 8;
+    if (!memcmp (atom + 4, "mp4a", 4))
+      ctx->info.codec = MELO_FILE_TAGS_CODEC_AAC;
+    else if (!memcmp (atom + 4, "alac", 4))
+      ctx->info.codec = MELO_FILE_TAGS_CODEC_ALAC;
+    else
+      continue;
+    ctx->info.channels = melo_file_tags_be16 (atom + 24);
+    ctx->info.rate = melo_file_tags_be16 (atom + 32);
+    break;
+  }
+}
+
+static gboolean
+melo_file_tags_parse_mp4 (MeloFileTagsContext *ctx, const guint8 *data,
+                          gsize size)
+{
+  const guint8 *moov, *udta, *meta, *ilst, *type, *payload;
+  gsize len, udta_len, ilst_len, pos = 0;
+
+  if (size < 12 || memcmp (data + 4, "ftyp", 4))
+    return FALSE;
+
+  /* Find movie header */
+  moov = melo_file_tags_mp4_find (data, size, "moov", &len);
+  if (!moov)
+    return FALSE;
+
+  /* Get stream details */
+  melo_file_tags_mp4_info (ctx, moov, len);
+
+  /* Find metadata: moov.udta.meta (or moov.meta) */
+  udta = melo_file_tags_mp4_find (moov, len, "udta", &udta_len);
+  if (udta)
+    meta = melo_file_tags_mp4_find (udta, udta_len, "meta", &len);
+  else
+    meta = melo_file_tags_mp4_find (moov, len, "meta", &len);
+  if (!meta || len < 4)
+    return TRUE;
+
+  /* Find item list (after version and flags of meta) */
+  ilst = melo_file_tags_mp4_find (meta + 4, len - 4, "ilst", &ilst_len);
+  if (!ilst)
+    return TRUE;
+
+  /* Parse items */
+  while (melo_file_tags_mp4_next (ilst, ilst_len, &pos, &type, &payload, &len))
+    melo_file_tags_mp4_item (ctx, type, payload, len);
+
+  return TRUE;
+}
+
+/**
+ * melo_file_tags_new_from_uri:
+ * @uri: the URI of a local file
+ * @fields: the tags to read
+ * @persist: cover data persistence option
+ * @info: (out) (allow-none): the stream details, or %NULL
+ *
+ * Read tags from a local audio file without using GStreamer. Only the
+ * metadata blocks of the file are read. Stream details which are not found
+ * are set to 0.
+ *
+ * Returns: (transfer full): a new #MeloTags or %NULL if the file is not a
+ * local file or its format is not supported. After use, call
+ * melo_tags_unref().
+ */
+MeloTags *
+melo_file_tags_new_from_uri (const gchar *uri, MeloTagsFields fields,
+                             MeloTagsCoverPersist persist,
+                             MeloFileDBInfo *info)
+{
+  MeloFileTagsContext ctx = { 0 };
+  gboolean ret = FALSE;
+  gsize size, skip = 0;
+  const guint8 *data;
+  GMappedFile *map;
+  gchar *filename;
+
+  /* Only local files are supported */
+  filename = g_filename_from_uri (uri, NULL, NULL);
+  if (!filename)
+    return NULL;
+
+  /* Map file in memory */
+  map = g_mapped_file_new (filename, FALSE, NULL);
+  g_free (filename);
+  if (!map)
+    return NULL;
+  data = (const guint8 *) g_mapped_file_get_contents (map);
+  size = g_mapped_file_get_length (map);
+  if (!data || !size) {
+    g_mapped_file_unref (map);
+    return NULL;
+  }
+
+  /* Create new tags */
+  ctx.tags = melo_tags_new ();
+  ctx.fields = fields;
+
+  /* Parse metadata */
+  if (melo_file_tags_parse_id3v2 (&ctx, data, size, &skip)) {
+    /* FLAC can start with an ID3v2 tag */
+    if (skip < size &&
+        !melo_file_tags_parse_flac (&ctx, data + skip, size - skip))
+      melo_file_tags_parse_mpeg (&ctx, data + skip, size - skip);
+    melo_file_tags_parse_id3v1 (&ctx, data, size);
+    ret = TRUE;
+  } else if (melo_file_tags_parse_flac (&ctx, data, size) ||
+             melo_file_tags_parse_ogg (&ctx, data, size) ||
+             melo_file_tags_parse_mp4 (&ctx, data, size)) {
+    ret = TRUE;
+  } else if (size >= 2 && data[0] == 0xff && (data[1] & 0xe0) == 0xe0) {
+    /* MPEG audio with only an ID3v1 tag */
+    ret = melo_file_tags_parse_id3v1 (&ctx, data, size);
+    if (ret)
+      melo_file_tags_parse_mpeg (&ctx, data, size);
+  }
+
+  /* Get average bitrate from file size */
+  if (ret && !ctx.info.bitrate && ctx.info.duration > 0)
+    ctx.info.bitrate = (guint64) (size - skip) * 8000 / ctx.info.duration;
+
+  /* Set cover */
+  if (ctx.cover) {
+    if (ret)
+      melo_tags_set_cover_by_data (ctx.tags, ctx.cover, persist);
+    g_bytes_unref (ctx.cover);
+  }
+  g_mapped_file_unref (map);
+
+  /* Format not supported */
+  if (!ret) {
+    melo_tags_unref (ctx.tags);
+    return NULL;
+  }
+
+  /* Set stream details */
+  if (info)
+    *info = ctx.info;
+
+  return ctx.tags;
+}
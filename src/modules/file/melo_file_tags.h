@@ -0,0 +1,37 @@
+/*
+ * melo_file_tags.h: Native tags reader for common audio files
+ *
+ * Copyright (C) 2016 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __MELO_FILE_TAGS_H__
+#define __MELO_FILE_TAGS_H__
+
+#include <glib.h>
+
+#include "melo_tags.h"
+#include "melo_file_db.h"
+
+/* Read tags and stream details of a local MP3, FLAC, Ogg Vorbis / Opus or MP4
+ * file
+ */
+MeloTags *melo_file_tags_new_from_uri (const gchar *uri, MeloTagsFields fields,
+                                       MeloTagsCoverPersist persist,
+                                       MeloFileDBInfo *info);
+
+#endif /* __MELO_FILE_TAGS_H__ */
@@ -24,6 +24,7 @@
 #include <string.h>
 
 #include "melo_file_utils.h"
+#include "melo_playlist_simple.h"
 
 #include "melo_library_file.h"
 
@@ -36,7 +37,7 @@ static MeloBrowserInfo melo_library_file_info = {
   .description = "Navigate though whole media library",
   /* Search support */
   .search_support = TRUE,
-  .search_hint_support = FALSE,
+  .search_hint_support = TRUE,
   .search_input_text = "Search a media by title, artist or album...",
   .search_button_text = "Search",
   /* Tags support */
@@ -51,6 +52,8 @@ static MeloBrowserList *melo_library_file_get_list (MeloBrowser *browser,
 static MeloBrowserList *melo_library_file_search (MeloBrowser *browser,
                                          const gchar *input,
                                          const MeloBrowserSearchParams *params);
+static gchar *melo_library_file_search_hint (MeloBrowser *browser,
+                                             const gchar *input);
 static MeloTags *melo_library_file_get_tags (MeloBrowser *browser,
                                              const gchar *path,
                                              MeloTagsFields fields);
@@ -70,6 +73,12 @@ typedef struct _MeloLibraryFileParse {
   MeloFileDBFields filter;
 } MeloLibraryFileParse;
 
+typedef struct _MeloLibraryFileFeed {
+  MeloLibraryFile *lfile;
+  MeloLibraryFileParse parse[MELO_LIBRARY_FILE_PARSE_COUNT_MAX];
+  MeloSort sort;
+} MeloLibraryFileFeed;
+
 G_DEFINE_TYPE_WITH_PRIVATE (MeloLibraryFile, melo_library_file, MELO_TYPE_BROWSER)
 
 static void
@@ -95,6 +104,7 @@ melo_library_file_class_init (MeloLibraryFileClass *klass)
   bclass->get_info = melo_library_file_get_info;
   bclass->get_list = melo_library_file_get_list;
   bclass->search = melo_library_file_search;
+  bclass->search_hint = melo_library_file_search_hint;
   bclass->get_tags = melo_library_file_get_tags;
   bclass->action = melo_library_file_action;
 
@@ -198,7 +208,7 @@ static gboolean
 melo_library_file_gen (const gchar *path, const gchar *file, gint id,
                        MeloFileDBType type, MeloTags *tags, gpointer user_data)
 {
-  GList **list = (GList **) user_data;
+  MeloBrowserList *list = user_data;
   MeloBrowserItemType item_type;
   const gchar *type_name = "";
   const gchar *name = NULL;
@@ -229,14 +239,14 @@ melo_library_file_gen (const gchar *path, const gchar *file, gint id,
       return FALSE;
   }
 
-  /* Create MeloBrowserItem */
-  item = melo_browser_item_new (NULL, item_type);
-  item->id = g_strdup_printf ("%d%s", id, type_name);
-  item->name = g_strdup (name);
+  /* Create MeloBrowserItem in list arena */
+  item = melo_browser_list_new_item (list, NULL, item_type);
+  item->id = melo_browser_list_strdup_printf (list, "%d%s", id, type_name);
+  item->name = melo_browser_list_strdup (list, name);
   item->tags = tags;
   item->actions = MELO_BROWSER_ITEM_ACTION_FIELDS_ADD |
                   MELO_BROWSER_ITEM_ACTION_FIELDS_PLAY;
-  *list = g_list_prepend (*list, item);
+  melo_browser_list_prepend (list, item);
 
   return TRUE;
 }
@@ -260,8 +270,8 @@ melo_library_file_get_list (MeloBrowser *browser, const gchar *path,
   if (!path || *path != '/')
     return NULL;
 
-  /* Create browser list */
-  list = melo_browser_list_new (path++);
+  /* Create browser list: items are allocated from its arena */
+  list = melo_browser_list_new_with_arena (path++);
   if (!list)
     return NULL;
 
@@ -270,24 +280,29 @@ melo_library_file_get_list (MeloBrowser *browser, const gchar *path,
     /* Root path: "/" */
 
     /* Add song entry to browse by song */
-    item = melo_browser_item_new ("song", MELO_BROWSER_ITEM_TYPE_CATEGORY);
-    item->name = g_strdup ("Song");
-    list->items = g_list_append(list->items, item);
+    item = melo_browser_list_new_item (list, "song",
+                                       MELO_BROWSER_ITEM_TYPE_CATEGORY);
+    item->name = melo_browser_list_strdup (list, "Song");
+    melo_browser_list_prepend (list, item);
 
     /* Add artist entry to browse by artist */
-    item = melo_browser_item_new ("artist", MELO_BROWSER_ITEM_TYPE_CATEGORY);
-    item->name = g_strdup ("Artist");
-    list->items = g_list_append(list->items, item);
+    item = melo_browser_list_new_item (list, "artist",
+                                       MELO_BROWSER_ITEM_TYPE_CATEGORY);
+    item->name = melo_browser_list_strdup (list, "Artist");
+    melo_browser_list_prepend (list, item);
 
     /* Add album entry to browse by album */
-    item = melo_browser_item_new ("album", MELO_BROWSER_ITEM_TYPE_CATEGORY);
-    item->name = g_strdup ("Album");
-    list->items = g_list_append(list->items, item);
+    item = melo_browser_list_new_item (list, "album",
+                                       MELO_BROWSER_ITEM_TYPE_CATEGORY);
+    item->name = melo_browser_list_strdup (list, "Album");
+    melo_browser_list_prepend (list, item);
 
     /* Add genre entry to browse by genre */
-    item = melo_browser_item_new ("genre", MELO_BROWSER_ITEM_TYPE_CATEGORY);
-    item->name = g_strdup ("Genre");
-    list->items = g_list_append(list->items, item);
+    item = melo_browser_list_new_item (list, "genre",
+                                       MELO_BROWSER_ITEM_TYPE_CATEGORY);
+    item->name = melo_browser_list_strdup (list, "Genre");
+    melo_browser_list_prepend (list, item);
+    list->items = g_list_reverse (list->items);
 
     return list;
   }
@@ -313,17 +328,17 @@ melo_library_file_get_list (MeloBrowser *browser, const gchar *path,
   }
 
   /* Generate list */
-  if (!melo_file_db_get_list (priv->fdb, obj, melo_library_file_gen,
-                              &list->items, params->offset, params->count, sort,
-                              FALSE, type, tags_fields,
-                              parse[0].filter, parse[0].id,
-                              parse[1].filter, parse[1].id,
-                              parse[2].filter, parse[2].id,
-                              MELO_FILE_DB_FIELDS_END))
+  if (!melo_file_db_get_list_with_token (priv->fdb, obj, melo_library_file_gen,
+                                         list, params->token,
+                                         &list->next_token, params->offset,
+                                         params->count, sort, FALSE, type,
+                                         tags_fields,
+                                         parse[0].filter, parse[0].id,
+                                         parse[1].filter, parse[1].id,
+                                         parse[2].filter, parse[2].id,
+                                         MELO_FILE_DB_FIELDS_END))
     goto error;
 
-
-
   /* Reverse final list */
   list->items = g_list_reverse (list->items);
 
@@ -342,26 +357,53 @@ melo_library_file_search (MeloBrowser *browser, const gchar *input,
   MeloLibraryFilePrivate *priv = lfile->priv;
   GObject *obj = G_OBJECT (lfile);
   MeloBrowserList *list;
+  MeloSort sort;
+  gchar *query;
 
   /* Check path */
   if (!input)
     return NULL;
 
-  /* Create browser list */
-  list = melo_browser_list_new ("/song/");
+  /* Create browser list: items are allocated from its arena */
+  list = melo_browser_list_new_with_arena ("/song/");
   if (!list)
     return NULL;
 
-  melo_file_db_get_list (priv->fdb, obj, melo_library_file_gen, &list->items,
-                         params->offset, params->count, params->sort, TRUE,
-                         MELO_FILE_DB_TYPE_SONG, params->tags_fields,
-                         MELO_FILE_DB_FIELDS_TITLE, input,
-                         MELO_FILE_DB_FIELDS_FILE, input,
-                         MELO_FILE_DB_FIELDS_END);
+  /* Match words of input as prefixes */
+  query = melo_file_db_build_prefix_query (input);
+  if (!query)
+    return list;
+
+  /* Sort by relevance by default */
+  sort = params->sort != MELO_SORT_NONE ? params->sort : MELO_SORT_RELEVANT;
+
+  melo_file_db_get_list_with_token (priv->fdb, obj, melo_library_file_gen,
+                                    list, params->token,
+                                    &list->next_token, params->offset,
+                                    params->count, sort, TRUE,
+                                    MELO_FILE_DB_TYPE_SONG, params->tags_fields,
+                                    MELO_FILE_DB_FIELDS_TITLE, query,
+                                    MELO_FILE_DB_FIELDS_FILE, query,
+                                    MELO_FILE_DB_FIELDS_ARTIST, query,
+                                    MELO_FILE_DB_FIELDS_ALBUM, query,
+                                    MELO_FILE_DB_FIELDS_END);
+  g_free (query);
+
+  /* Reverse final list */
+  list->items = g_list_reverse (list->items);
 
   return list;
 }
 
+static gchar *
+melo_library_file_search_hint (MeloBrowser *browser, const gchar *input)
+{
+  MeloLibraryFile *lfile = MELO_LIBRARY_FILE (browser);
+
+  /* Complete last word from library */
+  return melo_file_db_get_hint (lfile->priv->fdb, input);
+}
+
 static MeloTags *
 melo_library_file_get_tags (MeloBrowser *browser, const gchar *path,
                             MeloTagsFields fields)
@@ -391,8 +433,7 @@ melo_library_file_add_cb (const gchar *path, const gchar *file, gint id,
                           MeloFileDBType type, MeloTags *tags,
                           gpointer user_data)
 {
-  MeloPlayer *player = (MeloPlayer *) user_data;
-  gboolean ret;
+  GList **items = (GList **) user_data;
   gchar *uri;
 
   /* Generate URI */
@@ -406,11 +447,25 @@ melo_library_file_add_cb (const gchar *path, const gchar *file, gint id,
     return FALSE;
   }
 
-  /* Add media */
-  ret = melo_player_add (player, uri, file, tags);
+  /* Add media to list: all medias are added to player at once */
+  *items = g_list_prepend (*items, melo_playlist_item_new (NULL, file, uri,
+                                                           tags));
   melo_tags_unref (tags);
   g_free (uri);
 
+  return TRUE;
+}
+
+static gboolean
+melo_library_file_add_list (MeloPlayer *player, GList *items)
+{
+  gboolean ret;
+
+  /* Add all medias to player */
+  items = g_list_reverse (items);
+  ret = melo_player_add_many (player, items);
+  g_list_free_full (items, (GDestroyNotify) melo_playlist_item_unref);
+
   return ret;
 }
 
@@ -424,6 +479,8 @@ melo_library_file_add (MeloBrowser *browser, const gchar *path,
   MeloLibraryFilePrivate *priv = lfile->priv;
   GObject *obj = G_OBJECT (browser);
   guint media_count = -1;
+  GList *items = NULL;
+  gboolean ret;
 
   /* Parse path */
   count = melo_library_file_parse (path, parse, count);
@@ -434,17 +491,21 @@ melo_library_file_add (MeloBrowser *browser, const gchar *path,
   if (parse[count-1].type == MELO_FILE_DB_TYPE_SONG && parse[count-1].id)
     media_count = 1;
 
+  /* Get media(s) */
+  ret = melo_file_db_get_list (priv->fdb, obj, melo_library_file_add_cb,
+                               &items, 0, media_count, params->sort,
+                               FALSE, MELO_FILE_DB_TYPE_FILE,
+                               MELO_TAGS_FIELDS_FULL,
+                               parse[0].filter, parse[0].id,
+                               parse[1].filter, parse[1].id,
+                               parse[2].filter, parse[2].id,
+                               MELO_FILE_DB_FIELDS_END);
+
   /* Add media(s) to playlist */
-  return melo_file_db_get_list (priv->fdb, obj, melo_library_file_add_cb,
-                                browser->player, 0, media_count, params->sort,
-                                FALSE, MELO_FILE_DB_TYPE_FILE,
-                                MELO_TAGS_FIELDS_FULL,
-                                parse[0].filter, parse[0].id,
-                                parse[1].filter, parse[1].id,
-                                parse[2].filter, parse[2].id,
-                                MELO_FILE_DB_FIELDS_END);
+  if (items && !melo_library_file_add_list (browser->player, items))
+    ret = FALSE;
 
-  return FALSE;
+  return ret;
 }
 
 static gboolean
@@ -475,6 +536,33 @@ melo_library_file_play_cb (const gchar *path, const gchar *file, gint id,
   return ret;
 }
 
+static GList *
+melo_library_file_feed (guint offset, guint count, gpointer user_data)
+{
+  MeloLibraryFileFeed *feed = user_data;
+  MeloLibraryFileParse *parse = feed->parse;
+  GList *items = NULL;
+
+  /* Get next medias after the first one played */
+  melo_file_db_get_list (feed->lfile->priv->fdb, G_OBJECT (feed->lfile),
+                         melo_library_file_add_cb, &items, offset + 1, count,
+                         feed->sort, FALSE, MELO_FILE_DB_TYPE_FILE,
+                         MELO_TAGS_FIELDS_FULL,
+                         parse[0].filter, parse[0].id,
+                         parse[1].filter, parse[1].id,
+                         parse[2].filter, parse[2].id,
+                         MELO_FILE_DB_FIELDS_END);
+
+  return g_list_reverse (items);
+}
+
+static void
+melo_library_file_feed_free (MeloLibraryFileFeed *feed)
+{
+  g_object_unref (feed->lfile);
+  g_slice_free (MeloLibraryFileFeed, feed);
+}
+
 static gboolean
 melo_library_file_play (MeloBrowser *browser, const gchar *path,
                         const MeloBrowserActionParams *params)
@@ -484,6 +572,9 @@ melo_library_file_play (MeloBrowser *browser, const gchar *path,
   MeloLibraryFile *lfile = MELO_LIBRARY_FILE (browser);
   MeloLibraryFilePrivate *priv = lfile->priv;
   GObject *obj = G_OBJECT (browser);
+  MeloPlaylist *playlist = NULL;
+  MeloLibraryFileFeed *feed;
+  GList *items = NULL;
   gboolean ret;
 
   /* Parse path */
@@ -491,6 +582,10 @@ melo_library_file_play (MeloBrowser *browser, const gchar *path,
   if (count <= 0)
     return FALSE;
 
+  /* Get playlist of player */
+  if (browser->player)
+    playlist = browser->player->playlist;
+
   /* Play first media */
   ret = melo_file_db_get_list (priv->fdb, obj, melo_library_file_play_cb,
                                browser->player, 0, 1, params->sort, FALSE,
@@ -500,15 +595,29 @@ melo_library_file_play (MeloBrowser *browser, const gchar *path,
                                parse[2].filter, parse[2].id,
                                MELO_FILE_DB_FIELDS_END);
 
-  /* Add other media to playlist */
-  if (parse[count-1].type != MELO_FILE_DB_TYPE_SONG || !parse[count-1].id)
+  /* Add other media to playlist progressively */
+  if ((parse[count-1].type != MELO_FILE_DB_TYPE_SONG || !parse[count-1].id) &&
+      playlist && MELO_IS_PLAYLIST_SIMPLE (playlist)) {
+    feed = g_slice_new (MeloLibraryFileFeed);
+    feed->lfile = g_object_ref (lfile);
+    memcpy (feed->parse, parse, sizeof (parse));
+    feed->sort = params->sort;
+    melo_playlist_simple_set_feed (MELO_PLAYLIST_SIMPLE (playlist),
+                                   melo_library_file_feed, feed,
+                                   (GDestroyNotify) melo_library_file_feed_free);
+  } else if (parse[count-1].type != MELO_FILE_DB_TYPE_SONG ||
+             !parse[count-1].id) {
+    /* Add other media to playlist */
     ret = melo_file_db_get_list (priv->fdb, obj, melo_library_file_add_cb,
-                                 browser->player, 1, -1, params->sort, FALSE,
+                                 &items, 1, -1, params->sort, FALSE,
                                  MELO_FILE_DB_TYPE_FILE, MELO_TAGS_FIELDS_FULL,
                                  parse[0].filter, parse[0].id,
                                  parse[1].filter, parse[1].id,
                                  parse[2].filter, parse[2].id,
                                  MELO_FILE_DB_FIELDS_END);
+    if (items && !melo_library_file_add_list (browser->player, items))
+      ret = FALSE;
+  }
 
   return ret;
 }
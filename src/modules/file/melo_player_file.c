@@ -20,15 +20,61 @@
  */
 
 #include <gst/gst.h>
+#include <gst/controller/gstinterpolationcontrolsource.h>
+#include <gst/controller/gstdirectcontrolbinding.h>
 
 #include "melo_sink.h"
+#include "melo_sched.h"
+#include "melo_file_loudness.h"
 #include "melo_player_file.h"
 
+/* Next media is prepared some time before transition (in ms) */
+#define MELO_PLAYER_FILE_PRELOAD 5000
+
+#define MELO_PLAYER_FILE_DECKS 2
+
+/* Default loudness target (in LUFS) */
+#define MELO_PLAYER_FILE_LOUDNESS_TARGET -18.0
+
+typedef struct {
+  MeloPlayerFile *pfile;
+  guint index;
+
+  /* Decode branch */
+  GstElement *bin;
+  GstElement *src;
+  GstElement *queue;
+  GstElement *volume;
+  GstElement *filter;
+  GstControlSource *fade;
+  GstPad *pad;
+  GstPad *mixer_pad;
+  gulong block_id;
+
+  /* Stream state */
+  GstSegment segment;
+  GstClockTime running_end;
+  gint64 duration;
+  gboolean prepared;
+  gdouble gain;
+
+  /* Time to first audio of a prepared media */
+  gint64 load_start;
+  gint load_time;
+} MeloPlayerFileDeck;
+
 static gboolean bus_call (GstBus *bus, GstMessage *msg, gpointer data);
-static void pad_added_handler (GstElement *src, GstPad *pad, GstElement *sink);
+static void pad_added_handler (GstElement *src, GstPad *pad,
+                               MeloPlayerFileDeck *deck);
+static GstPadProbeReturn melo_player_file_probe (GstPad *pad,
+                                                 GstPadProbeInfo *info,
+                                                 gpointer user_data);
+static void melo_player_file_application (MeloPlayerFile *pfile,
+                                          const GstStructure *str);
 
 static gboolean melo_player_file_add (MeloPlayer *player, const gchar *path,
                                       const gchar *name, MeloTags *tags);
+static gboolean melo_player_file_add_many (MeloPlayer *player, GList *items);
 static gboolean melo_player_file_load (MeloPlayer *player, const gchar *path,
                                        const gchar *name, MeloTags *tags,
                                        gboolean insert, gboolean stopped);
@@ -51,22 +97,57 @@ struct _MeloPlayerFilePrivate {
   /* Status */
   gboolean load;
 
+  /* Loudness matching */
+  MeloFileDB *fdb;
+  gboolean loudness;
+  gdouble target;
+
+  /* Next media prepared for transition */
+  gchar *next_path;
+  gchar *next_id;
+  MeloTags *next_tags;
+
   /* Gstreamer pipeline */
   GstElement *pipeline;
-  GstElement *src;
+  GstElement *mixer;
   MeloSink *sink;
   guint bus_watch_id;
+
+  /* Decks: current one is playing and other one is prepared for next media.
+   * Switch between decks is done from streaming thread under deck_mutex.
+   */
+  MeloPlayerFileDeck decks[MELO_PLAYER_FILE_DECKS];
+  GMutex deck_mutex;
+  guint current;
+  gboolean next_ready;
+  gint crossfade;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (MeloPlayerFile, melo_player_file, MELO_TYPE_PLAYER)
 
 static void melo_player_file_constructed (GObject *object);
+static void melo_player_file_deck_reset (MeloPlayerFilePrivate *priv,
+                                         MeloPlayerFileDeck *deck);
+
+/* Must be called with player locked */
+static void
+melo_player_file_clear_next (MeloPlayerFilePrivate *priv)
+{
+  g_free (priv->next_path);
+  g_free (priv->next_id);
+  if (priv->next_tags)
+    melo_tags_unref (priv->next_tags);
+  priv->next_path = NULL;
+  priv->next_id = NULL;
+  priv->next_tags = NULL;
+}
 
 static void
 melo_player_file_finalize (GObject *gobject)
 {
   MeloPlayerFile *pfile = MELO_PLAYER_FILE (gobject);
   MeloPlayerFilePrivate *priv = melo_player_file_get_instance_private (pfile);
+  guint i;
 
   /* Stop pipeline */
   gst_element_set_state (priv->pipeline, GST_STATE_NULL);
@@ -74,13 +155,27 @@ melo_player_file_finalize (GObject *gobject)
   /* Remove message handler */
   g_source_remove (priv->bus_watch_id);
 
+  /* Release decks */
+  for (i = 0; i < MELO_PLAYER_FILE_DECKS; i++) {
+    melo_player_file_deck_reset (priv, &priv->decks[i]);
+    gst_object_unref (priv->decks[i].fade);
+  }
+
   /* Free gstreamer pipeline */
   g_object_unref (priv->pipeline);
 
   /* Free audio sink */
   g_object_unref (priv->sink);
 
+  /* Release media database */
+  if (priv->fdb)
+    g_object_unref (priv->fdb);
+
+  /* Free queued media */
+  melo_player_file_clear_next (priv);
+
   /* Free player mutex */
+  g_mutex_clear (&priv->deck_mutex);
   g_mutex_clear (&priv->mutex);
 
   /* Chain up to the parent class */
@@ -95,6 +190,7 @@ melo_player_file_class_init (MeloPlayerFileClass *klass)
 
   /* Control */
   pclass->add = melo_player_file_add;
+  pclass->add_many = melo_player_file_add_many;
   pclass->load = melo_player_file_load;
   pclass->play = melo_player_file_play;
   pclass->set_state = melo_player_file_set_state;
@@ -121,6 +217,190 @@ melo_player_file_init (MeloPlayerFile *self)
 
   /* Init player mutex */
   g_mutex_init (&priv->mutex);
+  g_mutex_init (&priv->deck_mutex);
+
+  /* Set default loudness target */
+  priv->target = MELO_PLAYER_FILE_LOUDNESS_TARGET;
+}
+
+static void
+melo_player_file_deck_set_fade (MeloPlayerFileDeck *deck, GstClockTime start,
+                                GstClockTime end, gdouble from, gdouble to)
+{
+  GstTimedValueControlSource *tvcs;
+
+  tvcs = GST_TIMED_VALUE_CONTROL_SOURCE (deck->fade);
+
+  /* Set volume ramp in stream time: constant when end is before start. The
+   * ramp is scaled by the deck gain, so each side of a crossfade keeps its own
+   * level.
+   */
+  gst_timed_value_control_source_unset_all (tvcs);
+  gst_timed_value_control_source_set (tvcs, start, from * deck->gain);
+  if (end > start)
+    gst_timed_value_control_source_set (tvcs, end, to * deck->gain);
+}
+
+static void
+melo_player_file_deck_init (MeloPlayerFile *pfile, MeloPlayerFileDeck *deck,
+                            guint index, const gchar *id)
+{
+  GstElement *convert, *resample;
+  GstPad *pad;
+  gchar *name;
+
+  /* Create decode branch: it is started only when a media is set */
+  name = g_strdup_printf ("%s_deck%u", id, index);
+  deck->pfile = pfile;
+  deck->index = index;
+  deck->bin = gst_bin_new (name);
+  deck->src = gst_element_factory_make ("uridecodebin", NULL);
+  deck->queue = gst_element_factory_make ("queue", NULL);
+  convert = gst_element_factory_make ("audioconvert", NULL);
+  resample = gst_element_factory_make ("audioresample", NULL);
+  deck->volume = gst_element_factory_make ("volume", NULL);
+  deck->filter = gst_element_factory_make ("capsfilter", NULL);
+  gst_bin_add_many (GST_BIN (deck->bin), deck->src, deck->queue, convert,
+                    resample, deck->volume, deck->filter, NULL);
+  gst_element_link_many (deck->queue, convert, resample, deck->volume,
+                         deck->filter, NULL);
+  gst_element_set_locked_state (deck->bin, TRUE);
+  gst_bin_add (GST_BIN (pfile->priv->pipeline), deck->bin);
+  g_free (name);
+
+  /* Decode ahead in its own thread */
+  g_object_set (deck->queue, "max-size-buffers", 0, "max-size-bytes", 0,
+                "max-size-time", GST_SECOND, NULL);
+
+  /* Add ghost pad and track stream from its target */
+  pad = gst_element_get_static_pad (deck->filter, "src");
+  deck->pad = gst_ghost_pad_new ("src", pad);
+  gst_element_add_pad (deck->bin, deck->pad);
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER |
+                     GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+                     melo_player_file_probe, deck, NULL);
+  gst_object_unref (pad);
+
+  /* Control volume with sample accurate ramps */
+  deck->fade = gst_interpolation_control_source_new ();
+  g_object_set (deck->fade, "mode", GST_INTERPOLATION_MODE_LINEAR, NULL);
+  gst_object_add_control_binding (GST_OBJECT (deck->volume),
+                     gst_direct_control_binding_new_absolute (
+                         GST_OBJECT (deck->volume), "volume", deck->fade));
+  deck->gain = 1.0;
+  melo_player_file_deck_set_fade (deck, 0, 0, 1.0, 1.0);
+  gst_segment_init (&deck->segment, GST_FORMAT_TIME);
+  deck->load_time = -1;
+
+  /* Link decoded audio */
+  g_signal_connect (deck->src, "pad-added", G_CALLBACK (pad_added_handler),
+                    deck);
+}
+
+/* Can be called from streaming thread */
+static void
+melo_player_file_deck_link (MeloPlayerFilePrivate *priv,
+                            MeloPlayerFileDeck *deck, GstClockTime offset)
+{
+  /* Mix deck audio from running time offset */
+  deck->mixer_pad = gst_element_get_request_pad (priv->mixer, "sink_%u");
+  gst_pad_set_offset (deck->pad, offset);
+  gst_pad_link (deck->pad, deck->mixer_pad);
+
+  /* Release prepared data */
+  if (deck->block_id)
+    gst_pad_remove_probe (deck->pad, deck->block_id);
+  deck->block_id = 0;
+}
+
+static void
+melo_player_file_deck_reset (MeloPlayerFilePrivate *priv,
+                             MeloPlayerFileDeck *deck)
+{
+  /* Stop decode branch */
+  gst_element_set_locked_state (deck->bin, TRUE);
+  gst_element_set_state (deck->bin, GST_STATE_NULL);
+  if (deck->block_id)
+    gst_pad_remove_probe (deck->pad, deck->block_id);
+  deck->block_id = 0;
+
+  /* Release mixer pad */
+  if (deck->mixer_pad) {
+    gst_pad_unlink (deck->pad, deck->mixer_pad);
+    gst_element_release_request_pad (priv->mixer, deck->mixer_pad);
+    gst_object_unref (deck->mixer_pad);
+    deck->mixer_pad = NULL;
+  }
+  gst_pad_set_offset (deck->pad, 0);
+
+  /* Reset stream state */
+  deck->gain = 1.0;
+  melo_player_file_deck_set_fade (deck, 0, 0, 1.0, 1.0);
+  gst_segment_init (&deck->segment, GST_FORMAT_TIME);
+  deck->running_end = 0;
+  deck->duration = 0;
+  deck->prepared = FALSE;
+  deck->load_start = 0;
+  g_atomic_int_set (&deck->load_time, -1);
+}
+
+/* Must be called with player locked */
+static gdouble
+melo_player_file_get_gain (MeloPlayerFilePrivate *priv, const gchar *uri)
+{
+  gchar *dir, *base, *path, *name;
+  gdouble loudness, peak, gain = 1.0;
+  gint path_id;
+
+  if (!priv->fdb || !priv->loudness)
+    return 1.0;
+
+  /* Paths and file names are saved unescaped in database */
+  dir = g_path_get_dirname (uri);
+  base = g_path_get_basename (uri);
+  path = g_uri_unescape_string (dir, NULL);
+  name = g_uri_unescape_string (base, NULL);
+
+  /* Get gain from loudness computed by indexer */
+  if (path && name &&
+      melo_file_db_get_path_id (priv->fdb, path, FALSE, &path_id) &&
+      melo_file_db_get_loudness (priv->fdb, path_id, name, &loudness, &peak))
+    gain = melo_file_loudness_get_gain (loudness, peak, priv->target);
+
+  g_free (dir);
+  g_free (base);
+  g_free (path);
+  g_free (name);
+
+  return gain;
+}
+
+static void
+melo_player_file_deck_start (MeloPlayerFileDeck *deck, const gchar *uri,
+                             GstCaps *caps)
+{
+  /* Set media and output format, then start decoding */
+  g_object_set (deck->src, "uri", uri, NULL);
+  g_object_set (deck->filter, "caps", caps, NULL);
+  gst_element_set_locked_state (deck->bin, FALSE);
+  gst_element_sync_state_with_parent (deck->bin);
+}
+
+static gint64
+melo_player_file_deck_query (MeloPlayerFilePrivate *priv, gboolean duration)
+{
+  MeloPlayerFileDeck *deck;
+  gint64 value;
+
+  /* Query current deck */
+  g_mutex_lock (&priv->deck_mutex);
+  deck = &priv->decks[priv->current];
+  g_mutex_unlock (&priv->deck_mutex);
+  if (duration ? !gst_pad_query_duration (deck->pad, GST_FORMAT_TIME, &value) :
+                 !gst_pad_query_position (deck->pad, GST_FORMAT_TIME, &value))
+    return -1;
+
+  return value;
 }
 
 static void
@@ -129,37 +409,40 @@ melo_player_file_constructed (GObject *object)
   MeloPlayerFile *pfile = MELO_PLAYER_FILE (object);
   MeloPlayerFilePrivate *priv = pfile->priv;
   MeloPlayer *player = MELO_PLAYER (object);
-  gchar *pipe_name, *uri_name, *sink_name;
+  gchar *pipe_name, *sink_name;
   const gchar *id, *name;
   GstElement *sink;
   GstBus *bus;
+  guint i;
 
   /* Generate element names */
   id = melo_player_get_id (player);
   name = melo_player_get_name (player);
   pipe_name = g_strjoin ("_", id, "pipeline", NULL);
-  uri_name = g_strjoin ("_", id, "uridecodebin", NULL);
   sink_name = g_strjoin ("_", id, "sink", NULL);
 
-  /* Create pipeline */
+  /* Create pipeline: decks are mixed for gapless and crossfade transitions */
   priv->pipeline = gst_pipeline_new (pipe_name);
-  priv->src = gst_element_factory_make ("uridecodebin", uri_name);
+  priv->mixer = gst_element_factory_make ("audiomixer", NULL);
   priv->sink = melo_sink_new (player, sink_name, name);
   sink = melo_sink_get_gst_sink (priv->sink);
-  gst_bin_add_many (GST_BIN (priv->pipeline), priv->src, sink, NULL);
+  gst_bin_add_many (GST_BIN (priv->pipeline), priv->mixer, sink, NULL);
+  gst_element_link (priv->mixer, sink);
+
+  /* Create decks */
+  for (i = 0; i < MELO_PLAYER_FILE_DECKS; i++)
+    melo_player_file_deck_init (pfile, &priv->decks[i], i, id);
 
   /* Free element names */
   g_free (pipe_name);
-  g_free (uri_name);
   g_free (sink_name);
 
-  /* Add signal handler on new pad */
-  g_signal_connect(priv->src, "pad-added",
-                   G_CALLBACK (pad_added_handler), sink);
-
   /* Add a message handler */
   bus = gst_pipeline_get_bus (GST_PIPELINE (priv->pipeline));
   priv->bus_watch_id = gst_bus_add_watch (bus, bus_call, pfile);
+
+  /* Promote streaming threads */
+  melo_sched_watch_bus (bus);
   gst_object_unref (bus);
 }
 
@@ -178,15 +461,18 @@ bus_call (GstBus *bus, GstMessage *msg, gpointer data)
       gint64 value;
 
       /* Get duration */
-      if (gst_element_query_duration (priv->src, GST_FORMAT_TIME, &value))
+      value = melo_player_file_deck_query (priv, TRUE);
+      if (value >= 0)
         melo_player_set_status_duration (player, value / 1000000);
 
       /* Get position */
-      if (gst_element_query_position (priv->pipeline, GST_FORMAT_TIME, &value))
+      value = melo_player_file_deck_query (priv, FALSE);
+      if (value >= 0)
         melo_player_set_status_pos (player, value / 1000000);
       break;
     }
     case GST_MESSAGE_TAG: {
+      MeloPlayerFileDeck *other;
       MeloTags *mtags, *otags;
       GstTagList *tags;
 
@@ -196,21 +482,43 @@ bus_call (GstBus *bus, GstMessage *msg, gpointer data)
       /* Fill MeloTags with GstTagList */
       mtags = melo_tags_new_from_gst_tag_list (tags, MELO_TAGS_FIELDS_FULL,
                                                MELO_TAGS_COVER_PERSIST_NONE);
+      gst_tag_list_unref (tags);
+
+      /* Tags of prepared media are kept until transition */
+      g_mutex_lock (&priv->deck_mutex);
+      other = &priv->decks[!priv->current];
+      g_mutex_unlock (&priv->deck_mutex);
+      if (gst_object_has_ancestor (GST_MESSAGE_SRC (msg),
+                                   GST_OBJECT (other->bin))) {
+        g_mutex_lock (&priv->mutex);
+        if (priv->next_path) {
+          if (priv->next_tags) {
+            mtags = melo_tags_merge_ref (mtags, priv->next_tags);
+            melo_tags_unref (priv->next_tags);
+          }
+          priv->next_tags = mtags;
+          mtags = NULL;
+        }
+        g_mutex_unlock (&priv->mutex);
+        if (mtags)
+          melo_tags_unref (mtags);
+        break;
+      }
 
-      /* Merge with old tags */
+      /* Merge with old tags: share them if nothing changed */
       otags = melo_player_get_tags (player);
       if (otags) {
-        melo_tags_merge (mtags, otags);
+        mtags = melo_tags_merge_ref (mtags, otags);
         melo_tags_unref (otags);
       }
 
       /* Set tags to status */
       melo_player_take_status_tags (player, mtags);
-
-      /* Free tag list */
-      gst_tag_list_unref (tags);
       break;
     }
+    case GST_MESSAGE_APPLICATION:
+      melo_player_file_application (pfile, gst_message_get_structure (msg));
+      break;
     case GST_MESSAGE_STREAM_START:
       /* Playback is started */
       melo_player_set_status_state (player,
@@ -259,16 +567,16 @@ bus_call (GstBus *bus, GstMessage *msg, gpointer data)
 }
 
 static void
-pad_added_handler (GstElement *src, GstPad *pad, GstElement *sink)
+pad_added_handler (GstElement *src, GstPad *pad, MeloPlayerFileDeck *deck)
 {
   GstStructure *str;
   GstPad *sink_pad;
   GstCaps *caps;
 
-  /* Get sink pad from sink element */
-  sink_pad = gst_element_get_static_pad (sink, "sink");
+  /* Get sink pad from deck queue */
+  sink_pad = gst_element_get_static_pad (deck->queue, "sink");
   if (GST_PAD_IS_LINKED (sink_pad)) {
-    g_object_unref (sink_pad);
+    gst_object_unref (sink_pad);
     return;
   }
 
@@ -284,7 +592,253 @@ pad_added_handler (GstElement *src, GstPad *pad, GstElement *sink)
 
   /* Link elements */
   gst_pad_link (pad, sink_pad);
-  g_object_unref (sink_pad);
+  gst_object_unref (sink_pad);
+}
+
+static void
+melo_player_file_post (MeloPlayerFileDeck *deck, const gchar *name)
+{
+  GstStructure *str;
+
+  /* Forward deck event to main loop */
+  str = gst_structure_new (name, "deck", G_TYPE_UINT, deck->index, NULL);
+  gst_element_post_message (deck->bin,
+                  gst_message_new_application (GST_OBJECT (deck->bin), str));
+}
+
+/* Must be called with deck_mutex locked */
+static void
+melo_player_file_start_next (MeloPlayerFilePrivate *priv, GstClockTime offset)
+{
+  MeloPlayerFileDeck *next = &priv->decks[!priv->current];
+
+  /* First sample of next media is mixed right after last sample sent */
+  melo_player_file_deck_link (priv, next, offset);
+  priv->current = next->index;
+  priv->next_ready = FALSE;
+  melo_player_file_post (next, "melo-file-next");
+}
+
+static GstPadProbeReturn
+melo_player_file_block (GstPad *pad, GstPadProbeInfo *info,
+                        gpointer user_data)
+{
+  /* Keep prepared media until transition */
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+melo_player_file_probe (GstPad *pad, GstPadProbeInfo *info,
+                        gpointer user_data)
+{
+  MeloPlayerFileDeck *deck = user_data;
+  MeloPlayerFilePrivate *priv = deck->pfile->priv;
+  GstClockTime end, pos, fade;
+  GstBuffer *buffer;
+  GstEvent *event;
+  gboolean current;
+  gint load_time;
+
+  /* Stream events */
+  if (!(info->type & GST_PAD_PROBE_TYPE_BUFFER)) {
+    event = GST_PAD_PROBE_INFO_EVENT (info);
+    switch (GST_EVENT_TYPE (event)) {
+      case GST_EVENT_SEGMENT:
+        gst_event_copy_segment (event, &deck->segment);
+        break;
+      case GST_EVENT_FLUSH_STOP:
+        gst_segment_init (&deck->segment, GST_FORMAT_TIME);
+        break;
+      case GST_EVENT_EOS:
+        /* Start next media now when transition has not been reached */
+        g_mutex_lock (&priv->deck_mutex);
+        if (deck->index == priv->current && priv->next_ready)
+          melo_player_file_start_next (priv, deck->running_end);
+        g_mutex_unlock (&priv->deck_mutex);
+        melo_player_file_post (deck, "melo-file-eos");
+        break;
+      default:
+        ;
+    }
+    return GST_PAD_PROBE_OK;
+  }
+
+  /* First audio of a prepared media: report it now if already playing */
+  if (deck->load_start && g_atomic_int_get (&deck->load_time) < 0) {
+    load_time = (g_get_monotonic_time () - deck->load_start) / 1000;
+    g_atomic_int_set (&deck->load_time, load_time);
+    g_mutex_lock (&priv->deck_mutex);
+    current = deck->index == priv->current;
+    g_mutex_unlock (&priv->deck_mutex);
+    if (current)
+      melo_player_set_status_load_time (MELO_PLAYER (deck->pfile), load_time);
+  }
+
+  /* Get end of buffer */
+  buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  if (!GST_BUFFER_PTS_IS_VALID (buffer))
+    return GST_PAD_PROBE_OK;
+  end = GST_BUFFER_PTS (buffer);
+  if (GST_BUFFER_DURATION_IS_VALID (buffer))
+    end += GST_BUFFER_DURATION (buffer);
+
+  /* Save running time of last sample: deck offset is applied on ghost pad */
+  pos = gst_segment_to_running_time (&deck->segment, GST_FORMAT_TIME, end);
+  if (GST_CLOCK_TIME_IS_VALID (pos))
+    deck->running_end = pos + gst_pad_get_offset (deck->pad);
+  pos = gst_segment_to_stream_time (&deck->segment, GST_FORMAT_TIME, end);
+
+  /* Get media duration */
+  if (deck->duration <= 0 &&
+      !gst_pad_query_duration (pad, GST_FORMAT_TIME, &deck->duration))
+    deck->duration = 0;
+  if (deck->duration <= 0 || !GST_CLOCK_TIME_IS_VALID (pos))
+    return GST_PAD_PROBE_OK;
+
+  g_mutex_lock (&priv->deck_mutex);
+  if (deck->index == priv->current) {
+    fade = (GstClockTime) priv->crossfade * GST_MSECOND;
+    pos += fade;
+
+    /* Prepare next media */
+    if (!deck->prepared && pos + MELO_PLAYER_FILE_PRELOAD * GST_MSECOND >=
+                           (GstClockTime) deck->duration) {
+      deck->prepared = TRUE;
+      melo_player_file_post (deck, "melo-file-prepare");
+    }
+
+    /* Transition is reached */
+    if (priv->next_ready && pos >= (GstClockTime) deck->duration)
+      melo_player_file_start_next (priv, deck->running_end);
+  }
+  g_mutex_unlock (&priv->deck_mutex);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+melo_player_file_prepare_next (MeloPlayerFile *pfile)
+{
+  MeloPlayerFilePrivate *priv = pfile->priv;
+  MeloPlayer *player = MELO_PLAYER (pfile);
+  MeloPlayerFileDeck *deck, *next;
+  MeloTags *tags = NULL;
+  gchar *path, *id = NULL;
+  GstClockTime fade, duration;
+  GstCaps *caps;
+
+  if (!player->playlist)
+    return;
+
+  /* Get next media without changing current one in playlist */
+  path = melo_playlist_get_next (player->playlist, &id, &tags, FALSE);
+  if (!path)
+    return;
+
+  g_mutex_lock (&priv->mutex);
+
+  /* Save next media */
+  melo_player_file_clear_next (priv);
+  priv->next_path = path;
+  priv->next_id = id;
+  priv->next_tags = tags;
+
+  /* Get decks */
+  g_mutex_lock (&priv->deck_mutex);
+  deck = &priv->decks[priv->current];
+  next = &priv->decks[!priv->current];
+  fade = (GstClockTime) priv->crossfade * GST_MSECOND;
+  g_mutex_unlock (&priv->deck_mutex);
+  melo_player_file_deck_reset (priv, next);
+  next->gain = melo_player_file_get_gain (priv, path);
+  melo_player_file_deck_set_fade (next, 0, 0, 1.0, 1.0);
+
+  /* Set volume ramps on both medias */
+  duration = deck->duration;
+  if (fade && duration > fade) {
+    melo_player_file_deck_set_fade (deck, duration - fade, duration, 1.0, 0.0);
+    melo_player_file_deck_set_fade (next, 0, fade, 0.0, 1.0);
+  }
+
+  /* Decode next media in advance with same format as current one */
+  next->block_id = gst_pad_add_probe (next->pad,
+                                      GST_PAD_PROBE_TYPE_BLOCK_DOWNSTREAM,
+                                      melo_player_file_block, NULL, NULL);
+  caps = gst_pad_get_current_caps (deck->pad);
+  next->load_start = g_get_monotonic_time ();
+  melo_player_file_deck_start (next, path, caps);
+  if (caps)
+    gst_caps_unref (caps);
+
+  /* Next media can be started */
+  g_mutex_lock (&priv->deck_mutex);
+  priv->next_ready = TRUE;
+  g_mutex_unlock (&priv->deck_mutex);
+
+  g_mutex_unlock (&priv->mutex);
+}
+
+static void
+melo_player_file_application (MeloPlayerFile *pfile, const GstStructure *str)
+{
+  MeloPlayerFilePrivate *priv = pfile->priv;
+  MeloPlayer *player = MELO_PLAYER (pfile);
+  gboolean current, ready, found = TRUE;
+  gint64 duration;
+  gint load_time;
+  guint index = 0;
+
+  /* Get deck state */
+  gst_structure_get_uint (str, "deck", &index);
+  g_mutex_lock (&priv->deck_mutex);
+  current = index == priv->current;
+  ready = priv->next_ready;
+  g_mutex_unlock (&priv->deck_mutex);
+
+  if (gst_structure_has_name (str, "melo-file-prepare")) {
+    /* End of current media is near */
+    if (current)
+      melo_player_file_prepare_next (pfile);
+  } else if (gst_structure_has_name (str, "melo-file-next")) {
+    /* Next media is now playing: move playlist to the media prepared */
+    g_mutex_lock (&priv->mutex);
+    if (priv->next_path) {
+      found = melo_playlist_set_current (player->playlist, priv->next_id);
+      melo_player_reset_status (player, MELO_PLAYER_STATE_PLAYING,
+                                priv->next_id, priv->next_tags);
+      priv->next_tags = NULL;
+      melo_player_file_clear_next (priv);
+    }
+    g_mutex_unlock (&priv->mutex);
+
+    /* Media has been removed from playlist in the meantime: play the media
+     * which follows the current one in playlist instead
+     */
+    if (!found) {
+      if (!melo_player_file_next (player)) {
+        gst_element_set_state (priv->pipeline, GST_STATE_NULL);
+        melo_player_set_status_state (player, MELO_PLAYER_STATE_STOPPED);
+      }
+      return;
+    }
+
+    /* Time to first audio of the media decoded in advance */
+    load_time = g_atomic_int_get (&priv->decks[index].load_time);
+    if (load_time >= 0)
+      melo_player_set_status_load_time (player, load_time);
+
+    /* Update duration */
+    duration = melo_player_file_deck_query (priv, TRUE);
+    if (duration >= 0)
+      melo_player_set_status_duration (player, duration / 1000000);
+  } else if (gst_structure_has_name (str, "melo-file-eos")) {
+    /* Previous media is done: release its deck */
+    if (!current && !ready) {
+      g_mutex_lock (&priv->mutex);
+      melo_player_file_deck_reset (priv, &priv->decks[index]);
+      g_mutex_unlock (&priv->mutex);
+    }
+  }
 }
 
 static gboolean
@@ -311,19 +865,55 @@ melo_player_file_add (MeloPlayer *player, const gchar *path, const gchar *name,
   return TRUE;
 }
 
+static gboolean
+melo_player_file_add_many (MeloPlayer *player, GList *items)
+{
+  GList *l;
+
+  if (!player->playlist)
+    return FALSE;
+
+  /* Extract file names from URIs */
+  for (l = items; l; l = l->next) {
+    MeloPlaylistItem *item = l->data;
+
+    if (!item->name && item->path) {
+      gchar *escaped = g_path_get_basename (item->path);
+      item->name = g_uri_unescape_string (escaped, NULL);
+      g_free (escaped);
+    }
+  }
+
+  /* Add URIs to playlist */
+  return melo_playlist_add_many (player->playlist, items);
+}
+
 static gboolean
 melo_player_file_setup (MeloPlayer *player, const gchar *path,
                         const gchar *name, MeloTags *tags, gboolean insert,
                         MeloPlayerState state)
 {
   MeloPlayerFilePrivate *priv = (MELO_PLAYER_FILE (player))->priv;
+  MeloPlayerFileDeck *deck;
   gchar *_name = NULL;
+  guint i;
 
   /* Lock player mutex */
   g_mutex_lock (&priv->mutex);
 
-  /* Stop pipeline */
-  gst_element_set_state (priv->pipeline, GST_STATE_NULL);
+  /* Cancel transition */
+  g_mutex_lock (&priv->deck_mutex);
+  priv->next_ready = FALSE;
+  g_mutex_unlock (&priv->deck_mutex);
+
+  /* Go back to ready (keeps audio sink opened) and drop queued media */
+  gst_element_set_state (priv->pipeline, GST_STATE_READY);
+  melo_player_file_clear_next (priv);
+  for (i = 0; i < MELO_PLAYER_FILE_DECKS; i++)
+    melo_player_file_deck_reset (priv, &priv->decks[i]);
+  g_mutex_lock (&priv->deck_mutex);
+  priv->current = 0;
+  g_mutex_unlock (&priv->deck_mutex);
 
   /* Extract file name from URI */
   if (!name) {
@@ -336,8 +926,13 @@ melo_player_file_setup (MeloPlayer *player, const gchar *path,
   /* Reset status */
   melo_player_reset_status (player, state, name, melo_tags_ref (tags));
 
-  /* Set new location to src element */
-  g_object_set (priv->src, "uri", path, NULL);
+  /* Set new location to first deck */
+  deck = &priv->decks[0];
+  deck->gain = melo_player_file_get_gain (priv, path);
+  melo_player_file_deck_set_fade (deck, 0, 0, 1.0, 1.0);
+  melo_player_file_deck_link (priv, deck, 0);
+  melo_player_file_deck_start (deck, path, NULL);
+  melo_sink_start_load (priv->sink);
   if (state == MELO_PLAYER_STATE_LOADING) {
     priv->load = FALSE;
     gst_element_set_state (priv->pipeline, GST_STATE_PLAYING);
@@ -448,6 +1043,24 @@ melo_player_file_set_pos (MeloPlayer *player, gint pos)
 {
   MeloPlayerFilePrivate *priv = (MELO_PLAYER_FILE (player))->priv;
   gint64 time = (gint64) pos * 1000000;
+  MeloPlayerFileDeck *deck;
+
+  g_mutex_lock (&priv->mutex);
+
+  /* Cancel transition */
+  g_mutex_lock (&priv->deck_mutex);
+  priv->next_ready = FALSE;
+  deck = &priv->decks[priv->current];
+  g_mutex_unlock (&priv->deck_mutex);
+  melo_player_file_deck_reset (priv, &priv->decks[!deck->index]);
+  melo_player_file_clear_next (priv);
+
+  /* Running time restarts from zero after flush */
+  melo_player_file_deck_set_fade (deck, 0, 0, 1.0, 1.0);
+  gst_pad_set_offset (deck->pad, 0);
+  deck->prepared = FALSE;
+
+  g_mutex_unlock (&priv->mutex);
 
   /* Seek to new position */
   if (!gst_element_seek (priv->pipeline, 1.0, GST_FORMAT_TIME,
@@ -486,9 +1099,47 @@ melo_player_file_get_pos (MeloPlayer *player)
   MeloPlayerFilePrivate *priv = (MELO_PLAYER_FILE (player))->priv;
   gint64 pos;
 
-  /* Get length */
-  if (!gst_element_query_position (priv->pipeline, GST_FORMAT_TIME, &pos))
+  /* Get position in current media */
+  pos = melo_player_file_deck_query (priv, FALSE);
+  if (pos < 0)
     pos = 0;
 
   return pos / 1000000;
 }
+
+void
+melo_player_file_set_crossfade (MeloPlayerFile *pfile, gint duration)
+{
+  MeloPlayerFilePrivate *priv = pfile->priv;
+
+  /* Used from next transition */
+  g_mutex_lock (&priv->deck_mutex);
+  priv->crossfade = duration > 0 ? duration : 0;
+  g_mutex_unlock (&priv->deck_mutex);
+}
+
+void
+melo_player_file_set_db (MeloPlayerFile *pfile, MeloFileDB *fdb)
+{
+  MeloPlayerFilePrivate *priv = pfile->priv;
+
+  /* Used from next media */
+  g_mutex_lock (&priv->mutex);
+  if (priv->fdb)
+    g_object_unref (priv->fdb);
+  priv->fdb = fdb ? g_object_ref (fdb) : NULL;
+  g_mutex_unlock (&priv->mutex);
+}
+
+void
+melo_player_file_set_loudness (MeloPlayerFile *pfile, gboolean enable,
+                               gdouble target)
+{
+  MeloPlayerFilePrivate *priv = pfile->priv;
+
+  /* Used from next media */
+  g_mutex_lock (&priv->mutex);
+  priv->loudness = enable;
+  priv->target = target;
+  g_mutex_unlock (&priv->mutex);
+}
@@ -24,6 +24,8 @@
 
 #include "melo_player.h"
 
+#include "melo_file_db.h"
+
 G_BEGIN_DECLS
 
 #define MELO_TYPE_PLAYER_FILE             (melo_player_file_get_type ())
@@ -50,6 +52,16 @@ struct _MeloPlayerFileClass {
 
 GType melo_player_file_get_type (void);
 
+/* Set overlap between two medias (in ms), 0 for gapless playback */
+void melo_player_file_set_crossfade (MeloPlayerFile *pfile, gint duration);
+
+/* Set media database used to get loudness of songs */
+void melo_player_file_set_db (MeloPlayerFile *pfile, MeloFileDB *fdb);
+
+/* Match loudness of songs analyzed by indexer to a target (in LUFS) */
+void melo_player_file_set_loudness (MeloPlayerFile *pfile, gboolean enable,
+                                    gdouble target);
+
 G_END_DECLS
 
 #endif /* __MELO_PLAYER_FILE_H__ */
@@ -26,6 +26,13 @@
 
 #include "melo_browser_radio.h"
 
+/* Resolved stream URLs are kept for ten minutes */
+#define MELO_BROWSER_RADIO_STATION_TTL 600
+
+/* Stations resolved in background */
+#define MELO_BROWSER_RADIO_PREFETCH 20
+#define MELO_BROWSER_RADIO_RECENT 10
+
 /* Radio browser info */
 static MeloBrowserInfo melo_browser_radio_info = {
   .name = "Browse radios",
@@ -51,13 +58,71 @@ static gboolean melo_browser_radio_action (MeloBrowser *browser,
                                          MeloBrowserItemAction action,
                                          const MeloBrowserActionParams *params);
 
+typedef struct {
+  MeloBrowserRadio *bradio;
+  gchar *url;
+
+  /* Parsed response and size of its body */
+  JsonNode *root;
+  gsize size;
+  gchar *etag;
+  gchar *last_modified;
+  gint64 time;
+  gboolean updating;
+} MeloBrowserRadioCache;
+
+typedef struct {
+  MeloBrowserRadio *bradio;
+  gchar *path;
+
+  /* Resolved stream */
+  gchar *name;
+  gchar *url;
+  gint64 time;
+  gboolean resolving;
+  GList *recent;
+} MeloBrowserRadioStation;
+
 struct _MeloBrowserRadioPrivate {
   GMutex mutex;
   SoupSession *session;
+
+  /* Response cache */
+  GHashTable *cache;
+  gint64 cache_ttl;
+  gchar *cache_path;
+
+  /* Stream URL resolver */
+  GHashTable *stations;
+  GQueue recent;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (MeloBrowserRadio, melo_browser_radio, MELO_TYPE_BROWSER)
 
+static void
+melo_browser_radio_cache_free (gpointer data)
+{
+  MeloBrowserRadioCache *cache = data;
+
+  if (cache->root)
+    json_node_free (cache->root);
+  g_free (cache->last_modified);
+  g_free (cache->etag);
+  g_free (cache->url);
+  g_slice_free (MeloBrowserRadioCache, cache);
+}
+
+static void
+melo_browser_radio_station_free (gpointer data)
+{
+  MeloBrowserRadioStation *station = data;
+
+  g_free (station->url);
+  g_free (station->name);
+  g_free (station->path);
+  g_slice_free (MeloBrowserRadioStation, station);
+}
+
 static void
 melo_browser_radio_finalize (GObject *gobject)
 {
@@ -68,6 +133,14 @@ melo_browser_radio_finalize (GObject *gobject)
   /* Free Soup session */
   g_object_unref (priv->session);
 
+  /* Free resolved stations */
+  g_queue_clear (&priv->recent);
+  g_hash_table_unref (priv->stations);
+
+  /* Free response cache */
+  g_hash_table_unref (priv->cache);
+  g_free (priv->cache_path);
+
   /* Clear mutex */
   g_mutex_clear (&priv->mutex);
 
@@ -105,6 +178,16 @@ melo_browser_radio_init (MeloBrowserRadio *self)
   priv->session = soup_session_new_with_options (
                                 SOUP_SESSION_USER_AGENT, "Melo",
                                 NULL);
+
+  /* Create response cache */
+  priv->cache = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                       melo_browser_radio_cache_free);
+  priv->cache_ttl = MELO_BROWSER_RADIO_CACHE_TTL;
+
+  /* Create stream URL resolver */
+  priv->stations = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                          melo_browser_radio_station_free);
+  g_queue_init (&priv->recent);
 }
 
 static const MeloBrowserInfo *
@@ -113,44 +196,40 @@ melo_browser_radio_get_info (MeloBrowser *browser)
   return &melo_browser_radio_info;
 }
 
-static GList *
-melo_browser_radio_parse (MeloBrowserRadio *bradio, const gchar *url)
+static JsonNode *
+melo_browser_radio_parse (const gchar *data, gssize len)
 {
-  SoupMessage *msg;
-  GInputStream *stream;
-  GList *list = NULL;
   JsonParser *parser;
-  JsonNode *node;
-  JsonArray *array;
-  JsonObject *obj;
-  gint count, i;
-
-  /* Create request */
-  msg = soup_message_new ("GET", url);
+  JsonNode *root = NULL;
 
-  /* Send message and wait answer */
-  stream = soup_session_send (bradio->priv->session, msg, NULL, NULL);
-  if (!stream)
-    goto bad_request;
+  /* Parse JSON and keep a copy of root node */
+  parser = json_parser_new ();
+  if (json_parser_load_from_data (parser, data, len, NULL) &&
+      json_parser_get_root (parser))
+    root = json_node_copy (json_parser_get_root (parser));
+  g_object_unref (parser);
 
-  /* Bad status */
-  if (msg->status_code != 200)
-    goto bad_status;
+  return root;
+}
 
-  /* Parse JSON */
-  parser = json_parser_new ();
-  if (!json_parser_load_from_stream (parser, stream, NULL, NULL))
-    goto bad_json;
+static GList *
+melo_browser_radio_get_items (JsonNode *node, gint offset, gint count)
+{
+  GList *list = NULL;
+  JsonArray *array;
+  JsonObject *obj;
+  gint len, i;
 
-  /* Get root node and check its type */
-  node = json_parser_get_root (parser);
+  /* Check node type */
   if (!node || json_node_get_node_type (node) != JSON_NODE_ARRAY)
-    goto bad_json;
+    return NULL;
 
-  /* Get array from node */
+  /* Get requested page from array */
   array = json_node_get_array (node);
-  count = json_array_get_length (array);
-  for (i = 0; i < count; i ++) {
+  len = json_array_get_length (array);
+  if (count >= 0 && offset + count < len)
+    len = offset + count;
+  for (i = offset; i < len; i ++) {
     const gchar *id, *name, *type;
     MeloBrowserItem *item;
 
@@ -178,22 +257,457 @@ melo_browser_radio_parse (MeloBrowserRadio *bradio, const gchar *url)
   }
 
   /* Reverse list */
-  list = g_list_reverse (list);
+  return g_list_reverse (list);
+}
 
-  /* Free objects */
-  g_object_unref (parser);
-  g_object_unref (stream);
-  g_object_unref (msg);
+static gchar *
+melo_browser_radio_cache_get_file (MeloBrowserRadioPrivate *priv,
+                                   const gchar *url)
+{
+  gchar *sha1, *file;
 
-  return list;
+  /* Use URL hash as file name */
+  sha1 = g_compute_checksum_for_string (G_CHECKSUM_SHA1, url, -1);
+  file = g_strdup_printf ("%s/%s.cache", priv->cache_path, sha1);
+  g_free (sha1);
 
-bad_json:
-  g_object_unref (parser);
-bad_status:
-  g_object_unref (stream);
-bad_request:
+  return file;
+}
+
+static void
+melo_browser_radio_cache_save (MeloBrowserRadioPrivate *priv,
+                               MeloBrowserRadioCache *cache,
+                               SoupMessageBody *body)
+{
+  GKeyFile *kfile;
+  gchar *file, *data;
+  gsize len;
+
+  /* Disk cache is disabled */
+  if (!priv->cache_path)
+    return;
+
+  /* Save response and its validators */
+  kfile = g_key_file_new ();
+  g_key_file_set_string (kfile, "cache", "url", cache->url);
+  if (cache->etag)
+    g_key_file_set_string (kfile, "cache", "etag", cache->etag);
+  if (cache->last_modified)
+    g_key_file_set_string (kfile, "cache", "last_modified",
+                           cache->last_modified);
+  g_key_file_set_int64 (kfile, "cache", "time", cache->time);
+  if (body) {
+    data = g_strndup (body->data, body->length);
+    g_key_file_set_string (kfile, "cache", "body", data);
+    g_free (data);
+  }
+
+  /* Write to file: only validators and time are updated on revalidation */
+  file = melo_browser_radio_cache_get_file (priv, cache->url);
+  if (!body) {
+    GKeyFile *old = g_key_file_new ();
+
+    /* Keep previous body */
+    data = NULL;
+    if (g_key_file_load_from_file (old, file, G_KEY_FILE_NONE, NULL))
+      data = g_key_file_get_string (old, "cache", "body", NULL);
+    g_key_file_free (old);
+    if (!data)
+      goto end;
+    g_key_file_set_string (kfile, "cache", "body", data);
+    g_free (data);
+  }
+  data = g_key_file_to_data (kfile, &len, NULL);
+  g_mkdir_with_parents (priv->cache_path, 0700);
+  g_file_set_contents (file, data, len, NULL);
+  g_free (data);
+
+end:
+  g_free (file);
+  g_key_file_free (kfile);
+}
+
+/* Must be called with browser locked */
+static MeloBrowserRadioCache *
+melo_browser_radio_cache_lookup (MeloBrowserRadio *bradio, const gchar *url)
+{
+  MeloBrowserRadioPrivate *priv = bradio->priv;
+  MeloBrowserRadioCache *cache;
+  GKeyFile *kfile;
+  gchar *file, *body;
+
+  /* Find in memory */
+  cache = g_hash_table_lookup (priv->cache, url);
+  if (cache || !priv->cache_path)
+    return cache;
+
+  /* Load from disk */
+  file = melo_browser_radio_cache_get_file (priv, url);
+  kfile = g_key_file_new ();
+  if (!g_key_file_load_from_file (kfile, file, G_KEY_FILE_NONE, NULL))
+    goto end;
+
+  /* Parse saved response */
+  body = g_key_file_get_string (kfile, "cache", "body", NULL);
+  if (!body)
+    goto end;
+  cache = g_slice_new0 (MeloBrowserRadioCache);
+  cache->root = melo_browser_radio_parse (body, -1);
+  cache->size = strlen (body);
+  g_free (body);
+  if (!cache->root) {
+    g_slice_free (MeloBrowserRadioCache, cache);
+    cache = NULL;
+    goto end;
+  }
+
+  /* Add to memory cache */
+  cache->bradio = bradio;
+  cache->url = g_strdup (url);
+  cache->etag = g_key_file_get_string (kfile, "cache", "etag", NULL);
+  cache->last_modified = g_key_file_get_string (kfile, "cache",
+                                                "last_modified", NULL);
+  cache->time = g_key_file_get_int64 (kfile, "cache", "time", NULL);
+  g_hash_table_insert (priv->cache, cache->url, cache);
+
+end:
+  g_key_file_free (kfile);
+  g_free (file);
+  return cache;
+}
+
+/* Must be called with browser locked */
+static gboolean
+melo_browser_radio_cache_update (MeloBrowserRadio *bradio,
+                                 MeloBrowserRadioCache *cache,
+                                 SoupMessage *msg)
+{
+  MeloBrowserRadioPrivate *priv = bradio->priv;
+  SoupMessageBody *body = NULL;
+  const gchar *value;
+  JsonNode *root;
+
+  /* Response has changed */
+  if (msg->status_code == SOUP_STATUS_OK) {
+    body = msg->response_body;
+    root = melo_browser_radio_parse (body->data, body->length);
+    if (!root)
+      return FALSE;
+    if (cache->root)
+      json_node_free (cache->root);
+    cache->root = root;
+    cache->size = body->length;
+  } else if (msg->status_code != SOUP_STATUS_NOT_MODIFIED || !cache->root)
+    return FALSE;
+
+  /* Update validators */
+  value = soup_message_headers_get_one (msg->response_headers, "ETag");
+  if (value || body) {
+    g_free (cache->etag);
+    cache->etag = g_strdup (value);
+  }
+  value = soup_message_headers_get_one (msg->response_headers,
+                                        "Last-Modified");
+  if (value || body) {
+    g_free (cache->last_modified);
+    cache->last_modified = g_strdup (value);
+  }
+  cache->time = g_get_real_time () / G_USEC_PER_SEC;
+
+  /* Save to disk */
+  melo_browser_radio_cache_save (priv, cache, body);
+
+  return TRUE;
+}
+
+static SoupMessage *
+melo_browser_radio_cache_request (MeloBrowserRadioCache *cache)
+{
+  SoupMessage *msg;
+
+  /* Create conditional request */
+  msg = soup_message_new ("GET", cache->url);
+  if (!msg || !cache->root)
+    return msg;
+  if (cache->etag)
+    soup_message_headers_append (msg->request_headers, "If-None-Match",
+                                 cache->etag);
+  if (cache->last_modified)
+    soup_message_headers_append (msg->request_headers, "If-Modified-Since",
+                                 cache->last_modified);
+
+  return msg;
+}
+
+static void
+melo_browser_radio_cache_revalidated (SoupSession *session, SoupMessage *msg,
+                                      gpointer user_data)
+{
+  MeloBrowserRadioCache *cache = user_data;
+  MeloBrowserRadio *bradio = cache->bradio;
+
+  /* Update entry: stale response is kept on failure */
+  g_mutex_lock (&bradio->priv->mutex);
+  melo_browser_radio_cache_update (bradio, cache, msg);
+  cache->updating = FALSE;
+  g_mutex_unlock (&bradio->priv->mutex);
+
+  g_object_unref (bradio);
+}
+
+/* Must be called with browser locked: the returned node is only valid until
+ * browser is unlocked.
+ */
+static JsonNode *
+melo_browser_radio_cache_get (MeloBrowserRadio *bradio, const gchar *url)
+{
+  MeloBrowserRadioPrivate *priv = bradio->priv;
+  MeloBrowserRadioCache *cache;
+  SoupMessage *msg;
+  gint64 now;
+
+  /* Serve cached response and revalidate it in background when stale */
+  cache = melo_browser_radio_cache_lookup (bradio, url);
+  if (cache && cache->root) {
+    now = g_get_real_time () / G_USEC_PER_SEC;
+    if (!cache->updating && now - cache->time >= priv->cache_ttl) {
+      msg = melo_browser_radio_cache_request (cache);
+      if (msg) {
+        cache->updating = TRUE;
+        g_object_ref (bradio);
+        soup_session_queue_message (priv->session, msg,
+                                    melo_browser_radio_cache_revalidated,
+                                    cache);
+      }
+    }
+    return cache->root;
+  }
+
+  /* Create new entry */
+  if (!cache) {
+    cache = g_slice_new0 (MeloBrowserRadioCache);
+    cache->bradio = bradio;
+    cache->url = g_strdup (url);
+    g_hash_table_insert (priv->cache, cache->url, cache);
+  }
+
+  /* Send message and wait answer */
+  msg = melo_browser_radio_cache_request (cache);
+  if (!msg)
+    return NULL;
+  soup_session_send_message (priv->session, msg);
+  melo_browser_radio_cache_update (bradio, cache, msg);
   g_object_unref (msg);
-  return NULL;
+
+  return cache->root;
+}
+
+static gboolean
+melo_browser_radio_is_playlist (const gchar *url)
+{
+  const gchar *end;
+  gsize len;
+
+  /* Check extension of URL path */
+  end = strchr (url, '?');
+  len = end ? (gsize) (end - url) : strlen (url);
+  return (len > 4 && (!g_ascii_strncasecmp (url + len - 4, ".pls", 4) ||
+                      !g_ascii_strncasecmp (url + len - 4, ".m3u", 4)));
+}
+
+static gchar *
+melo_browser_radio_parse_playlist (const gchar *data, gsize len)
+{
+  gchar **lines, *line, *url = NULL;
+  gchar *str;
+  gint i;
+
+  /* Get first entry of a PLS or M3U playlist */
+  str = g_strndup (data, len);
+  lines = g_strsplit_set (str, "\r\n", -1);
+  g_free (str);
+  for (i = 0; lines[i] && !url; i++) {
+    line = g_strstrip (lines[i]);
+
+    /* Skip empty lines, comments and sections */
+    if (*line == '\0' || *line == '#' || *line == '[')
+      continue;
+
+    /* PLS entry */
+    if (!g_ascii_strncasecmp (line, "file", 4) && strchr (line, '='))
+      line = strchr (line, '=') + 1;
+
+    if (strstr (line, "://"))
+      url = g_strdup (g_strstrip (line));
+  }
+  g_strfreev (lines);
+
+  return url;
+}
+
+static gboolean
+melo_browser_radio_station_is_valid (MeloBrowserRadioStation *station)
+{
+  return station->url && g_get_real_time () / G_USEC_PER_SEC - station->time <
+                                     MELO_BROWSER_RADIO_STATION_TTL;
+}
+
+/* Must be called with browser locked */
+static void
+melo_browser_radio_station_set (MeloBrowserRadioStation *station,
+                                const gchar *name, const gchar *url)
+{
+  gchar *old_name = station->name;
+
+  station->resolving = FALSE;
+  if (!url)
+    return;
+
+  /* Save final stream URL */
+  g_free (station->url);
+  station->name = g_strdup (name);
+  station->url = g_strdup (url);
+  g_free (old_name);
+  station->time = g_get_real_time () / G_USEC_PER_SEC;
+}
+
+/* Must be called with browser locked */
+static MeloBrowserRadioStation *
+melo_browser_radio_station_get (MeloBrowserRadio *bradio, const gchar *path)
+{
+  MeloBrowserRadioStation *station;
+
+  station = g_hash_table_lookup (bradio->priv->stations, path);
+  if (!station) {
+    station = g_slice_new0 (MeloBrowserRadioStation);
+    station->bradio = bradio;
+    station->path = g_strdup (path);
+    g_hash_table_insert (bradio->priv->stations, station->path, station);
+  }
+
+  return station;
+}
+
+static void
+melo_browser_radio_station_playlist_cb (SoupSession *session,
+                                        SoupMessage *msg, gpointer user_data)
+{
+  MeloBrowserRadioStation *station = user_data;
+  MeloBrowserRadio *bradio = station->bradio;
+  gchar *url = NULL;
+
+  /* Unwrap playlist */
+  if (msg->status_code == SOUP_STATUS_OK)
+    url = melo_browser_radio_parse_playlist (msg->response_body->data,
+                                             msg->response_body->length);
+
+  /* Keep playlist URL when unwrapping failed */
+  if (!url)
+    url = soup_uri_to_string (soup_message_get_uri (msg), FALSE);
+
+  /* Save stream URL */
+  g_mutex_lock (&bradio->priv->mutex);
+  melo_browser_radio_station_set (station, station->name, url);
+  g_mutex_unlock (&bradio->priv->mutex);
+  g_free (url);
+
+  g_object_unref (bradio);
+}
+
+static void
+melo_browser_radio_station_cb (SoupSession *session, SoupMessage *msg,
+                               gpointer user_data)
+{
+  MeloBrowserRadioStation *station = user_data;
+  MeloBrowserRadio *bradio = station->bradio;
+  const gchar *name = NULL, *url = NULL;
+  SoupMessage *pmsg = NULL;
+  JsonObject *obj;
+  JsonNode *node;
+
+  /* Parse station */
+  node = msg->status_code == SOUP_STATUS_OK ?
+         melo_browser_radio_parse (msg->response_body->data,
+                                   msg->response_body->length) : NULL;
+  if (node && json_node_get_node_type (node) == JSON_NODE_OBJECT) {
+    obj = json_node_get_object (node);
+    name = json_object_get_string_member (obj, "name");
+    url = json_object_get_string_member (obj, "url");
+  }
+
+  g_mutex_lock (&bradio->priv->mutex);
+
+  /* Fetch playlist before saving stream URL */
+  if (url && melo_browser_radio_is_playlist (url))
+    pmsg = soup_message_new ("GET", url);
+  if (pmsg) {
+    g_free (station->name);
+    station->name = g_strdup (name);
+    g_object_ref (bradio);
+    soup_session_queue_message (session, pmsg,
+                                melo_browser_radio_station_playlist_cb,
+                                station);
+  } else
+    melo_browser_radio_station_set (station, name, url);
+
+  g_mutex_unlock (&bradio->priv->mutex);
+
+  if (node)
+    json_node_free (node);
+  g_object_unref (bradio);
+}
+
+/* Must be called with browser locked */
+static void
+melo_browser_radio_station_resolve (MeloBrowserRadio *bradio,
+                                    MeloBrowserRadioStation *station)
+{
+  SoupMessage *msg;
+  gchar *url;
+
+  /* Already resolved or in progress */
+  if (station->resolving || melo_browser_radio_station_is_valid (station))
+    return;
+
+  /* Get station in background */
+  url = g_strdup_printf ("http://www.sparod.com/radio%s", station->path);
+  msg = soup_message_new ("GET", url);
+  g_free (url);
+  if (!msg)
+    return;
+  station->resolving = TRUE;
+  g_object_ref (bradio);
+  soup_session_queue_message (bradio->priv->session, msg,
+                              melo_browser_radio_station_cb, station);
+}
+
+/* Must be called with browser locked */
+static void
+melo_browser_radio_prefetch (MeloBrowserRadio *bradio, const gchar *path,
+                             GList *items)
+{
+  MeloBrowserRadioStation *station;
+  gchar *spath;
+  GList *l;
+  gint i;
+
+  /* Resolve visible stations */
+  for (l = items, i = 0; l && i < MELO_BROWSER_RADIO_PREFETCH; l = l->next) {
+    MeloBrowserItem *item = l->data;
+
+    if (item->type != MELO_BROWSER_ITEM_TYPE_MEDIA)
+      continue;
+
+    spath = g_strconcat (path, item->id, NULL);
+    station = melo_browser_radio_station_get (bradio, spath);
+    melo_browser_radio_station_resolve (bradio, station);
+    g_free (spath);
+    i++;
+  }
+
+  /* Keep recently played stations resolved */
+  for (l = bradio->priv->recent.head; l; l = l->next)
+    melo_browser_radio_station_resolve (bradio, l->data);
 }
 
 static MeloBrowserList *
@@ -203,20 +717,22 @@ melo_browser_radio_get_list (MeloBrowser *browser, const gchar *path,
   MeloBrowserRadio *bradio = MELO_BROWSER_RADIO (browser);
   static MeloBrowserList *list;
   gchar *url;
-  gint page;
 
   /* Create browser list */
   list = melo_browser_list_new (path);
   if (!list)
     return NULL;
 
-  /* Generate URL */
-  page = (params->offset / params->count) + 1;
-  url = g_strdup_printf ("http://www.sparod.com/radio%s?count=%d&page=%d",
-                         path, params->count, page);
+  /* Generate URL: full category is cached and paged locally */
+  url = g_strdup_printf ("http://www.sparod.com/radio%s", path);
 
-  /* Get list from URL */
-  list->items = melo_browser_radio_parse (bradio, url);
+  /* Get list from cache */
+  g_mutex_lock (&bradio->priv->mutex);
+  list->items = melo_browser_radio_get_items (
+                                   melo_browser_radio_cache_get (bradio, url),
+                                   params->offset, params->count);
+  melo_browser_radio_prefetch (bradio, path, list->items);
+  g_mutex_unlock (&bradio->priv->mutex);
   g_free (url);
 
   return list;
@@ -228,6 +744,8 @@ melo_browser_radio_search (MeloBrowser *browser, const gchar *input,
 {
   MeloBrowserRadio *bradio = MELO_BROWSER_RADIO (browser);
   static MeloBrowserList *list;
+  SoupMessage *msg;
+  JsonNode *node;
   gchar *url;
   gint page;
 
@@ -241,9 +759,22 @@ melo_browser_radio_search (MeloBrowser *browser, const gchar *input,
   url = g_strdup_printf ("http://www.sparod.com/radio/search/%s?"
                          "count=%d&page=%d", input, params->count, page);
 
-  /* Get list from URL */
-  list->items = melo_browser_radio_parse (bradio, url);
+  /* Search results are not cached */
+  msg = soup_message_new ("GET", url);
   g_free (url);
+  if (!msg)
+    return list;
+
+  /* Send message and wait answer */
+  if (soup_session_send_message (bradio->priv->session, msg) ==
+      SOUP_STATUS_OK) {
+    node = melo_browser_radio_parse (msg->response_body->data,
+                                     msg->response_body->length);
+    list->items = melo_browser_radio_get_items (node, 0, -1);
+    if (node)
+      json_node_free (node);
+  }
+  g_object_unref (msg);
 
   return list;
 }
@@ -254,12 +785,12 @@ melo_browser_radio_action (MeloBrowser *browser, const gchar *path,
                            const MeloBrowserActionParams *params)
 {
   MeloBrowserRadio *bradio = MELO_BROWSER_RADIO (browser);
+  MeloBrowserRadioPrivate *priv = bradio->priv;
+  MeloBrowserRadioStation *station;
   SoupMessage *msg;
-  GInputStream *stream;
-  JsonParser *parser;
   JsonNode *node;
   JsonObject *obj;
-  const gchar *name, *surl;
+  gchar *name = NULL, *surl = NULL, *purl;
   gchar *url;
   gboolean ret;
 
@@ -267,58 +798,126 @@ melo_browser_radio_action (MeloBrowser *browser, const gchar *path,
   if (action != MELO_BROWSER_ITEM_ACTION_PLAY)
     return FALSE;
 
-  /* Generate URL */
-  url = g_strdup_printf ("http://www.sparod.com/radio%s", path);
+  g_mutex_lock (&priv->mutex);
+
+  /* Move station on top of recently played */
+  station = melo_browser_radio_station_get (bradio, path);
+  if (station->recent)
+    g_queue_unlink (&priv->recent, station->recent);
+  else
+    station->recent = g_list_alloc ();
+  station->recent->data = station;
+  g_queue_push_head_link (&priv->recent, station->recent);
+  if (priv->recent.length > MELO_BROWSER_RADIO_RECENT) {
+    MeloBrowserRadioStation *old = g_queue_pop_tail (&priv->recent);
+    old->recent = NULL;
+  }
 
-  /* Create request */
-  msg = soup_message_new ("GET", url);
+  /* Use resolved stream URL */
+  if (melo_browser_radio_station_is_valid (station)) {
+    name = g_strdup (station->name);
+    surl = g_strdup (station->url);
+    g_mutex_unlock (&priv->mutex);
+    goto play;
+  }
+
+  /* Get radio from cache */
+  url = g_strdup_printf ("http://www.sparod.com/radio%s", path);
+  node = melo_browser_radio_cache_get (bradio, url);
   g_free (url);
 
-  /* Send message and wait answer */
-  stream = soup_session_send (bradio->priv->session, msg, NULL, NULL);
-  if (!stream)
-    goto bad_request;
+  /* Get stream URL */
+  if (node && json_node_get_node_type (node) == JSON_NODE_OBJECT) {
+    obj = json_node_get_object (node);
+    name = g_strdup (json_object_get_string_member (obj, "name"));
+    surl = g_strdup (json_object_get_string_member (obj, "url"));
+  }
+  g_mutex_unlock (&priv->mutex);
+  if (!surl) {
+    g_free (name);
+    return FALSE;
+  }
 
-  /* Bad status */
-  if (msg->status_code != 200)
-    goto bad_status;
+  /* Unwrap playlist */
+  if (melo_browser_radio_is_playlist (surl)) {
+    msg = soup_message_new ("GET", surl);
+    if (msg) {
+      if (soup_session_send_message (priv->session, msg) == SOUP_STATUS_OK) {
+        purl = melo_browser_radio_parse_playlist (msg->response_body->data,
+                                                  msg->response_body->length);
+        if (purl) {
+          g_free (surl);
+          surl = purl;
+        }
+      }
+      g_object_unref (msg);
+    }
+  }
 
-  /* Parse JSON */
-  parser = json_parser_new ();
-  if (!json_parser_load_from_stream (parser, stream, NULL, NULL))
-    goto bad_json;
+  /* Save resolved stream URL */
+  g_mutex_lock (&priv->mutex);
+  melo_browser_radio_station_set (station, name, surl);
+  g_mutex_unlock (&priv->mutex);
 
-  /* Get root node and check its type */
-  node = json_parser_get_root (parser);
-  if (!node || json_node_get_node_type (node) != JSON_NODE_OBJECT)
-    goto bad_json;
+play:
+  /* Play radio */
+  ret = melo_player_play (browser->player, surl, name, NULL, FALSE);
+  g_free (surl);
+  g_free (name);
 
-  /* Get object from node */
-  obj = json_node_get_object (node);
-  if (!obj)
-    goto bad_json;
+  return ret;
+}
 
-  /* Get stream URL */
-  name = json_object_get_string_member (obj, "name");
-  surl = json_object_get_string_member (obj, "url");
-  if (!surl)
-    return FALSE;
+void
+melo_browser_radio_set_cache (MeloBrowserRadio *bradio, guint ttl,
+                              const gchar *path)
+{
+  MeloBrowserRadioPrivate *priv = bradio->priv;
 
-  /* Play radio */
-  ret = melo_player_play (browser->player, surl, name, NULL, FALSE);
+  g_mutex_lock (&priv->mutex);
+  priv->cache_ttl = ttl;
+  g_free (priv->cache_path);
+  priv->cache_path = g_strdup (path);
+  g_mutex_unlock (&priv->mutex);
+}
 
-  /* Free objects */
-  g_object_unref (parser);
-  g_object_unref (stream);
-  g_object_unref (msg);
+void
+melo_browser_radio_get_cache_usage (MeloBrowserRadio *bradio,
+                                    MeloMemoryUsage *usage)
+{
+  MeloBrowserRadioPrivate *priv = bradio->priv;
+  MeloBrowserRadioCache *cache;
+  GHashTableIter iter;
+
+  /* Add size of cached responses */
+  g_mutex_lock (&priv->mutex);
+  g_hash_table_iter_init (&iter, priv->cache);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &cache)) {
+    usage->bytes += cache->size;
+    usage->count++;
+  }
+  g_mutex_unlock (&priv->mutex);
+}
 
-  return ret;
+static gboolean
+melo_browser_radio_cache_is_idle (gpointer key, gpointer value,
+                                  gpointer user_data)
+{
+  MeloBrowserRadioCache *cache = value;
 
-bad_json:
-  g_object_unref (parser);
-bad_status:
-  g_object_unref (stream);
-bad_request:
-  g_object_unref (msg);
-  return FALSE;
+  return !cache->updating;
+}
+
+void
+melo_browser_radio_trim_cache (MeloBrowserRadio *bradio)
+{
+  MeloBrowserRadioPrivate *priv = bradio->priv;
+
+  /* Drop responses which are not being revalidated: they are reloaded from
+   * disk on next access
+   */
+  g_mutex_lock (&priv->mutex);
+  g_hash_table_foreach_remove (priv->cache, melo_browser_radio_cache_is_idle,
+                               NULL);
+  g_mutex_unlock (&priv->mutex);
 }
@@ -48,8 +48,20 @@ struct _MeloBrowserRadioClass {
   MeloBrowserClass parent_class;
 };
 
+/* Cached responses are revalidated after one hour */
+#define MELO_BROWSER_RADIO_CACHE_TTL 3600
+
 GType melo_browser_radio_get_type (void);
 
+/* Set cache TTL (in s) and directory for saving responses (or NULL) */
+void melo_browser_radio_set_cache (MeloBrowserRadio *bradio, guint ttl,
+                                   const gchar *path);
+
+/* Get size of responses kept in memory (the body size) and drop them */
+void melo_browser_radio_get_cache_usage (MeloBrowserRadio *bradio,
+                                         MeloMemoryUsage *usage);
+void melo_browser_radio_trim_cache (MeloBrowserRadio *bradio);
+
 G_END_DECLS
 
 #endif /* __MELO_BROWSER_RADIO_H__ */
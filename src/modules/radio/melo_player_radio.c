@@ -24,10 +24,24 @@
 #include <gst/gst.h>
 
 #include "melo_sink.h"
+#include "melo_sched.h"
 #include "melo_player_radio.h"
 
+/* Default ring buffer size and pre-roll (in ms) */
+#define MELO_PLAYER_RADIO_BUFFER_TIME 10000
+#define MELO_PLAYER_RADIO_PREROLL_TIME 1000
+
+/* First reconnect delay (in ms), doubled on each attempt */
+#define MELO_PLAYER_RADIO_RECONNECT_DELAY 250
+#define MELO_PLAYER_RADIO_RECONNECT_MAX 6
+
 static gboolean bus_call (GstBus *bus, GstMessage *msg, gpointer data);
-static void pad_added_handler (GstElement *src, GstPad *pad, GstElement *sink);
+static void pad_added_handler (GstElement *src, GstPad *pad,
+                               MeloPlayerRadio *pradio);
+static GstPadProbeReturn melo_player_radio_probe (GstPad *pad,
+                                                  GstPadProbeInfo *info,
+                                                  gpointer user_data);
+static void melo_player_radio_running (GstElement *queue, gpointer user_data);
 
 static gboolean melo_player_radio_load (MeloPlayer *player, const gchar *path,
                                        const gchar *name, MeloTags *tags,
@@ -50,10 +64,22 @@ struct _MeloPlayerRadioPrivate {
   /* Gstreamer pipeline */
   GstElement *pipeline;
   GstElement *src;
+  GstElement *queue;
   MeloSink *sink;
   guint bus_watch_id;
   gchar *title;
 
+  /* Ring buffer */
+  guint buffer_time;
+  guint preroll_time;
+  GstSegment segment;
+  GstClockTime running_end;
+
+  /* Reconnect */
+  gint started;
+  gint retries;
+  guint reconnect_id;
+
   /* Browser tags */
   MeloTags *btags;
 };
@@ -72,8 +98,10 @@ melo_player_radio_finalize (GObject *gobject)
   /* Stop pipeline */
   gst_element_set_state (priv->pipeline, GST_STATE_NULL);
 
-  /* Remove message handler */
+  /* Remove message handler and pending reconnect */
   g_source_remove (priv->bus_watch_id);
+  if (priv->reconnect_id)
+    g_source_remove (priv->reconnect_id);
 
   /* Free gstreamer pipeline */
   g_object_unref (priv->pipeline);
@@ -125,6 +153,11 @@ melo_player_radio_init (MeloPlayerRadio *self)
 
   /* Init player mutex */
   g_mutex_init (&priv->mutex);
+
+  /* Set default ring buffer */
+  priv->buffer_time = MELO_PLAYER_RADIO_BUFFER_TIME;
+  priv->preroll_time = MELO_PLAYER_RADIO_PREROLL_TIME;
+  gst_segment_init (&priv->segment, GST_FORMAT_TIME);
 }
 
 static void
@@ -133,9 +166,10 @@ melo_player_radio_constructed (GObject *object)
   MeloPlayerRadio *pradio = MELO_PLAYER_RADIO (object);
   MeloPlayerRadioPrivate *priv = pradio->priv;
   MeloPlayer *player = MELO_PLAYER (object);
-  gchar *pipe_name, *uri_name, *sink_name;
+  gchar *pipe_name, *uri_name, *queue_name, *sink_name;
   const gchar *id, *name;
   GstElement *sink;
+  GstPad *pad;
   GstBus *bus;
 
   /* Generate element names */
@@ -143,30 +177,116 @@ melo_player_radio_constructed (GObject *object)
   name = melo_player_get_name (player);
   pipe_name = g_strjoin ("_", id, "pipeline", NULL);
   uri_name = g_strjoin ("_", id, "uridecodebin", NULL);
+  queue_name = g_strjoin ("_", id, "queue", NULL);
   sink_name = g_strjoin ("_", id, "sink", NULL);
 
   /* Create pipeline */
   priv->pipeline = gst_pipeline_new (pipe_name);
   priv->src = gst_element_factory_make ("uridecodebin", uri_name);
+  priv->queue = gst_element_factory_make ("queue", queue_name);
   priv->sink = melo_sink_new (player, sink_name, name);
   sink = melo_sink_get_gst_sink (priv->sink);
-  gst_bin_add_many (GST_BIN (priv->pipeline), priv->src, sink, NULL);
+  gst_bin_add_many (GST_BIN (priv->pipeline), priv->src, priv->queue, sink,
+                    NULL);
+  gst_element_link (priv->queue, sink);
 
   /* Free element names */
   g_free (pipe_name);
   g_free (uri_name);
+  g_free (queue_name);
   g_free (sink_name);
 
+  /* Setup ring buffer: decoded audio is kept after the source, so it can be
+   * restarted without flushing what is not played yet
+   */
+  g_object_set (priv->queue, "max-size-buffers", 0, "max-size-bytes", 0,
+                "max-size-time", priv->buffer_time * GST_MSECOND, NULL);
+  g_signal_connect (priv->queue, "running",
+                    G_CALLBACK (melo_player_radio_running), pradio);
+
+  /* Track buffered stream and catch end of stream */
+  pad = gst_element_get_static_pad (priv->queue, "sink");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER |
+                     GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+                     melo_player_radio_probe, pradio, NULL);
+  gst_object_unref (pad);
+
   /* Add signal handler on new pad */
   g_signal_connect(priv->src, "pad-added",
-                   G_CALLBACK (pad_added_handler), sink);
+                   G_CALLBACK (pad_added_handler), pradio);
 
   /* Add a message handler */
   bus = gst_pipeline_get_bus (GST_PIPELINE (priv->pipeline));
   priv->bus_watch_id = gst_bus_add_watch (bus, bus_call, pradio);
+
+  /* Promote streaming threads */
+  melo_sched_watch_bus (bus);
   gst_object_unref (bus);
 }
 
+/* Must be called with player locked */
+static void
+melo_player_radio_cancel_reconnect (MeloPlayerRadioPrivate *priv)
+{
+  if (priv->reconnect_id)
+    g_source_remove (priv->reconnect_id);
+  priv->reconnect_id = 0;
+  gst_segment_init (&priv->segment, GST_FORMAT_TIME);
+  priv->running_end = 0;
+  g_atomic_int_set (&priv->started, FALSE);
+  g_atomic_int_set (&priv->retries, 0);
+}
+
+static gboolean
+melo_player_radio_reconnect_cb (gpointer user_data)
+{
+  MeloPlayerRadioPrivate *priv = (MELO_PLAYER_RADIO (user_data))->priv;
+
+  g_mutex_lock (&priv->mutex);
+  priv->reconnect_id = 0;
+
+  /* Restart only the source: the ring buffer and the sink keep playing */
+  gst_element_set_state (priv->src, GST_STATE_NULL);
+  gst_element_sync_state_with_parent (priv->src);
+
+  g_mutex_unlock (&priv->mutex);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+melo_player_radio_reconnect (MeloPlayerRadio *pradio)
+{
+  MeloPlayerRadioPrivate *priv = pradio->priv;
+  gint retries;
+
+  g_mutex_lock (&priv->mutex);
+
+  /* A reconnect is already pending */
+  if (priv->reconnect_id) {
+    g_mutex_unlock (&priv->mutex);
+    return TRUE;
+  }
+
+  /* Only reconnect a stream which has already played */
+  retries = g_atomic_int_get (&priv->retries);
+  if (!g_atomic_int_get (&priv->started) ||
+      retries >= MELO_PLAYER_RADIO_RECONNECT_MAX) {
+    g_mutex_unlock (&priv->mutex);
+    return FALSE;
+  }
+
+  /* Schedule reconnect with exponential backoff */
+  g_atomic_int_set (&priv->retries, retries + 1);
+  priv->reconnect_id = g_timeout_add (MELO_PLAYER_RADIO_RECONNECT_DELAY <<
+                                      retries,
+                                      melo_player_radio_reconnect_cb, pradio);
+
+  g_mutex_unlock (&priv->mutex);
+
+  return TRUE;
+}
+
 static gboolean
 bus_call (GstBus *bus, GstMessage *msg, gpointer data)
 {
@@ -180,7 +300,7 @@ bus_call (GstBus *bus, GstMessage *msg, gpointer data)
     case GST_MESSAGE_TAG: {
       GstTagList *tags;
       MeloTags *mtags;
-      gchar *artist, *title;
+      gchar *artist, *title, *tmp;
 
       /* Get tag list from message */
       gst_message_parse_tag (msg, &tags);
@@ -192,9 +312,9 @@ bus_call (GstBus *bus, GstMessage *msg, gpointer data)
       mtags = melo_tags_new_from_gst_tag_list (tags, MELO_TAGS_FIELDS_FULL,
                                                MELO_TAGS_COVER_PERSIST_NONE);
 
-      /* Merge with browser tags */
+      /* Merge with browser tags: share them if nothing changed */
       if (priv->btags)
-        melo_tags_merge (mtags, priv->btags);
+        mtags = melo_tags_merge_ref (mtags, priv->btags);
 
       /* New title */
       if (mtags->title && g_strcmp0 (priv->title, mtags->title)) {
@@ -203,15 +323,18 @@ bus_call (GstBus *bus, GstMessage *msg, gpointer data)
         priv->title = g_strdup (mtags->title);
 
         /* Split title */
-        if (!mtags->artist) {
+        if (!mtags->artist && strstr (mtags->title, " - ")) {
+          /* Tags can be shared with browser tags */
+          mtags = melo_tags_make_writable (mtags);
+
           /* Get title space */
           artist = mtags->title;
-          title = strstr (mtags->title, " - ");
-          if (title) {
-            mtags->title = g_strdup (title + 3);
-            mtags->artist = g_strndup (artist, title - artist);
-            g_free (artist);
-          }
+          title = strstr (artist, " - ");
+          mtags->title = melo_tags_intern_string (title + 3);
+          tmp = g_strndup (artist, title - artist);
+          mtags->artist = melo_tags_intern_string (tmp);
+          melo_tags_release_string (artist);
+          g_free (tmp);
         }
 
         /* Add title to playlist */
@@ -252,12 +375,24 @@ bus_call (GstBus *bus, GstMessage *msg, gpointer data)
                                                    MELO_PLAYER_STATE_PLAYING);
       break;
     }
+    case GST_MESSAGE_APPLICATION:
+      /* Stream has been closed by server: reconnect */
+      if (!gst_message_has_name (msg, "melo-radio-reconnect") ||
+          melo_player_radio_reconnect (pradio))
+        break;
+      /* Fall through */
     case GST_MESSAGE_EOS:
       /* Stop playing */
       gst_element_set_state (priv->pipeline, GST_STATE_NULL);
       melo_player_set_status_state (player, MELO_PLAYER_STATE_STOPPED);
       break;
     case GST_MESSAGE_ERROR:
+      /* Network error on source: try to reconnect transparently */
+      if (gst_object_has_ancestor (GST_MESSAGE_SRC (msg),
+                                   GST_OBJECT (priv->src)) &&
+          melo_player_radio_reconnect (pradio))
+        break;
+
       /* Update error message */
       gst_message_parse_error (msg, &error, NULL);
       melo_player_set_status_error (player, error->message);
@@ -271,14 +406,17 @@ bus_call (GstBus *bus, GstMessage *msg, gpointer data)
 }
 
 static void
-pad_added_handler (GstElement *src, GstPad *pad, GstElement *sink)
+pad_added_handler (GstElement *src, GstPad *pad, MeloPlayerRadio *pradio)
 {
+  MeloPlayerRadioPrivate *priv = pradio->priv;
+  GstClockTime now, offset;
   GstStructure *str;
+  GstClock *clock;
   GstPad *sink_pad;
   GstCaps *caps;
 
-  /* Get sink pad from sink element */
-  sink_pad = gst_element_get_static_pad (sink, "sink");
+  /* Get sink pad from ring buffer */
+  sink_pad = gst_element_get_static_pad (priv->queue, "sink");
   if (GST_PAD_IS_LINKED (sink_pad)) {
     g_object_unref (sink_pad);
     return;
@@ -294,11 +432,87 @@ pad_added_handler (GstElement *src, GstPad *pad, GstElement *sink)
   }
   gst_caps_unref (caps);
 
+  /* After a reconnect, new stream starts again from zero: shift it after
+   * the buffered audio, or to current time when ring buffer underran
+   */
+  offset = priv->running_end;
+  clock = gst_element_get_clock (priv->pipeline);
+  if (clock) {
+    now = gst_clock_get_time (clock) -
+          gst_element_get_base_time (priv->pipeline);
+    if (offset && now > offset)
+      offset = now;
+    gst_object_unref (clock);
+  }
+  gst_pad_set_offset (pad, offset);
+
   /* Link elements */
   gst_pad_link (pad, sink_pad);
   g_object_unref (sink_pad);
 }
 
+static GstPadProbeReturn
+melo_player_radio_probe (GstPad *pad, GstPadProbeInfo *info,
+                         gpointer user_data)
+{
+  MeloPlayerRadio *pradio = MELO_PLAYER_RADIO (user_data);
+  MeloPlayerRadioPrivate *priv = pradio->priv;
+  GstClockTime end;
+  GstBuffer *buffer;
+  GstEvent *event;
+  gint64 duration;
+
+  /* Save running time of last buffered audio */
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+    buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+    if (GST_BUFFER_PTS_IS_VALID (buffer)) {
+      end = GST_BUFFER_PTS (buffer);
+      if (GST_BUFFER_DURATION_IS_VALID (buffer))
+        end += GST_BUFFER_DURATION (buffer);
+      end = gst_segment_to_running_time (&priv->segment, GST_FORMAT_TIME, end);
+      if (GST_CLOCK_TIME_IS_VALID (end))
+        priv->running_end = end;
+    }
+
+    /* Stream is flowing: reset reconnect attempts */
+    g_atomic_int_set (&priv->started, TRUE);
+    g_atomic_int_set (&priv->retries, 0);
+    return GST_PAD_PROBE_OK;
+  }
+
+  event = GST_PAD_PROBE_INFO_EVENT (info);
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_SEGMENT:
+      gst_event_copy_segment (event, &priv->segment);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      gst_segment_init (&priv->segment, GST_FORMAT_TIME);
+      break;
+    case GST_EVENT_EOS:
+      /* Keep end of a finite stream */
+      if (gst_pad_peer_query_duration (pad, GST_FORMAT_TIME, &duration) &&
+          duration > 0)
+        break;
+
+      /* Live stream has been closed: keep playing buffer and reconnect */
+      gst_element_post_message (priv->queue,
+                      gst_message_new_application (GST_OBJECT (priv->queue),
+                             gst_structure_new_empty ("melo-radio-reconnect")));
+      return GST_PAD_PROBE_DROP;
+    default:
+      ;
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+melo_player_radio_running (GstElement *queue, gpointer user_data)
+{
+  /* Pre-roll is done: drain ring buffer freely on network stalls */
+  g_object_set (queue, "min-threshold-time", (guint64) 0, NULL);
+}
+
 static gboolean
 melo_player_radio_setup (MeloPlayer *player, const gchar *path,
                          const gchar *name, MeloTags *tags, gboolean insert,
@@ -313,8 +527,9 @@ melo_player_radio_setup (MeloPlayer *player, const gchar *path,
   if (!name)
     name = "Unknown radio";
 
-  /* Stop pipeline */
-  gst_element_set_state (priv->pipeline, GST_STATE_NULL);
+  /* Go back to ready: audio sink is kept opened between stations */
+  gst_element_set_state (priv->pipeline, GST_STATE_READY);
+  melo_player_radio_cancel_reconnect (priv);
 
   /* Replace status */
   if (priv->btags) {
@@ -330,8 +545,11 @@ melo_player_radio_setup (MeloPlayer *player, const gchar *path,
   if (tags)
     priv->btags = melo_tags_ref (tags);
 
-  /* Set new location to src element */
+  /* Set new location to src element and wait for a short pre-roll */
   g_object_set (priv->src, "uri", path, NULL);
+  g_object_set (priv->queue, "min-threshold-time",
+                (guint64) priv->preroll_time * GST_MSECOND, NULL);
+  melo_sink_start_load (priv->sink);
   if (state == MELO_PLAYER_STATE_LOADING) {
     priv->load = FALSE;
     gst_element_set_state (priv->pipeline, GST_STATE_PLAYING);
@@ -371,6 +589,13 @@ melo_player_radio_set_state (MeloPlayer *player, MeloPlayerState state)
 {
   MeloPlayerRadioPrivate *priv = (MELO_PLAYER_RADIO (player))->priv;
 
+  /* Drop pending reconnect when stopped */
+  if (state == MELO_PLAYER_STATE_NONE || state == MELO_PLAYER_STATE_STOPPED) {
+    g_mutex_lock (&priv->mutex);
+    melo_player_radio_cancel_reconnect (priv);
+    g_mutex_unlock (&priv->mutex);
+  }
+
   if (state == MELO_PLAYER_STATE_NONE) {
     gst_element_set_state (priv->pipeline, GST_STATE_NULL);
     melo_player_reset_status (player, MELO_PLAYER_STATE_NONE, NULL, NULL);
@@ -421,3 +646,21 @@ melo_player_radio_get_pos (MeloPlayer *player)
 
   return pos / 1000000;
 }
+
+void
+melo_player_radio_set_buffer (MeloPlayerRadio *pradio, guint buffer_time,
+                              guint preroll_time)
+{
+  MeloPlayerRadioPrivate *priv = pradio->priv;
+
+  /* Pre-roll must fit in ring buffer */
+  if (preroll_time > buffer_time)
+    preroll_time = buffer_time;
+
+  g_mutex_lock (&priv->mutex);
+  priv->buffer_time = buffer_time;
+  priv->preroll_time = preroll_time;
+  g_object_set (priv->queue, "max-size-time",
+                (guint64) buffer_time * GST_MSECOND, NULL);
+  g_mutex_unlock (&priv->mutex);
+}
@@ -50,6 +50,10 @@ struct _MeloPlayerRadioClass {
 
 GType melo_player_radio_get_type (void);
 
+/* Set ring buffer size and pre-roll before playing a new stream (in ms) */
+void melo_player_radio_set_buffer (MeloPlayerRadio *pradio, guint buffer_time,
+                                   guint preroll_time);
+
 G_END_DECLS
 
 #endif /* __MELO_PLAYER_RADIO_H__ */
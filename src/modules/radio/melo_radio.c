@@ -19,6 +19,8 @@
  * Boston, MA  02110-1301, USA.
  */
 
+#include "melo_memory.h"
+
 #include "melo_radio.h"
 #include "melo_browser_radio.h"
 #include "melo_player_radio.h"
@@ -58,6 +60,7 @@ melo_radio_finalize (GObject *gobject)
   }
 
   if (priv->radios) {
+    melo_memory_unregister ("radio_cache");
     melo_module_unregister_browser (MELO_MODULE (gobject), "radio_radios");
     g_object_unref (priv->radios);
   }
@@ -78,10 +81,23 @@ melo_radio_class_init (MeloRadioClass *klass)
   oclass->finalize = melo_radio_finalize;
 }
 
+static void
+melo_radio_memory_usage (MeloMemoryUsage *usage, gpointer user_data)
+{
+  melo_browser_radio_get_cache_usage (user_data, usage);
+}
+
+static void
+melo_radio_memory_trim (gsize budget, gpointer user_data)
+{
+  melo_browser_radio_trim_cache (user_data);
+}
+
 static void
 melo_radio_init (MeloRadio *self)
 {
   MeloRadioPrivate *priv = melo_radio_get_instance_private (self);
+  gchar *path;
 
   self->priv = priv;
   priv->radios = melo_browser_new (MELO_TYPE_BROWSER_RADIO, "radio_radios");
@@ -93,6 +109,14 @@ melo_radio_init (MeloRadio *self)
   if (!priv->radios || !priv->player || !priv->player)
     return;
 
+  /* Save radio directory responses on disk */
+  path = g_strdup_printf ("%s/melo/radio", g_get_user_cache_dir ());
+  melo_browser_radio_set_cache (MELO_BROWSER_RADIO (priv->radios),
+                                MELO_BROWSER_RADIO_CACHE_TTL, path);
+  g_free (path);
+  melo_memory_register ("radio_cache", melo_radio_memory_usage,
+                        melo_radio_memory_trim, priv->radios);
+
   /* Catch new browser registration */
   g_signal_connect (self, "register-browser",
                     (GCallback) melo_radio_register_browser, NULL);
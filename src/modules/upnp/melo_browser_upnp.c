@@ -0,0 +1,1052 @@
+/*
+ * melo_browser_upnp.c: UPnP / DLNA media server browser
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <libsoup/soup.h>
+#include <libgupnp/gupnp.h>
+#include <libgupnp-av/gupnp-av.h>
+
+#include "melo_browser_upnp.h"
+
+/* Media server and content directory types */
+#define MELO_BROWSER_UPNP_SERVER "urn:schemas-upnp-org:device:MediaServer:1"
+#define MELO_BROWSER_UPNP_CDS "urn:schemas-upnp-org:service:ContentDirectory:1"
+
+/* Timeout of actions sent to media servers (in s) */
+#define MELO_BROWSER_UPNP_TIMEOUT 10
+
+/* UPnP browser info */
+static MeloBrowserInfo melo_browser_upnp_info = {
+  .name = "Browse media servers",
+  .description = "Navigate through UPnP / DLNA media servers of the network",
+  .tags_support = TRUE,
+  .tags_cache_support = TRUE,
+  /* Search feature */
+  .search_support = TRUE,
+  .search_input_text = "Type a title, an artist or an album...",
+  .search_button_text = "Search",
+};
+
+static const MeloBrowserInfo *melo_browser_upnp_get_info (
+                                                          MeloBrowser *browser);
+static MeloBrowserList *melo_browser_upnp_get_list (MeloBrowser *browser,
+                                        const gchar *path,
+                                        const MeloBrowserGetListParams *params);
+static MeloBrowserList *melo_browser_upnp_search (MeloBrowser *browser,
+                                         const gchar *input,
+                                         const MeloBrowserSearchParams *params);
+static MeloTags *melo_browser_upnp_get_tags (MeloBrowser *browser,
+                                             const gchar *path,
+                                             MeloTagsFields fields);
+static gboolean melo_browser_upnp_action (MeloBrowser *browser,
+                                          const gchar *path,
+                                          MeloBrowserItemAction action,
+                                          const MeloBrowserActionParams *params);
+
+static void on_context_available (GUPnPContextManager *manager,
+                                  GUPnPContext *context, gpointer user_data);
+static void on_system_update_id (GUPnPServiceProxy *proxy,
+                                 const char *variable, GValue *value,
+                                 gpointer user_data);
+
+typedef struct {
+  gchar *key;
+  GList *link;
+
+  /* DIDL-Lite result and total matches */
+  gchar *result;
+  guint total;
+} MeloBrowserUpnpPage;
+
+typedef struct {
+  MeloBrowserUpnp *bupnp;
+  gchar *udn;
+  gchar *name;
+
+  /* Content directory service */
+  GUPnPServiceProxy *cds;
+  gchar *control_url;
+  gchar *service_type;
+  gchar *search_caps;
+
+  /* Result pages cache: valid until SystemUpdateID changes */
+  guint32 update_id;
+  gboolean evented;
+  GHashTable *pages;
+  GQueue lru;
+} MeloBrowserUpnpServer;
+
+typedef struct {
+  gint depth;
+  gchar *name;
+  GString *text;
+  GHashTable *args;
+} MeloBrowserUpnpSoap;
+
+typedef struct {
+  const gchar *prefix;
+  gboolean tags;
+  GList *items;
+} MeloBrowserUpnpList;
+
+typedef struct {
+  MeloTags *tags;
+  gchar *name;
+  gchar *uri;
+} MeloBrowserUpnpMeta;
+
+struct _MeloBrowserUpnpPrivate {
+  GMutex mutex;
+  SoupSession *session;
+
+  /* Media servers discovery */
+  GUPnPContextManager *manager;
+  GList *servers;
+};
+
+G_DEFINE_TYPE_WITH_PRIVATE (MeloBrowserUpnp, melo_browser_upnp, MELO_TYPE_BROWSER)
+
+static void
+melo_browser_upnp_page_free (gpointer data)
+{
+  MeloBrowserUpnpPage *page = data;
+
+  g_free (page->result);
+  g_free (page->key);
+  g_slice_free (MeloBrowserUpnpPage, page);
+}
+
+/* Must be called with browser locked */
+static void
+melo_browser_upnp_server_flush (MeloBrowserUpnpServer *server)
+{
+  g_queue_clear (&server->lru);
+  g_hash_table_remove_all (server->pages);
+}
+
+static void
+melo_browser_upnp_server_free (MeloBrowserUpnpServer *server)
+{
+  /* Stop events */
+  gupnp_service_proxy_remove_notify (server->cds, "SystemUpdateID",
+                                     on_system_update_id, server);
+  g_signal_handlers_disconnect_by_data (server->cds, server);
+  gupnp_service_proxy_set_subscribed (server->cds, FALSE);
+  g_object_unref (server->cds);
+
+  /* Free result pages cache */
+  melo_browser_upnp_server_flush (server);
+  g_hash_table_unref (server->pages);
+
+  g_free (server->search_caps);
+  g_free (server->service_type);
+  g_free (server->control_url);
+  g_free (server->name);
+  g_free (server->udn);
+  g_slice_free (MeloBrowserUpnpServer, server);
+}
+
+static void
+melo_browser_upnp_finalize (GObject *gobject)
+{
+  MeloBrowserUpnp *browser_upnp = MELO_BROWSER_UPNP (gobject);
+  MeloBrowserUpnpPrivate *priv =
+                          melo_browser_upnp_get_instance_private (browser_upnp);
+
+  /* Free UPnP context manager and its control points */
+  g_object_unref (priv->manager);
+
+  /* Free media servers */
+  g_list_free_full (priv->servers,
+                    (GDestroyNotify) melo_browser_upnp_server_free);
+
+  /* Free Soup session */
+  g_object_unref (priv->session);
+
+  /* Clear mutex */
+  g_mutex_clear (&priv->mutex);
+
+  /* Chain up to the parent class */
+  G_OBJECT_CLASS (melo_browser_upnp_parent_class)->finalize (gobject);
+}
+
+static void
+melo_browser_upnp_class_init (MeloBrowserUpnpClass *klass)
+{
+  MeloBrowserClass *bclass = MELO_BROWSER_CLASS (klass);
+  GObjectClass *oclass = G_OBJECT_CLASS (klass);
+
+  bclass->get_info = melo_browser_upnp_get_info;
+  bclass->get_list = melo_browser_upnp_get_list;
+  bclass->search = melo_browser_upnp_search;
+  bclass->get_tags = melo_browser_upnp_get_tags;
+  bclass->action = melo_browser_upnp_action;
+
+  /* Add custom finalize() function */
+  oclass->finalize = melo_browser_upnp_finalize;
+}
+
+static void
+melo_browser_upnp_init (MeloBrowserUpnp *self)
+{
+  MeloBrowserUpnpPrivate *priv = melo_browser_upnp_get_instance_private (self);
+
+  self->priv = priv;
+
+  /* Init mutex */
+  g_mutex_init (&priv->mutex);
+
+  /* Create a new Soup session for actions */
+  priv->session = soup_session_new_with_options (
+                                SOUP_SESSION_USER_AGENT, "Melo",
+                                SOUP_SESSION_TIMEOUT, MELO_BROWSER_UPNP_TIMEOUT,
+                                NULL);
+
+  /* Create a new UPnP context manager to discover media servers */
+  priv->manager = gupnp_context_manager_create (0);
+  g_signal_connect (priv->manager, "context-available",
+                    (GCallback) on_context_available, self);
+}
+
+static const MeloBrowserInfo *
+melo_browser_upnp_get_info (MeloBrowser *browser)
+{
+  return &melo_browser_upnp_info;
+}
+
+/* Must be called with browser locked */
+static MeloBrowserUpnpServer *
+melo_browser_upnp_server_find (MeloBrowserUpnpPrivate *priv, const gchar *udn)
+{
+  GList *l;
+
+  for (l = priv->servers; l != NULL; l = l->next) {
+    MeloBrowserUpnpServer *server = l->data;
+
+    if (!g_strcmp0 (server->udn, udn))
+      return server;
+  }
+
+  return NULL;
+}
+
+static void
+on_system_update_id (GUPnPServiceProxy *proxy, const char *variable,
+                     GValue *value, gpointer user_data)
+{
+  MeloBrowserUpnpServer *server = user_data;
+  MeloBrowserUpnpPrivate *priv = server->bupnp->priv;
+  guint32 id;
+
+  /* Get new system update ID */
+  id = g_value_get_uint (value);
+
+  /* Content has changed on server: drop cached pages */
+  g_mutex_lock (&priv->mutex);
+  if (id != server->update_id)
+    melo_browser_upnp_server_flush (server);
+  server->update_id = id;
+  server->evented = TRUE;
+  g_mutex_unlock (&priv->mutex);
+}
+
+static void
+on_subscription_lost (GUPnPServiceProxy *proxy, const GError *error,
+                      gpointer user_data)
+{
+  MeloBrowserUpnpServer *server = user_data;
+  MeloBrowserUpnpPrivate *priv = server->bupnp->priv;
+
+  /* System update ID must be requested before using cache */
+  g_mutex_lock (&priv->mutex);
+  server->evented = FALSE;
+  g_mutex_unlock (&priv->mutex);
+}
+
+static void
+on_server_available (GUPnPControlPoint *cp, GUPnPDeviceProxy *proxy,
+                     gpointer user_data)
+{
+  MeloBrowserUpnp *bupnp = MELO_BROWSER_UPNP (user_data);
+  MeloBrowserUpnpPrivate *priv = bupnp->priv;
+  GUPnPDeviceInfo *info = GUPNP_DEVICE_INFO (proxy);
+  MeloBrowserUpnpServer *server;
+  GUPnPServiceInfo *cds;
+  const gchar *udn;
+
+  /* Server already found on another interface */
+  udn = gupnp_device_info_get_udn (info);
+  g_mutex_lock (&priv->mutex);
+  server = melo_browser_upnp_server_find (priv, udn);
+  g_mutex_unlock (&priv->mutex);
+  if (!udn || server)
+    return;
+
+  /* Get content directory service */
+  cds = gupnp_device_info_get_service (info, MELO_BROWSER_UPNP_CDS);
+  if (!cds)
+    return;
+
+  /* Create new media server */
+  server = g_slice_new0 (MeloBrowserUpnpServer);
+  server->bupnp = bupnp;
+  server->udn = g_strdup (udn);
+  server->name = gupnp_device_info_get_friendly_name (info);
+  server->cds = GUPNP_SERVICE_PROXY (cds);
+  server->control_url = gupnp_service_info_get_control_url (cds);
+  server->service_type = g_strdup (gupnp_service_info_get_service_type (cds));
+  server->pages = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                         melo_browser_upnp_page_free);
+  g_queue_init (&server->lru);
+
+  /* Be notified of content changes */
+  gupnp_service_proxy_add_notify (server->cds, "SystemUpdateID", G_TYPE_UINT,
+                                  on_system_update_id, server);
+  g_signal_connect (server->cds, "subscription-lost",
+                    (GCallback) on_subscription_lost, server);
+  gupnp_service_proxy_set_subscribed (server->cds, TRUE);
+
+  /* Add media server to list */
+  g_mutex_lock (&priv->mutex);
+  priv->servers = g_list_append (priv->servers, server);
+  g_mutex_unlock (&priv->mutex);
+}
+
+static void
+on_server_unavailable (GUPnPControlPoint *cp, GUPnPDeviceProxy *proxy,
+                       gpointer user_data)
+{
+  MeloBrowserUpnpPrivate *priv = (MELO_BROWSER_UPNP (user_data))->priv;
+  MeloBrowserUpnpServer *server;
+  const gchar *udn;
+
+  /* Remove media server from list */
+  udn = gupnp_device_info_get_udn (GUPNP_DEVICE_INFO (proxy));
+  g_mutex_lock (&priv->mutex);
+  server = melo_browser_upnp_server_find (priv, udn);
+  if (server)
+    priv->servers = g_list_remove (priv->servers, server);
+  g_mutex_unlock (&priv->mutex);
+
+  /* Free media server */
+  if (server)
+    melo_browser_upnp_server_free (server);
+}
+
+static void
+on_context_available (GUPnPContextManager *manager, GUPnPContext *context,
+                      gpointer user_data)
+{
+  GUPnPControlPoint *cp;
+
+  /* Find media servers on new network interface */
+  cp = gupnp_control_point_new (context, MELO_BROWSER_UPNP_SERVER);
+  g_signal_connect (cp, "device-proxy-available",
+                    (GCallback) on_server_available, user_data);
+  g_signal_connect (cp, "device-proxy-unavailable",
+                    (GCallback) on_server_unavailable, user_data);
+  gssdp_resource_browser_set_active (GSSDP_RESOURCE_BROWSER (cp), TRUE);
+
+  /* Control point is released with its context */
+  gupnp_context_manager_manage_control_point (manager, cp);
+  g_object_unref (cp);
+}
+
+static void
+melo_browser_upnp_soap_start (GMarkupParseContext *context,
+                              const gchar *element_name,
+                              const gchar **attribute_names,
+                              const gchar **attribute_values,
+                              gpointer user_data, GError **error)
+{
+  MeloBrowserUpnpSoap *soap = user_data;
+  const gchar *name;
+
+  /* Output arguments are children of action response in SOAP body */
+  if (++soap->depth != 4)
+    return;
+
+  /* Strip namespace prefix */
+  name = strchr (element_name, ':');
+  g_free (soap->name);
+  soap->name = g_strdup (name ? name + 1 : element_name);
+  g_string_truncate (soap->text, 0);
+}
+
+static void
+melo_browser_upnp_soap_end (GMarkupParseContext *context,
+                            const gchar *element_name, gpointer user_data,
+                            GError **error)
+{
+  MeloBrowserUpnpSoap *soap = user_data;
+
+  if (soap->depth-- != 4 || !soap->name)
+    return;
+
+  /* Save output argument */
+  g_hash_table_insert (soap->args, soap->name,
+                       g_strndup (soap->text->str, soap->text->len));
+  soap->name = NULL;
+}
+
+static void
+melo_browser_upnp_soap_text (GMarkupParseContext *context, const gchar *text,
+                             gsize text_len, gpointer user_data,
+                             GError **error)
+{
+  MeloBrowserUpnpSoap *soap = user_data;
+
+  if (soap->depth == 4 && soap->name)
+    g_string_append_len (soap->text, text, text_len);
+}
+
+/* Send an action to a content directory and wait for its response: a table
+ * of output arguments is returned, or %NULL on failure.
+ */
+static GHashTable *
+melo_browser_upnp_soap (MeloBrowserUpnp *bupnp, const gchar *url,
+                        const gchar *type, const gchar *action,
+                        const gchar *args)
+{
+  static const GMarkupParser parser = {
+    melo_browser_upnp_soap_start,
+    melo_browser_upnp_soap_end,
+    melo_browser_upnp_soap_text,
+    NULL,
+    NULL,
+  };
+  MeloBrowserUpnpSoap soap = { 0 };
+  GMarkupParseContext *ctx;
+  SoupMessage *msg;
+  gchar *body, *value;
+
+  /* Create SOAP request */
+  msg = soup_message_new ("POST", url);
+  if (!msg)
+    return NULL;
+  body = g_strdup_printf ("<?xml version=\"1.0\" encoding=\"utf-8\"?>"
+                   "<s:Envelope "
+                   "xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" "
+                   "s:encodingStyle="
+                   "\"http://schemas.xmlsoap.org/soap/encoding/\">"
+                   "<s:Body><u:%s xmlns:u=\"%s\">%s</u:%s></s:Body>"
+                   "</s:Envelope>", action, type, args, action);
+  soup_message_set_request (msg, "text/xml; charset=\"utf-8\"",
+                            SOUP_MEMORY_TAKE, body, strlen (body));
+  value = g_strdup_printf ("\"%s#%s\"", type, action);
+  soup_message_headers_append (msg->request_headers, "SOAPAction", value);
+  g_free (value);
+
+  /* Send message and wait answer */
+  if (soup_session_send_message (bupnp->priv->session, msg) != SOUP_STATUS_OK)
+    goto end;
+
+  /* Parse output arguments */
+  soap.args = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  soap.text = g_string_new (NULL);
+  ctx = g_markup_parse_context_new (&parser, 0, &soap, NULL);
+  if (!g_markup_parse_context_parse (ctx, msg->response_body->data,
+                                     msg->response_body->length, NULL) ||
+      !g_markup_parse_context_end_parse (ctx, NULL)) {
+    g_hash_table_unref (soap.args);
+    soap.args = NULL;
+  }
+  g_markup_parse_context_free (ctx);
+  g_string_free (soap.text, TRUE);
+  g_free (soap.name);
+
+end:
+  g_object_unref (msg);
+  return soap.args;
+}
+
+static gboolean
+melo_browser_upnp_get_update_id (MeloBrowserUpnp *bupnp, const gchar *url,
+                                 const gchar *type, guint32 *update_id)
+{
+  const gchar *value;
+  GHashTable *out;
+
+  /* Get current system update ID */
+  out = melo_browser_upnp_soap (bupnp, url, type, "GetSystemUpdateID", "");
+  if (!out)
+    return FALSE;
+  value = g_hash_table_lookup (out, "Id");
+  if (value)
+    *update_id = strtoul (value, NULL, 10);
+  g_hash_table_unref (out);
+
+  return value != NULL;
+}
+
+/* Send a Browse or a Search action, or get its result from the cache of the
+ * server: the DIDL-Lite result is returned and the total number of matches is
+ * set in @total. The @args must contain escaped arguments preceding the
+ * "Filter" argument.
+ */
+static gchar *
+melo_browser_upnp_query (MeloBrowserUpnp *bupnp, const gchar *udn,
+                         const gchar *action, const gchar *args, gint offset,
+                         gint count, guint *total)
+{
+  MeloBrowserUpnpPrivate *priv = bupnp->priv;
+  gchar *url = NULL, *type = NULL, *key, *req, *result = NULL;
+  MeloBrowserUpnpServer *server;
+  MeloBrowserUpnpPage *page;
+  const gchar *value;
+  guint32 update_id;
+  gboolean evented;
+  GHashTable *out;
+
+  *total = 0;
+  if (count < 0)
+    count = 0;
+  key = g_strdup_printf ("%s\n%s\n%d\n%d", action, args, offset, count);
+
+  /* Find server and cached page */
+  g_mutex_lock (&priv->mutex);
+  server = melo_browser_upnp_server_find (priv, udn);
+  if (!server)
+    goto unlock;
+  page = g_hash_table_lookup (server->pages, key);
+  if (page && server->evented)
+    goto hit;
+  url = g_strdup (server->control_url);
+  type = g_strdup (server->service_type);
+  update_id = server->update_id;
+  evented = server->evented;
+  g_mutex_unlock (&priv->mutex);
+
+  /* Content changes are not evented: check system update ID */
+  if (!evented && melo_browser_upnp_get_update_id (bupnp, url, type,
+                                                   &update_id)) {
+    g_mutex_lock (&priv->mutex);
+    server = melo_browser_upnp_server_find (priv, udn);
+    if (server && !server->evented) {
+      if (update_id != server->update_id)
+        melo_browser_upnp_server_flush (server);
+      server->update_id = update_id;
+      page = g_hash_table_lookup (server->pages, key);
+      if (page)
+        goto hit;
+    }
+    g_mutex_unlock (&priv->mutex);
+  }
+
+  /* Request page directly to server */
+  req = g_strdup_printf ("%s<Filter>*</Filter>"
+                         "<StartingIndex>%d</StartingIndex>"
+                         "<RequestedCount>%d</RequestedCount>"
+                         "<SortCriteria></SortCriteria>", args, offset, count);
+  out = melo_browser_upnp_soap (bupnp, url, type, action, req);
+  g_free (req);
+  if (!out)
+    goto end;
+
+  /* Get result */
+  result = g_strdup (g_hash_table_lookup (out, "Result"));
+  value = g_hash_table_lookup (out, "TotalMatches");
+  if (value)
+    *total = strtoul (value, NULL, 10);
+  g_hash_table_unref (out);
+  if (!result)
+    goto end;
+
+  /* Save page in cache if content has not changed in between */
+  g_mutex_lock (&priv->mutex);
+  server = melo_browser_upnp_server_find (priv, udn);
+  if (server && server->update_id == update_id &&
+      !g_hash_table_contains (server->pages, key)) {
+    page = g_slice_new0 (MeloBrowserUpnpPage);
+    page->key = key;
+    page->result = g_strdup (result);
+    page->total = *total;
+    g_hash_table_insert (server->pages, page->key, page);
+    g_queue_push_head (&server->lru, page);
+    page->link = server->lru.head;
+    key = NULL;
+
+    /* Drop least recently used page */
+    if (server->lru.length > MELO_BROWSER_UPNP_CACHE_SIZE) {
+      page = g_queue_pop_tail (&server->lru);
+      g_hash_table_remove (server->pages, page->key);
+    }
+  }
+  g_mutex_unlock (&priv->mutex);
+  goto end;
+
+hit:
+  /* Move page on top of cache */
+  g_queue_unlink (&server->lru, page->link);
+  g_queue_push_head_link (&server->lru, page->link);
+  result = g_strdup (page->result);
+  *total = page->total;
+unlock:
+  g_mutex_unlock (&priv->mutex);
+end:
+  g_free (type);
+  g_free (url);
+  g_free (key);
+  return result;
+}
+
+static MeloTags *
+melo_browser_upnp_get_object_tags (GUPnPDIDLLiteObject *object)
+{
+  const gchar *img;
+  MeloTags *tags;
+  gint track;
+
+  /* Generate a new tags */
+  tags = melo_tags_new ();
+  if (!tags)
+    return NULL;
+
+  /* Fill with basic tags */
+  tags->title = melo_tags_intern_string (
+                                    gupnp_didl_lite_object_get_title (object));
+  tags->artist = melo_tags_intern_string (
+                                   gupnp_didl_lite_object_get_artist (object));
+  tags->album = melo_tags_intern_string (
+                                   gupnp_didl_lite_object_get_album (object));
+  tags->genre = melo_tags_intern_string (
+                                   gupnp_didl_lite_object_get_genre (object));
+  track = gupnp_didl_lite_object_get_track_number (object);
+  if (track > 0)
+    tags->track = track;
+
+  /* Set image cover */
+  img = gupnp_didl_lite_object_get_album_art (object);
+  if (img)
+    melo_tags_set_cover_by_url (tags, img, MELO_TAGS_COVER_PERSIST_EXIT);
+
+  return tags;
+}
+
+static void
+on_object_available (GUPnPDIDLLiteParser *parser, GUPnPDIDLLiteObject *object,
+                     gpointer user_data)
+{
+  MeloBrowserUpnpList *list = user_data;
+  MeloBrowserItem *item;
+  gchar *id, *tmp;
+
+  /* Generate item ID from object ID */
+  id = g_uri_escape_string (gupnp_didl_lite_object_get_id (object), NULL,
+                            FALSE);
+  if (list->prefix) {
+    tmp = g_strconcat (list->prefix, "/", id, NULL);
+    g_free (id);
+    id = tmp;
+  }
+
+  /* Create new item */
+  if (GUPNP_IS_DIDL_LITE_CONTAINER (object))
+    item = melo_browser_item_new (id, MELO_BROWSER_ITEM_TYPE_FOLDER);
+  else {
+    item = melo_browser_item_new (id, MELO_BROWSER_ITEM_TYPE_MEDIA);
+    item->actions = MELO_BROWSER_ITEM_ACTION_FIELDS_PLAY;
+  }
+  item->name = g_strdup (gupnp_didl_lite_object_get_title (object));
+  g_free (id);
+
+  /* Tags are provided with object */
+  if (list->tags)
+    item->tags = melo_browser_upnp_get_object_tags (object);
+
+  /* Add item to list */
+  list->items = g_list_prepend (list->items, item);
+}
+
+static GList *
+melo_browser_upnp_parse (const gchar *didl, const gchar *prefix,
+                         gboolean tags)
+{
+  MeloBrowserUpnpList list = { prefix, tags, NULL };
+  GUPnPDIDLLiteParser *parser;
+
+  if (!didl)
+    return NULL;
+
+  /* Parse result with GUPnP parser */
+  parser = gupnp_didl_lite_parser_new ();
+  g_signal_connect (parser, "object-available",
+                    (GCallback) on_object_available, &list);
+  gupnp_didl_lite_parser_parse_didl (parser, didl, NULL);
+  g_object_unref (parser);
+
+  /* Reverse list */
+  return g_list_reverse (list.items);
+}
+
+/* Split a path into the server UDN and the object ID: the root container is
+ * used when path has no object part.
+ */
+static gboolean
+melo_browser_upnp_parse_path (const gchar *path, gchar **udn, gchar **id)
+{
+  gchar **parts;
+
+  /* Split path */
+  while (*path == '/')
+    path++;
+  parts = g_strsplit (path, "/", 3);
+  if (!parts[0] || !*parts[0]) {
+    g_strfreev (parts);
+    return FALSE;
+  }
+
+  /* Get server and object */
+  *id = parts[1] && *parts[1] ? g_uri_unescape_string (parts[1], NULL) :
+                                g_strdup ("0");
+  *udn = *id ? g_strdup (parts[0]) : NULL;
+  g_strfreev (parts);
+
+  return *id != NULL;
+}
+
+static GList *
+melo_browser_upnp_get_servers (MeloBrowserUpnp *bupnp, gint offset, gint count,
+                               gint *total)
+{
+  MeloBrowserUpnpPrivate *priv = bupnp->priv;
+  GList *list = NULL, *l;
+
+  /* Get requested part of media servers list */
+  g_mutex_lock (&priv->mutex);
+  *total = g_list_length (priv->servers);
+  for (l = g_list_nth (priv->servers, offset); l && count; l = l->next) {
+    MeloBrowserUpnpServer *server = l->data;
+    MeloBrowserItem *item;
+
+    /* Create new item */
+    item = melo_browser_item_new (server->udn, MELO_BROWSER_ITEM_TYPE_REMOTE);
+    item->name = g_strdup (server->name);
+    list = g_list_prepend (list, item);
+    count--;
+  }
+  g_mutex_unlock (&priv->mutex);
+
+  /* Reverse list */
+  return g_list_reverse (list);
+}
+
+static MeloBrowserList *
+melo_browser_upnp_get_list (MeloBrowser *browser, const gchar *path,
+                            const MeloBrowserGetListParams *params)
+{
+  MeloBrowserUpnp *bupnp = MELO_BROWSER_UPNP (browser);
+  MeloBrowserList *list;
+  gchar *udn, *id, *args, *result;
+  gboolean tags;
+  guint total;
+
+  /* Create browser list */
+  list = melo_browser_list_new (path);
+  if (!list)
+    return NULL;
+
+  /* List media servers */
+  if (!melo_browser_upnp_parse_path (path, &udn, &id)) {
+    list->items = melo_browser_upnp_get_servers (bupnp, params->offset,
+                                                 params->count, &list->count);
+    return list;
+  }
+
+  /* Browse container: the page is requested to server, not the full list */
+  tags = params->tags_mode != MELO_BROWSER_TAGS_MODE_NONE;
+  args = g_markup_printf_escaped ("<ObjectID>%s</ObjectID>"
+                                  "<BrowseFlag>BrowseDirectChildren"
+                                  "</BrowseFlag>", id);
+  result = melo_browser_upnp_query (bupnp, udn, "Browse", args,
+                                    params->offset, params->count, &total);
+  list->items = melo_browser_upnp_parse (result, NULL, tags);
+  list->count = total;
+  g_free (result);
+  g_free (args);
+  g_free (udn);
+  g_free (id);
+
+  return list;
+}
+
+static gchar *
+melo_browser_upnp_get_search_caps (MeloBrowserUpnp *bupnp, const gchar *udn)
+{
+  MeloBrowserUpnpPrivate *priv = bupnp->priv;
+  MeloBrowserUpnpServer *server;
+  gchar *url, *type, *caps;
+  GHashTable *out;
+
+  /* Get search capabilities of server */
+  g_mutex_lock (&priv->mutex);
+  server = melo_browser_upnp_server_find (priv, udn);
+  if (!server || server->search_caps) {
+    caps = server ? g_strdup (server->search_caps) : NULL;
+    g_mutex_unlock (&priv->mutex);
+    return caps;
+  }
+  url = g_strdup (server->control_url);
+  type = g_strdup (server->service_type);
+  g_mutex_unlock (&priv->mutex);
+
+  /* Request search capabilities */
+  out = melo_browser_upnp_soap (bupnp, url, type, "GetSearchCapabilities", "");
+  caps = out ? g_strdup (g_hash_table_lookup (out, "SearchCaps")) : NULL;
+  if (out)
+    g_hash_table_unref (out);
+  g_free (type);
+  g_free (url);
+
+  /* Save search capabilities */
+  g_mutex_lock (&priv->mutex);
+  server = melo_browser_upnp_server_find (priv, udn);
+  if (server && caps && !server->search_caps)
+    server->search_caps = g_strdup (caps);
+  g_mutex_unlock (&priv->mutex);
+
+  return caps;
+}
+
+static gchar *
+melo_browser_upnp_get_search_criteria (MeloBrowserUpnp *bupnp,
+                                       const gchar *udn, const gchar *input)
+{
+  static const gchar *props[] = {
+    "dc:title", "upnp:artist", "upnp:album", "upnp:genre", NULL
+  };
+  gchar *caps, **list, *criteria = NULL;
+  GString *value, *str;
+  const gchar *p;
+  gboolean all;
+  gint i;
+
+  /* Get search capabilities */
+  caps = melo_browser_upnp_get_search_caps (bupnp, udn);
+  if (!caps || !*caps) {
+    g_free (caps);
+    return NULL;
+  }
+  list = g_strsplit (caps, ",", -1);
+  all = !g_strcmp0 (caps, "*");
+  g_free (caps);
+
+  /* Escape quotes in input */
+  value = g_string_new (NULL);
+  for (p = input; *p; p++) {
+    if (*p == '"' || *p == '\\')
+      g_string_append_c (value, '\\');
+    g_string_append_c (value, *p);
+  }
+
+  /* Match input on supported properties */
+  str = g_string_new (NULL);
+  for (i = 0; props[i]; i++) {
+    if (!all && !g_strv_contains ((const gchar * const *) list, props[i]))
+      continue;
+    g_string_append_printf (str, "%s%s contains \"%s\"", str->len ? " or " : "",
+                            props[i], value->str);
+  }
+
+  /* Search only media items */
+  if (str->len) {
+    if (all || g_strv_contains ((const gchar * const *) list, "upnp:class"))
+      criteria = g_strdup_printf ("upnp:class derivedfrom \"object.item\" and "
+                                  "(%s)", str->str);
+    else
+      criteria = g_strdup (str->str);
+  }
+  g_string_free (value, TRUE);
+  g_string_free (str, TRUE);
+  g_strfreev (list);
+
+  return criteria;
+}
+
+static MeloBrowserList *
+melo_browser_upnp_search (MeloBrowser *browser, const gchar *input,
+                          const MeloBrowserSearchParams *params)
+{
+  MeloBrowserUpnp *bupnp = MELO_BROWSER_UPNP (browser);
+  MeloBrowserUpnpPrivate *priv = bupnp->priv;
+  MeloBrowserList *list;
+  GList *udns = NULL, *l;
+  gint offset, count;
+  gboolean tags;
+
+  /* Create browser list */
+  list = melo_browser_list_new ("/");
+  if (!list)
+    return NULL;
+
+  /* Get media servers */
+  g_mutex_lock (&priv->mutex);
+  for (l = priv->servers; l != NULL; l = l->next) {
+    MeloBrowserUpnpServer *server = l->data;
+
+    udns = g_list_prepend (udns, g_strdup (server->udn));
+  }
+  g_mutex_unlock (&priv->mutex);
+  udns = g_list_reverse (udns);
+
+  /* Search on each server: the matches of all servers are concatenated */
+  tags = params->tags_mode != MELO_BROWSER_TAGS_MODE_NONE;
+  offset = params->offset;
+  count = params->count > 0 ? params->count : -1;
+  for (l = udns; l != NULL; l = l->next) {
+    gchar *criteria, *args, *result;
+    GList *items;
+    guint total;
+
+    /* Generate search criteria */
+    criteria = melo_browser_upnp_get_search_criteria (bupnp, l->data, input);
+    if (!criteria)
+      continue;
+
+    /* Get requested page of server matches */
+    args = g_markup_printf_escaped ("<ContainerID>0</ContainerID>"
+                                    "<SearchCriteria>%s</SearchCriteria>",
+                                    criteria);
+    result = melo_browser_upnp_query (bupnp, l->data, "Search", args, offset,
+                                      count, &total);
+    items = melo_browser_upnp_parse (result, l->data, tags);
+    g_free (result);
+    g_free (args);
+    g_free (criteria);
+
+    /* Add items to list */
+    list->items = g_list_concat (list->items, items);
+    list->count += total;
+    offset = MAX (offset - (gint) total, 0);
+    if (count > 0) {
+      count -= g_list_length (items);
+      if (count <= 0)
+        break;
+    }
+  }
+  g_list_free_full (udns, g_free);
+
+  return list;
+}
+
+static void
+on_metadata_available (GUPnPDIDLLiteParser *parser,
+                       GUPnPDIDLLiteObject *object, gpointer user_data)
+{
+  MeloBrowserUpnpMeta *meta = user_data;
+  GList *resources, *l;
+
+  /* Only first object is used */
+  if (meta->tags)
+    return;
+
+  /* Get tags and name */
+  meta->tags = melo_browser_upnp_get_object_tags (object);
+  meta->name = g_strdup (gupnp_didl_lite_object_get_title (object));
+
+  /* Use first resource served over HTTP */
+  resources = gupnp_didl_lite_object_get_resources (object);
+  for (l = resources; l != NULL && !meta->uri; l = l->next) {
+    const gchar *uri = gupnp_didl_lite_resource_get_uri (l->data);
+
+    if (uri && g_str_has_prefix (uri, "http"))
+      meta->uri = g_strdup (uri);
+  }
+  g_list_free_full (resources, g_object_unref);
+}
+
+static gboolean
+melo_browser_upnp_get_metadata (MeloBrowserUpnp *bupnp, const gchar *path,
+                                MeloBrowserUpnpMeta *meta)
+{
+  GUPnPDIDLLiteParser *parser;
+  gchar *udn, *id, *args, *result;
+  guint total;
+
+  /* Get server and object */
+  if (!melo_browser_upnp_parse_path (path, &udn, &id))
+    return FALSE;
+
+  /* Get object metadata */
+  args = g_markup_printf_escaped ("<ObjectID>%s</ObjectID>"
+                                  "<BrowseFlag>BrowseMetadata</BrowseFlag>",
+                                  id);
+  result = melo_browser_upnp_query (bupnp, udn, "Browse", args, 0, 0, &total);
+  g_free (args);
+  g_free (udn);
+  g_free (id);
+  if (!result)
+    return FALSE;
+
+  /* Parse metadata with GUPnP parser */
+  parser = gupnp_didl_lite_parser_new ();
+  g_signal_connect (parser, "object-available",
+                    (GCallback) on_metadata_available, meta);
+  gupnp_didl_lite_parser_parse_didl (parser, result, NULL);
+  g_object_unref (parser);
+  g_free (result);
+
+  return meta->tags != NULL;
+}
+
+static MeloTags *
+melo_browser_upnp_get_tags (MeloBrowser *browser, const gchar *path,
+                            MeloTagsFields fields)
+{
+  MeloBrowserUpnpMeta meta = { 0 };
+
+  /* Get object metadata */
+  melo_browser_upnp_get_metadata (MELO_BROWSER_UPNP (browser), path, &meta);
+  g_free (meta.name);
+  g_free (meta.uri);
+
+  return meta.tags;
+}
+
+static gboolean
+melo_browser_upnp_action (MeloBrowser *browser, const gchar *path,
+                          MeloBrowserItemAction action,
+                          const MeloBrowserActionParams *params)
+{
+  MeloBrowserUpnpMeta meta = { 0 };
+  gboolean ret = FALSE;
+
+  /* Only support play */
+  if (action != MELO_BROWSER_ITEM_ACTION_PLAY)
+    return FALSE;
+
+  /* Get media URI and tags, then play it */
+  melo_browser_upnp_get_metadata (MELO_BROWSER_UPNP (browser), path, &meta);
+  if (meta.uri)
+    ret = melo_player_play (browser->player, meta.uri, meta.name, meta.tags,
+                            FALSE);
+
+  /* Free metadata */
+  if (meta.tags)
+    melo_tags_unref (meta.tags);
+  g_free (meta.name);
+  g_free (meta.uri);
+
+  return ret;
+}
@@ -0,0 +1,58 @@
+/*
+ * melo_browser_upnp.h: UPnP / DLNA media server browser
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __MELO_BROWSER_UPNP_H__
+#define __MELO_BROWSER_UPNP_H__
+
+#include "melo_browser.h"
+
+G_BEGIN_DECLS
+
+#define MELO_TYPE_BROWSER_UPNP             (melo_browser_upnp_get_type ())
+#define MELO_BROWSER_UPNP(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), MELO_TYPE_BROWSER_UPNP, MeloBrowserUpnp))
+#define MELO_IS_BROWSER_UPNP(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), MELO_TYPE_BROWSER_UPNP))
+#define MELO_BROWSER_UPNP_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass), MELO_TYPE_BROWSER_UPNP, MeloBrowserUpnpClass))
+#define MELO_IS_BROWSER_UPNP_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass), MELO_TYPE_BROWSER_UPNP))
+#define MELO_BROWSER_UPNP_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj), MELO_TYPE_BROWSER_UPNP, MeloBrowserUpnpClass))
+
+typedef struct _MeloBrowserUpnp MeloBrowserUpnp;
+typedef struct _MeloBrowserUpnpClass MeloBrowserUpnpClass;
+typedef struct _MeloBrowserUpnpPrivate MeloBrowserUpnpPrivate;
+
+struct _MeloBrowserUpnp {
+  MeloBrowser parent_instance;
+
+  /*< private >*/
+  MeloBrowserUpnpPrivate *priv;
+};
+
+struct _MeloBrowserUpnpClass {
+  MeloBrowserClass parent_class;
+};
+
+/* Number of result pages cached per media server */
+#define MELO_BROWSER_UPNP_CACHE_SIZE 64
+
+GType melo_browser_upnp_get_type (void);
+
+G_END_DECLS
+
+#endif /* __MELO_BROWSER_UPNP_H__ */
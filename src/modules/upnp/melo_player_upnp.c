@@ -22,8 +22,12 @@
 #include <rygel-renderer-gst.h>
 
 #include "melo_sink.h"
+#include "melo_sched.h"
 #include "melo_player_upnp.h"
 
+static gboolean melo_player_upnp_play (MeloPlayer *player, const gchar *path,
+                                       const gchar *name, MeloTags *tags,
+                                       gboolean insert);
 static MeloPlayerState melo_player_upnp_set_state (MeloPlayer *player,
                                                    MeloPlayerState state);
 static gint melo_player_upnp_set_pos (MeloPlayer *player, gint pos);
@@ -36,6 +40,13 @@ static void on_context_available (GUPnPContextManager *manager,
 static void on_context_unavailable (GUPnPContextManager *manager,
                                     GUPnPContext *context, gpointer user_data);
 
+typedef struct {
+  gchar *uri;
+  gchar *meta;
+  MeloTags *tags;
+  gint duration;
+} MeloPlayerUpnpNext;
+
 struct _MeloPlayerUpnpPrivate {
   GMutex player_mutex;
 
@@ -45,10 +56,34 @@ struct _MeloPlayerUpnpPrivate {
   RygelMediaPlayer *player;
   MeloSink *sink;
   GList *ifaces;
+
+  /* Gapless playback */
+  GMutex next_mutex;
+  GstElement *playbin;
+  GstBus *bus;
+  guint action_signal;
+  gulong action_hook;
+  MeloPlayerUpnpNext *next;
+  MeloPlayerUpnpNext *pending;
+  gchar *cur_meta;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (MeloPlayerUpnp, melo_player_upnp, MELO_TYPE_PLAYER)
 
+static void
+melo_player_upnp_next_free (MeloPlayerUpnpNext *next)
+{
+  if (!next)
+    return;
+
+  /* Free next media */
+  if (next->tags)
+    melo_tags_unref (next->tags);
+  g_free (next->meta);
+  g_free (next->uri);
+  g_slice_free (MeloPlayerUpnpNext, next);
+}
+
 static void
 melo_player_upnp_finalize (GObject *gobject)
 {
@@ -62,11 +97,24 @@ melo_player_upnp_finalize (GObject *gobject)
   if (priv->ifaces)
     g_list_free (priv->ifaces);
 
+  /* Free next media */
+  melo_player_upnp_next_free (priv->next);
+  melo_player_upnp_next_free (priv->pending);
+  g_free (priv->cur_meta);
+
   /* Clear mutex */
+  g_mutex_clear (&priv->next_mutex);
   g_mutex_clear (&priv->player_mutex);
 
   /* Free UPnP renderer */
   if (priv->renderer) {
+    g_signal_remove_emission_hook (priv->action_signal, priv->action_hook);
+    g_signal_handlers_disconnect_by_data (priv->playbin, priv);
+    g_signal_handlers_disconnect_by_data (priv->bus, pup);
+    melo_sched_unwatch_bus (priv->bus);
+    gst_bus_remove_signal_watch (priv->bus);
+    gst_object_unref (priv->bus);
+    g_object_unref (priv->playbin);
     g_object_unref (priv->player);
     g_object_unref (priv->renderer);
   }
@@ -82,6 +130,7 @@ melo_player_upnp_class_init (MeloPlayerUpnpClass *klass)
   MeloPlayerClass *pclass = MELO_PLAYER_CLASS (klass);
 
   /* Control */
+  pclass->play = melo_player_upnp_play;
   pclass->set_state = melo_player_upnp_set_state;
   pclass->set_pos = melo_player_upnp_set_pos;
   pclass->set_volume = melo_player_upnp_set_volume;
@@ -102,6 +151,7 @@ melo_player_upnp_init (MeloPlayerUpnp *self)
 
   /* Init player and status mutex */
   g_mutex_init (&priv->player_mutex);
+  g_mutex_init (&priv->next_mutex);
 
   /* Create a new UPnP context manager */
   priv->manager = gupnp_context_manager_create (0);
@@ -111,6 +161,41 @@ melo_player_upnp_init (MeloPlayerUpnp *self)
                     (GCallback) on_context_unavailable, priv);
 }
 
+static void melo_player_upnp_set_next (MeloPlayerUpnp *up, const gchar *uri,
+                                       const gchar *meta);
+
+static gboolean
+melo_player_upnp_play (MeloPlayer *player, const gchar *path,
+                       const gchar *name, MeloTags *tags, gboolean insert)
+{
+  MeloPlayerUpnp *up = MELO_PLAYER_UPNP (player);
+  MeloPlayerUpnpPrivate *priv = up->priv;
+  gboolean ret = FALSE;
+
+  /* Drop queued media */
+  melo_player_upnp_set_next (up, NULL, NULL);
+
+  /* Lock player mutex */
+  g_mutex_lock (&priv->player_mutex);
+
+  if (priv->player) {
+    /* Reset status with provided tags */
+    melo_player_reset_status (player, MELO_PLAYER_STATE_LOADING, name,
+                              melo_tags_ref (tags));
+
+    /* Play media from a media server with the renderer */
+    rygel_media_player_set_metadata (priv->player, "");
+    rygel_media_player_set_uri (priv->player, path);
+    rygel_media_player_set_playback_state (priv->player, "PLAYING");
+    ret = TRUE;
+  }
+
+  /* Unlock player mutex */
+  g_mutex_unlock (&priv->player_mutex);
+
+  return ret;
+}
+
 static MeloPlayerState
 melo_player_upnp_set_state (MeloPlayer *player, MeloPlayerState state)
 {
@@ -264,28 +349,62 @@ static void
 on_object_available (GUPnPDIDLLiteParser *parser, GUPnPDIDLLiteObject *object,
                      gpointer user_data)
 {
-  MeloPlayerUpnp *up = MELO_PLAYER_UPNP (user_data);
-  MeloPlayer *player = MELO_PLAYER (up);
+  MeloPlayerUpnpNext *next = (MeloPlayerUpnpNext *) user_data;
+  GList *resources, *l;
   const gchar *img;
   MeloTags *tags;
 
+  /* Only first object is used */
+  if (next->tags)
+    return;
+
   /* Generate a new tags */
   tags = melo_tags_new ();
   if (!tags)
     return;
 
   /* Fill with basic tags */
-  tags->title = g_strdup (gupnp_didl_lite_object_get_title (object));
-  tags->artist = g_strdup (gupnp_didl_lite_object_get_artist (object));
-  tags->album = g_strdup (gupnp_didl_lite_object_get_album (object));
-  tags->genre = g_strdup (gupnp_didl_lite_object_get_genre (object));
+  tags->title = melo_tags_intern_string (
+                                    gupnp_didl_lite_object_get_title (object));
+  tags->artist = melo_tags_intern_string (
+                                   gupnp_didl_lite_object_get_artist (object));
+  tags->album = melo_tags_intern_string (
+                                   gupnp_didl_lite_object_get_album (object));
+  tags->genre = melo_tags_intern_string (
+                                   gupnp_didl_lite_object_get_genre (object));
 
   /* Set image cover */
   img = gupnp_didl_lite_object_get_album_art (object);
   melo_tags_set_cover_by_url (tags, img, MELO_TAGS_COVER_PERSIST_NONE);
 
-  /* Update tags in status */
-  melo_player_take_status_tags (player, tags);
+  /* Get duration from resources */
+  resources = gupnp_didl_lite_object_get_resources (object);
+  for (l = resources; l != NULL; l = l->next) {
+    glong duration;
+
+    duration = gupnp_didl_lite_resource_get_duration (l->data);
+    if (duration > 0 && next->duration <= 0)
+      next->duration = duration;
+  }
+  g_list_free_full (resources, g_object_unref);
+
+  next->tags = tags;
+}
+
+static void
+melo_player_upnp_parse_metadata (MeloPlayerUpnpNext *next)
+{
+  GUPnPDIDLLiteParser *parser;
+
+  if (!next->meta || !*next->meta)
+    return;
+
+  /* Parse meta with GUPnP parser */
+  parser = gupnp_didl_lite_parser_new ();
+  g_signal_connect (parser, "object-available",
+                    (GCallback)on_object_available, next);
+  gupnp_didl_lite_parser_parse_didl (parser, next->meta, NULL);
+  g_object_unref (parser);
 }
 
 static void
@@ -330,21 +449,188 @@ on_notify (GObject *object, GParamSpec *pspec, gpointer user_data)
     volume = rygel_media_player_get_volume (priv->player);
     melo_player_set_status_volume (play, volume);
   } else if (!g_strcmp0 (pspec->name, "metadata")) {
-    GUPnPDIDLLiteParser *parser;
-    gchar *meta;
+    MeloPlayerUpnpNext next = { 0 };
+    gboolean parsed;
 
     /* Get metatdata DIDLLite information */
-    meta = rygel_media_player_get_metadata (player);
-
-    /* Parse meta with GUPnP parser */
-    parser = gupnp_didl_lite_parser_new ();
-    g_signal_connect (parser, "object-available",
-                      (GCallback)on_object_available, up);
-    gupnp_didl_lite_parser_parse_didl (parser, meta, NULL);
-    g_object_unref (parser);
+    next.meta = rygel_media_player_get_metadata (player);
+
+    /* Metadata already parsed when queued as next media */
+    g_mutex_lock (&priv->next_mutex);
+    parsed = priv->cur_meta && !g_strcmp0 (next.meta, priv->cur_meta);
+    g_mutex_unlock (&priv->next_mutex);
+
+    /* Parse metadata and update tags in status */
+    if (!parsed) {
+      melo_player_upnp_parse_metadata (&next);
+      if (next.tags)
+        melo_player_take_status_tags (play, next.tags);
+    }
+    g_free (next.meta);
   }
 }
 
+static void
+melo_player_upnp_next_cover (const gchar *id, GBytes *cover,
+                             gpointer user_data)
+{
+}
+
+static void
+melo_player_upnp_set_next (MeloPlayerUpnp *up, const gchar *uri,
+                           const gchar *meta)
+{
+  MeloPlayerUpnpPrivate *priv = up->priv;
+  MeloPlayerUpnpNext *next = NULL, *old;
+
+  if (uri && *uri) {
+    /* Create next media */
+    next = g_slice_new0 (MeloPlayerUpnpNext);
+    next->uri = g_strdup (uri);
+    next->meta = g_strdup (meta);
+
+    /* Parse metadata and download cover ahead of time */
+    melo_player_upnp_parse_metadata (next);
+    if (next->tags && next->tags->cover)
+      melo_tags_get_cover_by_id_async (next->tags->cover,
+                                       melo_player_upnp_next_cover, NULL);
+  }
+
+  /* Replace next media */
+  g_mutex_lock (&priv->next_mutex);
+  old = priv->next;
+  priv->next = next;
+  g_mutex_unlock (&priv->next_mutex);
+
+  /* Free previous next media */
+  melo_player_upnp_next_free (old);
+}
+
+static gboolean
+melo_player_upnp_action_hook (GSignalInvocationHint *ihint,
+                              guint n_param_values, const GValue *param_values,
+                              gpointer user_data)
+{
+  MeloPlayerUpnp *up = MELO_PLAYER_UPNP (user_data);
+  GUPnPServiceAction *action;
+  GUPnPService *service;
+  const gchar *type, *name;
+
+  /* Get service and action */
+  service = g_value_get_object (&param_values[0]);
+  action = g_value_peek_pointer (&param_values[1]);
+
+  /* Only AVTransport service is handled */
+  type = gupnp_service_info_get_service_type (GUPNP_SERVICE_INFO (service));
+  if (!type ||
+      !g_str_has_prefix (type, "urn:schemas-upnp-org:service:AVTransport:"))
+    return TRUE;
+
+  /* Parse action */
+  name = gupnp_service_action_get_name (action);
+  if (!g_strcmp0 (name, "SetNextAVTransportURI")) {
+    gchar *uri = NULL, *meta = NULL;
+    guint id = 0;
+
+    /* Rygel only plays the next media after end of stream: its handler is
+     * blocked and the action is handled here, before it.
+     */
+    if (!g_object_get_data (G_OBJECT (service), "melo-next-blocked")) {
+      g_signal_handlers_block_matched (service,
+                                       G_SIGNAL_MATCH_ID | G_SIGNAL_MATCH_DETAIL,
+                                       ihint->signal_id,
+                                       g_quark_from_static_string (name),
+                                       NULL, NULL, NULL);
+      g_object_set_data (G_OBJECT (service), "melo-next-blocked",
+                         GINT_TO_POINTER (TRUE));
+    }
+
+    /* Get arguments */
+    gupnp_service_action_get (action,
+                              "InstanceID", G_TYPE_UINT, &id,
+                              "NextURI", G_TYPE_STRING, &uri,
+                              "NextURIMetaData", G_TYPE_STRING, &meta,
+                              NULL);
+
+    /* Queue next media */
+    if (id == 0) {
+      melo_player_upnp_set_next (up, uri, meta);
+      gupnp_service_action_return (action);
+    } else
+      gupnp_service_action_return_error (action, 718, "Invalid InstanceID");
+
+    g_free (meta);
+    g_free (uri);
+  } else if (!g_strcmp0 (name, "SetAVTransportURI") ||
+             !g_strcmp0 (name, "Stop")) {
+    /* Drop next media */
+    melo_player_upnp_set_next (up, NULL, NULL);
+  }
+
+  return TRUE;
+}
+
+static void
+on_about_to_finish (GstElement *playbin, gpointer user_data)
+{
+  MeloPlayerUpnpPrivate *priv = (MeloPlayerUpnpPrivate *) user_data;
+  MeloPlayerUpnpNext *next, *old;
+
+  /* Get next media */
+  g_mutex_lock (&priv->next_mutex);
+  next = priv->next;
+  old = priv->pending;
+  priv->pending = next;
+  priv->next = NULL;
+  g_mutex_unlock (&priv->next_mutex);
+
+  /* Free media never started */
+  melo_player_upnp_next_free (old);
+
+  /* Pre-roll next media while current one ends */
+  if (next)
+    g_object_set (playbin, "uri", next->uri, NULL);
+}
+
+static void
+on_stream_start (GstBus *bus, GstMessage *msg, gpointer user_data)
+{
+  MeloPlayerUpnp *up = MELO_PLAYER_UPNP (user_data);
+  MeloPlayerUpnpPrivate *priv = up->priv;
+  MeloPlayer *player = MELO_PLAYER (up);
+  MeloPlayerUpnpNext *next;
+
+  /* Get started media */
+  g_mutex_lock (&priv->next_mutex);
+  next = priv->pending;
+  priv->pending = NULL;
+  if (next) {
+    g_free (priv->cur_meta);
+    priv->cur_meta = g_strdup (next->meta);
+  }
+  g_mutex_unlock (&priv->next_mutex);
+
+  /* Not a gapless transition */
+  if (!next)
+    return;
+
+  /* Update status with tags parsed ahead of time */
+  melo_player_set_status_pos (player, 0);
+  melo_player_set_status_duration (player, next->duration);
+  if (next->tags) {
+    melo_player_take_status_tags (player, next->tags);
+    next->tags = NULL;
+  }
+
+  /* Report new metadata to control points */
+  g_mutex_lock (&priv->player_mutex);
+  if (priv->player && next->meta)
+    rygel_media_player_set_metadata (priv->player, next->meta);
+  g_mutex_unlock (&priv->player_mutex);
+
+  melo_player_upnp_next_free (next);
+}
+
 gboolean
 melo_player_upnp_start (MeloPlayerUpnp *up, const gchar *name)
 {
@@ -353,6 +639,7 @@ melo_player_upnp_start (MeloPlayerUpnp *up, const gchar *name)
   GstElement *playbin, *sink;
   RygelPlugin *plugin;
   gboolean ret = FALSE;
+  gpointer klass;
   gchar *sink_name;
   GList *l;
 
@@ -393,8 +680,27 @@ melo_player_upnp_start (MeloPlayerUpnp *up, const gchar *name)
   sink = gst_element_factory_make ("fakesink", NULL);
   g_object_set (G_OBJECT (playbin), "video-sink", sink, NULL);
 
-  /* Release gstreamer playbin */
-  g_object_unref (playbin);
+  /* Switch to next media without gap */
+  g_signal_connect (playbin, "about-to-finish",
+                    (GCallback) on_about_to_finish, priv);
+  priv->bus = gst_element_get_bus (playbin);
+  gst_bus_add_signal_watch (priv->bus);
+  g_signal_connect (priv->bus, "message::stream-start",
+                    (GCallback) on_stream_start, up);
+  priv->playbin = playbin;
+
+  /* Promote streaming threads */
+  melo_sched_watch_bus (priv->bus);
+
+  /* Catch SetNextAVTransportURI actions on AVTransport service */
+  klass = g_type_class_ref (GUPNP_TYPE_SERVICE);
+  priv->action_signal = g_signal_lookup ("action-invoked", GUPNP_TYPE_SERVICE);
+  priv->action_hook = g_signal_add_emission_hook (priv->action_signal, 0,
+                                                 melo_player_upnp_action_hook,
+                                                 up, NULL);
+  g_type_class_unref (klass);
+
+  /* Release sink name */
   g_free (sink_name);
 
   /* Setup interfaces */
@@ -421,6 +727,17 @@ melo_player_upnp_stop (MeloPlayerUpnp *up)
   g_mutex_lock (&priv->player_mutex);
 
   if (priv->renderer) {
+    /* Stop gapless playback */
+    g_signal_remove_emission_hook (priv->action_signal, priv->action_hook);
+    g_signal_handlers_disconnect_by_data (priv->playbin, priv);
+    g_signal_handlers_disconnect_by_data (priv->bus, up);
+    melo_sched_unwatch_bus (priv->bus);
+    gst_bus_remove_signal_watch (priv->bus);
+    gst_object_unref (priv->bus);
+    g_object_unref (priv->playbin);
+    priv->playbin = NULL;
+    priv->bus = NULL;
+
     /* Stop and free UPnP renderer */
     g_object_unref (priv->player);
     g_object_unref (priv->renderer);
@@ -428,6 +745,13 @@ melo_player_upnp_stop (MeloPlayerUpnp *up)
     priv->player = NULL;
   }
 
+  /* Drop next media */
+  g_mutex_lock (&priv->next_mutex);
+  melo_player_upnp_next_free (priv->next);
+  melo_player_upnp_next_free (priv->pending);
+  priv->pending = priv->next = NULL;
+  g_mutex_unlock (&priv->next_mutex);
+
   /* Free Melo audio sink */
   g_object_unref (priv->sink);
 
@@ -21,6 +21,7 @@
 
 #include <string.h>
 
+#include "melo_browser_upnp.h"
 #include "melo_player_upnp.h"
 #include "melo_config_upnp.h"
 #include "melo_upnp.h"
@@ -28,13 +29,15 @@
 /* Module upnp info */
 static MeloModuleInfo melo_upnp_info = {
   .name = "UPnP / DLNA",
-  .description = "Play any media wireless on Melo with UPnP / DLNA",
+  .description = "Play any media wireless on Melo with UPnP / DLNA, and "
+                 "browse media servers of the network",
   .config_id = "upnp",
 };
 
 static const MeloModuleInfo *melo_upnp_get_info (MeloModule *module);
 
 struct _MeloUpnpPrivate {
+  MeloBrowser *servers;
   MeloPlayer *player;
   GMutex mutex;
   MeloConfig *config;
@@ -54,6 +57,12 @@ melo_upnp_finalize (GObject *gobject)
     g_object_unref (priv->player);
   }
 
+  /* Free media servers browser */
+  if (priv->servers) {
+    melo_module_unregister_browser (MELO_MODULE (gobject), "upnp_servers");
+    g_object_unref (priv->servers);
+  }
+
   /* Free name */
   g_free (priv->name);
 
@@ -107,6 +116,15 @@ melo_upnp_init (MeloUpnp *self)
   /* Start UPnP renderer */
   melo_player_upnp_start (MELO_PLAYER_UPNP (priv->player), priv->name);
 
+  /* Create and register media servers browser: medias are played with the
+   * UPnP renderer
+   */
+  priv->servers = melo_browser_new (MELO_TYPE_BROWSER_UPNP, "upnp_servers");
+  if (priv->servers) {
+    melo_browser_set_player (priv->servers, priv->player);
+    melo_module_register_browser (MELO_MODULE (self), priv->servers);
+  }
+
   /* Add config handler for update */
   melo_config_set_update_callback (priv->config, "general",
                                    melo_config_upnp_update, self);
@@ -0,0 +1,519 @@
+/*
+ * melo_bench.c: Micro-benchmarks of libmelo hot paths
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "melo_tags.h"
+#include "melo_jsonrpc.h"
+#include "melo_playlist_simple.h"
+
+#ifdef MELO_BENCH_FILE_DB
+#include "melo_file_db.h"
+#endif
+
+/*
+ * Each benchmark is run MELO_BENCH_REPEAT times and the median and minimum
+ * time per operation are printed, one result per line, as tab separated
+ * values:
+ *   name  size  iterations  median_ns  min_ns
+ * The median is the value to compare between two runs, the minimum shows the
+ * noise of the machine.
+ */
+#define MELO_BENCH_REPEAT 7
+
+typedef void (*MeloBenchFunc) (gpointer data, guint iterations);
+
+static const gchar *melo_bench_filter;
+
+static gboolean
+melo_bench_selected (const gchar *name)
+{
+  return !melo_bench_filter || g_str_has_prefix (name, melo_bench_filter);
+}
+
+static gint
+melo_bench_cmp (gconstpointer a, gconstpointer b)
+{
+  gdouble da = *(const gdouble *) a, db = *(const gdouble *) b;
+
+  return da < db ? -1 : da > db;
+}
+
+static void
+melo_bench_measure (const gchar *name, guint size, MeloBenchFunc func,
+                    gpointer data, guint iterations, guint ops)
+{
+  gdouble results[MELO_BENCH_REPEAT];
+  guint i;
+
+  /* Run benchmark: each run does ops operations per iteration */
+  for (i = 0; i < MELO_BENCH_REPEAT; i++) {
+    gint64 start = g_get_monotonic_time ();
+    func (data, iterations);
+    results[i] = (g_get_monotonic_time () - start) * 1000.0 /
+                 ((gdouble) iterations * ops);
+  }
+
+  /* Print median and minimum */
+  qsort (results, MELO_BENCH_REPEAT, sizeof (*results), melo_bench_cmp);
+  printf ("%s\t%u\t%u\t%.1f\t%.1f\n", name, size, iterations * ops,
+          results[MELO_BENCH_REPEAT / 2], results[0]);
+  fflush (stdout);
+}
+
+static MeloTags *
+melo_bench_tags_new (guint i)
+{
+  MeloTags *tags;
+  gchar *str;
+
+  /* Generate tags: 10 songs per album, 10 albums per artist */
+  tags = melo_tags_new ();
+  tags->title = g_strdup_printf ("Title %08x", g_int_hash (&i));
+  str = g_strdup_printf ("Artist %u", i / 100);
+  tags->artist = melo_tags_intern_string (str);
+  g_free (str);
+  str = g_strdup_printf ("Album %u", i / 10);
+  tags->album = melo_tags_intern_string (str);
+  g_free (str);
+  str = g_strdup_printf ("Genre %u", i % 16);
+  tags->genre = melo_tags_intern_string (str);
+  g_free (str);
+  tags->date = 1970 + i % 50;
+  tags->track = i % 10 + 1;
+  tags->tracks = 10;
+
+  return tags;
+}
+
+/* JSON-RPC dispatch and parameters validation */
+static void
+melo_bench_jsonrpc_method (const gchar *method,
+                           JsonArray *s_params, JsonNode *params,
+                           JsonNode **result, JsonNode **error,
+                           gpointer user_data)
+{
+  JsonObject *obj;
+
+  /* Validate parameters */
+  obj = melo_jsonrpc_get_object (s_params, params, error);
+  if (!obj)
+    return;
+  json_object_unref (obj);
+
+  *result = json_node_new (JSON_NODE_VALUE);
+  json_node_set_boolean (*result, TRUE);
+}
+
+static MeloJSONRPCMethod melo_bench_jsonrpc_methods[] = {
+  {
+    .method = "get_list",
+    .params = "["
+              "  {\"name\": \"id\", \"type\": \"string\"},"
+              "  {\"name\": \"path\", \"type\": \"string\"},"
+              "  {\"name\": \"offset\", \"type\": \"integer\"},"
+              "  {\"name\": \"count\", \"type\": \"integer\"},"
+              "  {"
+              "    \"name\": \"fields\", \"type\": \"array\","
+              "    \"required\": false"
+              "  }"
+              "]",
+    .result = "{\"type\":\"boolean\"}",
+    .callback = melo_bench_jsonrpc_method,
+    .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAGS_CONCURRENT,
+  },
+};
+
+static void
+melo_bench_jsonrpc_func (gpointer data, guint iterations)
+{
+  const gchar *req = data;
+  gsize len = strlen (req);
+  guint i;
+
+  for (i = 0; i < iterations; i++)
+    g_free (melo_jsonrpc_parse_request (req, len, NULL));
+}
+
+static void
+melo_bench_jsonrpc (void)
+{
+  static const gchar *valid =
+    "{\"jsonrpc\":\"2.0\",\"method\":\"bench.get_list\",\"params\":"
+    "{\"id\":\"files\",\"path\":\"/music\",\"offset\":0,\"count\":50,"
+    "\"fields\":[\"title\",\"artist\",\"album\"]},\"id\":1}";
+  static const gchar *invalid =
+    "{\"jsonrpc\":\"2.0\",\"method\":\"bench.get_list\",\"params\":"
+    "{\"id\":\"files\",\"offset\":\"zero\"},\"id\":1}";
+  static const gchar *unknown =
+    "{\"jsonrpc\":\"2.0\",\"method\":\"bench.unknown\",\"id\":1}";
+  static const gchar *batch =
+    "[{\"jsonrpc\":\"2.0\",\"method\":\"bench.get_list\",\"params\":"
+    "[\"files\",\"/music\",0,50],\"id\":1},"
+    "{\"jsonrpc\":\"2.0\",\"method\":\"bench.get_list\",\"params\":"
+    "[\"files\",\"/music\",50,50],\"id\":2}]";
+
+  if (!melo_bench_selected ("jsonrpc"))
+    return;
+
+  /* Register benchmark method */
+  melo_jsonrpc_register_methods ("bench", melo_bench_jsonrpc_methods,
+                                 G_N_ELEMENTS (melo_bench_jsonrpc_methods));
+
+  melo_bench_measure ("jsonrpc.parse_request", 1, melo_bench_jsonrpc_func,
+                      (gpointer) valid, 10000, 1);
+  melo_bench_measure ("jsonrpc.parse_request.invalid_params", 1,
+                      melo_bench_jsonrpc_func, (gpointer) invalid, 10000, 1);
+  melo_bench_measure ("jsonrpc.parse_request.not_found", 1,
+                      melo_bench_jsonrpc_func, (gpointer) unknown, 10000, 1);
+  melo_bench_measure ("jsonrpc.parse_request.batch", 2,
+                      melo_bench_jsonrpc_func, (gpointer) batch, 5000, 2);
+
+  /* Unregister benchmark method */
+  melo_jsonrpc_unregister_methods ("bench", melo_bench_jsonrpc_methods,
+                                   G_N_ELEMENTS (melo_bench_jsonrpc_methods));
+}
+
+/* Tags serialization */
+static void
+melo_bench_tags_func (gpointer data, guint iterations)
+{
+  MeloTags *tags = data;
+  guint i;
+
+  for (i = 0; i < iterations; i++)
+    json_object_unref (melo_tags_to_json_object (tags, MELO_TAGS_FIELDS_FULL));
+}
+
+static void
+melo_bench_tags (void)
+{
+  MeloTags *tags;
+
+  if (!melo_bench_selected ("tags"))
+    return;
+
+  tags = melo_bench_tags_new (42);
+  melo_bench_measure ("tags.to_json_object", 1, melo_bench_tags_func, tags,
+                      100000, 1);
+  melo_tags_unref (tags);
+}
+
+/* Cover cache */
+static void
+melo_bench_cover_func (gpointer data, guint iterations)
+{
+  const gchar *id = data;
+  GBytes *cover;
+  guint i;
+
+  for (i = 0; i < iterations; i++) {
+    cover = melo_tags_get_cover_by_id (id);
+    if (cover)
+      g_bytes_unref (cover);
+  }
+}
+
+static void
+melo_bench_cover (void)
+{
+  MeloTags *tags;
+  GBytes *data;
+  gchar *id;
+
+  if (!melo_bench_selected ("cover"))
+    return;
+
+  /* Add a cover in cache */
+  tags = melo_tags_new ();
+  data = g_bytes_new_take (g_malloc0 (64 * 1024), 64 * 1024);
+  id = g_strdup (melo_tags_set_cover_by_data (tags, data,
+                                              MELO_TAGS_COVER_PERSIST_EXIT));
+
+  melo_bench_measure ("cover.get_by_id", 1, melo_bench_cover_func, id, 100000,
+                      1);
+  melo_bench_measure ("cover.get_by_id.miss", 1, melo_bench_cover_func,
+                      "bench_unknown_cover", 100000, 1);
+
+  g_free (id);
+  melo_tags_unref (tags);
+}
+
+/* Simple playlist */
+typedef struct {
+  MeloPlaylist *plist;
+  guint size;
+  gchar *id;
+  MeloSort sort;
+} MeloBenchPlaylist;
+
+static void
+melo_bench_playlist_add_func (gpointer data, guint iterations)
+{
+  MeloBenchPlaylist *b = data;
+  guint i, j;
+
+  for (i = 0; i < iterations; i++) {
+    /* Fill an empty playlist */
+    melo_playlist_empty (b->plist);
+    for (j = 0; j < b->size; j++) {
+      MeloTags *tags = melo_bench_tags_new (j);
+      gchar *path = g_strdup_printf ("file:///music/%u.mp3", j);
+
+      melo_playlist_add (b->plist, path, tags->title, tags, FALSE);
+      melo_tags_unref (tags);
+      g_free (path);
+    }
+  }
+}
+
+static void
+melo_bench_playlist_get_list_func (gpointer data, guint iterations)
+{
+  MeloBenchPlaylist *b = data;
+  guint i;
+
+  for (i = 0; i < iterations; i++)
+    melo_playlist_list_free (melo_playlist_get_list (b->plist, b->size / 2, 50,
+                                                     MELO_TAGS_FIELDS_FULL));
+}
+
+static void
+melo_bench_playlist_move_func (gpointer data, guint iterations)
+{
+  MeloBenchPlaylist *b = data;
+  guint i;
+
+  /* Move the same media up and down */
+  for (i = 0; i < iterations; i++)
+    melo_playlist_move (b->plist, b->id, i & 1 ? -1 : 1, 1);
+}
+
+static void
+melo_bench_playlist_sort_func (gpointer data, guint iterations)
+{
+  MeloBenchPlaylist *b = data;
+  MeloPlaylistList *list;
+  guint i;
+
+  for (i = 0; i < iterations; i++) {
+    /* Get first media */
+    list = melo_playlist_get_list (b->plist, 0, 1, MELO_TAGS_FIELDS_NONE);
+    if (list->items) {
+      MeloPlaylistItem *item = list->items->data;
+
+      /* Reverse order at each call to really sort the list */
+      b->sort = melo_sort_invert (b->sort);
+      melo_playlist_sort (b->plist, item->id, -1, b->sort);
+    }
+    melo_playlist_list_free (list);
+  }
+}
+
+static void
+melo_bench_playlist (void)
+{
+  static const guint sizes[] = { 1000, 10000, 100000 };
+  MeloBenchPlaylist b;
+  guint i;
+
+  if (!melo_bench_selected ("playlist"))
+    return;
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++) {
+    MeloPlaylistList *list;
+
+    /* Create playlist */
+    b.plist = melo_playlist_new (MELO_TYPE_PLAYLIST_SIMPLE, "bench");
+    b.size = sizes[i];
+    b.sort = MELO_SORT_TITLE;
+
+    melo_bench_measure ("playlist_simple.add", b.size,
+                        melo_bench_playlist_add_func, &b, 1, b.size);
+    melo_bench_measure ("playlist_simple.get_list", b.size,
+                        melo_bench_playlist_get_list_func, &b, 1000, 1);
+
+    /* Get a media in the middle of the playlist */
+    list = melo_playlist_get_list (b.plist, b.size / 2, 1,
+                                   MELO_TAGS_FIELDS_NONE);
+    b.id = list->items ?
+           g_strdup (((MeloPlaylistItem *) list->items->data)->id) : NULL;
+    melo_playlist_list_free (list);
+
+    melo_bench_measure ("playlist_simple.move", b.size,
+                        melo_bench_playlist_move_func, &b, 1000, 1);
+    melo_bench_measure ("playlist_simple.sort", b.size,
+                        melo_bench_playlist_sort_func, &b, 2, 1);
+
+    g_free (b.id);
+    g_object_unref (b.plist);
+  }
+}
+
+#ifdef MELO_BENCH_FILE_DB
+/* File database */
+typedef struct {
+  MeloFileDB *db;
+  gchar *file;
+  guint size;
+} MeloBenchFileDB;
+
+static void
+melo_bench_file_db_add_func (gpointer data, guint iterations)
+{
+  MeloBenchFileDB *b = data;
+  guint i, j;
+
+  for (i = 0; i < iterations; i++) {
+    /* Start from an empty database */
+    if (b->db)
+      g_object_unref (b->db);
+    g_unlink (b->file);
+    b->db = melo_file_db_new (b->file, NULL);
+
+    /* Add songs: 100 songs per directory */
+    melo_file_db_begin_batch (b->db);
+    for (j = 0; j < b->size; j++) {
+      MeloFileDBInfo info = { 180000, "mp3", 44100, 2, 320000 };
+      MeloTags *tags = melo_bench_tags_new (j);
+      gchar *path, *file;
+      gint path_id;
+
+      path = g_strdup_printf ("/music/%u", j / 100);
+      file = g_strdup_printf ("%u.mp3", j);
+      if (melo_file_db_get_path_id (b->db, path, TRUE, &path_id))
+        melo_file_db_add_tags_batch (b->db, path_id, file, 0, tags, &info);
+      melo_tags_unref (tags);
+      g_free (path);
+      g_free (file);
+    }
+    melo_file_db_commit_batch (b->db);
+  }
+}
+
+static gboolean
+melo_bench_file_db_cb (const gchar *path, const gchar *file, gint id,
+                       MeloFileDBType type, MeloTags *tags, gpointer user_data)
+{
+  (*(guint *) user_data)++;
+  if (tags)
+    melo_tags_unref (tags);
+  return TRUE;
+}
+
+static void
+melo_bench_file_db_get_list_func (gpointer data, guint iterations)
+{
+  MeloBenchFileDB *b = data;
+  guint i, count = 0;
+
+  /* Get a page of songs sorted by title in the middle of the library */
+  for (i = 0; i < iterations; i++)
+    melo_file_db_get_list (b->db, NULL, melo_bench_file_db_cb, &count,
+                           b->size / 2, 50, MELO_SORT_TITLE, FALSE,
+                           MELO_FILE_DB_TYPE_SONG, MELO_TAGS_FIELDS_FULL,
+                           MELO_FILE_DB_FIELDS_END);
+}
+
+static void
+melo_bench_file_db_get_artist_func (gpointer data, guint iterations)
+{
+  MeloBenchFileDB *b = data;
+  guint i, count = 0;
+
+  /* Get the songs of an artist */
+  for (i = 0; i < iterations; i++)
+    melo_file_db_get_list (b->db, NULL, melo_bench_file_db_cb, &count, 0, 100,
+                           MELO_SORT_ALBUM, FALSE, MELO_FILE_DB_TYPE_SONG,
+                           MELO_TAGS_FIELDS_FULL,
+                           MELO_FILE_DB_FIELDS_ARTIST, "Artist 5",
+                           MELO_FILE_DB_FIELDS_END);
+}
+
+static void
+melo_bench_file_db (void)
+{
+  static const guint sizes[] = { 1000, 10000, 100000 };
+  MeloBenchFileDB b;
+  gchar *dir;
+  guint i;
+
+  if (!melo_bench_selected ("file_db"))
+    return;
+
+  /* Create a temporary directory */
+  dir = g_dir_make_tmp ("melo_bench_XXXXXX", NULL);
+  if (!dir)
+    return;
+  b.file = g_build_filename (dir, "bench.db", NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++) {
+    b.db = NULL;
+    b.size = sizes[i];
+
+    melo_bench_measure ("file_db.add_tags_batch", b.size,
+                        melo_bench_file_db_add_func, &b, 1, b.size);
+    melo_bench_measure ("file_db.get_list", b.size,
+                        melo_bench_file_db_get_list_func, &b, 100, 1);
+    melo_bench_measure ("file_db.get_list.artist", b.size,
+                        melo_bench_file_db_get_artist_func, &b, 100, 1);
+
+    g_object_unref (b.db);
+  }
+
+  /* Remove temporary files */
+  g_unlink (b.file);
+  g_rmdir (dir);
+  g_free (b.file);
+  g_free (dir);
+}
+#endif
+
+int
+main (int argc, char *argv[])
+{
+  /* Only run benchmarks starting with first argument */
+  if (argc > 1)
+    melo_bench_filter = argv[1];
+
+  /* Print header */
+  printf ("# name\tsize\titerations\tmedian_ns\tmin_ns\n");
+
+  /* Run benchmarks */
+  melo_bench_jsonrpc ();
+  melo_bench_tags ();
+  melo_bench_cover ();
+  melo_bench_playlist ();
+#ifdef MELO_BENCH_FILE_DB
+  melo_bench_file_db ();
+#endif
+
+  /* Release cover cache */
+  melo_tags_flush_cover_cache ();
+
+  return 0;
+}
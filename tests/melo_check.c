@@ -0,0 +1,165 @@
+/*
+ * melo_check.c: Unit tests of libmelo
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include <glib.h>
+#include <gst/gst.h>
+
+#include "melo_event.h"
+#include "melo_sink.h"
+#include "melo_rtp.h"
+
+/*
+ * The unit tests are run with 'make check': they only use libmelo and no
+ * audio device is opened (the pipelines are never started).
+ */
+
+/* Size of the RTP packets generated by the tests */
+#define MELO_CHECK_RTP_SIZE 64
+
+static gsize
+melo_check_rtp_packet (guchar *data, guint16 seq, gboolean padding,
+                       guint8 pad_len)
+{
+  /* Generate RTP header: version 2, no CSRC */
+  memset (data, 0, MELO_CHECK_RTP_SIZE);
+  data[0] = 0x80 | (padding ? 0x20 : 0);
+  data[1] = 96;
+  data[2] = seq >> 8;
+  data[3] = seq & 0xff;
+
+  /* Set padding length in last byte */
+  if (padding)
+    data[MELO_CHECK_RTP_SIZE - 1] = pad_len;
+
+  return MELO_CHECK_RTP_SIZE;
+}
+
+static void
+melo_check_rtp_padding (void)
+{
+  guchar data[MELO_CHECK_RTP_SIZE];
+  MeloSink *sink;
+  MeloRTP *rtp;
+  gsize size;
+
+  /* Create receiver */
+  sink = melo_sink_new (NULL, "check_rtp", "Check RTP");
+  g_assert_nonnull (sink);
+  rtp = melo_rtp_new (sink, "audio/x-raw,format=S16LE,layout=interleaved,"
+                      "rate=44100,channels=2", 44100, 100);
+  g_assert_nonnull (rtp);
+
+  /* Valid padding */
+  size = melo_check_rtp_packet (data, 1, TRUE, 4);
+  g_assert_true (melo_rtp_push_packet (rtp, data, size));
+
+  /* Padding covers the whole payload */
+  size = melo_check_rtp_packet (data, 2, TRUE, size - 12);
+  g_assert_false (melo_rtp_push_packet (rtp, data, size));
+
+  /* Padding is longer than the payload */
+  size = melo_check_rtp_packet (data, 3, TRUE, 255);
+  g_assert_false (melo_rtp_push_packet (rtp, data, size));
+
+  /* Extension header is longer than the packet */
+  size = melo_check_rtp_packet (data, 4, FALSE, 0);
+  data[0] |= 0x10;
+  data[14] = 0xff;
+  data[15] = 0xff;
+  g_assert_false (melo_rtp_push_packet (rtp, data, size));
+
+  /* Receiver is still usable */
+  size = melo_check_rtp_packet (data, 5, FALSE, 0);
+  g_assert_true (melo_rtp_push_packet (rtp, data, size));
+
+  melo_rtp_free (rtp);
+  g_object_unref (sink);
+}
+
+static void
+melo_check_event_journal_resize (void)
+{
+  GBytes *event = g_bytes_new_static ("{}", 2);
+  GPtrArray *events;
+  guint64 seq, first, last;
+  gboolean missed;
+  guint i;
+
+  /* Fill journal */
+  melo_event_journal_set_size (8);
+  first = melo_event_journal_add (event);
+  for (i = 0; i < 4; i++)
+    seq = melo_event_journal_add (event);
+  g_assert_cmpuint (seq, ==, first + 4);
+
+  /* Shrink journal: all events are dropped */
+  melo_event_journal_set_size (4);
+  events = melo_event_journal_get_since (first, 0, NULL, &last, &missed);
+  g_assert_cmpuint (events->len, ==, 0);
+  g_assert_cmpuint (last, ==, seq);
+  g_assert_true (missed);
+  g_ptr_array_unref (events);
+
+  /* Only events added after resize are returned */
+  for (i = 0; i < 2; i++)
+    seq = melo_event_journal_add (event);
+  events = melo_event_journal_get_since (first, 0, NULL, &last, &missed);
+  g_assert_cmpuint (events->len, ==, 2);
+  g_assert_cmpuint (last, ==, seq);
+  g_assert_true (missed);
+  g_ptr_array_unref (events);
+
+  /* Up to date client */
+  events = melo_event_journal_get_since (seq - 1, 0, NULL, &last, &missed);
+  g_assert_cmpuint (events->len, ==, 1);
+  g_assert_false (missed);
+  g_ptr_array_unref (events);
+
+  melo_event_journal_set_size (0);
+  g_bytes_unref (event);
+}
+
+int
+main (int argc, char *argv[])
+{
+  int ret;
+
+  g_test_init (&argc, &argv, NULL);
+  gst_init (&argc, &argv);
+
+  /* Initialize main audio sink */
+  melo_sink_main_init (44100, 2);
+
+  /* RTP receiver */
+  g_test_add_func ("/rtp/padding", melo_check_rtp_padding);
+
+  /* Event journal */
+  g_test_add_func ("/event/journal-resize", melo_check_event_journal_resize);
+
+  ret = g_test_run ();
+
+  /* Release main audio sink */
+  melo_sink_main_release ();
+
+  return ret;
+}
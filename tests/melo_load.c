@@ -0,0 +1,714 @@
+/*
+ * melo_load.c: Concurrent HTTP load generator for Melo
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <libsoup/soup.h>
+#include <json-glib/json-glib.h>
+
+/*
+ * melo_load simulates many clients (as the web UI) against a running melo.
+ * Each client loops on actions picked randomly with the weights of the
+ * selected scenario, and waits the think time between two actions:
+ *  - status: one /rpc batch with "player.get_status" for all players,
+ *  - browse: "browser.get_list" scrolling, page after page,
+ *  - cover: GET /cover/<id> with cover IDs found while browsing,
+ *  - control: small reads of other groups ("module.get_list",
+ *    "sink.get_list", "playlist.get_list" and "system.get_stats"),
+ *  - events: a WebSocket subscription on /events kept open for some time.
+ *
+ * At the end, one line per action is printed as tab separated values:
+ *   action  requests  errors  req_per_s  p50_ms  p90_ms  p99_ms  max_ms
+ */
+
+typedef enum {
+  MELO_LOAD_ACTION_STATUS = 0,
+  MELO_LOAD_ACTION_BROWSE,
+  MELO_LOAD_ACTION_COVER,
+  MELO_LOAD_ACTION_CONTROL,
+  MELO_LOAD_ACTION_EVENTS,
+
+  MELO_LOAD_ACTION_COUNT
+} MeloLoadAction;
+
+static const gchar *melo_load_action_names[MELO_LOAD_ACTION_COUNT] = {
+  [MELO_LOAD_ACTION_STATUS] = "status",
+  [MELO_LOAD_ACTION_BROWSE] = "browse",
+  [MELO_LOAD_ACTION_COVER] = "cover",
+  [MELO_LOAD_ACTION_CONTROL] = "control",
+  [MELO_LOAD_ACTION_EVENTS] = "events",
+};
+
+/* Canned scenarios: weights of each action */
+static const struct {
+  const gchar *name;
+  const gchar *description;
+  guint weights[MELO_LOAD_ACTION_COUNT];
+} melo_load_scenarios[] = {
+  { "status", "player status polling only", { 100, 0, 0, 0, 0 } },
+  { "browse", "browser list scrolling only", { 0, 100, 0, 0, 0 } },
+  { "covers", "browsing with cover fetches", { 0, 30, 70, 0, 0 } },
+  { "events", "event subscriptions with status polling", { 50, 0, 0, 0, 50 } },
+  { "mixed", "typical UI session", { 50, 20, 15, 10, 5 } },
+};
+
+/* Maximum number of cover IDs kept */
+#define MELO_LOAD_COVERS_MAX 1024
+
+typedef struct {
+  GArray *latencies;
+  guint errors;
+} MeloLoadStats;
+
+typedef struct {
+  SoupSession *session;
+  GMainLoop *loop;
+  gchar *url;
+  gchar *rpc_url;
+
+  /* Settings */
+  const guint *weights;
+  guint weights_total;
+  guint think;
+  guint hold;
+  const gchar *browser;
+  const gchar *path;
+  guint count;
+
+  /* Discovered objects */
+  GPtrArray *players;
+  GPtrArray *covers;
+
+  /* State */
+  gboolean running;
+  guint active;
+  gint64 start;
+  gint64 end;
+
+  /* Results */
+  MeloLoadStats stats[MELO_LOAD_ACTION_COUNT];
+  guint64 events;
+} MeloLoad;
+
+typedef struct {
+  MeloLoad *load;
+  MeloLoadAction action;
+  gint64 start;
+
+  /* Browsing state */
+  guint offset;
+  gchar *token;
+
+  /* Event subscription */
+  SoupWebsocketConnection *conn;
+} MeloLoadClient;
+
+static void melo_load_client_next (MeloLoadClient *client);
+
+static void
+melo_load_record (MeloLoadClient *client, gboolean success)
+{
+  MeloLoadStats *stats = &client->load->stats[client->action];
+  gdouble ms = (g_get_monotonic_time () - client->start) / 1000.0;
+
+  /* Save latency */
+  g_array_append_val (stats->latencies, ms);
+  if (!success)
+    stats->errors++;
+}
+
+static gboolean
+melo_load_client_next_cb (gpointer user_data)
+{
+  melo_load_client_next (user_data);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+melo_load_client_wait (MeloLoadClient *client)
+{
+  /* Wait think time before next action */
+  if (client->load->think)
+    g_timeout_add (client->load->think, melo_load_client_next_cb, client);
+  else
+    g_idle_add (melo_load_client_next_cb, client);
+}
+
+static gboolean
+melo_load_response_is_valid (JsonNode *node)
+{
+  JsonArray *array;
+  guint i;
+
+  /* Single response */
+  if (JSON_NODE_HOLDS_OBJECT (node))
+    return !json_object_has_member (json_node_get_object (node), "error");
+
+  /* Batch response */
+  if (!JSON_NODE_HOLDS_ARRAY (node))
+    return FALSE;
+  array = json_node_get_array (node);
+  for (i = 0; i < json_array_get_length (array); i++)
+    if (!melo_load_response_is_valid (json_array_get_element (array, i)))
+      return FALSE;
+
+  return TRUE;
+}
+
+static void
+melo_load_browse_parse (MeloLoadClient *client, JsonObject *obj)
+{
+  MeloLoad *load = client->load;
+  const gchar *token = NULL;
+  JsonArray *items;
+  guint i, len;
+
+  if (!json_object_has_member (obj, "result"))
+    return;
+  obj = json_object_get_object_member (obj, "result");
+  if (!obj || !json_object_has_member (obj, "items"))
+    return;
+
+  /* Collect cover IDs */
+  items = json_object_get_array_member (obj, "items");
+  len = json_array_get_length (items);
+  for (i = 0; i < len && load->covers->len < MELO_LOAD_COVERS_MAX; i++) {
+    JsonObject *item = json_array_get_object_element (items, i);
+    JsonObject *tags;
+
+    if (!item || !json_object_has_member (item, "tags") ||
+        JSON_NODE_HOLDS_NULL (json_object_get_member (item, "tags")))
+      continue;
+    tags = json_object_get_object_member (item, "tags");
+    if (json_object_has_member (tags, "cover") &&
+        !JSON_NODE_HOLDS_NULL (json_object_get_member (tags, "cover")))
+      g_ptr_array_add (load->covers,
+                       g_strdup (json_object_get_string_member (tags, "cover")));
+  }
+
+  /* Scroll to next page or restart from beginning */
+  if (json_object_has_member (obj, "next_token") &&
+      !JSON_NODE_HOLDS_NULL (json_object_get_member (obj, "next_token")))
+    token = json_object_get_string_member (obj, "next_token");
+  g_free (client->token);
+  client->token = g_strdup (token);
+  client->offset = len < load->count ? 0 : client->offset + len;
+}
+
+static void
+melo_load_rpc_done (SoupSession *session, SoupMessage *msg, gpointer user_data)
+{
+  MeloLoadClient *client = user_data;
+  gboolean success = FALSE;
+  JsonParser *parser;
+
+  /* Parse response */
+  if (SOUP_STATUS_IS_SUCCESSFUL (msg->status_code)) {
+    parser = json_parser_new ();
+    if (json_parser_load_from_data (parser, msg->response_body->data,
+                                    msg->response_body->length, NULL)) {
+      JsonNode *root = json_parser_get_root (parser);
+
+      success = melo_load_response_is_valid (root);
+      if (success && client->action == MELO_LOAD_ACTION_BROWSE)
+        melo_load_browse_parse (client, json_node_get_object (root));
+    }
+    g_object_unref (parser);
+  }
+  melo_load_record (client, success);
+
+  /* Restart browsing from beginning on error */
+  if (!success && client->action == MELO_LOAD_ACTION_BROWSE) {
+    g_free (client->token);
+    client->token = NULL;
+    client->offset = 0;
+  }
+
+  melo_load_client_wait (client);
+}
+
+static void
+melo_load_rpc (MeloLoadClient *client, gchar *body)
+{
+  SoupMessage *msg;
+
+  /* Send request */
+  msg = soup_message_new ("POST", client->load->rpc_url);
+  soup_message_set_request (msg, "application/json", SOUP_MEMORY_TAKE, body,
+                            strlen (body));
+  soup_session_queue_message (client->load->session, msg, melo_load_rpc_done,
+                              client);
+}
+
+static void
+melo_load_status (MeloLoadClient *client)
+{
+  MeloLoad *load = client->load;
+  GString *body;
+  guint i;
+
+  /* Poll status of all players in one batch */
+  body = g_string_new ("[");
+  for (i = 0; i < load->players->len; i++)
+    g_string_append_printf (body, "%s{\"jsonrpc\":\"2.0\","
+                            "\"method\":\"player.get_status\","
+                            "\"params\":{\"id\":\"%s\","
+                            "\"fields\":[\"state\",\"pos\",\"duration\"],"
+                            "\"tags\":[\"title\",\"artist\",\"album\","
+                            "\"cover\"]},\"id\":%u}",
+                            i ? "," : "", (gchar *) load->players->pdata[i],
+                            i + 1);
+  g_string_append_c (body, ']');
+
+  melo_load_rpc (client, g_string_free (body, FALSE));
+}
+
+static void
+melo_load_browse (MeloLoadClient *client)
+{
+  MeloLoad *load = client->load;
+  gchar *token;
+
+  /* Get next page */
+  token = client->token ? g_strescape (client->token, NULL) : g_strdup ("");
+  melo_load_rpc (client, g_strdup_printf (
+                 "{\"jsonrpc\":\"2.0\",\"method\":\"browser.get_list\","
+                 "\"params\":{\"id\":\"%s\",\"path\":\"%s\",\"offset\":%u,"
+                 "\"count\":%u,\"token\":\"%s\",\"fields\":[\"full\"],"
+                 "\"tags\":{\"mode\":\"full\",\"fields\":[\"full\"]}},"
+                 "\"id\":1}",
+                 load->browser, load->path, client->token ? 0 : client->offset,
+                 load->count, token));
+  g_free (token);
+}
+
+static void
+melo_load_control (MeloLoadClient *client)
+{
+  static const gchar *requests[] = {
+    "{\"jsonrpc\":\"2.0\",\"method\":\"module.get_list\",\"params\":{},"
+    "\"id\":1}",
+    "{\"jsonrpc\":\"2.0\",\"method\":\"sink.get_list\",\"params\":{},"
+    "\"id\":1}",
+    "{\"jsonrpc\":\"2.0\",\"method\":\"system.get_stats\",\"params\":{},"
+    "\"id\":1}",
+  };
+  MeloLoad *load = client->load;
+  guint i;
+
+  /* Get playlist of a player or a small read from other groups */
+  i = g_random_int_range (0, G_N_ELEMENTS (requests) + 1);
+  if (i == G_N_ELEMENTS (requests))
+    melo_load_rpc (client, g_strdup_printf (
+                   "{\"jsonrpc\":\"2.0\",\"method\":\"playlist.get_list\","
+                   "\"params\":{\"id\":\"%s\",\"offset\":0,\"count\":50},"
+                   "\"id\":1}",
+                   (gchar *) load->players->pdata[
+                     g_random_int_range (0, load->players->len)]));
+  else
+    melo_load_rpc (client, g_strdup (requests[i]));
+}
+
+static void
+melo_load_cover_done (SoupSession *session, SoupMessage *msg,
+                      gpointer user_data)
+{
+  MeloLoadClient *client = user_data;
+
+  melo_load_record (client, SOUP_STATUS_IS_SUCCESSFUL (msg->status_code));
+  melo_load_client_wait (client);
+}
+
+static void
+melo_load_cover (MeloLoadClient *client)
+{
+  MeloLoad *load = client->load;
+  SoupMessage *msg;
+  gchar *url;
+
+  /* Fetch a random cover */
+  url = g_strdup_printf ("%s/cover/%s", load->url, (gchar *)
+               load->covers->pdata[g_random_int_range (0, load->covers->len)]);
+  msg = soup_message_new ("GET", url);
+  g_free (url);
+  if (!msg) {
+    melo_load_record (client, FALSE);
+    melo_load_client_wait (client);
+    return;
+  }
+  soup_session_queue_message (load->session, msg, melo_load_cover_done,
+                              client);
+}
+
+static void
+melo_load_events_message (SoupWebsocketConnection *conn, gint type,
+                          GBytes *message, gpointer user_data)
+{
+  MeloLoadClient *client = user_data;
+
+  client->load->events++;
+}
+
+static gboolean
+melo_load_events_close (gpointer user_data)
+{
+  MeloLoadClient *client = user_data;
+
+  /* Close subscription */
+  if (soup_websocket_connection_get_state (client->conn) ==
+      SOUP_WEBSOCKET_STATE_OPEN)
+    soup_websocket_connection_close (client->conn, SOUP_WEBSOCKET_CLOSE_NORMAL,
+                                     NULL);
+  g_signal_handlers_disconnect_by_data (client->conn, client);
+  g_clear_object (&client->conn);
+
+  melo_load_client_next (client);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+melo_load_events_connected (GObject *source, GAsyncResult *res,
+                            gpointer user_data)
+{
+  MeloLoadClient *client = user_data;
+
+  /* Connection is established */
+  client->conn = soup_session_websocket_connect_finish (SOUP_SESSION (source),
+                                                        res, NULL);
+  melo_load_record (client, client->conn != NULL);
+  if (!client->conn) {
+    melo_load_client_wait (client);
+    return;
+  }
+
+  /* Count events and keep subscription */
+  g_signal_connect (client->conn, "message",
+                    G_CALLBACK (melo_load_events_message), client);
+  g_timeout_add_seconds (client->load->hold, melo_load_events_close, client);
+}
+
+static void
+melo_load_events (MeloLoadClient *client)
+{
+  SoupMessage *msg;
+  gchar *url;
+
+  /* Subscribe to events */
+  url = g_strdup_printf ("%s/events", client->load->url);
+  msg = soup_message_new ("GET", url);
+  g_free (url);
+  soup_session_websocket_connect_async (client->load->session, msg, NULL, NULL,
+                                        NULL, melo_load_events_connected,
+                                        client);
+  g_object_unref (msg);
+}
+
+static void
+melo_load_client_next (MeloLoadClient *client)
+{
+  MeloLoad *load = client->load;
+  guint w, i;
+
+  /* End of test */
+  if (!load->running) {
+    if (!--load->active)
+      g_main_loop_quit (load->loop);
+    return;
+  }
+
+  /* Pick an action */
+  w = g_random_int_range (0, load->weights_total);
+  for (i = 0; i < MELO_LOAD_ACTION_COUNT - 1; i++) {
+    if (w < load->weights[i])
+      break;
+    w -= load->weights[i];
+  }
+  client->action = i;
+
+  /* No cover found yet: browse first */
+  if (client->action == MELO_LOAD_ACTION_COVER && !load->covers->len)
+    client->action = MELO_LOAD_ACTION_BROWSE;
+
+  /* Run action */
+  client->start = g_get_monotonic_time ();
+  switch (client->action) {
+    case MELO_LOAD_ACTION_STATUS:
+      melo_load_status (client);
+      break;
+    case MELO_LOAD_ACTION_BROWSE:
+      melo_load_browse (client);
+      break;
+    case MELO_LOAD_ACTION_COVER:
+      melo_load_cover (client);
+      break;
+    case MELO_LOAD_ACTION_CONTROL:
+      melo_load_control (client);
+      break;
+    case MELO_LOAD_ACTION_EVENTS:
+    default:
+      melo_load_events (client);
+  }
+}
+
+static gboolean
+melo_load_stop (gpointer user_data)
+{
+  MeloLoad *load = user_data;
+
+  /* Stop clients after their current action */
+  load->running = FALSE;
+  load->end = g_get_monotonic_time ();
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+melo_load_authenticate (SoupSession *session, SoupMessage *msg, SoupAuth *auth,
+                        gboolean retrying, gpointer user_data)
+{
+  gchar **credentials = user_data;
+
+  if (!retrying)
+    soup_auth_authenticate (auth, credentials[0], credentials[1]);
+}
+
+static void
+melo_load_get_players (MeloLoad *load)
+{
+  static const gchar *req =
+    "{\"jsonrpc\":\"2.0\",\"method\":\"player.get_list\","
+    "\"params\":{\"fields\":[\"id\"]},\"id\":1}";
+  JsonParser *parser;
+  SoupMessage *msg;
+
+  /* Get player list */
+  msg = soup_message_new ("POST", load->rpc_url);
+  soup_message_set_request (msg, "application/json", SOUP_MEMORY_STATIC, req,
+                            strlen (req));
+  soup_session_send_message (load->session, msg);
+
+  /* Parse player IDs */
+  parser = json_parser_new ();
+  if (SOUP_STATUS_IS_SUCCESSFUL (msg->status_code) &&
+      json_parser_load_from_data (parser, msg->response_body->data,
+                                  msg->response_body->length, NULL)) {
+    JsonNode *root = json_parser_get_root (parser);
+    JsonObject *obj = JSON_NODE_HOLDS_OBJECT (root) ?
+                      json_node_get_object (root) : NULL;
+
+    if (obj && json_object_has_member (obj, "result")) {
+      JsonArray *array = json_object_get_array_member (obj, "result");
+      guint i;
+
+      for (i = 0; array && i < json_array_get_length (array); i++) {
+        JsonObject *o = json_array_get_object_element (array, i);
+        if (o && json_object_has_member (o, "id"))
+          g_ptr_array_add (load->players,
+                           g_strdup (json_object_get_string_member (o, "id")));
+      }
+    }
+  }
+  g_object_unref (parser);
+  g_object_unref (msg);
+
+  /* Use default player */
+  if (!load->players->len)
+    g_ptr_array_add (load->players, g_strdup ("file_player"));
+}
+
+static gint
+melo_load_cmp (gconstpointer a, gconstpointer b)
+{
+  gdouble da = *(const gdouble *) a, db = *(const gdouble *) b;
+
+  return da < db ? -1 : da > db;
+}
+
+static gdouble
+melo_load_percentile (GArray *array, gdouble p)
+{
+  if (!array->len)
+    return 0;
+  return g_array_index (array, gdouble, (guint) ((array->len - 1) * p));
+}
+
+static void
+melo_load_report (MeloLoad *load)
+{
+  gdouble duration = (load->end - load->start) / 1000000.0;
+  guint i;
+
+  /* Print results of each action */
+  printf ("# action\trequests\terrors\treq_per_s\tp50_ms\tp90_ms\tp99_ms\t"
+          "max_ms\n");
+  for (i = 0; i < MELO_LOAD_ACTION_COUNT; i++) {
+    MeloLoadStats *stats = &load->stats[i];
+
+    if (!stats->latencies->len)
+      continue;
+    g_array_sort (stats->latencies, melo_load_cmp);
+    printf ("%s\t%u\t%u\t%.1f\t%.2f\t%.2f\t%.2f\t%.2f\n",
+            melo_load_action_names[i], stats->latencies->len, stats->errors,
+            stats->latencies->len / duration,
+            melo_load_percentile (stats->latencies, 0.50),
+            melo_load_percentile (stats->latencies, 0.90),
+            melo_load_percentile (stats->latencies, 0.99),
+            melo_load_percentile (stats->latencies, 1.0));
+  }
+  printf ("# events received: %" G_GUINT64_FORMAT " (%.1f/s)\n", load->events,
+          load->events / duration);
+}
+
+int
+main (int argc, char *argv[])
+{
+  gchar *host = "localhost", *scenario = "mixed";
+  gchar *browser = "file_library", *path = "/";
+  gchar *username = NULL, *password = NULL;
+  gint port = 8080, clients = 10, duration = 30, think = 100, hold = 10;
+  gint count = 50;
+  gboolean list = FALSE;
+  GOptionEntry options[] = {
+    {"host", 'H', 0, G_OPTION_ARG_STRING, &host, "Melo host", NULL},
+    {"port", 'p', 0, G_OPTION_ARG_INT, &port, "Melo HTTP port", NULL},
+    {"scenario", 's', 0, G_OPTION_ARG_STRING, &scenario, "Scenario to run",
+                                                                        NULL},
+    {"list", 'l', 0, G_OPTION_ARG_NONE, &list, "List scenarios", NULL},
+    {"clients", 'c', 0, G_OPTION_ARG_INT, &clients,
+                                           "Number of concurrent clients", NULL},
+    {"duration", 'd', 0, G_OPTION_ARG_INT, &duration, "Duration (in s)", NULL},
+    {"think", 't', 0, G_OPTION_ARG_INT, &think,
+                                 "Think time between two actions (in ms)", NULL},
+    {"hold", 0, 0, G_OPTION_ARG_INT, &hold,
+                                     "Event subscription duration (in s)", NULL},
+    {"browser", 'b', 0, G_OPTION_ARG_STRING, &browser, "Browser to scroll",
+                                                                        NULL},
+    {"path", 0, 0, G_OPTION_ARG_STRING, &path, "Path to scroll", NULL},
+    {"count", 0, 0, G_OPTION_ARG_INT, &count, "Items per page", NULL},
+    {"username", 'u', 0, G_OPTION_ARG_STRING, &username, "User name", NULL},
+    {"password", 'P', 0, G_OPTION_ARG_STRING, &password, "Password", NULL},
+    {NULL}
+  };
+  gchar *credentials[2];
+  GOptionContext *ctx;
+  GError *err = NULL;
+  MeloLoadClient *c;
+  MeloLoad load;
+  guint i;
+
+  /* Parse command line */
+  ctx = g_option_context_new ("- Melo load generator");
+  g_option_context_add_main_entries (ctx, options, NULL);
+  if (!g_option_context_parse (ctx, &argc, &argv, &err)) {
+    g_printerr ("Option parsing failed: %s\n", err->message);
+    g_clear_error (&err);
+    g_option_context_free (ctx);
+    return -1;
+  }
+  g_option_context_free (ctx);
+
+  /* List scenarios */
+  if (list) {
+    for (i = 0; i < G_N_ELEMENTS (melo_load_scenarios); i++)
+      printf ("%s: %s\n", melo_load_scenarios[i].name,
+              melo_load_scenarios[i].description);
+    return 0;
+  }
+
+  /* Find scenario */
+  memset (&load, 0, sizeof (load));
+  for (i = 0; i < G_N_ELEMENTS (melo_load_scenarios); i++)
+    if (!g_strcmp0 (melo_load_scenarios[i].name, scenario))
+      load.weights = melo_load_scenarios[i].weights;
+  if (!load.weights || clients <= 0 || duration <= 0 || count <= 0) {
+    g_printerr ("Invalid scenario or settings\n");
+    return -1;
+  }
+  for (i = 0; i < MELO_LOAD_ACTION_COUNT; i++)
+    load.weights_total += load.weights[i];
+
+  /* Init load */
+  load.url = g_strdup_printf ("http://%s:%d", host, port);
+  load.rpc_url = g_strdup_printf ("%s/rpc", load.url);
+  load.think = think > 0 ? think : 0;
+  load.hold = hold > 0 ? hold : 1;
+  load.browser = browser;
+  load.path = path;
+  load.count = count;
+  load.players = g_ptr_array_new_with_free_func (g_free);
+  load.covers = g_ptr_array_new_with_free_func (g_free);
+  for (i = 0; i < MELO_LOAD_ACTION_COUNT; i++)
+    load.stats[i].latencies = g_array_new (FALSE, FALSE, sizeof (gdouble));
+
+  /* Create session: one connection per client */
+  load.session = soup_session_new_with_options (
+                                  SOUP_SESSION_MAX_CONNS, clients * 2,
+                                  SOUP_SESSION_MAX_CONNS_PER_HOST, clients * 2,
+                                  NULL);
+  if (username && password) {
+    credentials[0] = username;
+    credentials[1] = password;
+    g_signal_connect (load.session, "authenticate",
+                      G_CALLBACK (melo_load_authenticate), credentials);
+  }
+
+  /* Discover players */
+  melo_load_get_players (&load);
+  g_printerr ("Running '%s' on %s with %d clients for %d s (%u players)\n",
+              scenario, load.url, clients, duration, load.players->len);
+
+  /* Start clients */
+  load.loop = g_main_loop_new (NULL, FALSE);
+  c = g_new0 (MeloLoadClient, clients);
+  load.running = TRUE;
+  load.active = clients;
+  load.start = g_get_monotonic_time ();
+  for (i = 0; i < (guint) clients; i++) {
+    c[i].load = &load;
+    g_idle_add (melo_load_client_next_cb, &c[i]);
+  }
+  g_timeout_add_seconds (duration, melo_load_stop, &load);
+
+  /* Run until all clients are done */
+  g_main_loop_run (load.loop);
+  g_main_loop_unref (load.loop);
+
+  /* Print report */
+  melo_load_report (&load);
+
+  /* Free resources */
+  for (i = 0; i < (guint) clients; i++)
+    g_free (c[i].token);
+  g_free (c);
+  for (i = 0; i < MELO_LOAD_ACTION_COUNT; i++)
+    g_array_free (load.stats[i].latencies, TRUE);
+  g_ptr_array_free (load.players, TRUE);
+  g_ptr_array_free (load.covers, TRUE);
+  g_object_unref (load.session);
+  g_free (load.rpc_url);
+  g_free (load.url);
+
+  return 0;
+}
@@ -1012,7 +1012,7 @@ function melo_network_scan_wifi(iface, element)
     if (response.error || !response.result)
       return;
 
-    var list = response.result;
+    var list = response.result.aps;
 
     /* Fill list */
     element.html("");